@@ -262,6 +262,7 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    cJSON_bool insitu; /* content is mutable and owned by the caller; strings are unescaped in place */
 } parse_buffer;
 
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
@@ -286,6 +287,51 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         return false;
     }
 
+    /* Fast path for plain integers (expiry timestamps, intervals, counters):
+     * no locale handling and no strtod round trip through a copy buffer.
+     * Falls through to the general path for anything with a fraction, an
+     * exponent or more than 18 digits. */
+    {
+        size_t fast_i = 0;
+        size_t digits = 0;
+        cJSON_bool negative = false;
+        unsigned long long integer = 0;
+
+        if (can_access_at_index(input_buffer, fast_i) && (buffer_at_offset(input_buffer)[fast_i] == '-'))
+        {
+            negative = true;
+            fast_i++;
+        }
+        while ((digits < 18) && can_access_at_index(input_buffer, fast_i) && (buffer_at_offset(input_buffer)[fast_i] >= '0') && (buffer_at_offset(input_buffer)[fast_i] <= '9'))
+        {
+            integer = (integer * 10) + (unsigned long long)(buffer_at_offset(input_buffer)[fast_i] - '0');
+            digits++;
+            fast_i++;
+        }
+        if ((digits > 0) && (cannot_access_at_index(input_buffer, fast_i) || ((buffer_at_offset(input_buffer)[fast_i] != '.') && (buffer_at_offset(input_buffer)[fast_i] != 'e') && (buffer_at_offset(input_buffer)[fast_i] != 'E') && ((buffer_at_offset(input_buffer)[fast_i] < '0') || (buffer_at_offset(input_buffer)[fast_i] > '9')))))
+        {
+            item->valuedouble = negative ? -((double)integer) : (double)integer;
+
+            /* use saturation in case of overflow, like the strtod path */
+            if (!negative && (integer >= (unsigned long long)INT_MAX))
+            {
+                item->valueint = INT_MAX;
+            }
+            else if (negative && (integer >= ((unsigned long long)INT_MAX) + 1))
+            {
+                item->valueint = INT_MIN;
+            }
+            else
+            {
+                item->valueint = negative ? -((int)integer) : (int)integer;
+            }
+
+            item->type = cJSON_Number;
+            input_buffer->offset += fast_i;
+            return true;
+        }
+    }
+
     /* copy the number into a temporary buffer and replace '.' with the decimal point
      * of the current locale (for strtod)
      * This also takes care of '\0' not necessarily being available for marking the end of the input */
@@ -704,6 +750,31 @@ fail:
     return 0;
 }
 
+/* Advance over string bytes that are neither a quote nor a backslash,
+ * eight at a time (SWAR): a byte of the word is zero exactly where it
+ * matches the broadcast pattern, and (x - 0x01..) & ~x & 0x80.. has a high
+ * bit set exactly where a byte of x is zero. */
+static const unsigned char *skip_plain_string_bytes(const unsigned char *pointer, const unsigned char * const end)
+{
+    const unsigned long long ones = 0x0101010101010101ULL;
+    const unsigned long long highs = 0x8080808080808080ULL;
+    const unsigned long long quotes = 0x2222222222222222ULL; /* '\"' */
+    const unsigned long long backslashes = 0x5C5C5C5C5C5C5C5CULL; /* '\\' */
+
+    while ((size_t)(end - pointer) >= sizeof(unsigned long long))
+    {
+        unsigned long long word;
+        memcpy(&word, pointer, sizeof(word));
+        if ((((word ^ quotes) - ones) & ~(word ^ quotes) & highs) | (((word ^ backslashes) - ones) & ~(word ^ backslashes) & highs))
+        {
+            break;
+        }
+        pointer += sizeof(word);
+    }
+
+    return pointer;
+}
+
 /* Parse the input text into an unescaped cinput, and populate item. */
 static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -724,6 +795,12 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         size_t skipped_bytes = 0;
         while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
         {
+            /* skip runs of plain bytes word-at-a-time */
+            input_end = skip_plain_string_bytes(input_end, input_buffer->content + input_buffer->length);
+            if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end == '\"'))
+            {
+                break;
+            }
             /* is escape sequence */
             if (input_end[0] == '\\')
             {
@@ -742,12 +819,22 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
             goto fail; /* string ended unexpectedly */
         }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
-        if (output == NULL)
+        if (input_buffer->insitu)
         {
-            goto fail; /* allocation failure */
+            /* unescape in place: escape sequences only ever shrink, so writing
+             * forward from the first content byte can never overtake the read
+             * pointer */
+            output = (unsigned char*)input_pointer;
+        }
+        else
+        {
+            /* This is at most how much we need for the output */
+            allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+            output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
         }
     }
 
@@ -757,7 +844,13 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     {
         if (*input_pointer != '\\')
         {
-            *output_pointer++ = *input_pointer++;
+            /* bulk-copy the run up to the next escape sequence; memmove
+             * because in situ output overlaps the input */
+            const unsigned char *next_escape = (const unsigned char*)memchr(input_pointer, '\\', (size_t)(input_end - input_pointer));
+            size_t run_length = (size_t)((next_escape != NULL ? next_escape : input_end) - input_pointer);
+            memmove(output_pointer, input_pointer, run_length);
+            output_pointer += run_length;
+            input_pointer += run_length;
         }
         /* escape sequence */
         else
@@ -811,7 +904,9 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     /* zero terminate the output */
     *output_pointer = '\0';
 
-    item->type = cJSON_String;
+    /* an in situ string borrows the parsed buffer, so cJSON_Delete must not
+     * free it */
+    item->type = input_buffer->insitu ? (cJSON_String | cJSON_IsReference) : cJSON_String;
     item->valuestring = (char*)output;
 
     input_buffer->offset = (size_t) (input_end - input_buffer->content);
@@ -820,7 +915,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && !input_buffer->insitu)
     {
         input_buffer->hooks.deallocate(output);
     }
@@ -1092,6 +1187,86 @@ CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
     return cJSON_ParseWithOpts(value, 0, 0);
 }
 
+/* Parse a mutable, cJSON_malloc allocated buffer in place: string keys and
+ * values point into the buffer with escape sequences fixed up in situ, instead
+ * of being copied. On success the returned item takes ownership of the buffer
+ * and frees it on cJSON_Delete; on failure the buffer stays with the caller. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseInSitu(char *buffer)
+{
+    parse_buffer input = { 0, 0, 0, 0, { 0, 0, 0 }, 0 };
+    cJSON *item = NULL;
+
+    /* reset error position */
+    global_error.json = NULL;
+    global_error.position = 0;
+
+    if (buffer == NULL)
+    {
+        goto fail;
+    }
+
+    input.content = (const unsigned char*)buffer;
+    input.length = strlen(buffer) + sizeof("");
+    input.offset = 0;
+    input.hooks = global_hooks;
+    input.insitu = true;
+
+    item = cJSON_New_Item(&global_hooks);
+    if (item == NULL) /* memory fail */
+    {
+        goto fail;
+    }
+
+    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&input))))
+    {
+        /* parse failure. ep is set. */
+        goto fail;
+    }
+
+    /* hand ownership of the buffer to the root item, so that cJSON_Delete
+     * releases it together with the tree */
+    if (item->valuestring == NULL)
+    {
+        item->valuestring = buffer;
+    }
+    else
+    {
+        /* the root itself is a string borrowing the buffer; move it to the
+         * front so the buffer can be owned (and freed) through valuestring */
+        memmove(buffer, item->valuestring, strlen(item->valuestring) + sizeof(""));
+        item->valuestring = buffer;
+        item->type &= ~cJSON_IsReference;
+    }
+
+    return item;
+
+fail:
+    if (item != NULL)
+    {
+        cJSON_Delete(item);
+    }
+
+    if (buffer != NULL)
+    {
+        error local_error;
+        local_error.json = (const unsigned char*)buffer;
+        local_error.position = 0;
+
+        if (input.offset < input.length)
+        {
+            local_error.position = input.offset;
+        }
+        else if (input.length > 0)
+        {
+            local_error.position = input.length - 1;
+        }
+
+        global_error = local_error;
+    }
+
+    return NULL;
+}
+
 #define cjson_min(a, b) ((a < b) ? a : b)
 
 static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
@@ -1572,6 +1747,12 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
         /* swap valuestring and string, because we parsed the name */
         current_item->string = current_item->valuestring;
         current_item->valuestring = NULL;
+        if (input_buffer->insitu)
+        {
+            /* protect the borrowed key already, in case parsing the value
+             * fails and the item is deleted */
+            current_item->type |= cJSON_StringIsConst;
+        }
 
         if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
         {
@@ -1586,6 +1767,12 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
             goto fail; /* failed to parse value */
         }
         buffer_skip_whitespace(input_buffer);
+        if (input_buffer->insitu)
+        {
+            /* the key points into the parsed buffer and must not be freed;
+             * set after parse_value, which overwrites the type */
+            current_item->type |= cJSON_StringIsConst;
+        }
     }
     while (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','));
 
@@ -2593,11 +2780,14 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
     }
     if (item->string)
     {
-        newitem->string = (item->type&cJSON_StringIsConst) ? item->string : (char*)cJSON_strdup((unsigned char*)item->string, &global_hooks);
+        /* always copy the key, so that the duplicate is self contained even
+         * if the original borrows its key (e.g. from an in situ parse) */
+        newitem->string = (char*)cJSON_strdup((unsigned char*)item->string, &global_hooks);
         if (!newitem->string)
         {
             goto fail;
         }
+        newitem->type &= ~cJSON_StringIsConst;
     }
     /* If non-recursive, then we're done! */
     if (!recurse)
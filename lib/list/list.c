@@ -36,7 +36,7 @@ void list_destroy(list_t* self) {
     next = curr->next;
     if (self->free)
       self->free(curr->val);
-    LIST_FREE(curr);
+    list_node_free(curr);
     curr = next;
   }
 
@@ -134,24 +134,20 @@ list_node_t* list_lpush(list_t* self, list_node_t* node) {
  */
 
 list_node_t* list_find(list_t* self, const void* val) {
-  list_iterator_t* it = list_iterator_new(self, LIST_HEAD);
-  list_node_t*     node;
+  list_node_t* node;
 
-  while ((node = list_iterator_next(it))) {
+  LIST_FOREACH(self, node) {
     if (self->match) {
       if (self->match(val, node->val)) {
-        list_iterator_destroy(it);
         return node;
       }
     } else {
       if (val == node->val) {
-        list_iterator_destroy(it);
         return node;
       }
     }
   }
 
-  list_iterator_destroy(it);
   return NULL;
 }
 
@@ -190,6 +186,6 @@ void list_remove(list_t* self, list_node_t* node) {
   if (self->free)
     self->free(node->val);
 
-  LIST_FREE(node);
+  list_node_free(node);
   --self->len;
 }
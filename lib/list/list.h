@@ -65,10 +65,27 @@ typedef struct {
   list_direction_t direction;
 } list_iterator_t;
 
+/*
+ * Stack-based traversal needing no heap allocation.
+ *
+ *   list_node_t* node;
+ *   LIST_FOREACH(list, node) { use(node->val); }
+ *
+ * The successor is read before the body runs, so removing the current
+ * node from the list inside the body is safe.
+ */
+#define LIST_FOREACH(list, node)                                       \
+  for (list_node_t* _lf_next = ((node) = (list) ? (list)->head : NULL, \
+                               (node) ? (node)->next : NULL);          \
+       (node) != NULL; (node) = _lf_next,                              \
+                      _lf_next = (node) ? (node)->next : NULL)
+
 // Node prototypes.
 
 list_node_t* list_node_new(void* val);
 
+void list_node_free(list_node_t* node);
+
 // list_t prototypes.
 
 list_t* list_new();
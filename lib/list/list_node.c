@@ -7,6 +7,20 @@
 
 #include "list.h"
 
+/*
+ * Thread-local free list of nodes. Nodes are the most frequent small
+ * allocation of the library's users; keeping freed ones around turns
+ * list_node_new/list_node_free into pointer swaps on hot paths. The pool
+ * links spare nodes through their next pointer.
+ */
+
+#ifndef LIST_NODE_POOL_MAX
+#define LIST_NODE_POOL_MAX 128
+#endif
+
+static __thread list_node_t *node_pool = NULL;
+static __thread unsigned int node_pool_len = 0;
+
 /*
  * Allocates a new list_node_t. NULL on failure.
  */
@@ -14,10 +28,34 @@
 list_node_t *
 list_node_new(void *val) {
   list_node_t *self;
-  if (!(self = LIST_MALLOC(sizeof(list_node_t))))
+  if (node_pool) {
+    self = node_pool;
+    node_pool = self->next;
+    node_pool_len--;
+  } else if (!(self = LIST_MALLOC(sizeof(list_node_t)))) {
     return NULL;
+  }
   self->prev = NULL;
   self->next = NULL;
   self->val = val;
   return self;
+}
+
+/*
+ * Free the node, keeping it for reuse while the pool has room.
+ */
+
+void
+list_node_free(list_node_t *node) {
+  if (!node)
+    return;
+  if (node_pool_len >= LIST_NODE_POOL_MAX) {
+    LIST_FREE(node);
+    return;
+  }
+  node->prev = NULL;
+  node->val = NULL;
+  node->next = node_pool;
+  node_pool = node;
+  node_pool_len++;
 }
\ No newline at end of file
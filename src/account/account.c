@@ -6,10 +6,12 @@
 #include "utils/file_io/fileUtils.h"
 #include "utils/file_io/file_io.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/file_io/oidc_index.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/matcher.h"
+#include "utils/secure_compare.h"
 
 /**
  * @brief compares two accounts by their name.
@@ -30,12 +32,75 @@ int account_matchByName(const struct oidc_account* p1,
  */
 int account_matchByState(const struct oidc_account* p1,
                          const struct oidc_account* p2) {
-  return matchStrings(account_getUsedState(p1), account_getUsedState(p2));
+  // states gate auth code flows; compare without early exit
+  return strsecequal(account_getUsedState(p1), account_getUsedState(p2));
 }
 
 int account_matchByIssuerUrl(const struct oidc_account* p1,
                              const struct oidc_account* p2) {
-  return matchUrls(account_getIssuerUrl(p1), account_getIssuerUrl(p2));
+  return issuer_urlsEqual(account_getIssuer(p1), account_getIssuer(p2));
+}
+
+/*
+ * Parsed pubclients.config index: the file is split into
+ * client_id/client_secret/issuer entries once and only re-parsed when its
+ * (cached) content changes, so pubclient resolution is a plain walk over
+ * the index.
+ */
+
+struct pubClientEntry {
+  char* client_id;
+  char* client_secret;
+  char* issuer;
+};
+
+static list_t* pub_clients     = NULL;
+static char*   pub_clients_src = NULL;
+
+static void _secFreePubClientEntry(struct pubClientEntry* entry) {
+  secFree(entry->client_id);
+  secFree(entry->client_secret);
+  secFree(entry->issuer);
+  secFree(entry);
+}
+
+static void _pubClientsEnsure() {
+  char* content = readFileCached(ETC_PUBCLIENTS_CONFIG_FILE);
+  if (pub_clients != NULL && strequal(content, pub_clients_src)) {
+    secFree(content);
+    return;
+  }
+  secFreeList(pub_clients);
+  pub_clients       = list_new();
+  pub_clients->free = (void (*)(void*)) & _secFreePubClientEntry;
+  if (content == NULL) {
+    secFree(pub_clients_src);
+    pub_clients_src = NULL;
+    return;
+  }
+  char*            copy  = oidc_strcopy(content);
+  list_t*          lines = delimitedStringToViewList(copy, '\n');
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(lines, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    char* client = strtok(node->val, "@");
+    char* iss    = strtok(NULL, "@");
+    if (client == NULL || iss == NULL) {
+      continue;
+    }
+    char* client_id     = strtok(client, ":");
+    char* client_secret = strtok(NULL, ":");
+    struct pubClientEntry* entry = secAlloc(sizeof(struct pubClientEntry));
+    entry->client_id             = oidc_strcopy(client_id);
+    entry->client_secret         = oidc_strcopy(client_secret);
+    entry->issuer                = oidc_strcopy(iss);
+    list_rpush(pub_clients, list_node_new(entry));
+  }
+  list_iterator_destroy(it);
+  list_destroy(lines);
+  secFree(copy);
+  secFree(pub_clients_src);
+  pub_clients_src = content;
 }
 
 /**
@@ -50,24 +115,20 @@ struct oidc_account* updateAccountWithPublicClientInfo(
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  char*   issuer_url     = account_getIssuerUrl(account);
-  list_t* pubClientLines = getLinesFromFile(ETC_PUBCLIENTS_CONFIG_FILE);
-  if (pubClientLines == NULL) {
+  char* issuer_url = account_getIssuerUrl(account);
+  _pubClientsEnsure();
+  if (pub_clients_src == NULL) {  // pubclients file could not be read
     return NULL;
   }
   list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(pubClientLines, LIST_HEAD);
+  list_iterator_t* it = list_iterator_new(pub_clients, LIST_HEAD);
   while ((node = list_iterator_next(it))) {
-    char* client = strtok(node->val, "@");
-    char* iss    = strtok(NULL, "@");
-    // logger(DEBUG, "Found public client for '%s'", iss);
-    if (compIssuerUrls(issuer_url, iss)) {
-      char* client_id     = strtok(client, ":");
-      char* client_secret = strtok(NULL, ":");
-      account_setClientId(account, oidc_strcopy(client_id));
-      account_setClientSecret(account, oidc_strcopy(client_secret));
+    struct pubClientEntry* entry = node->val;
+    if (compIssuerUrls(issuer_url, entry->issuer)) {
+      account_setClientId(account, oidc_strcopy(entry->client_id));
+      account_setClientSecret(account, oidc_strcopy(entry->client_secret));
       logger(DEBUG, "Using public client with id '%s' and secret '%s'",
-             client_id, client_secret);
+             entry->client_id, entry->client_secret);
       list_t* redirect_uris =
           createList(0, "http://localhost:8080", "http://localhost:4242",
                      "http://localhost:43985", NULL);
@@ -77,7 +138,6 @@ struct oidc_account* updateAccountWithPublicClientInfo(
     }
   }
   list_iterator_destroy(it);
-  list_destroy(pubClientLines);
   return account;
 }
 
@@ -92,13 +152,125 @@ struct oidc_account* getAccountFromJSON(const char* json) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  // the account retains the DOM beyond this call, so it must not live in
+  // the per-request json arena
+  int    arenaState = jsonArena_pause();
+  cJSON* cjson      = stringToJson(json);
+  jsonArena_resume(arenaState);
+  if (cjson == NULL) {
+    return NULL;
+  }
+  struct oidc_account* p   = secAlloc(sizeof(struct oidc_account));
+  struct oidc_issuer*  iss = secAlloc(sizeof(struct oidc_issuer));
+  // issuer and shortname are needed by practically every consumer (issuer
+  // config lookup, db matching, logging) and are materialized eagerly; the
+  // remaining fields are materialized from the retained json view on first
+  // access through the account_get* accessors
+  char* issuer_url = getJSONValue(cjson, AGENT_KEY_ISSUERURL);
+  issuer_setIssuerUrl(iss, issuer_url ?: getJSONValue(cjson, OIDC_KEY_ISSUER));
+  char* daeSetByUser = getJSONValue(cjson, AGENT_KEY_DAESETBYUSER);
+  issuer_setDeviceAuthorizationEndpoint(
+      iss, getJSONValue(cjson, OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT),
+      strToInt(daeSetByUser));
+  secFree(daeSetByUser);
+  account_setIssuer(p, iss);
+  account_setName(p, getJSONValue(cjson, AGENT_KEY_SHORTNAME), NULL);
+  p->source = cjson;
+  p->materialized &=
+      ~ACCOUNT_FIELD_CLIENTNAME;  // the json value wins over the client
+                                  // name derived from the shortname
+  return p;
+}
+
+/**
+ * @brief materializes one lazily deserialized account field
+ *
+ * No-op if the account has no retained json view or the field was already
+ * materialized or explicitly set.
+ * @param p the account
+ * @param field the ACCOUNT_FIELD_* bit of the field to materialize
+ */
+void account_materialize(struct oidc_account* p, unsigned short field) {
+  if (p == NULL || p->source == NULL || p->materialized & field) {
+    return;
+  }
+  p->materialized |= field;
+  switch (field) {
+    case ACCOUNT_FIELD_CLIENTID:
+      account_setClientId(p, getJSONValue(p->source, OIDC_KEY_CLIENTID));
+      break;
+    case ACCOUNT_FIELD_CLIENTSECRET:
+      account_setClientSecret(p,
+                              getJSONValue(p->source, OIDC_KEY_CLIENTSECRET));
+      break;
+    case ACCOUNT_FIELD_USERNAME:
+      account_setUsername(p, getJSONValue(p->source, OIDC_KEY_USERNAME));
+      break;
+    case ACCOUNT_FIELD_PASSWORD:
+      account_setPassword(p, getJSONValue(p->source, OIDC_KEY_PASSWORD));
+      break;
+    case ACCOUNT_FIELD_REFRESHTOKEN:
+      account_setRefreshToken(p,
+                              getJSONValue(p->source, OIDC_KEY_REFRESHTOKEN));
+      break;
+    case ACCOUNT_FIELD_CERTPATH:
+      account_setCertPath(p, getJSONValue(p->source, AGENT_KEY_CERTPATH));
+      break;
+    case ACCOUNT_FIELD_SCOPE:
+      account_setScopeExact(p, getJSONValue(p->source, OIDC_KEY_SCOPE));
+      break;
+    case ACCOUNT_FIELD_CLIENTNAME:
+      account_setClientName(p, getJSONValue(p->source, OIDC_KEY_CLIENTNAME));
+      break;
+    case ACCOUNT_FIELD_REDIRECTURIS:
+      account_setRedirectUris(
+          p, JSONArrayToList(getJSONItem(p->source, OIDC_KEY_REDIRECTURIS)));
+      break;
+  }
+}
+
+/**
+ * @brief materializes all remaining lazy fields and drops the json view
+ *
+ * Has to be called before an account becomes long-lived (e.g. is added to
+ * the account db), so no unencrypted copy of its secrets is kept around in
+ * the json view.
+ */
+void account_materializeAll(struct oidc_account* p) {
+  if (p == NULL || p->source == NULL) {
+    return;
+  }
+  for (unsigned short field = ACCOUNT_FIELD_CLIENTID;
+       field <= ACCOUNT_FIELD_REDIRECTURIS; field <<= 1) {
+    account_materialize(p, field);
+  }
+  secFreeJson(p->source);
+}
+
+/**
+ * @brief parses an account from an already parsed json object
+ *
+ * Used on the agent hot path where the request was already parsed into a
+ * DOM, so the embedded account is not parsed a second time.
+ * @param cjson the json object describing the account
+ * @return a pointer a the oidc_account. Has to be freed after usage. On
+ * failure NULL is returned.
+ */
+struct oidc_account* getAccountFromCJSON(const cJSON* cjson) {
+  if (NULL == cjson) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
   INIT_KEY_VALUE(AGENT_KEY_ISSUERURL, OIDC_KEY_ISSUER, AGENT_KEY_SHORTNAME,
                  OIDC_KEY_CLIENTID, OIDC_KEY_CLIENTSECRET, OIDC_KEY_USERNAME,
                  OIDC_KEY_PASSWORD, OIDC_KEY_REFRESHTOKEN, AGENT_KEY_CERTPATH,
                  OIDC_KEY_REDIRECTURIS, OIDC_KEY_SCOPE,
                  OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT, OIDC_KEY_CLIENTNAME,
                  AGENT_KEY_DAESETBYUSER);
-  GET_JSON_VALUES_RETURN_NULL_ONERROR(json);
+  if (CALL_GETJSONVALUES_FROM_CJSON(cjson) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
   KEY_VALUE_VARS(issuer_url, issuer, shortname, client_id, client_secret,
                  username, password, refresh_token, cert_path, redirect_uris,
                  scope, device_authorization_endpoint, clientname,
@@ -231,6 +403,7 @@ void secFreeAccountContent(struct oidc_account* p) {
   account_setCertPath(p, NULL);
   account_setRedirectUris(p, NULL);
   account_setUsedState(p, NULL);
+  secFreeJson(p->source);
 }
 
 /** int accountconfigExists(const char* accountname)
@@ -239,6 +412,10 @@ void secFreeAccountContent(struct oidc_account* p) {
  * @return 1 if the configuration exists, 0 if not
  */
 int accountConfigExists(const char* accountname) {
+  int indexed = oidcIndex_accountExists(accountname);
+  if (indexed >= 0) {  // answered from the index without touching the dir
+    return indexed;
+  }
   return oidcFileDoesExist(accountname);
 }
 
@@ -295,6 +472,117 @@ char* defineUsableScopes(const struct oidc_account* account) {
   return usable;
 }
 
+static int _compareScopeTokens(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief builds the account's pre-tokenized scope set if not cached
+ *
+ * The scope string is split once into a privately owned buffer and the
+ * token views are sorted, so request-time scope comparisons are plain
+ * walks without any allocation or list handling. The cache is invalidated
+ * whenever the scope string changes (see @c account_setScopeExact ).
+ */
+static void _scopeTokensEnsure(struct oidc_account* p) {
+  if (p->scope_tokens != NULL) {
+    return;
+  }
+  const char* scope = account_getScope(p);
+  if (!strValid(scope)) {
+    return;
+  }
+  char*  buf   = oidc_strcopy(scope);
+  size_t count = 0;
+  for (char* t = strtok(buf, " "); t != NULL; t = strtok(NULL, " ")) {
+    count++;
+  }
+  if (count == 0) {
+    secFree(buf);
+    return;
+  }
+  char** tokens = secAlloc(count * sizeof(char*));
+  char*  pos    = buf;
+  for (size_t i = 0; i < count; i++) {
+    while (*pos == '\0' || *pos == ' ') {  // strtok's terminators and any
+                                           // delimiter runs it skipped
+      pos++;
+    }
+    tokens[i] = pos;
+    pos += strlen(pos);
+  }
+  qsort(tokens, count, sizeof(char*), _compareScopeTokens);
+  p->scope_tokens      = tokens;
+  p->scope_tokens_buf  = buf;
+  p->scope_token_count = count;
+}
+
+/**
+ * @brief checks if a space delimited scope list names exactly the
+ * account's scope set
+ *
+ * Order and duplicates do not matter. Works on the cached pre-tokenized
+ * set, walking the given list once and binary searching each entry, so a
+ * per-request comparison costs no allocation.
+ * @return 1 if the scope sets are equal; 0 otherwise
+ */
+int account_scopeSetEquals(struct oidc_account* p, const char* scope_list) {
+  _scopeTokensEnsure(p);
+  if (p->scope_tokens == NULL || !strValid(scope_list)) {
+    return 0;
+  }
+  size_t         n              = p->scope_token_count;
+  unsigned char  stack_seen[64] = {0};
+  unsigned char* seen = n <= sizeof(stack_seen) ? stack_seen : secAlloc(n);
+  int            equal = 1;
+  const char*    q     = scope_list;
+  while (*q != '\0') {
+    while (*q == ' ') { q++; }
+    if (*q == '\0') {
+      break;
+    }
+    const char* start = q;
+    while (*q != '\0' && *q != ' ') { q++; }
+    size_t len   = q - start;
+    size_t lo    = 0;
+    size_t hi    = n;
+    long   found = -1;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      int    cmp = strncmp(p->scope_tokens[mid], start, len);
+      if (cmp == 0 && p->scope_tokens[mid][len] != '\0') {
+        cmp = 1;  // the account token only starts with the entry
+      }
+      if (cmp == 0) {
+        found = mid;
+        break;
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (found < 0) {
+      equal = 0;
+      break;
+    }
+    seen[found] = 1;
+  }
+  if (equal) {
+    for (size_t i = 0; i < n; i++) {
+      if (!seen[i]) {  // the list misses one of the account's scopes
+        equal = 0;
+        break;
+      }
+    }
+  }
+  if (seen != stack_seen) {
+    secFree(seen);
+  }
+  return equal;
+}
+
 void stringifyIssuerUrl(struct oidc_account* account) {
   account_setIssuerUrl(account,
                        withTrailingSlash(account_getIssuerUrl(account)));
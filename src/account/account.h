@@ -15,12 +15,20 @@ struct token {
 };
 
 struct oidc_account {
+  cJSON* source;  // retained json view; fields still NULL here are
+                  // materialized from it on first access
+  unsigned short      materialized;  // ACCOUNT_FIELD_* bits
   struct oidc_issuer* issuer;
   char*               shortname;
   char*               clientname;
   char*               client_id;
   char*               client_secret;
   char*               scope;
+  char**              scope_tokens;  // lazily built sorted views into
+                                     // scope_tokens_buf; invalidated whenever
+                                     // the scope string changes
+  size_t              scope_token_count;
+  char*               scope_tokens_buf;
   char*               username;
   char*               password;
   char*               refresh_token;
@@ -30,16 +38,35 @@ struct oidc_account {
   char*               usedState;
   unsigned char       usedStateChecked;
   time_t              death;
+  time_t              last_used;
+  unsigned long       used_count;
   char*               code_challenge_method;
   unsigned char       mode;
+  unsigned char       plain_depth;  // nesting depth of open decrypted
+                                    // windows; see _db_decryptFoundAccount
 };
 
 #define ACCOUNT_MODE_CONFIRM 0x01
 #define ACCOUNT_MODE_NO_WEBSERVER 0x02
 #define ACCOUNT_MODE_NO_SCHEME 0x04
 
+// fields that are materialized lazily from a retained json view
+#define ACCOUNT_FIELD_CLIENTID 0x0001
+#define ACCOUNT_FIELD_CLIENTSECRET 0x0002
+#define ACCOUNT_FIELD_USERNAME 0x0004
+#define ACCOUNT_FIELD_PASSWORD 0x0008
+#define ACCOUNT_FIELD_REFRESHTOKEN 0x0010
+#define ACCOUNT_FIELD_CERTPATH 0x0020
+#define ACCOUNT_FIELD_SCOPE 0x0040
+#define ACCOUNT_FIELD_CLIENTNAME 0x0080
+#define ACCOUNT_FIELD_REDIRECTURIS 0x0100
+
 char*                defineUsableScopes(const struct oidc_account* account);
+int account_scopeSetEquals(struct oidc_account* p, const char* scope_list);
 struct oidc_account* getAccountFromJSON(const char* json);
+struct oidc_account* getAccountFromCJSON(const cJSON* cjson);
+void account_materialize(struct oidc_account* p, unsigned short field);
+void account_materializeAll(struct oidc_account* p);
 cJSON*               accountToJSON(const struct oidc_account* p);
 char*                accountToJSONString(const struct oidc_account* p);
 cJSON* accountToJSONWithoutCredentials(const struct oidc_account* p);
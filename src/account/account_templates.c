@@ -0,0 +1,105 @@
+#include "account_templates.h"
+#include "account/issuer_helper.h"
+#include "account/setandget.h"
+#include "defines/agent_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/*
+ * Site-provided account templates: the account_templates.config file is a
+ * json object mapping an issuer url to a template object whose keys are
+ * account config keys (scope, cert_path, client_name, redirect_uris). The
+ * file is parsed once into a cached DOM and only re-parsed when its (cached)
+ * content changes, so applying a template is a lookup plus a few setters
+ * instead of rebuilding every field - and site-wide defaults can change
+ * without touching code.
+ */
+
+static cJSON* templates     = NULL;
+static char*  templates_src = NULL;
+
+static void _templatesEnsure() {
+  char* content = readFileCached(ETC_ACCOUNT_TEMPLATES_CONFIG_FILE);
+  if (templates_src != NULL && strequal(content, templates_src)) {
+    secFree(content);
+    return;
+  }
+  secFreeJson(templates);
+  templates = NULL;
+  secFree(templates_src);
+  templates_src = NULL;
+  if (content == NULL) {
+    return;
+  }
+  templates = stringToJson(content);
+  if (templates == NULL) {
+    logger(WARNING, "could not parse '%s'",
+           ETC_ACCOUNT_TEMPLATES_CONFIG_FILE);
+  }
+  templates_src = content;
+}
+
+/**
+ * @brief fills unset account fields from the site template for its issuer.
+ * Only fields the user has not set yet are filled, so template values become
+ * the defaults shown in the prompts and explicit input always wins. Does
+ * nothing if there is no template file or no template for the issuer.
+ * @param account the account to be filled
+ */
+void accountTemplate_apply(struct oidc_account* account) {
+  if (account == NULL) {
+    return;
+  }
+  _templatesEnsure();
+  if (templates == NULL) {
+    return;
+  }
+  cJSON* tmpl = NULL;
+  for (cJSON* it = templates->child; it != NULL; it = it->next) {
+    if (compIssuerUrls(it->string, account_getIssuerUrl(account))) {
+      tmpl = it;
+      break;
+    }
+  }
+  if (tmpl == NULL) {
+    return;
+  }
+  logger(DEBUG, "applying account template for issuer '%s'",
+         account_getIssuerUrl(account));
+  if (!strValid(account_getScope(account))) {
+    char* scope = getJSONValue(tmpl, OIDC_KEY_SCOPE);
+    if (strValid(scope)) {
+      account_setScope(account, scope);
+    } else {
+      secFree(scope);
+    }
+  }
+  if (!strValid(account_getCertPath(account))) {
+    char* cert_path = getJSONValue(tmpl, AGENT_KEY_CERTPATH);
+    if (strValid(cert_path)) {
+      account_setCertPath(account, cert_path);
+    } else {
+      secFree(cert_path);
+    }
+  }
+  if (!strValid(account_getClientName(account))) {
+    char* client_name = getJSONValue(tmpl, OIDC_KEY_CLIENTNAME);
+    if (strValid(client_name)) {
+      account_setClientName(account, client_name);
+    } else {
+      secFree(client_name);
+    }
+  }
+  list_t* uris = account_getRedirectUris(account);
+  if (uris == NULL || uris->len == 0) {
+    cJSON* tmpl_uris = getJSONItem(tmpl, OIDC_KEY_REDIRECTURIS);
+    if (tmpl_uris != NULL && !jsonArrayIsEmpty(tmpl_uris)) {
+      account_setRedirectUris(account, JSONArrayToList(tmpl_uris));
+    }
+  }
+}
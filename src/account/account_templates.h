@@ -0,0 +1,8 @@
+#ifndef ACCOUNT_TEMPLATES_H
+#define ACCOUNT_TEMPLATES_H
+
+#include "account/account.h"
+
+void accountTemplate_apply(struct oidc_account* account);
+
+#endif  // ACCOUNT_TEMPLATES_H
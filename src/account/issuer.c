@@ -1,4 +1,8 @@
 #include "issuer.h"
+#include "account/issuer_helper.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
 
 void _secFreeIssuer(struct oidc_issuer* iss) {
   if (!iss) {
@@ -17,3 +21,50 @@ void _secFreeIssuer(struct oidc_issuer* iss) {
   secFree(iss);
   iss = NULL;
 }
+
+/**
+ * @brief (re)computes the cached normalized form of the issuer url
+ * Called by @c issuer_setIssuerUrl whenever the url changes; the normalized
+ * form strips the trailing slash - the only difference @c compIssuerUrls
+ * tolerates - and is stored together with its hash.
+ */
+void issuer_cacheNormalizedUrl(struct oidc_issuer* iss) {
+  if (iss == NULL) {
+    return;
+  }
+  secFree(iss->issuer_url_norm);
+  iss->issuer_url_hash = 0;
+  if (!strValid(iss->issuer_url)) {
+    return;
+  }
+  char*  norm = oidc_strcopy(iss->issuer_url);
+  size_t len  = strlen(norm);
+  if (norm[len - 1] == '/') {
+    norm[len - 1] = '\0';
+  }
+  iss->issuer_url_norm = norm;
+  iss->issuer_url_hash = oidc_strhash(norm);
+}
+
+/**
+ * @brief compares two issuers by their url
+ * Equality follows @c compIssuerUrls : the urls are equal up to a trailing
+ * slash. With both normalized forms cached - the regular case, the cache is
+ * filled on every url set - this is a hash check plus one string comparison;
+ * an issuer built without the cache falls back to the char-wise comparison.
+ * @return @c 1 if equal, @c 0 if not
+ */
+int issuer_urlsEqual(const struct oidc_issuer* a, const struct oidc_issuer* b) {
+  if (a == NULL || b == NULL) {
+    return 0;
+  }
+  if (a->issuer_url_norm == NULL || b->issuer_url_norm == NULL) {
+    return a->issuer_url != NULL && b->issuer_url != NULL
+               ? compIssuerUrls(a->issuer_url, b->issuer_url)
+               : 0;
+  }
+  if (a->issuer_url_hash != b->issuer_url_hash) {
+    return 0;
+  }
+  return strequal(a->issuer_url_norm, b->issuer_url_norm);
+}
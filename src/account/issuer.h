@@ -9,7 +9,12 @@ struct device_authorization_endpoint {
 };
 
 struct oidc_issuer {
-  char* issuer_url;
+  char*         issuer_url;
+  char*         issuer_url_norm;  // issuer_url without the trailing slash;
+                                  // cached together with its hash so url
+                                  // comparisons are a hash check plus one
+                                  // string comparison
+  unsigned long issuer_url_hash;
 
   char*                                configuration_endpoint;
   char*                                token_endpoint;
@@ -23,7 +28,9 @@ struct oidc_issuer {
   char* response_types_supported;  // as json array
 };
 
-void                _secFreeIssuer(struct oidc_issuer* iss);
+void _secFreeIssuer(struct oidc_issuer* iss);
+void issuer_cacheNormalizedUrl(struct oidc_issuer* iss);
+int  issuer_urlsEqual(const struct oidc_issuer* a, const struct oidc_issuer* b);
 inline static char* issuer_getIssuerUrl(struct oidc_issuer* iss) {
   return iss ? iss->issuer_url : NULL;
 };
@@ -67,6 +74,7 @@ inline static void issuer_setIssuerUrl(struct oidc_issuer* iss,
   }
   secFree(iss->issuer_url);
   iss->issuer_url = issuer_url;
+  issuer_cacheNormalizedUrl(iss);
 }
 inline static void issuer_setConfigurationEndpoint(
     struct oidc_issuer* iss, char* configuration_endpoint) {
@@ -5,6 +5,7 @@
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
 #include "defines/settings.h"
+#include "utils/file_io/fileUtils.h"
 #include "utils/file_io/file_io.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
@@ -137,82 +138,203 @@ int compIssuerUrls(const char* a, const char* b) {
   return 0;
 }
 
-void printIssuerHelp(const char* url) {
-  if (!fileDoesExist(ETC_ISSUER_CONFIG_FILE)) {
+/*
+ * Issuer config index. The issuer suggestions and the issuer help used to
+ * re-read and re-parse issuer.config (oidc dir) and /etc issuer.config on
+ * every call. Both files are now parsed once into an in-memory index that is
+ * revalidated against the (cached, cheap) file contents, so a call after an
+ * updateIssuerConfig append picks up the new entry while unchanged files
+ * cost no parsing and no per-entry allocation.
+ *
+ * Entries are kept twice: in file order for the suggestion prompt (the
+ * user's own entries stay on top) and as an array sorted by the normalized
+ * url - trailing slash stripped - so a lookup is a binary search instead of
+ * a linear compIssuerUrls scan over a site file with hundreds of issuers.
+ */
+
+struct issuerConfigEntry {
+  char*         issuer;
+  char*         norm;   // issuer url without trailing slash; the lookup key
+  char*         extra;  // shortname (user file) or "reg_uri contact" (/etc)
+  unsigned char fromEtc;
+};
+
+static struct issuerConfigEntry** issuer_entries  = NULL;  // file order
+static struct issuerConfigEntry** issuer_sorted   = NULL;  // by norm
+static size_t                     issuer_count    = 0;
+static size_t                     issuer_capacity = 0;
+static char*                      issuer_index_user_src = NULL;
+static char*                      issuer_index_etc_src  = NULL;
+
+static void _secFreeIssuerConfigEntry(struct issuerConfigEntry* entry) {
+  secFree(entry->issuer);
+  secFree(entry->norm);
+  secFree(entry->extra);
+  secFree(entry);
+}
+
+static char* _normalizeIssuerUrl(const char* url) {
+  char*  norm = oidc_strcopy(url);
+  size_t len  = strlen(norm);
+  if (len > 0 && norm[len - 1] == '/') {
+    norm[len - 1] = '\0';
+  }
+  return norm;
+}
+
+/**
+ * @brief finds the sorted position of @p norm
+ * @param found set to @c 1 if an entry with this key already exists
+ * @return the index of the existing entry or the insert position
+ */
+static size_t _issuerSortedPos(const char* norm, int* found) {
+  size_t lo = 0;
+  size_t hi = issuer_count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int    cmp = strcmp(issuer_sorted[mid]->norm, norm);
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *found = 0;
+  return lo;
+}
+
+static void _issuerIndexAdd(const char* url, const char* extra,
+                            unsigned char fromEtc) {
+  char*  norm  = _normalizeIssuerUrl(url);
+  int    found = 0;
+  size_t pos   = _issuerSortedPos(norm, &found);
+  if (found) {  // user entries are added first and win over /etc ones
+    secFree(norm);
     return;
   }
-  char* fileContent = readFile(ETC_ISSUER_CONFIG_FILE);
-  char* elem        = strtok(fileContent, "\n");
+  if (issuer_count == issuer_capacity) {
+    issuer_capacity = issuer_capacity ? issuer_capacity * 2 : 32;
+    issuer_entries =
+        secRealloc(issuer_entries, issuer_capacity * sizeof(*issuer_entries));
+    issuer_sorted =
+        secRealloc(issuer_sorted, issuer_capacity * sizeof(*issuer_sorted));
+  }
+  struct issuerConfigEntry* entry = secAlloc(sizeof(struct issuerConfigEntry));
+  entry->issuer                   = oidc_strcopy(url);
+  entry->norm                     = norm;
+  entry->extra                    = extra ? oidc_strcopy(extra) : NULL;
+  entry->fromEtc                  = fromEtc;
+  memmove(issuer_sorted + pos + 1, issuer_sorted + pos,
+          (issuer_count - pos) * sizeof(*issuer_sorted));
+  issuer_sorted[pos]             = entry;
+  issuer_entries[issuer_count++] = entry;
+}
+
+static void _issuerIndexAddFromContent(const char* content,
+                                       unsigned char fromEtc) {
+  if (content == NULL) {
+    return;
+  }
+  char* copy = oidc_strcopy(content);
+  char* elem = strtok(copy, "\n");
   while (elem != NULL) {
     char* space = strchr(elem, ' ');
     if (space) {
       *space = '\0';
     }
-    if (compIssuerUrls(url, elem)) {
-      if (space) {
-        char* reg_uri = space + 1;
-        space         = strchr(reg_uri, ' ');
-        char* contact = NULL;
-        if (space) {
-          *space  = '\0';
-          contact = space + 1;
-        }
-        if (strValid(reg_uri)) {
-          printf("You can try to register a client manually at '%s'\n",
-                 reg_uri);
-        }
-        if (strValid(contact)) {
-          printf("You can contact the OpenID Provider at '%s'\n", contact);
-        }
-      } else {
-        printf(
-            "Unfortunately no contact information were found for issuer '%s'\n",
-            url);
-      }
-      break;
+    if (strValid(elem)) {
+      _issuerIndexAdd(elem, space ? space + 1 : NULL, fromEtc);
     }
     elem = strtok(NULL, "\n");
   }
-  secFree(fileContent);
+  secFree(copy);
 }
 
-list_t* getSuggestableIssuers() {
-  list_t* issuers = list_new();
-  issuers->free   = (void (*)(void*)) & _secFree;
-  issuers->match  = (matchFunction)compIssuerUrls;
+static void _issuerIndexEnsure() {
+  char* user = readOidcFile(ISSUER_CONFIG_FILENAME);
+  char* etc  = readFileCached(ETC_ISSUER_CONFIG_FILE);
+  if (issuer_entries != NULL && strequal(user, issuer_index_user_src) &&
+      strequal(etc, issuer_index_etc_src)) {  // index is current
+    secFree(user);
+    secFree(etc);
+    return;
+  }
+  for (size_t i = 0; i < issuer_count; i++) {
+    _secFreeIssuerConfigEntry(issuer_entries[i]);
+  }
+  secFree(issuer_entries);
+  secFree(issuer_sorted);
+  issuer_entries  = NULL;
+  issuer_sorted   = NULL;
+  issuer_count    = 0;
+  issuer_capacity = 0;
+  _issuerIndexAddFromContent(user, 0);
+  _issuerIndexAddFromContent(etc, 1);
+  secFree(issuer_index_user_src);
+  secFree(issuer_index_etc_src);
+  issuer_index_user_src = user;
+  issuer_index_etc_src  = etc;
+}
 
-  char* fileContent = readOidcFile(ISSUER_CONFIG_FILENAME);
-  if (fileContent) {
-    char* elem = strtok(fileContent, "\n");
-    while (elem != NULL) {
-      char* space = strchr(elem, ' ');
-      if (space) {
-        *space = '\0';
-      }
-      if (findInList(issuers, elem) == NULL) {
-        list_rpush(issuers, list_node_new(oidc_sprintf(elem)));
-      }
-      elem = strtok(NULL, "\n");
-    }
-    secFree(fileContent);
+/**
+ * @brief looks up the index entry for @p url with a binary search
+ * @return the entry or @c NULL; owned by the index
+ */
+static struct issuerConfigEntry* _issuerIndexFind(const char* url) {
+  if (url == NULL) {
+    return NULL;
   }
+  _issuerIndexEnsure();
+  char*  norm  = _normalizeIssuerUrl(url);
+  int    found = 0;
+  size_t pos   = _issuerSortedPos(norm, &found);
+  secFree(norm);
+  return found ? issuer_sorted[pos] : NULL;
+}
 
-  fileContent = readFile(ETC_ISSUER_CONFIG_FILE);
-  if (fileContent) {
-    char* elem = strtok(fileContent, "\n");
-    while (elem != NULL) {
-      char* space = strchr(elem, ' ');
-      if (space) {
-        *space = '\0';
-      }
-      if (findInList(issuers, elem) == NULL) {
-        list_rpush(issuers, list_node_new(oidc_sprintf(elem)));
-      }
-      elem = strtok(NULL, "\n");
-    }
-    secFree(fileContent);
+void printIssuerHelp(const char* url) {
+  struct issuerConfigEntry* entry = _issuerIndexFind(url);
+  if (entry == NULL || !entry->fromEtc) {
+    return;
+  }
+  if (entry->extra == NULL) {
+    printf("Unfortunately no contact information were found for issuer '%s'\n",
+           url);
+    return;
+  }
+  char* extra   = oidc_strcopy(entry->extra);
+  char* reg_uri = extra;
+  char* space   = strchr(extra, ' ');
+  char* contact = NULL;
+  if (space) {
+    *space  = '\0';
+    contact = space + 1;
   }
+  if (strValid(reg_uri)) {
+    printf("You can try to register a client manually at '%s'\n", reg_uri);
+  }
+  if (strValid(contact)) {
+    printf("You can contact the OpenID Provider at '%s'\n", contact);
+  }
+  secFree(extra);
+}
 
+/**
+ * @brief returns the issuers from the user's and the global issuer.config
+ * The returned list holds views into the issuer config index - nothing is
+ * copied; it still has to be freed after usage (the elements must not).
+ */
+list_t* getSuggestableIssuers() {
+  _issuerIndexEnsure();
+  list_t* issuers = list_new();
+  issuers->match  = (matchFunction)compIssuerUrls;
+  for (size_t i = 0; i < issuer_count; i++) {
+    list_rpush(issuers, list_node_new(issuer_entries[i]->issuer));
+  }
   return issuers;
 }
 
@@ -1,5 +1,13 @@
 #include "setandget.h"
 
+/*
+ * Accounts deserialized by getAccountFromJSON() keep the parsed json as
+ * p->source and materialize most fields from it on first access. Getters
+ * of such fields call account_materialize() first; setters mark the field
+ * as materialized so an explicitly set value is never overwritten by the
+ * lazy json view.
+ */
+
 struct oidc_issuer* account_getIssuer(const struct oidc_account* p) {
   return p ? p->issuer : NULL;
 }
@@ -53,30 +61,37 @@ char* account_getName(const struct oidc_account* p) {
 }
 
 char* account_getClientName(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_CLIENTNAME);
   return p ? p->clientname : NULL;
 }
 
 char* account_getClientId(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_CLIENTID);
   return p ? p->client_id : NULL;
 }
 
 char* account_getClientSecret(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_CLIENTSECRET);
   return p ? p->client_secret : NULL;
 }
 
 char* account_getScope(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_SCOPE);
   return p ? p->scope : NULL;
 }
 
 char* account_getUsername(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_USERNAME);
   return p ? p->username : NULL;
 }
 
 char* account_getPassword(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_PASSWORD);
   return p ? p->password : NULL;
 }
 
 char* account_getRefreshToken(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_REFRESHTOKEN);
   return p ? p->refresh_token : NULL;
 }
 
@@ -89,14 +104,17 @@ unsigned long account_getTokenExpiresAt(const struct oidc_account* p) {
 }
 
 char* account_getCertPath(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_CERTPATH);
   return p ? p->cert_path : NULL;
 }
 
 list_t* account_getRedirectUris(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_REDIRECTURIS);
   return p ? p->redirect_uris : NULL;
 }
 
 size_t account_getRedirectUrisCount(const struct oidc_account* p) {
+  account_materialize((struct oidc_account*)p, ACCOUNT_FIELD_REDIRECTURIS);
   return p ? p->redirect_uris ? p->redirect_uris->len : 0 : 0;
 }
 
@@ -108,6 +126,22 @@ time_t account_getDeath(const struct oidc_account* p) {
   return p ? p->death : 0;
 }
 
+time_t account_getLastUsed(const struct oidc_account* p) {
+  return p ? p->last_used : 0;
+}
+
+unsigned long account_getUsedCount(const struct oidc_account* p) {
+  return p ? p->used_count : 0;
+}
+
+void account_touch(struct oidc_account* p) {
+  if (p == NULL) {
+    return;
+  }
+  p->last_used = time(NULL);
+  p->used_count++;
+}
+
 char* account_getCodeChallengeMethod(const struct oidc_account* p) {
   return p ? p->code_challenge_method : NULL;
 }
@@ -132,7 +166,8 @@ void account_setIssuerUrl(struct oidc_account* p, char* issuer_url) {
 }
 
 void account_setClientName(struct oidc_account* p, char* clientname) {
-  if (p->clientname == clientname) {
+  p->materialized |= ACCOUNT_FIELD_CLIENTNAME;
+    if (p->clientname == clientname) {
     return;
   }
   secFree(p->clientname);
@@ -154,7 +189,8 @@ void account_setName(struct oidc_account* p, char* shortname,
 }
 
 void account_setClientId(struct oidc_account* p, char* client_id) {
-  if (p->client_id == client_id) {
+  p->materialized |= ACCOUNT_FIELD_CLIENTID;
+    if (p->client_id == client_id) {
     return;
   }
   secFree(p->client_id);
@@ -162,7 +198,8 @@ void account_setClientId(struct oidc_account* p, char* client_id) {
 }
 
 void account_setClientSecret(struct oidc_account* p, char* client_secret) {
-  if (p->client_secret == client_secret) {
+  p->materialized |= ACCOUNT_FIELD_CLIENTSECRET;
+    if (p->client_secret == client_secret) {
     return;
   }
   secFree(p->client_secret);
@@ -170,11 +207,16 @@ void account_setClientSecret(struct oidc_account* p, char* client_secret) {
 }
 
 void account_setScopeExact(struct oidc_account* p, char* scope) {
-  if (p->scope == scope) {
+  p->materialized |= ACCOUNT_FIELD_SCOPE;
+    if (p->scope == scope) {
     return;
   }
   secFree(p->scope);
   p->scope = scope;
+  // the pre-tokenized scope set mirrors the scope string
+  secFree(p->scope_tokens);
+  secFree(p->scope_tokens_buf);
+  p->scope_token_count = 0;
 }
 
 void account_setScope(struct oidc_account* p, char* scope) {
@@ -210,7 +252,8 @@ void account_setScopesSupported(struct oidc_account* p,
 }
 
 void account_setUsername(struct oidc_account* p, char* username) {
-  if (p->username == username) {
+  p->materialized |= ACCOUNT_FIELD_USERNAME;
+    if (p->username == username) {
     return;
   }
   secFree(p->username);
@@ -218,7 +261,8 @@ void account_setUsername(struct oidc_account* p, char* username) {
 }
 
 void account_setPassword(struct oidc_account* p, char* password) {
-  if (p->password == password) {
+  p->materialized |= ACCOUNT_FIELD_PASSWORD;
+    if (p->password == password) {
     return;
   }
   secFree(p->password);
@@ -226,7 +270,8 @@ void account_setPassword(struct oidc_account* p, char* password) {
 }
 
 void account_setRefreshToken(struct oidc_account* p, char* refresh_token) {
-  if (p->refresh_token == refresh_token) {
+  p->materialized |= ACCOUNT_FIELD_REFRESHTOKEN;
+    if (p->refresh_token == refresh_token) {
     return;
   }
   secFree(p->refresh_token);
@@ -250,7 +295,8 @@ void account_setTokenExpiresAt(struct oidc_account* p,
 }
 
 void account_setCertPath(struct oidc_account* p, char* cert_path) {
-  if (p->cert_path == cert_path) {
+  p->materialized |= ACCOUNT_FIELD_CERTPATH;
+    if (p->cert_path == cert_path) {
     return;
   }
   secFree(p->cert_path);
@@ -258,7 +304,8 @@ void account_setCertPath(struct oidc_account* p, char* cert_path) {
 }
 
 void account_setRedirectUris(struct oidc_account* p, list_t* redirect_uris) {
-  if (p->redirect_uris == redirect_uris) {
+  p->materialized |= ACCOUNT_FIELD_REDIRECTURIS;
+    if (p->redirect_uris == redirect_uris) {
     return;
   }
   if (p->redirect_uris) {
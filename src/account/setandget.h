@@ -3,6 +3,14 @@
 
 #include "account/account.h"
 
+/*
+ * Ownership contract: the setters take ownership of the passed value (move
+ * semantics) - they free the old value and store the pointer as is, so
+ * callers only copy when handing over borrowed data. The getters return
+ * views owned by the account; they stay valid until the field is set again
+ * or the account is freed and must not be freed by the caller.
+ */
+
 struct oidc_issuer* account_getIssuer(const struct oidc_account* p);
 char*               account_getIssuerUrl(const struct oidc_account* p);
 char*               account_getConfigEndpoint(const struct oidc_account* p);
@@ -29,6 +37,9 @@ list_t*       account_getRedirectUris(const struct oidc_account* p);
 size_t        account_getRedirectUrisCount(const struct oidc_account* p);
 char*         account_getUsedState(const struct oidc_account* p);
 time_t        account_getDeath(const struct oidc_account* p);
+time_t        account_getLastUsed(const struct oidc_account* p);
+unsigned long account_getUsedCount(const struct oidc_account* p);
+void          account_touch(struct oidc_account* p);
 char*         account_getCodeChallengeMethod(const struct oidc_account* p);
 unsigned char account_getConfirmationRequired(const struct oidc_account* p);
 unsigned char account_getNoWebServer(const struct oidc_account* p);
@@ -7,6 +7,9 @@
 #define AGENT_KEY_SHORTNAME "name"
 #define AGENT_KEY_CERTPATH "cert_path"
 #define AGENT_KEY_EXPIRESAT "expires_at"
+#define AGENT_KEY_VALIDFOR "valid_for"
+#define AGENT_KEY_NEXTREQUESTAT "next_request_at"
+#define AGENT_KEY_STALE "stale"
 
 // INTERNAL / CLI FLOW VALUES
 #define FLOW_VALUE_CODE "code"
@@ -18,6 +18,7 @@
 #define IPC_KEY_FLOW "flow"
 #define IPC_KEY_APPLICATIONHINT "application_hint"
 #define IPC_KEY_MINVALID "min_valid_period"
+#define IPC_KEY_DEADLINE "deadline_ms"
 #define IPC_KEY_PASSWORDENTRY "pw_entry"
 #define IPC_KEY_CONFIRM "confirm"
 #define IPC_KEY_REDIRECTEDURI "redirect_uri"
@@ -26,6 +27,16 @@
 #define IPC_KEY_NOSCHEME "no_scheme"
 #define IPC_KEY_ISSUERURL "issuer"
 #define IPC_KEY_MAXSCOPES "max_scopes"
+#define IPC_KEY_METRICS "metrics"
+#define IPC_KEY_TENANT "tenant_uid"
+#define IPC_KEY_ACCOUNTLIST "account_list"
+#define IPC_KEY_TOKENS "tokens"
+#define IPC_KEY_VERSION "version"
+#define IPC_KEY_FEATURES "features"
+#define IPC_KEY_MAXACCOUNTS "max_accounts"
+#define IPC_KEY_PWLIFETIME "pw_lifetime"
+#define IPC_KEY_WAIT "wait"
+#define IPC_KEY_BULKID "bulk_id"
 
 // STATUS
 #define STATUS_SUCCESS "success"
@@ -36,6 +47,7 @@
 
 // REQUEST VALUES
 #define REQUEST_VALUE_ADD "add"
+#define REQUEST_VALUE_BULKADD "bulk_add"
 #define REQUEST_VALUE_GEN "gen"
 #define REQUEST_VALUE_REGISTER "register"
 #define REQUEST_VALUE_REMOVE "remove"
@@ -50,6 +62,17 @@
 #define REQUEST_VALUE_UNLOCK "unlock"
 #define REQUEST_VALUE_CHECK "check"
 #define REQUEST_VALUE_SCOPES "scopes"
+#define REQUEST_VALUE_PREFETCH "prefetch_config"
+#define REQUEST_VALUE_ACCOUNTCONFIG "account_config"
+#define REQUEST_VALUE_METRICS "metrics"
+#define REQUEST_VALUE_ACCOUNTLIST "loaded_accounts"
+#define REQUEST_VALUE_STOREINFO "storeinfo"
+#define REQUEST_VALUE_GENSESSIONKEY "gen_session_key"
+#define REQUEST_VALUE_HANDOFF "handoff"
+#define REQUEST_VALUE_PING "ping"
+#define REQUEST_VALUE_HEALTH "health"
+#define REQUEST_VALUE_RELOAD "reload"
+#define REQUEST_VALUE_CANCEL "cancel_request"
 
 // RESPONSE TEMPLATES
 #define RESPONSE_SUCCESS "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\"}"
@@ -59,6 +82,19 @@
 #define RESPONSE_SUCCESS_INFO                                               \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_INFO "\":\"%" \
   "s\"}"
+#define RESPONSE_SUCCESS_ACCOUNTLIST                               \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_INFO \
+  "\":%s}"
+#define RESPONSE_SUCCESS_STOREINFO                                 \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_INFO \
+  "\":%s}"
+#define RESPONSE_SUCCESS_PING                                         \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_VERSION \
+  "\":\"%s\",\"" IPC_KEY_FEATURES "\":[%s]}"
+#define RESPONSE_SUCCESS_HEALTH                                    \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"uptime\":%lu," \
+  "\"error_responses\":%lu,\"dropped_clients\":%lu,"               \
+  "\"status_age\":%ld,\"agent\":%s}"
 #define RESPONSE_ERROR_CLIENT                                        \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_FAILURE "\",\"" OIDC_KEY_ERROR \
   "\":\"%s\",\"" IPC_KEY_CLIENT "\":%s}"
@@ -72,7 +108,16 @@
 #define RESPONSE_STATUS_ACCESS                             \
   "{\"" IPC_KEY_STATUS "\":\"%s\",\"" OIDC_KEY_ACCESSTOKEN \
   "\":\"%s\",\"" OIDC_KEY_ISSUER "\":\"%s\","              \
-  "\"" AGENT_KEY_EXPIRESAT "\":%lu}"
+  "\"" AGENT_KEY_EXPIRESAT "\":%lu,\"" AGENT_KEY_VALIDFOR  \
+  "\":%lu,\"" AGENT_KEY_NEXTREQUESTAT "\":%lu}"
+#define RESPONSE_STATUS_ACCESS_STALE                       \
+  "{\"" IPC_KEY_STATUS "\":\"%s\",\"" OIDC_KEY_ACCESSTOKEN \
+  "\":\"%s\",\"" OIDC_KEY_ISSUER "\":\"%s\","              \
+  "\"" AGENT_KEY_EXPIRESAT "\":%lu,\"" AGENT_KEY_VALIDFOR  \
+  "\":%lu,\"" AGENT_KEY_NEXTREQUESTAT "\":%lu,\"" AGENT_KEY_STALE "\":true}"
+#define RESPONSE_STATUS_TOKENS                            \
+  "{\"" IPC_KEY_STATUS "\":\"%s\",\"" IPC_KEY_TOKENS \
+  "\":%s}"
 #define RESPONSE_STATUS_REGISTER \
   "{\"" IPC_KEY_STATUS "\":\"%s\",\"response\":%s}"
 #define RESPONSE_STATUS_CODEURI                   \
@@ -94,6 +139,9 @@
   "\":\"Bad Request: %s\"}"
 #define RESPONSE_STATUS_INFO \
   "{\"" IPC_KEY_STATUS "\":\"%s\",\"" IPC_KEY_INFO "\":\"%s\"}"
+#define RESPONSE_STATUS_METRICS                                         \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_METRICS \
+  "\":%s}"
 #define RESPONSE_ACCEPTED_DEVICE                                      \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_ACCEPTED "\",\"" IPC_KEY_DEVICE \
   "\":%s,\"" IPC_KEY_CONFIG "\":%s}"
@@ -134,6 +182,9 @@
 #define REQUEST_STATELOOKUP                               \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_STATELOOKUP \
   "\",\"" OIDC_KEY_STATE "\":\"%s\"}"
+#define REQUEST_STATELOOKUP_WAIT                          \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_STATELOOKUP \
+  "\",\"" OIDC_KEY_STATE "\":\"%s\",\"" IPC_KEY_WAIT "\":1}"
 #define REQUEST_DEVICE                                     \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_DEVICELOOKUP \
   "\",\"" IPC_KEY_DEVICE "\":%s,\"" IPC_KEY_CONFIG "\":%s}"
@@ -143,9 +194,24 @@
 #define REQUEST_LOCK \
   "{\"" IPC_KEY_REQUEST "\":\"%s\",\"" IPC_KEY_PASSWORD "\":\"%s\"}"
 #define REQUEST_CHECK "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_CHECK "\"}"
+#define REQUEST_GENSESSIONKEY \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_GENSESSIONKEY "\"}"
+#define REQUEST_HANDOFF \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_HANDOFF "\"}"
+#define REQUEST_PING "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_PING "\"}"
+#define REQUEST_HEALTH \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_HEALTH "\"}"
+#define REQUEST_CANCEL \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_CANCEL "\"}"
 #define REQUEST_SCOPES                                                         \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_SCOPES "\",\"" IPC_KEY_ISSUERURL \
   "\":\"%s\"}"
+#define REQUEST_PREFETCH                                \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_PREFETCH \
+  "\",\"" IPC_KEY_ISSUERURL "\":\"%s\"}"
+#define REQUEST_ACCOUNTCONFIG                                \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCOUNTCONFIG \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\"}"
 
 #define ACCOUNT_NOT_LOADED "account not loaded"
 
@@ -154,6 +220,7 @@
 #define INT_REQUEST_VALUE_AUTOLOAD "autoload"
 #define INT_REQUEST_VALUE_CONFIRM "confirm"
 #define INT_REQUEST_VALUE_QUERY_ACCDEFAULT "query_account_default"
+#define INT_REQUEST_VALUE_STATUS "status_push"
 
 #define INT_IPC_KEY_OIDCERRNO "oidc_errno"
 
@@ -181,6 +248,9 @@
   "\",\"" IPC_KEY_ISSUERURL "\":\"%s\"}"
 #define INT_REQUEST_QUERY_ACCDEFAULT \
   "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_QUERY_ACCDEFAULT "\"}"
+#define INT_REQUEST_STATUS                                 \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_STATUS   \
+  "\",\"" IPC_KEY_INFO "\":%s}"
 #define INT_RESPONSE_ACCDEFAULT                                         \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_SHORTNAME \
   "\":\"%s\"}"
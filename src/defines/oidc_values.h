@@ -17,6 +17,7 @@
 
 // TOKEN RESPONSE KEYS
 #define OIDC_KEY_EXPIRESIN "expires_in"
+#define OIDC_KEY_JWT_EXP "exp"
 #define OIDC_KEY_ACCESSTOKEN "access_token"
 #define OIDC_KEY_REFRESHTOKEN "refresh_token"
 
@@ -15,6 +15,37 @@
  * location
  */
 #define OIDC_CONFIG_DIR_ENV_NAME "OIDC_CONFIG_DIR"
+/**
+ * the name of the environment variable that selects the key derivation
+ * profile used for new encryptions; see @c crypt_setKDFProfile
+ */
+#define OIDC_KDF_PROFILE_ENV_NAME "OIDC_AGENT_KDF_PROFILE"
+/**
+ * the name of the environment variable that makes config file writes fsync
+ * before the atomic rename
+ */
+#define OIDC_FSYNC_ENV_NAME "OIDC_AGENT_FSYNC"
+/**
+ * the name of the environment variable that enables per-path file I/O
+ * tracing; the collected counters are part of the metrics IPC response
+ */
+#define OIDC_IO_TRACE_ENV_NAME "OIDC_AGENT_IO_TRACE"
+/**
+ * the name of the environment variable that makes the agent mirror cached
+ * token material into a shared-memory segment readable by same-uid clients
+ */
+#define OIDC_TOKEN_MIRROR_ENV_NAME "OIDC_AGENT_TOKEN_MIRROR"
+/**
+ * the name of the environment variable that sets the look-ahead window in
+ * seconds for proactive background token refreshes; 0 disables them
+ */
+#define OIDC_REFRESH_AHEAD_ENV_NAME "OIDC_AGENT_REFRESH_AHEAD"
+/**
+ * the name of the environment variable that sets the path of the pre-shared
+ * key file authenticating network ipc handshakes; defaults to 'net.key' in
+ * the oidc-agent directory
+ */
+#define OIDC_NET_KEY_ENV_NAME "OIDC_AGENT_NET_KEY"
 /**
  * the scope used as default value
  */
@@ -33,6 +64,9 @@
 #define PUBCLIENTS_FILENAME "pubclients.config"
 #define ETC_PUBCLIENTS_CONFIG_FILE \
   CONFIG_PATH "/oidc-agent/" PUBCLIENTS_FILENAME
+#define ACCOUNT_TEMPLATES_FILENAME "account_templates.config"
+#define ETC_ACCOUNT_TEMPLATES_CONFIG_FILE \
+  CONFIG_PATH "/oidc-agent/" ACCOUNT_TEMPLATES_FILENAME
 
 #define MAX_PASS_TRIES 3
 /**
@@ -3,17 +3,22 @@
 #include "defines/settings.h"
 #include "ipc.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/printer.h"
+#include "utils/stringUtils.h"
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 char* communicateWithConnection(const char* fmt, va_list args,
                                 struct connection* con) {
   if (ipc_connect(*con) < 0) {
     return NULL;
   }
-  char* response = ipc_communicateWithSock(*(con->sock), fmt, args);
+  char* response = ipc_vcommunicateWithSock(*(con->sock), fmt, args);
   ipc_closeConnection(con);
   if (NULL == response) {
     printError("An unexpected error occured. It seems that oidc-agent has "
@@ -28,6 +33,69 @@ char* communicateWithConnection(const char* fmt, va_list args,
   return response;
 }
 
+// Each thread keeps its own persistent connection to the agent, so
+// concurrent threads issue requests in parallel without serializing on a
+// shared socket and without paying a connect and handshake per call. The
+// agent keeps client connections in its pool after answering, so reuse is
+// just writing the next request on the same socket.
+static __thread struct connection thread_con;
+static __thread unsigned char     thread_con_open = 0;
+static __thread pid_t             thread_con_pid  = 0;
+
+static pthread_key_t  thread_con_key;
+static pthread_once_t thread_con_once = PTHREAD_ONCE_INIT;
+
+static void _closeThreadConnection(void* con) {
+  ipc_closeConnection((struct connection*)con);
+}
+
+static void _makeThreadConnectionKey() {
+  pthread_key_create(&thread_con_key, _closeThreadConnection);
+}
+
+static void _dropThreadConnection() {
+  ipc_closeConnection(&thread_con);
+  thread_con_open = 0;
+}
+
+/**
+ * @brief makes sure the calling thread has an open connection to the agent
+ *
+ * Reuses the thread's cached connection if it still refers to the current
+ * socket path and process - after a fork the child drops its copy of the
+ * parent's connection instead of interleaving messages on it - and connects
+ * a new one otherwise. The connection is closed when the thread exits.
+ */
+static oidc_error_t _ensureThreadConnection() {
+  const char* path = getenv(OIDC_SOCK_ENV_NAME);
+  if (thread_con_open) {
+    if (thread_con_pid == getpid() && path != NULL &&
+        strequal(thread_con.server->sun_path, path)) {
+      return OIDC_SUCCESS;
+    }
+    _dropThreadConnection();
+  }
+  if (ipc_client_init(&thread_con, OIDC_SOCK_ENV_NAME) != OIDC_SUCCESS) {
+    secFree(thread_con.server);
+    thread_con.server = NULL;
+    secFree(thread_con.sock);
+    thread_con.sock = NULL;
+    return oidc_errno;
+  }
+  if (ipc_connect(thread_con) < 0) {  // already closed the socket fd
+    secFree(thread_con.server);
+    thread_con.server = NULL;
+    secFree(thread_con.sock);
+    thread_con.sock = NULL;
+    return oidc_errno;
+  }
+  thread_con_open = 1;
+  thread_con_pid  = getpid();
+  pthread_once(&thread_con_once, _makeThreadConnectionKey);
+  pthread_setspecific(thread_con_key, &thread_con);
+  return OIDC_SUCCESS;
+}
+
 char* ipc_communicate(const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
@@ -37,9 +105,43 @@ char* ipc_communicate(const char* fmt, ...) {
 }
 
 char* ipc_vcommunicate(const char* fmt, va_list args) {
-  static struct connection con;
-  if (ipc_client_init(&con, OIDC_SOCK_ENV_NAME) != OIDC_SUCCESS) {
+  char* msg = oidc_vsprintf(fmt, args);  // rendered once, so a retry after a
+                                         // dropped connection resends the
+                                         // identical message
+  if (msg == NULL) {
+    return NULL;
+  }
+  unsigned char reused = thread_con_open;
+  if (_ensureThreadConnection() != OIDC_SUCCESS) {  // no agent to talk to
+    secFree(msg);
     return NULL;
   }
-  return communicateWithConnection(fmt, args, &con);
+  char* response = NULL;
+  if (ipc_writeMessage(*(thread_con.sock), msg) == OIDC_SUCCESS) {
+    response = ipc_read(*(thread_con.sock));
+  }
+  if (response == NULL && reused) {  // the agent restarted or dropped the
+                                     // idle connection; retry once on a
+                                     // fresh one
+    _dropThreadConnection();
+    if (_ensureThreadConnection() == OIDC_SUCCESS &&
+        ipc_writeMessage(*(thread_con.sock), msg) == OIDC_SUCCESS) {
+      response = ipc_read(*(thread_con.sock));
+    }
+  }
+  if (response == NULL) {  // don't keep a connection in unknown state
+    _dropThreadConnection();
+  }
+  secFree(msg);
+  if (NULL == response) {
+    printError("An unexpected error occured. It seems that oidc-agent has "
+               "stopped.\n%s\n",
+               oidc_serror());
+    logger(ERROR,
+           "An unexpected error occured. It seems that oidc-agent has "
+           "stopped.\n%s\n",
+           oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  return response;
 }
@@ -0,0 +1,282 @@
+#define _XOPEN_SOURCE 700
+#include "compactIpc.h"
+
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The field tag table is wire protocol: tags are fixed and may only be
+ * appended to, never renumbered. Fields whose key is not in this table
+ * cannot be encoded and fall back to json.
+ */
+struct compact_field {
+  unsigned char tag;
+  const char*   key;
+  unsigned char isNumber;
+};
+
+static const struct compact_field compact_fields[] = {
+    {1, IPC_KEY_REQUEST, 0},
+    {2, IPC_KEY_SHORTNAME, 0},
+    {3, IPC_KEY_ISSUERURL, 0},  // same string as OIDC_KEY_ISSUER
+    {4, IPC_KEY_MINVALID, 1},
+    {5, OIDC_KEY_SCOPE, 0},
+    {6, IPC_KEY_APPLICATIONHINT, 0},
+    {7, IPC_KEY_STATUS, 0},
+    {8, OIDC_KEY_ERROR, 0},
+    {9, IPC_KEY_INFO, 0},
+    {10, OIDC_KEY_ACCESSTOKEN, 0},
+    {11, AGENT_KEY_EXPIRESAT, 1},
+    {12, IPC_KEY_CONFIG, 0},
+    {13, IPC_KEY_LIFETIME, 1},
+    {14, INT_IPC_KEY_OIDCERRNO, 1},
+    {15, IPC_KEY_PASSWORD, 0},
+};
+
+#define COMPACT_FIELD_COUNT \
+  (sizeof(compact_fields) / sizeof(*compact_fields))
+
+static const struct compact_field* _fieldForKey(const char* key) {
+  for (size_t i = 0; i < COMPACT_FIELD_COUNT; i++) {
+    if (strequal(compact_fields[i].key, key)) {
+      return &compact_fields[i];
+    }
+  }
+  return NULL;
+}
+
+static const struct compact_field* _fieldForTag(unsigned char tag) {
+  for (size_t i = 0; i < COMPACT_FIELD_COUNT; i++) {
+    if (compact_fields[i].tag == tag) {
+      return &compact_fields[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief checks if @p value can be embedded in a compact message as is
+ *
+ * The compact framing has no escaping; values containing control bytes
+ * (including the field separator) cannot be represented.
+ */
+static int _valueEncodable(const char* value) {
+  for (const unsigned char* c = (const unsigned char*)value; *c; c++) {
+    if (*c < 0x20) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief encodes a flat json object into a compact binary message
+ * @param json the json string to be encoded
+ * @return the compact message or @c NULL if the message cannot be
+ * represented compactly (unknown key, nested value, control bytes). The
+ * caller should fall back to sending @p json in that case. Has to be freed
+ * after usage.
+ */
+char* compactIpc_encode(const char* json) {
+  if (NULL == json) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  cJSON* obj = stringToJson(json);
+  if (obj == NULL || !cJSON_IsObject(obj)) {
+    secFreeJson(obj);
+    return NULL;
+  }
+  // Every encoded field (tag + value + separator) is shorter than its json
+  // form ("key":"value"), so the json text length is a safe upper bound.
+  char*  out = secAlloc(strlen(json) + 2);
+  size_t len = 0;
+  out[len++] = COMPACT_IPC_MAGIC;
+  for (cJSON* field = obj->child; field != NULL; field = field->next) {
+    if (field->string == NULL) {
+      goto fallback;
+    }
+    const struct compact_field* f = _fieldForKey(field->string);
+    if (f == NULL) {
+      goto fallback;
+    }
+    char numbuf[32];
+    const char* value;
+    if (f->isNumber && cJSON_IsNumber(field)) {
+      if (field->valuedouble != (double)(long)field->valuedouble) {
+        goto fallback;
+      }
+      snprintf(numbuf, sizeof(numbuf), "%ld", (long)field->valuedouble);
+      value = numbuf;
+    } else if (!f->isNumber && cJSON_IsString(field) &&
+               field->valuestring != NULL) {
+      if (!_valueEncodable(field->valuestring)) {
+        goto fallback;
+      }
+      value = field->valuestring;
+    } else {
+      goto fallback;
+    }
+    out[len++] = (char)(0x80 | f->tag);
+    size_t vlen = strlen(value);
+    memcpy(out + len, value, vlen);
+    len += vlen;
+    out[len++] = COMPACT_IPC_FIELD_END;
+  }
+  secFreeJson(obj);
+  return out;
+fallback:
+  secFreeJson(obj);
+  secFree(out);
+  return NULL;
+}
+
+/**
+ * @brief decodes a compact binary message into its json text form
+ * @param msg the compact message
+ * @return the json string or @c NULL on malformed input (sets
+ * @c OIDC_ECOMPACT). Has to be freed after usage.
+ */
+char* compactIpc_decode(const char* msg) {
+  if (NULL == msg) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!compactIpc_isCompact(msg)) {
+    oidc_errno = OIDC_ECOMPACT;
+    return NULL;
+  }
+  // json form per field: "key":"value", plus braces; keys are bounded by the
+  // tag table and values can at most double through escaping. The estimate
+  // counts every key once, so repeated tags - which would each emit the full
+  // key again - are rejected below; a flat json object cannot hold duplicate
+  // keys anyway.
+  size_t cap = 3;
+  for (size_t i = 0; i < COMPACT_FIELD_COUNT; i++) {
+    cap += strlen(compact_fields[i].key) + 6;
+  }
+  cap += 2 * strlen(msg);
+  char*         out                       = secAlloc(cap);
+  unsigned char seen[COMPACT_FIELD_COUNT] = {0};
+  size_t        len                       = 0;
+  out[len++]                              = '{';
+  const unsigned char* c                  = (const unsigned char*)msg + 1;
+  while (*c != '\0') {
+    const struct compact_field* f = _fieldForTag(*c & 0x7F);
+    if (f == NULL || !(*c & 0x80)) {
+      goto fail;
+    }
+    size_t fi = (size_t)(f - compact_fields);
+    if (seen[fi]) {
+      goto fail;  // duplicate tag
+    }
+    seen[fi] = 1;
+    c++;
+    const unsigned char* value = c;
+    while (*c != '\0' && *c != COMPACT_IPC_FIELD_END) { c++; }
+    if (*c != COMPACT_IPC_FIELD_END) {
+      goto fail;  // unterminated field
+    }
+    size_t vlen = (size_t)(c - value);
+    c++;
+    if (len > 1) {
+      out[len++] = ',';
+    }
+    out[len++] = '"';
+    size_t klen = strlen(f->key);
+    memcpy(out + len, f->key, klen);
+    len += klen;
+    out[len++] = '"';
+    out[len++] = ':';
+    if (f->isNumber) {
+      for (size_t i = 0; i < vlen; i++) {
+        if ((value[i] < '0' || value[i] > '9') &&
+            !(i == 0 && value[i] == '-')) {
+          goto fail;
+        }
+      }
+      if (vlen == 0) {
+        goto fail;
+      }
+      memcpy(out + len, value, vlen);
+      len += vlen;
+    } else {
+      out[len++] = '"';
+      for (size_t i = 0; i < vlen; i++) {
+        if (value[i] < 0x20) {
+          goto fail;
+        }
+        if (value[i] == '"' || value[i] == '\\') {
+          out[len++] = '\\';
+        }
+        out[len++] = (char)value[i];
+      }
+      out[len++] = '"';
+    }
+  }
+  out[len++] = '}';
+  return out;
+fail:
+  secFree(out);
+  oidc_errno = OIDC_ECOMPACT;
+  return NULL;
+}
+
+/**
+ * @brief checks if @p msg is a compact binary message
+ */
+int compactIpc_isCompact(const char* msg) {
+  return msg != NULL && (unsigned char)msg[0] == COMPACT_IPC_MAGIC;
+}
+
+/*
+ * Sockets whose client sent a compact request. The set is small (one entry
+ * per connected compact client), so a plain array is enough.
+ */
+#define COMPACT_SOCKS_MAX 64
+static int compact_socks[COMPACT_SOCKS_MAX];
+static size_t compact_socks_count = 0;
+
+/**
+ * @brief remembers that the client on @p sock speaks the compact framing
+ *
+ * Responses on @p sock are encoded compactly until the connection is
+ * dropped (@c compactIpc_unmarkSock).
+ */
+void compactIpc_markSock(int sock) {
+  if (compactIpc_sockIsCompact(sock)) {
+    return;
+  }
+  if (compact_socks_count >= COMPACT_SOCKS_MAX) {
+    logger(WARNING, "too many compact ipc clients; answering in json");
+    return;
+  }
+  compact_socks[compact_socks_count++] = sock;
+}
+
+void compactIpc_unmarkSock(int sock) {
+  for (size_t i = 0; i < compact_socks_count; i++) {
+    if (compact_socks[i] == sock) {
+      compact_socks[i] = compact_socks[--compact_socks_count];
+      return;
+    }
+  }
+}
+
+int compactIpc_sockIsCompact(int sock) {
+  for (size_t i = 0; i < compact_socks_count; i++) {
+    if (compact_socks[i] == sock) {
+      return 1;
+    }
+  }
+  return 0;
+}
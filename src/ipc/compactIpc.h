@@ -0,0 +1,36 @@
+#ifndef OIDC_COMPACT_IPC_H
+#define OIDC_COMPACT_IPC_H
+
+#include "utils/oidc_error.h"
+
+/**
+ * Compact binary framing for the agent ipc.
+ *
+ * A compact message is a normal length-prefixed ipc message whose payload
+ * starts with @c COMPACT_IPC_MAGIC instead of a json object. It encodes a
+ * flat json object as a sequence of fields, each consisting of a one byte
+ * field tag (the tag number with the high bit set) followed by the raw value
+ * bytes and a unit separator. Only the fixed protocol keys from ipc_values.h
+ * have tags; messages using other keys - or values that cannot be
+ * represented - are sent as json as before, so the compact mode is a pure
+ * fast path. The payload never contains a zero byte, so it passes through
+ * the string based ipc plumbing unchanged.
+ *
+ * Negotiation is per connection: a client opts in by sending its request
+ * compact; the agent remembers the socket and answers compact for as long as
+ * the connection lives. Compact framing is only used on unencrypted
+ * connections.
+ */
+
+#define COMPACT_IPC_MAGIC 0x02
+#define COMPACT_IPC_FIELD_END 0x1F
+
+char* compactIpc_encode(const char* json);
+char* compactIpc_decode(const char* msg);
+int   compactIpc_isCompact(const char* msg);
+
+void compactIpc_markSock(int sock);
+void compactIpc_unmarkSock(int sock);
+int  compactIpc_sockIsCompact(int sock);
+
+#endif  // OIDC_COMPACT_IPC_H
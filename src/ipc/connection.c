@@ -1,10 +1,31 @@
 #include "connection.h"
+#include "utils/agent_sdt.h"
 
+#include "utils/db/connection_db.h"
 #include "utils/memory.h"
+#include "utils/slab.h"
 
+#include <string.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+// Accepted clients allocate a connection struct plus an fd cell per
+// connection; with thousands of short connections these come out of pools
+// instead of churning the heap.
+static struct slab_pool connection_pool = SLAB_POOL_INIT(struct connection);
+static struct slab_pool fd_pool         = SLAB_POOL_INIT(int);
+
+/**
+ * @brief allocates a connection struct for an accepted client from the pool
+ * @return a zeroed connection with an allocated @c msgsock cell. Has to be
+ * freed after usage using @c secFreeConnection.
+ */
+struct connection* secAllocConnection() {
+  struct connection* con = slab_alloc(&connection_pool);
+  con->msgsock           = slab_alloc(&fd_pool);
+  return con;
+}
+
 /** @fn int connection_comparator(const void* v1, const void* v2)
  * @brief compares two connections by their msgsock.
  * @param v1 pointer to the first element
@@ -25,15 +46,80 @@ int connection_comparator(const struct connection* c1,
   return 0;
 }
 
+/** @fn int connection_getSockFd(const struct connection* con)
+ * @brief returns a connection's msgsock fd
+ * @param con a pointer to the connection
+ * @return the fd or @c -1 if there is none
+ */
+int connection_getSockFd(const struct connection* con) {
+  if (con == NULL || con->msgsock == NULL) {
+    return -1;
+  }
+  return *(con->msgsock);
+}
+
+/**
+ * @brief looks up the accepted connection a socket belongs to
+ * @param sock the socket fd
+ * @return the connection registered in the connectionDB or @c NULL
+ */
+struct connection* connection_findBySock(const int sock) {
+  int               msgsock = sock;
+  struct connection key     = {.msgsock = &msgsock};
+  return connectionDB_findValue(&key);
+}
+
+/**
+ * @brief stores a session key set in the connection's inline key ring
+ *
+ * The key sets are kept as a stack, so the set stored last is the one popped
+ * first, matching the order responses are written in. If the ring is full -
+ * which a protocol-conforming client cannot cause - the oldest set is
+ * dropped.
+ * @param con the connection the keys were negotiated on
+ * @param keys the key set to store; it is copied, the caller keeps ownership
+ */
+void connection_pushKeySet(struct connection*       con,
+                           const struct ipc_keySet* keys) {
+  if (con == NULL || keys == NULL) {
+    return;
+  }
+  if (con->keyRing_len >= CONNECTION_KEYRING_SIZE) {
+    memmove(con->keyRing, con->keyRing + 1,
+            (CONNECTION_KEYRING_SIZE - 1) * sizeof(struct ipc_keySet));
+    con->keyRing_len = CONNECTION_KEYRING_SIZE - 1;
+  }
+  con->keyRing[con->keyRing_len++] = *keys;
+}
+
+/**
+ * @brief pops the session key set stored last off the connection's key ring
+ * @param con the connection
+ * @param keys filled with the popped key set; wipe it after usage
+ * @return @c 1 if a key set was popped, @c 0 if the ring is empty
+ */
+int connection_popKeySet(struct connection* con, struct ipc_keySet* keys) {
+  if (con == NULL || con->keyRing_len == 0) {
+    return 0;
+  }
+  struct ipc_keySet* slot = &con->keyRing[--con->keyRing_len];
+  *keys                   = *slot;
+  moresecure_memzero(slot, sizeof(struct ipc_keySet));
+  return 1;
+}
+
 void _secFreeConnection(struct connection* con) {
   secFree(con->server);
   con->server = NULL;
-  secFree(con->sock);
+  secFree(con->net_server);
+  con->net_server = NULL;
+  slab_free(&fd_pool, con->sock);
   con->sock = NULL;
   if (con->msgsock) {
+    AGENT_PROBE1(client_close, *(con->msgsock));
     close(*(con->msgsock));
   }
-  secFree(con->msgsock);
+  slab_free(&fd_pool, con->msgsock);
   con->msgsock = NULL;
-  secFree(con);
+  slab_free(&connection_pool, con);
 }
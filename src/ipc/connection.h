@@ -1,17 +1,60 @@
 #ifndef IPC_CONNECTION_H
 #define IPC_CONNECTION_H
 
+#include "ipc/cryptIpc.h"
+
 #include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * number of session key sets a connection can hold for responses that have
+ * not been written yet; with the request/response protocol one slot is in
+ * use at a time, the extra slots cover pipelined requests
+ */
+#define CONNECTION_KEYRING_SIZE 4
 
 struct connection {
   int*                sock;
   int*                msgsock;
   struct sockaddr_un* server;
+  /**
+   * session key sets awaiting their response, stored inline so the
+   * per-message key handling is an index operation on memory adjacent to the
+   * connection state instead of nodes on a heap list
+   */
+  struct ipc_keySet keyRing[CONNECTION_KEYRING_SIZE];
+  unsigned char     keyRing_len;
+  /**
+   * uid of the connected peer, taken from the socket credentials at accept
+   * time; used to schedule ready connections fairly between users. Set to
+   * @c (uid_t)-1 if the credentials could not be read.
+   */
+  uid_t peer_uid;
+  /**
+   * set for clients accepted on the network (tcp/vsock) listener; those
+   * sockets carry no peer credentials and only encrypted requests are
+   * accepted on them
+   */
+  unsigned char is_net;
+  /**
+   * target address of a client connection to a tcp or vsock server; when
+   * set, @c ipc_connect uses it instead of @c server. Allocated by
+   * @c initConnectionWithPath, freed with the connection.
+   */
+  struct sockaddr_storage* net_server;
+  socklen_t                net_server_len;
 };
 
 int  connection_comparator(const struct connection* c1,
                            const struct connection* c2);
-void _secFreeConnection(struct connection* con);
+int  connection_getSockFd(const struct connection* con);
+struct connection* secAllocConnection();
+void               _secFreeConnection(struct connection* con);
+struct connection* connection_findBySock(const int sock);
+void               connection_pushKeySet(struct connection*       con,
+                                         const struct ipc_keySet* keys);
+int connection_popKeySet(struct connection* con, struct ipc_keySet* keys);
 
 #ifndef secFreeConnection
 #define secFreeConnection(ptr) \
@@ -5,9 +5,13 @@
 #include "utils/crypt/cryptUtils.h"
 #include "utils/json.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
 
 #include <sodium.h>
+#include <string.h>
+#include <sys/socket.h>
 
 char* ipc_cryptCommunicate(const char* fmt, ...) {
   va_list args;
@@ -17,18 +21,102 @@ char* ipc_cryptCommunicate(const char* fmt, ...) {
   return ret;
 }
 
+// Opt-in session resumption: when enabled the session keys of the last
+// successful key exchange are kept and the next request is sent encrypted
+// with them - prefixed with IPC_RESUME_PREFIX - so the agent can skip the
+// key exchange for a recently-seen peer. If the agent rejects the resume the
+// client reconnects and falls back to a full handshake.
+static unsigned char      use_session_resumption = 0;
+static struct ipc_keySet* cached_session_keys    = NULL;
+
+/**
+ * @brief enables session resumption for this process' encrypted ipc
+ *
+ * Useful for clients that talk to the agent repeatedly, like oidc-gen while
+ * polling for an authorization code.
+ */
+void ipc_cryptUseSessionResumption() { use_session_resumption = 1; }
+
+static char* _tryResume(const struct connection* con, const char* msg) {
+  char* payload = encryptForIpc(msg, cached_session_keys->key_tx);
+  if (payload == NULL) {
+    return NULL;
+  }
+  oidc_error_t e = ipc_write(*(con->sock), IPC_RESUME_PREFIX "%s", payload);
+  secFree(payload);
+  if (e != OIDC_SUCCESS) {
+    return NULL;
+  }
+  char* response = ipc_read(*(con->sock));
+  if (response == NULL) {
+    return NULL;
+  }
+  if (isLikelyJSONObject(response)) {  // plain response: the agent did not
+                                       // resume
+    secFree(response);
+    return NULL;
+  }
+  char* decryptedResponse = decryptForIpc(response, cached_session_keys->key_rx);
+  secFree(response);
+  return decryptedResponse;
+}
+
+/**
+ * @brief replaces the socket of @p con with a freshly connected one
+ *
+ * Needed after a rejected session resumption: the agent drops the client
+ * after answering a request it could not read.
+ */
+static oidc_error_t _reconnect(struct connection* con) {
+  ipc_close(*(con->sock));
+  *(con->sock) = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (*(con->sock) < 0) {
+    logger(ERROR, "opening stream socket: %m");
+    oidc_errno = OIDC_ECRSOCK;
+    return oidc_errno;
+  }
+  if (ipc_connect(*con) < 0) {
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
 char* _ipc_vcryptCommunicateWithConnection(struct connection con,
                                            const char* fmt, va_list args) {
   logger(DEBUG, "Doing encrypted ipc communication");
+  char* msg = oidc_vsprintf(fmt, args);
+  if (msg == NULL) {
+    return NULL;
+  }
   if (ipc_connect(con) < 0) {
+    secFree(msg);
     return NULL;
   }
+  if (use_session_resumption && cached_session_keys != NULL) {
+    char* resumedResponse = _tryResume(&con, msg);
+    if (resumedResponse != NULL) {
+      ipc_closeConnection(&con);
+      secFree(msg);
+      return resumedResponse;
+    }
+    logger(DEBUG, "Session resumption failed; doing full key exchange");
+    secFreeIpcKeySet(cached_session_keys);
+    cached_session_keys = NULL;  // the key exchange below may reuse the slab
+                                 // slot; a stale pointer here would alias it
+    if (_reconnect(&con) != OIDC_SUCCESS) {
+      ipc_closeConnection(&con);
+      secFree(msg);
+      return NULL;
+    }
+  }
   struct ipc_keySet* ipc_keys = client_keyExchange(*(con.sock));
   if (ipc_keys == NULL) {
     ipc_closeConnection(&con);
+    secFree(msg);
     return NULL;
   }
-  oidc_error_t e = ipc_vcryptWrite(*(con.sock), ipc_keys->key_tx, fmt, args);
+  oidc_error_t e = ipc_cryptWrite(*(con.sock), ipc_keys->key_tx, "%s", msg);
+  secFree(msg);
   if (e != OIDC_SUCCESS) {
     secFreeIpcKeySet(ipc_keys);
     ipc_closeConnection(&con);
@@ -42,13 +130,19 @@ char* _ipc_vcryptCommunicateWithConnection(struct connection con,
     return NULL;
   }
 
-  if (isJSONObject(encryptedResponse)) {
+  if (isLikelyJSONObject(encryptedResponse)) {
     // Response not encrypted
     secFreeIpcKeySet(ipc_keys);
     return encryptedResponse;
   }
   char* decryptedResponse = decryptForIpc(encryptedResponse, ipc_keys->key_rx);
   secFree(encryptedResponse);
+  if (use_session_resumption && decryptedResponse != NULL) {
+    if (cached_session_keys == NULL) {
+      cached_session_keys = secAllocIpcKeySet();
+    }
+    memcpy(cached_session_keys, ipc_keys, sizeof(struct ipc_keySet));
+  }
   secFreeIpcKeySet(ipc_keys);
   return decryptedResponse;
 }
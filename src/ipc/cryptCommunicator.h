@@ -4,6 +4,7 @@
 #include <stdarg.h>
 
 char* ipc_cryptCommunicate(const char*, ...);
+void  ipc_cryptUseSessionResumption();
 char* ipc_vcryptCommunicate(const char*, va_list);
 char* ipc_vcryptCommunicateWithPath(const char*, const char*, va_list);
 char* ipc_cryptCommunicateWithPath(const char*, const char*, ...);
@@ -1,13 +1,31 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE  // struct ucred
+#endif
+
 #include "cryptIpc.h"
+#include "connection.h"
+#include "defines/settings.h"
 #include "ipc.h"
+#include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/slab.h"
+#include "utils/stringUtils.h"
 
 #include <sodium.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#ifndef __APPLE__
+#include <time.h>
+#endif
 
 typedef int (*crypto_kx_session_keys)(
     unsigned char       rx[crypto_kx_SESSIONKEYBYTES],
@@ -31,28 +49,222 @@ oidc_error_t ipc_vcryptWrite(const int sock, const unsigned char* key,
   if (msg == NULL) {
     return oidc_errno;
   }
-  logger(DEBUG, "Doing encrypted ipc write of %lu bytes: '%s'", strlen(msg),
-         msg);
-  char* encryptedMessage = encryptForIpc(msg, key);
+  oidc_error_t e = ipc_cryptWriteMsg(sock, key, msg);
   secFree(msg);
-  if (encryptedMessage == NULL) {
+  return e;
+}
+
+/**
+ * @brief encrypts and writes an already assembled message
+ * Unlike @c ipc_cryptWrite this neither formats nor copies @p msg; forwarding
+ * paths that already hold the complete message use it to go straight into the
+ * encryption.
+ */
+oidc_error_t ipc_cryptWriteMsg(const int sock, const unsigned char* key,
+                               const char* msg) {
+  if (msg == NULL) {
+    oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  oidc_error_t e = ipc_write(sock, encryptedMessage);
-  secFree(encryptedMessage);
+  size_t msg_len = strlen(msg);
+  logger(DEBUG, "Doing encrypted ipc write of %lu bytes: '%s'", msg_len, msg);
+  struct encryptionInfo* cryptResult =
+      crypt_encryptWithKey((unsigned char*)msg, key);
+  if (cryptResult->encrypted_base64 == NULL) {
+    secFreeEncryptionInfo(cryptResult);
+    return oidc_errno;
+  }
+  // the encoded message "<len>:<nonce>:<cipher>" is not assembled into one
+  // buffer; the parts go zero-copy into the send
+  char lenStr[21];
+  snprintf(lenStr, sizeof(lenStr), "%lu", msg_len);
+  const char*  parts[] = {lenStr, ":", cryptResult->nonce_base64, ":",
+                          cryptResult->encrypted_base64};
+  oidc_error_t e = ipc_writeParts(sock, parts, sizeof(parts) / sizeof(*parts));
+  secFreeEncryptionInfo(cryptResult);
   return e;
 }
 
-void secFreeIpcKeySet(struct ipc_keySet* k) { secFree(k); }
+// Session key sets are allocated per handshake and when popped-off response
+// keys outlive their connection's key ring; reuse them through a pool instead
+// of the heap. The wipe on reclaim also makes sure no key material lingers.
+static struct slab_pool ipc_keySet_pool = SLAB_POOL_INIT(struct ipc_keySet);
+
+struct ipc_keySet* secAllocIpcKeySet() { return slab_alloc(&ipc_keySet_pool); }
+
+void secFreeIpcKeySet(struct ipc_keySet* k) { slab_free(&ipc_keySet_pool, k); }
 void secFreePubSecKeySet(struct pubsec_keySet* k) { secFree(k); }
 
+// Pool of precomputed ephemeral keypairs. crypto_kx keypair generation is
+// the expensive part of the handshake; the agent refills this pool while its
+// event loop is idle so the handshake path can pop a ready keypair in O(1).
+#define KEYPAIR_POOL_SIZE 8
+
+static struct pubsec_keySet* keypair_pool[KEYPAIR_POOL_SIZE];
+static unsigned char         keypair_pool_len = 0;
+
 struct pubsec_keySet* generatePubSecKeys() {
-  struct pubsec_keySet* keys = secAlloc(sizeof(struct pubsec_keySet));
+  struct pubsec_keySet* keys;
+  if (keypair_pool_len > 0) {
+    keys                           = keypair_pool[--keypair_pool_len];
+    keypair_pool[keypair_pool_len] = NULL;
+    logger(DEBUG, "Popped precomputed pub/sec keys");
+    return keys;
+  }
+  keys = secAlloc(sizeof(struct pubsec_keySet));
   crypto_kx_keypair(keys->pub, keys->sec);
   logger(DEBUG, "Generated pub/sec keys");
   return keys;
 }
 
+/**
+ * @brief refills the pool of precomputed ephemeral keypairs
+ *
+ * Has to be called off the request's critical path, i.e. by the agent event
+ * loop before it starts serving and whenever it wakes up without work.
+ */
+void ipc_keyPairPool_refill() {
+  while (keypair_pool_len < KEYPAIR_POOL_SIZE) {
+    struct pubsec_keySet* keys = secAlloc(sizeof(struct pubsec_keySet));
+    crypto_kx_keypair(keys->pub, keys->sec);
+    keypair_pool[keypair_pool_len++] = keys;
+  }
+}
+
+/**
+ * Pre-shared-key authentication for network ipc handshakes.
+ *
+ * The unix socket authenticates its peers through file permissions and
+ * SO_PEERCRED; a tcp or vsock listener has neither, and the anonymous key
+ * exchange encrypts but authenticates nobody. Handshakes on a network
+ * socket are therefore bound to a pre-shared key: each side appends a
+ * keyed MAC over its ephemeral public key, and a public key whose MAC does
+ * not verify is rejected. The agent creates the key file on the first
+ * --net-listener start; it has to be provisioned to the containers and VMs
+ * that may use the agent, which point @c OIDC_AGENT_NET_KEY at their copy.
+ * The MAC only gates the handshake - substituting or replaying a public
+ * key without its secret key yields no usable session keys, so the session
+ * itself stays protected by the key exchange.
+ */
+
+#define IPC_NET_KEY_FILENAME "net.key"
+// separates the public key from its MAC; not part of the base64 alphabet
+#define IPC_NET_AUTH_SEP '.'
+
+static unsigned char net_auth_key[crypto_auth_KEYBYTES];
+static int           net_auth_state = 0;  // 0 not loaded; 1 loaded; -1 absent
+
+/**
+ * @brief loads (and for the listening agent creates) the pre-shared network
+ * ipc key
+ * @param generate whether a missing key file should be generated
+ * @return @c 1 if the key is available, @c -1 otherwise
+ */
+static int _netAuth_load(int generate) {
+  if (net_auth_state != 0) {
+    return net_auth_state;
+  }
+  const char* env = getenv(OIDC_NET_KEY_ENV_NAME);
+  char*       path =
+      strValid(env) ? oidc_strcopy(env) : concatToOidcDir(IPC_NET_KEY_FILENAME);
+  if (path == NULL) {
+    return net_auth_state = -1;
+  }
+  char* key_base64 = readFile(path);
+  if (key_base64 == NULL && generate) {
+    secRandomFill(net_auth_key, sizeof(net_auth_key));
+    key_base64 = toBase64((char*)net_auth_key, sizeof(net_auth_key));
+    if (writeFile(path, key_base64) != OIDC_SUCCESS) {
+      logger(ERROR, "Could not write the network ipc key file '%s': %s", path,
+             oidc_serror());
+      secFree(key_base64);
+      key_base64 = NULL;
+    } else {
+      chmod(path, S_IRUSR | S_IWUSR);  // the key gates agent access
+      logger(NOTICE,
+             "Generated network ipc key file '%s'; provision it to the "
+             "clients that may use this agent",
+             path);
+    }
+  }
+  if (key_base64 == NULL ||
+      fromBase64(key_base64, sizeof(net_auth_key), net_auth_key) != 0) {
+    if (key_base64 != NULL) {
+      logger(ERROR, "Network ipc key file '%s' is not a valid key", path);
+    }
+    net_auth_state = -1;
+  } else {
+    net_auth_state = 1;
+  }
+  secFree(key_base64);
+  secFree(path);
+  return net_auth_state;
+}
+
+/**
+ * @brief loads or creates the pre-shared key gating the network listener
+ * Has to succeed before a network socket starts listening: without the key
+ * no peer could be told apart from any other host that can connect.
+ */
+oidc_error_t ipc_netAuth_serverInit() {
+  if (_netAuth_load(1) != 1) {
+    oidc_setInternalError(
+        "could not load or create the network ipc key file; refusing an "
+        "unauthenticated network listener");
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief appends the keyed MAC to a base64 public key
+ * @return the tagged public key message. Has to be freed after usage.
+ */
+static char* _netAuth_tagPubKey(const char*          pk_base64,
+                                const unsigned char* pk) {
+  unsigned char mac[crypto_auth_BYTES];
+  crypto_auth(mac, pk, crypto_kx_PUBLICKEYBYTES, net_auth_key);
+  char* mac_base64 = toBase64((char*)mac, sizeof(mac));
+  char* tagged =
+      oidc_sprintf("%s%c%s", pk_base64, IPC_NET_AUTH_SEP, mac_base64);
+  secFree(mac_base64);
+  return tagged;
+}
+
+/**
+ * @brief verifies the keyed MAC of a tagged public key message
+ * @param pk_out filled with the decoded public key on success
+ * @return @c 1 if the MAC verifies, @c 0 otherwise
+ */
+static int _netAuth_verifyPubKey(const char* tagged, unsigned char* pk_out) {
+  const char* sep = strchr(tagged, IPC_NET_AUTH_SEP);
+  if (sep == NULL) {
+    return 0;
+  }
+  char*         pk_base64 = oidc_strncopy(tagged, sep - tagged);
+  unsigned char mac[crypto_auth_BYTES];
+  int ok = pk_base64 != NULL &&
+           fromBase64(pk_base64, crypto_kx_PUBLICKEYBYTES, pk_out) == 0 &&
+           fromBase64(sep + 1, sizeof(mac), mac) == 0 &&
+           crypto_auth_verify(mac, pk_out, crypto_kx_PUBLICKEYBYTES,
+                              net_auth_key) == 0;
+  secFree(pk_base64);
+  return ok;
+}
+
+/**
+ * @return whether @p sock is a network socket (and its handshake therefore
+ * needs the pre-shared-key authentication)
+ */
+static int _sockIsNet(const int sock) {
+  struct sockaddr_storage addr;
+  socklen_t               len = sizeof(addr);
+  if (getsockname(sock, (struct sockaddr*)&addr, &len) != 0) {
+    return 0;
+  }
+  return addr.ss_family != AF_UNIX;
+}
+
 char* communicatePublicKey(const int                   _sock,
                            const struct pubsec_keySet* key_set) {
   if (key_set == NULL) {
@@ -73,7 +285,7 @@ struct ipc_keySet* generateIpcKeys(const struct pubsec_keySet* pubsec_keys,
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  struct ipc_keySet*     keys = secAlloc(sizeof(struct ipc_keySet));
+  struct ipc_keySet*     keys = secAllocIpcKeySet();
   crypto_kx_session_keys sessionKeys =
       isServer ? crypto_kx_server_session_keys : crypto_kx_client_session_keys;
   if (sessionKeys(keys->key_rx, keys->key_tx, pubsec_keys->pub,
@@ -99,19 +311,200 @@ struct ipc_keySet* generateServerIpcKeys(
   return generateIpcKeys(pubsec_keys, clientPubKey, 1);
 }
 
-list_t* encryptionKeys = NULL;
+#ifndef __APPLE__
+
+/**
+ * Session resumption cache for repeat clients.
+ *
+ * A client polling the agent - like oidc-gen during state lookup - pays a
+ * full crypto_kx key exchange per connection. Peers are identified with
+ * SO_PEERCRED by (uid, pid, exe start time), so a recently-seen process can
+ * resume its symmetric session keys by sending its next request encrypted
+ * with them, prefixed with @c IPC_RESUME_PREFIX, instead of a new key
+ * exchange. Possession of the keys is the proof: if the decrypt fails the
+ * client gets an error and falls back to a full handshake. Clients opt in
+ * with @c ipc_cryptUseSessionResumption.
+ */
+
+#define PEER_SESSION_LIFETIME 300
+#define PEER_SESSION_MAX 16
+
+struct peer_session {
+  uid_t              uid;
+  pid_t              pid;
+  unsigned long long starttime;
+  struct ipc_keySet  keys;
+  time_t             created;
+};
+
+static list_t* peerSessions = NULL;
+
+static void _secFreePeerSession(struct peer_session* session) {
+  moresecure_memzero(session, sizeof(struct peer_session));
+  secFree(session);
+}
+
+/**
+ * @brief gets the start time of a process from /proc, so a recycled pid
+ * cannot inherit a cached session
+ * @return the start time in clock ticks or @c 0 on failure
+ */
+static unsigned long long _getProcStarttime(pid_t pid) {
+  char* path = oidc_sprintf("/proc/%d/stat", pid);
+  char* stat = readFile(path);
+  secFree(path);
+  if (stat == NULL) {
+    return 0;
+  }
+  char*              p         = strrchr(stat, ')');  // comm can hold spaces
+  unsigned long long starttime = 0;
+  if (p != NULL) {
+    sscanf(p + 1,
+           " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d "
+           "%*d %*d %*d %*d %llu",
+           &starttime);
+  }
+  secFree(stat);
+  return starttime;
+}
+
+static struct peer_session* _findPeerSession(uid_t uid, pid_t pid,
+                                             unsigned long long starttime) {
+  if (peerSessions == NULL) {
+    return NULL;
+  }
+  time_t           now = time(NULL);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(peerSessions, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct peer_session* session = node->val;
+    if (session->created + PEER_SESSION_LIFETIME < now) {
+      list_remove(peerSessions, node);
+      continue;
+    }
+    if (session->uid == uid && session->pid == pid &&
+        session->starttime == starttime) {
+      list_iterator_destroy(it);
+      return session;
+    }
+  }
+  list_iterator_destroy(it);
+  return NULL;
+}
+
+static struct peer_session* _findPeerSessionForSock(const int sock) {
+  struct ucred cred;
+  socklen_t    len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return NULL;
+  }
+  unsigned long long starttime = _getProcStarttime(cred.pid);
+  if (starttime == 0) {
+    return NULL;
+  }
+  return _findPeerSession(cred.uid, cred.pid, starttime);
+}
+
+static void _storePeerSession(const int sock, const struct ipc_keySet* keys) {
+  struct ucred cred;
+  socklen_t    len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return;
+  }
+  unsigned long long starttime = _getProcStarttime(cred.pid);
+  if (starttime == 0) {
+    return;
+  }
+  if (peerSessions == NULL) {
+    peerSessions       = list_new();
+    peerSessions->free = (void (*)(void*))_secFreePeerSession;
+  }
+  struct peer_session* session =
+      _findPeerSession(cred.uid, cred.pid, starttime);
+  if (session == NULL) {
+    if (peerSessions->len >= PEER_SESSION_MAX) {  // evict the oldest
+      list_remove(peerSessions, peerSessions->head);
+    }
+    session            = secAlloc(sizeof(struct peer_session));
+    session->uid       = cred.uid;
+    session->pid       = cred.pid;
+    session->starttime = starttime;
+    list_rpush(peerSessions, list_node_new(session));
+  }
+  memcpy(&session->keys, keys, sizeof(struct ipc_keySet));
+  session->created = time(NULL);
+}
+
+static char* _server_ipc_resumeRead(const int sock, const char* msg) {
+  struct peer_session* session = _findPeerSessionForSock(sock);
+  if (session == NULL) {
+    logger(DEBUG, "No cached session for resuming peer");
+    oidc_errno = OIDC_ECRYPMIPC;
+    return NULL;
+  }
+  char* decryptedRequest =
+      decryptForIpc(msg + strlen(IPC_RESUME_PREFIX), session->keys.key_rx);
+  if (decryptedRequest == NULL) {
+    oidc_errno = OIDC_ECRYPMIPC;
+    return NULL;
+  }
+  logger(DEBUG, "Resumed session for peer pid %d", session->pid);
+  session->created = time(NULL);
+  struct ipc_keySet response_keys = {{0}, {0}};
+  memcpy(response_keys.key_tx, session->keys.key_tx,
+         crypto_kx_SESSIONKEYBYTES);
+  connection_pushKeySet(connection_findBySock(sock), &response_keys);
+  moresecure_memzero(&response_keys, sizeof(response_keys));
+  return decryptedRequest;
+}
+
+#endif  // __APPLE__
 
 char* server_ipc_cryptRead(const int sock, const char* client_pk_base64) {
   logger(DEBUG, "Doing encrypted ipc read");
-  unsigned char client_pk[crypto_kx_PUBLICKEYBYTES];
-  fromBase64(client_pk_base64, crypto_kx_PUBLICKEYBYTES, client_pk);
+  if (strncmp(client_pk_base64, IPC_RESUME_PREFIX,
+              strlen(IPC_RESUME_PREFIX)) == 0) {
+#ifndef __APPLE__
+    return _server_ipc_resumeRead(sock, client_pk_base64);
+#else
+    oidc_errno = OIDC_ECRYPMIPC;
+    return NULL;
+#endif
+  }
+  unsigned char      client_pk[crypto_kx_PUBLICKEYBYTES];
+  struct connection* con    = connection_findBySock(sock);
+  int                is_net = con != NULL && con->is_net;
+  if (is_net) {
+    // a network peer carries no socket credentials; only a handshake bound
+    // to the pre-shared key is accepted
+    if (net_auth_state != 1 ||
+        !_netAuth_verifyPubKey(client_pk_base64, client_pk)) {
+      logger(WARNING,
+             "Rejecting network client without a valid handshake "
+             "authentication tag");
+      oidc_errno = OIDC_ECRYPMIPC;
+      return NULL;
+    }
+  } else {
+    fromBase64(client_pk_base64, crypto_kx_PUBLICKEYBYTES, client_pk);
+  }
   struct pubsec_keySet* pubsec_keys = generatePubSecKeys();
   struct ipc_keySet* ipc_keys = generateServerIpcKeys(pubsec_keys, client_pk);
   if (ipc_keys == NULL) {
     secFreePubSecKeySet(pubsec_keys);
     return NULL;
   }
-  char* encrypted_request = communicatePublicKey(sock, pubsec_keys);
+  char* encrypted_request;
+  if (is_net) {  // the client verifies the agent the same way
+    char* pk_base64 = toBase64((char*)pubsec_keys->pub,
+                               crypto_kx_PUBLICKEYBYTES);
+    char* tagged    = _netAuth_tagPubKey(pk_base64, pubsec_keys->pub);
+    secFree(pk_base64);
+    encrypted_request = ipc_communicateWithSock(sock, "%s", tagged);
+    secFree(tagged);
+  } else {
+    encrypted_request = communicatePublicKey(sock, pubsec_keys);
+  }
   secFreePubSecKeySet(pubsec_keys);
   if (encrypted_request == NULL) {
     secFreeIpcKeySet(ipc_keys);
@@ -121,28 +514,57 @@ char* server_ipc_cryptRead(const int sock, const char* client_pk_base64) {
   char* decryptedRequest = decryptForIpc(encrypted_request, ipc_keys->key_rx);
   secFree(encrypted_request);
   logger(DEBUG, "Decrypted request is '%s'", decryptedRequest);
-  moresecure_memzero(ipc_keys->key_rx, crypto_kx_SESSIONKEYBYTES);
   if (decryptedRequest != NULL) {
-    if (encryptionKeys == NULL) {
-      encryptionKeys = list_new();
-    }
-    list_rpush(encryptionKeys, list_node_new(ipc_keys));
+#ifndef __APPLE__
+    _storePeerSession(sock, ipc_keys);  // has to keep key_rx for resumption
+#endif
+    moresecure_memzero(ipc_keys->key_rx, crypto_kx_SESSIONKEYBYTES);
+    connection_pushKeySet(connection_findBySock(sock), ipc_keys);
   } else {
-    secFreeIpcKeySet(ipc_keys);
+    moresecure_memzero(ipc_keys->key_rx, crypto_kx_SESSIONKEYBYTES);
   }
+  secFreeIpcKeySet(ipc_keys);
   return decryptedRequest;
 }
 
 struct ipc_keySet* client_keyExchange(const int sock) {
+  int is_net = _sockIsNet(sock);
+  if (is_net && _netAuth_load(0) != 1) {
+    oidc_setInternalError(
+        "no network ipc key; point " OIDC_NET_KEY_ENV_NAME " at a copy of "
+        "the agent's key file");
+    return NULL;
+  }
   struct pubsec_keySet* pubsec_keys = generatePubSecKeys();
-  char* server_pk_base64            = communicatePublicKey(sock, pubsec_keys);
+  char*                 server_pk_base64;
+  if (is_net) {
+    char* pk_base64 = toBase64((char*)pubsec_keys->pub,
+                               crypto_kx_PUBLICKEYBYTES);
+    char* tagged    = _netAuth_tagPubKey(pk_base64, pubsec_keys->pub);
+    secFree(pk_base64);
+    server_pk_base64 = ipc_communicateWithSock(sock, "%s", tagged);
+    secFree(tagged);
+  } else {
+    server_pk_base64 = communicatePublicKey(sock, pubsec_keys);
+  }
   if (server_pk_base64 == NULL) {
     secFreePubSecKeySet(pubsec_keys);
     return NULL;
   }
   logger(DEBUG, "Received server public key");
   unsigned char server_pk[crypto_kx_PUBLICKEYBYTES];
-  fromBase64(server_pk_base64, crypto_kx_PUBLICKEYBYTES, server_pk);
+  if (is_net) {
+    if (!_netAuth_verifyPubKey(server_pk_base64, server_pk)) {
+      logger(ERROR, "The agent did not authenticate its handshake; wrong "
+                    "network ipc key?");
+      oidc_errno = OIDC_ECRYPMIPC;
+      secFree(server_pk_base64);
+      secFreePubSecKeySet(pubsec_keys);
+      return NULL;
+    }
+  } else {
+    fromBase64(server_pk_base64, crypto_kx_PUBLICKEYBYTES, server_pk);
+  }
   secFree(server_pk_base64);
   struct ipc_keySet* ipc_keys = generateClientIpcKeys(pubsec_keys, server_pk);
   secFreePubSecKeySet(pubsec_keys);
@@ -6,6 +6,10 @@
 #include <sodium.h>
 #include <stdarg.h>
 
+// First message of a client resuming a cached session: the prefix followed
+// by the request encrypted with the previously negotiated session keys.
+#define IPC_RESUME_PREFIX "resume:"
+
 struct ipc_keySet {
   unsigned char key_rx[crypto_kx_SESSIONKEYBYTES];
   unsigned char key_tx[crypto_kx_SESSIONKEYBYTES];
@@ -21,12 +25,16 @@ struct ipc_keySet* generateServerIpcKeys(const struct pubsec_keySet*,
 struct ipc_keySet* generateClientIpcKeys(const struct pubsec_keySet*,
                                          const unsigned char*);
 struct pubsec_keySet* generatePubSecKeys();
+void                  ipc_keyPairPool_refill();
 oidc_error_t ipc_cryptWrite(const int, const unsigned char*, const char*, ...);
+oidc_error_t ipc_cryptWriteMsg(const int, const unsigned char*, const char*);
 oidc_error_t ipc_vcryptWrite(const int, const unsigned char*, const char*,
                              va_list);
-void         secFreeIpcKeySet(struct ipc_keySet*);
+struct ipc_keySet* secAllocIpcKeySet();
+void               secFreeIpcKeySet(struct ipc_keySet*);
 void         secFreePubSecKeySet(struct pubsec_keySet*);
 char*        server_ipc_cryptRead(const int, const char*);
 struct ipc_keySet* client_keyExchange(const int sock);
+oidc_error_t       ipc_netAuth_serverInit();
 
 #endif  // IPC_CRYPT_H
@@ -0,0 +1,317 @@
+#include "eventEngine.h"
+#include "ipc.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+
+#ifdef __APPLE__
+#include <sys/event.h>
+#else
+#include <sys/epoll.h>
+#endif
+#include <sys/time.h>
+#include <unistd.h>
+
+/**
+ * Persistent event engine for the agent's server socket.
+ *
+ * Instead of rebuilding an fd_set from the whole connection list on every
+ * wakeup, connections are registered once - the listening socket in
+ * @c eventEngine_init and every accepted client in
+ * @c eventEngine_registerClient - and the kernel hands us the ready fds
+ * directly. The engine is level-triggered, so events that are not consumed
+ * by one wait call show up again on the next one; closing a client socket
+ * removes it from the interest set automatically.
+ */
+
+static int engine_fd        = -1;
+static int engine_lsock     = -1;
+static int engine_net_lsock = -1;
+static int engine_pipe_fds[EVENT_ENGINE_MAX_PIPES];
+static int engine_pipe_count = 0;
+
+// sentinels used as event user data for the registered pipe fds; the
+// offset into the array identifies the pipe in the event
+static char pipe_sentinels[EVENT_ENGINE_MAX_PIPES];
+// sentinel used as event user data for the registered network listen socket
+static char net_listener_sentinel;
+
+// how many ready events one wait call fetches; more than one is needed so
+// ready connections of different users are visible for the fair pick
+#define ENGINE_MAX_EVENTS 16
+
+/**
+ * @brief picks one of the ready client connections, cycling between peer
+ * uids
+ *
+ * The engine is level-triggered, so the connections that are not picked
+ * stay ready and show up again on the next wait call. It is therefore
+ * enough to prefer a connection belonging to a different uid than the one
+ * served last: a single user looping requests then shares the agent with
+ * everyone else instead of monopolizing it.
+ */
+static struct connection* _pickFairly(struct connection** ready, int count) {
+  static uid_t       last_uid = (uid_t)-1;
+  struct connection* pick     = ready[0];
+  for (int i = 0; i < count; i++) {
+    if (ready[i]->peer_uid != last_uid) {
+      pick = ready[i];
+      break;
+    }
+  }
+  last_uid = pick->peer_uid;
+  return pick;
+}
+
+#ifdef __APPLE__
+
+oidc_error_t eventEngine_init(int listen_sock) {
+  if (engine_fd != -1) {
+    return OIDC_SUCCESS;
+  }
+  engine_fd = kqueue();
+  if (engine_fd == -1) {
+    logger(ALERT, "kqueue: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  struct kevent ev;
+  EV_SET(&ev, listen_sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+  if (kevent(engine_fd, &ev, 1, NULL, 0, NULL) == -1) {
+    logger(ALERT, "kevent add listen sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_lsock = listen_sock;
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerClient(struct connection* con) {
+  struct kevent ev;
+  EV_SET(&ev, *(con->msgsock), EVFILT_READ, EV_ADD, 0, 0, con);
+  if (kevent(engine_fd, &ev, 1, NULL, 0, NULL) == -1) {
+    logger(ERROR, "kevent add client sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerNetListener(int listen_sock) {
+  if (engine_net_lsock == listen_sock) {
+    return OIDC_SUCCESS;
+  }
+  struct kevent ev;
+  EV_SET(&ev, listen_sock, EVFILT_READ, EV_ADD, 0, 0, &net_listener_sentinel);
+  if (kevent(engine_fd, &ev, 1, NULL, 0, NULL) == -1) {
+    logger(ERROR, "kevent add net listen sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_net_lsock = listen_sock;
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerPipe(int pipe_rx) {
+  for (int i = 0; i < engine_pipe_count; i++) {
+    if (engine_pipe_fds[i] == pipe_rx) {
+      return OIDC_SUCCESS;
+    }
+  }
+  if (engine_pipe_count >= EVENT_ENGINE_MAX_PIPES) {
+    oidc_seterror("too many pipes registered with the event engine");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  struct kevent ev;
+  EV_SET(&ev, pipe_rx, EVFILT_READ, EV_ADD, 0, 0,
+         &pipe_sentinels[engine_pipe_count]);
+  if (kevent(engine_fd, &ev, 1, NULL, 0, NULL) == -1) {
+    logger(ERROR, "kevent add pipe fd: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_pipe_fds[engine_pipe_count++] = pipe_rx;
+  return OIDC_SUCCESS;
+}
+
+struct engine_event eventEngine_waitWithTimeout(time_t death) {
+  struct engine_event event   = {0, 0, 0, -1, NULL};
+  struct timeval      timeout_storage;
+  struct timeval*     timeout = initTimeout(&timeout_storage, death);
+  if (oidc_errno != OIDC_SUCCESS) {  // death before now
+    return event;
+  }
+  struct timespec  ts;
+  struct timespec* tsp = NULL;
+  if (timeout != NULL) {
+    ts.tv_sec  = timeout->tv_sec;
+    ts.tv_nsec = 0;
+    tsp        = &ts;
+  }
+  struct kevent evs[ENGINE_MAX_EVENTS];
+  int           ret = kevent(engine_fd, NULL, 0, evs, ENGINE_MAX_EVENTS, tsp);
+  if (ret < 0) {
+    logger(ERROR, "kevent: %m");
+    oidc_errno = OIDC_ESELECT;
+    return event;
+  }
+  if (ret == 0) {
+    logger(DEBUG, "Reached event engine timeout");
+    oidc_errno = OIDC_ETIMEOUT;
+    return event;
+  }
+  struct connection* ready[ENGINE_MAX_EVENTS];
+  int                readyCount = 0;
+  for (int i = 0; i < ret; i++) {
+    if ((int)evs[i].ident == engine_lsock) {
+      event.new_client = 1;
+    } else if (evs[i].udata == &net_listener_sentinel) {
+      event.new_net_client = 1;
+    } else if ((char*)evs[i].udata >= pipe_sentinels &&
+               (char*)evs[i].udata < pipe_sentinels + EVENT_ENGINE_MAX_PIPES) {
+      event.pipe_ready = 1;
+      event.pipe_idx   = (int)((char*)evs[i].udata - pipe_sentinels);
+    } else {
+      ready[readyCount++] = evs[i].udata;
+    }
+  }
+  oidc_errno = OIDC_SUCCESS;
+  if (event.new_client || event.new_net_client ||
+      event.pipe_ready) {  // served first; the client events that are not
+                           // consumed now show up again
+    return event;
+  }
+  event.con = _pickFairly(ready, readyCount);
+  return event;
+}
+
+#else
+
+oidc_error_t eventEngine_init(int listen_sock) {
+  if (engine_fd != -1) {
+    return OIDC_SUCCESS;
+  }
+  engine_fd = epoll_create1(0);
+  if (engine_fd == -1) {
+    logger(ALERT, "epoll_create1: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  struct epoll_event ev = {.events = EPOLLIN, .data = {.ptr = NULL}};
+  if (epoll_ctl(engine_fd, EPOLL_CTL_ADD, listen_sock, &ev) == -1) {
+    logger(ALERT, "epoll_ctl add listen sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_lsock = listen_sock;
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerClient(struct connection* con) {
+  struct epoll_event ev = {.events = EPOLLIN, .data = {.ptr = con}};
+  if (epoll_ctl(engine_fd, EPOLL_CTL_ADD, *(con->msgsock), &ev) == -1) {
+    logger(ERROR, "epoll_ctl add client sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerNetListener(int listen_sock) {
+  if (engine_net_lsock == listen_sock) {
+    return OIDC_SUCCESS;
+  }
+  struct epoll_event ev = {.events = EPOLLIN,
+                           .data   = {.ptr = &net_listener_sentinel}};
+  if (epoll_ctl(engine_fd, EPOLL_CTL_ADD, listen_sock, &ev) == -1) {
+    logger(ERROR, "epoll_ctl add net listen sock: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_net_lsock = listen_sock;
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t eventEngine_registerPipe(int pipe_rx) {
+  for (int i = 0; i < engine_pipe_count; i++) {
+    if (engine_pipe_fds[i] == pipe_rx) {
+      return OIDC_SUCCESS;
+    }
+  }
+  if (engine_pipe_count >= EVENT_ENGINE_MAX_PIPES) {
+    oidc_seterror("too many pipes registered with the event engine");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  struct epoll_event ev = {.events = EPOLLIN,
+                           .data = {.ptr = &pipe_sentinels[engine_pipe_count]}};
+  if (epoll_ctl(engine_fd, EPOLL_CTL_ADD, pipe_rx, &ev) == -1) {
+    logger(ERROR, "epoll_ctl add pipe fd: %m");
+    oidc_errno = OIDC_ESELECT;
+    return oidc_errno;
+  }
+  engine_pipe_fds[engine_pipe_count++] = pipe_rx;
+  return OIDC_SUCCESS;
+}
+
+struct engine_event eventEngine_waitWithTimeout(time_t death) {
+  struct engine_event event   = {0, 0, 0, -1, NULL};
+  struct timeval      timeout_storage;
+  struct timeval*     timeout = initTimeout(&timeout_storage, death);
+  if (oidc_errno != OIDC_SUCCESS) {  // death before now
+    return event;
+  }
+  int timeout_ms = -1;
+  if (timeout != NULL) {
+    timeout_ms = timeout->tv_sec * 1000;
+  }
+  struct epoll_event evs[ENGINE_MAX_EVENTS];
+  int ret = epoll_wait(engine_fd, evs, ENGINE_MAX_EVENTS, timeout_ms);
+  if (ret < 0) {
+    logger(ERROR, "epoll_wait: %m");
+    oidc_errno = OIDC_ESELECT;
+    return event;
+  }
+  if (ret == 0) {
+    logger(DEBUG, "Reached event engine timeout");
+    oidc_errno = OIDC_ETIMEOUT;
+    return event;
+  }
+  struct connection* ready[ENGINE_MAX_EVENTS];
+  int                readyCount = 0;
+  for (int i = 0; i < ret; i++) {
+    if (evs[i].data.ptr == NULL) {  // the listening socket was registered
+                                    // with a NULL pointer
+      event.new_client = 1;
+    } else if (evs[i].data.ptr == &net_listener_sentinel) {
+      event.new_net_client = 1;
+    } else if ((char*)evs[i].data.ptr >= pipe_sentinels &&
+               (char*)evs[i].data.ptr <
+                   pipe_sentinels + EVENT_ENGINE_MAX_PIPES) {
+      event.pipe_ready = 1;
+      event.pipe_idx   = (int)((char*)evs[i].data.ptr - pipe_sentinels);
+    } else {
+      ready[readyCount++] = evs[i].data.ptr;
+    }
+  }
+  oidc_errno = OIDC_SUCCESS;
+  if (event.new_client || event.new_net_client ||
+      event.pipe_ready) {  // served first; the client events that are not
+                           // consumed now show up again
+    return event;
+  }
+  event.con = _pickFairly(ready, readyCount);
+  return event;
+}
+
+#endif  // __APPLE__
+
+void eventEngine_close() {
+  if (engine_fd != -1) {
+    close(engine_fd);
+    engine_fd         = -1;
+    engine_lsock      = -1;
+    engine_net_lsock  = -1;
+    engine_pipe_count = 0;
+  }
+}
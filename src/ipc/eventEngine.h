@@ -0,0 +1,31 @@
+#ifndef IPC_EVENT_ENGINE_H
+#define IPC_EVENT_ENGINE_H
+
+#include "connection.h"
+#include "utils/oidc_error.h"
+
+#include <time.h>
+
+// how many pipe fds can be registered at once; bounds the number of oidcd
+// workers oidcp can watch
+#define EVENT_ENGINE_MAX_PIPES 8
+
+struct engine_event {
+  unsigned char      new_client; /**< set if the listening socket is readable */
+  unsigned char      new_net_client; /**< set if the registered network
+                                        listening socket is readable */
+  unsigned char      pipe_ready; /**< set if a registered pipe is readable */
+  int                pipe_idx;   /**< which registered pipe is readable, in
+                                    registration order; only valid if
+                                    pipe_ready is set */
+  struct connection* con; /**< ready client connection or @c NULL */
+};
+
+oidc_error_t        eventEngine_init(int listen_sock);
+oidc_error_t        eventEngine_registerClient(struct connection* con);
+oidc_error_t        eventEngine_registerNetListener(int listen_sock);
+oidc_error_t        eventEngine_registerPipe(int pipe_rx);
+struct engine_event eventEngine_waitWithTimeout(time_t death);
+void                eventEngine_close();
+
+#endif  // IPC_EVENT_ENGINE_H
@@ -1,17 +1,67 @@
+#define _XOPEN_SOURCE 700  // getaddrinfo
 #include "ipc.h"
 #include "defines/ipc_values.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/memzero.h"
 #include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
 
+#include <ctype.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
+#include <string.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/vm_sockets.h>
+#endif
+
+/**
+ * Messages are length-prefixed: a 4 byte big endian payload length followed
+ * by the payload. The reader learns the message size from the header instead
+ * of an ioctl(FIONREAD) probe - which also makes messages larger than one
+ * kernel buffer work - and the writer sends header and payload with one
+ * writev() call without concatenating them first.
+ */
+void ipc_packMsgLen(unsigned char header[IPC_LEN_PREFIX_SIZE],
+                    uint32_t      len) {
+  header[0] = (len >> 24) & 0xff;
+  header[1] = (len >> 16) & 0xff;
+  header[2] = (len >> 8) & 0xff;
+  header[3] = len & 0xff;
+}
+
+uint32_t ipc_unpackMsgLen(const unsigned char header[IPC_LEN_PREFIX_SIZE]) {
+  return ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) |
+         ((uint32_t)header[2] << 8) | (uint32_t)header[3];
+}
+
+static oidc_error_t _readExactly(const int _sock, char* buf, size_t len) {
+  size_t read_bytes = 0;
+  while (read_bytes < len) {
+    ssize_t read_ret = read(_sock, buf + read_bytes, len - read_bytes);
+    if (read_ret < 0) {
+      oidc_setErrnoError();
+      return oidc_errno;
+    }
+    if (read_ret == 0) {
+      logger(DEBUG, "Client disconnected");
+      oidc_errno = OIDC_EIPCDIS;
+      return oidc_errno;
+    }
+    read_bytes += read_ret;
+  }
+  return OIDC_SUCCESS;
+}
 
 oidc_error_t initConnectionWithoutPath(struct connection* con, int isServer) {
   con->server = secAlloc(sizeof(struct sockaddr_un));
@@ -39,9 +89,93 @@ oidc_error_t initClientConnection(struct connection* con) {
   return initConnectionWithoutPath(con, 0);
 }
 
+/**
+ * @brief initializes a client connection to a 'tcp://host:port' or
+ * 'vsock://cid:port' target
+ *
+ * Used when the socket path carries one of the network schemes, i.e. the
+ * agent was started with a network listener and the client runs in a
+ * container or VM that cannot reach the agent's unix socket. The resolved
+ * address is stored in the connection's @c net_server field, which
+ * @c ipc_connect uses instead of the unix socket path.
+ * @param con a pointer to the connection struct
+ * @param uri the target including the scheme prefix
+ * @return @c OIDC_SUCCESS on success, otherwise an error code
+ */
+static oidc_error_t _initNetConnection(struct connection* con,
+                                       const char*        uri) {
+  if (initConnectionWithoutPath(con, 0) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  con->net_server = secAlloc(sizeof(struct sockaddr_storage));
+  int sock        = -1;
+  if (strstarts(uri, IPC_VSOCK_SCHEME)) {
+#ifdef __linux__
+    const char* spec = uri + strlen(IPC_VSOCK_SCHEME);
+    const char* sep  = strchr(spec, ':');
+    if (sep == NULL || !isdigit(*spec) || !isdigit(*(sep + 1))) {
+      oidc_setInternalError("vsock address must be 'vsock://cid:port'");
+      return oidc_errno;
+    }
+    struct sockaddr_vm* addr = (struct sockaddr_vm*)con->net_server;
+    addr->svm_family         = AF_VSOCK;
+    addr->svm_cid            = (unsigned int)strToULong(spec);
+    addr->svm_port           = (unsigned int)strToULong(sep + 1);
+    con->net_server_len      = sizeof(struct sockaddr_vm);
+    sock                     = socket(AF_VSOCK, SOCK_STREAM, 0);
+#else
+    oidc_setInternalError("vsock is not supported on this platform");
+    return oidc_errno;
+#endif
+  } else {
+    char* host = oidc_strcopy(uri + strlen(IPC_TCP_SCHEME));
+    char* sep  = strrchr(host, ':');
+    if (sep == NULL) {
+      secFree(host);
+      oidc_setInternalError("tcp address must be 'tcp://host:port'");
+      return oidc_errno;
+    }
+    *sep                  = '\0';
+    struct addrinfo hints = {0};
+    hints.ai_family       = AF_UNSPEC;
+    hints.ai_socktype     = SOCK_STREAM;
+    struct addrinfo* res  = NULL;
+    int              gai  = getaddrinfo(host, sep + 1, &hints, &res);
+    if (gai != 0) {
+      logger(ERROR, "resolving '%s': %s", host, gai_strerror(gai));
+      secFree(host);
+      oidc_errno = OIDC_ECONSOCK;
+      return oidc_errno;
+    }
+    memcpy(con->net_server, res->ai_addr, res->ai_addrlen);
+    con->net_server_len = res->ai_addrlen;
+    sock                = socket(res->ai_family, res->ai_socktype,
+                                 res->ai_protocol);
+    if (sock >= 0) {  // the request/response ping-pong must not wait on
+                      // Nagle coalescing
+      int flag = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    freeaddrinfo(res);
+    secFree(host);
+  }
+  if (sock < 0) {
+    logger(ERROR, "opening network socket: %m");
+    oidc_errno = OIDC_ECRSOCK;
+    return oidc_errno;
+  }
+  close(*(con->sock));  // replaces the unix socket of the generic init
+  *(con->sock) = sock;
+  return OIDC_SUCCESS;
+}
+
 oidc_error_t initConnectionWithPath(struct connection* con,
                                     const char*        socket_path) {
   logger(DEBUG, "initializing ipc with path %s\n", socket_path);
+  if (strstarts(socket_path, IPC_TCP_SCHEME) ||
+      strstarts(socket_path, IPC_VSOCK_SCHEME)) {
+    return _initNetConnection(con, socket_path);
+  }
   if (initConnectionWithoutPath(con, 0) != OIDC_SUCCESS) {
     return oidc_errno;
   }
@@ -57,9 +191,6 @@ oidc_error_t initConnectionWithPath(struct connection* con,
  */
 oidc_error_t ipc_client_init(struct connection* con, const char* env_var_name) {
   logger(DEBUG, "initializing client ipc");
-  if (initClientConnection(con) != OIDC_SUCCESS) {
-    return oidc_errno;
-  }
   const char* path = getenv(env_var_name);
   if (path == NULL) {
     printError("Could not get the socket path from env var '%s'. Have you "
@@ -69,10 +200,8 @@ oidc_error_t ipc_client_init(struct connection* con, const char* env_var_name) {
            env_var_name);
     oidc_errno = OIDC_EENVVAR;
     return OIDC_EENVVAR;
-  } else {
-    strcpy(con->server->sun_path, path);
   }
-  return OIDC_SUCCESS;
+  return initConnectionWithPath(con, path);
 }
 
 /**
@@ -81,6 +210,17 @@ oidc_error_t ipc_client_init(struct connection* con, const char* env_var_name) {
  * @return the socket or @c OIDC_ECONSOCK on failure
  */
 int ipc_connect(struct connection con) {
+  if (con.net_server != NULL) {
+    logger(DEBUG, "connecting network ipc\n");
+    if (connect(*(con.sock), (struct sockaddr*)con.net_server,
+                con.net_server_len) < 0) {
+      close(*(con.sock));
+      logger(ERROR, "connecting network socket: %m");
+      oidc_errno = OIDC_ECONSOCK;
+      return OIDC_ECONSOCK;
+    }
+    return *(con.sock);
+  }
   logger(DEBUG, "connecting ipc %s\n", con.server->sun_path);
   if (connect(*(con.sock), (struct sockaddr*)con.server,
               sizeof(struct sockaddr_un)) < 0) {
@@ -101,7 +241,14 @@ int ipc_connect(struct connection con) {
  */
 char* ipc_read(const int _sock) { return ipc_readWithTimeout(_sock, 0); }
 
-struct timeval* initTimeout(time_t death) {
+/**
+ * @brief fills @p timeout with the time left until @p death
+ * @param timeout caller-provided storage for the timeout
+ * @param death the absolute death time; @c 0 for no timeout
+ * @return @p timeout, or @c NULL if there is no timeout or @p death has
+ * already passed (distinguished by @c oidc_errno)
+ */
+struct timeval* initTimeout(struct timeval* timeout, time_t death) {
   if (death == 0) {
     oidc_errno = OIDC_SUCCESS;
     return NULL;
@@ -112,9 +259,9 @@ struct timeval* initTimeout(time_t death) {
     oidc_errno = OIDC_ETIMEOUT;
     return NULL;
   }
-  struct timeval* timeout = secAlloc(sizeof(struct timeval));
-  timeout->tv_sec         = death - now;
-  oidc_errno              = OIDC_SUCCESS;
+  timeout->tv_sec  = death - now;
+  timeout->tv_usec = 0;
+  oidc_errno       = OIDC_SUCCESS;
   return timeout;
 }
 
@@ -127,18 +274,34 @@ struct timeval* initTimeout(time_t death) {
  * is set.
  */
 char* ipc_readWithTimeout(const int _sock, time_t death) {
+  return ipc_readWithTimeoutIntoBuffer(_sock, death, NULL);
+}
+
+/**
+ * @brief reads a message from a socket, reusing the given receive buffer
+ * @param _sock the socket to read from
+ * @param death the epoch time when the timeout is reached; @c 0 for no
+ * timeout
+ * @param buffer a reusable receive buffer, grown geometrically as needed; if
+ * @c NULL a fresh buffer sized for the message is allocated and the returned
+ * pointer has to be freed after usage. If a buffer is given, the returned
+ * pointer points into it and must NOT be freed; release the buffer itself
+ * with @c secFreeIpcBuffer when the connection is closed.
+ */
+char* ipc_readWithTimeoutIntoBuffer(const int _sock, time_t death,
+                                    struct ipc_buffer* buffer) {
   logger(DEBUG, "ipc reading from socket %d\n", _sock);
   if (_sock < 0) {
     logger(ERROR, "invalid socket in ipc_read");
     oidc_errno = OIDC_ESOCKINV;
     return NULL;
   }
-  int    len = 0;
   int    rv;
   fd_set set;
   FD_ZERO(&set);
   FD_SET(_sock, &set);
-  struct timeval* timeout = initTimeout(death);
+  struct timeval  timeout_storage;
+  struct timeval* timeout = initTimeout(&timeout_storage, death);
   if (oidc_errno != OIDC_SUCCESS) {  // death before now
     return NULL;
   }
@@ -152,33 +315,63 @@ char* ipc_readWithTimeout(const int _sock, time_t death) {
     oidc_errno = OIDC_ETIMEOUT;
     return NULL;
   }
-  if (ioctl(_sock, FIONREAD, &len) != 0) {
-    logger(ERROR, "ioctl: %m");
-    oidc_errno = OIDC_EIOCTL;
+  unsigned char header[IPC_LEN_PREFIX_SIZE];
+  if (_readExactly(_sock, (char*)header, IPC_LEN_PREFIX_SIZE) !=
+      OIDC_SUCCESS) {
     return NULL;
   }
-  if (len <= 0) {
+  uint32_t len = ipc_unpackMsgLen(header);
+  if (len == 0) {
     logger(DEBUG, "Client disconnected");
     oidc_errno = OIDC_EIPCDIS;
     return NULL;
   }
-  char* buf = secAlloc(sizeof(char) * (len + 1));
-  logger(DEBUG, "ipc want to read %d bytes", len);
-  int read_bytes = 0;
-  while (read_bytes < len) {
-    int read_ret = read(_sock, buf + read_bytes, len - read_bytes);
-    if (read_ret < 0) {
-      oidc_setErrnoError();
+  if (len > IPC_MAX_MSG_LEN) {
+    // the prefix comes from the peer; an absurd length must not size an
+    // allocation (or wrap the len+1 arithmetic below)
+    logger(ERROR, "ipc message length %u exceeds the maximum of %u", len,
+           (unsigned int)IPC_MAX_MSG_LEN);
+    oidc_errno = OIDC_EMSGSIZE;
+    return NULL;
+  }
+  size_t needed = (size_t)len + 1;
+  char*  buf;
+  if (buffer != NULL) {
+    if (buffer->cap < needed) {
+      size_t newCap = buffer->cap ? buffer->cap : 256;
+      while (newCap < needed) { newCap *= 2; }
+      secFreeIpcBuffer(buffer);
+      buffer->data = secAlloc(newCap);
+      buffer->cap  = newCap;
+    }
+    buf = buffer->data;
+  } else {
+    buf = secAlloc(needed);
+  }
+  logger(DEBUG, "ipc want to read %u bytes", len);
+  if (_readExactly(_sock, buf, len) != OIDC_SUCCESS) {
+    if (buffer == NULL) {
       secFree(buf);
-      return NULL;
     }
-    read_bytes += read_ret;
-    logger(DEBUG, "ipc did read %d bytes in total", read_bytes);
+    return NULL;
   }
+  buf[len] = '\0';
   logger(DEBUG, "ipc read '%s'", buf);
   return buf;
 }
 
+/**
+ * @brief wipes and releases a reusable receive buffer
+ */
+void secFreeIpcBuffer(struct ipc_buffer* buffer) {
+  if (buffer == NULL || buffer->data == NULL) {
+    return;
+  }
+  secFreeN(buffer->data, buffer->cap);
+  buffer->data = NULL;
+  buffer->cap  = 0;
+}
+
 /**
  * @brief writes a message to a socket
  * @param _sock the socket to write to
@@ -198,30 +391,160 @@ oidc_error_t ipc_vwrite(int _sock, const char* fmt, va_list args) {
   if (msg == NULL) {
     return oidc_errno;
   }
-  size_t msg_len = strlen(msg);
+  oidc_error_t e = ipc_writeMessage(_sock, msg);
+  secFree(msg);
+  return e;
+}
+
+/**
+ * @brief writes an already fully rendered message, given as multiple parts
+ *
+ * The parts and the length prefix are handed to the kernel in a single
+ * writev, so the message does not have to be assembled into one contiguous
+ * buffer first - a rendered response can go zero-copy into the send.
+ * @param _sock the socket to write to
+ * @param parts the message parts, sent back to back
+ * @param count the number of parts; at most @c IPC_WRITE_MAX_PARTS
+ * @return @c OIDC_SUCCESS on success
+ */
+oidc_error_t ipc_writeParts(int _sock, const char* const* parts,
+                            size_t count) {
+  if (parts == NULL || count == 0 || count > IPC_WRITE_MAX_PARTS) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct iovec iov[IPC_WRITE_MAX_PARTS + 1];
+  size_t       msg_len = 0;
+  size_t       used    = 1;  // iov[0] is the length prefix
+  for (size_t i = 0; i < count; i++) {
+    if (parts[i] == NULL) {
+      continue;
+    }
+    size_t len = strlen(parts[i]);
+    if (len == 0) {
+      continue;
+    }
+    iov[used].iov_base = (void*)parts[i];
+    iov[used].iov_len  = len;
+    msg_len += len;
+    used++;
+  }
   if (msg_len == 0) {  // Don't send an empty message. This will be read as
                        // client disconnected
-    msg_len = 1;
-    secFree(msg);
-    msg = oidc_strcopy(" ");
+    iov[1].iov_base = " ";
+    iov[1].iov_len  = 1;
+    msg_len         = 1;
+    used            = 2;
   }
   logger(DEBUG, "ipc writing %lu bytes to socket %d", msg_len, _sock);
-  logger(DEBUG, "ipc write message '%s'", msg);
-  ssize_t written_bytes = write(_sock, msg, msg_len);
-  secFree(msg);
+  unsigned char header[IPC_LEN_PREFIX_SIZE];
+  ipc_packMsgLen(header, msg_len);
+  iov[0].iov_base       = header;
+  iov[0].iov_len        = IPC_LEN_PREFIX_SIZE;
+  // MSG_NOSIGNAL: clients reusing a connection the agent already closed have
+  // to see EPIPE and reconnect instead of being killed by SIGPIPE
+  struct msghdr mh = {0};
+  mh.msg_iov       = iov;
+  mh.msg_iovlen    = used;
+  ssize_t written_bytes = sendmsg(_sock, &mh, MSG_NOSIGNAL);
+  if (written_bytes < 0 && errno == ENOTSOCK) {  // the oidcp-oidcd pipes are
+                                                 // written through here too
+    written_bytes = writev(_sock, iov, used);
+  }
   if (written_bytes < 0) {
     logger(ALERT, "writing on stream socket: %m");
     oidc_errno = OIDC_EWRITE;
     return oidc_errno;
   }
-  if ((size_t)written_bytes < msg_len) {
+  if ((size_t)written_bytes < msg_len + IPC_LEN_PREFIX_SIZE) {
     oidc_errno = OIDC_EMSGSIZE;
     return oidc_errno;
   }
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief writes an already fully rendered message
+ *
+ * Unlike @c ipc_write the message is not run through the format-string
+ * machinery again.
+ */
+oidc_error_t ipc_writeMessage(int _sock, const char* msg) {
+  logger(DEBUG, "ipc write message '%s'", msg);
+  return ipc_writeParts(_sock, &msg, 1);
+}
+
+/*
+ * Error responses repeat: under an issuer outage the same OIDC_E* code is
+ * answered thousands of times, and rendering the identical json each time
+ * is wasted cpu. Responses for fixed codes are formatted once per thread
+ * and reused; codes whose message is dynamic (captured errno / oidc error
+ * text, http status) reuse the last rendered response as long as code and
+ * message match.
+ */
+
+#define ERROR_RESPONSE_CACHE_SIZE 16
+
+struct error_response {
+  int   code;
+  char* resp;
+};
+
+static __thread struct error_response error_responses[ERROR_RESPONSE_CACHE_SIZE];
+static __thread unsigned char         error_responses_len = 0;
+
+// codes whose message lives in the thread's oidc_error buffer or encodes an
+// http status; their rendered response cannot be reused by code alone
+static int _errnoIsDynamic(int e) {
+  return e == OIDC_EERROR || e == OIDC_EARGNULLFUNC || e == OIDC_EOIDC ||
+         e == OIDC_EINTERNAL || e == OIDC_EGERROR || (e >= 200 && e < 600);
+}
+
+static const char* _errorResponseFor(int code) {
+  for (unsigned char i = 0; i < error_responses_len; i++) {
+    if (error_responses[i].code == code) {
+      return error_responses[i].resp;
+    }
+  }
+  if (error_responses_len >= ERROR_RESPONSE_CACHE_SIZE) {
+    return NULL;
+  }
+  char* resp = oidc_sprintf(RESPONSE_ERROR, oidc_serrorFor(code));
+  if (resp == NULL) {
+    return NULL;
+  }
+  error_responses[error_responses_len].code   = code;
+  error_responses[error_responses_len++].resp = resp;  // kept for the
+                                                       // thread's lifetime
+  return resp;
+}
+
 oidc_error_t ipc_writeOidcErrno(int sock) {
+  if (_errnoIsDynamic(oidc_errno)) {
+    static __thread int   last_code = 0;
+    static __thread char  last_msg[sizeof(oidc_error)];
+    static __thread char* last_resp = NULL;
+    const char*           msg       = oidc_serror();
+    if (last_resp != NULL && last_code == oidc_errno &&
+        strequal(msg, last_msg)) {
+      return ipc_writeMessage(sock, last_resp);
+    }
+    char* resp = oidc_sprintf(RESPONSE_ERROR, msg);
+    if (resp == NULL) {
+      return ipc_write(sock, RESPONSE_ERROR, msg);
+    }
+    last_code = oidc_errno;
+    strncpy(last_msg, msg, sizeof(last_msg) - 1);
+    last_msg[sizeof(last_msg) - 1] = '\0';
+    secFree(last_resp);
+    last_resp        = resp;
+    oidc_error_t ret = ipc_writeMessage(sock, resp);
+    return ret;
+  }
+  const char* resp = _errorResponseFor(oidc_errno);
+  if (resp != NULL) {
+    return ipc_writeMessage(sock, resp);
+  }
   return ipc_write(sock, RESPONSE_ERROR, oidc_serror());
 }
 
@@ -5,19 +5,65 @@
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+/**
+ * Reusable receive buffer for a long-lived connection. Grown geometrically
+ * and wiped before every release, so reading many messages from the same fd
+ * does not allocate per message.
+ */
+struct ipc_buffer {
+  char*  data;
+  size_t cap;
+};
+
+/**
+ * Socket path schemes for the network listener. A socket path of the form
+ * 'tcp://host:port' or 'vsock://cid:port' makes the client connect over the
+ * network instead of a unix domain socket; everything else is a unix socket
+ * path.
+ */
+#define IPC_TCP_SCHEME "tcp://"
+#define IPC_VSOCK_SCHEME "vsock://"
+
 oidc_error_t initConnectionWithoutPath(struct connection*, int);
 oidc_error_t initConnectionWithPath(struct connection*, const char*);
 oidc_error_t ipc_client_init(struct connection*, const char*);
 
 int ipc_connect(struct connection con);
 
+/**
+ * Messages are length-prefixed: a 4 byte big endian payload length followed
+ * by the payload. The pack/unpack helpers are exported for callers that do
+ * their own non-blocking reads and writes on an agent socket.
+ */
+#define IPC_LEN_PREFIX_SIZE 4
+
+// upper bound for a single message; the length prefix comes from the peer,
+// so it must not be trusted to size allocations unbounded. Large enough for
+// a bulk token batch or a metrics dump; can be overridden at build time.
+#ifndef IPC_MAX_MSG_LEN
+#define IPC_MAX_MSG_LEN (16 * 1024 * 1024)
+#endif
+
+void     ipc_packMsgLen(unsigned char header[IPC_LEN_PREFIX_SIZE],
+                        uint32_t      len);
+uint32_t ipc_unpackMsgLen(const unsigned char header[IPC_LEN_PREFIX_SIZE]);
+
 char* ipc_read(const int _sock);
 char* ipc_readWithTimeout(const int _sock, time_t timeout);
+char* ipc_readWithTimeoutIntoBuffer(const int _sock, time_t timeout,
+                                    struct ipc_buffer* buffer);
+void  secFreeIpcBuffer(struct ipc_buffer* buffer);
+
+#define IPC_WRITE_MAX_PARTS 8
 
 oidc_error_t ipc_write(int _sock, const char* msg, ...);
 oidc_error_t ipc_vwrite(int _sock, const char* msg, va_list args);
+oidc_error_t ipc_writeMessage(int _sock, const char* msg);
+oidc_error_t ipc_writeParts(int _sock, const char* const* parts, size_t count);
 oidc_error_t ipc_writeOidcErrno(int sock);
 
 int          ipc_close(int _sock);
@@ -27,6 +73,6 @@ oidc_error_t ipc_closeAndUnlinkConnection(struct connection* con);
 char* ipc_communicateWithSock(int sock, const char* fmt, ...);
 char* ipc_vcommunicateWithSock(int sock, const char* fmt, va_list args);
 
-struct timeval* initTimeout(time_t death);
+struct timeval* initTimeout(struct timeval* timeout, time_t death);
 
 #endif  // IPC_H
@@ -2,33 +2,52 @@
 #include "pipe.h"
 #include "defines/ipc_values.h"
 #include "ipc/ipc.h"
+#include "utils/agent_sdt.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/memzero.h"
 #include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+// Serializes pipe writes so worker threads and the main loop cannot
+// interleave their messages.
+static pthread_mutex_t pipe_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Separates the request id header from the payload in a pipe message. Every
+// message written to a pipe is tagged with the id of the request it belongs
+// to, so oidcp can have multiple requests in flight to oidcd and route
+// responses and internal requests to the right one. The header also carries
+// the sender's current trace id ("<id>:<trace>"), so log lines of both
+// processes working on one request can be correlated.
+#define PIPE_RID_SEP 0x1f
+
+// Reusable receive buffer for the process' pipe read end; released when the
+// pipes are closed.
+static struct ipc_buffer pipe_rx_buffer;
+
 void ipc_closePipes(struct ipcPipe p) {
   close(p.rx);
   close(p.tx);
+  secFreeIpcBuffer(&pipe_rx_buffer);
 }
 
 struct pipeSet ipc_pipe_init() {
   int fd1[2];
   int fd2[2];
-#ifdef __APPLE__
+  // The length-prefixed framing in the ipc layer delimits messages, so the
+  // pipes are plain byte streams; O_DIRECT packet mode would truncate
+  // messages at the header read.
   if (pipe(fd1) != 0) {
-#else
-  if (pipe2(fd1, O_DIRECT) != 0) {
-#endif
     oidc_setErrnoError();
     return (struct pipeSet){{-1, -1}, {-1, -1}};
   }
-#ifdef __APPLE__
   if (pipe(fd2) != 0) {
-#else
-  if (pipe2(fd2, O_DIRECT) != 0) {
-#endif
     oidc_setErrnoError();
     return (struct pipeSet){{-1, -1}, {-1, -1}};
   }
@@ -39,6 +58,7 @@ struct pipeSet ipc_pipe_init() {
 
 struct ipcPipe toServerPipes(struct pipeSet pipes) {
   struct ipcPipe server;
+  server.id = 0;
   close(pipes.pipe1.tx);
   server.rx = pipes.pipe1.rx;
   close(pipes.pipe2.rx);
@@ -48,6 +68,7 @@ struct ipcPipe toServerPipes(struct pipeSet pipes) {
 
 struct ipcPipe toClientPipes(struct pipeSet pipes) {
   struct ipcPipe client;
+  client.id = 0;
   close(pipes.pipe1.rx);
   client.tx = pipes.pipe1.tx;
   close(pipes.pipe2.tx);
@@ -63,18 +84,114 @@ oidc_error_t ipc_writeToPipe(struct ipcPipe pipes, char* fmt, ...) {
   return ret;
 }
 
+// Messages up to this payload size are rendered - length prefix, id/trace
+// header and payload together - into one stack buffer and written with a
+// single write(). That covers the bulk of pipe traffic (status accepts,
+// error responses, internal requests), which otherwise pays two heap
+// allocations and a double copy per message: one for the payload and one
+// for the header-plus-payload assembly.
+#define PIPE_INLINE_MAX 512
+
 oidc_error_t ipc_vwriteToPipe(struct ipcPipe pipes, char* fmt, va_list args) {
-  return ipc_vwrite(pipes.tx, fmt, args);
+  char    buf[IPC_LEN_PREFIX_SIZE + PIPE_INLINE_MAX];
+  va_list fallback;
+  va_copy(fallback, args);
+  int header_len = snprintf(buf + IPC_LEN_PREFIX_SIZE, PIPE_INLINE_MAX,
+                            "%lu:%s%c", pipes.id, agent_trace_get() ?: "",
+                            PIPE_RID_SEP);
+  int payload_len = -1;
+  if (header_len > 0 && header_len < PIPE_INLINE_MAX) {
+    payload_len = vsnprintf(buf + IPC_LEN_PREFIX_SIZE + header_len,
+                            PIPE_INLINE_MAX - header_len, fmt, args);
+  }
+  if (payload_len >= 0 && header_len + payload_len < PIPE_INLINE_MAX) {
+    va_end(fallback);
+    size_t msg_len = (size_t)(header_len + payload_len);
+    AGENT_PROBE2(pipe_write, pipes.id,
+                 buf + IPC_LEN_PREFIX_SIZE + header_len);
+    ipc_packMsgLen((unsigned char*)buf, msg_len);
+    // a single write below PIPE_BUF is atomic on a pipe, but the lock is
+    // still needed to not interleave with a large message's writev
+    pthread_mutex_lock(&pipe_write_lock);
+    ssize_t written_bytes =
+        write(pipes.tx, buf, IPC_LEN_PREFIX_SIZE + msg_len);
+    pthread_mutex_unlock(&pipe_write_lock);
+    moresecure_memzero(buf + IPC_LEN_PREFIX_SIZE, msg_len);  // may hold tokens
+    if (written_bytes < 0) {
+      logger(ALERT, "writing on pipe: %m");
+      oidc_errno = OIDC_EWRITE;
+      return oidc_errno;
+    }
+    if ((size_t)written_bytes < IPC_LEN_PREFIX_SIZE + msg_len) {
+      oidc_errno = OIDC_EMSGSIZE;
+      return oidc_errno;
+    }
+    return OIDC_SUCCESS;
+  }
+  // payload does not fit inline; assemble it on the heap as before
+  char* payload = oidc_vsprintf(fmt, fallback);
+  va_end(fallback);
+  if (payload == NULL) {
+    return oidc_errno;
+  }
+  AGENT_PROBE2(pipe_write, pipes.id, payload);
+  pthread_mutex_lock(&pipe_write_lock);
+  oidc_error_t ret = ipc_write(pipes.tx, "%lu:%s%c%s", pipes.id,
+                               agent_trace_get() ?: "", PIPE_RID_SEP, payload);
+  pthread_mutex_unlock(&pipe_write_lock);
+  secFree(payload);
+  return ret;
 }
 
 oidc_error_t ipc_writeOidcErrnoToPipe(struct ipcPipe pipes) {
   return ipc_writeToPipe(pipes, RESPONSE_ERROR, oidc_serror());
 }
 
-char* ipc_readFromPipe(struct ipcPipe pipes) { return ipc_read(pipes.rx); }
+char* ipc_readFromPipe(struct ipcPipe pipes) {
+  return ipc_readFromPipeWithTimeout(pipes, 0);
+}
 
 char* ipc_readFromPipeWithTimeout(struct ipcPipe pipes, time_t timeout) {
-  return ipc_readWithTimeout(pipes.rx, timeout);
+  struct pipeMessage pm = ipc_readMessageFromPipeWithTimeout(pipes, timeout);
+  return pm.msg;
+}
+
+struct pipeMessage ipc_readMessageFromPipe(struct ipcPipe pipes) {
+  return ipc_readMessageFromPipeWithTimeout(pipes, 0);
+}
+
+/**
+ * @brief reads a message from the pipe and splits off its request id and
+ * trace id header
+ * @return a pipeMessage struct; @c msg is @c NULL on error / timeout and has
+ * to be freed after usage otherwise
+ */
+struct pipeMessage ipc_readMessageFromPipeWithTimeout(struct ipcPipe pipes,
+                                                      time_t         timeout) {
+  struct pipeMessage pm = {0, NULL, ""};
+  char*              raw =
+      ipc_readWithTimeoutIntoBuffer(pipes.rx, timeout, &pipe_rx_buffer);
+  if (raw == NULL) {
+    return pm;
+  }
+  char* sep = strchr(raw, PIPE_RID_SEP);
+  if (sep == NULL) {  // message without id header
+    pm.msg = oidc_strcopy(raw);
+    return pm;
+  }
+  pm.id       = strToULong(raw);  // strToULong stops at the ':'
+  char* colon = strchr(raw, ':');
+  if (colon != NULL && colon < sep) {
+    size_t len = sep - colon - 1;
+    if (len > AGENT_TRACE_ID_LEN) {
+      len = AGENT_TRACE_ID_LEN;
+    }
+    memcpy(pm.trace, colon + 1, len);
+    pm.trace[len] = '\0';
+  }
+  pm.msg = oidc_strcopy(sep + 1);
+  AGENT_PROBE2(pipe_read, pm.id, pm.msg);
+  return pm;
 }
 
 char* ipc_vcommunicateThroughPipe(struct ipcPipe pipes, char* fmt,
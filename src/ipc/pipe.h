@@ -1,6 +1,7 @@
 #ifndef OIDC_IPC_PIPE_H
 #define OIDC_IPC_PIPE_H
 
+#include "utils/agent_trace.h"
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
@@ -9,6 +10,15 @@
 struct ipcPipe {
   int rx;
   int tx;
+  unsigned long id; /**< the request id pipe messages are tagged with */
+};
+
+struct pipeMessage {
+  unsigned long id;
+  char*         msg;
+  char trace[AGENT_TRACE_ID_LEN + 1]; /**< the trace id of the request the
+                                         message belongs to; empty if the
+                                         sender had none */
 };
 
 struct pipeSet {
@@ -26,6 +36,8 @@ oidc_error_t ipc_vwriteToPipe(struct ipcPipe, char*, va_list);
 oidc_error_t ipc_writeOidcErrnoToPipe(struct ipcPipe);
 char*        ipc_readFromPipe(struct ipcPipe);
 char*        ipc_readFromPipeWithTimeout(struct ipcPipe, time_t);
+struct pipeMessage ipc_readMessageFromPipe(struct ipcPipe);
+struct pipeMessage ipc_readMessageFromPipeWithTimeout(struct ipcPipe, time_t);
 char*        ipc_communicateThroughPipe(struct ipcPipe, char*, ...);
 char*        ipc_vcommunicateThroughPipe(struct ipcPipe, char*, va_list);
 
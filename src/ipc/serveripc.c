@@ -1,31 +1,151 @@
 #ifndef __APPLE__
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE  // struct ucred for SO_PEERCRED
 #endif
 #include "serveripc.h"
+#include "compactIpc.h"
 #include "cryptIpc.h"
 #include "defines/ipc_values.h"
+#include "eventEngine.h"
 #include "ipc.h"
 #include "ipc/cryptCommunicator.h"
 #include "list/list.h"
+#include "utils/agent_sdt.h"
+#include "utils/agent_trace.h"
 #include "utils/db/connection_db.h"
+#include "utils/file_io/file_io.h"
 #include "utils/file_io/fileUtils.h"
 #include "utils/json.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/stringUtils.h"
 
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <sys/fcntl.h>
-#include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/vm_sockets.h>
+#endif
 
 #define SOCKET_DIR "/tmp/oidc-XXXXXX"
+#define SOCKET_RUNTIME_SUBDIR "oidc-agent"
+
+/**
+ * listen backlog for the server socket; the old value of 5 overflows
+ * silently when many clients connect at once on a shared host and the
+ * kernel then drops connects. Can be overridden at build time.
+ */
+#ifndef IPC_LISTEN_BACKLOG
+#define IPC_LISTEN_BACKLOG 128
+#endif
 
 static char* oidc_ipc_dir       = NULL;
 static char* server_socket_path = NULL;
 
+/**
+ * @brief returns the per-user socket base dir under XDG_RUNTIME_DIR
+ * @return the base dir path, or @c NULL if XDG_RUNTIME_DIR is not usable.
+ * Has to be freed after usage.
+ */
+static char* _socketRuntimeBase() {
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (!strValid(runtime_dir) || dirExists(runtime_dir) <= 0) {
+    return NULL;
+  }
+  return oidc_sprintf("%s/%s", runtime_dir, SOCKET_RUNTIME_SUBDIR);
+}
+
+/**
+ * @brief removes socket dirs of agents that are no longer running
+ * The per-agent dirs under @p base are named '<pid>.XXXXXX'; a dir whose pid
+ * does not exist anymore is left over from an agent that did not shut down
+ * cleanly. Doing the sweep when a new agent starts batches the cleanup
+ * instead of leaving it to every kill path.
+ */
+static void _cleanupStaleSocketDirs(const char* base) {
+  DIR* dir = opendir(base);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strequal(ent->d_name, ".") || strequal(ent->d_name, "..")) {
+      continue;
+    }
+    pid_t pid = strToInt(ent->d_name);  // stops at the '.'
+    if (pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH) {
+      continue;  // agent still running (or pid reused); leave it alone
+    }
+    char* stale = oidc_sprintf("%s/%s", base, ent->d_name);
+    DEBUG_LOG("Removing stale socket dir '%s'", stale);
+    DIR* staleDir = opendir(stale);
+    if (staleDir != NULL) {
+      struct dirent* staleEnt;
+      while ((staleEnt = readdir(staleDir)) != NULL) {
+        if (strequal(staleEnt->d_name, ".") ||
+            strequal(staleEnt->d_name, "..")) {
+          continue;
+        }
+        char* path = oidc_sprintf("%s/%s", stale, staleEnt->d_name);
+        unlink(path);
+        secFree(path);
+      }
+      closedir(staleDir);
+    }
+    rmdir(stale);
+    secFree(stale);
+  }
+  closedir(dir);
+}
+
+/**
+ * @brief creates the per-agent socket dir
+ * Prefers a dir under XDG_RUNTIME_DIR - tmpfs, per-user and cleaned up by
+ * the system at logout - and falls back to a mkdtemp dir under /tmp. The
+ * stale dirs of dead agents under the runtime base are swept on the way.
+ * @return the socket dir path, or @c NULL on failure. Has to be freed after
+ * usage.
+ */
+static char* _createSocketDir() {
+  char* base = _socketRuntimeBase();
+  if (base != NULL) {
+    if (mkdir(base, 0700) != 0 && errno != EEXIST) {
+      logger(NOTICE, "could not create '%s': %m; falling back to /tmp", base);
+      secFree(base);
+      base = NULL;
+    }
+  }
+  if (base != NULL) {
+    _cleanupStaleSocketDirs(base);  // batched cleanup of dead agents' dirs
+    char* dir = oidc_sprintf("%s/%d.XXXXXX", base, (int)getppid());
+    secFree(base);
+    if (mkdtemp(dir) != NULL) {
+      return dir;
+    }
+    logger(NOTICE, "mkdtemp '%s': %m; falling back to /tmp", dir);
+    secFree(dir);
+  }
+  char* dir = oidc_strcopy(SOCKET_DIR);
+  if (mkdtemp(dir) == NULL) {
+    logger(ALERT, "%m");
+    oidc_errno = OIDC_EMKTMP;
+    secFree(dir);
+    return NULL;
+  }
+  return dir;
+}
+
 /**
  * @brief generates the socket path and prints commands for setting env vars
  * @param env_var_name the name of the environment variable which will be set.
@@ -36,10 +156,8 @@ static char* server_socket_path = NULL;
  */
 char* init_socket_path(const char* env_var_name, const char* group_name) {
   if (NULL == oidc_ipc_dir) {
-    oidc_ipc_dir = oidc_strcopy(SOCKET_DIR);
-    if (mkdtemp(oidc_ipc_dir) == NULL) {
-      logger(ALERT, "%m");
-      oidc_errno = OIDC_EMKTMP;
+    oidc_ipc_dir = _createSocketDir();
+    if (oidc_ipc_dir == NULL) {
       return NULL;
     }
     if (group_name != NULL) {
@@ -62,8 +180,75 @@ oidc_error_t initServerConnection(struct connection* con) {
   return initConnectionWithoutPath(con, 1);
 }
 
+// the first fd systemd passes per the sd_listen_fds protocol; reimplemented
+// here so socket activation does not pull in a libsystemd dependency
+#define SD_LISTEN_FDS_START 3
+
+static unsigned char socket_activated = 0;
+
+/**
+ * @brief returns the listen fd passed via systemd socket activation
+ * @return the fd, or @c -1 if the agent was not socket activated
+ */
+static int _systemdListenFd() {
+  const char* pidstr = getenv("LISTEN_PID");
+  const char* fdsstr = getenv("LISTEN_FDS");
+  if (!strValid(pidstr) || !strValid(fdsstr)) {
+    return -1;
+  }
+  if ((pid_t)strToInt(pidstr) != getpid() || strToInt(fdsstr) < 1) {
+    return -1;  // the fds were passed to another process
+  }
+  return SD_LISTEN_FDS_START;
+}
+
+/**
+ * @return @c 1 if the server socket was adopted from systemd socket
+ * activation, @c 0 if the agent created it itself
+ */
+int ipc_socketActivated() { return socket_activated; }
+
+/**
+ * @brief adopts an already bound and listening unix socket as the server
+ * socket
+ * Used for systemd socket activation and for --handoff, where the previous
+ * agent passes its listening socket on; the socket path is taken from the
+ * fd itself.
+ * @param con a pointer to the connection struct; initialized if it was not
+ * @param listen_fd the listening socket to adopt
+ * @param env_var_name if not @c NULL, the socket path export line for this
+ * variable is printed
+ */
+oidc_error_t ipc_server_adoptFd(struct connection* con, int listen_fd,
+                                const char* env_var_name) {
+  if (con->sock == NULL && initServerConnection(con) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  struct sockaddr_un addr = {0};
+  socklen_t          len  = sizeof(addr);
+  if (getsockname(listen_fd, (struct sockaddr*)&addr, &len) != 0 ||
+      addr.sun_family != AF_UNIX || !strValid(addr.sun_path)) {
+    logger(ERROR, "passed listen fd is not a usable unix socket: %m");
+    oidc_errno = OIDC_EBIND;
+    return oidc_errno;
+  }
+  DEBUG_LOG("adopting listen fd for '%s'", addr.sun_path);
+  close(*(con->sock));
+  *(con->sock) = listen_fd;
+  strcpy(con->server->sun_path, addr.sun_path);
+  server_socket_path = con->server->sun_path;
+  if (env_var_name) {
+    printf("%s=%s; export %s;\n", env_var_name, server_socket_path,
+           env_var_name);
+  }
+  return OIDC_SUCCESS;
+}
+
 /**
  * @brief initializes a server unix domain socket
+ * If systemd passed a listen fd (socket activation) it is adopted instead of
+ * creating a socket: the socket then already exists - and queues clients -
+ * before the agent is even started, and no socket dir has to be created.
  * @param con, a pointer to the connection struct. The relevant fields will be
  * initialized.
  * @param env_var_name, the socket_path environment variable name
@@ -72,10 +257,18 @@ oidc_error_t initServerConnection(struct connection* con) {
  */
 oidc_error_t ipc_server_init(struct connection* con, const char* env_var_name,
                              const char* group_name) {
-  logger(DEBUG, "initializing server ipc");
+  DEBUG_LOG("initializing server ipc");
   if (initServerConnection(con) != OIDC_SUCCESS) {
     return oidc_errno;
   }
+  int listen_fd = _systemdListenFd();
+  if (listen_fd >= 0) {
+    if (ipc_server_adoptFd(con, listen_fd, env_var_name) != OIDC_SUCCESS) {
+      return oidc_errno;
+    }
+    socket_activated = 1;
+    return OIDC_SUCCESS;
+  }
   char* path = init_socket_path(env_var_name, group_name);
   if (path == NULL) {
     return oidc_errno;
@@ -97,7 +290,7 @@ oidc_error_t ipc_initWithPath(struct connection* con) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  logger(DEBUG, "initializing ipc with path %s\n", server_socket_path);
+  DEBUG_LOG("initializing ipc with path %s\n", server_socket_path);
   if (initConnectionWithoutPath(con, 0) != OIDC_SUCCESS) {
     return oidc_errno;
   }
@@ -113,7 +306,15 @@ char* getServerSocketPath() { return server_socket_path; }
  * @return @c 0 on success or an errorcode on failure
  */
 int ipc_bindAndListen(struct connection* con) {
-  logger(DEBUG, "binding ipc\n");
+  if (socket_activated) {  // systemd already bound the socket and listens on
+                           // it; only the non-blocking mode is ours to set
+    int flags;
+    if (-1 == (flags = fcntl(*(con->sock), F_GETFL, 0)))
+      flags = 0;
+    fcntl(*(con->sock), F_SETFL, flags | O_NONBLOCK);
+    return 0;
+  }
+  DEBUG_LOG("binding ipc\n");
   unlink(con->server->sun_path);
   if (bind(*(con->sock), (struct sockaddr*)con->server,
            sizeof(struct sockaddr_un))) {
@@ -127,48 +328,142 @@ int ipc_bindAndListen(struct connection* con) {
     flags = 0;
   fcntl(*(con->sock), F_SETFL, flags | O_NONBLOCK);
 
-  logger(DEBUG, "listen ipc\n");
-  return listen(*(con->sock), 5);
+  DEBUG_LOG("listen ipc\n");
+  return listen(*(con->sock), IPC_LISTEN_BACKLOG);
 }
 
-int _determineMaxSockAndAddToReadSet(int sock_listencon, fd_set* readSet) {
-  int              maxSock = sock_listencon;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(connectionDB_getList(), LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    struct connection* con = node->val;
-    FD_SET(*(con->msgsock), readSet);
-    if (*(con->msgsock) > maxSock) {
-      maxSock = *(con->msgsock);
+static int net_listen_sock = -1;
+
+/**
+ * @brief binds and listens on an additional network listen socket
+ *
+ * The agent always serves its unix socket; this adds a tcp or vsock
+ * listener next to it, so clients in containers and VMs - which cannot
+ * reach the unix socket without mounting it in - can use the one agent on
+ * the host. Requests on this socket go through the same encrypted-IPC key
+ * exchange and length-prefixed framing as on the unix socket and plaintext
+ * requests are rejected. A network socket carries no peer credentials, so
+ * the handshake additionally requires the pre-shared key the agent creates
+ * on the first listener start (see the netAuth section in cryptIpc.c):
+ * only clients provisioned with the key file can use the agent. The tcp
+ * listener still binds to loopback unless an address is given, and wider
+ * exposure should additionally be confined with a firewall or network
+ * namespace.
+ * @param spec @c 'PORT' or @c 'ADDR:PORT' for tcp, @c 'vsock:PORT' for
+ * vsock
+ * @return @c 0 on success or an errorcode on failure
+ */
+int ipc_bindAndListenNet(const char* spec) {
+  if (ipc_netAuth_serverInit() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  int sock;
+  if (strstarts(spec, "vsock:")) {
+#ifdef __linux__
+    struct sockaddr_vm addr = {0};
+    addr.svm_family         = AF_VSOCK;
+    addr.svm_cid            = VMADDR_CID_ANY;
+    addr.svm_port           = (unsigned int)strToULong(spec + strlen("vsock:"));
+    sock                    = socket(AF_VSOCK, SOCK_STREAM, 0);
+    if (sock < 0) {
+      logger(ALERT, "opening vsock socket: %m");
+      oidc_errno = OIDC_ECRSOCK;
+      return OIDC_ECRSOCK;
+    }
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+      logger(ALERT, "binding vsock socket: %m");
+      close(sock);
+      oidc_errno = OIDC_EBIND;
+      return OIDC_EBIND;
+    }
+#else
+    oidc_setInternalError("vsock is not supported on this platform");
+    return oidc_errno;
+#endif
+  } else {
+    struct sockaddr_in addr = {0};
+    addr.sin_family         = AF_INET;
+    const char* sep         = strrchr(spec, ':');
+    const char* port        = sep != NULL ? sep + 1 : spec;
+    if (sep != NULL) {
+      char* host = oidc_strncopy(spec, sep - spec);
+      int   ok   = inet_pton(AF_INET, host, &addr.sin_addr);
+      secFree(host);
+      if (ok != 1) {
+        oidc_setInternalError("tcp listener address must be 'ADDR:PORT'");
+        return oidc_errno;
+      }
+    } else {
+      inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    }
+    if (!isdigit(*port)) {
+      oidc_setInternalError("tcp listener port must be numeric");
+      return oidc_errno;
+    }
+    addr.sin_port = htons(strToUShort(port));
+    sock          = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+      logger(ALERT, "opening tcp socket: %m");
+      oidc_errno = OIDC_ECRSOCK;
+      return OIDC_ECRSOCK;
+    }
+    int reuse = 1;  // a restarted agent must not wait out TIME_WAIT
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+      logger(ALERT, "binding tcp socket: %m");
+      close(sock);
+      oidc_errno = OIDC_EBIND;
+      return OIDC_EBIND;
     }
   }
-  list_iterator_destroy(it);
-  return maxSock;
+  int flags;
+  if (-1 == (flags = fcntl(sock, F_GETFL, 0)))
+    flags = 0;
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+  if (listen(sock, IPC_LISTEN_BACKLOG) != 0) {
+    logger(ALERT, "listen on network socket: %m");
+    close(sock);
+    oidc_errno = OIDC_EBIND;
+    return OIDC_EBIND;
+  }
+  DEBUG_LOG("listening on network listener '%s'", spec);
+  net_listen_sock = sock;
+  return OIDC_SUCCESS;
 }
 
-struct connection* _checkClientSocksForMsg(fd_set* readSet) {
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(connectionDB_getList(), LIST_TAIL);
-  while ((node = list_iterator_next(it))) {
-    struct connection* con = node->val;
-    logger(DEBUG, "Checking client %d", *(con->msgsock));
-    if (FD_ISSET(*(con->msgsock), readSet)) {
-      logger(DEBUG, "New message for read av");
-      list_iterator_destroy(it);
-      return con;
-    }
+/**
+ * @brief reads the uid of the peer connected on @p sock from the socket
+ * credentials
+ * @return the peer uid or @c (uid_t)-1 on error
+ */
+static uid_t _peerUid(int sock) {
+#ifdef __APPLE__
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(sock, &uid, &gid) == 0) {
+    return uid;
   }
-  list_iterator_destroy(it);
-  return NULL;
+#else
+  struct ucred cred;
+  socklen_t    len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) {
+    return cred.uid;
+  }
+#endif
+  logger(ERROR, "could not read peer credentials: %m");
+  return (uid_t)-1;
 }
 
 /**
  * @brief handles asynchronous server read for multiple sockets
  *
  * listens for incoming connections on the listencon and for incoming messages
- * on multiple client sockets. If a new client connects it is added to the list
- * of current client connections.  If on any client socket is a message
- * available for reading, a pointer to this connection is returned.
+ * on multiple client sockets. The sockets are registered once with the
+ * persistent event engine - the listening socket on the first call, client
+ * sockets when they are accepted - so a wakeup costs one wait call instead of
+ * a walk over the whole connection list. If a new client connects it is added
+ * to the list of current client connections. If on any client socket is a
+ * message available for reading, a pointer to this connection is returned.
  * @param listencon the connection struct for the socket accepting new client
  * connections. The list is updated if a new client connects.
  * @return A pointer to a client connection. On this connection is either a
@@ -176,47 +471,120 @@ struct connection* _checkClientSocksForMsg(fd_set* readSet) {
  */
 struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
     struct connection listencon, time_t death) {
-  while (1) {
-    fd_set readSockSet;
-    FD_ZERO(&readSockSet);
-    FD_SET(*(listencon.sock), &readSockSet);
-    int maxSock =
-        _determineMaxSockAndAddToReadSet(*(listencon.sock), &readSockSet);
-
-    struct timeval* timeout = initTimeout(death);
-    if (oidc_errno != OIDC_SUCCESS) {  // death before now
+  return ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipe(listencon, -1,
+                                                               death, NULL);
+}
+
+/**
+ * @brief like @c ipc_readAsyncFromMultipleConnectionsWithTimeout, but also
+ * watches the read end of the oidcd pipe
+ * @param pipe_rx the pipe fd to watch; pass @c -1 to not watch a pipe
+ * @param pipe_ready set to @c 1 if the function returned because the pipe
+ * became readable
+ */
+struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipe(
+    struct connection listencon, int pipe_rx, time_t death,
+    unsigned char* pipe_ready) {
+  int                ready_pipe = -1;
+  struct connection* con = ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipes(
+      listencon, &pipe_rx, pipe_rx >= 0 ? 1 : 0, death, &ready_pipe);
+  if (pipe_ready != NULL && ready_pipe >= 0) {
+    *pipe_ready = 1;
+  }
+  return con;
+}
+
+/**
+ * @brief like @c ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipe,
+ * but watches the read ends of several oidcd pipes (one per worker)
+ * @param pipe_rxs the pipe fds to watch
+ * @param pipe_count how many fds \p pipe_rxs holds
+ * @param ready_pipe set to the index of the readable pipe if the function
+ * returned because a pipe became readable; left untouched otherwise
+ */
+struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipes(
+    struct connection listencon, const int* pipe_rxs, size_t pipe_count,
+    time_t death, int* ready_pipe) {
+  if (eventEngine_init(*(listencon.sock)) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  for (size_t i = 0; i < pipe_count; i++) {
+    if (eventEngine_registerPipe(pipe_rxs[i]) != OIDC_SUCCESS) {
       return NULL;
     }
-    logger(DEBUG, "Calling select with maxSock %d and timeout %lu", maxSock,
-           timeout ? timeout->tv_sec : 0);
+  }
+  if (net_listen_sock >= 0 &&
+      eventEngine_registerNetListener(net_listen_sock) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  while (1) {
     // Waiting for incoming connections and messages
-    int ret = select(maxSock + 1, &readSockSet, NULL, NULL, timeout);
-    if (ret > 0) {
-      if (FD_ISSET(*(listencon.sock),
-                   &readSockSet)) {  // if listensock read something it means a
-                                     // new client connected
-        logger(DEBUG, "New incoming client");
-        struct connection* newClient = secAlloc(sizeof(struct connection));
-        newClient->msgsock           = secAlloc(sizeof(int));
-        *(newClient->msgsock)        = accept(*(listencon.sock), 0, 0);
-        if (*(newClient->msgsock) >= 0) {
-          logger(DEBUG, "accepted new client sock: %d", *(newClient->msgsock));
-          connectionDB_addValue(newClient);
-          logger(DEBUG, "updated client list");
-        } else {
-          logger(ERROR, "%m");
+    struct engine_event event = eventEngine_waitWithTimeout(death);
+    if (event.new_client) {  // if listensock read something it means a
+                             // new client connected
+      DEBUG_LOG("New incoming client");
+      struct connection* newClient = secAllocConnection();
+      *(newClient->msgsock)        = accept(*(listencon.sock), 0, 0);
+      if (*(newClient->msgsock) >= 0) {
+        AGENT_PROBE1(client_accept, *(newClient->msgsock));
+        DEBUG_LOG("accepted new client sock: %d", *(newClient->msgsock));
+        newClient->peer_uid = _peerUid(*(newClient->msgsock));
+        if (eventEngine_registerClient(newClient) != OIDC_SUCCESS) {
+          secFreeConnection(newClient);
+          continue;
         }
+        connectionDB_addValue(newClient);
+        DEBUG_LOG("updated client list");
+      } else {
+        logger(ERROR, "%m");
+        secFreeConnection(newClient);
       }
-      struct connection* con = _checkClientSocksForMsg(&readSockSet);
-      if (con) {
-        return con;
+      continue;
+    }
+    if (event.new_net_client) {  // a client connected on the tcp/vsock
+                                 // listener
+      DEBUG_LOG("New incoming network client");
+      struct connection* newClient = secAllocConnection();
+      *(newClient->msgsock)        = accept(net_listen_sock, 0, 0);
+      if (*(newClient->msgsock) >= 0) {
+        AGENT_PROBE1(client_accept, *(newClient->msgsock));
+        DEBUG_LOG("accepted new network client sock: %d",
+                  *(newClient->msgsock));
+        int flag = 1;  // harmless on vsock; the request/response ping-pong
+                       // must not wait on Nagle coalescing
+        setsockopt(*(newClient->msgsock), IPPROTO_TCP, TCP_NODELAY, &flag,
+                   sizeof(flag));
+        newClient->peer_uid = (uid_t)-1;  // no socket credentials here; all
+                                          // network clients share one
+                                          // fairness bucket
+        newClient->is_net   = 1;
+        if (eventEngine_registerClient(newClient) != OIDC_SUCCESS) {
+          secFreeConnection(newClient);
+          continue;
+        }
+        connectionDB_addValue(newClient);
+        DEBUG_LOG("updated client list");
+      } else {
+        logger(ERROR, "%m");
+        secFreeConnection(newClient);
+      }
+      continue;
+    }
+    if (event.pipe_ready) {
+      if (ready_pipe != NULL) {
+        *ready_pipe = event.pipe_idx;
       }
-    } else if (ret == 0) {
-      logger(DEBUG, "Reached select timeout");
-      oidc_errno = OIDC_ETIMEOUT;
       return NULL;
-    } else {
-      logger(ERROR, "%m");
+    }
+    if (event.con) {
+      DEBUG_LOG("New message for read av");
+      return event.con;
+    }
+    if (oidc_errno == OIDC_ETIMEOUT) {
+      return NULL;
+    }
+    if (oidc_errno != OIDC_SUCCESS) {
+      return NULL;
     }
   }
   return NULL;
@@ -234,23 +602,39 @@ char* ipc_vcryptCommunicateWithServerPath(const char* fmt, va_list args) {
   return ipc_vcryptCommunicateWithPath(server_socket_path, fmt, args);
 }
 
-extern list_t* encryptionKeys;
+/**
+ * @brief writes an unencrypted response; compact if the client on @p sock
+ * negotiated the compact framing and the message is representable, as json
+ * text otherwise
+ */
+static oidc_error_t _server_ipc_vwritePlain(const int sock, const char* fmt,
+                                            va_list args) {
+  if (!compactIpc_sockIsCompact(sock)) {
+    return ipc_vwrite(sock, fmt, args);
+  }
+  char* msg = oidc_vsprintf(fmt, args);
+  if (msg == NULL) {
+    return oidc_errno;
+  }
+  char*        compact = compactIpc_encode(msg);
+  oidc_error_t e       = ipc_writeMessage(sock, compact ?: msg);
+  secFree(compact);
+  secFree(msg);
+  return e;
+}
 
 oidc_error_t server_ipc_write(const int sock, const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  if (encryptionKeys == NULL || encryptionKeys->len <= 0) {
-    oidc_error_t ret = ipc_vwrite(sock, fmt, args);
+  struct ipc_keySet keys;
+  if (!connection_popKeySet(connection_findBySock(sock), &keys)) {
+    oidc_error_t ret = _server_ipc_vwritePlain(sock, fmt, args);
     va_end(args);
     return ret;
   }
-  list_node_t*       node = list_rpop(encryptionKeys);
-  struct ipc_keySet* keys = node->val;
-  LIST_FREE(node);
-
-  oidc_error_t e = ipc_vcryptWrite(sock, keys->key_tx, fmt, args);
+  oidc_error_t e = ipc_vcryptWrite(sock, keys.key_tx, fmt, args);
   va_end(args);
-  secFree(keys);
+  moresecure_memzero(&keys, sizeof(keys));
   if (e == OIDC_SUCCESS) {
     return OIDC_SUCCESS;
   }
@@ -258,8 +642,30 @@ oidc_error_t server_ipc_write(const int sock, const char* fmt, ...) {
 }
 
 char* server_ipc_read(const int sock) {
+  agent_trace_begin();  // a new client request starts a new trace
   char* msg = ipc_read(sock);
-  if (isJSONObject(msg)) {
+  if (msg != NULL) {
+    struct connection* con = connection_findBySock(sock);
+    if (con != NULL && con->is_net &&
+        (compactIpc_isCompact(msg) || isLikelyJSONObject(msg))) {
+      // network clients carry no socket credentials, but also no secrets in
+      // the clear: a request there is either the key exchange or encrypted
+      logger(WARNING, "rejecting plaintext request on network connection");
+      ipc_write(sock, RESPONSE_ERROR,
+                "plaintext requests are not accepted on the network listener");
+      secFree(msg);
+      oidc_errno = OIDC_EIPCDIS;
+      return NULL;
+    }
+  }
+  if (compactIpc_isCompact(msg)) {
+    // the client opted into the compact framing for this connection
+    compactIpc_markSock(sock);
+    char* json = compactIpc_decode(msg);
+    secFree(msg);
+    return json;
+  }
+  if (isLikelyJSONObject(msg)) {
     return msg;
   }
   char* res = server_ipc_cryptRead(sock, msg);
@@ -267,14 +673,89 @@ char* server_ipc_read(const int sock) {
   return res;
 }
 
-void server_ipc_freeLastKey() {
-  if (encryptionKeys == NULL || encryptionKeys->len <= 0) {
-    return;
+void server_ipc_freeLastKey(const int sock) {
+  struct ipc_keySet* keys = server_ipc_popLastKey(sock);
+  if (keys != NULL) {
+    secFreeIpcKeySet(keys);
+  }
+}
+
+/**
+ * @brief takes the encryption key set stored by the last encrypted
+ * @c server_ipc_read off the connection's key ring
+ * @return the key set or @c NULL if the last read was unencrypted. Has to be
+ * freed after usage.
+ */
+struct ipc_keySet* server_ipc_popLastKey(const int sock) {
+  struct connection* con = connection_findBySock(sock);
+  if (con == NULL) {
+    return NULL;
+  }
+  struct ipc_keySet* keys = secAllocIpcKeySet();
+  if (!connection_popKeySet(con, keys)) {
+    secFreeIpcKeySet(keys);
+    return NULL;
+  }
+  return keys;
+}
+
+/**
+ * @brief writes a response encrypted with the given key set
+ *
+ * Used when requests are in flight concurrently and responses are written in
+ * a different order than the requests were read, so the connection's key
+ * ring cannot be used.
+ * @param keys the key set popped with @c server_ipc_popLastKey after reading
+ * the request; if @c NULL the response is written unencrypted.
+ */
+oidc_error_t server_ipc_writeWithKey(const int sock,
+                                     const struct ipc_keySet* keys,
+                                     const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (keys == NULL) {
+    oidc_error_t ret = _server_ipc_vwritePlain(sock, fmt, args);
+    va_end(args);
+    return ret;
+  }
+  oidc_error_t e = ipc_vcryptWrite(sock, keys->key_tx, fmt, args);
+  va_end(args);
+  if (e == OIDC_SUCCESS) {
+    return OIDC_SUCCESS;
+  }
+  return ipc_writeOidcErrno(sock);
+}
+
+/**
+ * @brief like @c server_ipc_writeWithKey but for an already assembled message
+ *
+ * The message is neither treated as a format string nor copied before the
+ * encryption; a forwarding path that already holds the complete response
+ * (oidcp pushing an oidcd response through) hands its buffer straight to the
+ * cipher.
+ */
+oidc_error_t server_ipc_writeMsgWithKey(const int                sock,
+                                        const struct ipc_keySet* keys,
+                                        const char*              msg) {
+  if (keys == NULL) {
+    if (!compactIpc_sockIsCompact(sock)) {
+      return ipc_writeMessage(sock, msg);
+    }
+    char*        compact = compactIpc_encode(msg);
+    oidc_error_t e       = ipc_writeMessage(sock, compact ?: msg);
+    secFree(compact);
+    return e;
+  }
+  oidc_error_t e = ipc_cryptWriteMsg(sock, keys->key_tx, msg);
+  if (e == OIDC_SUCCESS) {
+    return OIDC_SUCCESS;
   }
-  list_node_t*       node = list_rpop(encryptionKeys);
-  struct ipc_keySet* keys = node->val;
-  LIST_FREE(node);
-  secFreeIpcKeySet(keys);
+  return ipc_writeOidcErrno(sock);
+}
+
+oidc_error_t server_ipc_writeOidcErrnoWithKey(const int                sock,
+                                              const struct ipc_keySet* keys) {
+  return server_ipc_writeWithKey(sock, keys, RESPONSE_ERROR, oidc_serror());
 }
 
 oidc_error_t server_ipc_writeOidcErrno(const int sock) {
@@ -2,6 +2,7 @@
 #define IPC_SERVER_H
 
 #include "connection.h"
+#include "cryptIpc.h"
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
@@ -9,16 +10,31 @@
 
 struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
     struct connection, time_t);
+struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipe(
+    struct connection, int, time_t, unsigned char*);
+struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipes(
+    struct connection, const int*, size_t, time_t, int*);
 char* ipc_vcryptCommunicateWithServerPath(const char* fmt, va_list args);
 char* ipc_cryptCommunicateWithServerPath(const char* fmt, ...);
 char* getServerSocketPath();
+int   ipc_socketActivated();
 
 oidc_error_t ipc_server_init(struct connection* con, const char* env_var_name,
                              const char* group_name);
+oidc_error_t ipc_server_adoptFd(struct connection* con, int listen_fd,
+                                const char* env_var_name);
 oidc_error_t ipc_initWithPath(struct connection* con);
 int          ipc_bindAndListen(struct connection* con);
+int          ipc_bindAndListenNet(const char* spec);
 
-void         server_ipc_freeLastKey();
+void               server_ipc_freeLastKey(const int);
+struct ipc_keySet* server_ipc_popLastKey(const int);
+oidc_error_t server_ipc_writeMsgWithKey(const int, const struct ipc_keySet*,
+                                        const char*);
+oidc_error_t server_ipc_writeWithKey(const int, const struct ipc_keySet*,
+                                     const char*, ...);
+oidc_error_t server_ipc_writeOidcErrnoWithKey(const int,
+                                              const struct ipc_keySet*);
 char*        server_ipc_read(const int);
 oidc_error_t server_ipc_write(const int, const char*, ...);
 oidc_error_t server_ipc_writeOidcErrno(const int);
@@ -0,0 +1,275 @@
+#define _XOPEN_SOURCE 700
+#include "tokenMirror.h"
+
+#include "defines/settings.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+char* tokenMirror_pathFor(const char* socket_path) {
+  if (socket_path == NULL) {
+    return NULL;
+  }
+  char* copy = oidc_strcopy(socket_path);  // dirname may modify its arg
+  char* path = oidc_sprintf("%s/%s", dirname(copy), TOKEN_MIRROR_FILENAME);
+  secFree(copy);
+  return path;
+}
+
+/* ---------------- agent side ---------------- */
+
+// Token updates come from multiple worker threads; the mutex serializes
+// writers, the seqlock protects readers in other processes.
+static struct token_mirror* mirror = NULL;
+static pthread_mutex_t      mirror_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int         mirror_evict = 0;
+
+static void _writeBegin() {
+  __atomic_store_n(&mirror->seq, mirror->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);  // odd seq visible before the data
+}
+
+static void _writeEnd() {
+  __atomic_thread_fence(__ATOMIC_RELEASE);  // data visible before the even seq
+  __atomic_store_n(&mirror->seq, mirror->seq + 1, __ATOMIC_RELAXED);
+}
+
+oidc_error_t tokenMirror_init(const char* socket_path) {
+  const char* env = getenv(OIDC_TOKEN_MIRROR_ENV_NAME);
+  if (!strValid(env) || strequal(env, "0")) {  // not opted in
+    return OIDC_SUCCESS;
+  }
+  char* path = tokenMirror_pathFor(socket_path);
+  if (path == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  secFree(path);
+  if (fd < 0) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  if (ftruncate(fd, sizeof(struct token_mirror)) != 0) {
+    oidc_setErrnoError();
+    close(fd);
+    return oidc_errno;
+  }
+  void* map = mmap(NULL, sizeof(struct token_mirror), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  mirror          = map;
+  mirror->version = TOKEN_MIRROR_VERSION;
+  // published last: readers ignore the file until the magic is in place
+  __atomic_store_n(&mirror->magic, TOKEN_MIRROR_MAGIC, __ATOMIC_RELEASE);
+  logger(DEBUG, "token mirror enabled");
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief mirrors a token for an account; no-op if the mirror is not enabled
+ * Values longer than the fixed entry fields are not mirrored - those
+ * requests keep going through the socket.
+ */
+void tokenMirror_update(const char* short_name, const char* token,
+                        const char* issuer, const char* scope,
+                        time_t expires_at) {
+  if (mirror == NULL || short_name == NULL || token == NULL) {
+    return;
+  }
+  if (strlen(short_name) >= TOKEN_MIRROR_NAME_LEN ||
+      strlen(token) >= TOKEN_MIRROR_TOKEN_LEN ||
+      (issuer != NULL && strlen(issuer) >= TOKEN_MIRROR_ISS_LEN) ||
+      (scope != NULL && strlen(scope) >= TOKEN_MIRROR_SCOPE_LEN)) {
+    return;
+  }
+  pthread_mutex_lock(&mirror_lock);
+  struct token_mirror_entry* slot = NULL;
+  time_t                     now  = time(NULL);
+  for (int i = 0; i < TOKEN_MIRROR_ENTRIES; i++) {
+    if (strequal(mirror->entries[i].short_name, short_name)) {
+      slot = &mirror->entries[i];
+      break;
+    }
+  }
+  if (slot == NULL) {  // take an unused or expired slot first
+    for (int i = 0; i < TOKEN_MIRROR_ENTRIES; i++) {
+      if (mirror->entries[i].short_name[0] == '\0' ||
+          (time_t)mirror->entries[i].expires_at <= now) {
+        slot = &mirror->entries[i];
+        break;
+      }
+    }
+  }
+  if (slot == NULL) {
+    slot = &mirror->entries[mirror_evict++ % TOKEN_MIRROR_ENTRIES];
+  }
+  _writeBegin();
+  strcpy(slot->short_name, short_name);
+  strcpy(slot->issuer, issuer ?: "");
+  strcpy(slot->scope, scope ?: "");
+  strcpy(slot->token, token);
+  slot->expires_at = expires_at;
+  _writeEnd();
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+void tokenMirror_remove(const char* short_name) {
+  if (mirror == NULL || short_name == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&mirror_lock);
+  for (int i = 0; i < TOKEN_MIRROR_ENTRIES; i++) {
+    if (strequal(mirror->entries[i].short_name, short_name)) {
+      _writeBegin();
+      moresecure_memzero(&mirror->entries[i],
+                         sizeof(struct token_mirror_entry));
+      _writeEnd();
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+void tokenMirror_clear() {
+  if (mirror == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&mirror_lock);
+  _writeBegin();
+  moresecure_memzero(mirror->entries, sizeof(mirror->entries));
+  _writeEnd();
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+/* ---------------- client side ---------------- */
+
+static struct token_mirror* reader_map      = NULL;
+static char*                reader_map_path = NULL;
+static pthread_mutex_t      reader_lock     = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief maps the mirror belonging to the current OIDC_SOCK read-only
+ * @return the mapping or @c NULL if there is none - the agent did not opt
+ * in, or no agent is running. Called with @c reader_lock held.
+ */
+static struct token_mirror* _readerMap() {
+  char* path = tokenMirror_pathFor(getenv(OIDC_SOCK_ENV_NAME));
+  if (path == NULL) {
+    return NULL;
+  }
+  if (reader_map != NULL) {
+    if (strequal(path, reader_map_path)) {
+      secFree(path);
+      return reader_map;
+    }
+    munmap(reader_map, sizeof(struct token_mirror));  // agent changed
+    reader_map = NULL;
+    secFree(reader_map_path);
+    reader_map_path = NULL;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    secFree(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct token_mirror)) {
+    close(fd);
+    secFree(path);
+    return NULL;
+  }
+  void* map =
+      mmap(NULL, sizeof(struct token_mirror), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    secFree(path);
+    return NULL;
+  }
+  reader_map      = map;
+  reader_map_path = path;
+  return reader_map;
+}
+
+/**
+ * @brief serves a token request from the agent's shared-memory mirror
+ *
+ * The matching entry is copied out under the seqlock, so a concurrent agent
+ * update can never produce a torn token.
+ * @param scope has to match the scope the token was mirrored with; @c NULL
+ * matches only default-scope entries
+ * @param token_out , @p issuer_out set to copies on a hit. Have to be freed
+ * after usage.
+ * @return @c 1 on a hit, @c 0 if the request has to go through the socket
+ */
+int tokenMirror_lookup(const char* short_name, const char* scope,
+                       time_t min_valid_period, char** token_out,
+                       char** issuer_out, time_t* expires_at_out) {
+  if (short_name == NULL || strlen(short_name) >= TOKEN_MIRROR_NAME_LEN) {
+    return 0;
+  }
+  pthread_mutex_lock(&reader_lock);
+  struct token_mirror* map = _readerMap();
+  if (map == NULL ||
+      __atomic_load_n(&map->magic, __ATOMIC_ACQUIRE) != TOKEN_MIRROR_MAGIC ||
+      map->version != TOKEN_MIRROR_VERSION) {
+    pthread_mutex_unlock(&reader_lock);
+    return 0;
+  }
+  struct token_mirror_entry entry;
+  int                       found = 0;
+  for (int try = 0; try < 16; try++) {  // bounded seqlock retry
+    uint32_t s1 = __atomic_load_n(&map->seq, __ATOMIC_ACQUIRE);
+    if (s1 & 1) {  // the agent is writing right now
+      continue;
+    }
+    found = 0;
+    for (int i = 0; i < TOKEN_MIRROR_ENTRIES; i++) {
+      if (strequal(map->entries[i].short_name, short_name)) {
+        memcpy(&entry, &map->entries[i], sizeof(entry));
+        found = 1;
+        break;
+      }
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);  // read data before rechecking
+    if (__atomic_load_n(&map->seq, __ATOMIC_RELAXED) == s1) {
+      break;  // nothing changed while we copied
+    }
+    found = 0;
+  }
+  pthread_mutex_unlock(&reader_lock);
+  if (!found) {
+    return 0;
+  }
+  if (!strequal(entry.scope, scope ?: "")) {
+    return 0;
+  }
+  if ((time_t)entry.expires_at - time(NULL) <
+      (min_valid_period > 0 ? min_valid_period : 1)) {
+    return 0;  // not valid long enough; the agent has to refresh
+  }
+  if (token_out != NULL) {
+    *token_out = oidc_strcopy(entry.token);
+  }
+  if (issuer_out != NULL) {
+    *issuer_out = strValid(entry.issuer) ? oidc_strcopy(entry.issuer) : NULL;
+  }
+  if (expires_at_out != NULL) {
+    *expires_at_out = (time_t)entry.expires_at;
+  }
+  moresecure_memzero(&entry, sizeof(entry));
+  return 1;
+}
@@ -0,0 +1,71 @@
+#ifndef OIDC_TOKEN_MIRROR_H
+#define OIDC_TOKEN_MIRROR_H
+
+#include "utils/oidc_error.h"
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Opt-in shared-memory mirror of cached token material.
+ *
+ * When the agent is started with @c OIDC_AGENT_TOKEN_MIRROR set, oidcd
+ * mirrors the non-secret part of its token cache - access token, issuer,
+ * scope, and expiry per account short name - into a memory-mapped file next
+ * to the agent socket (mode 0600, so only the same uid can read it; on the
+ * XDG runtime dir this lives on tmpfs). liboidc-agent maps it read-only and
+ * serves still-valid token requests from it without any ipc round trip,
+ * falling back to the socket for misses and refreshes. Refresh tokens and
+ * account configs never enter the mirror.
+ *
+ * Consistency uses a seqlock: the agent bumps @c seq to odd before writing
+ * and to even after, readers retry while the sequence is odd or changed
+ * under them. Entries are fixed size, so the table never moves.
+ */
+
+#define TOKEN_MIRROR_FILENAME  "token_mirror"
+#define TOKEN_MIRROR_MAGIC     0x4d54414fu  // "OATM"
+#define TOKEN_MIRROR_VERSION   1u
+#define TOKEN_MIRROR_ENTRIES   32
+#define TOKEN_MIRROR_NAME_LEN  128
+#define TOKEN_MIRROR_ISS_LEN   256
+#define TOKEN_MIRROR_SCOPE_LEN 512
+#define TOKEN_MIRROR_TOKEN_LEN 4096
+
+struct token_mirror_entry {
+  char     short_name[TOKEN_MIRROR_NAME_LEN];  // empty string = unused slot
+  char     issuer[TOKEN_MIRROR_ISS_LEN];
+  char     scope[TOKEN_MIRROR_SCOPE_LEN];  // the scope the token was
+                                           // requested with; "" for default
+  char     token[TOKEN_MIRROR_TOKEN_LEN];
+  uint64_t expires_at;
+};
+
+struct token_mirror {
+  uint32_t                  magic;
+  uint32_t                  version;
+  uint32_t                  seq;  // seqlock: odd while the agent writes
+  uint32_t                  _pad;
+  struct token_mirror_entry entries[TOKEN_MIRROR_ENTRIES];
+};
+
+/**
+ * @brief builds the mirror file path belonging to a socket path
+ * @return the path. Has to be freed after usage.
+ */
+char* tokenMirror_pathFor(const char* socket_path);
+
+// agent side
+oidc_error_t tokenMirror_init(const char* socket_path);
+void         tokenMirror_update(const char* short_name, const char* token,
+                                const char* issuer, const char* scope,
+                                time_t expires_at);
+void         tokenMirror_remove(const char* short_name);
+void         tokenMirror_clear();
+
+// client side
+int tokenMirror_lookup(const char* short_name, const char* scope,
+                       time_t min_valid_period, char** token_out,
+                       char** issuer_out, time_t* expires_at_out);
+
+#endif  // OIDC_TOKEN_MIRROR_H
@@ -4,8 +4,12 @@
 #include "ipc/cryptCommunicator.h"
 #include "oidc-add/parse_ipc.h"
 #include "utils/accountUtils.h"
+#include "utils/file_io/cryptFileUtils.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
 #include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
 #include "utils/password_entry.h"
 #include "utils/prompt.h"
 #include "utils/promptUtils.h"
@@ -21,17 +25,14 @@ time_t getPWExpiresInDependingOn(struct arguments* arguments) {
   return arguments->pw_lifetime.lifetime;
 }
 
-void add_handleAdd(char* account, struct arguments* arguments) {
-  struct resultWithEncryptionPassword result =
-      getDecryptedAccountAsStringAndPasswordFromFilePrompt(account,
-                                                           arguments->pw_cmd);
-  char* json_p = result.result;
-  if (json_p == NULL) {
-    secFree(result.password);
-    exit(EXIT_FAILURE);
-  }
-  char* password = result.password;
-
+/**
+ * @brief builds the password entry for a decrypted config and sends the add
+ * request
+ * @p json_p and @p password stay owned by the caller
+ */
+static void _add_addLoadedConfig(char* account, const char* json_p,
+                                 const char*       password,
+                                 struct arguments* arguments) {
   struct password_entry pw   = {.shortname = account};
   unsigned char         type = PW_TYPE_PRMT;
   if (arguments->pw_cmd) {
@@ -39,20 +40,19 @@ void add_handleAdd(char* account, struct arguments* arguments) {
     type |= PW_TYPE_CMD;
   }
   if (arguments->pw_lifetime.argProvided) {
-    pwe_setPassword(&pw, password);
+    pwe_setPassword(&pw, (char*)password);
     pwe_setExpiresIn(&pw, getPWExpiresInDependingOn(arguments));
     type |= PW_TYPE_MEM;
   }
   if (arguments->pw_keyring) {
     if (!arguments->pw_lifetime
              .argProvided) {  // Only set password if not already done
-      pwe_setPassword(&pw, password);
+      pwe_setPassword(&pw, (char*)password);
     }
     type |= PW_TYPE_MNG;
   }
   pwe_setType(&pw, type);
   char* pw_str = passwordEntryToJSONString(&pw);
-  secFree(password);
 
   char* res = NULL;
   if (arguments->lifetime.argProvided) {
@@ -63,10 +63,168 @@ void add_handleAdd(char* account, struct arguments* arguments) {
     res = ipc_cryptCommunicate(REQUEST_ADD, json_p, pw_str, arguments->confirm);
   }
   secFree(pw_str);
-  secFree(json_p);
   add_parseResponse(res);
 }
 
+void add_handleAdd(char* account, struct arguments* arguments) {
+  struct resultWithEncryptionPassword result =
+      getDecryptedAccountAsStringAndPasswordFromFilePrompt(account,
+                                                           arguments->pw_cmd);
+  if (result.result == NULL) {
+    secFree(result.password);
+    exit(EXIT_FAILURE);
+  }
+  _add_addLoadedConfig(account, result.result, result.password, arguments);
+  secFree(result.password);
+  secFree(result.result);
+}
+
+/**
+ * @brief loads @p accounts[1..count-1] with a single bulk load request
+ *
+ * The still encrypted config blobs are sent together with the shared
+ * (already verified) password; the agent decrypts them on its parallel
+ * decrypt engine, so the whole set costs one handshake instead of one per
+ * account. If the @c OIDC_ADD_BULK_ID environment variable is set it is
+ * sent as idempotence key: a retried provisioning run with the same key is
+ * acknowledged without being applied twice.
+ * @param done flags (indexed like @p accounts ) set for every account the
+ * agent reports as loaded; the caller handles the rest individually
+ * @return @c 1 if the bulk request was answered, @c 0 if it failed as a
+ * whole (e.g. an older agent) and the caller should fall back entirely
+ */
+static unsigned char _add_bulkLoad(char** accounts, size_t count,
+                                   const char*    password,
+                                   unsigned char* done) {
+  cJSON* entries = cJSON_CreateArray();
+  for (size_t j = 1; j < count; j++) {
+    char* blob = readOidcFile(accounts[j]);
+    if (blob == NULL) {  // left to the per-account fallback and its error
+      continue;
+    }
+    cJSON* entry = generateJSONObject(IPC_KEY_SHORTNAME, cJSON_String,
+                                      accounts[j], IPC_KEY_CONFIG,
+                                      cJSON_String, blob, IPC_KEY_PASSWORD,
+                                      cJSON_String, (char*)password, NULL);
+    secFree(blob);
+    cJSON_AddItemToArray(entries, entry);
+  }
+  cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                   REQUEST_VALUE_BULKADD, NULL);
+  const char* bulk_id = getenv("OIDC_ADD_BULK_ID");
+  if (strValid(bulk_id)) {
+    jsonAddStringValue(json, IPC_KEY_BULKID, bulk_id);
+  }
+  jsonAddJSON(json, IPC_KEY_ACCOUNTLIST, entries);
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  char* res = ipc_cryptCommunicate("%s", request);
+  secFree(request);
+  if (res == NULL) {
+    return 0;
+  }
+  cJSON* dom = stringToJson(res);
+  secFree(res);
+  if (dom == NULL) {
+    return 0;
+  }
+  char* error = getJSONValue(dom, OIDC_KEY_ERROR);
+  if (error != NULL) {  // e.g. an older agent without bulk load support
+    secFree(error);
+    secFreeJson(dom);
+    return 0;
+  }
+  cJSON* info = getJSONItem(dom, IPC_KEY_INFO);
+  int    n    = cJSON_GetArraySize(info);
+  for (int i = 0; i < n; i++) {
+    cJSON* entry  = cJSON_GetArrayItem(info, i);
+    char*  name   = getJSONValue(entry, IPC_KEY_SHORTNAME);
+    char*  status = getJSONValue(entry, IPC_KEY_STATUS);
+    if (strequal(status, STATUS_SUCCESS)) {
+      for (size_t j = 1; j < count; j++) {
+        if (strequal(accounts[j], name)) {
+          done[j] = 1;
+          break;
+        }
+      }
+      printf("%s (%s)\n", status, name);
+    }
+    secFree(name);
+    secFree(status);
+  }
+  secFreeJson(dom);
+  return 1;
+}
+
+void add_handleAddMultiple(char** accounts, size_t count,
+                           struct arguments* arguments) {
+  if (count == 1) {
+    add_handleAdd(accounts[0], arguments);
+    return;
+  }
+  // The shared password is prompted once and verified against the first
+  // config before any parallel work starts, so a typo costs one key
+  // derivation instead of one per config. Configs the verified password
+  // does not open fall back to the usual serial per-file prompt.
+  char*         firstPath = concatToOidcDir(accounts[0]);
+  char*         firstText = NULL;
+  char*         password  = NULL;
+  unsigned int  i         = 0;
+  unsigned int* i_ptr     = &i;
+  while (NULL == firstText) {
+    secFree(password);
+    password = getDecryptionPasswordFor("the account configurations",
+                                        arguments->pw_cmd, 0, i_ptr);
+    if (password == NULL && oidc_errno == OIDC_EMAXTRIES) {
+      secFree(firstPath);
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
+    firstText = decryptFile(firstPath, password);
+  }
+  secFree(firstPath);
+  _add_addLoadedConfig(accounts[0], firstText, password, arguments);
+  secFree(firstText);
+  if (!arguments->pw_cmd && !arguments->pw_lifetime.argProvided &&
+      !arguments->pw_keyring && !arguments->confirm &&
+      !arguments->lifetime.argProvided) {
+    // nothing but the load itself is requested per account, so a single
+    // bulk request replaces the per-account round trips; accounts it could
+    // not load fall back to the usual serial per-file prompt
+    unsigned char* done = secAlloc(count * sizeof(unsigned char));
+    if (_add_bulkLoad(accounts, count, password, done)) {
+      for (size_t j = 1; j < count; j++) {
+        if (!done[j]) {
+          add_handleAdd(accounts[j], arguments);
+        }
+      }
+      secFree(done);
+      secFree(password);
+      return;
+    }
+    secFree(done);
+  }
+  struct decryptFileJob* jobs =
+      secAlloc((count - 1) * sizeof(struct decryptFileJob));
+  for (size_t j = 1; j < count; j++) {
+    jobs[j - 1].filepath = concatToOidcDir(accounts[j]);
+    jobs[j - 1].password = password;
+  }
+  decryptFilesParallel(jobs, count - 1);
+  for (size_t j = 1; j < count; j++) {
+    if (jobs[j - 1].result != NULL) {
+      _add_addLoadedConfig(accounts[j], jobs[j - 1].result, password,
+                           arguments);
+      secFree(jobs[j - 1].result);
+    } else {
+      add_handleAdd(accounts[j], arguments);
+    }
+    _secFree((char*)jobs[j - 1].filepath);
+  }
+  secFree(password);
+  secFree(jobs);
+}
+
 void add_handleRemove(const char* account) {
   char* res = ipc_cryptCommunicate(REQUEST_REMOVE, account);
   add_parseResponse(res);
@@ -4,6 +4,8 @@
 #include "oidc-add/oidc-add_options.h"
 
 void add_handleAdd(char* account, struct arguments* arguments);
+void add_handleAddMultiple(char** accounts, size_t count,
+                           struct arguments* arguments);
 void add_handleRemove(const char* account);
 void add_handleRemoveAll();
 void add_handlePrint(char* account, struct arguments* arguments);
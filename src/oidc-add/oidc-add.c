@@ -43,21 +43,24 @@ int main(int argc, char** argv) {
   }
   checkOidcDirExists();
 
-  char* account = arguments.args[0];
-  if (!accountConfigExists(account)) {
-    oidc_errno = OIDC_ENOACCOUNT;
-    oidc_perror();
-    exit(EXIT_FAILURE);
+  for (unsigned int i = 0; i < arguments.account_count; i++) {
+    if (!accountConfigExists(arguments.args[i])) {
+      oidc_errno = OIDC_ENOACCOUNT;
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
   }
   if (arguments.print) {
-    add_handlePrint(account, &arguments);
+    add_handlePrint(arguments.args[0], &arguments);
     return EXIT_SUCCESS;
   }
 
   if (arguments.remove) {
-    add_handleRemove(account);
+    for (unsigned int i = 0; i < arguments.account_count; i++) {
+      add_handleRemove(arguments.args[i]);
+    }
   } else {
-    add_handleAdd(account, &arguments);
+    add_handleAddMultiple(arguments.args, arguments.account_count, &arguments);
   }
 
   return EXIT_SUCCESS;
@@ -6,9 +6,12 @@
 
 #include <argp.h>
 
+#define MAX_BULK_ADD 64
+
 struct arguments {
-  char* args[1]; /* account */
-  char* pw_cmd;
+  char*        args[MAX_BULK_ADD]; /* accounts */
+  unsigned int account_count;
+  char*        pw_cmd;
 
   unsigned char remove;
   unsigned char removeAll;
@@ -112,10 +115,11 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
       argp_state_help(state, state->out_stream, ARGP_HELP_STD_HELP);
       break;
     case ARGP_KEY_ARG:
-      if (state->arg_num >= 1) {
+      if (state->arg_num >= MAX_BULK_ADD) {
         argp_usage(state);
       }
       arguments->args[state->arg_num] = arg;
+      arguments->account_count        = state->arg_num + 1;
       break;
     case ARGP_KEY_END:
       if (arguments->list || arguments->lock || arguments->unlock ||
@@ -131,7 +135,7 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
   return 0;
 }
 
-static char args_doc[] = "ACCOUNT_SHORTNAME | -l | -x | -X | -R";
+static char args_doc[] = "ACCOUNT_SHORTNAME... | -l | -x | -X | -R";
 
 static char doc[] =
     "oidc-add -- A client for adding and removing accounts to the oidc-agent";
@@ -150,6 +154,7 @@ static inline void initArguments(struct arguments* arguments) {
   arguments->lock                    = 0;
   arguments->unlock                  = 0;
   arguments->args[0]                 = NULL;
+  arguments->account_count           = 0;
   arguments->seccomp                 = 0;
   arguments->pw_lifetime.argProvided = 0;
   arguments->pw_lifetime.lifetime    = 0;
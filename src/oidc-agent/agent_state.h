@@ -6,7 +6,11 @@
 #include <time.h>
 
 struct agent_state {
-  time_t            defaultTimeout;
+  time_t        defaultTimeout;
+  unsigned long maxAccounts;   // 0 means unlimited
+  // allowed port range for the redirect webserver; min 0 means unrestricted
+  unsigned short    portRangeMin;
+  unsigned short    portRangeMax;
   struct lock_state lock_state;
 } agent_state;
 
@@ -1,7 +1,13 @@
+#define _XOPEN_SOURCE 700
 #include "http.h"
 
+#include "http_dns.h"
+#include "http_engine.h"
 #include "http_handler.h"
+#include "http_metrics.h"
 #include "http_postHandler.h"
+#include "http_resilience.h"
+#include "oidc-agent/oidcd/oidcd_stage.h"
 #include "utils/logger.h"
 #include "utils/oidc_error.h"
 #include "utils/pass.h"
@@ -9,6 +15,34 @@
 #include <curl/curl.h>
 
 #include <stdlib.h>
+#include <time.h>
+
+static unsigned long _now_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+// deadline of the request the calling thread is serving; every thread
+// (main loop, pool worker) serves one request at a time
+static __thread unsigned long thread_deadline_ms = 0;
+
+void http_setDeadline(unsigned long deadline_at_ms) {
+  thread_deadline_ms = deadline_at_ms;
+}
+
+/**
+ * @brief remaining time budget of the current request
+ * @return the remaining ms, @c 0 if no deadline is set, or @c -1 if the
+ * deadline already passed
+ */
+static long _remainingMs() {
+  if (thread_deadline_ms == 0) {
+    return 0;
+  }
+  unsigned long now = _now_ms();
+  return now >= thread_deadline_ms ? -1 : (long)(thread_deadline_ms - now);
+}
 
 /** @fn char* httpsGET(const char* url, const char* cert_path)
  * @brief does a https GET request
@@ -20,26 +54,81 @@
 char* _httpsGET(const char* url, struct curl_slist* headers,
                 const char* cert_path) {
   logger(DEBUG, "Https GET to: %s", url);
-  CURL* curl = init();
-  setUrl(curl, url);
-  struct string s;
-  if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
-    return NULL;
-  }
-  setSSLOpts(curl, cert_path);
-  setHeaders(curl, headers);
-  oidc_error_t err = perform(curl);
-  if (err != OIDC_SUCCESS) {
-    if (err >= 200 && err < 600 && strValid(s.ptr)) {
-      pass;
-    } else {
-      secFree(s.ptr);
+  // GETs are idempotent, so transport failures are retried with backoff
+  for (unsigned char attempt = 0;; attempt++) {
+    if (!http_breaker_allowRequest(url)) {
+      return NULL;
+    }
+    long budget = _remainingMs();
+    if (budget < 0) {  // the client gave up; finishing the transfer would
+                       // only burn handler time nobody waits for
+      oidc_errno = OIDC_ETIMEOUT;
       return NULL;
     }
+    if (!http_limiter_acquire(url, budget)) {  // the host's connection
+                                               // slots are taken
+      return NULL;
+    }
+    budget = _remainingMs();  // queueing for the slot ate into the budget
+    if (budget < 0) {
+      http_limiter_release(url);
+      oidc_errno = OIDC_ETIMEOUT;
+      return NULL;
+    }
+    CURL* curl = init_forUrl(url);
+    setUrl(curl, url);
+    // has to be set even without a deadline: the handle may be reused and
+    // still carry the timeout of a previous request
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, budget);
+    struct string s;
+    if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
+      cleanup(curl);
+      http_limiter_release(url);
+      return NULL;
+    }
+    setSSLOpts(curl, cert_path);
+    setHeaders(curl, headers);
+    struct curl_slist* resolve = http_dns_resolveList(url);
+    if (resolve != NULL) {
+      curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+    }
+    oidcd_stage_set("https GET %s", url);
+    unsigned long start = _now_ms();
+    oidc_error_t  err   = http_engine_perform(curl);
+    oidcd_stage_clear();
+    curl_slist_free_all(resolve);   // the transfer is done
+    http_limiter_release(url);      // a queued request may connect
+    if (err != OIDC_SUCCESS) {
+      if (err >= 200 && err < 600 && strValid(s.ptr)) {
+        pass;  // the endpoint answered; its error body is the response
+      } else {  // handle already cleaned up by CURLErrorHandling
+        secFree(s.ptr);
+        http_metrics_record(url, _now_ms() - start, 0);
+        http_breaker_report(url, 0);
+        if (err == OIDC_EERROR && attempt < HTTP_RETRY_MAX) {
+          http_retryBackoff(attempt);
+          continue;
+        }
+        return NULL;
+      }
+    }
+    http_metrics_record(url, _now_ms() - start, 1);
+    http_breaker_report(url, 1);
+    if (err == 429) {  // the endpoint throttles us; back off instead of
+                       // hammering it with the next requests
+      long retry_after = 0;
+#if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM >= 0x074200
+      curl_off_t ra = 0;
+      if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &ra) == CURLE_OK) {
+        retry_after = (long)ra;
+      }
+#endif
+      http_breaker_throttle(url, retry_after);
+    }
+    cleanupReuse(curl, url);
+    logger(DEBUG, "Response: %s\n", s.ptr);
+    return s.ptr;
   }
-  cleanup(curl);
-  logger(DEBUG, "Response: %s\n", s.ptr);
-  return s.ptr;
 }
 
 /** @fn char* httpsPOST(const char* url, const char* data, const char*
@@ -55,11 +144,35 @@ char* _httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                  const char* cert_path, const char* username,
                  const char* password) {
   logger(DEBUG, "Https POST to: %s", url);
-  CURL* curl = init();
+  if (!http_breaker_allowRequest(url)) {  // POSTs are not retried: they are
+    return NULL;                          // not idempotent
+  }
+  long budget = _remainingMs();
+  if (budget < 0) {  // the client gave up; finishing the transfer would
+                     // only burn handler time nobody waits for
+    oidc_errno = OIDC_ETIMEOUT;
+    return NULL;
+  }
+  if (!http_limiter_acquire(url, budget)) {  // the host's connection slots
+                                             // are taken
+    return NULL;
+  }
+  budget = _remainingMs();  // queueing for the slot ate into the budget
+  if (budget < 0) {
+    http_limiter_release(url);
+    oidc_errno = OIDC_ETIMEOUT;
+    return NULL;
+  }
+  CURL* curl = init_forUrl(url);
   setUrl(curl, url);
+  // has to be set even without a deadline: the handle may be reused and
+  // still carry the timeout of a previous request
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, budget);
   curl_easy_setopt(curl, CURLOPT_POST, 1L);
   struct string s;
   if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
+    cleanup(curl);
+    http_limiter_release(url);
     return NULL;
   }
   setPostData(curl, data);
@@ -68,17 +181,40 @@ char* _httpsPOST(const char* url, const char* data, struct curl_slist* headers,
   if (username) {
     setBasicAuth(curl, username, password ?: "");
   }
-  oidc_error_t err = perform(curl);
+  struct curl_slist* resolve = http_dns_resolveList(url);
+  if (resolve != NULL) {
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+  }
+  oidcd_stage_set("https POST %s", url);
+  unsigned long start = _now_ms();
+  oidc_error_t  err   = http_engine_perform(curl);
+  oidcd_stage_clear();
+  curl_slist_free_all(resolve);   // the transfer is done
+  http_limiter_release(url);      // a queued request may connect
   if (err != OIDC_SUCCESS) {
     if (err >= 200 && err < 600 && strValid(s.ptr)) {
       pass;
-    } else {
+    } else {  // handle already cleaned up by CURLErrorHandling
       secFree(s.ptr);
-      cleanup(curl);
+      http_metrics_record(url, _now_ms() - start, 0);
+      http_breaker_report(url, 0);
       return NULL;
     }
   }
-  cleanup(curl);
+  http_metrics_record(url, _now_ms() - start, 1);
+  http_breaker_report(url, 1);
+  if (err == 429) {  // the endpoint throttles us; back off instead of
+                     // hammering it with the next requests
+    long retry_after = 0;
+#if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM >= 0x074200
+    curl_off_t ra = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &ra) == CURLE_OK) {
+      retry_after = (long)ra;
+    }
+#endif
+    http_breaker_throttle(url, retry_after);
+  }
+  cleanupReuse(curl, url);
   logger(DEBUG, "Response: %s\n", s.ptr ? s.ptr : "(null)");
   return s.ptr;
 }
@@ -8,4 +8,11 @@ char* _httpsGET(const char* url, struct curl_slist* list,
 char* _httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                  const char* cert_path, const char* username,
                  const char* password);
+
+/**
+ * @brief sets the deadline for http calls made by the calling thread
+ * @param deadline_at_ms absolute monotonic time in ms after which the client
+ * waiting for the current request gives up; @c 0 clears the deadline
+ */
+void http_setDeadline(unsigned long deadline_at_ms);
 #endif
@@ -0,0 +1,208 @@
+#define _XOPEN_SOURCE 700
+#include "http_dns.h"
+#include "http_handler.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+/**
+ * Resolver cache for the endpoints the agent talks to.
+ *
+ * A cold transfer used to block on DNS inside curl; a slow site resolver
+ * adds hundreds of milliseconds to the refresh hot path. Endpoint hostnames
+ * are therefore resolved on a background thread - pre-resolved when an
+ * account is loaded and re-resolved once an entry's TTL passed - and the
+ * cached A/AAAA records are injected into the easy handle via
+ * CURLOPT_RESOLVE, so performing a request never waits for the resolver. A
+ * stale entry keeps being served while its refresh runs.
+ */
+
+#define DNS_CACHE_SIZE 16
+// big enough for a handful of A/AAAA records per name
+#define DNS_ADDRLIST_MAX 256
+
+struct dns_entry {
+  char*         host;     // including an explicit port, as in the url
+  char*         resolve;  // CURLOPT_RESOLVE entry "host:port:addr,addr"
+  time_t        resolved_at;
+  unsigned char resolving;
+};
+
+static struct dns_entry dns_cache[DNS_CACHE_SIZE];
+static pthread_mutex_t  dns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// called with the lock held
+static struct dns_entry* _dns_find(const char* host) {
+  for (unsigned char i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (dns_cache[i].host != NULL && strequal(dns_cache[i].host, host)) {
+      return &dns_cache[i];
+    }
+  }
+  return NULL;
+}
+
+// called with the lock held
+static struct dns_entry* _dns_findOrAdd(const char* host) {
+  struct dns_entry* entry = _dns_find(host);
+  if (entry != NULL) {
+    return entry;
+  }
+  struct dns_entry* slot = &dns_cache[0];
+  for (unsigned char i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (dns_cache[i].host == NULL) {
+      slot = &dns_cache[i];
+      break;
+    }
+    if (dns_cache[i].resolved_at < slot->resolved_at) {
+      slot = &dns_cache[i];  // evict the oldest entry
+    }
+  }
+  secFree(slot->host);
+  secFree(slot->resolve);
+  slot->host        = oidc_strcopy(host);
+  slot->resolve     = NULL;
+  slot->resolved_at = 0;
+  slot->resolving   = 0;
+  return slot;
+}
+
+/**
+ * @brief derives the port for a CURLOPT_RESOLVE entry
+ *
+ * An explicit port in @p host wins; otherwise the url scheme decides.
+ */
+static unsigned short _dns_port(const char* url, const char* host) {
+  const char* colon = strchr(host, ':');
+  if (colon != NULL) {
+    return strToInt(colon + 1);
+  }
+  return strstarts(url, "http://") ? 80 : 443;
+}
+
+struct dns_resolve_args {
+  char*          host;  // hostname without port
+  char*          key;   // cache key: host as it appears in the url
+  unsigned short port;
+};
+
+static void* _dns_resolveThread(void* p) {
+  struct dns_resolve_args* args = p;
+  struct addrinfo          hints = {.ai_family   = AF_UNSPEC,
+                                    .ai_socktype = SOCK_STREAM};
+  struct addrinfo*         result = NULL;
+  int                      err = getaddrinfo(args->host, NULL, &hints, &result);
+  if (err != 0) {
+    logger(NOTICE, "could not resolve %s: %s", args->host, gai_strerror(err));
+  }
+  char addrs[DNS_ADDRLIST_MAX] = {0};
+  for (struct addrinfo* ai = result; ai != NULL; ai = ai->ai_next) {
+    char buf[INET6_ADDRSTRLEN];
+    const void* src =
+        ai->ai_family == AF_INET
+            ? (void*)&((struct sockaddr_in*)(void*)ai->ai_addr)->sin_addr
+            : (void*)&((struct sockaddr_in6*)(void*)ai->ai_addr)->sin6_addr;
+    if (inet_ntop(ai->ai_family, src, buf, sizeof(buf)) == NULL) {
+      continue;
+    }
+    if (strlen(addrs) + strlen(buf) + 2 > sizeof(addrs)) {
+      break;
+    }
+    if (addrs[0] != '\0') {
+      strcat(addrs, ",");
+    }
+    strcat(addrs, buf);
+  }
+  if (result != NULL) {
+    freeaddrinfo(result);
+  }
+  pthread_mutex_lock(&dns_lock);
+  struct dns_entry* entry = _dns_findOrAdd(args->key);
+  entry->resolving        = 0;
+  if (addrs[0] != '\0') {
+    secFree(entry->resolve);
+    entry->resolve =
+        oidc_sprintf("%s:%hu:%s", args->host, args->port, addrs);
+    entry->resolved_at = time(NULL);
+    logger(DEBUG, "resolved %s to %s", args->host, addrs);
+  }
+  pthread_mutex_unlock(&dns_lock);
+  secFree(args->host);
+  secFree(args->key);
+  secFree(args);
+  return NULL;
+}
+
+// called with the lock held; marks the entry as resolving
+static void _dns_startResolve(struct dns_entry* entry, const char* url) {
+  entry->resolving              = 1;
+  struct dns_resolve_args* args = secAlloc(sizeof(struct dns_resolve_args));
+  args->key                     = oidc_strcopy(entry->host);
+  const char* colon             = strchr(entry->host, ':');
+  args->host = colon != NULL ? oidc_strncopy(entry->host, colon - entry->host)
+                             : oidc_strcopy(entry->host);
+  args->port = _dns_port(url, entry->host);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _dns_resolveThread, args) != 0) {
+    logger(ERROR, "could not create resolver thread: %m");
+    entry->resolving = 0;
+    secFree(args->host);
+    secFree(args->key);
+    secFree(args);
+    return;
+  }
+  pthread_detach(thread);
+}
+
+/**
+ * @brief resolves the host of @p url in the background
+ *
+ * Called when an account is loaded so its endpoints are already resolved
+ * when the first token request comes in.
+ */
+void http_dns_prefetch(const char* url) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dns_lock);
+  struct dns_entry* entry = _dns_findOrAdd(host);
+  if (!entry->resolving &&
+      entry->resolved_at + HTTP_DNS_TTL <= time(NULL)) {
+    _dns_startResolve(entry, url);
+  }
+  pthread_mutex_unlock(&dns_lock);
+  secFree(host);
+}
+
+/**
+ * @brief gets the cached addresses for the host of @p url
+ *
+ * Never blocks: an unknown host is resolved in the background for next
+ * time, a stale entry is served while its refresh runs.
+ * @return a list to be set as CURLOPT_RESOLVE. Has to be freed with
+ * @c curl_slist_free_all after the transfer. @c NULL if nothing is cached.
+ */
+struct curl_slist* http_dns_resolveList(const char* url) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&dns_lock);
+  struct dns_entry* entry = _dns_findOrAdd(host);
+  if (!entry->resolving &&
+      entry->resolved_at + HTTP_DNS_TTL <= time(NULL)) {
+    _dns_startResolve(entry, url);  // refresh for the next request
+  }
+  struct curl_slist* list =
+      entry->resolve != NULL ? curl_slist_append(NULL, entry->resolve) : NULL;
+  pthread_mutex_unlock(&dns_lock);
+  secFree(host);
+  return list;
+}
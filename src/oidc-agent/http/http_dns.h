@@ -0,0 +1,13 @@
+#ifndef HTTP_DNS_H
+#define HTTP_DNS_H
+
+#include <curl/curl.h>
+
+// How long a resolved address list is used before it is refreshed in the
+// background.
+#define HTTP_DNS_TTL 120
+
+void               http_dns_prefetch(const char* url);
+struct curl_slist* http_dns_resolveList(const char* url);
+
+#endif  // HTTP_DNS_H
@@ -0,0 +1,150 @@
+#include "http_engine.h"
+#include "http_errorHandler.h"
+#include "utils/logger.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * curl multi event engine.
+ *
+ * All outbound HTTP of the agent runs over one curl_multi handle owned by a
+ * dedicated engine thread, so transfers submitted by several worker threads
+ * proceed concurrently inside one process - one slow issuer no longer
+ * serializes the others. Submitting threads block until their transfer is
+ * done; the engine finds the submitter through the job the easy handle is
+ * tagged with and signals it, so the synchronous flow code on top stays
+ * unchanged. Keeping all transfers in one process (instead of the former
+ * fork-per-request) is also what makes connection reuse across requests
+ * possible at all.
+ */
+
+struct http_job {
+  CURL*            easy;
+  CURLcode         result;
+  unsigned char    done;
+  struct http_job* next;
+};
+
+static pthread_mutex_t  engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   job_done    = PTHREAD_COND_INITIALIZER;
+static struct http_job* pending     = NULL;
+
+static CURLM*        multi          = NULL;
+static int           wake_pipe[2]   = {-1, -1};
+static unsigned char engine_started = 0;
+
+static void* _engine_main(void* ignored) {
+  (void)ignored;
+  while (1) {
+    pthread_mutex_lock(&engine_lock);
+    while (pending != NULL) {
+      struct http_job* job = pending;
+      pending              = job->next;
+      curl_multi_add_handle(multi, job->easy);
+    }
+    pthread_mutex_unlock(&engine_lock);
+
+    int still_running = 0;
+    curl_multi_perform(multi, &still_running);
+
+    CURLMsg* msg;
+    int      msgs_left;
+    while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      CURL*            easy   = msg->easy_handle;
+      CURLcode         result = msg->data.result;
+      struct http_job* job    = NULL;
+      curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&job);
+      curl_multi_remove_handle(multi, easy);
+      pthread_mutex_lock(&engine_lock);
+      if (job != NULL) {
+        job->result = result;
+        job->done   = 1;
+      }
+      pthread_cond_broadcast(&job_done);
+      pthread_mutex_unlock(&engine_lock);
+    }
+
+    // Wait for transfer activity; the wake pipe interrupts the wait as soon
+    // as another thread submits a new transfer.
+    struct curl_waitfd wakefd = {wake_pipe[0], CURL_WAIT_POLLIN, 0};
+    curl_multi_wait(multi, &wakefd, 1, 1000, NULL);
+    if (wakefd.revents & CURL_WAIT_POLLIN) {
+      char drain[64];  // leftover bytes only cause an extra wakeup
+      if (read(wake_pipe[0], drain, sizeof(drain)) < 0) {
+        logger(ERROR, "could not drain http engine wake pipe: %m");
+      }
+    }
+  }
+  return NULL;
+}
+
+static oidc_error_t _engine_start() {
+  pthread_mutex_lock(&engine_lock);
+  if (engine_started) {
+    pthread_mutex_unlock(&engine_lock);
+    return OIDC_SUCCESS;
+  }
+  multi = curl_multi_init();
+  if (multi == NULL) {
+    pthread_mutex_unlock(&engine_lock);
+    oidc_errno = OIDC_ECURLI;
+    return oidc_errno;
+  }
+  if (pipe(wake_pipe) != 0) {
+    curl_multi_cleanup(multi);
+    multi = NULL;
+    pthread_mutex_unlock(&engine_lock);
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _engine_main, NULL) != 0) {
+    logger(ERROR, "could not create http engine thread: %m");
+    curl_multi_cleanup(multi);
+    multi = NULL;
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    pthread_mutex_unlock(&engine_lock);
+    oidc_errno = OIDC_ECURLI;
+    return oidc_errno;
+  }
+  pthread_detach(thread);
+  engine_started = 1;
+  logger(DEBUG, "started http engine");
+  pthread_mutex_unlock(&engine_lock);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief performs a transfer on the engine's multi handle and checks for
+ * errors
+ *
+ * Blocks the calling thread until the transfer is done while other threads'
+ * transfers proceed concurrently. Falls back to a plain synchronous perform
+ * if the engine cannot be started.
+ * @param curl the prepared easy handle
+ * @return 0 on success, for error values see @c CURLErrorHandling
+ */
+oidc_error_t http_engine_perform(CURL* curl) {
+  if (_engine_start() != OIDC_SUCCESS) {
+    return CURLErrorHandling(curl_easy_perform(curl), curl);
+  }
+  struct http_job job = {curl, CURLE_OK, 0, NULL};
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, &job);
+  pthread_mutex_lock(&engine_lock);
+  job.next = pending;
+  pending  = &job;
+  pthread_mutex_unlock(&engine_lock);
+  if (write(wake_pipe[1], "w", 1) < 0) {
+    logger(ERROR, "could not wake http engine: %m");
+  }
+  pthread_mutex_lock(&engine_lock);
+  while (!job.done) { pthread_cond_wait(&job_done, &engine_lock); }
+  pthread_mutex_unlock(&engine_lock);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, NULL);
+  return CURLErrorHandling(job.result, curl);
+}
@@ -0,0 +1,10 @@
+#ifndef HTTP_ENGINE_H
+#define HTTP_ENGINE_H
+
+#include "utils/oidc_error.h"
+
+#include <curl/curl.h>
+
+oidc_error_t http_engine_perform(CURL* curl);
+
+#endif  // HTTP_ENGINE_H
@@ -1,47 +1,201 @@
+#define _XOPEN_SOURCE 700
 #include "http_handler.h"
 #include "http_errorHandler.h"
+#include "utils/agent_sdt.h"
 #include "utils/logger.h"
 #include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+
+// Minimum buffer size when growing without a known Content-Length, and the
+// largest Content-Length that is trusted for an up-front reservation.
+#define HTTP_BUFFER_MIN_CAP 4096
+#define HTTP_BUFFER_MAX_RESERVE (16 * 1024 * 1024)
 
 static size_t write_callback(void* ptr, size_t size, size_t nmemb,
                              struct string* s) {
   size_t new_len = s->len + size * nmemb;
-  void*  tmp     = secRealloc(s->ptr, new_len + 1);
-  if (tmp == NULL) {
-    exit(EXIT_FAILURE);
+  if (new_len + 1 > s->cap) {  // double instead of reallocating per chunk
+    size_t cap = s->cap > HTTP_BUFFER_MIN_CAP ? s->cap : HTTP_BUFFER_MIN_CAP;
+    while (cap < new_len + 1) { cap *= 2; }
+    if (string_reserve(s, cap) != OIDC_SUCCESS) {
+      exit(EXIT_FAILURE);
+    }
   }
-  s->ptr = tmp;
   memcpy(s->ptr + s->len, ptr, size * nmemb);
-  // s->ptr[new_len] = '\0';
+  // the buffer is zeroed on allocation, so it stays zero terminated
   s->len = new_len;
 
   return size * nmemb;
 }
 
+static size_t header_callback(char* buffer, size_t size, size_t nitems,
+                              struct string* s) {
+  size_t len = size * nitems;
+  const size_t key_len = strlen("Content-Length:");
+  if (len > key_len && strncasecmp(buffer, "Content-Length:", key_len) == 0) {
+    char* value = oidc_strncopy(buffer + key_len,
+                                len - key_len);  // header line is not
+                                                 // zero terminated
+    size_t content_length = strtoul(value, NULL, 10);
+    secFree(value);
+    if (content_length > 0 && content_length < HTTP_BUFFER_MAX_RESERVE) {
+      string_reserve(s, content_length + 1);  // one allocation for the body
+    }
+  }
+  return len;
+}
+
+// curl_global_init is not thread safe and tears down shared state, so with
+// transfers running on several threads over the engine's multi handle it has
+// to happen exactly once for the process lifetime.
+static pthread_once_t curl_global_once = PTHREAD_ONCE_INIT;
+static CURLcode       curl_global_res  = CURLE_OK;
+
+static void _curl_globalInit() {
+  curl_global_res = curl_global_init_mem(CURL_GLOBAL_ALL, secAlloc, _secFree,
+                                         secRealloc, oidc_strcopy, secCalloc);
+}
+
 /** @fn CURL* init()
  * @brief initializes curl
  * @return a CURL pointer
  */
 CURL* init() {
-  CURLcode res = curl_global_init_mem(CURL_GLOBAL_ALL, secAlloc, _secFree,
-                                      secRealloc, oidc_strcopy, secCalloc);
-  if (CURLErrorHandling(res, NULL) != OIDC_SUCCESS) {
+  pthread_once(&curl_global_once, _curl_globalInit);
+  if (CURLErrorHandling(curl_global_res, NULL) != OIDC_SUCCESS) {
     return NULL;
   }
 
   CURL* curl = curl_easy_init();
   if (!curl) {
-    curl_global_cleanup();
     logger(ALERT, "%s (%s:%d) Couldn't init curl. %s\n", __func__, __FILE__,
-           __LINE__, curl_easy_strerror(res));
+           __LINE__, curl_easy_strerror(curl_global_res));
     oidc_errno = OIDC_ECURLI;
     return NULL;
   }
   return curl;
 }
 
+/**
+ * Per-host cache of easy handles.
+ *
+ * Destroying the easy handle after every call throws away the established
+ * keep-alive connection and TLS session, so every token refresh to the same
+ * issuer paid a full TCP+TLS handshake. Handles given back through
+ * @c cleanupReuse are kept per host and handed out again by @c init_forUrl;
+ * curl_easy_reset clears the options of the previous transfer but keeps the
+ * live connections and TLS session cache. Entries idle for too long are
+ * closed, and the least recently used one is evicted when the cache is full.
+ */
+#define CURL_CACHE_SIZE 8
+#define CURL_CACHE_IDLE_TIMEOUT 120
+
+struct curl_cache_entry {
+  char*  host;
+  CURL*  curl;
+  time_t last_used;
+};
+
+static struct curl_cache_entry curl_cache[CURL_CACHE_SIZE];
+static pthread_mutex_t         curl_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+char* http_urlHost(const char* url) {
+  if (url == NULL) {
+    return NULL;
+  }
+  const char* start = strstr(url, "://");
+  start             = start ? start + 3 : url;
+  const char* end   = strchr(start, '/');
+  return end ? oidc_strncopy(start, end - start) : oidc_strcopy(start);
+}
+
+static void _curl_cacheDropEntry(struct curl_cache_entry* entry) {
+  curl_easy_cleanup(entry->curl);
+  secFree(entry->host);
+  entry->curl      = NULL;
+  entry->last_used = 0;
+}
+
+static void _curl_cacheExpire() {
+  time_t now = time(NULL);
+  for (unsigned char i = 0; i < CURL_CACHE_SIZE; i++) {
+    if (curl_cache[i].curl != NULL &&
+        curl_cache[i].last_used + CURL_CACHE_IDLE_TIMEOUT < now) {
+      logger(DEBUG, "Closing idle connection to %s", curl_cache[i].host);
+      _curl_cacheDropEntry(&curl_cache[i]);
+    }
+  }
+}
+
+/**
+ * @brief gets an easy handle for a request to @p url, reusing a cached one
+ * for the same host if available
+ * @return a CURL pointer. Has to be given back using @c cleanupReuse (or
+ * @c cleanup if the connection state is unknown).
+ */
+CURL* init_forUrl(const char* url) {
+  char* host = http_urlHost(url);
+  if (host != NULL) {
+    pthread_mutex_lock(&curl_cache_lock);
+    _curl_cacheExpire();
+    for (unsigned char i = 0; i < CURL_CACHE_SIZE; i++) {
+      if (curl_cache[i].curl != NULL && strequal(curl_cache[i].host, host)) {
+        CURL* curl = curl_cache[i].curl;
+        curl_cache[i].curl = NULL;  // in use now
+        secFree(curl_cache[i].host);
+        pthread_mutex_unlock(&curl_cache_lock);
+        secFree(host);
+        logger(DEBUG, "Reusing connection to %s", url);
+        curl_easy_reset(curl);  // keeps connections and TLS sessions
+        return curl;
+      }
+    }
+    pthread_mutex_unlock(&curl_cache_lock);
+    secFree(host);
+  }
+  return init();
+}
+
+/**
+ * @brief gives an easy handle back for reuse by later requests to the same
+ * host
+ *
+ * The handle's keep-alive connection and TLS session stay established. If
+ * the cache is full the least recently used entry is closed.
+ */
+void cleanupReuse(CURL* curl, const char* url) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    cleanup(curl);
+    return;
+  }
+  pthread_mutex_lock(&curl_cache_lock);
+  _curl_cacheExpire();
+  struct curl_cache_entry* slot = NULL;
+  for (unsigned char i = 0; i < CURL_CACHE_SIZE; i++) {
+    if (curl_cache[i].curl == NULL) {
+      slot = &curl_cache[i];
+      break;
+    }
+    if (slot == NULL || curl_cache[i].last_used < slot->last_used) {
+      slot = &curl_cache[i];  // least recently used candidate
+    }
+  }
+  if (slot->curl != NULL) {
+    logger(DEBUG, "Evicting cached connection to %s", slot->host);
+    _curl_cacheDropEntry(slot);
+  }
+  slot->host      = host;
+  slot->curl      = curl;
+  slot->last_used = time(NULL);
+  pthread_mutex_unlock(&curl_cache_lock);
+}
+
 /** @fn void setSSLOpts(CURL* curl)
  * @brief sets SSL options
  * @param curl the curl instance
@@ -66,6 +220,8 @@ oidc_error_t setWriteFunction(CURL* curl, struct string* s) {
   }
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, s);
   return OIDC_SUCCESS;
 }
 
@@ -111,15 +267,17 @@ void setBasicAuth(CURL* curl, const char* username, const char* password) {
 oidc_error_t perform(CURL* curl) {
   // curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
   // curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+  AGENT_PROBE1(curl_perform_start, curl);
   CURLcode res = curl_easy_perform(curl);
+  AGENT_PROBE1(curl_perform_done, res);
   return CURLErrorHandling(res, curl);
 }
 
 /** @fn void cleanup(CURL* curl)
- * @brief does a easy and global cleanup
+ * @brief cleans up the easy handle
+ *
+ * The global curl state stays alive: other threads may have transfers in
+ * flight on the engine's multi handle.
  * @param curl the curl instance
  */
-void cleanup(CURL* curl) {
-  curl_easy_cleanup(curl);
-  curl_global_cleanup();
-}
+void cleanup(CURL* curl) { curl_easy_cleanup(curl); }
@@ -7,6 +7,9 @@
 #include <curl/curl.h>
 
 CURL*        init();
+CURL*        init_forUrl(const char* url);
+char*        http_urlHost(const char* url);
+void         cleanupReuse(CURL* curl, const char* url);
 void         setSSLOpts(CURL* curl, const char* cert_file);
 oidc_error_t setWriteFunction(CURL* curl, struct string* s);
 void         setUrl(CURL* curl, const char* url);
@@ -1,54 +1,17 @@
-#define _GNU_SOURCE
 #include "http_ipc.h"
-#include "ipc/pipe.h"
-#include "utils/oidc_error.h"
 #include "utils/logger.h"
+#include "utils/oidc_error.h"
 
-#include <fcntl.h>
-#include <signal.h>
-#include <stdlib.h>
-#include <sys/ioctl.h>
-#include <sys/select.h>
-#include <unistd.h>
-
-char* _handleParent(struct ipcPipe pipes) {
-  char* e = ipc_readFromPipe(pipes);
-  ipc_closePipes(pipes);
-  if (e == NULL) {
-    return NULL;
-  }
-  char*    end   = NULL;
-  long int error = strtol(e, &end, 10);
-  if (error) {
-    secFree(e);
-    oidc_errno = error;
-    logger(ERROR, "Error from http request: %s",
-           oidc_serror());
-    return NULL;
-  }
-  if (*end != '\0') {
-    char* res = e;
-    logger(DEBUG, "Received response: %s", res);
-    return res;
-  }
-  secFree(e);
-  logger(ERROR, "Internal error: Http sent 0");
-  oidc_errno = OIDC_EHTTP0;
-  return NULL;
-}
-
-void handleChild(char* res, struct ipcPipe pipes) {
-  if (res == NULL) {
-    ipc_writeOidcErrnoToPipe(pipes);
-    exit(EXIT_FAILURE);
-  }
-  ipc_writeToPipe(pipes, res);
-  secFree(res);
-  exit(EXIT_SUCCESS);
-}
+/**
+ * Historically every request forked a child that performed the transfer and
+ * sent the result back through a pipe. Since all transfers now run over the
+ * curl multi engine (http_engine.c) - which needs them in one process to
+ * overlap them and reuse connections - these entry points call into the
+ * http module directly.
+ */
 
 /** @fn char* httpsGET(const char* url, const char* cert_path)
- * @brief forks and does a https GET request
+ * @brief does a https GET request over the http engine
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @return a pointer to the response. Has to be freed after usage. If the Https
@@ -56,32 +19,12 @@ void handleChild(char* res, struct ipcPipe pipes) {
  */
 char* httpsGET(const char* url, struct curl_slist* headers,
                const char* cert_path) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    return NULL;
-  }
-  pid_t pid = fork();
-  if (pid == -1) {
-    logger(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return NULL;
-  }
-  if (pid == 0) {  // child
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    logger_open("oidc-agent.http");
-    char* res = _httpsGET(url, headers, cert_path);
-    handleChild(res, childPipes);
-    return NULL;
-  } else {  // parent
-    signal(SIGCHLD, SIG_IGN);
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return _handleParent(parentPipes);
-  }
+  return _httpsGET(url, headers, cert_path);
 }
 
 /** @fn char* httpsPOST(const char* url, const char* data, const char*
  * cert_path)
- * @brief forks and does a https POST request
+ * @brief does a https POST request over the http engine
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @param data the data to be posted
@@ -91,26 +34,7 @@ char* httpsGET(const char* url, struct curl_slist* headers,
 char* httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                 const char* cert_path, const char* username,
                 const char* password) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    return NULL;
-  }
-  pid_t pid = fork();
-  if (pid == -1) {
-    logger(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return NULL;
-  }
-  if (pid == 0) {  // child
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    logger_open("oidc-agent.http");
-    char* res = _httpsPOST(url, data, headers, cert_path, username, password);
-    handleChild(res, childPipes);
-    return NULL;
-  } else {  // parent
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return _handleParent(parentPipes);
-  }
+  return _httpsPOST(url, data, headers, cert_path, username, password);
 }
 
 char* sendPostDataWithBasicAuth(const char* endpoint, const char* data,
@@ -0,0 +1,204 @@
+#include "http_metrics.h"
+#include "http_handler.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+
+/**
+ * Per-endpoint HTTP metrics.
+ *
+ * Every transfer is counted into a per-host slot holding request and error
+ * counters, the accumulated transfer time and a power-of-two latency
+ * histogram. The hot path takes no lock: slots are found by scanning a fixed
+ * array whose host pointers are published with a release store after the
+ * slot is set up, and all counters are updated with relaxed atomic adds -
+ * exact cross-counter consistency does not matter for monitoring. Only
+ * registering a new host takes a mutex.
+ */
+
+#define HTTP_METRICS_HOSTS 16
+
+struct http_metrics_entry {
+  char*         host;
+  unsigned long requests;
+  unsigned long errors;
+  unsigned long total_time_ms;
+  unsigned long buckets[HTTP_METRICS_BUCKETS];
+};
+
+static struct http_metrics_entry metrics[HTTP_METRICS_HOSTS];
+static pthread_mutex_t           metrics_register_lock =
+    PTHREAD_MUTEX_INITIALIZER;
+
+static struct http_metrics_entry* _metrics_find(const char* host) {
+  for (unsigned char i = 0; i < HTTP_METRICS_HOSTS; i++) {
+    char* h = __atomic_load_n(&metrics[i].host, __ATOMIC_ACQUIRE);
+    if (h != NULL && strequal(h, host)) {
+      return &metrics[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief registers a slot for @p host, taking ownership of it
+ * @return the slot; @c NULL if the table is full - the host then simply
+ * stays uncounted
+ */
+static struct http_metrics_entry* _metrics_register(char* host) {
+  pthread_mutex_lock(&metrics_register_lock);
+  struct http_metrics_entry* entry = _metrics_find(host);
+  if (entry != NULL) {  // registered concurrently
+    pthread_mutex_unlock(&metrics_register_lock);
+    secFree(host);
+    return entry;
+  }
+  for (unsigned char i = 0; i < HTTP_METRICS_HOSTS; i++) {
+    if (metrics[i].host == NULL) {
+      // publish the host last so lock-free readers only see complete slots
+      __atomic_store_n(&metrics[i].host, host, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&metrics_register_lock);
+      return &metrics[i];
+    }
+  }
+  pthread_mutex_unlock(&metrics_register_lock);
+  logger(DEBUG, "http metrics table full; not counting %s", host);
+  secFree(host);
+  return NULL;
+}
+
+/**
+ * @brief counts a finished transfer to @p url
+ * @param duration_ms how long the transfer took
+ * @param success @c 0 for a transport-level failure, otherwise @c 1
+ */
+void http_metrics_record(const char* url, unsigned long duration_ms,
+                         int success) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return;
+  }
+  struct http_metrics_entry* entry = _metrics_find(host);
+  if (entry != NULL) {
+    secFree(host);
+  } else {
+    entry = _metrics_register(host);  // takes ownership of host
+    if (entry == NULL) {
+      return;
+    }
+  }
+  unsigned char bucket = 0;
+  for (unsigned long v = duration_ms;
+       v > 0 && bucket < HTTP_METRICS_BUCKETS - 1; v >>= 1) {
+    bucket++;
+  }
+  __atomic_add_fetch(&entry->requests, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->total_time_ms, duration_ms, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->buckets[bucket], 1, __ATOMIC_RELAXED);
+  if (!success) {
+    __atomic_add_fetch(&entry->errors, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * @brief dumps all collected metrics
+ * @return a pointer to a JSON object string, keyed by host. Has to be freed
+ * after usage.
+ */
+char* http_metrics_toJSON() {
+  cJSON* obj = stringToJson("{}");
+  if (obj == NULL) {
+    return NULL;
+  }
+  for (unsigned char i = 0; i < HTTP_METRICS_HOSTS; i++) {
+    char* host = __atomic_load_n(&metrics[i].host, __ATOMIC_ACQUIRE);
+    if (host == NULL) {
+      continue;
+    }
+    cJSON* e = stringToJson("{}");
+    jsonAddNumberValue(e, "requests",
+                       __atomic_load_n(&metrics[i].requests, __ATOMIC_RELAXED));
+    jsonAddNumberValue(e, "errors",
+                       __atomic_load_n(&metrics[i].errors, __ATOMIC_RELAXED));
+    jsonAddNumberValue(
+        e, "total_time_ms",
+        __atomic_load_n(&metrics[i].total_time_ms, __ATOMIC_RELAXED));
+    char* buckets = oidc_strcopy("[");
+    for (unsigned char b = 0; b < HTTP_METRICS_BUCKETS; b++) {
+      char* tmp = oidc_sprintf(
+          "%s%s%lu", buckets, b == 0 ? "" : ",",
+          __atomic_load_n(&metrics[i].buckets[b], __ATOMIC_RELAXED));
+      secFree(buckets);
+      buckets = tmp;
+    }
+    char* arr = oidc_strcat(buckets, "]");
+    secFree(buckets);
+    jsonAddArrayValue(e, "latency_ms_pow2_buckets", arr);
+    secFree(arr);
+    jsonAddJSON(obj, host, e);
+  }
+  char* json = jsonToStringUnformatted(obj);
+  secFreeJson(obj);
+  return json;
+}
+
+/**
+ * @brief dumps all collected metrics in the Prometheus text exposition
+ * format
+ *
+ * The power-of-two buckets map exactly onto cumulative 'le' bounds: after
+ * adding bucket @c b the covered durations are those below @c 2^b ms, so
+ * the bound is @c 2^b-1.
+ * @return a pointer to the exposition text. Has to be freed after usage.
+ */
+char* http_metrics_toPrometheus() {
+  char* text = oidc_strcopy(
+      "# HELP oidc_agent_http_requests_total HTTP transfers, by host.\n"
+      "# TYPE oidc_agent_http_requests_total counter\n"
+      "# HELP oidc_agent_http_errors_total Failed HTTP transfers, by host.\n"
+      "# TYPE oidc_agent_http_errors_total counter\n"
+      "# HELP oidc_agent_http_request_duration_milliseconds Transfer time, "
+      "by host.\n"
+      "# TYPE oidc_agent_http_request_duration_milliseconds histogram\n");
+  for (unsigned char i = 0; i < HTTP_METRICS_HOSTS; i++) {
+    char* host = __atomic_load_n(&metrics[i].host, __ATOMIC_ACQUIRE);
+    if (host == NULL) {
+      continue;
+    }
+    unsigned long requests =
+        __atomic_load_n(&metrics[i].requests, __ATOMIC_RELAXED);
+    char* tmp = oidc_sprintf(
+        "%soidc_agent_http_requests_total{host=\"%s\"} %lu\n"
+        "oidc_agent_http_errors_total{host=\"%s\"} %lu\n",
+        text, host, requests, host,
+        __atomic_load_n(&metrics[i].errors, __ATOMIC_RELAXED));
+    secFree(text);
+    text              = tmp;
+    unsigned long cum = 0;
+    for (unsigned char b = 0; b < HTTP_METRICS_BUCKETS - 1; b++) {
+      cum += __atomic_load_n(&metrics[i].buckets[b], __ATOMIC_RELAXED);
+      tmp = oidc_sprintf(
+          "%soidc_agent_http_request_duration_milliseconds_bucket{"
+          "host=\"%s\",le=\"%lu\"} %lu\n",
+          text, host, (1UL << b) - 1, cum);
+      secFree(text);
+      text = tmp;
+    }
+    tmp = oidc_sprintf(
+        "%soidc_agent_http_request_duration_milliseconds_bucket{"
+        "host=\"%s\",le=\"+Inf\"} %lu\n"
+        "oidc_agent_http_request_duration_milliseconds_sum{host=\"%s\"} "
+        "%lu\n"
+        "oidc_agent_http_request_duration_milliseconds_count{host=\"%s\"} "
+        "%lu\n",
+        text, host, requests, host,
+        __atomic_load_n(&metrics[i].total_time_ms, __ATOMIC_RELAXED), host,
+        requests);
+    secFree(text);
+    text = tmp;
+  }
+  return text;
+}
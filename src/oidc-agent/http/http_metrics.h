@@ -0,0 +1,13 @@
+#ifndef HTTP_METRICS_H
+#define HTTP_METRICS_H
+
+// Power-of-two latency buckets: bucket i counts transfers that took
+// [2^(i-1), 2^i) milliseconds; the last bucket takes everything slower.
+#define HTTP_METRICS_BUCKETS 12
+
+void  http_metrics_record(const char* url, unsigned long duration_ms,
+                          int success);
+char* http_metrics_toJSON();
+char* http_metrics_toPrometheus();
+
+#endif  // HTTP_METRICS_H
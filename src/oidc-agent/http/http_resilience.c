@@ -0,0 +1,305 @@
+#define _XOPEN_SOURCE 700
+#include "http_resilience.h"
+#include "http_handler.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sodium.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Per-issuer circuit breaker.
+ *
+ * When an issuer is down every request against it still eats a full connect
+ * timeout; renewal jobs that retry in a loop turn that into a permanent
+ * stall. After a few consecutive transport failures the breaker for the host
+ * opens and further requests fail immediately. Once the cooldown passed a
+ * single probe request is let through (half-open); its outcome decides
+ * whether the breaker closes again or stays open for another cooldown.
+ */
+
+#define BREAKER_SIZE 8
+
+struct breaker_entry {
+  char*         host;
+  unsigned char failures;
+  time_t        open_until;
+  unsigned char probing;  // a half-open probe is in flight
+};
+
+static struct breaker_entry breakers[BREAKER_SIZE];
+static pthread_mutex_t      breaker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// called with the lock held
+static struct breaker_entry* _breaker_find(const char* host) {
+  for (unsigned char i = 0; i < BREAKER_SIZE; i++) {
+    if (breakers[i].host != NULL && strequal(breakers[i].host, host)) {
+      return &breakers[i];
+    }
+  }
+  return NULL;
+}
+
+// called with the lock held
+static struct breaker_entry* _breaker_findOrAdd(const char* host) {
+  struct breaker_entry* entry = _breaker_find(host);
+  if (entry != NULL) {
+    return entry;
+  }
+  struct breaker_entry* slot = &breakers[0];
+  for (unsigned char i = 0; i < BREAKER_SIZE; i++) {
+    if (breakers[i].host == NULL) {
+      slot = &breakers[i];
+      break;
+    }
+    if (breakers[i].open_until < slot->open_until) {
+      slot = &breakers[i];  // reuse the entry that recovers first
+    }
+  }
+  secFree(slot->host);
+  slot->host       = oidc_strcopy(host);
+  slot->failures   = 0;
+  slot->open_until = 0;
+  slot->probing    = 0;
+  return slot;
+}
+
+/**
+ * @brief checks whether a request to @p url may be performed
+ * @return @c 1 if the request may proceed; @c 0 if the breaker for this host
+ * is open - oidc_errno is set and the caller should fail fast
+ */
+int http_breaker_allowRequest(const char* url) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return 1;
+  }
+  pthread_mutex_lock(&breaker_lock);
+  struct breaker_entry* entry = _breaker_find(host);
+  if (entry == NULL || entry->failures < HTTP_BREAKER_THRESHOLD) {
+    pthread_mutex_unlock(&breaker_lock);
+    secFree(host);
+    return 1;
+  }
+  if (entry->open_until <= time(NULL) && !entry->probing) {
+    entry->probing = 1;  // half-open: let a single probe through
+    pthread_mutex_unlock(&breaker_lock);
+    logger(DEBUG, "Circuit breaker for %s half-open; probing", host);
+    secFree(host);
+    return 1;
+  }
+  pthread_mutex_unlock(&breaker_lock);
+  logger(DEBUG, "Circuit breaker open for %s; failing fast", host);
+  char* err = oidc_sprintf("Issuer %s is currently unreachable", host);
+  oidc_seterror(err);
+  secFree(err);
+  oidc_errno = OIDC_EERROR;
+  secFree(host);
+  return 0;
+}
+
+/**
+ * @brief records the outcome of a request to @p url
+ * @param success @c 1 on a completed transfer (any HTTP status counts: the
+ * endpoint answered), @c 0 on a transport-level failure
+ */
+void http_breaker_report(const char* url, int success) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&breaker_lock);
+  if (success) {
+    struct breaker_entry* entry = _breaker_find(host);
+    if (entry != NULL) {
+      if (entry->failures >= HTTP_BREAKER_THRESHOLD) {
+        logger(DEBUG, "Circuit breaker for %s closed again", host);
+      }
+      entry->failures   = 0;
+      entry->open_until = 0;
+      entry->probing    = 0;
+    }
+  } else {
+    struct breaker_entry* entry = _breaker_findOrAdd(host);
+    if (entry->failures < HTTP_BREAKER_THRESHOLD) {
+      entry->failures++;
+    }
+    entry->probing = 0;
+    if (entry->failures >= HTTP_BREAKER_THRESHOLD) {
+      entry->open_until = time(NULL) + HTTP_BREAKER_COOLDOWN;
+      logger(NOTICE, "Circuit breaker for %s open for %d seconds", host,
+             HTTP_BREAKER_COOLDOWN);
+    }
+  }
+  pthread_mutex_unlock(&breaker_lock);
+  secFree(host);
+}
+
+/**
+ * @brief opens the breaker for @p url's host because the endpoint asked to
+ * slow down (HTTP 429)
+ *
+ * The answer completed on the transport level, so it does not count as a
+ * failure - but sending the next requests right away would only collect
+ * more 429s and strain the issuer relationship. The breaker machinery gives
+ * exactly the wanted behavior: requests fail fast for the requested window,
+ * then a single probe decides whether the issuer accepts traffic again.
+ * @param retry_after the Retry-After value in seconds; @c 0 if the response
+ * did not carry one
+ */
+void http_breaker_throttle(const char* url, long retry_after) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return;
+  }
+  if (retry_after <= 0) {
+    retry_after = HTTP_BREAKER_COOLDOWN;
+  }
+  pthread_mutex_lock(&breaker_lock);
+  struct breaker_entry* entry = _breaker_findOrAdd(host);
+  entry->failures             = HTTP_BREAKER_THRESHOLD;
+  entry->probing              = 0;
+  time_t until                = time(NULL) + retry_after;
+  if (until > entry->open_until) {
+    entry->open_until = until;
+  }
+  pthread_mutex_unlock(&breaker_lock);
+  logger(NOTICE, "Issuer %s asked to slow down (429); pausing requests for %ld seconds",
+         host, retry_after);
+  secFree(host);
+}
+
+/**
+ * Per-host concurrency limiter.
+ *
+ * With the worker pool, the refresh walk and client retries all issuing
+ * requests at once, an issuer hiccup can otherwise open a pile of
+ * connections to one endpoint and trip its rate limits. At most
+ * HTTP_HOST_MAX_CONCURRENT transfers per host run concurrently; excess
+ * requests wait on the host's condition variable - the kernel wakes
+ * waiters roughly in arrival order, so the queue drains fairly - and give
+ * up when the client's deadline budget, or the default patience without
+ * one, is spent.
+ */
+
+struct limiter_entry {
+  char*         host;
+  unsigned char active;
+};
+
+static struct limiter_entry limiters[BREAKER_SIZE];
+static pthread_mutex_t      limiter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       limiter_slot_freed = PTHREAD_COND_INITIALIZER;
+
+// called with the lock held
+static struct limiter_entry* _limiter_find(const char* host) {
+  for (unsigned char i = 0; i < BREAKER_SIZE; i++) {
+    if (limiters[i].host != NULL && strequal(limiters[i].host, host)) {
+      return &limiters[i];
+    }
+  }
+  return NULL;
+}
+
+// called with the lock held; returns NULL if the table is full of hosts
+// with active transfers - the request then runs unlimited rather than
+// blocking on an unrelated host's slot
+static struct limiter_entry* _limiter_findOrAdd(const char* host) {
+  struct limiter_entry* entry = _limiter_find(host);
+  if (entry != NULL) {
+    return entry;
+  }
+  for (unsigned char i = 0; i < BREAKER_SIZE; i++) {
+    if (limiters[i].host == NULL || limiters[i].active == 0) {
+      secFree(limiters[i].host);
+      limiters[i].host   = oidc_strcopy(host);
+      limiters[i].active = 0;
+      return &limiters[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief waits for a free connection slot to @p url's host
+ * @param budget_ms the remaining deadline budget of the request; @c 0 if it
+ * has no deadline
+ * @return @c 1 once a slot is held (release it with
+ * @c http_limiter_release); @c 0 if the budget was spent while queued -
+ * oidc_errno is set and the caller should fail fast
+ */
+int http_limiter_acquire(const char* url, long budget_ms) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return 1;
+  }
+  long wait_ms = budget_ms > 0 ? budget_ms : HTTP_LIMITER_MAX_WAIT * 1000;
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += wait_ms / 1000;
+  until.tv_nsec += (wait_ms % 1000) * 1000000;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&limiter_lock);
+  struct limiter_entry* entry = _limiter_findOrAdd(host);
+  while (entry != NULL && entry->active >= HTTP_HOST_MAX_CONCURRENT) {
+    logger(DEBUG, "Waiting for a connection slot to %s", host);
+    if (pthread_cond_timedwait(&limiter_slot_freed, &limiter_lock, &until) ==
+        ETIMEDOUT) {
+      pthread_mutex_unlock(&limiter_lock);
+      char* err = oidc_sprintf("Too many concurrent requests to %s", host);
+      oidc_seterror(err);
+      secFree(err);
+      oidc_errno = budget_ms > 0 ? OIDC_ETIMEOUT : OIDC_EERROR;
+      secFree(host);
+      return 0;
+    }
+    entry = _limiter_findOrAdd(host);  // the entry may have been reused for
+                                       // another host meanwhile
+  }
+  if (entry != NULL) {
+    entry->active++;
+  }
+  pthread_mutex_unlock(&limiter_lock);
+  secFree(host);
+  return 1;
+}
+
+/**
+ * @brief returns the connection slot taken with @c http_limiter_acquire
+ */
+void http_limiter_release(const char* url) {
+  char* host = http_urlHost(url);
+  if (host == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&limiter_lock);
+  struct limiter_entry* entry = _limiter_find(host);
+  if (entry != NULL && entry->active > 0) {
+    entry->active--;
+  }
+  pthread_cond_broadcast(&limiter_slot_freed);
+  pthread_mutex_unlock(&limiter_lock);
+  secFree(host);
+}
+
+/**
+ * @brief sleeps before retry number @p attempt
+ *
+ * Exponential backoff with full jitter: the wait doubles with every attempt
+ * and a random share of it is used, so parallel retries do not synchronize.
+ */
+void http_retryBackoff(unsigned char attempt) {
+  unsigned long max_wait = (unsigned long)HTTP_RETRY_BASE_US << attempt;
+  unsigned long wait     = randombytes_uniform(max_wait) + max_wait / 2;
+  logger(DEBUG, "Retrying in %lu us", wait);
+  struct timespec ts = {wait / 1000000, (wait % 1000000) * 1000};
+  nanosleep(&ts, NULL);
+}
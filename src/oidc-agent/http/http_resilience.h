@@ -0,0 +1,25 @@
+#ifndef HTTP_RESILIENCE_H
+#define HTTP_RESILIENCE_H
+
+// Retries after the first attempt, for idempotent (GET) requests only.
+#define HTTP_RETRY_MAX 2
+#define HTTP_RETRY_BASE_US 250000
+
+// Consecutive transport failures before a host's breaker opens, and how long
+// it stays open before a single probe request is let through.
+#define HTTP_BREAKER_THRESHOLD 3
+#define HTTP_BREAKER_COOLDOWN 30
+
+// Maximum concurrent requests to one host, and how long an excess request
+// without a client deadline waits for a slot before it fails.
+#define HTTP_HOST_MAX_CONCURRENT 4
+#define HTTP_LIMITER_MAX_WAIT 10
+
+int  http_breaker_allowRequest(const char* url);
+void http_breaker_report(const char* url, int success);
+void http_breaker_throttle(const char* url, long retry_after);
+int  http_limiter_acquire(const char* url, long budget_ms);
+void http_limiter_release(const char* url);
+void http_retryBackoff(unsigned char attempt);
+
+#endif  // HTTP_RESILIENCE_H
@@ -0,0 +1,111 @@
+#include "http_warmup.h"
+#include "defines/settings.h"
+#include "http_dns.h"
+#include "http_handler.h"
+#include "list/list.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <curl/curl.h>
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * Startup warm-up.
+ *
+ * The first HTTPS call after agent start used to pay curl's global init,
+ * the TLS backend initialization and CA bundle parsing, and the full
+ * TCP+TLS handshake to the issuer. A background thread started with the
+ * daemon does this work before the first real request arrives: it
+ * initializes curl, touches the CA bundle so the first handshake parses it
+ * from the page cache, pre-resolves the issuers the user has accounts for,
+ * and pre-connects to a few of them - the established connections are put
+ * into the per-host handle cache, where the first token request picks them
+ * up.
+ */
+
+#define WARMUP_PRECONNECT_MAX 4
+#define WARMUP_CONNECT_TIMEOUT 5
+
+static void _preconnect(const char* issuer_url) {
+  CURL* curl = init();
+  if (curl == NULL) {
+    return;
+  }
+  setUrl(curl, issuer_url);
+  setSSLOpts(curl, NULL);
+  curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)WARMUP_CONNECT_TIMEOUT);
+  CURLcode res = curl_easy_perform(curl);
+  if (res == CURLE_OK) {
+    logger(DEBUG, "pre-connected to %s", issuer_url);
+    cleanupReuse(curl, issuer_url);  // the warm connection goes into the
+                                     // handle cache
+  } else {
+    logger(DEBUG, "pre-connect to %s failed: %s", issuer_url,
+           curl_easy_strerror(res));
+    cleanup(curl);
+  }
+}
+
+static void* _warmup_main(void* ignored) {
+  (void)ignored;
+  CURL* curl = init();  // curl global init and TLS backend initialization
+  if (curl != NULL) {
+    cleanup(curl);
+  }
+  for (unsigned char i = 0;
+       i < sizeof(possibleCertFiles) / sizeof(*possibleCertFiles); i++) {
+    if (fileDoesExist(possibleCertFiles[i])) {
+      char* bundle = readFile(possibleCertFiles[i]);  // pull the CA store
+      secFree(bundle);                                // into the page cache
+      break;
+    }
+  }
+  // issuer.config lines are "<issuer_url> <shortname>..."; only issuers the
+  // user has an account for are listed with a shortname
+  list_t* lines = getLinesFromOidcFile(ISSUER_CONFIG_FILENAME);
+  if (lines == NULL) {
+    return NULL;
+  }
+  unsigned char    preconnected = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(lines, LIST_HEAD);
+  while ((node = list_iterator_next(it)) != NULL) {
+    const char* space = strchr(node->val, ' ');
+    if (space == NULL) {  // no account for this issuer
+      continue;
+    }
+    char* issuer = oidc_strncopy(node->val, space - (char*)node->val);
+    http_dns_prefetch(issuer);
+    if (preconnected < WARMUP_PRECONNECT_MAX) {
+      _preconnect(issuer);
+      preconnected++;
+    }
+    secFree(issuer);
+  }
+  list_iterator_destroy(it);
+  secFreeList(lines);
+  logger(DEBUG, "http warm-up done");
+  return NULL;
+}
+
+/**
+ * @brief warms up the http stack in the background
+ *
+ * Started with the daemon so the first token request after boot finds an
+ * initialized TLS stack, cached CA store and - for known issuers - an
+ * established connection.
+ */
+void http_warmup() {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _warmup_main, NULL) != 0) {
+    logger(ERROR, "could not create http warm-up thread: %m");
+    return;
+  }
+  pthread_detach(thread);
+}
@@ -0,0 +1,6 @@
+#ifndef HTTP_WARMUP_H
+#define HTTP_WARMUP_H
+
+void http_warmup();
+
+#endif  // HTTP_WARMUP_H
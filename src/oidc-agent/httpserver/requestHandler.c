@@ -4,15 +4,18 @@
 
 #include "defines/ipc_values.h"
 #include "ipc/serveripc.h"
+#include "list/list.h"
+#include "oidc-agent/httpserver/startHttpserver.h"
 #include "oidc-agent/oidc/parse_oidp.h"
+#include "utils/agent_metrics.h"
 #include "utils/errorUtils.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/stringUtils.h"
 
-#include <signal.h>
+#include <pthread.h>
 #include <string.h>
-#include <sys/types.h>
 
 const char* const HTML_SUCCESS =
 #include "static/success.html"
@@ -32,6 +35,105 @@ const char* const HTML_CODE_EXCHANGE_FAILED_WITH_ERROR =
 const char* const HTML_ERROR =
 #include "static/error.html"
     ;
+const char* const HTML_EXCHANGING =
+#include "static/exchanging.html"
+    ;
+
+// The pages without substitutions are wrapped in an MHD response exactly
+// once and the same object is queued for every request: queueing takes its
+// own reference, so the cached one is never destroyed. The templated pages
+// (state, error text) still have to be built per request.
+static struct MHD_Response* wrong_state_response = NULL;
+static struct MHD_Response* no_code_response     = NULL;
+static struct MHD_Response* pending_response     = NULL;
+static pthread_once_t       static_responses_once = PTHREAD_ONCE_INIT;
+
+static void _initStaticResponses() {
+  wrong_state_response = MHD_create_response_from_buffer(
+      strlen(HTML_WRONG_STATE), (void*)HTML_WRONG_STATE,
+      MHD_RESPMEM_PERSISTENT);
+  no_code_response = MHD_create_response_from_buffer(
+      strlen(HTML_NO_CODE), (void*)HTML_NO_CODE, MHD_RESPMEM_PERSISTENT);
+  pending_response = MHD_create_response_from_buffer(
+      strlen("pending"), (void*)"pending", MHD_RESPMEM_PERSISTENT);
+}
+
+/**
+ * A code exchange running (or finished) in the background, keyed by state.
+ * The redirect is answered with a progress page right away and the browser
+ * polls until the exchange finished, so the token-endpoint round trip does
+ * not sit between the user and the first rendered page and no mhd thread
+ * is held open across the http call.
+ */
+struct exchange_job {
+  char*         state;
+  char*         url;     // redirect uri incl. code; for the failure page
+  char*         result;  // the ipc response; valid once done is set
+  unsigned char done;
+};
+
+static list_t*         exchange_jobs = NULL;
+static pthread_mutex_t exchange_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _secFreeExchangeJob(struct exchange_job* job) {
+  secFree(job->state);
+  secFree(job->url);
+  secFree(job->result);
+  secFree(job);
+}
+
+static int _matchExchangeJob(const char* state, struct exchange_job* job) {
+  return strequal(job->state, state);
+}
+
+// exchange_lock has to be held
+static struct exchange_job* _findJob(const char* state) {
+  if (exchange_jobs == NULL || state == NULL) {
+    return NULL;
+  }
+  list_node_t* node = findInList(exchange_jobs, (char*)state);
+  return node != NULL ? node->val : NULL;
+}
+
+struct exchange_args {
+  char* state;
+  char* url;
+};
+
+static void* _exchangeThread(void* arg) {
+  struct exchange_args* args = arg;
+  char* res = ipc_cryptCommunicateWithServerPath(REQUEST_CODEEXCHANGE,
+                                                 args->url);
+  pthread_mutex_lock(&exchange_lock);
+  struct exchange_job* job = _findJob(args->state);
+  if (job != NULL) {
+    job->result = res;
+    job->done   = 1;
+  } else {  // the flow was terminated while the exchange ran
+    secFree(res);
+  }
+  pthread_mutex_unlock(&exchange_lock);
+  secFree(args->state);
+  secFree(args->url);
+  secFree(args);
+  return NULL;
+}
+
+/**
+ * @brief drops the exchange job for @p state, if any
+ * Called when a flow is terminated so a result nobody will poll for does
+ * not linger.
+ */
+void requestHandler_dropState(const char* state) {
+  pthread_mutex_lock(&exchange_lock);
+  if (exchange_jobs != NULL && state != NULL) {
+    list_node_t* node = findInList(exchange_jobs, (char*)state);
+    if (node != NULL) {
+      list_remove(exchange_jobs, node);
+    }
+  }
+  pthread_mutex_unlock(&exchange_lock);
+}
 
 static int makeResponseCodeExchangeFailed(struct MHD_Connection* connection,
                                           const char*            url) {
@@ -63,12 +165,9 @@ static int makeResponseFromIPCResponse(struct MHD_Connection* connection,
 }
 
 static int makeResponseWrongState(struct MHD_Connection* connection) {
-  struct MHD_Response* response = MHD_create_response_from_buffer(
-      strlen(HTML_WRONG_STATE), (void*)HTML_WRONG_STATE,
-      MHD_RESPMEM_PERSISTENT);
-  int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-  MHD_destroy_response(response);
-  return ret;
+  pthread_once(&static_responses_once, _initStaticResponses);
+  return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST,
+                            wrong_state_response);
 }
 
 static int makeResponseError(struct MHD_Connection* connection) {
@@ -85,17 +184,67 @@ static int makeResponseError(struct MHD_Connection* connection) {
     response = MHD_create_response_from_buffer(strlen(res), (void*)res,
                                                MHD_RESPMEM_MUST_COPY);
     secFree(res);
-    kill(getpid(), SIGTERM);
+    // the flow stays registered until the agent terminates it; the shared
+    // listener keeps serving the other pending flows
   } else {
-    response = MHD_create_response_from_buffer(
-        strlen(HTML_NO_CODE), (void*)HTML_NO_CODE, MHD_RESPMEM_PERSISTENT);
+    pthread_once(&static_responses_once, _initStaticResponses);
+    return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST,
+                              no_code_response);
   }
   int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
   MHD_destroy_response(response);
   return ret;
 }
 
-static int handleRequest(void* cls, struct MHD_Connection* connection) {
+static int makeResponseExchanging(struct MHD_Connection* connection,
+                                  const char*            state) {
+  char*                res      = oidc_sprintf(HTML_EXCHANGING, state);
+  struct MHD_Response* response = MHD_create_response_from_buffer(
+      strlen(res), (void*)res, MHD_RESPMEM_MUST_COPY);
+  secFree(res);
+  int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+static int _respondExchangeResult(struct MHD_Connection* connection, char* res,
+                                  const char* url, const char* state) {
+  if (res == NULL) {
+    return makeResponseCodeExchangeFailed(connection, url);
+  }
+  logger(DEBUG, "Httpserver ipc response is: %s", res);
+  return makeResponseFromIPCResponse(connection, res, url, state);
+}
+
+static int handlePoll(struct MHD_Connection* connection, const char* state) {
+  pthread_mutex_lock(&exchange_lock);
+  struct exchange_job* job = _findJob(state);
+  if (job == NULL) {
+    pthread_mutex_unlock(&exchange_lock);
+    return makeResponseWrongState(connection);
+  }
+  if (!job->done) {
+    pthread_mutex_unlock(&exchange_lock);
+    pthread_once(&static_responses_once, _initStaticResponses);
+    return MHD_queue_response(connection, MHD_HTTP_OK, pending_response);
+  }
+  char* res   = job->result;  // the final page is delivered exactly once;
+  job->result = NULL;         // take the result out before the job is freed
+  char* url   = job->url;
+  job->url    = NULL;
+  list_remove(exchange_jobs, list_find(exchange_jobs, job));
+  pthread_mutex_unlock(&exchange_lock);
+  int ret = _respondExchangeResult(connection, res, url, state);
+  secFree(url);
+  return ret;
+}
+
+static int handleRequest(struct MHD_Connection* connection) {
+  const char* poll =
+      MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "poll");
+  if (poll != NULL) {  // the progress page asking if the exchange finished
+    return handlePoll(connection, poll);
+  }
   const char* code =
       MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "code");
   const char* state =
@@ -105,22 +254,50 @@ static int handleRequest(void* cls, struct MHD_Connection* connection) {
     return makeResponseError(connection);
   }
   logger(DEBUG, "HttpServer: Code is %s", code);
-  char** cr = (char**)cls;
-  if (!strequal(cr[1], state)) {
+  char* redirect_uri = httpserver_uriForState(state);
+  if (redirect_uri == NULL) {  // no pending flow carries this state
     return makeResponseWrongState(connection);
   }
-  char* url = oidc_sprintf("%s?code=%s&state=%s", cr[0], code, state);
-  char* res = ipc_cryptCommunicateWithServerPath(REQUEST_CODEEXCHANGE, url);
-  int   ret;
-  if (res == NULL) {
-    ret = makeResponseCodeExchangeFailed(connection, url);
-  } else {
-    logger(DEBUG, "Httpserver ipc response is: %s", res);
-    ret = makeResponseFromIPCResponse(connection, res, url, state);
+  // span trace: the user authorized and the browser came back
+  agent_metrics_flowStage(state, "codeflow_authorization");
+  char* url =
+      oidc_sprintf("%s?code=%s&state=%s", redirect_uri, code, state);
+  secFree(redirect_uri);
+  pthread_mutex_lock(&exchange_lock);
+  if (exchange_jobs == NULL) {
+    exchange_jobs        = list_new();
+    exchange_jobs->free  = (void (*)(void*)) & _secFreeExchangeJob;
+    exchange_jobs->match = (matchFunction)_matchExchangeJob;
+  }
+  if (_findJob(state) == NULL) {  // first delivery of this code: start the
+                                  // exchange in the background
+    struct exchange_job* job = secAlloc(sizeof(struct exchange_job));
+    job->state               = oidc_strcopy(state);
+    job->url                 = oidc_strcopy(url);
+    struct exchange_args* args = secAlloc(sizeof(struct exchange_args));
+    args->state                = oidc_strcopy(state);
+    args->url                  = oidc_strcopy(url);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _exchangeThread, args) != 0) {
+      logger(ERROR, "could not create exchange thread: %m");
+      _secFreeExchangeJob(job);
+      secFree(args->state);
+      secFree(args->url);
+      secFree(args);
+      pthread_mutex_unlock(&exchange_lock);
+      // fall back to exchanging synchronously like before
+      char* res =
+          ipc_cryptCommunicateWithServerPath(REQUEST_CODEEXCHANGE, url);
+      int ret = _respondExchangeResult(connection, res, url, state);
+      secFree(url);
+      return ret;
+    }
+    pthread_detach(thread);
+    list_rpush(exchange_jobs, list_node_new(job));
   }
+  pthread_mutex_unlock(&exchange_lock);
   secFree(url);
-  secFreeArray(cr, 2);
-  return ret;
+  return makeResponseExchanging(connection, state);
 }
 
 int request_echo(void* cls, struct MHD_Connection* connection, const char* url,
@@ -144,6 +321,7 @@ int request_echo(void* cls, struct MHD_Connection* connection, const char* url,
     return MHD_NO; /* upload data in a GET!? */
   }
   *ptr = NULL; /* clear context pointer */
+  (void)cls;
 
-  return handleRequest(cls, connection);
+  return handleRequest(connection);
 }
@@ -6,5 +6,6 @@
 int request_echo(void* cls, struct MHD_Connection* connection, const char* url,
                  const char* method, const char* version,
                  const char* upload_data, size_t* upload_data_size, void** ptr);
+void requestHandler_dropState(const char* state);
 
 #endif  // HTTP_REQUEST_HANDLER_H
@@ -1,185 +1,398 @@
 #define _GNU_SOURCE
 #include "startHttpserver.h"
-#include "ipc/ipc.h"
 #include "list/list.h"
+#include "oidc-agent/agent_state.h"
 #include "requestHandler.h"
-#include "running_server.h"
-#include "termHttpserver.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/portUtils.h"
 #include "utils/stringUtils.h"
 
-#include <fcntl.h>
-#include <signal.h>
-#include <stdio.h>
-#include <stdlib.h>
-#ifdef __APPLE__
-#include <sys/event.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#else
-#include <sys/prctl.h>
-#endif
+#include <microhttpd.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 /**
- * @param config a pointer to a json account config.
- * */
-struct MHD_Daemon** startHttpServer(const char* redirect_uri,
-                                    const char* state) {
-  logger_open("oidc-agent.httpserver");
-  unsigned short port = getPortFromUri(redirect_uri);
-  if (port == 0) {
-    logger(NOTICE, "Could not get port from uri");
-    return NULL;
+ * In-process redirect listener for the auth code flow.
+ *
+ * The flow used to fork a helper process per pending flow, each running a
+ * libmicrohttpd daemon with a thread per browser connection, and to read
+ * the bound port back over a pipe before the auth url could be printed.
+ * Redirects are now served in-process: one epoll-mode daemon per redirect
+ * port, shared by every pending flow on that port, and the pending states
+ * live in a registry the request handler consults. Starting a flow costs a
+ * registry entry - plus a daemon start when its port is not bound yet -
+ * instead of fork+pipe, and a daemon owns one listener thread however many
+ * flows and connections it serves.
+ */
+
+struct redirect_state {
+  char*          state;         // the (prefixed) oidc state parameter
+  char*          redirect_uri;  // uri the received code is attached to
+  unsigned short port;
+  time_t         started;  // when the flow registered; for the status query
+};
+
+struct port_listener {
+  unsigned short     port;
+  unsigned int       states;  // pending flows served by this listener
+  struct MHD_Daemon* daemon;
+};
+
+static list_t* redirect_states = NULL;
+static list_t* port_listeners  = NULL;
+// the request handler runs on mhd's listener threads while flows are
+// started and terminated on agent threads
+static pthread_mutex_t httpserver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// How long a failed bind keeps a port out of the probing order. Accounts
+// often register many stale redirect uris; remembering which ports did not
+// bind lets later flows converge on a working one without re-probing the
+// whole list. Can be overridden at build time.
+#ifndef PORT_FAIL_DECAY
+#define PORT_FAIL_DECAY 60
+#endif
+
+// one bit per port; decayed wholesale when the oldest entry expires
+static unsigned char failed_ports[65536 / 8];
+static time_t        failed_since = 0;
+
+static void _markPortFailed(unsigned short port) {
+  if (failed_since == 0) {
+    failed_since = time(NULL);
+  }
+  failed_ports[port / 8] |= (unsigned char)(1 << (port % 8));
+}
+
+static int _portRecentlyFailed(unsigned short port) {
+  if (failed_since == 0) {
+    return 0;
+  }
+  if (time(NULL) - failed_since >= PORT_FAIL_DECAY) {
+    memset(failed_ports, 0, sizeof(failed_ports));
+    failed_since = 0;
+    return 0;
+  }
+  return (failed_ports[port / 8] >> (port % 8)) & 1;
+}
+
+static int _portAllowed(unsigned short port) {
+  if (agent_state.portRangeMin == 0) {  // no range configured
+    return 1;
+  }
+  return port >= agent_state.portRangeMin && port <= agent_state.portRangeMax;
+}
+
+static void _secFreeRedirectState(struct redirect_state* s) {
+  secFree(s->state);
+  secFree(s->redirect_uri);
+  secFree(s);
+}
+
+static int _matchRedirectState(const char* state, struct redirect_state* s) {
+  return strequal(s->state, state);
+}
+
+static void _initLists() {
+  if (redirect_states == NULL) {
+    redirect_states        = list_new();
+    redirect_states->free  = (void (*)(void*)) & _secFreeRedirectState;
+    redirect_states->match = (matchFunction)_matchRedirectState;
+  }
+  if (port_listeners == NULL) {
+    port_listeners       = list_new();
+    port_listeners->free = (void (*)(void*)) & _secFree;
   }
-  size_t              cls_size = 2;
-  struct MHD_Daemon** d_ptr    = secAlloc(sizeof(struct MHD_Daemon*));
-  char**              cls      = secAlloc(sizeof(char*) * cls_size);
-  cls[0]                       = oidc_strcopy(redirect_uri);
-  cls[1] = oidc_sprintf("%hhu:%s", strEnds(redirect_uri, "/"), state);
-  *d_ptr = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION, port, NULL, NULL,
-                            &request_echo, cls, MHD_OPTION_END);
-
-  if (*d_ptr == NULL) {
-    logger(ERROR, "Error starting the HttpServer on port %d", port);
-    oidc_errno = OIDC_EHTTPD;
-    secFree(d_ptr);
-    secFreeArray(cls, cls_size);
+}
+
+static struct port_listener* _listenerForPort(unsigned short port) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(port_listeners, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct port_listener* l = node->val;
+    if (l->port == port) {
+      list_iterator_destroy(it);
+      return l;
+    }
+  }
+  list_iterator_destroy(it);
+  return NULL;
+}
+
+/**
+ * @brief looks up the redirect uri registered for @p state
+ * Called by the request handler for every incoming redirect.
+ * @return the registered uri - Has to be freed after usage - or @c NULL if
+ * no flow with this state is pending
+ */
+char* httpserver_uriForState(const char* state) {
+  if (state == NULL) {
     return NULL;
   }
-  logger(DEBUG, "HttpServer: Started HttpServer on port %d", port);
-  return d_ptr;
+  pthread_mutex_lock(&httpserver_lock);
+  char* uri = NULL;
+  if (redirect_states != NULL) {
+    list_node_t* node = findInList(redirect_states, (char*)state);
+    if (node != NULL) {
+      uri = oidc_strcopy(((struct redirect_state*)node->val)->redirect_uri);
+    }
+  }
+  pthread_mutex_unlock(&httpserver_lock);
+  return uri;
 }
 
-struct MHD_Daemon** oidc_mhd_daemon_ptr = NULL;
+static void* _stopDaemonThread(void* daemon) {
+  MHD_stop_daemon(daemon);
+  return NULL;
+}
 
-#ifdef __APPLE__
-// void noteProcDeath(CFFileDescriptorRef fdref, CFOptionFlags callBackTypes,
-//                    void* info) {
-//   struct kevent kev;
-//   int           fd = CFFileDescriptorGetNativeDescriptor(fdref);
-//   kevent(fd, NULL, 0, &kev, 1, NULL);
-//   // take action on death of process here
-//   unsigned int dead_pid = (unsigned int)kev.ident;
-//
-//   CFFileDescriptorInvalidate(fdref);
-//   CFRelease(fdref);
-//
-//   int our_pid = getpid();
-//   exit(EXIT_FAILURE);
-// }
-//
-// void suicide_if_we_become_a_zombie() {
-//   int           parent_pid = getppid();
-//   int           fd         = kqueue();
-//   struct kevent kev;
-//   EV_SET(&kev, parent_pid, EVFILT_PROC, EV_ADD | EV_ENABLE, NOTE_EXIT, 0,
-//   NULL); kevent(fd, &kev, 1, NULL, 0, NULL); CFFileDescriptorRef fdref =
-//   CFFileDescriptorCreate(kCFAllocatorDefault, fd,
-//                                                      true, noteProcDeath,
-//                                                      NULL);
-//   CFFileDescriptorEnableCallBacks(fdref, kCFFileDescriptorReadCallBack);
-//   CFRunLoopSourceRef source =
-//       CFFileDescriptorCreateRunLoopSource(kCFAllocatorDefault, fdref, 0);
-//   CFRunLoopAddSource(CFRunLoopGetMain(), source, kCFRunLoopDefaultMode);
-//   CFRelease(source);
-// }
-#endif
+/**
+ * @brief unregisters the flow for @p state and reaps its listener
+ *
+ * The daemon is only stopped when no other pending flow shares its port,
+ * and the stop runs on a detached thread: @c MHD_stop_daemon joins the
+ * listener thread, which may right now wait for this agent to answer a code
+ * exchange - waiting for it here would deadlock.
+ */
+void httpserver_stopForState(const char* state) {
+  pthread_mutex_lock(&httpserver_lock);
+  list_node_t* node = redirect_states != NULL
+                          ? findInList(redirect_states, (char*)state)
+                          : NULL;
+  if (node == NULL) {
+    pthread_mutex_unlock(&httpserver_lock);
+    logger(DEBUG, "No webserver registered for state %s", state);
+    return;
+  }
+  unsigned short port = ((struct redirect_state*)node->val)->port;
+  list_remove(redirect_states, node);
+  struct MHD_Daemon*    daemon   = NULL;
+  struct port_listener* listener = _listenerForPort(port);
+  if (listener != NULL && --(listener->states) == 0) {
+    daemon = listener->daemon;
+    list_remove(port_listeners, list_find(port_listeners, listener));
+  }
+  pthread_mutex_unlock(&httpserver_lock);
+  requestHandler_dropState(state);  // a pending exchange result for this
+                                    // flow will never be polled for
+  logger(DEBUG, "Unregistered webserver for state %s", state);
+  if (daemon != NULL) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _stopDaemonThread, daemon) != 0) {
+      logger(ERROR, "could not create stop thread: %m");
+      return;
+    }
+    pthread_detach(thread);
+    logger(DEBUG, "HttpServer: Stopping HttpServer on port %hu", port);
+  }
+}
 
-void http_sig_handler(int signo) {
-  switch (signo) {
-    case SIGTERM:
-      sleep(5);
-      stopHttpServer(oidc_mhd_daemon_ptr);
-      break;
-    default: logger(EMERGENCY, "HttpServer caught Signal %d", signo);
+/**
+ * @brief lists the pending redirect listeners with their ages
+ * @return a json array of the pending flows - port and age in seconds per
+ * entry - for the metrics response. Has to be freed after usage.
+ */
+char* httpserver_statusToJSON() {
+  cJSON* arr = stringToJson("[]");
+  if (arr == NULL) {
+    return NULL;
   }
-  exit(signo);
+  time_t now = time(NULL);
+  pthread_mutex_lock(&httpserver_lock);
+  if (redirect_states != NULL) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(redirect_states, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      struct redirect_state* s     = node->val;
+      cJSON*                 entry = stringToJson("{}");
+      jsonAddNumberValue(entry, "port", s->port);
+      jsonAddNumberValue(entry, "age_s", now - s->started);
+      cJSON_AddItemToArray(arr, entry);
+    }
+    list_iterator_destroy(it);
+  }
+  pthread_mutex_unlock(&httpserver_lock);
+  char* json = jsonToStringUnformatted(arr);
+  secFreeJson(arr);
+  return json;
 }
 
-oidc_error_t fireHttpServer(list_t* redirect_uris, size_t size,
-                            char** state_ptr) {
-  int fd[2];
-#ifdef __APPLE__
-  if (pipe(fd) != 0) {
-#else
-  if (pipe2(fd, O_DIRECT) != 0) {
-#endif
-    oidc_setErrnoError();
-    return oidc_errno;
+/**
+ * @brief binds and listens on @p port so mhd can adopt the socket
+ *
+ * Binding here instead of letting a full daemon startup fail makes probing
+ * a busy port one cheap socket call, and with port @c 0 the kernel assigns
+ * a free one. The returned socket is handed to mhd, so there is no window
+ * in which the probed port could be taken by someone else.
+ * @param port the port to bind or @c 0 for a kernel-assigned one
+ * @param bound_port set to the port actually bound
+ * @return the listening fd or @c -1
+ */
+static int _bindListenSocket(unsigned short port, unsigned short* bound_port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
   }
-  pid_t pid = fork();
-  if (pid == -1) {
-    logger(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return oidc_errno;
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port        = htons(port);
+  socklen_t len        = sizeof(addr);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 10) != 0 ||
+      getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+    close(fd);
+    return -1;
   }
-  if (pid == 0) {  // child
+  *bound_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+/**
+ * @brief binds the first available port of the configured allowed range
+ * Used as the fallback when no registered redirect uri could be bound; with
+ * a range configured a kernel-assigned port might lie outside the firewall.
+ * @param bound_port set to the port actually bound
+ * @return the listening fd or @c -1 if the whole range is unavailable
+ */
+static int _bindInRange(unsigned short* bound_port) {
+  for (unsigned int p = agent_state.portRangeMin;
+       p <= agent_state.portRangeMax; p++) {
+    if (_portRecentlyFailed((unsigned short)p)) {
+      continue;
+    }
+    int fd = _bindListenSocket((unsigned short)p, bound_port);
+    if (fd >= 0) {
+      return fd;
+    }
+    _markPortFailed((unsigned short)p);
+  }
+  return -1;
+}
+
+static struct MHD_Daemon* _startDaemonOnSocket(int fd) {
 #ifdef __APPLE__
-    // suicide_if_we_become_a_zombie();
+  unsigned int flags = MHD_USE_INTERNAL_POLLING_THREAD;  // no epoll
 #else
-    prctl(PR_SET_PDEATHSIG, SIGTERM);
+  // one epoll listener thread multiplexes all connections of all flows
+  unsigned int flags = MHD_USE_EPOLL | MHD_USE_INTERNAL_POLLING_THREAD;
 #endif
-    close(fd[0]);
-    size_t i;
-    for (i = 0; i < size && oidc_mhd_daemon_ptr == NULL; i++) {
-      oidc_mhd_daemon_ptr =
-          startHttpServer(list_at(redirect_uris, i)->val, *state_ptr);
+  return MHD_start_daemon(flags, 0, NULL, NULL, &request_echo, NULL,
+                          MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_END);
+}
+
+/**
+ * @brief makes sure a redirect listener runs for one of the @p redirect_uris
+ * and registers @p state_ptr with it
+ *
+ * An already bound port is reused; otherwise the configured ports are
+ * probed with plain bind calls and a daemon is started on the first free
+ * one. Ports outside a configured allowed range or that recently failed to
+ * bind are skipped without probing. When no configured port is usable, a
+ * free port - kernel-assigned, or the first available one of the allowed
+ * range - is bound instead and the registered redirect uri rewritten to it
+ * - providers following RFC 8252 accept any loopback port. The state is
+ * prefixed like
+ * before so the redirect can be rebuilt with or without trailing slash on
+ * exchange.
+ * @return the port the listener is bound to or an error code
+ */
+oidc_error_t fireHttpServer(list_t* redirect_uris, size_t size,
+                            char** state_ptr) {
+  pthread_mutex_lock(&httpserver_lock);
+  _initLists();
+  struct port_listener* listener      = NULL;
+  const char*           used_uri      = NULL;
+  char*                 ephemeral_uri = NULL;
+  for (size_t i = 0; i < size && listener == NULL; i++) {
+    const char*    uri  = list_at(redirect_uris, i)->val;
+    unsigned short port = getPortFromUri(uri);
+    if (port == 0) {
+      logger(NOTICE, "Could not get port from uri");
+      continue;
     }
-    if (oidc_mhd_daemon_ptr == NULL) {
-      ipc_write(fd[1], "%d", OIDC_EHTTPPORTS);
-      close(fd[1]);
-      exit(EXIT_FAILURE);
+    if (!_portAllowed(port)) {
+      logger(DEBUG, "Port %hu is outside the allowed port range", port);
+      continue;
     }
-    const char* used_uri = list_at(redirect_uris, i - 1)->val;
-    ipc_write(fd[1], "%hu", getPortFromUri(used_uri));
-    close(fd[1]);
-    signal(SIGTERM, http_sig_handler);
-    sigset_t sigset;
-    sigemptyset(&sigset);
-    sigaddset(&sigset, SIGTERM);
-    sigsuspend(&sigset);
-    return OIDC_ENOPE;
-  } else {  // parent
-    close(fd[1]);
-    char* e = ipc_read(fd[0]);
-    close(fd[0]);
-    if (e == NULL) {
-      return oidc_errno;
+    listener = _listenerForPort(port);
+    if (listener != NULL) {  // another pending flow already listens here
+      used_uri = uri;
+      break;
     }
-    char**   endptr = secAlloc(sizeof(char*));
-    long int port   = strtol(e, endptr, 10);
-    if (**endptr != '\0') {
-      secFree(endptr);
-      secFree(e);
-      oidc_errno = OIDC_EERROR;
-      oidc_seterror("Internal error. Could not convert pipe communication.");
-      return oidc_errno;
+    if (_portRecentlyFailed(port)) {
+      logger(DEBUG, "Port %hu failed to bind recently; skipping", port);
+      continue;
     }
-    secFree(endptr);
-    secFree(e);
-    if (port < 0) {
-      oidc_errno = port;
-      logger(ERROR, "HttpServer Start Error: %s", oidc_serror());
-      return oidc_errno;
+    unsigned short bound;
+    int            fd = _bindListenSocket(port, &bound);
+    if (fd < 0) {
+      logger(DEBUG, "Port %hu is busy", port);
+      _markPortFailed(port);
+      continue;
     }
-    char* used_uri = NULL;
-    for (size_t i = 0; i < size; i++) {
-      unsigned short p = getPortFromUri(list_at(redirect_uris, i)->val);
-      if (p == port) {
-        used_uri = list_at(redirect_uris, i)->val;
+    struct MHD_Daemon* daemon = _startDaemonOnSocket(fd);
+    if (daemon == NULL) {
+      logger(NOTICE, "Error starting the HttpServer on port %hu", port);
+      close(fd);
+      continue;
+    }
+    listener         = secAlloc(sizeof(struct port_listener));
+    listener->port   = bound;
+    listener->daemon = daemon;
+    list_rpush(port_listeners, list_node_new(listener));
+    used_uri = uri;
+    logger(DEBUG, "HttpServer: Started HttpServer on port %hu", bound);
+  }
+  if (listener == NULL) {  // all configured ports are busy or filtered
+    unsigned short bound;
+    int            fd = agent_state.portRangeMin != 0
+                            ? _bindInRange(&bound)
+                            : _bindListenSocket(0, &bound);
+    if (fd >= 0) {
+      struct MHD_Daemon* daemon = _startDaemonOnSocket(fd);
+      if (daemon == NULL) {
+        close(fd);
+      } else {
+        listener         = secAlloc(sizeof(struct port_listener));
+        listener->port   = bound;
+        listener->daemon = daemon;
+        list_rpush(port_listeners, list_node_new(listener));
+        ephemeral_uri = oidc_sprintf("http://localhost:%hu", bound);
+        used_uri      = ephemeral_uri;
+        logger(NOTICE,
+               "No configured redirect port is usable; falling back to "
+               "port %hu",
+               bound);
       }
     }
-    char* tmp = oidc_sprintf("%hhu:%s", strEnds(used_uri, "/"), *state_ptr);
-    secFree(*state_ptr);
-    *state_ptr = tmp;
-    struct running_server* running_server =
-        secAlloc(sizeof(struct running_server));
-    running_server->pid   = pid;
-    running_server->state = oidc_strcopy(*state_ptr);
-    addServer(running_server);
-    return port;
   }
+  if (listener == NULL) {
+    pthread_mutex_unlock(&httpserver_lock);
+    oidc_errno = OIDC_EHTTPPORTS;
+    return oidc_errno;
+  }
+  char* tmp = oidc_sprintf("%hhu:%s", strEnds(used_uri, "/"), *state_ptr);
+  secFree(*state_ptr);
+  *state_ptr                   = tmp;
+  struct redirect_state* entry = secAlloc(sizeof(struct redirect_state));
+  entry->state                 = oidc_strcopy(*state_ptr);
+  entry->redirect_uri          = oidc_strcopy(used_uri);
+  entry->port                  = listener->port;
+  entry->started               = time(NULL);
+  list_rpush(redirect_states, list_node_new(entry));
+  listener->states++;
+  unsigned short port = listener->port;
+  pthread_mutex_unlock(&httpserver_lock);
+  secFree(ephemeral_uri);
+  return port;
 }
@@ -7,5 +7,8 @@
 
 oidc_error_t fireHttpServer(list_t* redirect_uris, size_t size,
                             char** state_ptr);
+char*        httpserver_uriForState(const char* state);
+void         httpserver_stopForState(const char* state);
+char*        httpserver_statusToJSON();
 
 #endif  // START_HTTPSERVER_H
@@ -4,11 +4,15 @@
 #include "agent_state.h"
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
+#include "utils/crypt/keyCache.h"
+#include "utils/crypt/sha256.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/secure_compare.h"
 #include "utils/sleeper.h"
 
+#include <sodium.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -20,28 +24,34 @@ oidc_error_t unlock(const char* password) {
     oidc_errno = OIDC_ENOTLOCKED;
     return oidc_errno;
   }
-  char* hash = s256(password);
-  if (!strequal(agent_state.lock_state.hash, hash)) {
-    secFree(hash);
+  // gate with the hash stored at lock time: a wrong password is rejected in
+  // constant time without touching any account, so guessing attempts cannot
+  // burn decryption work or probe timing
+  unsigned char hash[AGENT_SHA256_BYTES];
+  agent_sha256(hash, (const unsigned char*)password, strlen(password));
+  if (!secure_equal(hash, agent_state.lock_state.hash, sizeof(hash))) {
+    sodium_memzero(hash, sizeof(hash));
+    /* delay in 0.1s increments up to 10s */
+    if (fail_count < 100) {
+      fail_count++;
+    }
+    unsigned int delay = 100 * fail_count;
+    logger(DEBUG, "unlock failed, delaying %0.1lf seconds",
+           (double)delay / 1000);
+    msleep(delay);
     oidc_errno = OIDC_EPASS;
     return oidc_errno;
   }
-  secFree(hash);
+  sodium_memzero(hash, sizeof(hash));
 
   if (lockDecrypt(password) == OIDC_SUCCESS) {
     agent_state.lock_state.locked = 0;
     fail_count                    = 0;
-    secFree(agent_state.lock_state.hash);
+    sodium_memzero(agent_state.lock_state.hash,
+                   sizeof(agent_state.lock_state.hash));
     logger(DEBUG, "Agent unlocked");
     return OIDC_SUCCESS;
   }
-  /* delay in 0.1s increments up to 10s */
-  if (fail_count < 100) {
-    fail_count++;
-  }
-  unsigned int delay = 100 * fail_count;
-  logger(DEBUG, "unlock failed, delaying %0.1lf seconds", (double)delay / 1000);
-  msleep(delay);
   return oidc_errno;
 }
 
@@ -52,10 +62,14 @@ oidc_error_t lock(const char* password) {
     oidc_errno = OIDC_ELOCKED;
     return oidc_errno;
   }
-  agent_state.lock_state.hash = s256(password);
+  agent_sha256(agent_state.lock_state.hash, (const unsigned char*)password,
+               strlen(password));
   if (lockEncrypt(password) != OIDC_SUCCESS) {
+    sodium_memzero(agent_state.lock_state.hash,
+                   sizeof(agent_state.lock_state.hash));
     return oidc_errno;
   }
+  keyCache_clear();  // a locked agent must not hold derived keys in memory
   agent_state.lock_state.locked = 1;
   logger(DEBUG, "Agent locked");
   return OIDC_SUCCESS;
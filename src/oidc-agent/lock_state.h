@@ -1,11 +1,14 @@
 #ifndef LOCK_STATE_H
 #define LOCK_STATE_H
 
+#include "utils/crypt/sha256.h"
 #include "utils/oidc_error.h"
 
 struct lock_state {
-  short locked;
-  char* hash;
+  short         locked;
+  unsigned char hash[AGENT_SHA256_BYTES];  // sha256 of the lock password,
+                                           // computed once at lock time; the
+                                           // password itself is never stored
 };
 
 oidc_error_t unlock(const char* password);
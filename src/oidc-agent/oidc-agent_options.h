@@ -5,6 +5,7 @@
 #include "utils/stringUtils.h"
 
 #include <argp.h>
+#include <string.h>
 #include <time.h>
 
 struct arguments {
@@ -16,11 +17,26 @@ struct arguments {
   unsigned char confirm;
   unsigned char no_webserver;
   unsigned char no_scheme;
+  unsigned char preload;
+  unsigned char restore;
+  unsigned char multi_tenant;
+  unsigned char handoff;
 
   time_t             lifetime;
   struct lifetimeArg pw_lifetime;
+  unsigned long      max_accounts;
+  unsigned long      memory_budget;  // MB; 0 means no ceiling
+  unsigned long      slo_budget_ms;  // 0 means no SLO probing
+  unsigned long      shards;         // oidcd worker count; 0/1 means one
+  unsigned int       shard;          // index of this oidcd worker; set by
+                                     // oidcp when forking, not an option
+  unsigned short     port_range_min;  // 0 means unrestricted
+  unsigned short     port_range_max;
 
   char* group;
+  char* metrics_file;
+  char* net_listener;
+  char* forward;
 };
 
 #define OPT_SECCOMP 1
@@ -29,6 +45,18 @@ struct arguments {
 #define OPT_PW_STORE 4
 #define OPT_GROUP 5
 #define OPT_NO_SCHEME 6
+#define OPT_MAX_ACCOUNTS 7
+#define OPT_PRELOAD 8
+#define OPT_RESTORE 9
+#define OPT_PORT_RANGE 10
+#define OPT_METRICS_FILE 11
+#define OPT_MULTI_TENANT 12
+#define OPT_NET_LISTENER 13
+#define OPT_FORWARD 14
+#define OPT_MEMORY_BUDGET 15
+#define OPT_SHARDS 16
+#define OPT_HANDOFF 17
+#define OPT_SLO 18
 
 static inline void initArguments(struct arguments* arguments) {
   arguments->kill_flag               = 0;
@@ -43,6 +71,20 @@ static inline void initArguments(struct arguments* arguments) {
   arguments->pw_lifetime.argProvided = 0;
   arguments->group                   = NULL;
   arguments->no_scheme               = 0;
+  arguments->max_accounts            = 0;
+  arguments->preload                 = 0;
+  arguments->restore                 = 0;
+  arguments->port_range_min          = 0;
+  arguments->port_range_max          = 0;
+  arguments->metrics_file            = NULL;
+  arguments->multi_tenant            = 0;
+  arguments->net_listener            = NULL;
+  arguments->forward                 = NULL;
+  arguments->memory_budget           = 0;
+  arguments->shards                  = 0;
+  arguments->shard                   = 0;
+  arguments->handoff                 = 0;
+  arguments->slo_budget_ms           = 0;
 }
 
 static struct argp_option options[] = {
@@ -80,6 +122,107 @@ static struct argp_option options[] = {
      "authorization code flow is used. oidc-agent will not use a custom uri "
      "scheme redirect.",
      1},
+    {"max-accounts", OPT_MAX_ACCOUNTS, "N", 0,
+     "Sets a maximum for the number of account configurations that can be "
+     "loaded at the same time. When the limit is reached the least recently "
+     "used account whose configuration is persisted on disk is evicted; it "
+     "can be loaded again at any time. Without this option the number is "
+     "unlimited.",
+     1},
+    {"preload", OPT_PRELOAD, 0, 0,
+     "Proactively warms the agent for the existing account configurations at "
+     "startup: the configuration files are pre-read and account "
+     "configurations that are not encrypted are loaded in the background, so "
+     "the first token request does not pay the full load cost. Encrypted "
+     "configurations still require the user's password and are loaded on "
+     "first use.",
+     1},
+    {"restore", OPT_RESTORE, 0, 0,
+     "Periodically writes the loaded account configurations - including "
+     "their refresh tokens - encrypted to the oidc-agent directory and "
+     "restores them at startup, so a restarted agent is immediately usable "
+     "without loading all accounts again. The snapshot is encrypted with a "
+     "key stored next to it; it is protected by file permissions only, not "
+     "by the account passwords.",
+     1},
+    {"handoff", OPT_HANDOFF, 0, 0,
+     "Takes over the running agent (given by the OIDC_SOCK environment "
+     "variable) instead of creating a new socket: the old agent hands its "
+     "listening socket to the new one over the connection, writes a final "
+     "state snapshot and exits. Clients queue on the socket during the "
+     "switch and never see a connection refusal. Intended for unattended "
+     "upgrades; combine with --restore so the new agent also inherits the "
+     "loaded accounts. Without a running agent a normal start is done.",
+     1},
+    {"multi-tenant", OPT_MULTI_TENANT, 0, 0,
+     "Tunes the agent for serving several users over one shared socket "
+     "(set up with --with-group): requests are attributed to the sending "
+     "user's uid in logs, stage dumps and metrics, and each uid gets its "
+     "own in-flight request quota so one user cannot starve the others. "
+     "The trust model is the same as with --with-group alone: every "
+     "allowed user can use every loaded account.",
+     1},
+    {"memory-budget", OPT_MEMORY_BUDGET, "MB", 0,
+     "Keeps the agent's resident memory around MB megabytes: when the "
+     "budget is exceeded, rebuildable caches (file contents, discovery "
+     "documents, derived keys) are dropped, long-idle accounts whose "
+     "configuration is persisted on disk are evicted - they are autoloaded "
+     "again on the next request - and freed heap pages are returned to the "
+     "kernel. Without this option the agent never reclaims on its own.",
+     1},
+    {"shards", OPT_SHARDS, "N", 0,
+     "Forks N oidcd worker processes instead of one and assigns each "
+     "account to exactly one of them by a stable hash of its short name, "
+     "so token throughput scales with cores without sharing secret memory "
+     "between workers. Requests that do not name an account (listing, "
+     "locking, metrics, pending auth code flows) are sent to all workers "
+     "and the answers are combined. Intended for heavily used multi-tenant "
+     "agents; for a personal agent one worker is enough.",
+     1},
+    {"forward", OPT_FORWARD, "SOCKET", 0,
+     "Forwards token requests for accounts that are not loaded in this "
+     "agent to the agent behind SOCKET, like ssh-agent forwarding: on a "
+     "remote host, forward the home agent's socket there (e.g. ssh -R "
+     "remote.sock:$OIDC_SOCK) and start the remote agent with "
+     "--forward=remote.sock; token requests then reach the home agent's "
+     "loaded accounts without re-adding them remotely. SOCKET can also be "
+     "a 'tcp://host:port' or 'vsock://cid:port' target of a network "
+     "listener.",
+     1},
+    {"net-listener", OPT_NET_LISTENER, "SPEC", 0,
+     "Additionally listens for clients on a network socket, so containers "
+     "and VMs can use this agent instead of running their own. SPEC is "
+     "'PORT' or 'ADDR:PORT' for a tcp listener (default address is "
+     "loopback) or 'vsock:PORT' for a virtio-vsock listener. Clients "
+     "connect by setting OIDC_SOCK to 'tcp://host:port' or "
+     "'vsock://cid:port'. Requests are encrypted like on the unix socket "
+     "and plaintext requests are rejected, but the socket carries no user "
+     "credentials: anyone who can connect can use the loaded accounts, so "
+     "restrict reachability with a firewall or network namespace.",
+     1},
+    {"slo", OPT_SLO, "MS", 0,
+     "Continuously checks the agent against an end-to-end latency objective "
+     "of MS milliseconds: a probe periodically sends a synthetic token "
+     "request through the agent's own socket - taking the identical path a "
+     "client's request takes - and the measured round trips are tracked in "
+     "the agent's metrics. A probe over the budget is counted as a "
+     "violation and logged with the dominant stage, so sustained compliance "
+     "is verifiable on the serving host, e.g. via --metrics-file.",
+     1},
+    {"metrics-file", OPT_METRICS_FILE, "FILE", 0,
+     "Periodically writes the agent's performance metrics (request rates, "
+     "handler latencies, per-host HTTP statistics, store sizes) in the "
+     "Prometheus text exposition format to FILE, e.g. for node_exporter's "
+     "textfile collector. A relative FILE is placed in the oidc-agent "
+     "directory; the file is replaced atomically on every write.",
+     1},
+    {"port-range", OPT_PORT_RANGE, "MIN:MAX", 0,
+     "This option applies only when the authorization code flow is used. "
+     "Restricts the ports the redirect webserver may listen on to the given "
+     "range (both inclusive), e.g. on hosts where a firewall only permits a "
+     "narrow range. Registered redirect uris with a port outside the range "
+     "are skipped and a free port inside the range is used instead.",
+     1},
     {"pw-store", OPT_PW_STORE, "TIME", OPTION_ARG_OPTIONAL,
      "Keeps the encryption passwords for all loaded account configurations "
      "encrypted in memory for TIME seconds. Can be overwritten for a specific "
@@ -114,13 +257,66 @@ static error_t parse_opt(int key, char* arg __attribute__((unused)),
     case OPT_NOAUTOLOAD: arguments->no_autoload = 1; break;
     case OPT_NO_WEBSERVER: arguments->no_webserver = 1; break;
     case OPT_NO_SCHEME: arguments->no_scheme = 1; break;
+    case OPT_PRELOAD: arguments->preload = 1; break;
+    case OPT_RESTORE: arguments->restore = 1; break;
     case OPT_GROUP: arguments->group = arg ?: "oidc-agent"; break;
+    case OPT_METRICS_FILE: arguments->metrics_file = arg; break;
+    case OPT_MULTI_TENANT: arguments->multi_tenant = 1; break;
+    case OPT_HANDOFF: arguments->handoff = 1; break;
+    case OPT_NET_LISTENER: arguments->net_listener = arg; break;
+    case OPT_FORWARD: arguments->forward = arg; break;
     case 't':
       if (!isdigit(*arg)) {
         return ARGP_ERR_UNKNOWN;
       }
       arguments->lifetime = strToInt(arg);
       break;
+    case OPT_MAX_ACCOUNTS:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->max_accounts = strToULong(arg);
+      break;
+    case OPT_MEMORY_BUDGET:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->memory_budget = strToULong(arg);
+      break;
+    case OPT_SLO:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->slo_budget_ms = strToULong(arg);
+      if (arguments->slo_budget_ms == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_SHARDS:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->shards = strToULong(arg);
+      if (arguments->shards == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_PORT_RANGE: {
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      char* sep = strchr(arg, ':');
+      if (sep == NULL || !isdigit(*(sep + 1))) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->port_range_min = strToUShort(arg);
+      arguments->port_range_max = strToUShort(sep + 1);
+      if (arguments->port_range_min == 0 ||
+          arguments->port_range_max < arguments->port_range_min) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    }
     case OPT_PW_STORE:
       arguments->pw_lifetime.argProvided = 1;
       arguments->pw_lifetime.lifetime    = strToULong(arg);
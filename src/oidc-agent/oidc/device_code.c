@@ -2,20 +2,64 @@
 #include "defines/oidc_values.h"
 #include "utils/json.h"
 #include "utils/logger.h"
+#include "utils/slab.h"
 #include "utils/stringUtils.h"
 
+// device code structs are created and freed once per device flow poll;
+// recycle them instead of churning the allocator
+static struct slab_pool device_code_pool =
+    SLAB_POOL_INIT(struct oidc_device_code);
+
+struct oidc_device_code* oidc_device_new(char*  device_code,
+                                         char*  user_code,
+                                         char*  verification_uri,
+                                         char*  verification_uri_complete,
+                                         size_t expires_in, size_t interval) {
+  struct oidc_device_code* c = slab_alloc(&device_code_pool);
+  oidc_device_setDeviceCode(c, device_code);
+  oidc_device_setUserCode(c, user_code);
+  oidc_device_setVerificationUrl(c, verification_uri);
+  oidc_device_setVerificationUrlComplete(c, verification_uri_complete);
+  oidc_device_setExpiresIn(c, expires_in);
+  oidc_device_setInterval(c, interval);
+  return c;
+}
+
+void _secFreeDeviceCode(struct oidc_device_code* c) {
+  if (c == NULL) {
+    return;
+  }
+  oidc_device_setDeviceCode(c, NULL);
+  oidc_device_setUserCode(c, NULL);
+  oidc_device_setVerificationUrl(c, NULL);
+  oidc_device_setVerificationUrlComplete(c, NULL);
+  slab_free(&device_code_pool, c);
+}
+
 struct oidc_device_code* getDeviceCodeFromJSON(const char* json) {
   if (NULL == json) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  cJSON* cjson = stringToJson(json);
+  if (cjson == NULL) {
+    return NULL;
+  }
+  struct oidc_device_code* code = getDeviceCodeFromCJSON(cjson);
+  secFreeJson(cjson);
+  return code;
+}
+
+struct oidc_device_code* getDeviceCodeFromCJSON(const cJSON* cjson) {
+  if (NULL == cjson) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
   INIT_KEY_VALUE(OIDC_KEY_DEVICECODE, OIDC_KEY_USERCODE,
                  OIDC_KEY_VERIFICATIONURI, OIDC_KEY_VERIFICATIONURI_COMPLETE,
                  OIDC_KEY_EXPIRESIN, OIDC_KEY_INTERVAL);
-  cJSON* cjson = stringToJson(json);
   if (CALL_GETJSONVALUES_FROM_CJSON(cjson) < 0) {
     logger(ERROR, "Error while parsing json\n");
-    secFreeJson(cjson);
     SEC_FREE_KEY_VALUES();
     return NULL;
   }
@@ -35,7 +79,6 @@ struct oidc_device_code* getDeviceCodeFromJSON(const char* json) {
         getJSONValue(cjson, GOOGLE_KEY_VERIFICATIONURI_COMPLETE);
   }  // needed for the google device flow that is not conforming to the spec
      // draft
-  secFreeJson(cjson);
   struct oidc_device_code* code =
       oidc_device_new(_device_code, _usercode, _verification_uri,
                       _verification_uri_complete, expires_in, interval);
@@ -1,6 +1,7 @@
 #ifndef DEVICE_CODE_H
 #define DEVICE_CODE_H
 
+#include "cJSON/cJSON.h"
 #include "utils/memory.h"
 
 #include <stddef.h>
@@ -76,30 +77,15 @@ static inline void oidc_device_setInterval(struct oidc_device_code* c,
   c->interval = interval;
 }
 
-static inline struct oidc_device_code* oidc_device_new(
-    char* device_code, char* user_code, char* verification_uri,
-    char* verification_uri_complete, size_t expires_in, size_t interval) {
-  struct oidc_device_code* c = secAlloc(sizeof(struct oidc_device_code));
-  oidc_device_setDeviceCode(c, device_code);
-  oidc_device_setUserCode(c, user_code);
-  oidc_device_setVerificationUrl(c, verification_uri);
-  oidc_device_setVerificationUrlComplete(c, verification_uri_complete);
-  oidc_device_setExpiresIn(c, expires_in);
-  oidc_device_setInterval(c, interval);
-  return c;
-}
-
-static inline void _secFreeDeviceCode(struct oidc_device_code* c) {
-  oidc_device_setDeviceCode(c, NULL);
-  oidc_device_setUserCode(c, NULL);
-  oidc_device_setVerificationUrl(c, NULL);
-  oidc_device_setVerificationUrlComplete(c, NULL);
-  oidc_device_setExpiresIn(c, 0);
-  oidc_device_setInterval(c, 0);
-  secFree(c);
-}
+struct oidc_device_code* oidc_device_new(char*  device_code,
+                                         char*  user_code,
+                                         char*  verification_uri,
+                                         char*  verification_uri_complete,
+                                         size_t expires_in, size_t interval);
+void                     _secFreeDeviceCode(struct oidc_device_code* c);
 
 struct oidc_device_code* getDeviceCodeFromJSON(const char* json);
+struct oidc_device_code* getDeviceCodeFromCJSON(const cJSON* cjson);
 char*                    deviceCodeToJSON(struct oidc_device_code c);
 void printDeviceCode(struct oidc_device_code c, int printQR, int terminalQR);
 
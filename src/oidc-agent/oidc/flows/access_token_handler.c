@@ -7,6 +7,7 @@
 #include "password.h"
 #include "refresh.h"
 #include "utils/json.h"
+#include "utils/jwtUtils.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 
@@ -56,19 +57,69 @@ int tokenIsValidForSeconds(const struct oidc_account* p,
                            time_t                     min_valid_period) {
   time_t now        = time(NULL);
   time_t expires_at = account_getTokenExpiresAt(p);
+  if (expires_at == 0) {
+    // issuers that omit expires_in leave the expiry unset; for JWT access
+    // tokens the exp claim still gives the precise expiry (cached, so this
+    // decodes once per token, not per check)
+    expires_at = jwt_getExpiresAt(account_getAccessToken(p));
+  }
   return expires_at - now > 0 && expires_at - now > min_valid_period;
 }
 
+/**
+ * @brief checks if @p error means the issuer could not be reached
+ *
+ * Covers the connection level failures (timeout, resolve / connect, ssl)
+ * and http 5xx answers; a 4xx is a problem with the request itself (e.g. a
+ * revoked refresh token) and must stay a hard failure.
+ */
+static int _errorIsIssuerUnreachable(oidc_error_t error) {
+  return error == OIDC_ETIMEOUT || error == OIDC_EURL ||
+         error == OIDC_ESSL || error >= 500;
+}
+
+/**
+ * @brief returns a valid access token, obtaining a new one if needed
+ *
+ * When the refresh flow fails because the issuer is unreachable and the
+ * account still holds a not-yet-expired token - typically one carried over
+ * by the state snapshot - that token is served in degraded mode instead of
+ * failing the request: @p stale_out is set so the caller can flag the
+ * response and schedule revalidation. The degraded path ignores
+ * @p min_valid_period (only actual expiry counts during an outage) and is
+ * disabled by passing @c NULL for @p stale_out.
+ */
 char* getAccessTokenUsingRefreshFlow(struct oidc_account* account,
                                      time_t min_valid_period, const char* scope,
-                                     struct ipcPipe pipes) {
+                                     struct ipcPipe pipes,
+                                     unsigned char* stale_out) {
+  if (stale_out != NULL) {
+    *stale_out = 0;
+  }
   if (scope == NULL && min_valid_period != FORCE_NEW_TOKEN &&
       strValid(account_getAccessToken(account)) &&
       tokenIsValidForSeconds(account, min_valid_period)) {
     return account_getAccessToken(account);
   }
   logger(DEBUG, "No acces token found that is valid long enough");
-  return tryRefreshFlow(account, scope, pipes);
+  char* token = tryRefreshFlow(account, scope, pipes);
+  if (token != NULL) {
+    return token;
+  }
+  if (stale_out != NULL && scope == NULL &&
+      min_valid_period != FORCE_NEW_TOKEN &&
+      _errorIsIssuerUnreachable(oidc_errno) &&
+      strValid(account_getAccessToken(account)) &&
+      tokenIsValidForSeconds(account, 0)) {
+    logger(NOTICE,
+           "Issuer for account '%s' unreachable (%s); serving the "
+           "still-valid token as stale",
+           account_getName(account), oidc_serror());
+    oidc_errno = OIDC_SUCCESS;
+    *stale_out = 1;
+    return account_getAccessToken(account);
+  }
+  return NULL;
 }
 
 oidc_error_t getAccessTokenUsingPasswordFlow(struct oidc_account* account,
@@ -12,7 +12,8 @@
 
 char*        getAccessTokenUsingRefreshFlow(struct oidc_account* account,
                                             time_t min_valid_period, const char* scope,
-                                            struct ipcPipe pipes);
+                                            struct ipcPipe pipes,
+                                            unsigned char* stale_out);
 oidc_error_t getAccessTokenUsingPasswordFlow(struct oidc_account* account,
                                              struct ipcPipe       pipes);
 oidc_error_t getAccessTokenUsingAuthCodeFlow(struct oidc_account* account,
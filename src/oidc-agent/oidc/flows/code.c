@@ -7,6 +7,7 @@
 #include "utils/crypt/crypt.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/oidc_string.h"
 #include "utils/portUtils.h"
 #include "utils/uriUtils.h"
 
@@ -67,7 +68,13 @@ char* buildCodeFlowUri(const struct oidc_account* account, char** state_ptr,
   }
   char* redirect =
       account_getNoScheme(account) ? NULL : findCustomSchemeUri(redirect_uris);
-  if (!account_getNoWebServer(account)) {
+  char* ephemeral_redirect = NULL;
+  // a flow whose account registers only custom scheme uris can never
+  // receive an http redirect; skip the webserver and port bookkeeping
+  // entirely - the scheme handler delivers the code
+  unsigned char scheme_only =
+      redirect != NULL && allUrisCustomScheme(redirect_uris);
+  if (!account_getNoWebServer(account) && !scheme_only) {
     int port = fireHttpServer(account_getRedirectUris(account),
                               account_getRedirectUrisCount(account), state_ptr);
     if (port <= 0) {
@@ -76,6 +83,12 @@ char* buildCodeFlowUri(const struct oidc_account* account, char** state_ptr,
       }
     }
     redirect = findRedirectUriByPort(account, port);
+    if (redirect == NULL &&
+        port > 0) {  // the listener runs on a kernel-assigned port; the
+                     // rewritten uri lives in the redirect registry
+      ephemeral_redirect = httpserver_uriForState(*state_ptr);
+      redirect           = ephemeral_redirect;
+    }
   } else {                   // no web server
     if (redirect == NULL) {  // no custom scheme uri found
       redirect = list_at(redirect_uris, 0)->val;
@@ -102,10 +115,21 @@ char* buildCodeFlowUri(const struct oidc_account* account, char** state_ptr,
     secFree(*code_verifier_ptr);
     code_verifier_ptr = NULL;
   }
-  char* uri_parameters = generatePostDataFromList(postData);
+  // build the uri in one pass instead of pasting an intermediate parameter
+  // string onto the endpoint
+  struct string uri;
+  char*         ret = NULL;
+  if (init_string(&uri) == OIDC_SUCCESS) {
+    string_appendf(&uri, "%s?", auth_endpoint);
+    for (size_t i = 0; i < postData->len - 1; i += 2) {
+      string_appendf(&uri, i == 0 ? "%s=%s" : "&%s=%s",
+                     (char*)list_at(postData, i)->val,
+                     (char*)list_at(postData, i + 1)->val);
+    }
+    ret = string_finish(&uri);
+  }
   secFree(code_challenge);
+  secFree(ephemeral_redirect);
   list_destroy(postData);
-  char* uri = oidc_sprintf("%s?%s", auth_endpoint, uri_parameters);
-  secFree(uri_parameters);
-  return uri;
+  return ret;
 }
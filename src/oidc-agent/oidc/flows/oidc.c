@@ -4,10 +4,11 @@
 #include "oidc-agent/oidcd/internal_request_handler.h"
 #include "utils/errorUtils.h"
 #include "utils/json.h"
-#include "utils/key_value.h"
+#include "utils/jwtUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/oidc_string.h"
 #include "utils/stringUtils.h"
 
 #include <stdarg.h>
@@ -38,18 +39,20 @@ char* generatePostDataFromList(list_t* list) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  char* data = oidc_sprintf("%s=%s", (char*)list_at(list, 0)->val,
-                            (char*)list_at(list, 1)->val);
+  struct string data;
+  if (init_string(&data) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  string_appendf(&data, "%s=%s", (char*)list_at(list, 0)->val,
+                 (char*)list_at(list, 1)->val);
   for (size_t i = 2; i < list->len - 1; i += 2) {
-    char* tmp = oidc_sprintf("%s&%s=%s", data, (char*)list_at(list, i)->val,
-                             (char*)list_at(list, i + 1)->val);
-    if (tmp == NULL) {
+    if (string_appendf(&data, "&%s=%s", (char*)list_at(list, i)->val,
+                       (char*)list_at(list, i + 1)->val) != OIDC_SUCCESS) {
+      _secFree(string_finish(&data));
       return NULL;
     }
-    secFree(data);
-    data = tmp;
   }
-  return data;
+  return string_finish(&data);
 }
 
 void defaultErrorHandling(const char* error, const char* error_description) {
@@ -60,46 +63,73 @@ void defaultErrorHandling(const char* error, const char* error_description) {
   secFree(error_str);
 }
 
+/**
+ * The response is parsed into one DOM and all fields are read as borrowed
+ * views; only the strings that are actually kept are copied out, exactly
+ * once, and handed to the account with ownership. On a busy agent this
+ * path runs for every refresh, so the former per-field extraction copies
+ * (including an unchanged refresh token and a print-parse round trip for
+ * the numeric expires_in) were a measurable allocation cost.
+ */
 char* parseTokenResponseCallbacks(
     const char* res, struct oidc_account* a, int saveAccessToken,
     void (*errorHandling)(const char*, const char*), struct ipcPipe pipes) {
-  INIT_KEY_VALUE(OIDC_KEY_ACCESSTOKEN, OIDC_KEY_REFRESHTOKEN,
-                 OIDC_KEY_EXPIRESIN, OIDC_KEY_ERROR,
-                 OIDC_KEY_ERROR_DESCRIPTION);
-  if (CALL_GETJSONVALUES(res) < 0) {
+  cJSON* json = stringToJson(res);
+  if (json == NULL) {
     logger(ERROR, "Error while parsing json\n");
-    SEC_FREE_KEY_VALUES();
     return NULL;
   }
-  KEY_VALUE_VARS(access_token, refresh_token, expires_in, error,
-                 error_description);
-  if (_error || _error_description) {
-    errorHandling(_error, _error_description);
-    SEC_FREE_KEY_VALUES();
+  const char* error = cJSON_GetStringValue(getJSONItem(json, OIDC_KEY_ERROR));
+  const char* error_description =
+      cJSON_GetStringValue(getJSONItem(json, OIDC_KEY_ERROR_DESCRIPTION));
+  if (error || error_description) {
+    errorHandling(error, error_description);
+    secFreeJson(json);
     return NULL;
   }
-  if (NULL != _expires_in) {
-    account_setTokenExpiresAt(a, time(NULL) + strToInt(_expires_in));
+  cJSON* expires_in = getJSONItem(json, OIDC_KEY_EXPIRESIN);
+  if (expires_in != NULL) {
+    // providers send the token lifetime as number or as string; both are
+    // read from the DOM directly
+    time_t in = cJSON_IsNumber(expires_in)
+                    ? (time_t)expires_in->valuedouble
+                    : strToInt(cJSON_GetStringValue(expires_in));
+    account_setTokenExpiresAt(a, time(NULL) + in);
     logger(DEBUG, "expires_at is: %lu\n", account_getTokenExpiresAt(a));
-    secFree(_expires_in);
   }
-  char* refresh_token = account_getRefreshToken(a);
-  if (strValid(_refresh_token) && !strequal(refresh_token, _refresh_token)) {
+  const char* refresh_token = account_getRefreshToken(a);
+  const char* new_refresh_token =
+      cJSON_GetStringValue(getJSONItem(json, OIDC_KEY_REFRESHTOKEN));
+  if (strValid(new_refresh_token) &&
+      !strequal(refresh_token, new_refresh_token)) {
     if (strValid(refresh_token)) {  // only update, if the refresh token
                                     // changes, not when
                                     // it is initially obtained
       logger(DEBUG, "Updating refreshtoken for %s from '%s' to '%s'",
-             account_getName(a), refresh_token, _refresh_token);
-      oidcd_handleUpdateRefreshToken(pipes, account_getName(a), _refresh_token);
+             account_getName(a), refresh_token, new_refresh_token);
+      oidcd_handleUpdateRefreshToken(pipes, account_getName(a),
+                                     new_refresh_token);
+    }
+    account_setRefreshToken(a, oidc_strcopy(new_refresh_token));
+  }
+  const char* token_view =
+      cJSON_GetStringValue(getJSONItem(json, OIDC_KEY_ACCESSTOKEN));
+  char* access_token = token_view != NULL ? oidc_strcopy(token_view) : NULL;
+  if (expires_in == NULL && access_token != NULL) {
+    // no expires_in in the response; a JWT access token still carries the
+    // precise expiry in its exp claim
+    time_t jwt_expires_at = jwt_getExpiresAt(access_token);
+    if (jwt_expires_at > 0) {
+      account_setTokenExpiresAt(a, jwt_expires_at);
+      logger(DEBUG, "expires_at from JWT exp claim is: %lu",
+             account_getTokenExpiresAt(a));
     }
-    account_setRefreshToken(a, _refresh_token);
-  } else {
-    secFree(_refresh_token);
   }
+  secFreeJson(json);
   if (saveAccessToken) {
-    account_setAccessToken(a, _access_token);
+    account_setAccessToken(a, access_token);
   }
-  return _access_token;
+  return access_token;
 }
 
 char* parseTokenResponse(const char* res, struct oidc_account* a,
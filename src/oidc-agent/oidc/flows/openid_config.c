@@ -4,11 +4,16 @@
 #include "defines/settings.h"
 #include "oidc-agent/http/http_ipc.h"
 #include "oidc-agent/oidc/parse_oidp.h"
+#include "openid_config_cache.h"
 #include "utils/logger.h"
 #include "utils/oidc_error.h"
 
 /** @fn oidc_error_t getIssuerConfig(struct oidc_account* account)
  * @brief retrieves issuer config from the configuration_endpoint
+ *
+ * For a known issuer the cached discovery document is used; if it is older
+ * than the TTL it is refetched in the background, so account loading never
+ * blocks on discovery.
  * @note the issuer url has to be set prior
  * @param account the account struct, will be updated with the retrieved
  * config
@@ -21,11 +26,24 @@ oidc_error_t getIssuerConfig(struct oidc_account* account) {
                                   configuration_endpoint);
   logger(DEBUG, "Configuration endpoint is: %s",
          account_getConfigEndpoint(account));
+  int   stale  = 0;
+  char* cached = discoveryCache_get(account_getIssuerUrl(account), &stale);
+  if (cached != NULL) {
+    logger(DEBUG, "Using cached discovery document for %s",
+           account_getIssuerUrl(account));
+    if (stale) {
+      discoveryCache_revalidate(account_getIssuerUrl(account),
+                                account_getConfigEndpoint(account),
+                                account_getCertPath(account));
+    }
+    return parseOpenidConfiguration(cached, account);
+  }
   char* res = httpsGET(account_getConfigEndpoint(account), NULL,
                        account_getCertPath(account));
   if (NULL == res) {
     return oidc_errno;
   }
+  discoveryCache_put(account_getIssuerUrl(account), res);
   return parseOpenidConfiguration(res, account);
 }
 
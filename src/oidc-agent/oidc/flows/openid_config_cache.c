@@ -0,0 +1,362 @@
+#include "openid_config_cache.h"
+
+#include "list/list.h"
+#include "oidc-agent/http/http_ipc.h"
+#include "utils/crypt/crypt.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/numberString.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Discovery documents change roughly never, but they were fetched on every
+ * account load - an agent restart with many loaded accounts turned into a
+ * discovery storm against the issuers. Retrieved documents are therefore
+ * cached per issuer url. The cache is persisted in the oidc directory,
+ * encrypted with a random key that is generated once and kept in a file next
+ * to it (discovery documents are public; the encryption at rest only ties
+ * them to the file permissions of the oidc directory). Entries older than
+ * the TTL are still served, but trigger a background refetch - loading an
+ * account for a known issuer never blocks on discovery.
+ */
+
+#define DISCOVERY_CACHE_FILE "discovery.cache"
+#define DISCOVERY_CACHE_KEY_FILE "discovery.cache.key"
+#define DISCOVERY_CACHE_KEY_LEN 32
+
+struct discovery_cache_entry {
+  char*         issuer_url;
+  char*         config;
+  time_t        updated_at;
+  unsigned char revalidating;
+};
+
+static list_t*         discovery_cache      = NULL;
+static pthread_mutex_t discovery_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _secFreeDiscoveryCacheEntry(void* p) {
+  struct discovery_cache_entry* entry = p;
+  secFree(entry->issuer_url);
+  secFree(entry->config);
+  secFree(entry);
+}
+
+static time_t _discoveryCacheTTL() {
+  const char* ttl = getenv(DISCOVERY_CACHE_TTL_ENV_NAME);
+  if (strValid(ttl)) {
+    return strToInt(ttl);
+  }
+  return DISCOVERY_CACHE_DEFAULT_TTL;
+}
+
+/**
+ * @brief reads the cache encryption key, generating and storing it on first
+ * use
+ * @return a pointer to the key. Has to be freed after usage.
+ */
+static char* _discoveryCacheKey() {
+  if (oidcFileDoesExist(DISCOVERY_CACHE_KEY_FILE)) {
+    return readOidcFile(DISCOVERY_CACHE_KEY_FILE);
+  }
+  char key[DISCOVERY_CACHE_KEY_LEN + 1];
+  randomFillBase64UrlSafe(key, DISCOVERY_CACHE_KEY_LEN);
+  key[DISCOVERY_CACHE_KEY_LEN] = '\0';
+  if (writeOidcFile(DISCOVERY_CACHE_KEY_FILE, key) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  return oidc_strcopy(key);
+}
+
+static struct discovery_cache_entry* _discoveryCache_find(
+    const char* issuer_url) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(discovery_cache, LIST_HEAD);
+  while ((node = list_iterator_next(it)) != NULL) {
+    struct discovery_cache_entry* entry = node->val;
+    if (strequal(entry->issuer_url, issuer_url)) {
+      list_iterator_destroy(it);
+      return entry;
+    }
+  }
+  list_iterator_destroy(it);
+  return NULL;
+}
+
+/**
+ * @brief loads the persisted cache into memory; called with the lock held
+ */
+static void _discoveryCache_load() {
+  if (discovery_cache != NULL) {
+    return;
+  }
+  discovery_cache       = list_new();
+  discovery_cache->free = _secFreeDiscoveryCacheEntry;
+  if (!oidcFileDoesExist(DISCOVERY_CACHE_FILE)) {
+    return;
+  }
+  char* key = _discoveryCacheKey();
+  if (key == NULL) {
+    return;
+  }
+  char* json = decryptOidcFile(DISCOVERY_CACHE_FILE, key);
+  secFree(key);
+  if (json == NULL) {
+    logger(NOTICE, "could not decrypt discovery cache; ignoring it");
+    return;
+  }
+  cJSON* obj = stringToJson(json);
+  secFree(json);
+  if (obj == NULL) {
+    return;
+  }
+  int size = cJSON_GetArraySize(obj);  // iterates the object's members
+  for (int i = 0; i < size; i++) {
+    cJSON* e = cJSON_GetArrayItem(obj, i);
+    if (e->string == NULL) {
+      continue;
+    }
+    char* updated_at = getJSONValue(e, "updated_at");
+    char* config     = getJSONValue(e, "config");
+    if (updated_at == NULL || config == NULL) {
+      secFree(updated_at);
+      secFree(config);
+      continue;
+    }
+    struct discovery_cache_entry* entry =
+        secAlloc(sizeof(struct discovery_cache_entry));
+    entry->issuer_url = oidc_strcopy(e->string);
+    entry->config     = config;
+    entry->updated_at = stringToNumber(updated_at);
+    secFree(updated_at);
+    list_rpush(discovery_cache, list_node_new(entry));
+  }
+  secFreeJson(obj);
+  logger(DEBUG, "loaded %d discovery cache entries",
+         (int)discovery_cache->len);
+}
+
+/**
+ * @brief persists the in-memory cache; called with the lock held
+ */
+static void _discoveryCache_save() {
+  char* key = _discoveryCacheKey();
+  if (key == NULL) {
+    logger(NOTICE, "could not obtain discovery cache key: %s",
+           oidc_serror());
+    return;
+  }
+  cJSON* obj = stringToJson("{}");
+  if (obj == NULL) {
+    secFree(key);
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(discovery_cache, LIST_HEAD);
+  while ((node = list_iterator_next(it)) != NULL) {
+    struct discovery_cache_entry* entry      = node->val;
+    char*                         updated_at = numberToString(entry->updated_at);
+    cJSON* e = generateJSONObject("updated_at", cJSON_String, updated_at, NULL);
+    secFree(updated_at);
+    jsonAddObjectValue(e, "config", entry->config);
+    jsonAddJSON(obj, entry->issuer_url, e);
+  }
+  list_iterator_destroy(it);
+  char* json = jsonToStringUnformatted(obj);
+  secFreeJson(obj);
+  if (json != NULL) {
+    encryptAndWriteToOidcFile(json, DISCOVERY_CACHE_FILE, key);
+    secFree(json);
+  }
+  secFree(key);
+}
+
+/**
+ * @brief looks up the cached discovery document for @p issuer_url
+ * @param issuer_url the issuer url
+ * @param stale if not @c NULL it is set to @c 1 if the returned document is
+ * older than the TTL and should be revalidated
+ * @return a pointer to the cached document. Has to be freed after usage. If
+ * there is no cached document for this issuer, @c NULL is returned.
+ */
+char* discoveryCache_get(const char* issuer_url, int* stale) {
+  if (issuer_url == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&discovery_cache_lock);
+  _discoveryCache_load();
+  struct discovery_cache_entry* entry = _discoveryCache_find(issuer_url);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&discovery_cache_lock);
+    return NULL;
+  }
+  if (stale != NULL) {
+    *stale = entry->updated_at + _discoveryCacheTTL() < time(NULL);
+  }
+  char* config = oidc_strcopy(entry->config);
+  pthread_mutex_unlock(&discovery_cache_lock);
+  return config;
+}
+
+/**
+ * @brief stores a retrieved discovery document for @p issuer_url and
+ * persists the cache
+ */
+void discoveryCache_put(const char* issuer_url, const char* config) {
+  if (issuer_url == NULL || config == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&discovery_cache_lock);
+  _discoveryCache_load();
+  struct discovery_cache_entry* entry = _discoveryCache_find(issuer_url);
+  if (entry == NULL) {
+    entry             = secAlloc(sizeof(struct discovery_cache_entry));
+    entry->issuer_url = oidc_strcopy(issuer_url);
+    list_rpush(discovery_cache, list_node_new(entry));
+  }
+  secFree(entry->config);
+  entry->config       = oidc_strcopy(config);
+  entry->updated_at   = time(NULL);
+  entry->revalidating = 0;
+  _discoveryCache_save();
+  pthread_mutex_unlock(&discovery_cache_lock);
+}
+
+struct revalidation_args {
+  char* issuer_url;
+  char* configuration_endpoint;
+  char* cert_path;
+};
+
+static void* _revalidate(void* p) {
+  struct revalidation_args* args = p;
+  char* res = httpsGET(args->configuration_endpoint, NULL, args->cert_path);
+  if (res != NULL) {
+    discoveryCache_put(args->issuer_url, res);
+    secFree(res);
+  } else {
+    // keep serving the stale document; the next lookup retries
+    pthread_mutex_lock(&discovery_cache_lock);
+    struct discovery_cache_entry* entry =
+        _discoveryCache_find(args->issuer_url);
+    if (entry != NULL) {
+      entry->revalidating = 0;
+    }
+    pthread_mutex_unlock(&discovery_cache_lock);
+  }
+  secFree(args->issuer_url);
+  secFree(args->configuration_endpoint);
+  secFree(args->cert_path);
+  secFree(args);
+  return NULL;
+}
+
+/**
+ * @brief fetches the discovery document for @p issuer_url in the background
+ * unless it is already freshly cached
+ *
+ * Used to warm the cache as soon as an issuer is known - e.g. while the
+ * oidc-gen user is still answering prompts - so the scope lookup and
+ * registration that follow do not block on discovery.
+ */
+void discoveryCache_prefetch(const char* issuer_url,
+                             const char* configuration_endpoint,
+                             const char* cert_path) {
+  if (issuer_url == NULL || configuration_endpoint == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&discovery_cache_lock);
+  _discoveryCache_load();
+  struct discovery_cache_entry* entry = _discoveryCache_find(issuer_url);
+  if (entry != NULL) {
+    int fresh = entry->updated_at + _discoveryCacheTTL() >= time(NULL);
+    pthread_mutex_unlock(&discovery_cache_lock);
+    if (!fresh) {
+      discoveryCache_revalidate(issuer_url, configuration_endpoint,
+                                cert_path);
+    }
+    return;
+  }
+  pthread_mutex_unlock(&discovery_cache_lock);
+  struct revalidation_args* args = secAlloc(sizeof(struct revalidation_args));
+  args->issuer_url               = oidc_strcopy(issuer_url);
+  args->configuration_endpoint   = oidc_strcopy(configuration_endpoint);
+  args->cert_path                = oidc_strcopy(cert_path);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _revalidate, args) != 0) {
+    logger(ERROR, "could not create discovery prefetch thread: %m");
+    secFree(args->issuer_url);
+    secFree(args->configuration_endpoint);
+    secFree(args->cert_path);
+    secFree(args);
+    return;
+  }
+  pthread_detach(thread);
+  logger(DEBUG, "prefetching discovery document for %s", issuer_url);
+}
+
+/**
+ * @brief refetches the discovery document for @p issuer_url in the
+ * background
+ *
+ * Does nothing if a revalidation for this issuer is already running.
+ */
+void discoveryCache_revalidate(const char* issuer_url,
+                               const char* configuration_endpoint,
+                               const char* cert_path) {
+  if (issuer_url == NULL || configuration_endpoint == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&discovery_cache_lock);
+  _discoveryCache_load();
+  struct discovery_cache_entry* entry = _discoveryCache_find(issuer_url);
+  if (entry == NULL || entry->revalidating) {
+    pthread_mutex_unlock(&discovery_cache_lock);
+    return;
+  }
+  entry->revalidating = 1;
+  pthread_mutex_unlock(&discovery_cache_lock);
+  struct revalidation_args* args = secAlloc(sizeof(struct revalidation_args));
+  args->issuer_url               = oidc_strcopy(issuer_url);
+  args->configuration_endpoint   = oidc_strcopy(configuration_endpoint);
+  args->cert_path                = oidc_strcopy(cert_path);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _revalidate, args) != 0) {
+    logger(ERROR, "could not create discovery revalidation thread: %m");
+    pthread_mutex_lock(&discovery_cache_lock);
+    entry = _discoveryCache_find(issuer_url);
+    if (entry != NULL) {
+      entry->revalidating = 0;
+    }
+    pthread_mutex_unlock(&discovery_cache_lock);
+    secFree(args->issuer_url);
+    secFree(args->configuration_endpoint);
+    secFree(args->cert_path);
+    secFree(args);
+    return;
+  }
+  pthread_detach(thread);
+  logger(DEBUG, "revalidating discovery document for %s", issuer_url);
+}
+
+/**
+ * @brief drops the in-memory discovery cache
+ * The documents stay persisted encrypted in the oidc directory, so the next
+ * lookup reloads them from disk instead of rediscovering the issuer. Used
+ * by the memory-pressure reclamation.
+ */
+void discoveryCache_drop() {
+  pthread_mutex_lock(&discovery_cache_lock);
+  if (discovery_cache != NULL) {
+    secFreeList(discovery_cache);
+    discovery_cache = NULL;
+  }
+  pthread_mutex_unlock(&discovery_cache_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef OPENID_CONFIG_CACHE_H
+#define OPENID_CONFIG_CACHE_H
+
+/**
+ * Cache for openid-configuration discovery documents, keyed by issuer url.
+ * Entries are held in memory and persisted encrypted in the oidc directory,
+ * so a restarted agent does not have to rediscover every known issuer.
+ */
+
+#define DISCOVERY_CACHE_TTL_ENV_NAME "OIDC_AGENT_DISCOVERY_CACHE_TTL"
+#define DISCOVERY_CACHE_DEFAULT_TTL 86400
+
+char* discoveryCache_get(const char* issuer_url, int* stale);
+void  discoveryCache_put(const char* issuer_url, const char* config);
+void  discoveryCache_revalidate(const char* issuer_url,
+                                const char* configuration_endpoint,
+                                const char* cert_path);
+void  discoveryCache_prefetch(const char* issuer_url,
+                              const char* configuration_endpoint,
+                              const char* cert_path);
+void  discoveryCache_drop();
+
+#endif  // OPENID_CONFIG_CACHE_H
@@ -6,6 +6,11 @@
 #include "oidc-agent/oidc/parse_oidp.h"
 #include "oidc.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <time.h>
 
 oidc_error_t revokeToken(struct oidc_account* account) {
   logger(DEBUG, "Performing Token revocation flow");
@@ -47,3 +52,145 @@ oidc_error_t revokeToken(struct oidc_account* account) {
   oidc_errno = OIDC_SUCCESS;
   return oidc_errno;
 }
+
+/**
+ * Batch revocation.
+ *
+ * Revoking many tokens one synchronous POST at a time serializes on network
+ * round trips. A batch runs the revocations on a small thread pool over the
+ * shared http engine - which overlaps the transfers and reuses per-host
+ * connections - bounded both overall and per issuer so no endpoint gets
+ * hammered, and stops handing out new work once the deadline passed.
+ */
+
+enum revoke_job_state { REVOKE_PENDING, REVOKE_RUNNING, REVOKE_DONE };
+
+struct revoke_job {
+  struct oidc_account* account;
+  unsigned char        state;
+  oidc_error_t         result;
+};
+
+struct revoke_batch {
+  struct revoke_job* jobs;
+  size_t             len;
+  time_t             deadline;
+  pthread_mutex_t    lock;
+  pthread_cond_t     changed;
+};
+
+// called with the batch lock held
+static size_t _runningForIssuer(struct revoke_batch* batch,
+                                const char*          issuer_url) {
+  size_t running = 0;
+  for (size_t i = 0; i < batch->len; i++) {
+    if (batch->jobs[i].state == REVOKE_RUNNING &&
+        strequal(account_getIssuerUrl(batch->jobs[i].account), issuer_url)) {
+      running++;
+    }
+  }
+  return running;
+}
+
+static void* _revokeBatchWorker(void* p) {
+  struct revoke_batch* batch = p;
+  pthread_mutex_lock(&batch->lock);
+  while (1) {
+    if (time(NULL) >= batch->deadline) {
+      break;  // out of time; pending jobs keep their tokens
+    }
+    struct revoke_job* job          = NULL;
+    int                pending_left = 0;
+    for (size_t i = 0; i < batch->len; i++) {
+      if (batch->jobs[i].state != REVOKE_PENDING) {
+        continue;
+      }
+      pending_left = 1;
+      if (_runningForIssuer(batch,
+                            account_getIssuerUrl(batch->jobs[i].account)) <
+          REVOKE_BATCH_ISSUER_PARALLELISM) {
+        job = &batch->jobs[i];
+        break;
+      }
+    }
+    if (job == NULL) {
+      if (!pending_left) {
+        break;  // nothing left to start
+      }
+      // all pending jobs wait for a slot on their issuer
+      pthread_cond_wait(&batch->changed, &batch->lock);
+      continue;
+    }
+    job->state = REVOKE_RUNNING;
+    pthread_mutex_unlock(&batch->lock);
+    oidc_error_t result = revokeToken(job->account);
+    pthread_mutex_lock(&batch->lock);
+    job->result = result;
+    job->state  = REVOKE_DONE;
+    pthread_cond_broadcast(&batch->changed);
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return NULL;
+}
+
+/**
+ * @brief revokes the refresh tokens of all @p accounts concurrently
+ * @param accounts a list of struct oidc_account*; the list is not modified
+ * and ownership stays with the caller
+ * @param deadline_seconds total time budget; revocations not started when it
+ * runs out are skipped so the batch duration stays bounded
+ * @return the number of successfully revoked tokens
+ */
+size_t revokeTokens(list_t* accounts, unsigned int deadline_seconds) {
+  if (accounts == NULL || accounts->len == 0) {
+    return 0;
+  }
+  logger(DEBUG, "Batch revoking %u tokens", accounts->len);
+  struct revoke_batch batch = {
+      .jobs     = secCalloc(accounts->len, sizeof(struct revoke_job)),
+      .len      = accounts->len,
+      .deadline = time(NULL) + deadline_seconds,
+  };
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.changed, NULL);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(accounts, LIST_HEAD);
+  for (size_t i = 0; (node = list_iterator_next(it)) != NULL; i++) {
+    batch.jobs[i].account = node->val;
+    batch.jobs[i].state   = REVOKE_PENDING;
+    batch.jobs[i].result  = OIDC_ETIMEOUT;
+  }
+  list_iterator_destroy(it);
+  pthread_t threads[REVOKE_BATCH_PARALLELISM];
+  size_t    thread_count =
+      batch.len < REVOKE_BATCH_PARALLELISM ? batch.len
+                                           : REVOKE_BATCH_PARALLELISM;
+  size_t started = 0;
+  for (size_t i = 0; i < thread_count; i++) {
+    if (pthread_create(&threads[started], NULL, _revokeBatchWorker, &batch) ==
+        0) {
+      started++;
+    } else {
+      logger(ERROR, "could not create revocation worker: %m");
+    }
+  }
+  if (started == 0) {  // fall back to revoking serially
+    for (size_t i = 0; i < batch.len && time(NULL) < batch.deadline; i++) {
+      batch.jobs[i].result = revokeToken(batch.jobs[i].account);
+      batch.jobs[i].state  = REVOKE_DONE;
+    }
+  }
+  for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+  size_t revoked = 0;
+  for (size_t i = 0; i < batch.len; i++) {
+    if (batch.jobs[i].state == REVOKE_DONE &&
+        batch.jobs[i].result == OIDC_SUCCESS) {
+      revoked++;
+    }
+  }
+  pthread_mutex_destroy(&batch.lock);
+  pthread_cond_destroy(&batch.changed);
+  secFree(batch.jobs);
+  logger(DEBUG, "Batch revoked %lu of %u tokens", revoked, accounts->len);
+  return revoked;
+}
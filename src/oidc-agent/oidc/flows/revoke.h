@@ -2,8 +2,14 @@
 #define OIDC_REVOKE_H
 
 #include "account/account.h"
+#include "list/list.h"
 #include "utils/oidc_error.h"
 
+// How many revocations run concurrently in a batch, overall and per issuer.
+#define REVOKE_BATCH_PARALLELISM 8
+#define REVOKE_BATCH_ISSUER_PARALLELISM 2
+
 oidc_error_t revokeToken(struct oidc_account* account);
+size_t       revokeTokens(list_t* accounts, unsigned int deadline_seconds);
 
 #endif  // OIDC_REVOKE_H
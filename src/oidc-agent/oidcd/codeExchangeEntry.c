@@ -1,5 +1,23 @@
 #include "codeExchangeEntry.h"
-#include "utils/matcher.h"
+#include "utils/secure_compare.h"
+#include "utils/stringUtils.h"
+
+#include <stdlib.h>
+
+/**
+ * @brief the time a pending auth code flow may wait for its redirect
+ * @return the value of @c OIDC_AGENT_CODE_FLOW_TTL (seconds) if set,
+ * @c CEE_EXPIRATION_DURATION otherwise; read once and cached
+ */
+time_t cee_expirationDuration() {
+  static time_t ttl = 0;
+  if (ttl == 0) {
+    const char* env = getenv(CEE_EXPIRATION_ENV_NAME);
+    ttl = strValid(env) && strToInt(env) > 0 ? strToInt(env)
+                                             : CEE_EXPIRATION_DURATION;
+  }
+  return ttl;
+}
 
 void secFreeCodeExchangeContent(struct codeExchangeEntry* cee) {
   secFreeAccount(cee->account);
@@ -18,9 +36,20 @@ struct codeExchangeEntry* createCodeExchangeEntry(char*                state,
   cee->account                  = account;
   cee->state                    = state;
   cee->code_verifier            = code_verifier;
+  cee->death                    = time(NULL) + cee_expirationDuration();
   return cee;
 }
 
 int cee_matchByState(struct codeExchangeEntry* a, struct codeExchangeEntry* b) {
-  return matchStrings(a->state, b->state);
+  // the state gates the code exchange; an early-exit compare would leak
+  // how many leading characters of a guess were right
+  return strsecequal(a->state, b->state);
+}
+
+const char* cee_getState(const struct codeExchangeEntry* cee) {
+  return cee ? cee->state : NULL;
+}
+
+time_t cee_getDeath(const struct codeExchangeEntry* cee) {
+  return cee ? cee->death : 0;
 }
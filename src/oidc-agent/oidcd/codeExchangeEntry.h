@@ -3,13 +3,37 @@
 
 #include "account/account.h"
 
+#include <time.h>
+
+// How long a started auth code flow may wait for its redirect before the
+// entry - and with it the flow's redirect listener - is considered
+// abandoned and evicted. Can be overridden at build time or at runtime
+// with the env below (value in seconds).
+#ifndef CEE_EXPIRATION_DURATION
+#define CEE_EXPIRATION_DURATION 600
+#endif
+
+#define CEE_EXPIRATION_ENV_NAME "OIDC_AGENT_CODE_FLOW_TTL"
+
+// How many auth code flows may be pending at the same time. Every pending
+// flow retains a decrypted account until it completes or expires; when the
+// limit is reached the flow closest to expiry is abandoned before a new one
+// is registered. Can be overridden at build time.
+#ifndef CEE_MAX_PENDING
+#define CEE_MAX_PENDING 32
+#endif
+
 struct codeExchangeEntry {
   char*                state;
   struct oidc_account* account;
   char*                code_verifier;
+  time_t               death;
 };
 
 int cee_matchByState(struct codeExchangeEntry* a, struct codeExchangeEntry* b);
+const char* cee_getState(const struct codeExchangeEntry* cee);
+time_t      cee_getDeath(const struct codeExchangeEntry* cee);
+time_t      cee_expirationDuration();
 struct codeExchangeEntry* createCodeExchangeEntry(char*                state,
                                                   struct oidc_account* account,
                                                   char* code_verifier);
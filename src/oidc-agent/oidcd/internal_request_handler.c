@@ -2,12 +2,13 @@
 #include "defines/ipc_values.h"
 #include "ipc/pipe.h"
 #include "oidc-agent/oidc/parse_oidp.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
 #include "utils/logger.h"
 
 void oidcd_handleUpdateRefreshToken(const struct ipcPipe pipes,
                                     const char*          short_name,
                                     const char*          refresh_token) {
-  char* res   = ipc_communicateThroughPipe(pipes, INT_REQUEST_UPD_REFRESH,
+  char* res   = oidcd_workers_communicate(pipes, INT_REQUEST_UPD_REFRESH,
                                          short_name, refresh_token);
   char* error = parseForError(res);
   if (error == NULL) {
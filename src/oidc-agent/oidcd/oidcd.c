@@ -1,10 +1,30 @@
 #include "oidcd.h"
 #include "account/account.h"
 #include "defines/ipc_values.h"
+#include "ipc/serveripc.h"
+#include "ipc/tokenMirror.h"
 #include "list/list.h"
 #include "oidc-agent/agent_state.h"
+#include "oidc-agent/http/http.h"
+#include "oidc-agent/http/http_warmup.h"
+#include "oidc-agent/httpserver/termHttpserver.h"
 #include "oidc-agent/oidcd/codeExchangeEntry.h"
+#include "oidc-agent/oidcd/oidcd_forward.h"
 #include "oidc-agent/oidcd/oidcd_handler.h"
+#include "oidc-agent/oidcd/oidcd_mempressure.h"
+#include "oidc-agent/oidcd/oidcd_preload.h"
+#include "oidc-agent/oidcd/oidcd_promexport.h"
+#include "oidc-agent/oidcd/oidcd_reaper.h"
+#include "oidc-agent/oidcd/oidcd_refresh.h"
+#include "oidc-agent/oidcd/oidcd_snapshot.h"
+#include "oidc-agent/oidcd/oidcd_stage.h"
+#include "oidc-agent/oidcd/oidcd_timers.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "oidc-agent/requestType.h"
+#include "utils/accountSnapshot.h"
+#include "utils/agent_sdt.h"
+#include "utils/agent_metrics.h"
+#include "utils/agent_trace.h"
 #include "utils/accountUtils.h"
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/memoryCrypt.h"
@@ -16,33 +36,118 @@
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 
-int oidcd_main(struct ipcPipe pipes, const struct arguments* arguments) {
+/**
+ * @brief pushes a fresh account summary to oidcp if the snapshot changed
+ *
+ * Fire-and-forget internal request carrying the loaded account count and
+ * per-account token expiries; oidcp caches it and answers health requests
+ * from the cache, so a monitoring probe never reaches oidcd.
+ */
+static void _pushStatus(struct ipcPipe pipes) {
+  static unsigned long pushed_generation = 0;
+  unsigned long        gen               = accountSnapshot_generation();
+  if (gen == pushed_generation) {
+    return;
+  }
+  pushed_generation = gen;
+  char* health      = accountSnapshot_healthJSON();
+  pipes.id          = 0;  // belongs to no client request
+  ipc_writeToPipe(pipes, INT_REQUEST_STATUS, health);
+  secFree(health);
+}
+
+int oidcd_main(struct ipcPipe pipes, struct arguments* arguments) {
   logger_open("oidc-agent.d");
+  logger_startAsync();  // keep syslog writes off the request loop
+  oidcd_stage_init();   // SIGUSR2 from oidcp's watchdog dumps the stage
   initCrypt();
   initMemoryCrypt();
+  http_warmup();  // overlaps with the rest of the agent start-up
+  tokenMirror_init(getServerSocketPath());  // no-op unless opted in
 
   codeVerifierDB_new();
   codeVerifierDB_setFreeFunction((freeFunction)_secFree);
   codeVerifierDB_setMatchFunction((matchFunction)cee_matchByState);
+  codeVerifierDB_setHashKeys((db_keyExtractor)cee_getState, NULL);
+  codeVerifierDB_setDeathGetter((time_t(*)(void*))cee_getDeath);
 
   accountDB_new();
-  accountDB_setFreeFunction((freeFunction)_secFreeAccount);
+  // frees are deferred while worker jobs hold pointers into the db
+  accountDB_setFreeFunction((freeFunction)oidcd_reaper_free);
   accountDB_setMatchFunction((matchFunction)account_matchByName);
+  accountDB_setHashKeys((db_keyExtractor)account_getName,
+                        (db_keyExtractor)account_getIssuerUrl);
+  accountDB_setDeathGetter((time_t(*)(void*))account_getDeath);
+  oidcd_snapshot_restore(arguments);      // no-op without --restore
+  oidcd_preload_start(pipes, arguments);  // no-op without --preload
+  oidcd_refresh_start(pipes, arguments);  // proactive token refresh timer
+  oidcd_snapshot_start(arguments);        // periodic state snapshot writes
+  oidcd_promexport_start(arguments);      // no-op without --metrics-file
+  oidcd_forward_init(arguments);          // no-op without --forward
+  oidcd_mempressure_start(arguments);     // reclaims only with
+                                          // --memory-budget
   time_t minDeath = 0;
 
   while (1) {
-    minDeath = getMinAccountDeath();
-    char* q  = ipc_readFromPipeWithTimeout(pipes, minDeath);
+    _pushStatus(pipes);  // any account change made below or by a worker is
+                         // pushed once the loop comes back around
+    minDeath        = getMinAccountDeath();
+    time_t ceeDeath = codeVerifierDB_getMinDeath((time_t(*)(void*))cee_getDeath);
+    if (ceeDeath != 0 && (minDeath == 0 || ceeDeath < minDeath)) {
+      minDeath = ceeDeath;
+    }
+    time_t timerAt = oidcd_timers_nextAt();
+    if (timerAt != 0 && (minDeath == 0 || timerAt < minDeath)) {
+      minDeath = timerAt;
+    }
+    time_t reapAt = oidcd_reaper_nextAt();
+    if (reapAt != 0 && (minDeath == 0 || reapAt < minDeath)) {
+      minDeath = reapAt;
+    }
+    struct pipeMessage pm = ipc_readMessageFromPipeWithTimeout(pipes, minDeath);
+    char*              q  = pm.msg;
     if (q == NULL) {
       if (oidc_errno == OIDC_ETIMEOUT) {
-        struct oidc_account* death = NULL;
-        while ((death = getDeathAccount()) != NULL) {
-          accountDB_removeIfFound(death);
+        if (oidcd_workers_jobsActive() == 0) {  // a worker might still hold a
+                                                // pointer into the account db
+          struct oidc_account* death        = NULL;
+          unsigned char        removedAccts = 0;
+          while ((death = getDeathAccount()) != NULL) {
+            accountDB_removeIfFound(death);
+            removedAccts = 1;
+          }
+          if (removedAccts) {
+            accountSnapshot_refresh();
+          }
+          // evict abandoned auth code flows whose redirect never came
+          struct codeExchangeEntry* deadCee = NULL;
+          while ((deadCee = codeVerifierDB_getDeathEntry(
+                      (time_t(*)(void*))cee_getDeath)) != NULL) {
+            logger(DEBUG, "Removing abandoned auth code flow for state '%s'",
+                   deadCee->state);
+            termHttpServer(deadCee->state);  // also reaps the redirect
+                                             // listener of the dead flow
+            oidcd_stateWaiters_notify(deadCee->state);  // a parked lookup
+                                                        // learns the flow died
+            agent_metrics_flowEnd(deadCee->state);
+            agent_metrics_record("codeflow_expired", 0);
+            secFreeCodeExchangeContent(deadCee);
+            codeVerifierDB_removeIfFound(deadCee);
+          }
         }
+        oidcd_timers_runDue();  // e.g. the proactive refresh walk
+        oidcd_reaper_drain();   // frees accounts removed while workers
+                                // were busy
         continue;
       }  // A real error and no timeout
       logger(ERROR, "%s", oidc_serror());
       if (oidc_errno == OIDC_EIPCDIS) {
+        // oidcp closing the pipe is how every shutdown - including a
+        // --handoff takeover - reaches oidcd; a final snapshot makes sure
+        // a restoring successor sees the freshest state. Deferring is not
+        // an option here; the walk is safe against in-flight workers
+        // because the decrypted windows nest (see _db_decryptFoundAccount)
+        oidcd_snapshot_write();
         exit(EXIT_FAILURE);
       }
       if (ipc_writeOidcErrnoToPipe(pipes) ==
@@ -51,89 +156,193 @@ int oidcd_main(struct ipcPipe pipes, const struct arguments* arguments) {
       }
       exit(EXIT_FAILURE);
     }
+    pipes.id = pm.id;  // tag all responses and internal requests with the id
+                       // of the request they belong to
+    agent_trace_set(pm.trace);  // continue the trace oidcp started for this
+                                // request
+    if (strequal(q, REQUEST_CANCEL)) {  // the client is gone; a queued job
+                                        // for this request is dropped, a
+                                        // running one is bounded by its http
+                                        // deadline and its response discarded
+                                        // by oidcp
+      oidcd_workers_cancelJob(pm.id);
+      oidcd_stateWaiters_cancel(pm.id);  // same for a parked state lookup
+      secFree(q);
+      continue;
+    }
+    if (oidcd_workers_tryDeliverResponse(pm.id, q)) {  // a worker is waiting
+                                                       // for this answer to
+                                                       // its internal request;
+                                                       // it takes ownership
+      continue;
+    }
+    // The request is parsed into a DOM exactly once; handlers that take an
+    // embedded account or device code get the json object out of this DOM
+    // instead of printing and parsing it again. All json nodes built while
+    // serving the request live in the arena and die with it.
+    jsonArena_begin();
+    secArena_begin();
+    cJSON* dom = stringToJson(q);
     INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_MINVALID,
-                   IPC_KEY_CONFIG, IPC_KEY_FLOW, IPC_KEY_USECUSTOMSCHEMEURL,
+                   IPC_KEY_FLOW, IPC_KEY_USECUSTOMSCHEMEURL,
                    IPC_KEY_REDIRECTEDURI, OIDC_KEY_STATE, IPC_KEY_AUTHORIZATION,
-                   OIDC_KEY_SCOPE, IPC_KEY_DEVICE, IPC_KEY_FROMGEN,
-                   IPC_KEY_LIFETIME, IPC_KEY_PASSWORD, IPC_KEY_APPLICATIONHINT,
-                   IPC_KEY_CONFIRM, IPC_KEY_ISSUERURL, IPC_KEY_NOSCHEME);
-    if (getJSONValuesFromString(q, pairs, sizeof(pairs) / sizeof(*pairs)) < 0) {
+                   OIDC_KEY_SCOPE, IPC_KEY_FROMGEN, IPC_KEY_LIFETIME,
+                   IPC_KEY_PASSWORD, IPC_KEY_APPLICATIONHINT, IPC_KEY_CONFIRM,
+                   IPC_KEY_ISSUERURL, IPC_KEY_NOSCHEME, IPC_KEY_MAXACCOUNTS,
+                   IPC_KEY_DEADLINE, IPC_KEY_WAIT, IPC_KEY_TENANT);
+    if (dom == NULL || CALL_GETJSONVALUES_FROM_CJSON(dom) < 0) {
       ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, oidc_serror());
       secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+      secFreeJson(dom);
+      jsonArena_end();
+      secArena_end();
       secFree(q);
       continue;
     }
     secFree(q);
-    KEY_VALUE_VARS(request, shortname, minvalid, config, flow, nowebserver,
-                   redirectedUri, state, authorization, scope, device, fromGen,
+    KEY_VALUE_VARS(request, shortname, minvalid, flow, nowebserver,
+                   redirectedUri, state, authorization, scope, fromGen,
                    lifetime, password, applicationHint, confirm, issuer,
-                   noscheme);  // Gives variables for key_value values;
-                               // e.g. _request=pairs[0].value
+                   noscheme, maxAccounts, deadline, wait,
+                   tenant);  // Gives variables for key_value values;
+                             // e.g. _request=pairs[0].value
+    cJSON* _config = getJSONItem(dom, IPC_KEY_CONFIG);  // owned by dom
+    cJSON* _device = getJSONItem(dom, IPC_KEY_DEVICE);  // owned by dom
     if (_request == NULL) {
       ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "No request type.");
       secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+      secFreeJson(dom);
+      jsonArena_end();
+      secArena_end();
       continue;
     }
+    oidcd_stage_set("handling '%s' request%s%s%s%s", _request,
+                    strValid(_shortname) ? " for account " : "",
+                    strValid(_shortname) ? _shortname : "",
+                    strValid(_tenant) ? " for uid " : "",
+                    strValid(_tenant) ? _tenant : "");
 
-    if (strequal(_request, REQUEST_VALUE_CHECK)) {  // Allow check in all cases
+    enum request_type req = requestType(_request);
+    if (req == REQ_TYPE_CHECK) {  // Allow check in all cases
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
       secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+      secFreeJson(dom);
+      jsonArena_end();
+      secArena_end();
       continue;
     }
     if (agent_state.lock_state.locked) {  // If locked allow only unlock
-      if (strequal(_request, REQUEST_VALUE_UNLOCK)) {
+      if (req == REQ_TYPE_UNLOCK) {
         oidcd_handleLock(pipes, _password, 0);
       } else {
         oidc_errno = OIDC_ELOCKED;
         ipc_writeOidcErrnoToPipe(pipes);
       }
       secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+      secFreeJson(dom);
+      jsonArena_end();
+      secArena_end();
       continue;
     }
-    if (strequal(_request, REQUEST_VALUE_GEN)) {
-      oidcd_handleGen(pipes, _config, _flow, _nowebserver, _noscheme,
-                      arguments);
-    } else if (strequal(_request, REQUEST_VALUE_CODEEXCHANGE)) {
-      oidcd_handleCodeExchange(pipes, _redirectedUri, _fromGen);
-    } else if (strequal(_request, REQUEST_VALUE_STATELOOKUP)) {
-      oidcd_handleStateLookUp(pipes, _state);
-    } else if (strequal(_request, REQUEST_VALUE_DEVICELOOKUP)) {
-      oidcd_handleDeviceLookup(pipes, _config, _device);
-    } else if (strequal(_request, REQUEST_VALUE_ADD)) {
-      oidcd_handleAdd(pipes, _config, _lifetime, _confirm);
-    } else if (strequal(_request, REQUEST_VALUE_REMOVE)) {
-      oidcd_handleRm(pipes, _shortname);
-    } else if (strequal(_request, REQUEST_VALUE_REMOVEALL)) {
-      oidcd_handleRemoveAll(pipes);
-    } else if (strequal(_request, REQUEST_VALUE_DELETE)) {
-      oidcd_handleDelete(pipes, _config);
-    } else if (strequal(_request, REQUEST_VALUE_ACCESSTOKEN)) {
-      if (_shortname) {
-        oidcd_handleToken(pipes, _shortname, _minvalid, _scope,
-                          _applicationHint, arguments);
-      } else if (_issuer) {
-        oidcd_handleTokenIssuer(pipes, _issuer, _minvalid, _scope,
-                                _applicationHint, arguments);
-      } else {
-        // global default
-        oidc_errno = OIDC_NOTIMPL;  // TODO
-        ipc_writeOidcErrnoToPipe(pipes);
+    AGENT_PROBE1(request_dispatch, _request);
+    unsigned long handle_start = agent_metrics_now_ms();
+    // absolute deadline of this request; http calls stop when the client's
+    // time budget is spent instead of finishing work nobody waits for
+    unsigned long deadline_at =
+        strValid(_deadline) ? handle_start + strToULong(_deadline) : 0;
+    http_setDeadline(deadline_at);
+    switch (req) {
+      case REQ_TYPE_GEN:
+        oidcd_handleGen(pipes, _config, _flow, _nowebserver, _noscheme,
+                        arguments);
+        break;
+      case REQ_TYPE_CODEEXCHANGE:
+        oidcd_handleCodeExchange(pipes, _redirectedUri, _fromGen);
+        break;
+      case REQ_TYPE_STATELOOKUP:
+        oidcd_handleStateLookUp(pipes, _state, strToInt(_wait));
+        break;
+      case REQ_TYPE_DEVICELOOKUP:
+        oidcd_handleDeviceLookup(pipes, _config, _device);
+        break;
+      case REQ_TYPE_ADD:
+        oidcd_handleAdd(pipes, _config, _lifetime, _confirm);
+        break;
+      case REQ_TYPE_BULKADD: {
+        cJSON* _accountList = getJSONItem(dom, IPC_KEY_ACCOUNTLIST);
+        char*  account_list =
+            _accountList != NULL ? jsonToStringUnformatted(_accountList)
+                                  : NULL;
+        char* bulk_id = getJSONValue(dom, IPC_KEY_BULKID);
+        oidcd_handleBulkAdd(pipes, account_list, bulk_id, _lifetime);
+        secFree(bulk_id);
+        secFree(account_list);
+        break;
+      }
+      case REQ_TYPE_REMOVE: oidcd_handleRm(pipes, _shortname); break;
+      case REQ_TYPE_REMOVEALL: oidcd_handleRemoveAll(pipes); break;
+      case REQ_TYPE_DELETE: oidcd_handleDelete(pipes, _config); break;
+      case REQ_TYPE_ACCESSTOKEN: {
+        cJSON* _accountList = getJSONItem(dom, IPC_KEY_ACCOUNTLIST);
+        if (_accountList != NULL) {
+          char* account_list = jsonToStringUnformatted(_accountList);
+          oidcd_workers_dispatchTokenBatch(pipes, account_list, _minvalid,
+                                           _scope, _applicationHint,
+                                           deadline_at, arguments);
+          secFree(account_list);
+        } else if (oidcd_forward_shouldForward(_shortname)) {
+          // not loaded here; the home agent serves it from its warm cache
+          // instead of the account being re-added on this host
+          char* fwd = jsonToStringUnformatted(dom);
+          oidcd_workers_dispatchForward(pipes, fwd, deadline_at);
+          secFree(fwd);
+        } else if (_shortname || _issuer) {
+          // served on the worker pool so a slow token endpoint only delays
+          // its own clients
+          oidcd_workers_dispatchToken(pipes, _shortname, _issuer, _minvalid,
+                                      _scope, _applicationHint, deadline_at,
+                                      arguments);
+        } else {
+          // global default
+          oidc_errno = OIDC_NOTIMPL;  // TODO
+          ipc_writeOidcErrnoToPipe(pipes);
+        }
+        break;
       }
-    } else if (strequal(_request, REQUEST_VALUE_REGISTER)) {
-      oidcd_handleRegister(pipes, _config, _flow, _authorization);
-    } else if (strequal(_request, REQUEST_VALUE_TERMHTTP)) {
-      oidcd_handleTermHttp(pipes, _state);
-    } else if (strequal(_request, REQUEST_VALUE_SCOPES)) {
-      oidcd_handleScopes(pipes, _issuer);
-    } else if (strequal(_request, REQUEST_VALUE_LOCK)) {
-      oidcd_handleLock(pipes, _password, 1);
-    } else if (strequal(_request, REQUEST_VALUE_UNLOCK)) {
-      oidc_errno = OIDC_ENOTLOCKED;
-      ipc_writeOidcErrnoToPipe(pipes);
-    } else {  // Unknown request type
-      ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "Unknown request type.");
+      case REQ_TYPE_REGISTER:
+        oidcd_handleRegister(pipes, _config, _flow, _authorization);
+        break;
+      case REQ_TYPE_TERMHTTP: oidcd_handleTermHttp(pipes, _state); break;
+      case REQ_TYPE_SCOPES: oidcd_handleScopes(pipes, _issuer); break;
+      case REQ_TYPE_PREFETCH: oidcd_handlePrefetch(pipes, _issuer); break;
+      case REQ_TYPE_METRICS: oidcd_handleMetrics(pipes); break;
+      case REQ_TYPE_ACCOUNTLIST: oidcd_handleAccountList(pipes); break;
+      case REQ_TYPE_ACCOUNTCONFIG:
+        oidcd_handleAccountConfig(pipes, _shortname);
+        break;
+      case REQ_TYPE_STOREINFO: oidcd_handleStoreInfo(pipes); break;
+      case REQ_TYPE_RELOAD:
+        oidcd_handleReload(pipes, arguments, _lifetime, _maxAccounts,
+                           _confirm);
+        break;
+      case REQ_TYPE_LOCK: oidcd_handleLock(pipes, _password, 1); break;
+      case REQ_TYPE_UNLOCK:
+        oidc_errno = OIDC_ENOTLOCKED;
+        ipc_writeOidcErrnoToPipe(pipes);
+        break;
+      default:  // Unknown request type
+        ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "Unknown request type.");
+        break;
     }
+    http_setDeadline(0);
+    AGENT_PROBE1(request_done, _request);
+    // for worker-dispatched requests this only measures the dispatch; the
+    // job itself is counted by the worker under its own op name
+    agent_metrics_record(_request, agent_metrics_now_ms() - handle_start);
     secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+    secFreeJson(dom);
+    jsonArena_end();
+    secArena_end();
   }
   return EXIT_FAILURE;
 }
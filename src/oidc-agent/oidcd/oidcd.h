@@ -4,6 +4,6 @@
 #include "ipc/pipe.h"
 #include "oidc-agent/oidc-agent_options.h"
 
-int oidcd_main(struct ipcPipe, const struct arguments*);
+int oidcd_main(struct ipcPipe, struct arguments*);
 
 #endif  // OIDC_DAEMON_H
@@ -0,0 +1,97 @@
+#include "oidcd_forward.h"
+#include "account/account.h"
+#include "defines/ipc_values.h"
+#include "ipc/cryptCommunicator.h"
+#include "utils/agent_metrics.h"
+#include "utils/db/account_db.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+/**
+ * Agent-to-agent forwarding, like ssh-agent forwarding.
+ *
+ * An agent started with --forward=SOCKET serves token requests for accounts
+ * it has loaded itself, and proxies requests for everything else to the
+ * agent behind SOCKET - typically the user's home agent, reached through an
+ * ssh forwarded unix socket (ssh -R remote.sock:local.sock) or through the
+ * home agent's network listener (tcp://host:port, vsock://cid:port). The
+ * home agent answers from its warm cache, so accounts never have to be
+ * re-added - and their secrets never duplicated - on every host the user
+ * logs in to.
+ *
+ * The forwarded request is the client's request verbatim, only its
+ * deadline_ms budget is shrunk by the time already spent on this hop, so
+ * the home agent stops working when the original client stops waiting. The
+ * upstream round trip blocks, so it runs on the worker pool like any other
+ * token job.
+ */
+
+static const char* upstream_path = NULL;
+
+void oidcd_forward_init(const struct arguments* arguments) {
+  upstream_path = arguments->forward;
+  if (upstream_path != NULL) {
+    logger(DEBUG, "forwarding unknown accounts to agent at '%s'",
+           upstream_path);
+  }
+}
+
+/**
+ * @brief whether a token request for @p short_name is served by the home
+ * agent
+ * @return @c 1 if forwarding is configured and the account is not loaded
+ * locally
+ */
+int oidcd_forward_shouldForward(const char* short_name) {
+  if (upstream_path == NULL || !strValid(short_name)) {
+    return 0;
+  }
+  struct oidc_account key = {.shortname = (char*)short_name};
+  return accountDB_findValue(&key) == NULL;
+}
+
+/**
+ * @brief forwards a client request to the home agent and passes the answer
+ * back
+ *
+ * Runs on the worker pool; the upstream connection does the same encrypted
+ * key exchange any local client does.
+ * @param request the client's request json
+ * @param deadline_at_ms the absolute monotonic deadline of the request;
+ * @c 0 for none
+ */
+void oidcd_forward_execute(struct ipcPipe pipes, const char* request,
+                           unsigned long deadline_at_ms) {
+  cJSON* req = stringToJson(request);
+  if (req == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  if (deadline_at_ms != 0) {
+    unsigned long now = agent_metrics_now_ms();
+    if (now >= deadline_at_ms) {
+      secFreeJson(req);
+      oidc_errno = OIDC_ETIMEOUT;
+      ipc_writeOidcErrnoToPipe(pipes);
+      return;
+    }
+    // the home agent gets what is left of the client's time budget
+    char* remaining = oidc_sprintf("%lu", deadline_at_ms - now);
+    setJSONValue(req, IPC_KEY_DEADLINE, remaining);
+    secFree(remaining);
+  }
+  char* fwd = jsonToStringUnformatted(req);
+  secFreeJson(req);
+  char* res = ipc_cryptCommunicateWithPath(upstream_path, "%s", fwd);
+  secFree(fwd);
+  if (res == NULL) {
+    logger(ERROR, "could not reach forwarding agent at '%s'", upstream_path);
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  ipc_writeToPipe(pipes, "%s", res);
+  secFree(res);
+}
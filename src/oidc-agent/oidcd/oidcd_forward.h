@@ -0,0 +1,12 @@
+#ifndef OIDCD_FORWARD_H
+#define OIDCD_FORWARD_H
+
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc-agent_options.h"
+
+void oidcd_forward_init(const struct arguments* arguments);
+int  oidcd_forward_shouldForward(const char* short_name);
+void oidcd_forward_execute(struct ipcPipe pipes, const char* request,
+                           unsigned long deadline_at_ms);
+
+#endif  // OIDCD_FORWARD_H
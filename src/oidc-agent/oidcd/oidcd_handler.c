@@ -3,10 +3,14 @@
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
+#include "defines/settings.h"
 #include "ipc/pipe.h"
 #include "ipc/serveripc.h"
+#include "ipc/tokenMirror.h"
 #include "list/list.h"
 #include "oidc-agent/agent_state.h"
+#include "oidc-agent/http/http_dns.h"
+#include "oidc-agent/http/http_metrics.h"
 #include "oidc-agent/httpserver/startHttpserver.h"
 #include "oidc-agent/httpserver/termHttpserver.h"
 #include "oidc-agent/oidc/device_code.h"
@@ -14,28 +18,61 @@
 #include "oidc-agent/oidc/flows/code.h"
 #include "oidc-agent/oidc/flows/device.h"
 #include "oidc-agent/oidc/flows/openid_config.h"
+#include "oidc-agent/oidc/flows/openid_config_cache.h"
 #include "oidc-agent/oidc/flows/registration.h"
 #include "oidc-agent/oidc/flows/revoke.h"
 #include "oidc-agent/oidcd/codeExchangeEntry.h"
+#include "oidc-agent/oidcd/oidcd_refresh.h"
+#include "oidc-agent/oidcd/oidcd_snapshot.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
 #include "oidc-agent/oidcd/parse_internal.h"
+#include "oidc-agent/oidcd/singleflight.h"
+#include "utils/accountSnapshot.h"
 #include "utils/accountUtils.h"
+#include "utils/agent_metrics.h"
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
 #include "utils/db/account_db.h"
 #include "utils/db/codeVerifier_db.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/file_io_metrics.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/uriUtils.h"
 
+#include <ctype.h>
+#include <pthread.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
 #include <time.h>
 
+/**
+ * @brief returns the pending flow closest to expiry
+ * It is the abandonment victim when @c CEE_MAX_PENDING is reached.
+ */
+static struct codeExchangeEntry* _oldestPendingFlow() {
+  list_t* pending = codeVerifierDB_getList();
+  if (pending == NULL) {
+    return NULL;
+  }
+  struct codeExchangeEntry* oldest = NULL;
+  list_node_t*              node;
+  LIST_FOREACH(pending, node) {
+    struct codeExchangeEntry* cee = node->val;
+    if (oldest == NULL || cee->death < oldest->death) {
+      oldest = cee;
+    }
+  }
+  return oldest;
+}
+
 void initAuthCodeFlow(struct oidc_account* account, struct ipcPipe pipes,
                       const char* info, const char* nowebserver_str,
                       const char*             noscheme_str,
                       const struct arguments* arguments) {
+  unsigned long setup_start = agent_metrics_now_ms();
   if (arguments->no_webserver || strToInt(nowebserver_str)) {
     account_setNoWebServer(account);
   }
@@ -69,8 +106,29 @@ void initAuthCodeFlow(struct oidc_account* account, struct ipcPipe pipes,
   }
   // logger(DEBUG, "code_verifier for state '%s' is '%s'",
   //        state, code_verifier);
+  while (codeVerifierDB_getSize() >= CEE_MAX_PENDING) {
+    struct codeExchangeEntry* oldest = _oldestPendingFlow();
+    if (oldest == NULL) {
+      break;
+    }
+    logger(NOTICE,
+           "Maximum of %d pending auth code flows reached; abandoning the "
+           "flow for state '%s'",
+           CEE_MAX_PENDING, oldest->state);
+    termHttpServer(oldest->state);
+    oidcd_stateWaiters_notify(oldest->state);
+    agent_metrics_flowEnd(oldest->state);
+    agent_metrics_record("codeflow_evicted", 0);
+    secFreeCodeExchangeContent(oldest);
+    codeVerifierDB_removeIfFound(oldest);
+  }
   codeVerifierDB_addValue(
       createCodeExchangeEntry(*state_ptr, account, code_verifier));
+  // span trace of this flow: the setup span ends here, the authorization
+  // span - the user thinking and logging in - starts
+  agent_metrics_record("codeflow_setup",
+                       agent_metrics_now_ms() - setup_start);
+  agent_metrics_flowBegin(*state_ptr);
   if (info) {
     ipc_writeToPipe(pipes, RESPONSE_STATUS_CODEURI_INFO, STATUS_ACCEPTED, uri,
                     *state_ptr, info);
@@ -81,12 +139,12 @@ void initAuthCodeFlow(struct oidc_account* account, struct ipcPipe pipes,
   secFree(uri);
 }
 
-void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
+void oidcd_handleGen(struct ipcPipe pipes, const cJSON* account_json,
                      const char* flow, const char* nowebserver_str,
                      const char*             noscheme_str,
                      const struct arguments* arguments) {
-  logger(DEBUG, "Handle Gen request");
-  struct oidc_account* account = getAccountFromJSON(account_json);
+  DEBUG_LOG("Handle Gen request");
+  struct oidc_account* account = getAccountFromCJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
@@ -101,6 +159,7 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
     secFreeAccount(account);
     return;
   }
+  http_dns_prefetch(account_getTokenEndpoint(account));
 
   int              success = 0;
   list_t*          flows   = parseFlow(flow);
@@ -108,8 +167,8 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
   list_iterator_t* it = list_iterator_new(flows, LIST_HEAD);
   while ((current_flow = list_iterator_next(it))) {
     if (strcaseequal(current_flow->val, FLOW_VALUE_REFRESH)) {
-      if (getAccessTokenUsingRefreshFlow(account, FORCE_NEW_TOKEN, NULL,
-                                         pipes) != NULL) {
+      if (getAccessTokenUsingRefreshFlow(account, FORCE_NEW_TOKEN, NULL, pipes,
+                                         NULL) != NULL) {
         success = 1;
         break;
       } else if (flows->len == 1) {
@@ -147,8 +206,10 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
         secFreeAccount(account);
         return;
       }
-      char* json = deviceCodeToJSON(*dc);
-      ipc_writeToPipe(pipes, RESPONSE_ACCEPTED_DEVICE, json, account_json);
+      char* json        = deviceCodeToJSON(*dc);
+      char* account_str = jsonToStringUnformatted((cJSON*)account_json);
+      ipc_writeToPipe(pipes, RESPONSE_ACCEPTED_DEVICE, json, account_str);
+      secFree(account_str);
       secFree(json);
       secFreeDeviceCode(dc);
       list_iterator_destroy(it);
@@ -159,10 +220,12 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
       char* msg;
       if (strcaseequal(current_flow->val, FLOW_VALUE_CODE) &&
           !hasRedirectUris(account)) {
-        msg = oidc_sprintf("Only '%s' flow specified, but no redirect uris",
+        msg = oidc_sprintf_scoped(
+            "Only '%s' flow specified, but no redirect uris",
                            FLOW_VALUE_CODE);
       } else {
-        msg = oidc_sprintf("Unknown flow '%s'", (char*)current_flow->val);
+        msg = oidc_sprintf_scoped("Unknown flow '%s'",
+                                  (char*)current_flow->val);
       }
       ipc_writeToPipe(pipes, RESPONSE_ERROR, msg);
       secFree(msg);
@@ -206,18 +269,22 @@ oidc_error_t addAccount(struct ipcPipe pipes, struct oidc_account* account) {
   if (!strValid(account_getTokenEndpoint(account))) {
     return oidc_errno;
   }
-  if (getAccessTokenUsingRefreshFlow(account, FORCE_NEW_TOKEN, NULL, pipes) ==
+  http_dns_prefetch(account_getTokenEndpoint(account));
+  if (getAccessTokenUsingRefreshFlow(account, FORCE_NEW_TOKEN, NULL, pipes,
+                                     NULL) ==
       NULL) {
     return oidc_errno;
   }
   db_addAccountEncrypted(account);
+  account_touch(account);  // a fresh account is not the eviction victim
+  accountDB_enforceLimit(agent_state.maxAccounts);
   return OIDC_SUCCESS;
 }
 
-void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
+void oidcd_handleAdd(struct ipcPipe pipes, const cJSON* account_json,
                      const char* timeout_str, const char* confirm_str) {
-  logger(DEBUG, "Handle Add request");
-  struct oidc_account* account = getAccountFromJSON(account_json);
+  DEBUG_LOG("Handle Add request");
+  struct oidc_account* account = getAccountFromCJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
@@ -232,7 +299,8 @@ void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
   if ((found = db_getAccountDecrypted(account)) != NULL) {
     if (account_getDeath(found) != account_getDeath(account)) {
       account_setDeath(found, account_getDeath(account));
-      char* msg = oidc_sprintf(
+      accountDB_notifyDeathChange(found);  // the lifetime may have shrunk
+      char* msg = oidc_sprintf_scoped(
           "account already loaded. Lifetime set to %lu seconds.", timeout ?: 0);
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, msg);
       secFree(msg);
@@ -248,9 +316,9 @@ void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  logger(DEBUG, "Loaded Account. Used timeout of %lu", timeout);
+  DEBUG_LOG("Loaded Account. Used timeout of %lu", timeout);
   if (timeout > 0) {
-    char* msg = oidc_sprintf("Lifetime set to %lu seconds", timeout);
+    char* msg = oidc_sprintf_scoped("Lifetime set to %lu seconds", timeout);
     ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, msg);
     secFree(msg);
   } else {
@@ -258,9 +326,144 @@ void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
   }
 }
 
-void oidcd_handleDelete(struct ipcPipe pipes, const char* account_json) {
-  logger(DEBUG, "Handle Delete request");
-  struct oidc_account* account = getAccountFromJSON(account_json);
+// how many applied bulk load ids are remembered for replay detection
+#ifndef BULKADD_ID_HISTORY
+#define BULKADD_ID_HISTORY 16
+#endif
+
+static list_t* applied_bulk_ids = NULL;
+
+static unsigned char _bulkIdSeen(const char* bulk_id) {
+  return strValid(bulk_id) && applied_bulk_ids != NULL &&
+         findInList(applied_bulk_ids, bulk_id) != NULL;
+}
+
+static void _bulkIdRecord(const char* bulk_id) {
+  if (!strValid(bulk_id)) {
+    return;
+  }
+  if (applied_bulk_ids == NULL) {
+    applied_bulk_ids        = list_new();
+    applied_bulk_ids->free  = (void(*)(void*)) & _secFree;
+    applied_bulk_ids->match = (matchFunction)strequal;
+  }
+  list_rpush(applied_bulk_ids, list_node_new(oidc_strcopy(bulk_id)));
+  if (applied_bulk_ids->len > BULKADD_ID_HISTORY) {
+    list_remove(applied_bulk_ids, applied_bulk_ids->head);
+  }
+}
+
+/**
+ * @brief loads several accounts from one bulk load request
+ *
+ * Every entry carries the account short name, the (usually still
+ * encrypted) config blob and the password to decrypt it, so a
+ * provisioning run loads its whole account set in a single round trip
+ * instead of one handshake per account. The key derivations - the
+ * dominating cost - run on the parallel decrypt engine; the accounts are
+ * then added one by one and the response carries a per-entry status
+ * array. A request with a bulk id that was already applied is answered
+ * without redoing any work, so retried provisioning is idempotent.
+ */
+void oidcd_handleBulkAdd(struct ipcPipe pipes, const char* account_list_json,
+                         const char* bulk_id, const char* timeout_str) {
+  DEBUG_LOG("Handle bulk add request");
+  if (account_list_json == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST,
+                    "Required field '" IPC_KEY_ACCOUNTLIST "' not present.");
+    return;
+  }
+  cJSON* arr = stringToJson(account_list_json);
+  int    n   = arr != NULL ? cJSON_GetArraySize(arr) : 0;
+  if (n == 0) {
+    secFreeJson(arr);
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "Account list is empty.");
+    return;
+  }
+  unsigned char replay  = _bulkIdSeen(bulk_id);
+  cJSON*        results = cJSON_CreateArray();
+  if (replay) {
+    logger(DEBUG, "Bulk request '%s' was already applied; skipping", bulk_id);
+    for (int i = 0; i < n; i++) {
+      char*  name = getJSONValue(cJSON_GetArrayItem(arr, i), IPC_KEY_SHORTNAME);
+      cJSON* res  = stringToJson("{}");
+      jsonAddStringValue(res, IPC_KEY_SHORTNAME, name ?: "");
+      jsonAddStringValue(res, IPC_KEY_STATUS, STATUS_SUCCESS);
+      jsonAddStringValue(res, IPC_KEY_INFO,
+                         "already applied by an earlier bulk request");
+      cJSON_AddItemToArray(results, res);
+      secFree(name);
+    }
+  } else {
+    time_t timeout =
+        strValid(timeout_str) ? atol(timeout_str) : agent_state.defaultTimeout;
+    char** configs   = secAlloc(n * sizeof(char*));
+    char** passwords = secAlloc(n * sizeof(char*));
+    struct decryptFileJob* jobs = secAlloc(n * sizeof(struct decryptFileJob));
+    for (int i = 0; i < n; i++) {
+      cJSON* e     = cJSON_GetArrayItem(arr, i);
+      configs[i]   = getJSONValue(e, IPC_KEY_CONFIG);
+      passwords[i] = getJSONValue(e, IPC_KEY_PASSWORD);
+      if (configs[i] != NULL && !isJSONObject(configs[i])) {  // encrypted
+        jobs[i].content  = configs[i];
+        jobs[i].password = passwords[i];
+      }
+    }
+    decryptFilesParallel(jobs, n);
+    for (int i = 0; i < n; i++) {
+      char*  name = getJSONValue(cJSON_GetArrayItem(arr, i), IPC_KEY_SHORTNAME);
+      cJSON* res  = stringToJson("{}");
+      jsonAddStringValue(res, IPC_KEY_SHORTNAME, name ?: "");
+      // a plaintext config is used as carried; an encrypted one only if the
+      // decrypt engine could open it with the entry's password
+      char* json = jobs[i].result
+                       ?: (configs[i] != NULL && isJSONObject(configs[i])
+                               ? configs[i]
+                               : NULL);
+      struct oidc_account* account =
+          json != NULL ? getAccountFromJSON(json) : NULL;
+      if (account == NULL) {
+        jsonAddStringValue(res, IPC_KEY_STATUS, STATUS_FAILURE);
+        jsonAddStringValue(res, OIDC_KEY_ERROR,
+                           json == NULL ? "could not decrypt account config"
+                                        : oidc_serror());
+      } else {
+        account_setDeath(account, timeout ? time(NULL) + timeout : 0);
+        struct oidc_account* found = db_getAccountDecrypted(account);
+        if (found != NULL) {
+          jsonAddStringValue(res, IPC_KEY_STATUS, STATUS_SUCCESS);
+          jsonAddStringValue(res, IPC_KEY_INFO, "account already loaded");
+          db_addAccountEncrypted(found);  // reencrypting sensitive data
+          secFreeAccount(account);
+        } else if (addAccount(pipes, account) != OIDC_SUCCESS) {
+          jsonAddStringValue(res, IPC_KEY_STATUS, STATUS_FAILURE);
+          jsonAddStringValue(res, OIDC_KEY_ERROR, oidc_serror());
+          secFreeAccount(account);
+        } else {
+          jsonAddStringValue(res, IPC_KEY_STATUS, STATUS_SUCCESS);
+        }
+      }
+      cJSON_AddItemToArray(results, res);
+      secFree(name);
+      secFree(jobs[i].result);
+      secFree(configs[i]);
+      secFree(passwords[i]);
+    }
+    secFree(jobs);
+    secFree(configs);
+    secFree(passwords);
+    _bulkIdRecord(bulk_id);
+  }
+  secFreeJson(arr);
+  char* results_str = jsonToStringUnformatted(results);
+  secFreeJson(results);
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_ACCOUNTLIST, results_str);
+  secFree(results_str);
+}
+
+void oidcd_handleDelete(struct ipcPipe pipes, const cJSON* account_json) {
+  DEBUG_LOG("Handle Delete request");
+  struct oidc_account* account = getAccountFromCJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
@@ -272,12 +475,16 @@ void oidcd_handleDelete(struct ipcPipe pipes, const char* account_json) {
   }
   if (revokeToken(account) != OIDC_SUCCESS) {
     secFreeAccount(account);
-    char* error = oidc_sprintf("Could not revoke token: %s", oidc_serror());
+    char* error =
+        oidc_sprintf_scoped("Could not revoke token: %s", oidc_serror());
     ipc_writeToPipe(pipes, RESPONSE_ERROR, error);
     secFree(error);
     return;
   }
   accountDB_removeIfFound(account);
+  accountSnapshot_refresh();
+  oidcd_snapshot_writeSoon();  // the refresh token was just revoked; it must
+                               // not linger in the state snapshot
   secFreeAccount(account);
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
@@ -290,29 +497,37 @@ void oidcd_handleRm(struct ipcPipe pipes, char* account_name) {
         "removed.");
     return;
   }
-  logger(DEBUG, "Handle Remove request for config '%s'", account_name);
+  DEBUG_LOG("Handle Remove request for config '%s'", account_name);
   struct oidc_account key = {.shortname = account_name};
   if (accountDB_findValue(&key) == NULL) {
     ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
     return;
   }
   accountDB_removeIfFound(&key);
+  accountSnapshot_refresh();
+  tokenMirror_remove(account_name);
+  oidcd_snapshot_writeSoon();  // removed refresh tokens must not linger on
+                               // disk
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
 
 void oidcd_handleRemoveAll(struct ipcPipe pipes) {
   accountDB_reset();
+  accountSnapshot_refresh();
+  tokenMirror_clear();
+  oidcd_snapshot_writeSoon();  // removed refresh tokens must not linger on
+                               // disk
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
 
 oidc_error_t oidcd_autoload(struct ipcPipe pipes, char* short_name,
                             char* issuer, const char* application_hint) {
-  logger(DEBUG, "Send autoload request for '%s'", short_name);
+  DEBUG_LOG("Send autoload request for '%s'", short_name);
   char* res =
-      issuer ? ipc_communicateThroughPipe(
+      issuer ? oidcd_workers_communicate(
                    pipes, INT_REQUEST_AUTOLOAD_WITH_ISSUER, short_name, issuer,
                    application_hint ?: "")
-             : ipc_communicateThroughPipe(pipes, INT_REQUEST_AUTOLOAD,
+             : oidcd_workers_communicate(pipes, INT_REQUEST_AUTOLOAD,
                                           short_name, application_hint ?: "");
   if (res == NULL) {
     return oidc_errno;
@@ -335,12 +550,12 @@ oidc_error_t oidcd_autoload(struct ipcPipe pipes, char* short_name,
 oidc_error_t oidcd_getConfirmation(struct ipcPipe pipes, const char* short_name,
                                    const char* issuer,
                                    const char* application_hint) {
-  logger(DEBUG, "Send confirm request for '%s'", short_name);
+  DEBUG_LOG("Send confirm request for '%s'", short_name);
   char* res =
-      issuer ? ipc_communicateThroughPipe(
+      issuer ? oidcd_workers_communicate(
                    pipes, INT_REQUEST_CONFIRM_WITH_ISSUER, issuer, short_name,
                    application_hint ?: "")
-             : ipc_communicateThroughPipe(pipes, INT_REQUEST_CONFIRM,
+             : oidcd_workers_communicate(pipes, INT_REQUEST_CONFIRM,
                                           short_name, application_hint ?: "");
   if (res == NULL) {
     return oidc_errno;
@@ -351,9 +566,9 @@ oidc_error_t oidcd_getConfirmation(struct ipcPipe pipes, const char* short_name,
 
 char* oidcd_queryDefaultAccountIssuer(struct ipcPipe pipes,
                                       const char*    issuer) {
-  logger(DEBUG, "Send default account config query request for issuer '%s'",
-         issuer);
-  char* res = ipc_communicateThroughPipe(
+  DEBUG_LOG("Send default account config query request for issuer '%s'",
+            issuer);
+  char* res = oidcd_workers_communicate(
       pipes, INT_REQUEST_QUERY_ACCDEFAULT_ISSUER, issuer);
   if (res == NULL) {
     return NULL;
@@ -367,12 +582,64 @@ char* oidcd_queryDefaultAccountIssuer(struct ipcPipe pipes,
   return shortname;
 }
 
+// how long before expiry the agent suggests a caching client should come
+// back; by then the proactive refresh usually already obtained the
+// successor token
+#ifndef AGENT_RATEHINT_MARGIN
+#define AGENT_RATEHINT_MARGIN 60
+#endif
+
+// the rate hint attached to a stale (issuer-unreachable) response; the
+// revalidation usually brings a fresh token within seconds, so the client
+// should come back much sooner than the expiry would suggest
+#ifndef AGENT_STALE_RETRY_HINT
+#define AGENT_STALE_RETRY_HINT 30
+#endif
+
+/**
+ * @brief writes a successful access token response including rate hints
+ *
+ * Besides the token itself the response carries the remaining validity and
+ * a suggested next-request time. A caching client (e.g. liboidc-agent's
+ * token cache) serves from its cache until that time instead of asking the
+ * agent again - thousands of over-eager callers then cost one ipc round
+ * trip per hint window instead of one per call. For tokens without a known
+ * expiration time the hint is the only cacheability information there is,
+ * so it is kept short.
+ *
+ * A token served in degraded mode because its issuer was unreachable is
+ * flagged with @c "stale":true and carries a short retry hint instead of
+ * the expiry based one.
+ */
+static void _writeAccessTokenResponse(struct ipcPipe pipes,
+                                      const char*    access_token,
+                                      const char* issuer, time_t expires_at,
+                                      unsigned char stale) {
+  time_t now       = time(NULL);
+  time_t valid_for = expires_at > now ? expires_at - now : 0;
+  time_t next_request_at;
+  if (stale) {  // retry soon; the background revalidation is already running
+    next_request_at = now + AGENT_STALE_RETRY_HINT;
+  } else if (expires_at ==
+             0) {  // expiry unknown; suggest a short recheck interval
+    next_request_at = now + AGENT_RATEHINT_MARGIN;
+  } else if (valid_for > AGENT_RATEHINT_MARGIN) {
+    next_request_at = expires_at - AGENT_RATEHINT_MARGIN;
+  } else {  // about to expire; no point in caching it
+    next_request_at = 0;
+  }
+  ipc_writeToPipe(pipes,
+                  stale ? RESPONSE_STATUS_ACCESS_STALE : RESPONSE_STATUS_ACCESS,
+                  STATUS_SUCCESS, access_token, issuer, expires_at, valid_for,
+                  next_request_at);
+}
+
 void oidcd_handleTokenIssuer(struct ipcPipe pipes, char* issuer,
                              const char* min_valid_period_str,
                              const char* scope, const char* application_hint,
                              const struct arguments* arguments) {
-  logger(DEBUG, "Handle Token request from '%s' for issuer '%s'",
-         application_hint, issuer);
+  DEBUG_LOG("Handle Token request from '%s' for issuer '%s'", application_hint,
+            issuer);
   time_t min_valid_period =
       min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
   struct oidc_account* account  = NULL;
@@ -431,39 +698,53 @@ void oidcd_handleTokenIssuer(struct ipcPipe pipes, char* issuer,
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  char* access_token =
-      getAccessTokenUsingRefreshFlow(account, min_valid_period, scope, pipes);
+  if (strValid(scope) && account_scopeSetEquals(account, scope)) {
+    scope = NULL;  // equal to the account's scope set; see _oidcd_obtainToken
+  }
+  unsigned char stale = 0;
+  char*         access_token = getAccessTokenUsingRefreshFlow(
+      account, min_valid_period, scope, pipes, &stale);
   db_addAccountEncrypted(account);  // reencrypting
   if (access_token == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, access_token,
-                  account_getIssuerUrl(account),
-                  account_getTokenExpiresAt(account));
+  if (stale) {
+    oidcd_refresh_revalidateSoon(account_getName(account));
+  }
+  _writeAccessTokenResponse(pipes, access_token, account_getIssuerUrl(account),
+                            account_getTokenExpiresAt(account), stale);
   if (strValid(scope)) {
     secFree(access_token);
   }
 }
 
-void oidcd_handleToken(struct ipcPipe pipes, char* short_name,
-                       const char* min_valid_period_str, const char* scope,
-                       const char*             application_hint,
-                       const struct arguments* arguments) {
-  logger(DEBUG, "Handle Token request from %s", application_hint);
-  if (short_name == NULL) {
-    ipc_writeToPipe(pipes, RESPONSE_ERROR,
-                    "Bad request. Required field '" IPC_KEY_SHORTNAME
-                    "' not present.");
-    return;
-  }
-  time_t min_valid_period =
-      min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
+/**
+ * @brief obtains a valid access token for @p short_name
+ * Loads the account if needed (autoloading unless disabled), asks for
+ * confirmation where required and runs the refresh flow.
+ * @param token_out filled with a view of the access token; borrowed from the
+ * account unless @p scope is set
+ * @param token_owned_out filled with the token allocation owned by the caller
+ * when @p scope is set, @c NULL otherwise. Has to be freed after usage.
+ * @param issuer_out filled with the issuer url; borrowed from the account
+ * @param expires_at_out filled with the token expiration time
+ * @param stale_out set if the token was served in degraded mode because the
+ * issuer was unreachable; a revalidation is then already scheduled
+ * @return @c OIDC_SUCCESS with the out parameters filled; an oidc_error code
+ * otherwise and @c oidc_errno is set.
+ */
+static oidc_error_t _oidcd_obtainToken(
+    struct ipcPipe pipes, char* short_name, time_t min_valid_period,
+    const char* scope, const char* application_hint,
+    const struct arguments* arguments, const char** token_out,
+    char** token_owned_out, const char** issuer_out, time_t* expires_at_out,
+    unsigned char* stale_out) {
   struct oidc_account* account = db_getAccountDecryptedByShortname(short_name);
   if (account == NULL) {
     if (arguments->no_autoload) {
-      ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
-      return;
+      oidc_seterror(ACCOUNT_NOT_LOADED);
+      return oidc_errno = OIDC_EERROR;
     }
     oidc_error_t autoload_error =
         oidcd_autoload(pipes, short_name, NULL, application_hint);
@@ -472,45 +753,207 @@ void oidcd_handleToken(struct ipcPipe pipes, char* short_name,
         account = db_getAccountDecryptedByShortname(short_name);
         break;
       case OIDC_EUSRPWCNCL:
-        ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
-        return;
-      default: ipc_writeOidcErrnoToPipe(pipes); return;
+        oidc_seterror(ACCOUNT_NOT_LOADED);
+        return oidc_errno = OIDC_EERROR;
+      default: return oidc_errno;
     }
   } else if (arguments->confirm || account_getConfirmationRequired(account)) {
     if (oidcd_getConfirmation(pipes, short_name, NULL, application_hint) !=
         OIDC_SUCCESS) {
       db_addAccountEncrypted(account);  // reencrypting
-      ipc_writeOidcErrnoToPipe(pipes);
-      return;
+      return oidc_errno;
     }
   }
-  char* access_token =
-      getAccessTokenUsingRefreshFlow(account, min_valid_period, scope, pipes);
+  if (strValid(scope) && account_scopeSetEquals(account, scope)) {
+    // the request names exactly the account's scope set; the account's own
+    // token already carries these scopes, so the unscoped fast path (and
+    // its validity window check) applies
+    scope = NULL;
+  }
+  char* access_token = getAccessTokenUsingRefreshFlow(
+      account, min_valid_period, scope, pipes, stale_out);
   db_addAccountEncrypted(account);  // reencrypting
   if (access_token == NULL) {
+    return oidc_errno;
+  }
+  if (*stale_out) {
+    oidcd_refresh_revalidateSoon(short_name);
+  }
+  // a scoped token is minted outside the account and handed to the caller;
+  // otherwise the account keeps the token and the caller only borrows the
+  // view - access tokens are not memory encrypted, so it stays valid after
+  // the reencrypting db_addAccountEncrypted above
+  *token_out       = access_token;
+  *token_owned_out = strValid(scope) ? access_token : NULL;
+  *issuer_out      = account_getIssuerUrl(account);
+  *expires_at_out  = account_getTokenExpiresAt(account);
+  tokenMirror_update(short_name, *token_out, *issuer_out, scope,
+                     *expires_at_out);  // no-op unless mirroring is enabled
+  return OIDC_SUCCESS;
+}
+
+static void _oidcd_handleTokenFlight(struct ipcPipe pipes, char* short_name,
+                                     const char* min_valid_period_str,
+                                     const char* scope,
+                                     const char* application_hint,
+                                     const struct arguments* arguments) {
+  time_t min_valid_period =
+      min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
+  const char*   access_token = NULL;
+  char*         owned_token  = NULL;
+  const char*   issuer       = NULL;
+  time_t        expires_at   = 0;
+  unsigned char stale        = 0;
+  if (_oidcd_obtainToken(pipes, short_name, min_valid_period, scope,
+                         application_hint, arguments, &access_token,
+                         &owned_token, &issuer, &expires_at,
+                         &stale) != OIDC_SUCCESS) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, access_token,
-                  account_getIssuerUrl(account),
-                  account_getTokenExpiresAt(account));
-  if (strValid(scope)) {
-    secFree(access_token);
+  _writeAccessTokenResponse(pipes, access_token, issuer, expires_at, stale);
+  secFree(owned_token);
+}
+
+void oidcd_handleToken(struct ipcPipe pipes, char* short_name,
+                       const char* min_valid_period_str, const char* scope,
+                       const char*             application_hint,
+                       const struct arguments* arguments) {
+  DEBUG_LOG("Handle Token request from %s", application_hint);
+  if (short_name == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "Bad request. Required field '" IPC_KEY_SHORTNAME
+                    "' not present.");
+    return;
   }
+  // Concurrent requests for the same account coalesce into a single
+  // in-flight refresh: followers wait here and then hit the validity window
+  // check with the token the leader just obtained.
+  singleflight_enter(short_name);
+  _oidcd_handleTokenFlight(pipes, short_name, min_valid_period_str, scope,
+                           application_hint, arguments);
+  singleflight_leave(short_name);
 }
 
-void oidcd_handleRegister(struct ipcPipe pipes, const char* account_json,
+/**
+ * @brief renews the access token of a loaded account in the background
+ *
+ * Runs on the worker pool for the proactive refresh scheduler; no client is
+ * waiting, so nothing is written back for the triggering request and
+ * failures are only logged. A background refresh must never create user
+ * interaction: accounts that are not loaded (autoload would prompt) or
+ * require confirmation are skipped and left to on-demand refresh.
+ */
+void oidcd_handleBackgroundRefresh(struct ipcPipe          pipes,
+                                   const char*             short_name,
+                                   time_t                  min_valid_period,
+                                   const struct arguments* arguments) {
+  singleflight_enter(short_name);
+  struct oidc_account* account = db_getAccountDecryptedByShortname(short_name);
+  if (account == NULL) {
+    singleflight_leave(short_name);
+    return;
+  }
+  if (arguments->confirm || account_getConfirmationRequired(account)) {
+    db_addAccountEncrypted(account);  // reencrypting
+    singleflight_leave(short_name);
+    return;
+  }
+  // no degraded fallback here: a background refresh exists to probe the
+  // issuer, so a failure has to surface for the retry backoff
+  char* access_token =
+      getAccessTokenUsingRefreshFlow(account, min_valid_period, NULL, pipes,
+                                     NULL);
+  db_addAccountEncrypted(account);  // reencrypting
+  if (access_token == NULL) {
+    logger(NOTICE, "Background refresh for account '%s' failed: %s",
+           short_name, oidc_serror());
+  } else {
+    // without an explicit scope the token is owned by the account
+    tokenMirror_update(short_name, access_token,
+                       account_getIssuerUrl(account), NULL,
+                       account_getTokenExpiresAt(account));
+    DEBUG_LOG("Background refresh for account '%s' done", short_name);
+  }
+  singleflight_leave(short_name);
+}
+
+/**
+ * @brief serves one access token request for several accounts at once
+ * One response carries a json array with one entry per requested account:
+ * the token, issuer and expiration time on success or an error message for
+ * that account. Cached-valid tokens are returned directly; stale ones go
+ * through the refresh flow. The accounts are processed one after another -
+ * internal round trips (autoload, confirmation) are routed by the client
+ * request id, so per-account parallelism within one request would cross the
+ * responses.
+ * @param account_list_json a json array of account short names
+ */
+void oidcd_handleTokenBatch(struct ipcPipe pipes, const char* account_list_json,
+                            const char* min_valid_period_str, const char* scope,
+                            const char*             application_hint,
+                            const struct arguments* arguments) {
+  DEBUG_LOG("Handle Token batch request from %s", application_hint);
+  list_t* names = JSONArrayStringToList(account_list_json);
+  if (names == NULL || names->len == 0) {
+    secFreeList(names);
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "Bad request. Required field '" IPC_KEY_ACCOUNTLIST
+                    "' empty or malformed.");
+    return;
+  }
+  time_t min_valid_period =
+      min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
+  cJSON*           tokens = stringToJson("[]");
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(names, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    char*         short_name   = node->val;
+    const char*   access_token = NULL;
+    char*         owned_token  = NULL;
+    const char*   issuer       = NULL;
+    time_t        expires_at   = 0;
+    unsigned char stale        = 0;
+    singleflight_enter(short_name);
+    oidc_error_t err = _oidcd_obtainToken(
+        pipes, short_name, min_valid_period, scope, application_hint,
+        arguments, &access_token, &owned_token, &issuer, &expires_at, &stale);
+    singleflight_leave(short_name);
+    cJSON* entry = stringToJson("{}");
+    jsonAddStringValue(entry, IPC_KEY_SHORTNAME, short_name);
+    if (err == OIDC_SUCCESS) {
+      jsonAddStringValue(entry, OIDC_KEY_ACCESSTOKEN, access_token);
+      jsonAddStringValue(entry, OIDC_KEY_ISSUER, issuer);
+      jsonAddNumberValue(entry, AGENT_KEY_EXPIRESAT, expires_at);
+      if (stale) {
+        cJSON_AddTrueToObject(entry, AGENT_KEY_STALE);
+      }
+    } else {
+      jsonAddStringValue(entry, OIDC_KEY_ERROR, oidc_serror());
+    }
+    secFree(owned_token);
+    cJSON_AddItemToArray(tokens, entry);
+  }
+  list_iterator_destroy(it);
+  secFreeList(names);
+  char* tokens_str = jsonToStringUnformatted(tokens);
+  secFreeJson(tokens);
+  ipc_writeToPipe(pipes, RESPONSE_STATUS_TOKENS, STATUS_SUCCESS, tokens_str);
+  secFree(tokens_str);
+}
+
+void oidcd_handleRegister(struct ipcPipe pipes, const cJSON* account_json,
                           const char* flows_json_str,
                           const char* access_token) {
-  logger(DEBUG, "Handle Register request for flows: '%s'", flows_json_str);
-  struct oidc_account* account = getAccountFromJSON(account_json);
+  DEBUG_LOG("Handle Register request for flows: '%s'", flows_json_str);
+  struct oidc_account* account = getAccountFromCJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  logger(DEBUG, "daeSetByUser is: %d",
-         issuer_getDeviceAuthorizationEndpointIsSetByUser(
-             account_getIssuer(account)));
+  DEBUG_LOG("daeSetByUser is: %d",
+            issuer_getDeviceAuthorizationEndpointIsSetByUser(
+                account_getIssuer(account)));
   if (NULL != accountDB_findValue(account)) {
     secFreeAccount(account);
     ipc_writeToPipe(
@@ -524,9 +967,9 @@ void oidcd_handleRegister(struct ipcPipe pipes, const char* account_json,
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  logger(DEBUG, "daeSetByUser is: %d",
-         issuer_getDeviceAuthorizationEndpointIsSetByUser(
-             account_getIssuer(account)));
+  DEBUG_LOG("daeSetByUser is: %d",
+            issuer_getDeviceAuthorizationEndpointIsSetByUser(
+                account_getIssuer(account)));
   list_t* flows = JSONArrayStringToList(flows_json_str);
   if (flows == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
@@ -594,8 +1037,8 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     return;
   }
   int fromGen = strToInt(fromString);
-  logger(DEBUG, "Handle codeExchange request for redirect_uri '%s' from %s",
-         redirected_uri, fromGen ? "oidc-gen" : "other (httpserver)");
+  DEBUG_LOG("Handle codeExchange request for redirect_uri '%s' from %s",
+            redirected_uri, fromGen ? "oidc-gen" : "other (httpserver)");
   struct codeState codeState    = codeStateFromURI(redirected_uri);
   char*            redirect_uri = codeState.uri;
   char*            state        = codeState.state;
@@ -606,7 +1049,7 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     return;
   }
   struct codeExchangeEntry key = {.state = state};
-  logger(DEBUG, "Getting code_verifier and account info for state '%s'", state);
+  DEBUG_LOG("Getting code_verifier and account info for state '%s'", state);
   struct codeExchangeEntry* cee = codeVerifierDB_findValue(&key);
   if (cee == NULL) {
     oidc_errno = OIDC_EWRONGSTATE;
@@ -642,6 +1085,7 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     // codeVerifierDB_removeIfFound(cee);
     return;
   }
+  agent_metrics_flowStage(state, "codeflow_exchange");
   if (account_refreshTokenIsValid(account)) {
     char* json = accountToJSONString(account);
     ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
@@ -655,23 +1099,127 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     }
     account_setUsedState(account, cee->state);
     codeVerifierDB_removeIfFound(cee);
+    oidcd_stateWaiters_notify(account_getUsedState(account));
   } else {
     ipc_writeToPipe(pipes, RESPONSE_ERROR, "Could not get a refresh token");
     secFreeCodeState(codeState);
+    oidcd_stateWaiters_notify(cee->state);  // unblocks with NotFound
+    agent_metrics_flowEnd(cee->state);
     secFreeCodeExchangeContent(cee);
     codeVerifierDB_removeIfFound(cee);
   }
 }
 
-void oidcd_handleDeviceLookup(struct ipcPipe pipes, const char* account_json,
-                              const char* device_json) {
-  logger(DEBUG, "Handle deviceLookup request");
-  struct oidc_account* account = getAccountFromJSON(account_json);
+struct device_poll {
+  struct ipcPipe           pipes;
+  struct oidc_account*     account;
+  struct oidc_device_code* dc;
+};
+
+/*
+ * Registry of pending device authorizations, keyed by device_code. Each
+ * pending authorization is owned by its poll thread, so the registry only
+ * has to answer "is this code already being polled" - a repeated lookup for
+ * the same device_code is rejected instead of starting a duplicate poll
+ * against the provider. Entries leave with their thread: on success, on a
+ * provider error and when the code expires.
+ */
+static list_t*         pending_device_codes = NULL;
+static pthread_mutex_t device_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief registers @p device_code as pending
+ * @return @c 1 if it was registered, @c 0 if it is already pending
+ */
+static int _deviceRegistryAdd(const char* device_code) {
+  pthread_mutex_lock(&device_registry_lock);
+  if (pending_device_codes == NULL) {
+    pending_device_codes        = list_new();
+    pending_device_codes->free  = (void (*)(void*)) & _secFree;
+    pending_device_codes->match = (matchFunction)strequal;
+  }
+  if (findInList(pending_device_codes, device_code) != NULL) {
+    pthread_mutex_unlock(&device_registry_lock);
+    return 0;
+  }
+  list_rpush(pending_device_codes, list_node_new(oidc_strcopy(device_code)));
+  pthread_mutex_unlock(&device_registry_lock);
+  return 1;
+}
+
+static void _deviceRegistryRemove(const char* device_code) {
+  pthread_mutex_lock(&device_registry_lock);
+  list_node_t* node = findInList(pending_device_codes, device_code);
+  if (node != NULL) {
+    list_remove(pending_device_codes, node);
+  }
+  pthread_mutex_unlock(&device_registry_lock);
+}
+
+/**
+ * @brief polls the token endpoint until the device authorization completes
+ *
+ * Runs detached from the main loop, sleeping between lookups and honoring
+ * the server's interval and slow_down, and pushes the final response to the
+ * waiting client - neither the client nor the daemon busy-waits on the user
+ * approving the authorization.
+ */
+static void* _devicePollThread(void* p) {
+  oidcd_workers_adoptThread();  // pipe round trips go through the main loop
+  struct device_poll*      poll    = p;
+  struct ipcPipe           pipes   = poll->pipes;
+  struct oidc_account*     account = poll->account;
+  struct oidc_device_code* dc      = poll->dc;
+  secFree(poll);
+  size_t interval   = oidc_device_getInterval(*dc) ?: 5;
+  size_t expires_in = oidc_device_getExpiresIn(*dc);
+  time_t expires_at = time(NULL) + expires_in;
+  while (expires_in ? expires_at > time(NULL) : 1) {
+    sleep(interval);
+    if (getAccessTokenUsingDeviceFlow(account, oidc_device_getDeviceCode(*dc),
+                                      pipes) == OIDC_SUCCESS) {
+      _deviceRegistryRemove(oidc_device_getDeviceCode(*dc));
+      secFreeDeviceCode(dc);
+      if (account_refreshTokenIsValid(account)) {
+        char* json = accountToJSONString(account);
+        ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
+        secFree(json);
+        db_addAccountEncrypted(account);
+      } else {
+        ipc_writeToPipe(pipes, RESPONSE_ERROR, "Could not get a refresh token");
+        secFreeAccount(account);
+      }
+      return NULL;
+    }
+    if (strequal(oidc_serror(), OIDC_AUTHORIZATION_PENDING)) {
+      continue;
+    }
+    if (strequal(oidc_serror(), OIDC_SLOW_DOWN)) {
+      interval++;
+      continue;
+    }
+    ipc_writeOidcErrnoToPipe(pipes);
+    secFreeAccount(account);
+    _deviceRegistryRemove(oidc_device_getDeviceCode(*dc));
+    secFreeDeviceCode(dc);
+    return NULL;
+  }
+  ipc_writeToPipe(pipes, RESPONSE_ERROR, "Device code is not valid any more");
+  secFreeAccount(account);
+  _deviceRegistryRemove(oidc_device_getDeviceCode(*dc));
+  secFreeDeviceCode(dc);
+  return NULL;
+}
+
+void oidcd_handleDeviceLookup(struct ipcPipe pipes, const cJSON* account_json,
+                              const cJSON* device_json) {
+  DEBUG_LOG("Handle deviceLookup request");
+  struct oidc_account* account = getAccountFromCJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  struct oidc_device_code* dc = getDeviceCodeFromJSON(device_json);
+  struct oidc_device_code* dc = getDeviceCodeFromCJSON(device_json);
   if (dc == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     secFreeAccount(account);
@@ -683,35 +1231,104 @@ void oidcd_handleDeviceLookup(struct ipcPipe pipes, const char* account_json,
     secFreeDeviceCode(dc);
     return;
   }
-  if (getAccessTokenUsingDeviceFlow(account, oidc_device_getDeviceCode(*dc),
-                                    pipes) != OIDC_SUCCESS) {
+  if (!_deviceRegistryAdd(oidc_device_getDeviceCode(*dc))) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "A device flow for this device code is already pending");
     secFreeAccount(account);
     secFreeDeviceCode(dc);
-    ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  secFreeDeviceCode(dc);
-  if (account_refreshTokenIsValid(account)) {
-    char* json = accountToJSONString(account);
-    ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
-    secFree(json);
-    db_addAccountEncrypted(account);
-  } else {
-    ipc_writeToPipe(pipes, RESPONSE_ERROR, "Could not get a refresh token");
+  struct device_poll* poll = secAlloc(sizeof(struct device_poll));
+  poll->pipes              = pipes;
+  poll->account            = account;
+  poll->dc                 = dc;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _devicePollThread, poll) != 0) {
+    logger(ERROR, "could not create device poll thread: %m");
+    secFree(poll);
     secFreeAccount(account);
+    _deviceRegistryRemove(oidc_device_getDeviceCode(*dc));
+    secFreeDeviceCode(dc);
+    oidc_errno = OIDC_EERROR;
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  pthread_detach(thread);
+  // the poll thread pushes the final response to the waiting client
+}
+
+/**
+ * An oidc-gen that asked to be notified instead of polling. The response is
+ * pushed over the stored pipes the moment the code exchange for the state
+ * settles.
+ */
+struct state_waiter {
+  char*          state;
+  struct ipcPipe pipes;
+};
+
+static list_t* state_waiters = NULL;
+
+static void _secFreeStateWaiter(struct state_waiter* w) {
+  secFree(w->state);
+  secFree(w);
+}
+
+static int _matchStateWaiter(const char* state, struct state_waiter* w) {
+  return strequal(w->state, state);
+}
+
+static void _parkStateWaiter(struct ipcPipe pipes, const char* state) {
+  if (state_waiters == NULL) {
+    state_waiters        = list_new();
+    state_waiters->free  = (void (*)(void*)) & _secFreeStateWaiter;
+    state_waiters->match = (matchFunction)_matchStateWaiter;
   }
+  struct state_waiter* waiter = secAlloc(sizeof(struct state_waiter));
+  waiter->state               = oidc_strcopy(state);
+  waiter->pipes               = pipes;
+  list_rpush(state_waiters, list_node_new(waiter));
+  DEBUG_LOG("Parked state lookup for state '%s'", state);
+}
+
+/**
+ * @brief drops the parked state lookup of a disconnected client
+ * Called for the cancel message oidcp sends when the waiting oidc-gen goes
+ * away; @p id is the request id the lookup was forwarded with.
+ */
+void oidcd_stateWaiters_cancel(unsigned long id) {
+  if (state_waiters == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(state_waiters, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (((struct state_waiter*)node->val)->pipes.id == id) {
+      list_remove(state_waiters, node);
+    }
+  }
+  list_iterator_destroy(it);
 }
 
-void oidcd_handleStateLookUp(struct ipcPipe pipes, char* state) {
-  logger(DEBUG, "Handle stateLookUp request");
+void oidcd_handleStateLookUp(struct ipcPipe pipes, char* state, int wait) {
+  DEBUG_LOG("Handle stateLookUp request");
   struct oidc_account key = {.usedState = state};
   matchFunction       oldMatch =
       accountDB_setMatchFunction((matchFunction)account_matchByState);
   struct oidc_account* account = db_getAccountDecrypted(&key);
   accountDB_setMatchFunction(oldMatch);
   if (account == NULL) {
+    if (wait) {
+      struct codeExchangeEntry cee_key = {.state = state};
+      if (codeVerifierDB_findValue(&cee_key) != NULL) {
+        // the flow is still pending; the response is pushed when the code
+        // exchange settles instead of making the client poll
+        _parkStateWaiter(pipes, state);
+        return;
+      }
+    }
     char* info =
-        oidc_sprintf("No loaded account info found for state=%s", state);
+        oidc_sprintf_scoped("No loaded account info found for state=%s", state);
     ipc_writeToPipe(pipes, RESPONSE_STATUS_INFO, STATUS_NOTFOUND, info);
     secFree(info);
     return;
@@ -726,10 +1343,30 @@ void oidcd_handleStateLookUp(struct ipcPipe pipes, char* state) {
   char* config              = accountToJSONString(account);
   ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, config);
   secFree(config);
+  agent_metrics_flowStage(state, "codeflow_delivery");
+  agent_metrics_flowEnd(state);
   db_addAccountEncrypted(account);  // reencrypting
   termHttpServer(state);
 }
 
+/**
+ * @brief answers the parked state lookups for @p state
+ * Called when the code exchange for @p state settles - or its flow dies -
+ * so waiting clients learn the outcome the moment it is known. The first
+ * waiter receives the config; later ones get the usual FoundButReceived.
+ */
+void oidcd_stateWaiters_notify(const char* state) {
+  if (state_waiters == NULL || state == NULL) {
+    return;
+  }
+  list_node_t* node;
+  while ((node = findInList(state_waiters, (char*)state)) != NULL) {
+    struct ipcPipe pipes = ((struct state_waiter*)node->val)->pipes;
+    list_remove(state_waiters, node);
+    oidcd_handleStateLookUp(pipes, (char*)state, 0);
+  }
+}
+
 void oidcd_handleTermHttp(struct ipcPipe pipes, const char* state) {
   termHttpServer(state);
   ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
@@ -738,6 +1375,7 @@ void oidcd_handleTermHttp(struct ipcPipe pipes, const char* state) {
 void oidcd_handleLock(struct ipcPipe pipes, const char* password, int _lock) {
   if (_lock) {
     if (lock(password) == OIDC_SUCCESS) {
+      tokenMirror_clear();  // a locked agent must not serve tokens
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, "Agent locked");
       return;
     }
@@ -755,7 +1393,7 @@ void oidcd_handleScopes(struct ipcPipe pipes, const char* issuer_url) {
     ipc_writeToPipe(pipes, RESPONSE_ERROR, "Bad Request: issuer url not given");
     return;
   }
-  logger(DEBUG, "Handle scope lookup request for %s", issuer_url);
+  DEBUG_LOG("Handle scope lookup request for %s", issuer_url);
   char* scopes = getScopesSupportedFor(issuer_url);
   if (scopes == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
@@ -764,3 +1402,152 @@ void oidcd_handleScopes(struct ipcPipe pipes, const char* issuer_url) {
   ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, scopes);
   secFree(scopes);
 }
+
+void oidcd_handlePrefetch(struct ipcPipe pipes, const char* issuer_url) {
+  if (issuer_url == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR, "Bad Request: issuer url not given");
+    return;
+  }
+  DEBUG_LOG("Handle config prefetch request for %s", issuer_url);
+  char* configuration_endpoint = oidc_strcat(issuer_url, CONF_ENDPOINT_SUFFIX);
+  // the fetch runs in the background; the client only pays the ipc round
+  // trip and the document is cached by the time it is actually needed
+  discoveryCache_prefetch(issuer_url, configuration_endpoint, NULL);
+  secFree(configuration_endpoint);
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
+}
+
+void oidcd_handleAccountList(struct ipcPipe pipes) {
+  DEBUG_LOG("Handle account list request");
+  char* names = accountSnapshot_nameListJSON();  // never touches the
+                                                 // secret-bearing account db
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_ACCOUNTLIST, names);
+  secFree(names);
+}
+
+void oidcd_handleAccountConfig(struct ipcPipe pipes, const char* short_name) {
+  if (short_name == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST,
+                    "Have to provide shortname of the account config.");
+    return;
+  }
+  DEBUG_LOG("Handle account config request for '%s'", short_name);
+  struct oidc_account  key     = {.shortname = (char*)short_name};
+  struct oidc_account* account = accountDB_findValue(&key);
+  if (account == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
+    return;
+  }
+  cJSON* json = accountToJSONWithoutCredentials(account);
+  setJSONValue(json, OIDC_KEY_REFRESHTOKEN,
+               "");  // the caller is about to replace it; the current refresh
+                     // token does not leave the agent
+  char* config = jsonToString(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, config);
+  secFree(config);
+}
+
+void oidcd_handleStoreInfo(struct ipcPipe pipes) {
+  DEBUG_LOG("Handle storeinfo request");
+  char* info = db_storeInfoToJSON();  // only covers the stores of this
+                                      // process; the connection and password
+                                      // dbs live in oidcp
+  if (info == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_STOREINFO, info);
+  secFree(info);
+}
+
+/**
+ * @brief applies new runtime settings to the running agent
+ *
+ * Only the values present in the request change; everything is validated
+ * before anything is applied so the reload is all-or-nothing. Loaded
+ * accounts and client connections are untouched. Settings tied to process
+ * setup (group, seccomp, webserver) cannot be changed at runtime.
+ */
+void oidcd_handleReload(struct ipcPipe pipes, struct arguments* arguments,
+                        const char* lifetime_str,
+                        const char* max_accounts_str, const char* confirm_str) {
+  DEBUG_LOG("Handle Reload request");
+  if ((lifetime_str != NULL && !isdigit(*lifetime_str)) ||
+      (max_accounts_str != NULL && !isdigit(*max_accounts_str)) ||
+      (confirm_str != NULL && !isdigit(*confirm_str))) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST,
+                    "Reload values have to be numeric.");
+    return;
+  }
+  if (lifetime_str != NULL) {
+    arguments->lifetime        = strToInt(lifetime_str);
+    agent_state.defaultTimeout = arguments->lifetime;
+    logger(NOTICE, "Reload: default lifetime is now %lu",
+           (unsigned long)agent_state.defaultTimeout);
+  }
+  if (confirm_str != NULL) {
+    arguments->confirm = strToInt(confirm_str) != 0;
+    logger(NOTICE, "Reload: confirmation requirement is now %s",
+           arguments->confirm ? "on" : "off");
+  }
+  if (max_accounts_str != NULL) {
+    arguments->max_accounts = strToULong(max_accounts_str);
+    agent_state.maxAccounts = arguments->max_accounts;
+    accountDB_enforceLimit(agent_state.maxAccounts);  // a lowered limit
+                                                      // evicts right away
+    accountSnapshot_refresh();
+    logger(NOTICE, "Reload: account limit is now %lu",
+           agent_state.maxAccounts);
+  }
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, "Configuration reloaded");
+}
+
+void oidcd_handleMetrics(struct ipcPipe pipes) {
+  DEBUG_LOG("Handle metrics request");
+  char* metrics = http_metrics_toJSON();
+  if (metrics == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  cJSON* obj = stringToJson(metrics);
+  secFree(metrics);
+  if (obj == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  jsonAddNumberValue(obj, "accounts_loaded", accountDB_getSize());
+  jsonAddNumberValue(obj, "accounts_max", agent_state.maxAccounts);
+  char* usage = accountSnapshot_usageJSON();
+  jsonAddArrayValue(obj, "account_usage", usage);
+  secFree(usage);
+  char* file_io = file_io_metrics_toJSON();
+  if (file_io != NULL) {  // only collected with OIDC_AGENT_IO_TRACE set
+    jsonAddObjectValue(obj, "file_io", file_io);
+    secFree(file_io);
+  }
+  char* webservers = httpserver_statusToJSON();
+  if (webservers != NULL) {  // pending auth code flows with their ages
+    jsonAddArrayValue(obj, "webservers", webservers);
+    secFree(webservers);
+  }
+  char* agent = agent_metrics_toJSON();
+  if (agent != NULL) {  // per request type: count, time, latency histogram
+    jsonAddObjectValue(obj, "agent", agent);
+    secFree(agent);
+  }
+  char* alloc_sites = allocAccounting_toJSON();
+  if (alloc_sites != NULL) {  // only collected when built with
+                              // ALLOC_ACCOUNTING
+    jsonAddArrayValue(obj, "alloc_sites", alloc_sites);
+    secFree(alloc_sites);
+  }
+  char* res = jsonToString(obj);
+  secFreeJson(obj);
+  if (res == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  ipc_writeToPipe(pipes, RESPONSE_STATUS_METRICS, res);
+  secFree(res);
+}
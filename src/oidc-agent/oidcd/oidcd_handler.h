@@ -5,13 +5,17 @@
 #include "ipc/pipe.h"
 #include "oidc-agent/oidc-agent_options.h"
 
-void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
+oidc_error_t addAccount(struct ipcPipe pipes, struct oidc_account* account);
+
+void oidcd_handleGen(struct ipcPipe pipes, const cJSON* account_json,
                      const char* flow, const char* nowebserver_str,
                      const char*             noscheme_str,
                      const struct arguments* arguments);
-void oidcd_handleAdd(struct ipcPipe, const char* account_json,
+void oidcd_handleAdd(struct ipcPipe, const cJSON* account_json,
                      const char* timeout_str, const char* confirm_str);
-void oidcd_handleDelete(struct ipcPipe, const char* account_json);
+void oidcd_handleBulkAdd(struct ipcPipe, const char* account_list_json,
+                         const char* bulk_id, const char* timeout_str);
+void oidcd_handleDelete(struct ipcPipe, const cJSON* account_json);
 void oidcd_handleRm(struct ipcPipe, char* account_name);
 void oidcd_handleRemoveAll(struct ipcPipe);
 void oidcd_handleToken(struct ipcPipe, char* short_name,
@@ -21,15 +25,34 @@ void oidcd_handleTokenIssuer(struct ipcPipe pipes, char* issuer,
                              const char* min_valid_period_str,
                              const char* scope, const char* application_hint,
                              const struct arguments* arguments);
-void oidcd_handleRegister(struct ipcPipe, const char* account_json,
+void oidcd_handleTokenBatch(struct ipcPipe          pipes,
+                            const char*             account_list_json,
+                            const char* min_valid_period_str, const char* scope,
+                            const char*             application_hint,
+                            const struct arguments* arguments);
+void oidcd_handleBackgroundRefresh(struct ipcPipe          pipes,
+                                   const char*             short_name,
+                                   time_t                  min_valid_period,
+                                   const struct arguments* arguments);
+void oidcd_handleRegister(struct ipcPipe, const cJSON* account_json,
                           const char* json_str, const char* access_token);
 void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
                               const char* fromString);
-void oidcd_handleStateLookUp(struct ipcPipe, char* state);
-void oidcd_handleDeviceLookup(struct ipcPipe, const char* account_json,
-                              const char* device_json);
+void oidcd_handleStateLookUp(struct ipcPipe, char* state, int wait);
+void oidcd_stateWaiters_cancel(unsigned long id);
+void oidcd_stateWaiters_notify(const char* state);
+void oidcd_handleDeviceLookup(struct ipcPipe, const cJSON* account_json,
+                              const cJSON* device_json);
 void oidcd_handleScopes(struct ipcPipe pipes, const char* issuer_url);
+void oidcd_handlePrefetch(struct ipcPipe pipes, const char* issuer_url);
 void oidcd_handleTermHttp(struct ipcPipe, const char* state);
 void oidcd_handleLock(struct ipcPipe, const char* password, int _lock);
+void oidcd_handleMetrics(struct ipcPipe);
+void oidcd_handleAccountList(struct ipcPipe);
+void oidcd_handleAccountConfig(struct ipcPipe pipes, const char* short_name);
+void oidcd_handleStoreInfo(struct ipcPipe);
+void oidcd_handleReload(struct ipcPipe pipes, struct arguments* arguments,
+                        const char* lifetime_str,
+                        const char* max_accounts_str, const char* confirm_str);
 
 #endif  // OIDCD_HANDLER_H
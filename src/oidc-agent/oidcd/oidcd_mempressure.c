@@ -0,0 +1,116 @@
+#include "oidcd_mempressure.h"
+#include "oidc-agent/oidc/flows/openid_config_cache.h"
+#include "oidc-agent/oidcd/oidcd_timers.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/accountUtils.h"
+#include "utils/agent_metrics.h"
+#include "utils/crypt/keyCache.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/logger.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/**
+ * Memory ceiling for oidcd.
+ *
+ * A long-running agent slowly creeps from a few MB to tens of MB: cached
+ * discovery documents, cached file contents, derived keys, freed-but-kept
+ * heap pages. With --memory-budget the resident set is sampled periodically
+ * and a pass over the budget reclaims in priority order, cheapest to
+ * rebuild first: the file cache (a disk read), the in-memory discovery
+ * cache (persisted encrypted on disk), the derived-key cache (re-derivable
+ * from the passwords). If that is not enough, accounts idle for a while are
+ * evicted back to their sealed on-disk form, and finally the allocator is
+ * asked to return freed pages to the kernel. The sampling always runs, so
+ * the high-water mark shows up in the metrics exposition even without a
+ * budget - the creep is visible before it matters.
+ */
+
+// seconds between two rss samples; can be overridden at build time
+#ifndef AGENT_MEMPRESSURE_INTERVAL
+#define AGENT_MEMPRESSURE_INTERVAL 30
+#endif
+
+// an account not used for this long may be sealed back to disk under
+// pressure; can be overridden at build time
+#ifndef AGENT_MEMPRESSURE_IDLE
+#define AGENT_MEMPRESSURE_IDLE 600
+#endif
+
+static unsigned long budget_kb     = 0;
+static unsigned long high_water_kb = 0;
+
+/**
+ * @brief reads the current resident set size
+ * @return the rss in kB; @c 0 if it cannot be read on this platform
+ */
+unsigned long oidcd_mempressure_rssKb() {
+#ifdef __linux__
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  unsigned long size     = 0;
+  unsigned long resident = 0;
+  int           n        = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+  if (n != 2) {
+    return 0;
+  }
+  return resident * ((unsigned long)sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief the highest rss sample seen so far, in kB
+ */
+unsigned long oidcd_mempressure_highWaterKb() { return high_water_kb; }
+
+static void _reclaim() {
+  unsigned long start = agent_metrics_now_ms();
+  fileCache_drop();
+  discoveryCache_drop();
+  keyCache_clear();
+  if (oidcd_workers_jobsActive() == 0) {  // a worker might still hold a
+                                          // pointer into the account db
+    accountDB_evictIdle(AGENT_MEMPRESSURE_IDLE);
+  }
+#ifdef __GLIBC__
+  malloc_trim(0);  // freed arena pages go back to the kernel, so the
+                   // reclaim shows up in rss and not only in free lists
+#endif
+  agent_metrics_record("mem_reclaim", agent_metrics_now_ms() - start);
+}
+
+static void _memTimerCb(void* ignored) {
+  (void)ignored;
+  unsigned long rss = oidcd_mempressure_rssKb();
+  if (rss > high_water_kb) {
+    high_water_kb = rss;
+  }
+  if (budget_kb != 0 && rss > budget_kb) {
+    logger(NOTICE, "rss %lu kB exceeds the %lu kB budget; reclaiming", rss,
+           budget_kb);
+    _reclaim();
+  }
+  oidcd_timer_schedule(time(NULL) + AGENT_MEMPRESSURE_INTERVAL, _memTimerCb,
+                       NULL);
+}
+
+/**
+ * @brief starts the periodic rss sampling and reclamation
+ * Sampling always runs so the high-water mark is available in the metrics;
+ * reclamation only happens with --memory-budget.
+ */
+void oidcd_mempressure_start(const struct arguments* arguments) {
+  budget_kb = arguments->memory_budget * 1024;
+  oidcd_timer_schedule(time(NULL) + AGENT_MEMPRESSURE_INTERVAL, _memTimerCb,
+                       NULL);
+}
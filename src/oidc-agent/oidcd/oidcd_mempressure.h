@@ -0,0 +1,10 @@
+#ifndef OIDCD_MEMPRESSURE_H
+#define OIDCD_MEMPRESSURE_H
+
+#include "oidc-agent/oidc-agent_options.h"
+
+void          oidcd_mempressure_start(const struct arguments* arguments);
+unsigned long oidcd_mempressure_rssKb();
+unsigned long oidcd_mempressure_highWaterKb();
+
+#endif  // OIDCD_MEMPRESSURE_H
@@ -0,0 +1,161 @@
+#include "oidcd_preload.h"
+#include "account/account.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidcd/oidcd_handler.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/db/account_db.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Account preloading (--preload).
+ *
+ * Without it every account is loaded lazily on first use, paying file read,
+ * issuer discovery and the token request at the worst time - the first
+ * client request. With --preload a few background threads walk the account
+ * configurations right after oidcd initializes: every configuration file is
+ * pre-read (warming the file cache and the page cache), and configurations
+ * that are not encrypted are loaded completely, including their first
+ * access token. Encrypted configurations cannot be decrypted without the
+ * user's password - asking for it is the autoload prompt on first use - so
+ * for them the pre-read is all that can be done up front.
+ *
+ * The preload threads adopt worker mode, so their pipe round trips (e.g. a
+ * refresh token update after token rotation) go through the worker wait
+ * slots. They tag their messages with ids from a dedicated high range that
+ * cannot collide with the request ids oidcp assigns to clients; oidcp
+ * answers internal requests with such ids without an in-flight client.
+ */
+
+#define PRELOAD_THREADS 4
+#define PRELOAD_ID_BASE (1UL << (sizeof(unsigned long) * 8 - 1))
+
+struct preloadPool {
+  struct ipcPipe  pipes;
+  list_t*         files;
+  unsigned int    next;
+  unsigned int    nthreads;  // running threads; the last one frees the pool
+  pthread_mutex_t lock;
+};
+
+static void _preloadAccountConfig(struct ipcPipe pipes, const char* filename,
+                                  unsigned long id) {
+  char* path    = concatToOidcDir(filename);
+  char* content = readFileCachedBinary(path, NULL);  // pre-read; also warms
+                                                     // the file cache
+  secFree(path);
+  if (content == NULL) {
+    return;
+  }
+  if (!isJSONObject(content)) {
+    logger(DEBUG, "Preload: config '%s' is encrypted; pre-read only",
+           filename);
+    secFree(content);
+    return;
+  }
+  struct oidc_account* account = getAccountFromJSON(content);
+  secFree(content);
+  if (account == NULL) {
+    logger(DEBUG, "Preload: could not parse config '%s'", filename);
+    return;
+  }
+  account_setDeath(account, agent_state.defaultTimeout
+                                ? time(NULL) + agent_state.defaultTimeout
+                                : 0);
+  pipes.id = id;
+  oidcd_workers_jobStarted();  // the idle eviction in the main loop must not
+                               // run while we hold account db pointers
+  if (addAccount(pipes, account) != OIDC_SUCCESS) {
+    logger(NOTICE, "Preload of account '%s' failed: %s", filename,
+           oidc_serror());
+    secFreeAccount(account);
+  } else {
+    logger(DEBUG, "Preloaded account '%s'", filename);
+  }
+  oidcd_workers_jobFinished();
+}
+
+static void* _preload_main(void* arg) {
+  struct preloadPool* pool = arg;
+  oidcd_workers_adoptThread();
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    unsigned int i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (i >= pool->files->len) {
+      break;
+    }
+    _preloadAccountConfig(pool->pipes, list_at(pool->files, i)->val,
+                          PRELOAD_ID_BASE | (i + 1));
+  }
+  pthread_mutex_lock(&pool->lock);
+  unsigned char last = --pool->nthreads == 0;
+  pthread_mutex_unlock(&pool->lock);
+  if (last) {
+    secFreeList(pool->files);
+    secFree(pool);
+  }
+  return NULL;
+}
+
+/**
+ * @brief starts the background account preload if @c --preload was given
+ * Has to be called after the account db is initialized; returns immediately,
+ * the work happens on detached threads.
+ */
+void oidcd_preload_start(struct ipcPipe          pipes,
+                         const struct arguments* arguments) {
+  if (!arguments->preload) {
+    return;
+  }
+  list_t* files = getAccountConfigFileList();
+  if (files != NULL && arguments->shards > 1) {
+    // with several oidcd workers each preloads only the accounts it owns;
+    // the config file name is the account short name
+    for (unsigned int i = 0; i < files->len;) {
+      list_node_t* node = list_at(files, i);
+      if (oidc_strhash(node->val) % arguments->shards != arguments->shard) {
+        list_remove(files, node);
+      } else {
+        i++;
+      }
+    }
+  }
+  if (files == NULL || files->len == 0) {
+    secFreeList(files);
+    return;
+  }
+  logger(DEBUG, "Preloading %u account configs", files->len);
+  struct preloadPool* pool = secAlloc(sizeof(struct preloadPool));
+  pool->pipes              = pipes;
+  pool->files              = files;
+  pthread_mutex_init(&pool->lock, NULL);
+  unsigned int numThreads =
+      files->len < PRELOAD_THREADS ? files->len : PRELOAD_THREADS;
+  pool->nthreads = numThreads;
+  unsigned int started = 0;
+  for (unsigned int i = 0; i < numThreads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _preload_main, pool) != 0) {
+      logger(ERROR, "could not create preload thread: %m");
+      pthread_mutex_lock(&pool->lock);
+      pool->nthreads--;
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+    pthread_detach(thread);
+    started++;
+  }
+  if (started == 0) {  // no thread could be started; nothing owns the pool
+    secFreeList(pool->files);
+    secFree(pool);
+  }
+}
@@ -0,0 +1,10 @@
+#ifndef OIDCD_PRELOAD_H
+#define OIDCD_PRELOAD_H
+
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc-agent_options.h"
+
+void oidcd_preload_start(struct ipcPipe          pipes,
+                         const struct arguments* arguments);
+
+#endif  // OIDCD_PRELOAD_H
@@ -0,0 +1,107 @@
+#include "oidcd_promexport.h"
+#include "oidc-agent/http/http_metrics.h"
+#include "oidc-agent/oidcd/oidcd_mempressure.h"
+#include "oidc-agent/oidcd/oidcd_timers.h"
+#include "utils/agent_metrics.h"
+#include "utils/db/account_db.h"
+#include "utils/db/codeVerifier_db.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Prometheus textfile export (--metrics-file).
+ *
+ * Scraping the agent directly would mean polling traffic to the agent and
+ * an open port; instead the counters and histograms already collected for
+ * the metrics request are periodically written in the Prometheus text
+ * exposition format, where node_exporter's textfile collector picks them
+ * up. The file is written to a temporary name and renamed into place, so
+ * the collector never reads a partial exposition.
+ */
+
+// seconds between two textfile writes; can be overridden at build time
+#ifndef AGENT_PROM_INTERVAL
+#define AGENT_PROM_INTERVAL 60
+#endif
+
+// resolved target path; NULL when the export is disabled
+static char* prom_path = NULL;
+
+static void _promWrite() {
+  char* agent = agent_metrics_toPrometheus();
+  char* http  = http_metrics_toPrometheus();
+  char* text  = oidc_sprintf(
+      "%s%s"
+      "# HELP oidc_agent_loaded_accounts Currently loaded account "
+       "configurations.\n"
+       "# TYPE oidc_agent_loaded_accounts gauge\n"
+       "oidc_agent_loaded_accounts %lu\n"
+       "# HELP oidc_agent_pending_auth_flows Auth code flows waiting for "
+       "the user.\n"
+       "# TYPE oidc_agent_pending_auth_flows gauge\n"
+       "oidc_agent_pending_auth_flows %lu\n"
+       "# HELP oidc_agent_rss_kilobytes Resident set size of oidcd.\n"
+       "# TYPE oidc_agent_rss_kilobytes gauge\n"
+       "oidc_agent_rss_kilobytes %lu\n"
+       "# HELP oidc_agent_rss_high_water_kilobytes Highest resident set "
+       "size sampled since start.\n"
+       "# TYPE oidc_agent_rss_high_water_kilobytes gauge\n"
+       "oidc_agent_rss_high_water_kilobytes %lu\n",
+      agent ?: "", http ?: "", (unsigned long)accountDB_getSize(),
+      (unsigned long)codeVerifierDB_getSize(), oidcd_mempressure_rssKb(),
+      oidcd_mempressure_highWaterKb());
+  secFree(agent);
+  secFree(http);
+  if (text == NULL) {
+    return;
+  }
+  char* tmp = oidc_strcat(prom_path, ".tmp");
+  if (tmp == NULL) {
+    secFree(text);
+    return;
+  }
+  if (writeFile(tmp, text) != OIDC_SUCCESS) {
+    logger(NOTICE, "Could not write metrics textfile: %s", oidc_serror());
+  } else if (rename(tmp, prom_path) != 0) {
+    oidc_setErrnoError();
+    logger(NOTICE, "Could not move metrics textfile into place: %s",
+           oidc_serror());
+  }
+  secFree(tmp);
+  secFree(text);
+}
+
+static void _promTimerCb(void* ignored) {
+  (void)ignored;
+  _promWrite();
+  oidcd_timer_schedule(time(NULL) + AGENT_PROM_INTERVAL, _promTimerCb, NULL);
+}
+
+/**
+ * @brief arms the periodic metrics textfile writes; no-op unless
+ * --metrics-file was given
+ *
+ * A relative path is resolved under the oidc directory; an absolute path
+ * (e.g. below /run) is used as is.
+ */
+void oidcd_promexport_start(const struct arguments* arguments) {
+  if (!strValid(arguments->metrics_file)) {
+    return;
+  }
+  prom_path = arguments->metrics_file[0] == '/'
+                  ? oidc_strcopy(arguments->metrics_file)
+                  : concatToOidcDir(arguments->metrics_file);
+  if (prom_path == NULL) {
+    logger(ERROR, "Could not resolve the metrics textfile path; not "
+                  "exporting metrics");
+    return;
+  }
+  oidcd_timer_schedule(time(NULL) + AGENT_PROM_INTERVAL, _promTimerCb, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef OIDCD_PROMEXPORT_H
+#define OIDCD_PROMEXPORT_H
+
+#include "oidc-agent/oidc-agent_options.h"
+
+void oidcd_promexport_start(const struct arguments* arguments);
+
+#endif  // OIDCD_PROMEXPORT_H
@@ -0,0 +1,97 @@
+#include "oidcd_reaper.h"
+#include "account/account.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/db/account_db.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+
+#include <pthread.h>
+
+/**
+ * Deferred freeing of account objects.
+ *
+ * Worker threads hold pointers into the account db across their upstream
+ * calls and still touch the account (and the token and issuer views
+ * borrowed from it) until their response is written. The background walks
+ * (idle eviction, memory reclaim, snapshots) gate on idle workers for that
+ * reason; the synchronous paths - the remove/delete handlers and the
+ * same-name overwrite in db_addAccountEncrypted - cannot wait, because a
+ * worker may in turn be waiting for the main loop to deliver an internal
+ * response. The account db's free function therefore routes through here:
+ * with idle workers the account is freed immediately, otherwise it is
+ * parked in a graveyard the main loop drains once the workers are idle
+ * again. Removal from the db itself stays immediate - clients observe it
+ * right away and no new lookup can hand the account out - only the memory
+ * outlives the removal until no thread can still reference it.
+ */
+
+struct grave {
+  struct oidc_account* account;
+  struct grave*        next;
+};
+
+// parked accounts; pushed from the main loop and from worker threads (a
+// worker's own db_addAccountEncrypted may overwrite), hence the lock
+static struct grave*   graveyard      = NULL;
+static pthread_mutex_t graveyard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief frees a detached account, deferring while worker jobs are active
+ * Installed as the account db's free function; must only be called for
+ * accounts no longer reachable through the db.
+ */
+void oidcd_reaper_free(void* account) {
+  if (account == NULL) {
+    return;
+  }
+  if (oidcd_workers_jobsActive() == 0) {
+    // jobs are only dispatched by the main loop, so none can start and
+    // grab a pointer while we free
+    _secFreeAccount((struct oidc_account*)account);
+    return;
+  }
+  struct grave* grave = secAlloc(sizeof(struct grave));
+  grave->account      = account;
+  pthread_mutex_lock(&graveyard_lock);
+  grave->next = graveyard;
+  graveyard   = grave;
+  pthread_mutex_unlock(&graveyard_lock);
+  logger(DEBUG, "parking removed account until the workers are idle");
+}
+
+/**
+ * @return the time the main loop should wake to drain parked accounts, or
+ * @c 0 if nothing is parked
+ */
+time_t oidcd_reaper_nextAt() {
+  pthread_mutex_lock(&graveyard_lock);
+  int pending = graveyard != NULL;
+  pthread_mutex_unlock(&graveyard_lock);
+  return pending ? time(NULL) + 1 : 0;
+}
+
+/**
+ * @brief frees the parked accounts; no-op while worker jobs are active
+ * Has to run on the main loop, so no new job can start during the drain.
+ */
+void oidcd_reaper_drain() {
+  if (oidcd_workers_jobsActive() != 0) {
+    return;
+  }
+  pthread_mutex_lock(&graveyard_lock);
+  struct grave* list = graveyard;
+  graveyard          = NULL;
+  pthread_mutex_unlock(&graveyard_lock);
+  while (list != NULL) {
+    struct grave* grave = list;
+    list                = grave->next;
+    if (accountDB_findValue(grave->account) == grave->account) {
+      // a worker re-added the account after its job (the reencrypting
+      // db_addAccountEncrypted); ownership is back with the db
+      logger(DEBUG, "parked account was re-added to the db; not freeing");
+    } else {
+      _secFreeAccount(grave->account);
+    }
+    secFree(grave);
+  }
+}
@@ -0,0 +1,10 @@
+#ifndef OIDCD_REAPER_H
+#define OIDCD_REAPER_H
+
+#include <time.h>
+
+void   oidcd_reaper_free(void* account);
+time_t oidcd_reaper_nextAt();
+void   oidcd_reaper_drain();
+
+#endif  // OIDCD_REAPER_H
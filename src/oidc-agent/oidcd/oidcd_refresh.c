@@ -0,0 +1,314 @@
+#include "oidcd_refresh.h"
+#include "account/account.h"
+#include "defines/settings.h"
+#include "list/list.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "oidc-agent/oidcd/oidcd_timers.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Proactive token refresh.
+ *
+ * Tokens are otherwise renewed only on demand: the first client after
+ * expiry pays the full refresh-flow http latency. During event-loop idle
+ * time oidcd therefore walks the loaded accounts and dispatches a
+ * background refresh to the worker pool for every token that expires within
+ * the look-ahead window, so steady-state clients practically always hit a
+ * valid in-memory token. The look-ahead defaults to
+ * @c DEFAULT_REFRESH_AHEAD seconds and can be changed - or, set to 0,
+ * disabled - via the OIDC_AGENT_REFRESH_AHEAD environment variable.
+ *
+ * The scheduling runs on a self re-arming oidcd timer: after every walk
+ * the next wake-up is set to the earliest due refresh, capped at
+ * @c REFRESH_IDLE_RECHECK so newly loaded accounts are picked up without
+ * any hook into the load paths.
+ *
+ * Background refreshes must never create user interaction, so accounts
+ * that are not loaded or would require a confirmation prompt are left to
+ * on-demand refresh (see @c oidcd_handleBackgroundRefresh). Failed
+ * attempts are retried only after a delay, so a broken issuer is not
+ * hammered on every idle tick.
+ *
+ * When a token was served in degraded mode because its issuer was
+ * unreachable, the handler queues the account for revalidation here (see
+ * @c oidcd_refresh_revalidateSoon); the walk then probes the issuer with a
+ * forced refresh on a short retry spacing until it is reachable again.
+ */
+
+#define DEFAULT_REFRESH_AHEAD 60
+#define REFRESH_RETRY_DELAY 30
+#define REFRESH_IDLE_RECHECK 60
+// retry spacing while an issuer is unreachable and stale tokens are being
+// served; shorter than the regular delay so the outage ends quickly for
+// the clients, long enough not to hammer the recovering issuer
+#define REFRESH_DEGRADED_RETRY 10
+
+// ids for the pipe messages of background refreshes; a dedicated high range
+// that cannot collide with the request ids oidcp assigns to clients or with
+// the preload range
+#define REFRESH_ID_BASE                          \
+  ((1UL << (sizeof(unsigned long) * 8 - 1)) |    \
+   (1UL << (sizeof(unsigned long) * 8 - 2)))
+
+static unsigned long next_id = REFRESH_ID_BASE;
+
+struct refresh_attempt {
+  char*  name;
+  time_t not_before;
+};
+
+static list_t* attempts = NULL;
+
+static struct refresh_attempt* _findAttempt(const char* name) {
+  if (attempts == NULL) {
+    return NULL;
+  }
+  list_node_t* node;
+  LIST_FOREACH(attempts, node) {
+    struct refresh_attempt* attempt = node->val;
+    if (strequal(attempt->name, name)) {
+      return attempt;
+    }
+  }
+  return NULL;
+}
+
+static time_t _notBefore(const char* name) {
+  struct refresh_attempt* attempt = _findAttempt(name);
+  return attempt != NULL ? attempt->not_before : 0;
+}
+
+static void _setNotBefore(const char* name, time_t not_before) {
+  struct refresh_attempt* attempt = _findAttempt(name);
+  if (attempt == NULL) {
+    if (attempts == NULL) {
+      attempts = list_new();
+    }
+    attempt             = secAlloc(sizeof(struct refresh_attempt));
+    attempt->name       = oidc_strcopy(name);
+    list_rpush(attempts, list_node_new(attempt));
+  }
+  attempt->not_before = not_before;
+}
+
+// accounts whose issuer was unreachable when a stale token was served;
+// filled by the token handlers on the worker threads, drained by the timer
+// on the main loop - hence the lock, unlike the main-loop-only attempts
+// list above
+static pthread_mutex_t revalidate_lock  = PTHREAD_MUTEX_INITIALIZER;
+static list_t*         revalidate_names = NULL;
+
+/**
+ * @brief queues @p shortname for a prompt background revalidation
+ *
+ * Called when a stale token was served because the issuer was unreachable.
+ * The next timer tick probes the issuer with a forced refresh instead of
+ * waiting for the regular retry backoff, so service recovers as soon as
+ * the issuer does. Thread-safe.
+ */
+void oidcd_refresh_revalidateSoon(const char* shortname) {
+  if (!strValid(shortname)) {
+    return;
+  }
+  pthread_mutex_lock(&revalidate_lock);
+  if (revalidate_names == NULL) {
+    revalidate_names        = list_new();
+    revalidate_names->free  = (void (*)(void*)) & _secFree;
+    revalidate_names->match = (matchFunction)strequal;
+  }
+  if (findInList(revalidate_names, shortname) == NULL) {
+    list_rpush(revalidate_names, list_node_new(oidc_strcopy(shortname)));
+  }
+  pthread_mutex_unlock(&revalidate_lock);
+}
+
+/**
+ * @brief takes the queued revalidations; the caller owns the returned list
+ */
+static list_t* _takeRevalidations() {
+  pthread_mutex_lock(&revalidate_lock);
+  list_t* taken    = revalidate_names;
+  revalidate_names = NULL;
+  pthread_mutex_unlock(&revalidate_lock);
+  return taken;
+}
+
+static int _revalidationsPending() {
+  pthread_mutex_lock(&revalidate_lock);
+  int pending = revalidate_names != NULL && revalidate_names->len > 0;
+  pthread_mutex_unlock(&revalidate_lock);
+  return pending;
+}
+
+static time_t _refreshAhead() {
+  const char* env = getenv(OIDC_REFRESH_AHEAD_ENV_NAME);
+  if (!strValid(env)) {
+    return DEFAULT_REFRESH_AHEAD;
+  }
+  return strToInt(env);
+}
+
+/**
+ * @brief computes when the next proactive refresh is due
+ *
+ * Walks the loaded accounts, so it has to be called from the main loop
+ * while no worker jobs are active - the same constraint the idle eviction
+ * has.
+ * @return the absolute time of the next due refresh or @c 0 if there is
+ * nothing to schedule
+ */
+static time_t oidcd_refresh_nextAt() {
+  time_t ahead = _refreshAhead();
+  if (ahead <= 0) {
+    return 0;
+  }
+  list_t* accounts = accountDB_getList();
+  if (accounts == NULL) {
+    return 0;
+  }
+  time_t       min = 0;
+  list_node_t* node;
+  LIST_FOREACH(accounts, node) {
+    struct oidc_account* account = node->val;
+    if (!strValid(account_getRefreshToken(account))) {
+      continue;  // nothing to refresh with
+    }
+    time_t expires_at = account_getTokenExpiresAt(account);
+    if (expires_at == 0) {
+      continue;
+    }
+    time_t due        = expires_at - ahead;
+    time_t not_before = _notBefore(account_getName(account));
+    if (due < not_before) {
+      due = not_before;  // an attempt just failed; retry later
+    }
+    if (min == 0 || due < min) {
+      min = due;
+    }
+  }
+  return min;
+}
+
+/**
+ * @brief dispatches background refreshes for all tokens near expiry
+ *
+ * Runs on the timer callback while no worker jobs are active. The
+ * refreshes themselves run on the worker pool; this only walks the
+ * accounts and queues the due ones.
+ */
+static void oidcd_refresh_check(struct ipcPipe          pipes,
+                                const struct arguments* arguments) {
+  time_t ahead = _refreshAhead();
+  if (ahead <= 0) {
+    return;
+  }
+  list_t* accounts = accountDB_getList();
+  if (accounts == NULL) {
+    return;
+  }
+  time_t       now = time(NULL);
+  list_node_t* node;
+  LIST_FOREACH(accounts, node) {
+    struct oidc_account* account = node->val;
+    if (!strValid(account_getRefreshToken(account))) {
+      continue;
+    }
+    time_t expires_at = account_getTokenExpiresAt(account);
+    if (expires_at == 0 || expires_at - now > ahead) {
+      continue;
+    }
+    const char* name = account_getName(account);
+    if (_notBefore(name) > now) {
+      continue;
+    }
+    _setNotBefore(name, now + REFRESH_RETRY_DELAY);
+    pipes.id = next_id++;
+    logger(DEBUG, "Dispatching background refresh for account '%s'", name);
+    oidcd_workers_dispatchRefresh(pipes, name, ahead, arguments);
+  }
+}
+
+/**
+ * @brief dispatches forced refreshes for accounts queued for revalidation
+ *
+ * Runs on the timer callback while no worker jobs are active. The refresh
+ * is forced ( @c FORCE_NEW_TOKEN ) so it actually hits the issuer - a
+ * still-valid stale token must not satisfy it. Accounts still inside their
+ * degraded retry spacing stay queued for the next tick.
+ */
+static void _dispatchRevalidations(struct ipcPipe          pipes,
+                                   const struct arguments* arguments) {
+  list_t* due = _takeRevalidations();
+  if (due == NULL) {
+    return;
+  }
+  time_t       now = time(NULL);
+  list_node_t* node;
+  LIST_FOREACH(due, node) {
+    const char* name = node->val;
+    if (_notBefore(name) > now) {
+      if (_notBefore(name) > now + REFRESH_DEGRADED_RETRY) {
+        // pull a longer regular backoff down to the degraded spacing
+        _setNotBefore(name, now + REFRESH_DEGRADED_RETRY);
+      }
+      oidcd_refresh_revalidateSoon(name);  // keep it queued
+      continue;
+    }
+    _setNotBefore(name, now + REFRESH_DEGRADED_RETRY);
+    pipes.id = next_id++;
+    logger(DEBUG, "Dispatching revalidation for account '%s'", name);
+    oidcd_workers_dispatchRefresh(pipes, name, FORCE_NEW_TOKEN, arguments);
+  }
+  secFreeList(due);
+}
+
+static struct ipcPipe          refresh_pipes;
+static const struct arguments* refresh_arguments = NULL;
+
+static void _refreshTimerCb(void* ignored) {
+  (void)ignored;
+  time_t now  = time(NULL);
+  time_t next = 0;
+  if (oidcd_workers_jobsActive() == 0) {  // the account walk must not race
+                                          // with workers mutating the db
+    _dispatchRevalidations(refresh_pipes, refresh_arguments);
+    oidcd_refresh_check(refresh_pipes, refresh_arguments);
+    next = oidcd_refresh_nextAt();
+  } else {
+    next = now + 1;  // workers own the db right now; look again shortly
+  }
+  if (next == 0 || next > now + REFRESH_IDLE_RECHECK) {
+    next = now + REFRESH_IDLE_RECHECK;  // newly loaded accounts are picked
+                                        // up within one recheck period
+  }
+  if (_revalidationsPending() && next > now + 1) {
+    next = now + 1;  // an issuer outage is in progress; probe promptly
+  }
+  if (next <= now) {
+    next = now + 1;
+  }
+  oidcd_timer_schedule(next, _refreshTimerCb, NULL);
+}
+
+/**
+ * @brief arms the proactive refresh timer
+ *
+ * The timer is armed even with proactive refreshes disabled via the
+ * environment: the degraded-mode revalidations drain on the same tick and
+ * have to keep working during an issuer outage.
+ */
+void oidcd_refresh_start(struct ipcPipe          pipes,
+                         const struct arguments* arguments) {
+  refresh_pipes     = pipes;
+  refresh_arguments = arguments;
+  oidcd_timer_schedule(time(NULL) + 1, _refreshTimerCb, NULL);
+}
@@ -0,0 +1,13 @@
+#ifndef OIDCD_REFRESH_H
+#define OIDCD_REFRESH_H
+
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc-agent_options.h"
+
+#include <time.h>
+
+void oidcd_refresh_start(struct ipcPipe          pipes,
+                         const struct arguments* arguments);
+void oidcd_refresh_revalidateSoon(const char* shortname);
+
+#endif  // OIDCD_REFRESH_H
@@ -0,0 +1,321 @@
+#include "oidcd_snapshot.h"
+#include "account/account.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "list/list.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidcd/oidcd_timers.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/accountSnapshot.h"
+#include "utils/accountUtils.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/cryptUtils.h"
+#include "utils/db/account_db.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+/**
+ * Encrypted agent state snapshot (--restore).
+ *
+ * An agent restart - upgrade, crash, logout - used to lose all loaded
+ * accounts; every client then paid the full reload cost (file decryption
+ * with a user password prompt, issuer discovery, token request) again.
+ * With --restore oidcd periodically writes the loaded account set -
+ * configurations including the refresh tokens, plus the issuer endpoints
+ * learned from discovery - to a snapshot file in the oidc directory, and
+ * rehydrates the account db from it at startup. The restore makes no
+ * network requests and asks no passwords: endpoints come from the
+ * snapshot, and still-valid access tokens are carried over - a restart
+ * during an issuer outage can then keep serving them in degraded mode (see
+ * the stale handling in oidcd_handler) - while expired ones are re-acquired
+ * lazily by the on-demand and proactive refresh paths, so the agent is
+ * fully serving again in well under a second.
+ *
+ * The snapshot is encrypted with a random key that is generated once and
+ * kept in a file next to it - the same at-rest model as the discovery
+ * cache, but here the protected content are refresh tokens: the
+ * encryption only ties them to the file permissions of the oidc
+ * directory, it does not add a password barrier. That is why the whole
+ * feature is opt-in. Account removal rewrites the snapshot immediately,
+ * so removed refresh tokens do not linger on disk.
+ */
+
+#define AGENT_SNAPSHOT_FILE "agent-state.snap"
+#define AGENT_SNAPSHOT_KEY_FILE "agent-state.snap.key"
+#define AGENT_SNAPSHOT_KEY_LEN 32
+#define SNAPSHOT_INTERVAL 120
+
+static unsigned char snapshot_enabled = 0;
+
+// with --shards every worker snapshots its own accounts to its own file;
+// worker 0 keeps the historic file name so a single-worker agent finds
+// its old snapshot
+static unsigned int shard_idx   = 0;
+static unsigned int shard_total = 1;
+
+/**
+ * @brief the snapshot file name of this worker. Has to be freed after usage.
+ */
+static char* _snapshotFile() {
+  return shard_idx == 0 ? oidc_strcopy(AGENT_SNAPSHOT_FILE)
+                        : oidc_sprintf(AGENT_SNAPSHOT_FILE ".%u", shard_idx);
+}
+
+// the plaintext of the last written snapshot; rewriting an unchanged state
+// would only burn a KDF run
+static char* last_written = NULL;
+
+/**
+ * @brief reads the snapshot encryption key, generating and storing it on
+ * first use
+ * @return a pointer to the key. Has to be freed after usage.
+ */
+static char* _snapshotKey() {
+  if (oidcFileDoesExist(AGENT_SNAPSHOT_KEY_FILE)) {
+    return readOidcFile(AGENT_SNAPSHOT_KEY_FILE);
+  }
+  char key[AGENT_SNAPSHOT_KEY_LEN + 1];
+  randomFillBase64UrlSafe(key, AGENT_SNAPSHOT_KEY_LEN);
+  key[AGENT_SNAPSHOT_KEY_LEN] = '\0';
+  if (writeOidcFile(AGENT_SNAPSHOT_KEY_FILE, key) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  return oidc_strcopy(key);
+}
+
+/**
+ * @brief writes the loaded account set to the encrypted snapshot file
+ *
+ * No-op unless --restore was given. Has to be called from the main loop;
+ * the walk takes the same account db pointers the idle eviction takes.
+ */
+void oidcd_snapshot_write() {
+  if (!snapshot_enabled) {
+    return;
+  }
+  int    arena = jsonArena_pause();  // the snapshot outlives a request arena
+  cJSON* arr   = stringToJson("[]");
+  list_t* accounts = accountDB_getList();
+  if (accounts != NULL) {
+    list_node_t* node;
+    LIST_FOREACH(accounts, node) {
+      struct oidc_account* account =
+          db_getAccountDecryptedByShortname(account_getName(node->val));
+      if (account == NULL) {
+        continue;
+      }
+      cJSON* entry = stringToJson("{}");
+      jsonAddJSON(entry, IPC_KEY_CONFIG, accountToJSON(account));
+      // the discovery results are not part of the account config json; they
+      // are persisted alongside so the restore does not need any http
+      jsonAddStringValue(entry, OIDC_KEY_TOKEN_ENDPOINT,
+                         account_getTokenEndpoint(account));
+      jsonAddStringValue(entry, OIDC_KEY_REVOCATION_ENDPOINT,
+                         account_getRevocationEndpoint(account));
+      jsonAddStringValue(entry, OIDC_KEY_SCOPES_SUPPORTED,
+                         account_getScopesSupported(account));
+      // the access token itself is not part of the account config json; a
+      // still-valid one is persisted alongside so a restart during an
+      // issuer outage can keep serving it in degraded mode
+      if (strValid(account_getAccessToken(account)) &&
+          (time_t)account_getTokenExpiresAt(account) > time(NULL)) {
+        jsonAddStringValue(entry, OIDC_KEY_ACCESSTOKEN,
+                           account_getAccessToken(account));
+        jsonAddNumberValue(entry, AGENT_KEY_EXPIRESAT,
+                           account_getTokenExpiresAt(account));
+      }
+      db_addAccountEncrypted(account);
+      cJSON_AddItemToArray(arr, entry);
+    }
+  }
+  char* json = jsonToStringUnformatted(arr);
+  secFreeJson(arr);
+  if (strequal(json, last_written)) {
+    secFree(json);
+    jsonArena_resume(arena);
+    return;
+  }
+  char* key = _snapshotKey();
+  if (key == NULL) {
+    secFree(json);
+    jsonArena_resume(arena);
+    return;
+  }
+  char* file = _snapshotFile();
+  if (encryptAndWriteToOidcFile(json, file, key) == OIDC_SUCCESS) {
+    logger(DEBUG, "Wrote agent state snapshot");
+    secFree(last_written);
+    last_written = json;
+  } else {
+    logger(NOTICE, "Could not write agent state snapshot: %s", oidc_serror());
+    secFree(json);
+  }
+  secFree(file);
+  secFree(key);
+  jsonArena_resume(arena);
+}
+
+/**
+ * @brief rehydrates the account db from the snapshot file; no-op unless
+ * --restore was given
+ *
+ * Restored accounts have their issuer endpoints set from the snapshot, so
+ * no discovery request is made and no password is asked. Access tokens that
+ * are still valid are restored too; expired ones are re-acquired by the
+ * normal refresh paths on demand.
+ */
+void oidcd_snapshot_restore(const struct arguments* arguments) {
+  if (!arguments->restore) {
+    return;
+  }
+  snapshot_enabled = 1;
+  shard_idx        = arguments->shard;
+  shard_total = arguments->shards > 1 ? (unsigned int)arguments->shards : 1;
+  char* file  = _snapshotFile();
+  if (!oidcFileDoesExist(file)) {
+    secFree(file);
+    return;
+  }
+  char* key = _snapshotKey();
+  if (key == NULL) {
+    secFree(file);
+    return;
+  }
+  char* json = decryptOidcFile(file, key);
+  secFree(file);
+  secFree(key);
+  if (json == NULL) {
+    logger(NOTICE, "Could not decrypt agent state snapshot; ignoring it");
+    return;
+  }
+  cJSON* arr = stringToJson(json);
+  secFree(json);
+  if (arr == NULL) {
+    return;
+  }
+  int restored = 0;
+  int size     = cJSON_GetArraySize(arr);
+  for (int i = 0; i < size; i++) {
+    cJSON* e      = cJSON_GetArrayItem(arr, i);
+    cJSON* config = getJSONItem(e, IPC_KEY_CONFIG);  // owned by arr
+    if (config == NULL) {
+      continue;
+    }
+    struct oidc_account* account = getAccountFromCJSON(config);
+    if (account == NULL) {
+      continue;
+    }
+    if (shard_total > 1 && oidc_strhash(account_getName(account)) %
+                                   shard_total !=
+                               shard_idx) {
+      // left over from a run with a different worker count; the account's
+      // current owner loads it on demand
+      secFreeAccount(account);
+      continue;
+    }
+    char* token_endpoint = getJSONValue(e, OIDC_KEY_TOKEN_ENDPOINT);
+    if (!strValid(token_endpoint)) {  // cannot refresh without it
+      secFree(token_endpoint);
+      secFreeAccount(account);
+      continue;
+    }
+    struct oidc_issuer* iss = account_getIssuer(account);
+    issuer_setTokenEndpoint(iss, token_endpoint);
+    issuer_setConfigurationEndpoint(
+        iss, oidc_strcat(account_getIssuerUrl(account), CONF_ENDPOINT_SUFFIX));
+    issuer_setRevocationEndpoint(
+        iss, getJSONValue(e, OIDC_KEY_REVOCATION_ENDPOINT));
+    issuer_setScopesSupported(iss,
+                              getJSONValue(e, OIDC_KEY_SCOPES_SUPPORTED));
+    char* access_token = getJSONValue(e, OIDC_KEY_ACCESSTOKEN);
+    if (strValid(access_token)) {
+      char*  expires_at_str = getJSONValue(e, AGENT_KEY_EXPIRESAT);
+      time_t expires_at =
+          expires_at_str != NULL ? (time_t)strToULong(expires_at_str) : 0;
+      secFree(expires_at_str);
+      if (expires_at > time(NULL)) {  // still valid; usable for degraded mode
+        account_setAccessToken(account, access_token);
+        account_setTokenExpiresAt(account, expires_at);
+        access_token = NULL;  // now owned by the account
+      }
+    }
+    secFree(access_token);
+    account_setDeath(account, agent_state.defaultTimeout
+                                  ? time(NULL) + agent_state.defaultTimeout
+                                  : 0);
+    db_addAccountEncrypted(account);
+    restored++;
+  }
+  secFreeJson(arr);
+  if (restored) {
+    accountSnapshot_refresh();
+    accountDB_enforceLimit(agent_state.maxAccounts);
+    logger(NOTICE, "Restored %d account configuration%s from the state "
+                   "snapshot",
+           restored, restored == 1 ? "" : "s");
+  }
+}
+
+static unsigned char write_pending = 0;
+
+static void _deferredWriteCb(void* ignored) {
+  (void)ignored;
+  if (oidcd_workers_jobsActive() != 0) {
+    oidcd_timer_schedule(time(NULL) + 1, _deferredWriteCb, NULL);
+    return;
+  }
+  write_pending = 0;
+  oidcd_snapshot_write();
+}
+
+/**
+ * @brief writes the snapshot now, or as soon as the worker pool is idle
+ *
+ * While a worker is mid-refresh the db can hold a half-rotated state - the
+ * old refresh token already invalidated at the issuer, the new one not yet
+ * stored - which must not be persisted. Writes requested during a job are
+ * therefore deferred (and coalesced) until the pool drains; the removal
+ * handlers use this, so a removed refresh token leaves the disk at most a
+ * few seconds later.
+ */
+void oidcd_snapshot_writeSoon() {
+  if (!snapshot_enabled) {
+    return;
+  }
+  if (oidcd_workers_jobsActive() == 0) {
+    oidcd_snapshot_write();
+    return;
+  }
+  if (write_pending) {
+    return;
+  }
+  write_pending = 1;
+  oidcd_timer_schedule(time(NULL) + 1, _deferredWriteCb, NULL);
+}
+
+static void _snapshotTimerCb(void* ignored) {
+  (void)ignored;
+  oidcd_snapshot_writeSoon();
+  oidcd_timer_schedule(time(NULL) + SNAPSHOT_INTERVAL, _snapshotTimerCb, NULL);
+}
+
+/**
+ * @brief arms the periodic snapshot timer; no-op unless --restore was given
+ *
+ * The periodic write picks up loaded accounts and rotated refresh tokens;
+ * account removals rewrite the snapshot immediately from the handlers.
+ */
+void oidcd_snapshot_start(const struct arguments* arguments) {
+  if (!arguments->restore) {
+    return;
+  }
+  oidcd_timer_schedule(time(NULL) + SNAPSHOT_INTERVAL, _snapshotTimerCb, NULL);
+}
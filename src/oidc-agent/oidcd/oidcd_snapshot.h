@@ -0,0 +1,11 @@
+#ifndef OIDCD_SNAPSHOT_H
+#define OIDCD_SNAPSHOT_H
+
+#include "oidc-agent/oidc-agent_options.h"
+
+void oidcd_snapshot_restore(const struct arguments* arguments);
+void oidcd_snapshot_start(const struct arguments* arguments);
+void oidcd_snapshot_write();
+void oidcd_snapshot_writeSoon();
+
+#endif  // OIDCD_SNAPSHOT_H
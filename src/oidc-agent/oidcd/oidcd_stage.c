@@ -0,0 +1,67 @@
+#include "oidcd_stage.h"
+#include "utils/agent_metrics.h"
+#include "utils/logger.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Self-profiling stage dump. Handlers record what they are about to do
+ * (request dispatch, the https call) in a stage buffer; when oidcp's
+ * watchdog decides oidcd is stuck it sends SIGUSR2 and the current stage
+ * plus how long oidcd has been in it is written to the log. The signal
+ * handler itself only pokes the log drainer thread (sem_post is
+ * async-signal-safe), which runs the actual dump - so the dump works even
+ * while the thread doing the work is wedged in a blocking call.
+ *
+ * There is one buffer for the whole process; with pool workers the last
+ * recorded stage wins, which is good enough to name the endpoint a stall
+ * is sitting on.
+ */
+
+static char            stage_buf[512];
+static unsigned long   stage_since_ms;
+static pthread_mutex_t stage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void oidcd_stage_set(const char* fmt, ...) {
+  char    buf[sizeof(stage_buf)];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  pthread_mutex_lock(&stage_lock);
+  strcpy(stage_buf, buf);
+  stage_since_ms = agent_metrics_now_ms();
+  pthread_mutex_unlock(&stage_lock);
+}
+
+void oidcd_stage_clear() {
+  pthread_mutex_lock(&stage_lock);
+  stage_buf[0] = '\0';
+  pthread_mutex_unlock(&stage_lock);
+}
+
+// runs on the log drainer thread, so it may take locks and allocate
+static void _stage_dump() {
+  pthread_mutex_lock(&stage_lock);
+  if (stage_buf[0] == '\0') {
+    logger(ERROR, "watchdog dump: no stage recorded - oidcd seems idle");
+  } else {
+    logger(ERROR, "watchdog dump: in stage '%s' for %lu ms", stage_buf,
+           agent_metrics_now_ms() - stage_since_ms);
+  }
+  pthread_mutex_unlock(&stage_lock);
+}
+
+static void _stage_dumpSignalHandler(int sig) {
+  (void)sig;
+  logger_requestDump();
+}
+
+void oidcd_stage_init() {
+  logger_setDumpCallback(_stage_dump);
+  signal(SIGUSR2, _stage_dumpSignalHandler);
+}
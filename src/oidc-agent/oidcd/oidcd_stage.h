@@ -0,0 +1,8 @@
+#ifndef OIDCD_STAGE_H
+#define OIDCD_STAGE_H
+
+void oidcd_stage_init();
+void oidcd_stage_set(const char* fmt, ...);
+void oidcd_stage_clear();
+
+#endif  // OIDCD_STAGE_H
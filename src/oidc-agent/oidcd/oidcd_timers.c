@@ -0,0 +1,65 @@
+#include "oidcd_timers.h"
+#include "utils/memory.h"
+#include "utils/timerQueue.h"
+
+struct oidcd_timer {
+  time_t         at;
+  oidcd_timer_cb cb;
+  void*          data;
+};
+
+static struct timerQueue* timers = NULL;
+
+static time_t _timerAt(void* timer) { return ((struct oidcd_timer*)timer)->at; }
+
+/**
+ * @brief schedules a one-shot callback at an absolute time
+ * @return a handle for @c oidcd_timer_cancel; it is invalidated when the
+ * timer fires
+ */
+struct oidcd_timer* oidcd_timer_schedule(time_t at, oidcd_timer_cb cb,
+                                         void* data) {
+  if (timers == NULL) {
+    timers = timerQueue_new(_timerAt);
+  }
+  struct oidcd_timer* timer = secAlloc(sizeof(struct oidcd_timer));
+  timer->at                 = at;
+  timer->cb                 = cb;
+  timer->data               = data;
+  timerQueue_push(timers, timer);
+  return timer;
+}
+
+void oidcd_timer_cancel(struct oidcd_timer* timer) {
+  if (timer == NULL) {
+    return;
+  }
+  timerQueue_remove(timers, timer);
+  secFree(timer);
+}
+
+/**
+ * @return the absolute time of the earliest pending timer or @c 0 if there
+ * is none
+ */
+time_t oidcd_timers_nextAt() {
+  if (timerQueue_getExpired(timers) != NULL) {
+    return time(NULL);  // nextDeath skips already-due entries, but the main
+                        // loop must wake for them immediately
+  }
+  return timerQueue_nextDeath(timers);
+}
+
+/**
+ * @brief fires all due timers
+ * A callback may schedule new timers; those are picked up in the same pass
+ * if already due.
+ */
+void oidcd_timers_runDue() {
+  struct oidcd_timer* timer;
+  while ((timer = timerQueue_getExpired(timers)) != NULL) {
+    timerQueue_remove(timers, timer);
+    timer->cb(timer->data);
+    secFree(timer);
+  }
+}
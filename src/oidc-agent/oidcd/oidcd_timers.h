@@ -0,0 +1,29 @@
+#ifndef OIDCD_TIMERS_H
+#define OIDCD_TIMERS_H
+
+#include <time.h>
+
+/**
+ * Generic one-shot timers for the oidcd main loop.
+ *
+ * Deadlines used to be hardcoded into the pipe read timeout computation;
+ * this gives oidcd features (proactive refresh, future pollers) a uniform
+ * way to get a callback at an absolute time instead. The timers are kept in
+ * the same lazy min-heap the dbs use for their death times, so schedule and
+ * cancel are O(log n); the main loop folds @c oidcd_timers_nextAt into its
+ * pipe read timeout and runs due callbacks with @c oidcd_timers_runDue on
+ * wake-up. Callbacks run on the main loop thread and therefore must not
+ * block; long work has to be dispatched to the worker pool.
+ */
+
+typedef void (*oidcd_timer_cb)(void* data);
+
+struct oidcd_timer;
+
+struct oidcd_timer* oidcd_timer_schedule(time_t at, oidcd_timer_cb cb,
+                                         void* data);
+void                oidcd_timer_cancel(struct oidcd_timer* timer);
+time_t              oidcd_timers_nextAt();
+void                oidcd_timers_runDue();
+
+#endif  // OIDCD_TIMERS_H
@@ -0,0 +1,396 @@
+#include "oidcd_workers.h"
+#include "oidc-agent/http/http.h"
+#include "oidc-agent/oidcd/oidcd_forward.h"
+#include "oidc-agent/oidcd/oidcd_handler.h"
+#include "utils/agent_metrics.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+
+/**
+ * Worker-pool execution mode for oidcd.
+ *
+ * Token requests can block for seconds inside a libcurl call to a slow
+ * issuer. Instead of serving them on the main oidcd loop - where they stall
+ * every other client behind the single pipe - they are dispatched to a small
+ * pool of worker threads, so a hung issuer only delays its own clients.
+ *
+ * Workers never read from the pipe themselves: the main loop stays the only
+ * reader and hands incoming messages that answer a worker's internal request
+ * (refresh token update, autoload, confirmation) over via
+ * @c oidcd_workers_tryDeliverResponse. All pipe messages carry the id of the
+ * client request they belong to, so responses are routed to the worker
+ * serving that request. Writes to the pipe are serialized in
+ * @c ipc_vwriteToPipe.
+ */
+
+struct token_job {
+  struct ipcPipe          pipes;
+  char*                   short_name;
+  char*                   issuer;
+  char*                   account_list;  // json array for batch requests
+  char*                   min_valid;
+  char*                   scope;
+  char*                   application_hint;
+  char*                   forward_request;  // request json to proxy to the
+                                            // home agent
+  unsigned char           background;  // proactive refresh; no client waits
+  time_t                  refresh_ahead;
+  unsigned long           deadline_ms;  // absolute monotonic ms; 0 = none
+  const struct arguments* arguments;
+  struct token_job*       next;
+};
+
+static pthread_mutex_t   job_lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    job_av      = PTHREAD_COND_INITIALIZER;
+static struct token_job* job_head    = NULL;
+static struct token_job* job_tail    = NULL;
+static unsigned int      jobs_active = 0;
+static unsigned char     pool_started = 0;
+
+// Wait slots for internal request round trips: a worker writes its request -
+// tagged with the request id it is serving - and waits here until the main
+// loop delivers the response carrying the same id. Each round trip links a
+// slot living on the waiting thread's stack, so any number of adopted
+// threads (pool workers, device-flow pollers) can wait concurrently.
+struct int_wait {
+  unsigned long    id;
+  char*            response;
+  struct int_wait* next;
+};
+
+static pthread_mutex_t  int_resp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   int_resp_av   = PTHREAD_COND_INITIALIZER;
+static struct int_wait* int_waits     = NULL;
+
+static __thread unsigned char thread_is_worker = 0;
+
+/**
+ * @brief marks the calling thread as a worker
+ *
+ * Threads that serve a client request outside the pool (e.g. a device-flow
+ * poller) adopt themselves so their pipe round trips go through the wait
+ * slots instead of reading from the pipe - the main loop stays the only pipe
+ * reader.
+ */
+void oidcd_workers_adoptThread() { thread_is_worker = 1; }
+
+static void _secFreeTokenJob(struct token_job* job) {
+  secFree(job->short_name);
+  secFree(job->issuer);
+  secFree(job->account_list);
+  secFree(job->min_valid);
+  secFree(job->scope);
+  secFree(job->application_hint);
+  secFree(job->forward_request);
+  secFree(job);
+}
+
+static void* _worker_main(void* ignored) {
+  (void)ignored;
+  thread_is_worker = 1;
+  while (1) {
+    pthread_mutex_lock(&job_lock);
+    while (job_head == NULL) {
+      pthread_cond_wait(&job_av, &job_lock);
+    }
+    struct token_job* job = job_head;
+    job_head              = job->next;
+    if (job_head == NULL) {
+      job_tail = NULL;
+    }
+    pthread_mutex_unlock(&job_lock);
+    http_setDeadline(job->deadline_ms);  // http calls of this job respect
+                                         // the client's time budget
+    unsigned long job_start = agent_metrics_now_ms();
+    const char*   job_op;
+    if (job->background) {
+      job_op = "refresh_job";
+      oidcd_handleBackgroundRefresh(job->pipes, job->short_name,
+                                    job->refresh_ahead, job->arguments);
+    } else if (job->forward_request) {
+      job_op = "forward_job";
+      oidcd_forward_execute(job->pipes, job->forward_request,
+                            job->deadline_ms);
+    } else if (job->account_list) {
+      job_op = "token_batch_job";
+      oidcd_handleTokenBatch(job->pipes, job->account_list, job->min_valid,
+                             job->scope, job->application_hint,
+                             job->arguments);
+    } else if (job->short_name) {
+      job_op = "token_job";
+      oidcd_handleToken(job->pipes, job->short_name, job->min_valid,
+                        job->scope, job->application_hint, job->arguments);
+    } else {
+      job_op = "token_job";
+      oidcd_handleTokenIssuer(job->pipes, job->issuer, job->min_valid,
+                              job->scope, job->application_hint,
+                              job->arguments);
+    }
+    agent_metrics_record(job_op, agent_metrics_now_ms() - job_start);
+    http_setDeadline(0);
+    pthread_mutex_lock(&job_lock);
+    jobs_active--;
+    pthread_mutex_unlock(&job_lock);
+    _secFreeTokenJob(job);
+  }
+  return NULL;
+}
+
+static void _startPool() {
+  if (pool_started) {
+    return;
+  }
+  for (unsigned char i = 0; i < WORKER_POOL_SIZE; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _worker_main, NULL) != 0) {
+      logger(ERROR, "could not create worker thread: %m");
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  pool_started = 1;
+  logger(DEBUG, "started %d oidcd workers", WORKER_POOL_SIZE);
+}
+
+/**
+ * @brief queues a token request for execution on the worker pool
+ *
+ * Either @p short_name or @p issuer has to be given; all strings are copied
+ * so the caller can free its key-value pairs right away.
+ */
+void oidcd_workers_dispatchToken(struct ipcPipe pipes, const char* short_name,
+                                 const char* issuer, const char* min_valid,
+                                 const char*             scope,
+                                 const char*             application_hint,
+                                 unsigned long           deadline_at_ms,
+                                 const struct arguments* arguments) {
+  _startPool();
+  struct token_job* job = secAlloc(sizeof(struct token_job));
+  job->pipes            = pipes;
+  job->short_name       = oidc_strcopy(short_name);
+  job->issuer           = oidc_strcopy(issuer);
+  job->min_valid        = oidc_strcopy(min_valid);
+  job->scope            = oidc_strcopy(scope);
+  job->application_hint = oidc_strcopy(application_hint);
+  job->deadline_ms      = deadline_at_ms;
+  job->arguments        = arguments;
+  job->next             = NULL;
+  pthread_mutex_lock(&job_lock);
+  if (job_tail == NULL) {
+    job_head = job;
+  } else {
+    job_tail->next = job;
+  }
+  job_tail = job;
+  jobs_active++;
+  pthread_mutex_unlock(&job_lock);
+  pthread_cond_signal(&job_av);
+}
+
+/**
+ * @brief queues a request for forwarding to the home agent
+ * @param request the client's request json; copied like the other strings
+ */
+void oidcd_workers_dispatchForward(struct ipcPipe pipes, const char* request,
+                                   unsigned long deadline_at_ms) {
+  _startPool();
+  struct token_job* job = secAlloc(sizeof(struct token_job));
+  job->pipes            = pipes;
+  job->forward_request  = oidc_strcopy(request);
+  job->deadline_ms      = deadline_at_ms;
+  job->next             = NULL;
+  pthread_mutex_lock(&job_lock);
+  if (job_tail == NULL) {
+    job_head = job;
+  } else {
+    job_tail->next = job;
+  }
+  job_tail = job;
+  jobs_active++;
+  pthread_mutex_unlock(&job_lock);
+  pthread_cond_signal(&job_av);
+}
+
+/**
+ * @brief queues a batched token request for execution on the worker pool
+ * @param account_list a json array of account short names; copied like the
+ * other strings
+ */
+void oidcd_workers_dispatchTokenBatch(struct ipcPipe pipes,
+                                      const char*    account_list,
+                                      const char* min_valid, const char* scope,
+                                      const char*             application_hint,
+                                      unsigned long           deadline_at_ms,
+                                      const struct arguments* arguments) {
+  _startPool();
+  struct token_job* job = secAlloc(sizeof(struct token_job));
+  job->pipes            = pipes;
+  job->account_list     = oidc_strcopy(account_list);
+  job->min_valid        = oidc_strcopy(min_valid);
+  job->scope            = oidc_strcopy(scope);
+  job->application_hint = oidc_strcopy(application_hint);
+  job->deadline_ms      = deadline_at_ms;
+  job->arguments        = arguments;
+  job->next             = NULL;
+  pthread_mutex_lock(&job_lock);
+  if (job_tail == NULL) {
+    job_head = job;
+  } else {
+    job_tail->next = job;
+  }
+  job_tail = job;
+  jobs_active++;
+  pthread_mutex_unlock(&job_lock);
+  pthread_cond_signal(&job_av);
+}
+
+/**
+ * @brief queues a proactive background refresh for an account
+ * No client waits for the result; the handler only logs failures.
+ */
+void oidcd_workers_dispatchRefresh(struct ipcPipe pipes,
+                                   const char* short_name, time_t ahead,
+                                   const struct arguments* arguments) {
+  _startPool();
+  struct token_job* job = secAlloc(sizeof(struct token_job));
+  job->pipes            = pipes;
+  job->short_name       = oidc_strcopy(short_name);
+  job->background       = 1;
+  job->refresh_ahead    = ahead;
+  job->arguments        = arguments;
+  job->next             = NULL;
+  pthread_mutex_lock(&job_lock);
+  if (job_tail == NULL) {
+    job_head = job;
+  } else {
+    job_tail->next = job;
+  }
+  job_tail = job;
+  jobs_active++;
+  pthread_mutex_unlock(&job_lock);
+  pthread_cond_signal(&job_av);
+}
+
+/**
+ * @brief removes the queued job belonging to a cancelled request
+ *
+ * A job that already runs cannot be interrupted - the http deadline limits
+ * how long it can still take and oidcp discards its response - but a job
+ * still waiting in the queue is dropped before it wastes a worker.
+ * @param id the id of the cancelled client request
+ * @return @c 1 if a queued job was removed, @c 0 otherwise
+ */
+int oidcd_workers_cancelJob(unsigned long id) {
+  pthread_mutex_lock(&job_lock);
+  struct token_job* prev = NULL;
+  for (struct token_job* job = job_head; job != NULL;
+       prev = job, job = job->next) {
+    if (job->pipes.id != id || job->background) {
+      continue;
+    }
+    if (prev == NULL) {
+      job_head = job->next;
+    } else {
+      prev->next = job->next;
+    }
+    if (job_tail == job) {
+      job_tail = prev;
+    }
+    jobs_active--;
+    pthread_mutex_unlock(&job_lock);
+    logger(DEBUG, "dropped queued job for cancelled request %lu", id);
+    _secFreeTokenJob(job);
+    return 1;
+  }
+  pthread_mutex_unlock(&job_lock);
+  return 0;
+}
+
+unsigned int oidcd_workers_jobsActive() {
+  pthread_mutex_lock(&job_lock);
+  unsigned int active = jobs_active;
+  pthread_mutex_unlock(&job_lock);
+  return active;
+}
+
+/**
+ * @brief marks a unit of background work that may hold account db pointers
+ * Jobs running outside the pool (e.g. account preloading) register
+ * themselves so the main loop's idle eviction waits for them like for pool
+ * jobs; has to be paired with @c oidcd_workers_jobFinished.
+ */
+void oidcd_workers_jobStarted() {
+  pthread_mutex_lock(&job_lock);
+  jobs_active++;
+  pthread_mutex_unlock(&job_lock);
+}
+
+void oidcd_workers_jobFinished() {
+  pthread_mutex_lock(&job_lock);
+  jobs_active--;
+  pthread_mutex_unlock(&job_lock);
+}
+
+/**
+ * @brief hands a message read from the pipe to the worker waiting for it
+ * @param id the request id the message was tagged with
+ * @param response the message read by the main loop; ownership is transferred
+ * on delivery
+ * @return @c 1 if a worker was waiting for this id and took the message,
+ * @c 0 if the message is a regular request and has to be handled by the
+ * caller
+ */
+int oidcd_workers_tryDeliverResponse(unsigned long id, char* response) {
+  pthread_mutex_lock(&int_resp_lock);
+  for (struct int_wait* slot = int_waits; slot != NULL; slot = slot->next) {
+    if (slot->id == id) {
+      slot->response = response;
+      pthread_cond_broadcast(&int_resp_av);
+      pthread_mutex_unlock(&int_resp_lock);
+      return 1;
+    }
+  }
+  pthread_mutex_unlock(&int_resp_lock);
+  return 0;
+}
+
+/**
+ * @brief pipe round trip that is safe to call from worker threads
+ *
+ * On the main thread this is a plain @c ipc_vcommunicateThroughPipe. On a
+ * worker thread the request is written to the pipe - tagged by
+ * @c ipc_vwriteToPipe with the id of the request the worker is serving - and
+ * the thread blocks until the main loop, the only pipe reader, delivers the
+ * response carrying that id.
+ */
+char* oidcd_workers_communicate(struct ipcPipe pipes, char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (!thread_is_worker) {
+    char* ret = ipc_vcommunicateThroughPipe(pipes, fmt, args);
+    va_end(args);
+    return ret;
+  }
+  struct int_wait slot = {pipes.id, NULL, NULL};
+  pthread_mutex_lock(&int_resp_lock);
+  slot.next = int_waits;
+  int_waits = &slot;
+  if (ipc_vwriteToPipe(pipes, fmt, args) != OIDC_SUCCESS) {
+    int_waits = slot.next;
+    pthread_mutex_unlock(&int_resp_lock);
+    va_end(args);
+    return NULL;
+  }
+  while (slot.response == NULL) {
+    pthread_cond_wait(&int_resp_av, &int_resp_lock);
+  }
+  struct int_wait** prev = &int_waits;  // unlink the stack slot
+  while (*prev != &slot) { prev = &(*prev)->next; }
+  *prev = slot.next;
+  pthread_mutex_unlock(&int_resp_lock);
+  va_end(args);
+  return slot.response;
+}
@@ -0,0 +1,33 @@
+#ifndef OIDCD_WORKERS_H
+#define OIDCD_WORKERS_H
+
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc-agent_options.h"
+
+#define WORKER_POOL_SIZE 4
+
+void oidcd_workers_dispatchToken(struct ipcPipe pipes, const char* short_name,
+                                 const char* issuer, const char* min_valid,
+                                 const char* scope, const char* application_hint,
+                                 unsigned long           deadline_at_ms,
+                                 const struct arguments* arguments);
+void oidcd_workers_dispatchTokenBatch(struct ipcPipe pipes,
+                                      const char*    account_list,
+                                      const char* min_valid, const char* scope,
+                                      const char*             application_hint,
+                                      unsigned long           deadline_at_ms,
+                                      const struct arguments* arguments);
+void oidcd_workers_dispatchForward(struct ipcPipe pipes, const char* request,
+                                   unsigned long deadline_at_ms);
+void oidcd_workers_dispatchRefresh(struct ipcPipe pipes,
+                                   const char* short_name, time_t ahead,
+                                   const struct arguments* arguments);
+unsigned int oidcd_workers_jobsActive();
+int          oidcd_workers_cancelJob(unsigned long id);
+void         oidcd_workers_jobStarted();
+void         oidcd_workers_jobFinished();
+void         oidcd_workers_adoptThread();
+int          oidcd_workers_tryDeliverResponse(unsigned long id, char* response);
+char*        oidcd_workers_communicate(struct ipcPipe pipes, char* fmt, ...);
+
+#endif  // OIDCD_WORKERS_H
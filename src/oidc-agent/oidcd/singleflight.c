@@ -0,0 +1,82 @@
+#include "singleflight.h"
+#include "oidc-agent/oidcd/oidcd_workers.h"
+#include "utils/intern.h"
+#include "utils/logger.h"
+
+#include <pthread.h>
+
+/**
+ * Single-flight coalescing for concurrent token requests.
+ *
+ * When a batch job array starts, many clients request an access token for
+ * the same short name within the same second. Without coalescing each one
+ * that misses the validity window triggers its own refresh flow round trip -
+ * slow, and dangerous with issuers that rotate the refresh token on every
+ * use. A worker therefore enters the flight for its account before touching
+ * it; followers block until the leader is done and then find the freshly
+ * cached access token inside the validity window, so only one HTTP round
+ * trip is made.
+ */
+
+struct flight {
+  const char*  key;  // interned; owned by the intern table
+  unsigned int holders;
+};
+
+static pthread_mutex_t flight_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  flight_done = PTHREAD_COND_INITIALIZER;
+
+// There cannot be more concurrent flights than workers.
+static struct flight flights[WORKER_POOL_SIZE];
+
+// keys are interned, so finding a flight is a pointer comparison
+static struct flight* _findFlight(const char* key) {
+  for (unsigned char i = 0; i < WORKER_POOL_SIZE; i++) {
+    if (flights[i].holders > 0 && flights[i].key == key) {
+      return &flights[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief enters the flight for the given key, waiting for an already running
+ * one to finish first
+ *
+ * Has to be paired with a @c singleflight_leave call with the same key.
+ */
+void singleflight_enter(const char* key) {
+  if (key == NULL) {
+    return;
+  }
+  const char* ikey = intern(key);
+  pthread_mutex_lock(&flight_lock);
+  struct flight* flight;
+  while ((flight = _findFlight(ikey)) != NULL) {
+    logger(DEBUG, "Coalescing with in-flight request for '%s'", key);
+    pthread_cond_wait(&flight_done, &flight_lock);
+  }
+  for (unsigned char i = 0; i < WORKER_POOL_SIZE; i++) {
+    if (flights[i].holders == 0) {
+      flights[i].key     = ikey;
+      flights[i].holders = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&flight_lock);
+}
+
+void singleflight_leave(const char* key) {
+  if (key == NULL) {
+    return;
+  }
+  const char* ikey = intern(key);
+  pthread_mutex_lock(&flight_lock);
+  struct flight* flight = _findFlight(ikey);
+  if (flight != NULL) {
+    flight->holders = 0;
+    flight->key     = NULL;
+  }
+  pthread_cond_broadcast(&flight_done);
+  pthread_mutex_unlock(&flight_lock);
+}
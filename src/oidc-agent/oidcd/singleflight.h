@@ -0,0 +1,7 @@
+#ifndef OIDCD_SINGLEFLIGHT_H
+#define OIDCD_SINGLEFLIGHT_H
+
+void singleflight_enter(const char* key);
+void singleflight_leave(const char* key);
+
+#endif  // OIDCD_SINGLEFLIGHT_H
@@ -0,0 +1,132 @@
+#include "handoff.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "ipc/connection.h"
+#include "ipc/ipc.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Socket handoff between an outgoing and an incoming agent (--handoff).
+ *
+ * An unattended upgrade used to kill the agent and start a new one; between
+ * the unlink of the old socket and the bind of the new one clients saw
+ * connection refusals, and the socket path changed, invalidating every
+ * exported OIDC_SOCK. With the handoff the new agent connects to the
+ * running one and asks for its listening socket; the old agent passes the
+ * fd over the connection (SCM_RIGHTS), lets its oidcd workers write a
+ * final state snapshot and exits. The socket - path, backlog and queued
+ * clients included - stays alive throughout, so no client ever sees a
+ * refusal; combined with --restore the new agent also starts with the old
+ * one's loaded accounts.
+ */
+
+/**
+ * @brief passes @p listen_fd to the peer of @p msgsock
+ * The fd travels as SCM_RIGHTS ancillary data on a one byte message; the
+ * receiving side picks it up with @c recvmsg after reading the handoff
+ * response.
+ * @return an oidc_error code. oidc_errno is set properly.
+ */
+oidc_error_t handoff_sendSocket(int msgsock, int listen_fd) {
+  char          payload = 'F';
+  struct iovec  iov     = {.iov_base = &payload, .iov_len = 1};
+  char          cbuf[CMSG_SPACE(sizeof(int))];
+  memset(cbuf, 0, sizeof(cbuf));
+  struct msghdr mh  = {0};
+  mh.msg_iov        = &iov;
+  mh.msg_iovlen     = 1;
+  mh.msg_control    = cbuf;
+  mh.msg_controllen = sizeof(cbuf);
+  struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+  cm->cmsg_level     = SOL_SOCKET;
+  cm->cmsg_type      = SCM_RIGHTS;
+  cm->cmsg_len       = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cm), &listen_fd, sizeof(int));
+  if (sendmsg(msgsock, &mh, MSG_NOSIGNAL) != 1) {
+    logger(ERROR, "passing listen socket: %m");
+    oidc_errno = OIDC_EWRITE;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief receives the fd a successful handoff response is followed by
+ * @return the fd; @c -1 on error
+ */
+static int _receiveSocket(int sock) {
+  char          payload = 0;
+  struct iovec  iov     = {.iov_base = &payload, .iov_len = 1};
+  char          cbuf[CMSG_SPACE(sizeof(int))];
+  struct msghdr mh  = {0};
+  mh.msg_iov        = &iov;
+  mh.msg_iovlen     = 1;
+  mh.msg_control    = cbuf;
+  mh.msg_controllen = sizeof(cbuf);
+  if (recvmsg(sock, &mh, 0) != 1) {
+    logger(ERROR, "receiving listen socket: %m");
+    oidc_errno = OIDC_EIPCDIS;
+    return -1;
+  }
+  for (struct cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm != NULL;
+       cm = CMSG_NXTHDR(&mh, cm)) {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS &&
+        cm->cmsg_len == CMSG_LEN(sizeof(int))) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+      return fd;
+    }
+  }
+  logger(ERROR, "handoff message carried no socket");
+  oidc_errno = OIDC_EIPCDIS;
+  return -1;
+}
+
+/**
+ * @brief asks the agent listening on @p socket_path to hand its listening
+ * socket over
+ * The request is sent in plaintext, like a ping: nothing secret travels in
+ * band, and the old agent grants it only to a peer with its own uid.
+ * @return the adopted listening socket; @c -1 if there is no agent on
+ * @p socket_path or it declined. oidc_errno is set properly.
+ */
+int handoff_requestSocket(const char* socket_path) {
+  if (socket_path == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return -1;
+  }
+  struct connection con = {0};
+  if (initConnectionWithPath(&con, socket_path) != OIDC_SUCCESS) {
+    return -1;
+  }
+  if (ipc_connect(con) < 0) {
+    return -1;
+  }
+  int fd = -1;
+  if (ipc_write(*(con.sock), REQUEST_HANDOFF) == OIDC_SUCCESS) {
+    char* res = ipc_read(*(con.sock));
+    if (res != NULL) {
+      char* status = getJSONValueFromString(res, IPC_KEY_STATUS);
+      if (strequal(status, STATUS_SUCCESS)) {
+        fd = _receiveSocket(*(con.sock));
+      } else {
+        char* error = getJSONValueFromString(res, OIDC_KEY_ERROR);
+        oidc_seterror(error ?: "handoff declined");
+        oidc_errno = OIDC_EERROR;
+        secFree(error);
+      }
+      secFree(status);
+      secFree(res);
+    }
+  }
+  ipc_closeConnection(&con);
+  return fd;
+}
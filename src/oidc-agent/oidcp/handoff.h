@@ -0,0 +1,9 @@
+#ifndef OIDCP_HANDOFF_H
+#define OIDCP_HANDOFF_H
+
+#include "utils/oidc_error.h"
+
+int          handoff_requestSocket(const char* socket_path);
+oidc_error_t handoff_sendSocket(int msgsock, int listen_fd);
+
+#endif  // OIDCP_HANDOFF_H
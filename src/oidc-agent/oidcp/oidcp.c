@@ -1,30 +1,41 @@
 #define _XOPEN_SOURCE 500
 
 #include "oidcp.h"
+#include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
 #include "defines/settings.h"
+#include "ipc/compactIpc.h"
 #include "ipc/cryptIpc.h"
+#include "ipc/eventEngine.h"
 #include "ipc/pipe.h"
 #include "ipc/serveripc.h"
+#include "ipc/tokenMirror.h"
 #include "list/list.h"
 #include "oidc-agent/agent_state.h"
 #include "oidc-agent/daemonize.h"
 #include "oidc-agent/oidcd/oidcd.h"
+#include "oidc-agent/oidcp/handoff.h"
 #include "oidc-agent/oidcp/passwords/askpass.h"
 #include "oidc-agent/oidcp/passwords/password_handler.h"
 #include "oidc-agent/oidcp/passwords/password_store.h"
 #include "oidc-agent/oidcp/proxy_handler.h"
+#include "oidc-agent/oidcp/slo.h"
+#include "oidc-agent/requestType.h"
 #ifndef __APPLE__
 #include "privileges/agent_privileges.h"
 #endif
+#include "utils/agent_metrics.h"
+#include "utils/agent_trace.h"
 #include "utils/crypt/crypt.h"
+#include "utils/crypt/memoryCrypt.h"
 #include "utils/db/connection_db.h"
 #include "utils/disableTracing.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/memzero.h"
 #include "utils/printer.h"
 #include "utils/stringUtils.h"
 
@@ -33,44 +44,87 @@
 #ifndef __APPLE__
 #include <sys/prctl.h>
 #endif
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
-struct ipcPipe startOidcd(const struct arguments* arguments) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    logger(ERROR, "could not create pipes");
-    exit(EXIT_FAILURE);
-  }
-  pid_t ppid_before_fork = getpid();
-  pid_t pid              = fork();
-  if (pid == -1) {
-    logger(ERROR, "fork %m");
-    exit(EXIT_FAILURE);
+// pids of the forked oidcd workers; the watchdog signals them for a stage
+// dump
+static pid_t oidcd_pids[EVENT_ENGINE_MAX_PIPES];
+// pipe pair per oidcd worker; with one worker (the default) only slot 0 is
+// used and everything behaves as it did with a single oidcd
+static struct ipcPipe shard_pipes[EVENT_ENGINE_MAX_PIPES];
+static unsigned int   shard_count = 1;
+
+/**
+ * @brief forks the oidcd workers (--shards, default one)
+ *
+ * Every worker is a complete oidcd with its own pipe pair, account db,
+ * http connections and secret memory; nothing is shared between them.
+ * Accounts are assigned to workers by a stable hash of their short name
+ * (see @c _shardFor), so an account's state lives in exactly one worker.
+ */
+void startOidcd(struct arguments* arguments) {
+  shard_count = arguments->shards > 1 ? (unsigned int)arguments->shards : 1;
+  if (shard_count > EVENT_ENGINE_MAX_PIPES) {
+    logger(WARNING, "--shards is capped at %d", EVENT_ENGINE_MAX_PIPES);
+    shard_count = EVENT_ENGINE_MAX_PIPES;
   }
-  if (pid == 0) {  // child
-#ifndef __APPLE__
-    // init child so that it exists if parent (oidcp) is killed.
-    int r = prctl(PR_SET_PDEATHSIG, SIGTERM);
-    if (r == -1) {
-      logger(ERROR, "prctl %m");
+  arguments->shards = shard_count;  // the workers derive their share of
+                                    // preload and snapshot work from it
+  for (unsigned int i = 0; i < shard_count; i++) {
+    struct pipeSet pipes = ipc_pipe_init();
+    if (pipes.pipe1.rx == -1) {
+      logger(ERROR, "could not create pipes");
       exit(EXIT_FAILURE);
     }
-#endif
-    // test in case the original parent exited just before the prctl() call
-    if (getppid() != ppid_before_fork) {
-      logger(ERROR, "Parent died shortly after fork");
+    pid_t ppid_before_fork = getpid();
+    pid_t pid              = fork();
+    if (pid == -1) {
+      logger(ERROR, "fork %m");
       exit(EXIT_FAILURE);
     }
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    oidcd_main(childPipes, arguments);
-    exit(EXIT_FAILURE);
-  } else {  // parent
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return parentPipes;
+    if (pid == 0) {  // child
+#ifndef __APPLE__
+      // init child so that it exists if parent (oidcp) is killed.
+      int r = prctl(PR_SET_PDEATHSIG, SIGTERM);
+      if (r == -1) {
+        logger(ERROR, "prctl %m");
+        exit(EXIT_FAILURE);
+      }
+#endif
+      // test in case the original parent exited just before the prctl() call
+      if (getppid() != ppid_before_fork) {
+        logger(ERROR, "Parent died shortly after fork");
+        exit(EXIT_FAILURE);
+      }
+      for (unsigned int j = 0; j < i; j++) {
+        ipc_closePipes(shard_pipes[j]);  // the other workers' pipe ends
+                                         // belong to oidcp
+      }
+      arguments->shard          = i;
+      struct ipcPipe childPipes = toClientPipes(pipes);
+      oidcd_main(childPipes, arguments);
+      exit(EXIT_FAILURE);
+    }  // parent
+    oidcd_pids[i]  = pid;
+    shard_pipes[i] = toServerPipes(pipes);
   }
 }
 
+/**
+ * @brief leaves through exit() on SIGTERM
+ *
+ * oidc-agent -k and service managers stop the agent with SIGTERM. Exiting
+ * instead of taking the default action flushes stdio and lets instrumented
+ * builds (`make pgo`) write their profile data. Installed before oidcd is
+ * forked, so the workers inherit it.
+ */
+static void _handleSigTerm(int sig) {
+  (void)sig;
+  exit(EXIT_SUCCESS);
+}
+
 int main(int argc, char** argv) {
   platform_disable_tracing();
   logger_open("oidc-agent.p");
@@ -90,7 +144,6 @@ int main(int argc, char** argv) {
     initOidcAgentPrivileges(&arguments);
   }
 #endif
-  initCrypt();
   if (arguments.kill_flag) {
     char* pidstr = getenv(OIDC_PID_ENV_NAME);
     if (pidstr == NULL) {
@@ -106,8 +159,16 @@ int main(int argc, char** argv) {
       perror("kill");
       exit(EXIT_FAILURE);
     } else {
-      unlink(getenv(OIDC_SOCK_ENV_NAME));
-      rmdir(dirname(getenv(OIDC_SOCK_ENV_NAME)));
+      const char* sock = getenv(OIDC_SOCK_ENV_NAME);
+      if (sock != NULL) {
+        unlink(sock);
+        char* mirror = tokenMirror_pathFor(sock);
+        unlink(mirror);  // may not exist; the rmdir needs an empty dir
+        secFree(mirror);
+        char* sock_copy = oidc_strcopy(sock);  // dirname may modify its arg
+        rmdir(dirname(sock_copy));  // per-agent dir in both socket dir schemes
+        secFree(sock_copy);
+      }
       printf("unset %s;\n", OIDC_SOCK_ENV_NAME);
       printf("unset %s;\n", OIDC_PID_ENV_NAME);
       printf("echo Agent pid %d killed;\n", pid);
@@ -116,146 +177,1011 @@ int main(int argc, char** argv) {
   }
 
   struct connection* listencon = secAlloc(sizeof(struct connection));
-  if (ipc_server_init(listencon, OIDC_SOCK_ENV_NAME, arguments.group) !=
-      OIDC_SUCCESS) {
+  int                handoff_fd = -1;
+  if (arguments.handoff) {
+    const char* running_sock = getenv(OIDC_SOCK_ENV_NAME);
+    if (running_sock != NULL) {
+      handoff_fd = handoff_requestSocket(running_sock);
+    }
+    if (handoff_fd < 0) {
+      // no running agent or it declined; a normal start keeps unattended
+      // upgrades working when there is nothing to take over
+      logger(WARNING, "Socket handoff failed (%s); doing a normal start",
+             oidc_serror());
+    }
+  }
+  if (handoff_fd >= 0) {
+    if (ipc_server_adoptFd(listencon, handoff_fd, OIDC_SOCK_ENV_NAME) !=
+        OIDC_SUCCESS) {
+      printError("%s\n", oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+  } else if (ipc_server_init(listencon, OIDC_SOCK_ENV_NAME, arguments.group) !=
+             OIDC_SUCCESS) {
     printError("%s\n", oidc_serror());
     exit(EXIT_FAILURE);
   }
-  if (!arguments.console) {
+  if (!arguments.console && !ipc_socketActivated()) {
+    // under socket activation systemd supervises the agent process itself;
+    // forking away from it would end the service
     daemonize();
   }
 
+  // Clients may disconnect while their connection idles in the pool; a write
+  // to such a socket must fail with EPIPE instead of killing the agent.
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGTERM, _handleSigTerm);
+
   agent_state.defaultTimeout = arguments.lifetime;
-  struct ipcPipe pipes       = startOidcd(&arguments);
+  agent_state.maxAccounts    = arguments.max_accounts;
+  agent_state.portRangeMin   = arguments.port_range_min;
+  agent_state.portRangeMax   = arguments.port_range_max;
+  startOidcd(&arguments);
 
-  ipc_bindAndListen(listencon);
+  if (handoff_fd < 0) {  // an adopted socket is already listening
+    ipc_bindAndListen(listencon);
+  }
+  if (arguments.net_listener != NULL &&
+      ipc_bindAndListenNet(arguments.net_listener) != OIDC_SUCCESS) {
+    printError("%s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
 
-  handleClientComm(listencon, pipes, &arguments);
+  initCrypt();  // needed only for the per-client crypto, so it runs after the
+                // socket is up and oidcd is forked; oidcd seeds its own
+  initMemoryCrypt();  // session key for the password store's in-memory
+                      // secretbox containers
+
+  slo_start(&arguments);  // no-op without --slo
+
+  handleClientComm(listencon, &arguments);
 
   return EXIT_FAILURE;
 }
 
-void handleClientComm(struct connection* listencon, struct ipcPipe pipes,
-                      const struct arguments* arguments) {
+/**
+ * A client request that was forwarded to oidcd and is waiting for its final
+ * answer. The connection stays in the pool until the response with the
+ * matching id comes back through the pipe; the encryption key set popped
+ * after reading the request is kept here so responses can be written in any
+ * order.
+ */
+struct in_flight {
+  unsigned long      id;
+  struct connection* con;
+  struct ipc_keySet* keys;
+  char*              op;       // request type; key for the latency metrics
+  char*              account;  // short name, if the request carries one
+  unsigned long      read_ms;  // when the request was read from the client
+  unsigned char      is_metrics;  // the response gets the proxy metrics added
+  unsigned char      wd_state;    // how far the watchdog escalated for it
+  uid_t              uid;         // peer uid; key for the per-tenant quota
+  unsigned int       shard;       // the oidcd worker the request went to
+  unsigned char      pending;     // worker answers still outstanding; only
+                                  // more than 1 for a broadcast request
+  char** shard_res;  // per-worker answers of a broadcast request, indexed
+                     // by shard; NULL for a routed request
+};
+
+static list_t*       in_flight_list  = NULL;
+
+// health data served by oidcp itself: start time for the uptime, the last
+// account summary oidcd pushed, and counters over the responses handled
+static time_t        oidcp_start           = 0;
+static char*         oidcd_status          = NULL;
+// with several workers each pushes its own summary; oidcd_status holds the
+// merged view served to health probes
+static char*         oidcd_shard_status[EVENT_ENGINE_MAX_PIPES];
+static time_t        oidcd_status_at       = 0;
+static unsigned long error_response_count  = 0;
+static unsigned long dropped_clients_count = 0;
+
+// whether --multi-tenant was given; cached here so the request path does
+// not need the arguments struct
+static unsigned char multi_tenant_mode = 0;
+static unsigned long next_request_id = 0;
+
+/**
+ * maximum number of requests waiting in oidcd at once; above this new
+ * requests get an explicit busy answer so clients back off and retry
+ * instead of queueing up to a timeout. Can be overridden at build time.
+ */
+#ifndef OIDCP_MAX_IN_FLIGHT
+#define OIDCP_MAX_IN_FLIGHT 64
+#endif
+
+/**
+ * maximum number of in-flight requests a single uid may hold in
+ * multi-tenant mode, so one user saturating the agent does not starve the
+ * other tenants. Can be overridden at build time.
+ */
+#ifndef OIDCP_TENANT_MAX_IN_FLIGHT
+#define OIDCP_TENANT_MAX_IN_FLIGHT 16
+#endif
+
+/**
+ * after how many seconds waiting on oidcd an in-flight request is logged
+ * (first threshold) and oidcd is signaled for a stage dump (second
+ * threshold). Can be overridden at build time.
+ */
+#ifndef OIDCP_WATCHDOG_WARN_SECS
+#define OIDCP_WATCHDOG_WARN_SECS 10
+#endif
+#ifndef OIDCP_WATCHDOG_DUMP_SECS
+#define OIDCP_WATCHDOG_DUMP_SECS 30
+#endif
+
+static size_t inFlightCountForUid(uid_t uid) {
+  size_t           count = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(in_flight_list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (((struct in_flight*)node->val)->uid == uid) {
+      count++;
+    }
+  }
+  list_iterator_destroy(it);
+  return count;
+}
+
+static struct in_flight* findInFlight(unsigned long id) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(in_flight_list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct in_flight* e = node->val;
+    if (e->id == id) {
+      list_iterator_destroy(it);
+      return e;
+    }
+  }
+  list_iterator_destroy(it);
+  return NULL;
+}
+
+static void _secFreeInFlight(struct in_flight* e) {
+  if (e->keys != NULL) {
+    secFreeIpcKeySet(e->keys);
+  }
+  if (e->shard_res != NULL) {
+    for (unsigned int i = 0; i < shard_count; i++) {
+      secFree(e->shard_res[i]);
+    }
+    secFree(e->shard_res);
+  }
+  secFree(e->op);
+  secFree(e->account);
+  secFree(e);
+}
+
+static void removeInFlight(struct in_flight* e) {
+  list_node_t* node = list_find(in_flight_list, e);
+  if (node != NULL) {
+    list_remove(in_flight_list, node);
+  }
+  _secFreeInFlight(e);
+}
+
+/**
+ * @brief removes a client connection and all in-flight requests attached to
+ * it from the pools
+ *
+ * oidcd gets a cancel note for every request that was still in flight so a
+ * job the client no longer waits for does not occupy a worker.
+ */
+static void dropClient(struct connection* con) {
+  dropped_clients_count++;
+  unsigned long    start_us = agent_metrics_now_us();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(in_flight_list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct in_flight* e = node->val;
+    if (e->con == con) {
+      // a broadcast request occupies every worker; cancel it everywhere
+      unsigned int first = e->shard_res != NULL ? 0 : e->shard;
+      unsigned int last  = e->shard_res != NULL ? shard_count - 1 : e->shard;
+      for (unsigned int s = first; s <= last; s++) {
+        struct ipcPipe pipes = shard_pipes[s];
+        pipes.id             = e->id;
+        if (ipc_writeToPipe(pipes, "%s", REQUEST_CANCEL) != OIDC_SUCCESS &&
+            oidc_errno == OIDC_EIPCDIS) {
+          logger(ERROR, "oidcd died");
+          exit(EXIT_FAILURE);
+        }
+      }
+      list_remove(in_flight_list, node);
+      _secFreeInFlight(e);
+    }
+  }
+  list_iterator_destroy(it);
+  logger(DEBUG, "Remove con from pool");
+  compactIpc_unmarkSock(*(con->msgsock));
+  connectionDB_removeIfFound(con);
+  logger(DEBUG, "Currently there are %lu connections", connectionDB_getSize());
+  agent_metrics_record("loop_cleanup_us", agent_metrics_now_us() - start_us);
+}
+
+/**
+ * @brief the oidcd worker that owns the account named \p name
+ *
+ * The worker count is fixed for the lifetime of the agent and the hash is
+ * stable across processes and restarts, so the same account always lands
+ * on the same worker - its state is never split between workers, and a
+ * worker's preload and snapshot cover exactly its own accounts.
+ */
+static unsigned int _shardFor(const char* name) {
+  if (shard_count <= 1 || !strValid(name)) {
+    return 0;
+  }
+  return oidc_strhash(name) % shard_count;
+}
+
+/**
+ * @brief forwards a client request to oidcd tagged with a fresh request id
+ *
+ * With several workers the request is routed by the account short name -
+ * taken from the request itself, or from the carried account config for
+ * add/gen style requests; a request naming only the issuer is routed by
+ * the issuer. A request with no account affinity at all (account list,
+ * lock, metrics, a pending auth code flow known only by its state) is
+ * broadcast to every worker and the answers are combined in
+ * @c _combineShardResponses; a token batch is split so every worker only
+ * sees the accounts it owns. The answer comes back asynchronously through
+ * the pipe and is routed by @c handleOidcdMsg, so the main loop can keep
+ * servicing other clients while oidcd works.
+ */
+static void forwardToOidcd(struct connection* con, const char* msg,
+                           const char* request_type, const char* account,
+                           const char* issuer, const char* config,
+                           const char* account_list, unsigned long read_ms) {
+  struct in_flight* e = secAlloc(sizeof(struct in_flight));
+  e->id               = ++next_request_id;
+  e->con              = con;
+  e->keys             = server_ipc_popLastKey(*(con->msgsock));
+  e->op               = oidc_strcopy(request_type);
+  e->account          = oidc_strcopy(account);
+  e->read_ms          = read_ms;
+  e->is_metrics       = strequal(request_type, REQUEST_VALUE_METRICS);
+  e->uid              = con->peer_uid;
+  e->pending          = 1;
+  unsigned char split = 0;
+  if (strValid(account)) {
+    e->shard = _shardFor(account);
+  } else if (strValid(account_list) && shard_count > 1) {
+    // a token batch or bulk load names several accounts; each worker gets
+    // the sub-batch it owns, so no worker touches (or autoloads) accounts
+    // of another
+    split        = 1;
+    e->pending   = 0;  // counted per written worker below
+    e->shard_res = secAlloc(sizeof(char*) * shard_count);
+  } else if (strValid(config)) {
+    // add/gen/delete requests carry the short name inside the account config
+    cJSON* obj  = stringToJson(config);
+    char*  name = getJSONValue(obj, AGENT_KEY_SHORTNAME);
+    e->shard    = _shardFor(name);
+    secFree(name);
+    secFreeJson(obj);
+  } else if (strValid(issuer)) {
+    // requests naming the account only by its issuer land on the issuer's
+    // worker; an account loaded by short name on another worker may then
+    // be autoloaded a second time - wasteful but harmless, refresh token
+    // updates are persisted centrally by oidcp either way
+    e->shard = _shardFor(issuer);
+  } else if (shard_count > 1) {
+    e->pending   = shard_count;
+    e->shard_res = secAlloc(sizeof(char*) * shard_count);
+  }
+  list_rpush(in_flight_list, list_node_new(e));
+  char* tagged = NULL;
+  if (multi_tenant_mode) {
+    // tag the request with the sender's uid so oidcd attributes its work
+    // (log lines, stage dumps) to the tenant
+    cJSON* obj = stringToJson(msg);
+    if (obj != NULL) {
+      jsonAddNumberValue(obj, IPC_KEY_TENANT, con->peer_uid);
+      tagged = jsonToStringUnformatted(obj);
+      secFreeJson(obj);
+    }
+  }
+  cJSON* entries = split ? stringToJson(account_list) : NULL;
+  if (split && (entries == NULL || cJSON_GetArraySize(entries) == 0)) {
+    split = 0;  // let one worker answer the bad-request error
+    secFree(e->shard_res);
+    e->shard_res = NULL;
+    e->pending   = 1;
+  }
+  unsigned int first = e->shard_res != NULL ? 0 : e->shard;
+  unsigned int last  = e->shard_res != NULL ? shard_count - 1 : e->shard;
+  for (unsigned int s = first; s <= last; s++) {
+    char* submsg = NULL;
+    if (split) {
+      cJSON* sub = cJSON_CreateArray();
+      int    num = cJSON_GetArraySize(entries);
+      for (int i = 0; i < num; i++) {
+        cJSON* el = cJSON_GetArrayItem(entries, i);
+        // a token batch entry is the short name itself; a bulk load entry
+        // is an object naming its account
+        char* name = cJSON_IsString(el) ? oidc_strcopy(el->valuestring)
+                                        : getJSONValue(el, IPC_KEY_SHORTNAME);
+        if (_shardFor(name) == s) {
+          cJSON_AddItemToArray(sub, cJSON_Duplicate(el, cJSON_True));
+        }
+        secFree(name);
+      }
+      if (cJSON_GetArraySize(sub) == 0) {  // this worker owns none of them
+        secFreeJson(sub);
+        continue;
+      }
+      cJSON* req = stringToJson(tagged ?: msg);
+      if (req == NULL) {
+        secFreeJson(sub);
+        continue;
+      }
+      cJSON_ReplaceItemInObject(req, IPC_KEY_ACCOUNTLIST, sub);
+      submsg = jsonToStringUnformatted(req);
+      secFreeJson(req);
+      if (submsg == NULL) {
+        continue;
+      }
+      e->pending++;
+    }
+    struct ipcPipe pipes = shard_pipes[s];
+    pipes.id             = e->id;
+    oidc_error_t werr =
+        ipc_writeToPipe(pipes, "%s", submsg ?: (tagged ?: (char*)msg));
+    secFree(submsg);
+    if (werr != OIDC_SUCCESS) {
+      if (oidc_errno == OIDC_EIPCDIS) {
+        logger(ERROR, "oidcd died");
+        exit(EXIT_FAILURE);
+      }
+      server_ipc_writeOidcErrnoWithKey(*(con->msgsock), e->keys);
+      removeInFlight(e);
+      dropClient(con);
+      break;
+    }
+  }
+  secFreeJson(entries);
+  secFree(tagged);
+}
+
+/**
+ * @brief logs in-flight requests that wait on oidcd for too long
+ *
+ * First threshold: the request type, account and elapsed time are logged
+ * and a latency sample is recorded under 'watchdog_stall', so stalls show
+ * up in the metrics response. Second threshold: oidcd gets a SIGUSR2 and
+ * dumps the stage it is currently in (request type, https endpoint), which
+ * names the endpoint a production stall is sitting on.
+ */
+static void watchdog_check() {
+  unsigned long    now_ms = agent_metrics_now_ms();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(in_flight_list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct in_flight* e       = node->val;
+    unsigned long     elapsed = now_ms - e->read_ms;
+    if (e->wd_state == 0 && elapsed >= OIDCP_WATCHDOG_WARN_SECS * 1000UL) {
+      logger(WARNING,
+             "watchdog: request '%s'%s%s (id %lu) waiting on oidcd for %lu ms",
+             e->op, strValid(e->account) ? " for account " : "",
+             strValid(e->account) ? e->account : "", e->id, elapsed);
+      agent_metrics_record("watchdog_stall", elapsed);
+      e->wd_state = 1;
+    }
+    if (e->wd_state == 1 && elapsed >= OIDCP_WATCHDOG_DUMP_SECS * 1000UL) {
+      logger(ERROR,
+             "watchdog: request '%s' (id %lu) still waiting after %lu ms; "
+             "asking oidcd for a stage dump",
+             e->op, e->id, elapsed);
+      kill(oidcd_pids[e->shard], SIGUSR2);
+      e->wd_state = 2;
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief when the watchdog next needs to look at the in-flight requests
+ * @return an absolute time or @c 0 if nothing is in flight
+ */
+static time_t watchdog_nextAt() {
+  unsigned long    now_ms  = agent_metrics_now_ms();
+  unsigned long    next_ms = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(in_flight_list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct in_flight* e = node->val;
+    if (e->wd_state >= 2) {
+      continue;
+    }
+    unsigned long at =
+        e->read_ms + (e->wd_state == 0 ? OIDCP_WATCHDOG_WARN_SECS
+                                       : OIDCP_WATCHDOG_DUMP_SECS) *
+                         1000UL;
+    if (next_ms == 0 || at < next_ms) {
+      next_ms = at;
+    }
+  }
+  list_iterator_destroy(it);
+  if (next_ms == 0) {
+    return 0;
+  }
+  return time(NULL) + (next_ms > now_ms ? (next_ms - now_ms) / 1000 : 0) + 1;
+}
+
+/**
+ * @brief lists the optional fast paths this agent supports
+ * @return a comma separated list of json strings for the ping response
+ */
+static const char* ping_features() {
+  const char* mirror = getenv(OIDC_TOKEN_MIRROR_ENV_NAME);
+  return strValid(mirror) && !strequal(mirror, "0")
+             ? "\"compact_ipc\",\"batch_tokens\",\"token_mirror\""
+             : "\"compact_ipc\",\"batch_tokens\"";
+}
+
+/**
+ * @brief returns the sealing key of this agent session, generating it on
+ * first use
+ * oidc-gen seals the state it leaves between two invocations of a flow
+ * with this key, so those files are only readable while this agent is
+ * running. The key lives in oidcp - the one process every request passes
+ * through - so it is the same key no matter which oidcd worker a request
+ * would be routed to, and it dies with the session.
+ * @return the key, base64 encoded
+ */
+static const char* genSessionKeyBase64() {
+  static char* key_base64 = NULL;
+  if (key_base64 == NULL) {
+    unsigned char key[CRYPT_SEAL_KEY_LEN];
+    secRandomFill(key, sizeof(key));
+    key_base64 = toBase64((char*)key, sizeof(key));
+    moresecure_memzero(key, sizeof(key));
+  }
+  return key_base64;
+}
+
+void handleClientComm(struct connection* listencon,
+                      struct arguments*  arguments) {
   connectionDB_new();
   connectionDB_setFreeFunction((void (*)(void*)) & _secFreeConnection);
   connectionDB_setMatchFunction((matchFunction)connection_comparator);
+  connectionDB_setFdKey((db_fdExtractor)connection_getSockFd);
+  in_flight_list = list_new();
+  ipc_keyPairPool_refill();
+  oidcp_start       = time(NULL);
+  multi_tenant_mode = arguments->multi_tenant;
 
   time_t minDeath = 0;
+  // Loop stall profiling: everything below runs inline on the loop, so any
+  // stall here delays all clients. Each iteration's time outside the
+  // select is measured from right after it returns to right before it is
+  // entered again and recorded (in microseconds) under loop_iteration_us;
+  // the branches attribute their share to a phase histogram, so a creeping
+  // loop_iteration_us distribution names the phase responsible.
+  unsigned long loop_work_start = 0;
   while (1) {
-    minDeath = getMinPasswordDeath();
+    agent_trace_end();  // each event handled below starts or adopts its own
+    watchdog_check();
+    minDeath        = getMinPasswordDeath();
+    time_t wdAt     = watchdog_nextAt();
+    if (wdAt != 0 && (minDeath == 0 || wdAt < minDeath)) {
+      minDeath = wdAt;
+    }
+    int pipe_fds[EVENT_ENGINE_MAX_PIPES];
+    for (unsigned int i = 0; i < shard_count; i++) {
+      pipe_fds[i] = shard_pipes[i].rx;
+    }
+    int ready_pipe = -1;
+    if (loop_work_start != 0) {
+      agent_metrics_record("loop_iteration_us",
+                           agent_metrics_now_us() - loop_work_start);
+    }
     struct connection* con =
-        ipc_readAsyncFromMultipleConnectionsWithTimeout(*listencon, minDeath);
+        ipc_readAsyncFromMultipleConnectionsWithTimeoutAndPipes(
+            *listencon, pipe_fds, shard_count, minDeath, &ready_pipe);
+    loop_work_start = agent_metrics_now_us();
+    if (ready_pipe >= 0) {  // a message from an oidcd worker is available
+      handleOidcdMsg((unsigned int)ready_pipe);
+      agent_metrics_record("loop_oidcd_msg_us",
+                           agent_metrics_now_us() - loop_work_start);
+      continue;
+    }
     if (con == NULL) {  // timeout reached
       removeDeathPasswords();
+      agent_metrics_record("loop_pw_expiry_us",
+                           agent_metrics_now_us() - loop_work_start);
+      ipc_keyPairPool_refill();  // idle time: precompute handshake keypairs
       continue;
     }
     char* q = server_ipc_read(*(con->msgsock));
+    agent_metrics_record("loop_read_us",
+                         agent_metrics_now_us() - loop_work_start);
     if (q == NULL) {
       server_ipc_writeOidcErrnoPlain(*(con->msgsock));
-    } else {  // NULL != q
-      INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_PASSWORDENTRY, IPC_KEY_SHORTNAME);
-      if (CALL_GETJSONVALUES(q) < 0) {
-        server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST, oidc_serror());
-      } else {
-        KEY_VALUE_VARS(request, passwordentry, shortname);
-        if (_request) {
-          if (strequal(_request, REQUEST_VALUE_ADD) ||
-              strequal(_request, REQUEST_VALUE_GEN)) {
-            pw_handleSave(_passwordentry, arguments->pw_lifetime);
-          } else if (strequal(_request, REQUEST_VALUE_REMOVE)) {
-            removePasswordFor(_shortname);
-          } else if (strequal(_request, REQUEST_VALUE_REMOVEALL)) {
-            removeAllPasswords();
+      dropClient(con);
+      continue;
+    }
+    unsigned long read_ms = agent_metrics_now_ms();
+    INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_PASSWORDENTRY, IPC_KEY_SHORTNAME,
+                   IPC_KEY_PWLIFETIME, IPC_KEY_ISSUERURL, IPC_KEY_CONFIG,
+                   IPC_KEY_ACCOUNTLIST);
+    if (CALL_GETJSONVALUES(q) < 0) {
+      server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST, oidc_serror());
+      dropClient(con);
+    } else {
+      KEY_VALUE_VARS(request, passwordentry, shortname, pw_lifetime, issuer,
+                     config, account_list);
+      if (_request) {
+        enum request_type req = requestType(_request);
+        if (req == REQ_TYPE_PING) {
+          // answered by oidcp itself, before any oidcd forwarding and - since
+          // the probe arrives unencrypted and no key was stored - in
+          // plaintext: liveness and feature discovery cost one round trip
+          // with no crypto. The connection stays pooled so the client can
+          // continue with real requests on it.
+          server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS_PING, VERSION,
+                           ping_features());
+          agent_metrics_record(REQUEST_VALUE_PING,
+                               agent_metrics_now_ms() - read_ms);
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;
+        }
+        if (req == REQ_TYPE_HEALTH) {
+          // answered by oidcp from cached data: a monitoring probe must not
+          // cost a token issuance or even a pipe round trip. The account
+          // summary is whatever oidcd last pushed; status_age tells the
+          // monitor how old it is (-1 before the first push).
+          server_ipc_write(
+              *(con->msgsock), RESPONSE_SUCCESS_HEALTH,
+              (unsigned long)(time(NULL) - oidcp_start), error_response_count,
+              dropped_clients_count,
+              oidcd_status != NULL ? (long)(time(NULL) - oidcd_status_at)
+                                   : -1L,
+              oidcd_status ?: "{\"loaded_accounts\":0,\"accounts\":[]}");
+          agent_metrics_record(REQUEST_VALUE_HEALTH,
+                               agent_metrics_now_ms() - read_ms);
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;
+        }
+        if (req == REQ_TYPE_HANDOFF) {
+          if (con->is_net || con->peer_uid != getuid()) {
+            server_ipc_write(*(con->msgsock), RESPONSE_ERROR,
+                             "handoff is only granted to the agent owner on "
+                             "the local socket");
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;
+          }
+          logger(NOTICE, "Handing the agent socket off and shutting down");
+          // closing the pipes is how a shutdown looks to oidcd: the workers
+          // write their final snapshot and exit. Waiting for them before
+          // answering guarantees the successor's --restore sees the
+          // freshest state; requests already forwarded are dropped, their
+          // clients reconnect to the successor on the same socket.
+          for (unsigned int i = 0; i < shard_count; i++) {
+            ipc_closePipes(shard_pipes[i]);
+          }
+          for (unsigned int i = 0; i < shard_count; i++) {
+            waitpid(oidcd_pids[i], NULL, 0);
           }
-          handleOidcdComm(pipes, *(con->msgsock), q);
-        } else {  //  no request type
-          server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST,
-                           "No request type.");
+          server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS);
+          handoff_sendSocket(*(con->msgsock), *(listencon->sock));
+          exit(EXIT_SUCCESS);
         }
+        if (req == REQ_TYPE_GENSESSIONKEY) {
+          // answered by oidcp itself so every client of this session gets
+          // the same key regardless of oidcd sharding; the request arrives
+          // through the encrypted channel, so the key does too
+          server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS_INFO,
+                           genSessionKeyBase64());
+          agent_metrics_record(REQUEST_VALUE_GENSESSIONKEY,
+                               agent_metrics_now_ms() - read_ms);
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;
+        }
+        if (in_flight_list->len >= OIDCP_MAX_IN_FLIGHT) {
+          // oidcd already has its hands full; answering busy now is
+          // backpressure the client can react to, and it keeps the side
+          // effects below from running for a request that is not forwarded
+          server_ipc_write(*(con->msgsock), RESPONSE_ERROR,
+                           "Agent is busy, please try again later.");
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;
+        }
+        if (multi_tenant_mode && inFlightCountForUid(con->peer_uid) >=
+                                     OIDCP_TENANT_MAX_IN_FLIGHT) {
+          // per-tenant backpressure: the shared limit above could
+          // otherwise be filled entirely by one user
+          server_ipc_write(*(con->msgsock), RESPONSE_ERROR,
+                           "Agent is busy, please try again later.");
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;
+        }
+        unsigned long handle_start_us = agent_metrics_now_us();
+        switch (req) {
+          case REQ_TYPE_RELOAD:
+            // the pw lifetime is oidcp state; the rest of the settings are
+            // applied by oidcd, which also sends the final response
+            if (strValid(_pw_lifetime)) {
+              arguments->pw_lifetime.lifetime    = strToULong(_pw_lifetime);
+              arguments->pw_lifetime.argProvided = 1;
+            }
+            break;
+          case REQ_TYPE_ADD:
+          case REQ_TYPE_GEN:
+            pw_handleSave(_passwordentry, arguments->pw_lifetime);
+            break;
+          case REQ_TYPE_REMOVE: removePasswordFor(_shortname); break;
+          case REQ_TYPE_REMOVEALL: removeAllPasswords(); break;
+          default:  // everything else is oidcd's business; forwarded below
+            break;
+        }
+        forwardToOidcd(con, q, _request, _shortname, _issuer, _config,
+                       _account_list,
+                       read_ms);  // the connection stays in the pool
+                                  // until the final answer arrives
+        // dominated by pw_handleSave's encryption work on add/gen; the
+        // pipe write is non-blocking in practice
+        agent_metrics_record("loop_handle_us",
+                             agent_metrics_now_us() - handle_start_us);
+      } else {  //  no request type
+        server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST,
+                         "No request type.");
+        dropClient(con);
       }
-      SEC_FREE_KEY_VALUES();
-      secFree(q);
     }
-    logger(DEBUG, "Remove con from pool");
-    connectionDB_removeIfFound(con);
-    logger(DEBUG, "Currently there are %lu connections",
-           connectionDB_getSize());
+    SEC_FREE_KEY_VALUES();
+    secFree(q);
   }
 }
 
-void handleOidcdComm(struct ipcPipe pipes, int sock, const char* msg) {
-  char* send = oidc_strcopy(msg);
-  INIT_KEY_VALUE(IPC_KEY_REQUEST, OIDC_KEY_REFRESHTOKEN, IPC_KEY_SHORTNAME,
-                 IPC_KEY_APPLICATIONHINT, IPC_KEY_ISSUERURL);
-  while (1) {
-    // RESET_KEY_VALUE_VALUES_TO_NULL();
-    char* oidcd_res = ipc_communicateThroughPipe(pipes, send);
-    secFree(send);
-    if (oidcd_res == NULL) {
-      if (oidc_errno == OIDC_EIPCDIS) {
-        logger(ERROR, "oidcd died");
-        exit(EXIT_FAILURE);
-      }
-      logger(ERROR, "no response from oidcd");
-      server_ipc_writeOidcErrno(sock);
-      return;
-    }  // oidcd_res!=NULL
-       // check response, it might be an internal request
-    if (CALL_GETJSONVALUES(oidcd_res) < 0) {
-      server_ipc_write(sock, RESPONSE_BADREQUEST, oidc_serror());
-      secFree(oidcd_res);
-      SEC_FREE_KEY_VALUES();
-      return;
+/**
+ * @brief adds oidcp's own request metrics to a metrics response from oidcd
+ *
+ * oidcp and oidcd are separate processes; oidcd cannot see the client wall
+ * times measured here. The gap between a type's wall time in 'proxy' and
+ * its handler time in 'agent' is the pipe and queueing overhead.
+ * @return the amended response, or @c NULL if \p msg could not be amended
+ * (the caller then forwards it unchanged). Has to be freed after usage.
+ */
+static char* _addProxyMetrics(const char* msg) {
+  cJSON* obj = stringToJson(msg);
+  if (obj == NULL) {
+    return NULL;
+  }
+  cJSON* metrics = getJSONItem(obj, IPC_KEY_METRICS);  // owned by obj
+  if (metrics == NULL) {  // e.g. an error response
+    secFreeJson(obj);
+    return NULL;
+  }
+  char* proxy = agent_metrics_toJSON();
+  if (proxy != NULL) {
+    jsonAddObjectValue(metrics, "proxy", proxy);
+    secFree(proxy);
+  }
+  char* res = jsonToStringUnformatted(obj);
+  secFreeJson(obj);
+  return res;
+}
+
+/**
+ * @brief merges the workers' account summaries for the health response
+ *
+ * With one worker this is a plain copy. With several, the per-worker
+ * account lists are concatenated and the loaded account counts summed, so
+ * the health response describes the whole agent and not one worker.
+ * @return the merged summary. Has to be freed after usage.
+ */
+static char* _mergedShardStatus() {
+  if (shard_count <= 1) {
+    return oidc_strcopy(oidcd_shard_status[0]);
+  }
+  cJSON* merged = NULL;
+  for (unsigned int i = 0; i < shard_count; i++) {
+    if (oidcd_shard_status[i] == NULL) {
+      continue;
     }
-    KEY_VALUE_VARS(request, refresh_token, shortname, application_hint, issuer);
-    if (_request == NULL) {  // if the response is the final response, forward
-                             // it to the client
-      server_ipc_write(sock,
-                       oidcd_res);  // Forward oidcd response to client
-      secFree(oidcd_res);
-      SEC_FREE_KEY_VALUES();
-      return;
+    cJSON* obj = stringToJson(oidcd_shard_status[i]);
+    if (obj == NULL) {
+      continue;
     }
-    secFree(oidcd_res);
-    if (strequal(_request, INT_REQUEST_VALUE_UPD_REFRESH)) {
-      oidc_error_t e = updateRefreshToken(_shortname, _refresh_token);
-      send           = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
-                               : oidc_sprintf(RESPONSE_ERROR, oidc_serror());
-      SEC_FREE_KEY_VALUES();
+    if (merged == NULL) {
+      merged = obj;
       continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_AUTOLOAD)) {
-      char* config = getAutoloadConfig(_shortname, _issuer, _application_hint);
-      send         = config
-                 ? oidc_sprintf(RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, config)
-                 : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
-      secFree(config);
-      SEC_FREE_KEY_VALUES();
+    }
+    cJSON* macc = cJSON_GetObjectItem(merged, "accounts");
+    cJSON* oacc = cJSON_GetObjectItem(obj, "accounts");
+    while (macc != NULL && oacc != NULL && cJSON_GetArraySize(oacc) > 0) {
+      cJSON_AddItemToArray(macc, cJSON_DetachItemFromArray(oacc, 0));
+    }
+    cJSON* mloaded = cJSON_GetObjectItem(merged, "loaded_accounts");
+    cJSON* oloaded = cJSON_GetObjectItem(obj, "loaded_accounts");
+    if (mloaded != NULL && oloaded != NULL) {
+      cJSON_SetNumberValue(mloaded,
+                           mloaded->valuedouble + oloaded->valuedouble);
+    }
+    secFreeJson(obj);
+  }
+  if (merged == NULL) {
+    return NULL;
+  }
+  char* res = jsonToStringUnformatted(merged);
+  secFreeJson(merged);
+  return res;
+}
+
+static unsigned char _isSuccessResponse(const char* res) {
+  return res != NULL &&
+         strstr(res, "\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\"") != NULL;
+}
+
+/**
+ * @brief merges the success answers of a broadcast request whose payload is
+ * a json array under \p key , by concatenating the per-worker arrays
+ * @return the merged response, or @c NULL if no worker answered with
+ * success. Has to be freed after usage.
+ */
+static char* _mergeArrayResponses(struct in_flight* e, const char* key) {
+  cJSON* merged = NULL;
+  cJSON* marr   = NULL;
+  for (unsigned int i = 0; i < shard_count; i++) {
+    if (!_isSuccessResponse(e->shard_res[i])) {
       continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_CONFIRM)) {
-      oidc_error_t e =
-          _issuer ? askpass_getConfirmationWithIssuer(_issuer, _shortname,
-                                                      _application_hint)
-                  : askpass_getConfirmation(_shortname, _application_hint);
-      send = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
-                               : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
-      SEC_FREE_KEY_VALUES();
+    }
+    cJSON* obj = stringToJson(e->shard_res[i]);
+    if (obj == NULL) {
+      continue;
+    }
+    if (merged == NULL) {
+      merged = obj;
+      marr   = cJSON_GetObjectItem(merged, key);
       continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_QUERY_ACCDEFAULT)) {
-      char* account = NULL;
-      if (strValid(_issuer)) {  // default for this issuer
-        account = getDefaultAccountConfigForIssuer(_issuer);
-      } else {                      // global default
-        oidc_errno = OIDC_NOTIMPL;  // TODO
+    }
+    cJSON* arr = cJSON_GetObjectItem(obj, key);
+    while (marr != NULL && arr != NULL && cJSON_GetArraySize(arr) > 0) {
+      cJSON_AddItemToArray(marr, cJSON_DetachItemFromArray(arr, 0));
+    }
+    secFreeJson(obj);
+  }
+  if (merged == NULL) {
+    return NULL;
+  }
+  char* res = jsonToStringUnformatted(merged);
+  secFreeJson(merged);
+  return res;
+}
+
+/**
+ * @brief combines the per-worker answers of a broadcast request
+ *
+ * For the account list and a split token batch the workers' arrays are
+ * concatenated; for the metrics request the other workers' metrics are
+ * attached to the first answer next to the 'proxy' object added later.
+ * For everything else the first success wins - for a stateful request
+ * (e.g. an auth code state lookup) exactly the owning worker succeeds -
+ * and if no worker succeeded, the last answer is forwarded.
+ * @return the response to send to the client. Has to be freed after usage.
+ */
+static char* _combineShardResponses(struct in_flight* e) {
+  if (strequal(e->op, REQUEST_VALUE_ACCOUNTLIST) ||
+      strequal(e->op, REQUEST_VALUE_BULKADD)) {
+    // per-entry results (loaded accounts / bulk load statuses) are entries
+    // in the array
+    char* res = _mergeArrayResponses(e, IPC_KEY_INFO);
+    if (res != NULL) {
+      return res;
+    }
+  } else if (strequal(e->op, REQUEST_VALUE_ACCESSTOKEN)) {
+    // a split token batch; per-account errors are entries in the array
+    char* res = _mergeArrayResponses(e, IPC_KEY_TOKENS);
+    if (res != NULL) {
+      return res;
+    }
+  } else if (e->is_metrics) {
+    cJSON* first    = NULL;
+    cJSON* fmetrics = NULL;
+    for (unsigned int i = 0; i < shard_count; i++) {
+      if (e->shard_res[i] == NULL) {
+        continue;
       }
-      send = oidc_sprintf(INT_RESPONSE_ACCDEFAULT, account ?: "");
-      SEC_FREE_KEY_VALUES();
+      cJSON* obj = stringToJson(e->shard_res[i]);
+      if (obj == NULL) {
+        continue;
+      }
+      if (first == NULL) {
+        first    = obj;
+        fmetrics = cJSON_GetObjectItem(first, IPC_KEY_METRICS);
+        continue;
+      }
+      cJSON* m = cJSON_DetachItemFromObject(obj, IPC_KEY_METRICS);
+      if (fmetrics != NULL && m != NULL) {
+        char* key = oidc_sprintf("shard%u", i);
+        cJSON_AddItemToObject(fmetrics, key, m);
+        secFree(key);
+      } else {
+        secFreeJson(m);
+      }
+      secFreeJson(obj);
+    }
+    if (first != NULL) {
+      char* res = jsonToStringUnformatted(first);
+      secFreeJson(first);
+      if (res != NULL) {
+        return res;
+      }
+    }
+  }
+  // default policy, and the fallback when a merge above found no success:
+  // forward the first success, else the last answer
+  char* pick = NULL;
+  for (unsigned int i = 0; i < shard_count; i++) {
+    if (e->shard_res[i] == NULL) {
       continue;
+    }
+    pick = e->shard_res[i];
+    if (_isSuccessResponse(pick)) {
+      break;
+    }
+  }
+  if (pick != NULL) {
+    return oidc_strcopy(pick);
+  }
+  return oidc_sprintf(RESPONSE_ERROR, "no response from any oidcd worker");
+}
+
+/**
+ * @brief handles one message read from an oidcd worker's pipe
+ *
+ * The message carries the id of the client request it belongs to. A final
+ * response is forwarded to the waiting client and the request is taken out of
+ * the in-flight pool - for a broadcast request only once every worker has
+ * answered; an internal request (refresh token update, autoload,
+ * confirmation, default account query) is answered back down the same
+ * worker's pipe with the same id while the client request stays in flight.
+ */
+void handleOidcdMsg(unsigned int shard) {
+  struct ipcPipe     pipes = shard_pipes[shard];
+  struct pipeMessage pm    = ipc_readMessageFromPipe(pipes);
+  agent_trace_set(pm.trace);  // continue the trace of the request the
+                              // message belongs to
+  if (pm.msg == NULL) {
+    if (oidc_errno == OIDC_EIPCDIS) {
+      logger(ERROR, "oidcd died");
+      exit(EXIT_FAILURE);
+    }
+    logger(ERROR, "no message from oidcd");
+    return;
+  }
+  struct in_flight* entry = findInFlight(pm.id);
+  // Background jobs in oidcd (e.g. account preloading) also send internal
+  // requests; their ids do not belong to any in-flight client request, so
+  // only final responses require an entry.
+  int sock = entry != NULL ? *(entry->con->msgsock) : -1;
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, OIDC_KEY_REFRESHTOKEN, IPC_KEY_SHORTNAME,
+                 IPC_KEY_APPLICATIONHINT, IPC_KEY_ISSUERURL, IPC_KEY_INFO);
+  if (CALL_GETJSONVALUES(pm.msg) < 0) {
+    if (entry != NULL) {
+      server_ipc_writeWithKey(sock, entry->keys, RESPONSE_BADREQUEST,
+                              oidc_serror());
+      struct connection* con = entry->con;
+      removeInFlight(entry);
+      dropClient(con);
     } else {
-      server_ipc_write(
-          sock, "Internal communication error: unknown internal request");
+      logger(WARNING, "Could not parse pipe message for request id %lu",
+             pm.id);
+    }
+    secFree(pm.msg);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(request, refresh_token, shortname, application_hint, issuer,
+                 info);
+  if (_request == NULL) {  // if the response is the final response, forward
+                           // it to the client
+    if (entry == NULL) {
+      logger(WARNING, "Received pipe message for unknown request id %lu",
+             pm.id);
+      secFree(pm.msg);
       SEC_FREE_KEY_VALUES();
       return;
     }
+    char* response = pm.msg;
+    if (entry->shard_res != NULL) {  // broadcast: hold the answer back
+                                     // until every worker has answered
+      entry->shard_res[shard] = pm.msg;
+      pm.msg                  = NULL;
+      if (--entry->pending > 0) {
+        SEC_FREE_KEY_VALUES();
+        return;
+      }
+      response = _combineShardResponses(entry);
+    }
+    char* amended = entry->is_metrics ? _addProxyMetrics(response) : NULL;
+    if (strstr(response, "\"" IPC_KEY_STATUS "\":\"" STATUS_FAILURE "\"") !=
+        NULL) {
+      error_response_count++;  // reported in the health response
+    }
+    server_ipc_writeMsgWithKey(sock, entry->keys,
+                               amended ?: response);  // Forward oidcd response
+                                                      // to client, uncopied
+    secFree(amended);
+    agent_metrics_record(entry->op, agent_metrics_now_ms() - entry->read_ms);
+    if (response != pm.msg) {  // a combined broadcast answer; the per-worker
+                               // answers are freed with the entry
+      secFree(response);
+    }
+    removeInFlight(entry);
+    // The connection stays in the pool: clients using the handle api keep
+    // the socket open and send further requests on it; one-shot clients
+    // close their end, which shows up as a read event and drops them.
+    secFree(pm.msg);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  secFree(pm.msg);
+  if (strequal(_request, INT_REQUEST_VALUE_STATUS)) {
+    // fire-and-forget account summary push from oidcd; cached for health
+    // requests, nothing goes back down the pipe. Re-serialized because the
+    // json getter pretty-prints object values.
+    cJSON* status = stringToJson(_info);
+    secFree(oidcd_shard_status[shard]);
+    oidcd_shard_status[shard] =
+        status != NULL ? jsonToStringUnformatted(status) : oidc_strcopy(_info);
+    secFreeJson(status);
+    secFree(oidcd_status);
+    oidcd_status    = _mergedShardStatus();
+    oidcd_status_at = time(NULL);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  char* send = NULL;
+  if (strequal(_request, INT_REQUEST_VALUE_UPD_REFRESH)) {
+    oidc_error_t e = updateRefreshToken(_shortname, _refresh_token);
+    send           = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
+                             : oidc_sprintf(RESPONSE_ERROR, oidc_serror());
+  } else if (strequal(_request, INT_REQUEST_VALUE_AUTOLOAD)) {
+    char* config = getAutoloadConfig(_shortname, _issuer, _application_hint);
+    send         = config
+               ? oidc_sprintf(RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, config)
+               : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+    secFree(config);
+  } else if (strequal(_request, INT_REQUEST_VALUE_CONFIRM)) {
+    oidc_error_t e =
+        _issuer ? askpass_getConfirmationWithIssuer(_issuer, _shortname,
+                                                    _application_hint)
+                : askpass_getConfirmation(_shortname, _application_hint);
+    send = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
+                             : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+  } else if (strequal(_request, INT_REQUEST_VALUE_QUERY_ACCDEFAULT)) {
+    char* account = NULL;
+    if (strValid(_issuer)) {  // default for this issuer
+      account = getDefaultAccountConfigForIssuer(_issuer);
+    } else {                      // global default
+      oidc_errno = OIDC_NOTIMPL;  // TODO
+    }
+    send = oidc_sprintf(INT_RESPONSE_ACCDEFAULT, account ?: "");
+  } else {
+    if (entry != NULL) {
+      server_ipc_writeWithKey(
+          sock, entry->keys,
+          "Internal communication error: unknown internal request");
+      struct connection* con = entry->con;
+      removeInFlight(entry);
+      dropClient(con);
+    } else {
+      logger(ERROR, "Unknown internal request for request id %lu", pm.id);
+    }
+    SEC_FREE_KEY_VALUES();
+    return;
   }
+  SEC_FREE_KEY_VALUES();
+  pipes.id = entry != NULL ? entry->id : pm.id;
+  ipc_writeToPipe(pipes, send);
+  secFree(send);
 }
@@ -1,10 +1,98 @@
 #include "askpass.h"
 #include "utils/logger.h"
+#include "utils/matcher.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
 #include "utils/system_runner.h"
 
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Confirmation decision cache. Every confirmation forks the askpass helper
+ * and interrupts the user, so an affirmative answer for a
+ * (shortname, application hint) pair is remembered for a while and repeated
+ * requests from the same service pass without a prompt. Denials are never
+ * cached - the user is asked again. The lifetime can be set at runtime via
+ * the env below (seconds; 0 disables the cache) and defaults to
+ * ASKPASS_CONFIRM_CACHE_TTL.
+ */
+
+#ifndef ASKPASS_CONFIRM_CACHE_TTL
+#define ASKPASS_CONFIRM_CACHE_TTL 300
+#endif
+
+#define ASKPASS_CONFIRM_CACHE_ENV_NAME "OIDC_AGENT_CONFIRM_CACHE_TTL"
+
+#define ASKPASS_CONFIRM_CACHE_SIZE 16
+
+static struct confirmDecision {
+  char*  shortname;
+  char*  hint;
+  time_t until;
+} confirm_cache[ASKPASS_CONFIRM_CACHE_SIZE];
+
+static time_t _confirmCacheTTL() {
+  static time_t ttl = -1;
+  if (ttl == -1) {
+    const char* env = getenv(ASKPASS_CONFIRM_CACHE_ENV_NAME);
+    ttl = strValid(env) ? strToInt(env) : ASKPASS_CONFIRM_CACHE_TTL;
+  }
+  return ttl;
+}
+
+static void _confirmCacheWipe(struct confirmDecision* d) {
+  secFree(d->shortname);
+  secFree(d->hint);
+  d->until = 0;
+}
+
+static int _confirmCacheHas(const char* shortname, const char* hint) {
+  for (unsigned char i = 0; i < ASKPASS_CONFIRM_CACHE_SIZE; i++) {
+    struct confirmDecision* d = &confirm_cache[i];
+    if (d->shortname == NULL || !strequal(d->shortname, shortname) ||
+        !matchStrings(d->hint, hint)) {
+      continue;
+    }
+    if (d->until >= time(NULL)) {
+      return 1;
+    }
+    _confirmCacheWipe(d);
+  }
+  return 0;
+}
+
+static void _confirmCacheAdd(const char* shortname, const char* hint) {
+  time_t ttl = _confirmCacheTTL();
+  if (ttl <= 0) {
+    return;
+  }
+  unsigned char slot = 0;
+  for (unsigned char i = 0; i < ASKPASS_CONFIRM_CACHE_SIZE; i++) {
+    if (confirm_cache[i].shortname == NULL) {
+      slot = i;
+      break;
+    }
+    if (confirm_cache[i].until < confirm_cache[slot].until) {
+      slot = i;  // evict the decision closest to expiry
+    }
+  }
+  _confirmCacheWipe(&confirm_cache[slot]);
+  confirm_cache[slot].shortname = oidc_strcopy(shortname);
+  confirm_cache[slot].hint      = hint ? oidc_strcopy(hint) : NULL;
+  confirm_cache[slot].until     = time(NULL) + ttl;
+}
+
+void askpass_confirmCacheDrop(const char* shortname) {
+  for (unsigned char i = 0; i < ASKPASS_CONFIRM_CACHE_SIZE; i++) {
+    if (confirm_cache[i].shortname != NULL &&
+        strequal(confirm_cache[i].shortname, shortname)) {
+      _confirmCacheWipe(&confirm_cache[i]);
+    }
+  }
+}
+
 char* _promptForPassword(const char* prompt_msg) {
   char* cmd = oidc_sprintf("ssh-askpass \"%s\"", prompt_msg);
   char* ret = getOutputFromCommand(cmd);
@@ -96,6 +184,10 @@ oidc_error_t askpass_getConfirmation(const char* shortname,
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (_confirmCacheHas(shortname, application_hint)) {
+    logger(DEBUG, "Using cached authorization for config '%s'", shortname);
+    return OIDC_SUCCESS;
+  }
   logger(DEBUG, "Prompting user for confirmation of using config '%s'",
          shortname);
   const char* const fmt = "An application %srequests an access token for '%s'. "
@@ -107,6 +199,9 @@ oidc_error_t askpass_getConfirmation(const char* shortname,
   secFree(application_str);
   oidc_error_t ret = askpass_promptConfirmation(msg);
   secFree(msg);
+  if (ret == OIDC_SUCCESS) {
+    _confirmCacheAdd(shortname, application_hint);
+  }
   return ret;
 }
 
@@ -117,6 +212,10 @@ oidc_error_t askpass_getConfirmationWithIssuer(const char* issuer,
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (_confirmCacheHas(shortname, application_hint)) {
+    logger(DEBUG, "Using cached authorization for config '%s'", shortname);
+    return OIDC_SUCCESS;
+  }
   logger(DEBUG,
          "Prompting user for confirmation of using config '%s' for issuer '%s'",
          shortname, issuer);
@@ -129,6 +228,9 @@ oidc_error_t askpass_getConfirmationWithIssuer(const char* issuer,
   secFree(application_str);
   oidc_error_t ret = askpass_promptConfirmation(msg);
   secFree(msg);
+  if (ret == OIDC_SUCCESS) {
+    _confirmCacheAdd(shortname, application_hint);
+  }
   return ret;
 }
 
@@ -15,5 +15,6 @@ oidc_error_t askpass_getConfirmation(const char* shortname,
 oidc_error_t askpass_getConfirmationWithIssuer(const char* issuer,
                                                const char* shortname,
                                                const char* application_hint);
+void         askpass_confirmCacheDrop(const char* shortname);
 
 #endif  // OIDC_ASKPASS_RUNNER_H
@@ -5,6 +5,7 @@
 #endif
 #include <time.h>
 #include "oidc-agent/oidcp/passwords/password_handler.h"
+#include "utils/crypt/memoryCrypt.h"
 #include "utils/crypt/passwordCrypt.h"
 #include "utils/db/password_db.h"
 #include "utils/deathUtils.h"
@@ -14,6 +15,76 @@
 #include "utils/password_entry.h"
 #include "utils/system_runner.h"
 
+// How long a failed password lookup is remembered. Within this window
+// repeated autoload attempts for the same shortname fail immediately
+// instead of re-walking the whole fallback chain (and possibly re-prompting
+// the user). Can be overridden at build time.
+#ifndef PW_NEGATIVE_CACHE_TTL
+#define PW_NEGATIVE_CACHE_TTL 30
+#endif
+
+#define PW_NEGATIVE_CACHE_SIZE 8
+
+static struct {
+  char*  shortname;
+  time_t until;
+} negative_cache[PW_NEGATIVE_CACHE_SIZE];
+
+// How many expired entries are processed per loop timeout. Expiring an
+// entry re-encrypts nothing but walks and updates the store, so a large
+// store expiring at once is spread over several iterations to keep the
+// inter-request gap flat. Can be overridden at build time.
+#ifndef PW_EXPIRY_BATCH
+#define PW_EXPIRY_BATCH 8
+#endif
+
+// cached next-death deadline; recomputed only when the store changed
+static time_t        cached_min_death = 0;
+static unsigned char min_death_dirty  = 1;
+
+static void _minDeathMarkDirty() { min_death_dirty = 1; }
+
+static int _negativeCacheHas(const char* shortname) {
+  for (unsigned char i = 0; i < PW_NEGATIVE_CACHE_SIZE; i++) {
+    if (negative_cache[i].shortname != NULL &&
+        strequal(negative_cache[i].shortname, shortname)) {
+      if (negative_cache[i].until >= time(NULL)) {
+        return 1;
+      }
+      secFree(negative_cache[i].shortname);
+      negative_cache[i].until = 0;
+    }
+  }
+  return 0;
+}
+
+static void _negativeCacheDrop(const char* shortname) {
+  for (unsigned char i = 0; i < PW_NEGATIVE_CACHE_SIZE; i++) {
+    if (negative_cache[i].shortname != NULL &&
+        strequal(negative_cache[i].shortname, shortname)) {
+      secFree(negative_cache[i].shortname);
+      negative_cache[i].until = 0;
+    }
+  }
+}
+
+static void _negativeCacheAdd(const char* shortname) {
+  _negativeCacheDrop(shortname);
+  unsigned char slot = 0;
+  for (unsigned char i = 0; i < PW_NEGATIVE_CACHE_SIZE; i++) {
+    if (negative_cache[i].shortname == NULL) {
+      slot = i;
+      break;
+    }
+    if (negative_cache[i].until < negative_cache[slot].until) {
+      slot = i;  // evict the entry closest to expiry
+    }
+  }
+  secFree(negative_cache[slot].shortname);
+  negative_cache[slot].shortname = oidc_strcopy(shortname);
+  negative_cache[slot].until     = time(NULL) + PW_NEGATIVE_CACHE_TTL;
+}
+
 int matchPasswordEntryByShortname(struct password_entry* a,
                                   struct password_entry* b) {
   if (a == NULL && b == NULL) {
@@ -49,6 +120,7 @@ void initPasswordStore() {
   passwordDB_new();
   passwordDB_setMatchFunction((matchFunction)matchPasswordEntryByShortname);
   passwordDB_setFreeFunction((void (*)(void*))_secFreePasswordEntry);
+  passwordDB_setDeathGetter((time_t(*)(void*))pwe_getExpiresAt);
 }
 
 oidc_error_t savePassword(struct password_entry* pw) {
@@ -58,12 +130,16 @@ oidc_error_t savePassword(struct password_entry* pw) {
   }
   logger(DEBUG, "Saving password for '%s'", pw->shortname);
   initPasswordStore();
+  _negativeCacheDrop(pw->shortname);
   if (pw->password) {  // For prompt and command password won't be set
-    char* tmp = encryptPassword(pw->password, pw->shortname);
+    struct memCryptBlob* blob = memoryEncryptBinary(pw->password);
+    char*                tmp  = encryptPassword(pw->password, pw->shortname);
     if (tmp == NULL) {
+      secFreeMemCryptBlob(blob);
       return oidc_errno;
     }
     pwe_setPassword(pw, tmp);
+    pw->mem_cipher = blob;  // after pwe_setPassword, which clears it
   }
   if (pw->command) {
     char* tmp = encryptPassword(pw->command, pw->shortname);
@@ -82,6 +158,7 @@ oidc_error_t savePassword(struct password_entry* pw) {
   passwordDB_removeIfFound(
       pw);  // Removing an existing (old) entry for the same shortname -> update
   passwordDB_addValue(pw);
+  _minDeathMarkDirty();
   logger(DEBUG, "Now there are %lu passwords saved", passwordDB_getSize());
   return OIDC_SUCCESS;
 }
@@ -110,10 +187,13 @@ oidc_error_t removeOrExpirePasswordFor(const char* shortname, int remove) {
   }
   if (remove) {
     passwordDB_removeIfFound(pw);
+    askpass_confirmCacheDrop(shortname);  // a removed account has to be
+                                          // re-authorized
   } else {
     pwe_setPassword(pw, NULL);
     pwe_setExpiresAt(pw, 0);
   }
+  _minDeathMarkDirty();
   logger(DEBUG, "Now there are %lu passwords saved", passwordDB_getSize());
   return OIDC_SUCCESS;
 }
@@ -129,6 +209,7 @@ oidc_error_t expirePasswordFor(const char* shortname) {
 oidc_error_t removeAllPasswords() {
   logger(DEBUG, "Removing all passwords");
   passwordDB_reset();
+  _minDeathMarkDirty();
   return OIDC_SUCCESS;
 }
 
@@ -138,19 +219,36 @@ char* getPasswordFor(const char* shortname) {
     return NULL;
   }
   logger(DEBUG, "Getting password for '%s'", shortname);
+  if (_negativeCacheHas(shortname)) {
+    logger(DEBUG,
+           "Recent lookup for '%s' already failed; not walking the "
+           "fallback chain again",
+           shortname);
+    oidc_errno = OIDC_EPWNOTFOUND;
+    return NULL;
+  }
   struct password_entry  key = {.shortname = oidc_strcopy(shortname)};
   struct password_entry* pw  = passwordDB_findValue(&key);
   secFree(key.shortname);
   if (pw == NULL) {
     logger(DEBUG, "No password found for '%s'", shortname);
     logger(DEBUG, "Try getting password from user prompt");
-    return askpass_getPasswordForUpdate(shortname);
+    char* res = askpass_getPasswordForUpdate(shortname);
+    if (res == NULL) {
+      _negativeCacheAdd(shortname);
+    }
+    return res;
   }
   unsigned char type = pw->type;
   logger(DEBUG, "Password type is %hhu", type);
-  char* res = NULL;
+  // the in-memory container holds MEM passwords as well as memoized keyring
+  // results: one secretbox open, no parsing, no key derivation
+  char* res = pw->expires_at && pw->expires_at < time(NULL)
+                  ? NULL  // the death timer has not collected the entry yet
+                  : memoryDecryptBinary(pw->mem_cipher);
   if (!res && type & PW_TYPE_MEM) {
     logger(DEBUG, "Try getting password from memory");
+    // entries saved before the binary container existed
     char* crypt = memory_getPasswordFor(pw);
     res         = decryptPassword(crypt, shortname);
     secFree(crypt);
@@ -161,6 +259,11 @@ char* getPasswordFor(const char* shortname) {
     char* crypt = keyring_getPasswordFor(shortname);
     res         = decryptPassword(crypt, shortname);
     secFree(crypt);
+    if (res && pw->mem_cipher == NULL) {
+      // one keyring round trip per entry: later lookups are served from the
+      // in-memory container instead of going back over the bus
+      pw->mem_cipher = memoryEncryptBinary(res);
+    }
 #else
     logger(WARNING, "keyring currently not supported for MACOS");
 #endif
@@ -176,14 +279,23 @@ char* getPasswordFor(const char* shortname) {
     res = askpass_getPasswordForUpdate(shortname);
     if (res && type & PW_TYPE_MEM) {
       pwe_setPassword(pw, encryptPassword(res, shortname));
+      pw->mem_cipher = memoryEncryptBinary(res);
     }
   }
+  if (res == NULL) {
+    _negativeCacheAdd(shortname);
+  }
   return res;
 }
 
 time_t getMinPasswordDeath() {
-  logger(DEBUG, "Getting min death time for passwords");
-  return passwordDB_getMinDeath((time_t(*)(void*))pwe_getExpiresAt);
+  if (min_death_dirty) {  // the walk over the store only runs after a change
+    logger(DEBUG, "Getting min death time for passwords");
+    cached_min_death =
+        passwordDB_getMinDeath((time_t(*)(void*))pwe_getExpiresAt);
+    min_death_dirty = 0;
+  }
+  return cached_min_death;
 }
 
 struct password_entry* getDeathPasswordEntry() {
@@ -192,8 +304,16 @@ struct password_entry* getDeathPasswordEntry() {
 }
 
 void removeDeathPasswords() {
+  if (getMinPasswordDeath() == 0 || cached_min_death > time(NULL)) {
+    return;  // nothing can be due yet
+  }
   struct password_entry* death_pwe = NULL;
-  while ((death_pwe = getDeathPasswordEntry()) != NULL) {
+  unsigned char          processed = 0;
+  // at most PW_EXPIRY_BATCH entries per call; anything left is picked up on
+  // the next loop timeout, which the refreshed deadline pulls to now
+  while (processed < PW_EXPIRY_BATCH &&
+         (death_pwe = getDeathPasswordEntry()) != NULL) {
     expirePasswordFor(death_pwe->shortname);
+    processed++;
   }
 }
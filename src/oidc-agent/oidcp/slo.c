@@ -0,0 +1,155 @@
+#define _XOPEN_SOURCE 500
+#include "slo.h"
+#include "defines/ipc_values.h"
+#include "ipc/connection.h"
+#include "ipc/cryptIpc.h"
+#include "ipc/ipc.h"
+#include "ipc/serveripc.h"
+#include "utils/agent_metrics.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Self-measured latency objective (--slo).
+ *
+ * A latency budget is only credible when it is checked on the serving host
+ * against the path clients actually take, not in a benchmark. A probe
+ * thread therefore periodically connects to the agent's own socket like any
+ * client and sends an access token request for a reserved short name that
+ * is never loaded and has no configuration file: the request travels the
+ * identical machinery - key exchange, oidcp dispatch, the pipe to oidcd,
+ * the token handler's account lookup, the response path - and only the
+ * upstream token fetch is skipped, so the round trip tracks the served
+ * (cached token) latency without minting tokens or prompting the user.
+ *
+ * The probe times its stages separately and feeds them into the metrics
+ * table next to the request counters, so the distribution is exported like
+ * everything else. A round trip over the budget is additionally counted
+ * under slo_violation and logged together with the probe's dominant stage,
+ * which tells apart a slow connect/handshake (client-side crypto, socket
+ * backlog) from time spent inside the agent.
+ */
+
+// seconds between two probes; can be overridden at build time
+#ifndef AGENT_SLO_PROBE_INTERVAL
+#define AGENT_SLO_PROBE_INTERVAL 30
+#endif
+
+// reserved short name the probe asks a token for; must not exist as an
+// account configuration, otherwise the probe would measure a real token
+// request (and possibly prompt for its password)
+#define SLO_PROBE_ACCOUNT "oidc-agent-slo-probe"
+
+#define SLO_PROBE_REQUEST                                          \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCESSTOKEN "\",\"" \
+  IPC_KEY_SHORTNAME "\":\"" SLO_PROBE_ACCOUNT "\"}"
+
+// the configured budget in ms; 0 keeps the probe disabled
+static unsigned long slo_budget_ms = 0;
+
+/**
+ * @brief runs one probe against the agent's own socket
+ *
+ * The crypt communicator is unrolled here so the stages can be timed
+ * individually: connect, the key exchange, and the request round trip
+ * through oidcp and oidcd.
+ */
+static void _slo_probe() {
+  struct connection con = {0};
+  if (initConnectionWithPath(&con, getServerSocketPath()) != OIDC_SUCCESS) {
+    agent_metrics_record("slo_probe_failed", 0);
+    return;
+  }
+  unsigned long start_us = agent_metrics_now_us();
+  if (ipc_connect(con) < 0) {
+    agent_metrics_record("slo_probe_failed", 0);
+    ipc_closeConnection(&con);
+    return;
+  }
+  unsigned long connected_us = agent_metrics_now_us();
+  struct ipc_keySet* keys    = client_keyExchange(*(con.sock));
+  if (keys == NULL) {
+    agent_metrics_record("slo_probe_failed", 0);
+    ipc_closeConnection(&con);
+    return;
+  }
+  unsigned long handshaked_us = agent_metrics_now_us();
+  char*         response      = NULL;
+  if (ipc_cryptWrite(*(con.sock), keys->key_tx, "%s", SLO_PROBE_REQUEST) ==
+      OIDC_SUCCESS) {
+    response = ipc_read(*(con.sock));
+  }
+  unsigned long end_us = agent_metrics_now_us();
+  secFreeIpcKeySet(keys);
+  ipc_closeConnection(&con);
+  if (response == NULL) {  // the expected answer is an error response - the
+                           // probe account is not loaded - but no answer at
+                           // all means the measurement failed
+    agent_metrics_record("slo_probe_failed", 0);
+    return;
+  }
+  secFree(response);
+
+  unsigned long connect_us   = connected_us - start_us;
+  unsigned long handshake_us = handshaked_us - connected_us;
+  unsigned long agent_us     = end_us - handshaked_us;
+  unsigned long total_us     = end_us - start_us;
+  agent_metrics_record("slo_connect_us", connect_us);
+  agent_metrics_record("slo_handshake_us", handshake_us);
+  agent_metrics_record("slo_agent_us", agent_us);
+  agent_metrics_record("slo_probe_ms", total_us / 1000);
+  if (total_us / 1000 < slo_budget_ms) {
+    return;
+  }
+  agent_metrics_record("slo_violation", total_us / 1000);
+  const char*   stage    = "agent";
+  unsigned long stage_us = agent_us;
+  if (connect_us > stage_us) {
+    stage    = "connect";
+    stage_us = connect_us;
+  }
+  if (handshake_us > stage_us) {
+    stage    = "handshake";
+    stage_us = handshake_us;
+  }
+  logger(WARNING,
+         "SLO violation: probe round trip took %0.1lfms against a %lums "
+         "budget; dominant stage: %s (%0.1lfms)",
+         (double)total_us / 1000, slo_budget_ms, stage,
+         (double)stage_us / 1000);
+}
+
+static void* _slo_main(void* ignored) {
+  (void)ignored;
+  while (1) {
+    sleep(AGENT_SLO_PROBE_INTERVAL);
+    _slo_probe();
+  }
+  return NULL;
+}
+
+/**
+ * @brief starts the periodic latency probe; no-op unless --slo was given
+ * Called in oidcp once the socket is listening and oidcd is forked, so the
+ * first probe already measures the full serving path.
+ */
+void slo_start(const struct arguments* arguments) {
+  if (arguments->slo_budget_ms == 0) {
+    return;
+  }
+  slo_budget_ms = arguments->slo_budget_ms;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _slo_main, NULL) != 0) {
+    logger(ERROR, "Could not start the SLO probe thread");
+    return;
+  }
+  pthread_detach(thread);
+  logger(NOTICE, "SLO mode: probing the serving path every %d seconds "
+                 "against a %lums budget",
+         AGENT_SLO_PROBE_INTERVAL, slo_budget_ms);
+}
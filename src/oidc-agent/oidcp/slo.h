@@ -0,0 +1,8 @@
+#ifndef OIDCP_SLO_H
+#define OIDCP_SLO_H
+
+#include "oidc-agent/oidc-agent_options.h"
+
+void slo_start(const struct arguments* arguments);
+
+#endif  // OIDCP_SLO_H
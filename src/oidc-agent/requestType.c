@@ -0,0 +1,92 @@
+#include "requestType.h"
+
+#include "defines/ipc_values.h"
+
+#include <string.h>
+
+struct request_name {
+  const char*       name;
+  unsigned char     len;
+  enum request_type type;
+};
+
+// One entry per REQUEST_VALUE_* define; the lengths are computed by the
+// compiler from the defines themselves. A type missing here answers as
+// 'Unknown request type.', so forgetting an entry fails loudly in the
+// first manual test instead of silently dispatching slowly.
+#define REQUEST_NAME(NAME, TYPE) \
+  { NAME, sizeof(NAME) - 1, TYPE }
+static const struct request_name request_names[] = {
+    REQUEST_NAME(REQUEST_VALUE_ADD, REQ_TYPE_ADD),
+    REQUEST_NAME(REQUEST_VALUE_BULKADD, REQ_TYPE_BULKADD),
+    REQUEST_NAME(REQUEST_VALUE_GEN, REQ_TYPE_GEN),
+    REQUEST_NAME(REQUEST_VALUE_REGISTER, REQ_TYPE_REGISTER),
+    REQUEST_NAME(REQUEST_VALUE_REMOVE, REQ_TYPE_REMOVE),
+    REQUEST_NAME(REQUEST_VALUE_REMOVEALL, REQ_TYPE_REMOVEALL),
+    REQUEST_NAME(REQUEST_VALUE_DELETE, REQ_TYPE_DELETE),
+    REQUEST_NAME(REQUEST_VALUE_CODEEXCHANGE, REQ_TYPE_CODEEXCHANGE),
+    REQUEST_NAME(REQUEST_VALUE_STATELOOKUP, REQ_TYPE_STATELOOKUP),
+    REQUEST_NAME(REQUEST_VALUE_DEVICELOOKUP, REQ_TYPE_DEVICELOOKUP),
+    REQUEST_NAME(REQUEST_VALUE_ACCESSTOKEN, REQ_TYPE_ACCESSTOKEN),
+    REQUEST_NAME(REQUEST_VALUE_TERMHTTP, REQ_TYPE_TERMHTTP),
+    REQUEST_NAME(REQUEST_VALUE_LOCK, REQ_TYPE_LOCK),
+    REQUEST_NAME(REQUEST_VALUE_UNLOCK, REQ_TYPE_UNLOCK),
+    REQUEST_NAME(REQUEST_VALUE_CHECK, REQ_TYPE_CHECK),
+    REQUEST_NAME(REQUEST_VALUE_SCOPES, REQ_TYPE_SCOPES),
+    REQUEST_NAME(REQUEST_VALUE_PREFETCH, REQ_TYPE_PREFETCH),
+    REQUEST_NAME(REQUEST_VALUE_ACCOUNTCONFIG, REQ_TYPE_ACCOUNTCONFIG),
+    REQUEST_NAME(REQUEST_VALUE_METRICS, REQ_TYPE_METRICS),
+    REQUEST_NAME(REQUEST_VALUE_ACCOUNTLIST, REQ_TYPE_ACCOUNTLIST),
+    REQUEST_NAME(REQUEST_VALUE_STOREINFO, REQ_TYPE_STOREINFO),
+    REQUEST_NAME(REQUEST_VALUE_GENSESSIONKEY, REQ_TYPE_GENSESSIONKEY),
+    REQUEST_NAME(REQUEST_VALUE_HANDOFF, REQ_TYPE_HANDOFF),
+    REQUEST_NAME(REQUEST_VALUE_PING, REQ_TYPE_PING),
+    REQUEST_NAME(REQUEST_VALUE_HEALTH, REQ_TYPE_HEALTH),
+    REQUEST_NAME(REQUEST_VALUE_RELOAD, REQ_TYPE_RELOAD),
+    REQUEST_NAME(REQUEST_VALUE_CANCEL, REQ_TYPE_CANCEL),
+};
+#define REQUEST_NAME_COUNT (sizeof(request_names) / sizeof(*request_names))
+
+// Open-addressed index over request_names, built on the first lookup.
+// 64 slots for 27 names keeps probe sequences at one or two slots; a
+// slot holds the table index plus one so 0 can mean empty.
+#define REQ_HASH_SLOTS 64
+static unsigned char req_slot[REQ_HASH_SLOTS];
+static int           req_index_built = 0;
+
+static unsigned char _reqHash(const char* s, size_t len) {
+  // length, first and last character separate all current request
+  // values; collisions would only cost an extra probe, not correctness
+  return (unsigned char)((len * 31u + (unsigned char)s[0] * 7u +
+                          (unsigned char)s[len - 1]) &
+                         (REQ_HASH_SLOTS - 1));
+}
+
+static void _reqIndexBuild() {
+  for (size_t i = 0; i < REQUEST_NAME_COUNT; i++) {
+    unsigned char h = _reqHash(request_names[i].name, request_names[i].len);
+    while (req_slot[h] != 0) { h = (h + 1) & (REQ_HASH_SLOTS - 1); }
+    req_slot[h] = (unsigned char)(i + 1);
+  }
+  req_index_built = 1;
+}
+
+enum request_type requestType(const char* request) {
+  if (request == NULL || *request == '\0') {
+    return REQ_TYPE_UNKNOWN;
+  }
+  if (!req_index_built) {
+    _reqIndexBuild();
+  }
+  size_t len = strlen(request);
+  for (unsigned char h = _reqHash(request, len);;
+       h               = (h + 1) & (REQ_HASH_SLOTS - 1)) {
+    if (req_slot[h] == 0) {
+      return REQ_TYPE_UNKNOWN;
+    }
+    const struct request_name* e = &request_names[req_slot[h] - 1];
+    if (e->len == len && memcmp(e->name, request, len) == 0) {
+      return e->type;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef OIDC_AGENT_REQUEST_TYPE_H
+#define OIDC_AGENT_REQUEST_TYPE_H
+
+/**
+ * One value per REQUEST_VALUE_* define in @c defines/ipc_values.h.
+ * Both oidcp and oidcd resolve the request string once with
+ * @c requestType and dispatch on the enum, so every request type costs
+ * one hash probe and one memcmp instead of a position in an strequal
+ * chain - and a newly added type cannot accidentally end up at the slow
+ * end of that chain.
+ */
+enum request_type {
+  REQ_TYPE_UNKNOWN = 0,
+  REQ_TYPE_ADD,
+  REQ_TYPE_BULKADD,
+  REQ_TYPE_GEN,
+  REQ_TYPE_REGISTER,
+  REQ_TYPE_REMOVE,
+  REQ_TYPE_REMOVEALL,
+  REQ_TYPE_DELETE,
+  REQ_TYPE_CODEEXCHANGE,
+  REQ_TYPE_STATELOOKUP,
+  REQ_TYPE_DEVICELOOKUP,
+  REQ_TYPE_ACCESSTOKEN,
+  REQ_TYPE_TERMHTTP,
+  REQ_TYPE_LOCK,
+  REQ_TYPE_UNLOCK,
+  REQ_TYPE_CHECK,
+  REQ_TYPE_SCOPES,
+  REQ_TYPE_PREFETCH,
+  REQ_TYPE_ACCOUNTCONFIG,
+  REQ_TYPE_METRICS,
+  REQ_TYPE_ACCOUNTLIST,
+  REQ_TYPE_STOREINFO,
+  REQ_TYPE_GENSESSIONKEY,
+  REQ_TYPE_HANDOFF,
+  REQ_TYPE_PING,
+  REQ_TYPE_HEALTH,
+  REQ_TYPE_RELOAD,
+  REQ_TYPE_CANCEL,
+};
+
+/**
+ * @brief resolves a request string into its @c request_type
+ * @param request the value of the request key of an ipc request; may be
+ * @c NULL
+ * @return the matching @c request_type; @c REQ_TYPE_UNKNOWN if @p request
+ * is @c NULL or not a known request type
+ */
+enum request_type requestType(const char* request);
+
+#endif  // OIDC_AGENT_REQUEST_TYPE_H
@@ -1,5 +1,6 @@
 #include "gen_handler.h"
 #include "account/account.h"
+#include "account/account_templates.h"
 #include "account/issuer_helper.h"
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
@@ -9,7 +10,9 @@
 #include "list/list.h"
 #include "oidc-agent/httpserver/termHttpserver.h"
 #include "oidc-agent/oidc/device_code.h"
+#include "oidc-gen/gen_session.h"
 #include "oidc-gen/gen_signal_handler.h"
+#include "oidc-gen/gen_timing.h"
 #include "oidc-gen/parse_ipc.h"
 #include "oidc-gen/promptAndSet.h"
 #include "utils/accountUtils.h"
@@ -35,11 +38,14 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
 struct state {
   int doNotMergeTmpFile;
+  char* batchPassword;  // encryption password shared by all configs of a
+                        // batch run; NULL outside of batch mode
 } oidc_gen_state;
 
 void handleGen(struct oidc_account* account, const struct arguments* arguments,
@@ -82,6 +88,7 @@ void handleGen(struct oidc_account* account, const struct arguments* arguments,
     promptAndSetPassword(account, arguments->flows);
   }
   char* json = accountToJSONString(account);
+  gen_timing_mark("prompting");
   printNormal("Generating account configuration ...\n");
   struct password_entry pw   = {.shortname = account_getName(account)};
   unsigned char         type = PW_TYPE_PRMT;
@@ -102,7 +109,9 @@ void handleGen(struct oidc_account* account, const struct arguments* arguments,
     secFreeAccount(account);
     exit(EXIT_FAILURE);
   }
+  gen_timing_mark("flow request");
   json = gen_parseResponse(res, arguments);
+  gen_timing_mark("authorization and exchange");
 
   char* issuer = getJSONValueFromString(json, AGENT_KEY_ISSUERURL);
   char* name   = getJSONValueFromString(json, AGENT_KEY_SHORTNAME);
@@ -111,6 +120,7 @@ void handleGen(struct oidc_account* account, const struct arguments* arguments,
   char* hint = oidc_sprintf("account configuration '%s'", name);
   gen_saveAccountConfig(json, account_getName(account), hint,
                         suggested_password, arguments);
+  gen_timing_mark("config save");
   secFree(name);
   secFree(hint);
   secFreeAccount(account);
@@ -132,6 +142,39 @@ void manualGen(struct oidc_account*    account,
   secFree(cryptPass);
 }
 
+/**
+ * @brief obtains the parameters of a loaded account from the agent.
+ * The agent already holds the account with resolved issuer metadata, so
+ * reauthentication does not have to decrypt the config file or rediscover
+ * the issuer. The returned account carries no refresh token; it is about to
+ * be replaced anyway.
+ * @param shortname the short name of the account
+ * @return a pointer to the account. Has to be freed after usage. @c NULL if
+ * the account is not loaded or the agent does not support the request.
+ */
+static struct oidc_account* _getLoadedAccountFromAgent(const char* shortname) {
+  char* res = ipc_cryptCommunicate(REQUEST_ACCOUNTCONFIG, shortname);
+  if (res == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, IPC_KEY_CONFIG);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(status, error, config);
+  struct oidc_account* account = NULL;
+  if (strequal(_status, STATUS_SUCCESS) && _config != NULL) {
+    account = getAccountFromJSON(_config);
+  } else {
+    logger(DEBUG, "agent could not provide the account parameters: %s", _error);
+  }
+  SEC_FREE_KEY_VALUES();
+  return account;
+}
+
 void reauthenticate(const char* shortname, const struct arguments* arguments) {
   if (arguments == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -147,6 +190,12 @@ void reauthenticate(const char* shortname, const struct arguments* arguments) {
     printError("No account configuration found with that shortname\n");
     exit(EXIT_FAILURE);
   }
+  struct oidc_account* loaded = _getLoadedAccountFromAgent(shortname);
+  if (loaded != NULL) {  // only the authorization step and the final config
+                         // write are left to do
+    handleGen(loaded, arguments, NULL);
+    exit(EXIT_SUCCESS);
+  }
   struct resultWithEncryptionPassword result =
       getDecryptedAccountAndPasswordFromFilePrompt(shortname,
                                                    arguments->pw_cmd);
@@ -178,10 +227,12 @@ void handleCodeExchange(const struct arguments* arguments) {
     oidc_perror();
     exit(EXIT_FAILURE);
   }
-  char* error = extractParameterValueFromUri(arguments->codeExchange, "error");
+  struct uriParams redirect_params;
+  uriParseParams(arguments->codeExchange, &redirect_params);
+  char* error = uriParamsGetValue(&redirect_params, "error");
   if (error) {
-    char* error_description = extractParameterValueFromUri(
-        arguments->codeExchange, "error_description");
+    char* error_description =
+        uriParamsGetValue(&redirect_params, "error_description");
     char* err = combineError(error, error_description);
     logger(ERROR, "HttpRedirect Error: %s", err);
     secFree(error_description);
@@ -281,18 +332,36 @@ char* configFromStateLookUp(const char*             state,
     exit(EXIT_FAILURE);
   }
   registerSignalHandler(state);
+  ipc_cryptUseSessionResumption();  // one key exchange for the whole wait
   char* config = NULL;
-  printf("Polling oidc-agent to get the generated account configuration ...");
+  printf("Waiting for the authorization to complete ...");
   fflush(stdout);
-  for (unsigned int i = 0; config == NULL && i < MAX_POLL; i++) {
-    config = singleStateLookUp(state, arguments);
-    if (config == NULL) {
-      sleep(DELTA_POLL);
-      printf(".");
-      fflush(stdout);
+  // the agent parks this request and pushes the response the moment the
+  // code exchange settles - no polling traffic and no poll-interval latency
+  char* res = ipc_cryptCommunicate(REQUEST_STATELOOKUP_WAIT, state);
+  if (res != NULL) {
+    if (arguments->verbose) {
+      printNormal("%s\n", res);
     }
+    config = gen_parseResponse(res, arguments);
   }
   printf("\n");
+  if (config == NULL) {  // e.g. the pending flow already died or an agent
+                         // that does not know the wait flag answered right
+                         // away; fall back to polling
+    printf(
+        "Polling oidc-agent to get the generated account configuration ...");
+    fflush(stdout);
+    for (unsigned int i = 0; config == NULL && i < MAX_POLL; i++) {
+      config = singleStateLookUp(state, arguments);
+      if (config == NULL) {
+        sleep(DELTA_POLL);
+        printf(".");
+        fflush(stdout);
+      }
+    }
+    printf("\n");
+  }
   if (config == NULL) {
     printNormal("Polling is boring. Already tried %d times. I stop now.\n",
                 MAX_POLL);
@@ -345,42 +414,40 @@ char* gen_handleDeviceFlow(char* json_device, char* json_account,
   }
   struct oidc_device_code* dc = getDeviceCodeFromJSON(json_device);
   printDeviceCode(*dc, arguments->qr, arguments->qrterminal);
-  size_t interval   = oidc_device_getInterval(*dc);
-  size_t expires_in = oidc_device_getExpiresIn(*dc);
-  long   expires_at = time(NULL) + expires_in;
   secFreeDeviceCode(dc);
-  while (expires_in ? expires_at > time(NULL) : 1) {
-    sleep(interval);
-    char* res = ipc_cryptCommunicate(REQUEST_DEVICE, json_device, json_account);
-    INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, IPC_KEY_CONFIG);
-    if (CALL_GETJSONVALUES(res) < 0) {
-      printError("Could not decode json: %s\n", res);
-      printError("This seems to be a bug. Please hand in a bug report.\n");
-      SEC_FREE_KEY_VALUES();
-      secFree(res);
-      exit(EXIT_FAILURE);
-    }
+  // The agent polls the token endpoint in the background - honoring the
+  // server's interval and slow_down - and answers this single request once
+  // the authorization completed.
+  char* res = ipc_cryptCommunicate(REQUEST_DEVICE, json_device, json_account);
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, IPC_KEY_CONFIG);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    printError("Could not decode json: %s\n", res);
+    printError("This seems to be a bug. Please hand in a bug report.\n");
+    SEC_FREE_KEY_VALUES();
     secFree(res);
-    KEY_VALUE_VARS(status, error, config);
-    if (_error) {
-      if (strequal(_error, OIDC_SLOW_DOWN)) {
-        interval++;
-        SEC_FREE_KEY_VALUES();
-        continue;
-      }
-      if (strequal(_error, OIDC_AUTHORIZATION_PENDING)) {
-        SEC_FREE_KEY_VALUES();
-        continue;
-      }
-      printError(_error);
-      SEC_FREE_KEY_VALUES();
-      exit(EXIT_FAILURE);
-    }
-    secFree(_status);
-    return _config;
+    exit(EXIT_FAILURE);
   }
-  printError("Device code is not valid any more!");
-  exit(EXIT_FAILURE);
+  secFree(res);
+  KEY_VALUE_VARS(status, error, config);
+  if (_error) {
+    printError(_error);
+    SEC_FREE_KEY_VALUES();
+    exit(EXIT_FAILURE);
+  }
+  secFree(_status);
+  return _config;
+}
+
+/**
+ * @brief asks the agent to warm its discovery cache for the account's issuer
+ * Fired as soon as the issuer is known: the agent fetches the discovery
+ * document in the background while the user answers the remaining prompts,
+ * so the scope lookup and the registration do not block on the issuer.
+ * Only costs an ipc round trip; failures are ignored.
+ */
+static void _prefetchIssuerConfig(const struct oidc_account* account) {
+  _secFree(
+      ipc_cryptCommunicate(REQUEST_PREFETCH, account_getIssuerUrl(account)));
 }
 
 struct oidc_account* genNewAccount(struct oidc_account*    account,
@@ -411,20 +478,29 @@ struct oidc_account* genNewAccount(struct oidc_account*    account,
   } else {
     printf("No account exists with this short name. Creating new configuration "
            "...\n");
-    char* tmpFile = oidc_strcat(CLIENT_TMP_PREFIX, shortname);
-    if (fileDoesExist(tmpFile)) {
+    if (gen_session_exists(shortname)) {
       if (promptConsentDefaultYes("Found temporary file for this shortname. Do "
                                   "you want to use it?")) {
-        secFreeAccount(account);
-        account = getAccountFromFile(tmpFile);
+        char* tmpconfig = gen_session_load(shortname);
+        if (tmpconfig == NULL) {
+          printError("Could not use the temporary file: %s\nContinuing "
+                     "without it.\n",
+                     oidc_serror());
+          oidc_gen_state.doNotMergeTmpFile = 1;
+        } else {
+          secFreeAccount(account);
+          account = getAccountFromJSON(tmpconfig);
+          secFree(tmpconfig);
+        }
       } else {
         oidc_gen_state.doNotMergeTmpFile = 1;
       }
     }
-    secFree(tmpFile);
   }
   promptAndSetCertPath(account, arguments->cert_path);
   promptAndSetIssuer(account);
+  accountTemplate_apply(account);  // site defaults become the prompt defaults
+  _prefetchIssuerConfig(account);  // discovery overlaps the next prompts
   promptAndSetClientId(account);
   promptAndSetClientSecret(account, arguments->usePublicClient);
   promptAndSetScope(account);
@@ -450,22 +526,32 @@ struct oidc_account* registerClient(struct arguments* arguments) {
     exit(EXIT_FAILURE);
   }
 
-  char* tmpFile = oidc_strcat(CLIENT_TMP_PREFIX, account_getName(account));
-  if (fileDoesExist(tmpFile) && !arguments->usePublicClient) {
+  if (gen_session_exists(account_getName(account)) &&
+      !arguments->usePublicClient) {
     if (promptConsentDefaultYes("Found temporary file for this shortname. Do "
                                 "you want to use it?")) {
-      secFreeAccount(account);
-      account = getAccountFromFile(tmpFile);
-      handleGen(account, arguments, NULL);
-      exit(EXIT_SUCCESS);
+      char* tmpconfig = gen_session_load(account_getName(account));
+      if (tmpconfig == NULL) {
+        printError("Could not use the temporary file: %s\nContinuing without "
+                   "it.\n",
+                   oidc_serror());
+        oidc_gen_state.doNotMergeTmpFile = 1;
+      } else {
+        secFreeAccount(account);
+        account = getAccountFromJSON(tmpconfig);
+        secFree(tmpconfig);
+        handleGen(account, arguments, NULL);
+        exit(EXIT_SUCCESS);
+      }
     } else {
       oidc_gen_state.doNotMergeTmpFile = 1;
     }
   }
-  secFree(tmpFile);
 
   promptAndSetCertPath(account, arguments->cert_path);
   promptAndSetIssuer(account);
+  accountTemplate_apply(account);  // site defaults become the prompt defaults
+  _prefetchIssuerConfig(account);  // discovery overlaps the scope prompt
   if (arguments->device_authorization_endpoint) {
     issuer_setDeviceAuthorizationEndpoint(
         account_getIssuer(account),
@@ -545,12 +631,11 @@ struct oidc_account* registerClient(struct arguments* arguments) {
       secFree(_client);
       char* config = jsonToString(json_config);
       secFreeJson(json_config);
-      char* path = oidc_strcat(CLIENT_TMP_PREFIX, account_getName(account));
       if (arguments->verbose) {
-        printNormal("Writing client config temporary to file '%s'\n", path);
+        printNormal("Writing client config temporary to file '%s%s'\n",
+                    CLIENT_TMP_PREFIX, account_getName(account));
       }
-      writeFile(path, config);
-      secFree(path);
+      gen_session_store(account_getName(account), config);
     }
 
     // if dyn reg not possible try using a preregistered public client
@@ -650,13 +735,12 @@ struct oidc_account* registerClient(struct arguments* arguments) {
         secFree(filename);
       }
     } else {  // not splitting config files
-      char* path = oidc_strcat(CLIENT_TMP_PREFIX, account_getName(account));
       if (arguments->verbose) {
-        printf("Writing client config temporary to file '%s'\n", path);
+        printf("Writing client config temporary to file '%s%s'\n",
+               CLIENT_TMP_PREFIX, account_getName(account));
       }
-      writeFile(path, text);
+      gen_session_store(account_getName(account), text);
       oidc_gen_state.doNotMergeTmpFile = 0;
-      secFree(path);
     }
     struct oidc_account* updatedAccount = getAccountFromJSON(text);
     secFree(text);
@@ -738,6 +822,66 @@ void handleDelete(const struct arguments* arguments) {
   secFree(json);
 }
 
+/**
+ * @brief encrypts and writes one account configuration to the oidc dir.
+ * The encryption password is obtained up front (the one prompted at the
+ * start of a batch run, or by prompting the user); the key derivation and
+ * the disk write then happen in a detached background process. By the time
+ * a config is saved the agent already has the account loaded, so the user
+ * does not have to wait for them. On success @p tmpFile (if given) is
+ * removed by the background writer.
+ * @return an oidc_error code; @c OIDC_SUCCESS when the background writer was
+ * started. Write errors in the background are printed when they occur.
+ */
+static oidc_error_t _encryptAndWriteConfig(const char* text,
+                                           const char* shortname,
+                                           const char* hint,
+                                           const char* suggestedPassword,
+                                           const char* pw_cmd,
+                                           const char* tmpFile) {
+  char* password =
+      oidc_gen_state.batchPassword != NULL
+          ? oidc_strcopy(oidc_gen_state.batchPassword)
+          : getEncryptionPasswordFor(hint, suggestedPassword, pw_cmd);
+  if (password == NULL) {
+    return oidc_errno;
+  }
+  oidc_error_t ret = OIDC_SUCCESS;
+  pid_t        pid = fork();
+  if (pid == 0) {  // double fork so the writer is not left as a zombie
+    pid_t worker = fork();
+    if (worker != 0) {
+      _exit(worker == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    oidc_error_t e = OIDC_SUCCESS;
+    if (!encryptedOidcFileHoldsText(text, shortname, password)) {
+      e = encryptAndWriteToOidcFile(text, shortname, password);
+    }
+    if (e != OIDC_SUCCESS) {
+      printError("Could not write the account configuration '%s': %s\n",
+                 shortname, oidc_serror());
+      _exit(EXIT_FAILURE);
+    }
+    if (tmpFile != NULL) {
+      removeFile(tmpFile);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  if (pid == -1) {  // could not fork; write synchronously
+    if (!encryptedOidcFileHoldsText(text, shortname, password)) {
+      ret = encryptAndWriteToOidcFile(text, shortname, password);
+    }
+    if (ret == OIDC_SUCCESS && tmpFile != NULL) {
+      removeFile(tmpFile);
+    }
+  } else {
+    int status;
+    waitpid(pid, &status, 0);  // reaps only the short lived intermediate
+  }
+  secFree(password);
+  return ret;
+}
+
 /**
  * @brief encrypts and writes an account configuration.
  * @param config the json encoded account configuration text. Might be
@@ -745,11 +889,6 @@ void handleDelete(const struct arguments* arguments) {
  * @param shortname the account short name
  * @param suggestedPassword the suggestedPassword for encryption, won't be
  * displayed; can be NULL.
- * @param filepath an absolute path to the output file. Either filepath or
- * filename has to be given. The other one shall be NULL.
- * @param filename the filename of the output file. The output file will be
- * placed in the oidc dir. Either filepath or filename has to be given. The
- * other one shall be NULL.
  * @return an oidc_error code. oidc_errno is set properly.
  */
 oidc_error_t gen_saveAccountConfig(const char* config, const char* shortname,
@@ -762,31 +901,28 @@ oidc_error_t gen_saveAccountConfig(const char* config, const char* shortname,
     if (arguments->verbose) {
       printNormal("The following data will be saved encrypted:\n%s\n", config);
     }
-    return promptEncryptAndWriteToOidcFile(
-        config, shortname, hint, suggestedPassword, arguments->pw_cmd);
+    return _encryptAndWriteConfig(config, shortname, hint, suggestedPassword,
+                                  arguments->pw_cmd, NULL);
   }
-  char* tmpcontent = readFile(tmpFile);
-  char* text       = mergeJSONObjectStrings(config, tmpcontent);
+  char* tmpcontent = gen_session_load(shortname);
+  char* text       = tmpcontent != NULL
+                         ? mergeJSONObjectStrings(config, tmpcontent)
+                         : NULL;
   secFree(tmpcontent);
-  oidc_error_t merge_error = OIDC_SUCCESS;
   if (text == NULL) {
     oidc_perror();
-    merge_error = oidc_errno;
     printError("Only saving the account configuration. You might want to "
                "save the content of '%s' in another location.\n",
                tmpFile);
-    secFree(tmpFile);
+    secFree(tmpFile);  // nulls tmpFile, so it is not removed after the write
     text = oidc_strcopy(config);
   }
   if (arguments->verbose) {
     printNormal("The following data will be saved encrypted:\n%s\n", text);
   }
-  oidc_error_t e = promptEncryptAndWriteToOidcFile(
-      text, shortname, hint, suggestedPassword, arguments->pw_cmd);
+  oidc_error_t e = _encryptAndWriteConfig(
+      text, shortname, hint, suggestedPassword, arguments->pw_cmd, tmpFile);
   secFree(text);
-  if (e == OIDC_SUCCESS && merge_error == OIDC_SUCCESS) {
-    removeFile(tmpFile);
-  }
   secFree(tmpFile);
   return e;
 }
@@ -842,9 +978,17 @@ void gen_handleUpdateConfigFile(const char*             file,
     }
     exit(write_e);
   }
+  char* (*decryptFnc)(const char*, const char*) = decryptFileContent;
+  const char* decryptArg                        = fileContent;
+  if (crypt_isBinaryCipher(fileContent)) {
+    // binary containers cannot be passed around as strings; decrypt from the
+    // file instead
+    decryptFnc = isShortname ? decryptOidcFile : decryptFile;
+    decryptArg = file;
+  }
   struct resultWithEncryptionPassword result =
-      _getDecryptedTextAndPasswordWithPromptFor(fileContent, file,
-                                                decryptFileContent, isShortname,
+      _getDecryptedTextAndPasswordWithPromptFor(decryptArg, file, decryptFnc,
+                                                isShortname,
                                                 arguments->pw_cmd);
   secFree(fileContent);
   if (result.result == NULL) {
@@ -903,3 +1047,109 @@ char* gen_handleScopeLookup(const char* issuer_url) {
   secFree(_status);
   return _scopes;
 }
+
+/**
+ * @brief provisions all account configurations described in a manifest file.
+ * The manifest is a json array of objects with the keys @c name and
+ * @c issuer_url and optionally @c scope and @c flow. All accounts use public
+ * clients; the discovery for every issuer is prefetched up front so it
+ * overlaps with the flows, and the encryption password is prompted only once
+ * for the whole batch.
+ * @param file the path to the manifest file
+ * @param arguments the parsed command line arguments
+ */
+void gen_handleBatch(const char* file, const struct arguments* arguments) {
+  char* manifest = readFile(file);
+  if (manifest == NULL) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  cJSON* json = stringToJson(manifest);
+  secFree(manifest);
+  if (json == NULL || !cJSON_IsArray(json)) {
+    secFreeJson(json);
+    printError(
+        "The batch manifest has to be a json array of account descriptions\n");
+    exit(EXIT_FAILURE);
+  }
+  int count = cJSON_GetArraySize(json);
+  for (int i = 0; i < count; i++) {  // warm the discovery cache for all
+                                     // issuers before the first flow starts
+    char* issuer = getJSONValue(cJSON_GetArrayItem(json, i), AGENT_KEY_ISSUERURL);
+    if (strValid(issuer)) {
+      _secFree(ipc_cryptCommunicate(REQUEST_PREFETCH, issuer));
+    }
+    secFree(issuer);
+  }
+  oidc_gen_state.batchPassword = getEncryptionPasswordFor(
+      "the new account configurations", NULL, arguments->pw_cmd);
+  if (oidc_gen_state.batchPassword == NULL) {
+    secFreeJson(json);
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  oidc_gen_state.doNotMergeTmpFile = 1;
+  unsigned int provisioned         = 0;
+  for (int i = 0; i < count; i++) {
+    cJSON* entry  = cJSON_GetArrayItem(json, i);
+    char*  name   = getJSONValue(entry, AGENT_KEY_SHORTNAME);
+    char*  issuer = getJSONValue(entry, AGENT_KEY_ISSUERURL);
+    if (!strValid(name) || !strValid(issuer)) {
+      printError("Skipping manifest entry %d: '%s' and '%s' are required\n",
+                 i + 1, AGENT_KEY_SHORTNAME, AGENT_KEY_ISSUERURL);
+      secFree(name);
+      secFree(issuer);
+      continue;
+    }
+    printNormal("Provisioning account configuration '%s' (%d/%d) ...\n", name,
+                i + 1, count);
+    struct oidc_account* account = secAlloc(sizeof(struct oidc_account));
+    account_setName(account, name,
+                    arguments->cnid.useIt ? arguments->cnid.str : NULL);
+    account_setIssuerUrl(account, issuer);
+    char* scope = getJSONValue(entry, OIDC_KEY_SCOPE);
+    if (strValid(scope)) {
+      account_setScope(account, scope);
+    } else {
+      secFree(scope);
+    }
+    accountTemplate_apply(account);
+    if (!strValid(account_getScope(account))) {
+      account_setScope(account, oidc_strcopy(DEFAULT_SCOPE));
+    }
+    if (!strValid(account_getCertPath(account))) {
+      account_setOSDefaultCertPath(account);
+    }
+    char* old_client_id = account_getClientId(account);
+    if (updateAccountWithPublicClientInfo(account) == NULL ||
+        account_getClientId(account) == old_client_id) {
+      printError("Skipping '%s': no public client for issuer '%s'\n",
+                 account_getName(account), account_getIssuerUrl(account));
+      secFreeAccount(account);
+      continue;
+    }
+    struct arguments batch_args = *arguments;
+    batch_args.usePublicClient  = 1;
+    batch_args.flows            = NULL;  // handleGen derives the flow from the
+                                         // account if none is given
+    char* flow = getJSONValue(entry, IPC_KEY_FLOW);
+    if (strValid(flow)) {
+      batch_args.flows        = list_new();
+      batch_args.flows->match = (matchFunction)strequal;
+      batch_args.flows->free  = _secFree;
+      list_rpush(batch_args.flows, list_node_new(flow));
+    } else {
+      secFree(flow);
+    }
+    handleGen(account, &batch_args, NULL);
+    if (batch_args.flows != NULL) {
+      list_destroy(batch_args.flows);
+    }
+    provisioned++;
+  }
+  secFreeJson(json);
+  secFree(oidc_gen_state.batchPassword);
+  oidc_gen_state.batchPassword = NULL;
+  printNormal("Provisioned %u of %d account configurations\n", provisioned,
+              count);
+}
@@ -34,5 +34,6 @@ void         gen_handleList();
 void         gen_handleUpdateConfigFile(const char*             file,
                                         const struct arguments* arguments);
 char*        gen_handleScopeLookup(const char* issuer_url);
+void gen_handleBatch(const char* file, const struct arguments* arguments);
 
 #endif  // GEN_HANDLER_H
@@ -0,0 +1,136 @@
+#include "gen_session.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "utils/crypt/crypt.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/*
+ * The client configuration oidc-gen leaves between the two invocations of
+ * a flow used to be written in plaintext under /tmp. It is now sealed with
+ * a key that only the running agent holds: the first invocation fetches
+ * the key over the encrypted ipc channel and seals the state, the second
+ * one restores it with a single read plus one secretbox open. Without the
+ * agent session the file is just noise - after an agent restart the seal
+ * cannot be opened and the caller starts the flow from scratch, the same
+ * behaviour as a missing file. Plaintext files from older versions are
+ * still read.
+ */
+
+static unsigned char session_key[CRYPT_SEAL_KEY_LEN];
+static int           session_key_state = 0;  // 0 unknown, 1 loaded, -1 none
+
+/**
+ * @brief returns the sealing key of the current agent session
+ * The key is fetched from the agent once per process; if there is no agent
+ * (or one that predates session keys) @c NULL is returned and the caller
+ * falls back to plaintext.
+ */
+static const unsigned char* _gen_sessionKey() {
+  if (session_key_state != 0) {
+    return session_key_state > 0 ? session_key : NULL;
+  }
+  session_key_state = -1;
+  char* res         = ipc_cryptCommunicate(REQUEST_GENSESSIONKEY);
+  if (res == NULL) {
+    return NULL;
+  }
+  char* key_base64 = getJSONValueFromString(res, IPC_KEY_INFO);
+  secFree(res);
+  if (key_base64 == NULL) {
+    return NULL;
+  }
+  if (fromBase64(key_base64, CRYPT_SEAL_KEY_LEN, session_key) == 0) {
+    session_key_state = 1;
+  }
+  secFree(key_base64);
+  return session_key_state > 0 ? session_key : NULL;
+}
+
+static char* _gen_sessionPath(const char* shortname) {
+  return oidc_strcat(CLIENT_TMP_PREFIX, shortname);
+}
+
+/**
+ * @brief checks if a session file exists for @p shortname
+ */
+int gen_session_exists(const char* shortname) {
+  char* path = _gen_sessionPath(shortname);
+  int   ret  = fileDoesExist(path);
+  secFree(path);
+  return ret;
+}
+
+/**
+ * @brief stores @p config in the session file for @p shortname
+ * The config is sealed with the agent session key; when no agent is
+ * available it is written in plaintext, as it was before session keys.
+ * @return an oidc_error code. oidc_errno is set properly.
+ */
+oidc_error_t gen_session_store(const char* shortname, const char* config) {
+  if (shortname == NULL || config == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  char*                path = _gen_sessionPath(shortname);
+  const unsigned char* key  = _gen_sessionKey();
+  oidc_error_t         ret;
+  if (key != NULL) {
+    char* sealed = crypt_sealWithKey(config, key);
+    if (sealed == NULL) {
+      secFree(path);
+      return oidc_errno;
+    }
+    ret = writeFile(path, sealed);
+    secFree(sealed);
+  } else {
+    logger(NOTICE,
+           "No agent session key available; writing session file for '%s' "
+           "in plaintext",
+           shortname);
+    ret = writeFile(path, config);
+  }
+  secFree(path);
+  return ret;
+}
+
+/**
+ * @brief loads the session file for @p shortname
+ * @return the stored config. Has to be freed after usage. @c NULL if there
+ * is no session file or it was sealed for another agent session; oidc_errno
+ * is set properly.
+ */
+char* gen_session_load(const char* shortname) {
+  if (shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  char* path    = _gen_sessionPath(shortname);
+  char* content = readFile(path);
+  secFree(path);
+  if (content == NULL) {
+    return NULL;
+  }
+  if (!crypt_isSealedCipher(content)) {
+    return content;  // plaintext file from an older version
+  }
+  const unsigned char* key = _gen_sessionKey();
+  if (key == NULL) {
+    secFree(content);
+    oidc_errno = OIDC_EDECRYPT;
+    return NULL;
+  }
+  char* config = crypt_unsealWithKey(content, key);
+  secFree(content);
+  if (config == NULL) {
+    logger(NOTICE,
+           "Could not unseal session file for '%s' - it was probably "
+           "written by a previous agent session",
+           shortname);
+  }
+  return config;
+}
@@ -0,0 +1,10 @@
+#ifndef OIDC_GEN_SESSION_H
+#define OIDC_GEN_SESSION_H
+
+#include "utils/oidc_error.h"
+
+int          gen_session_exists(const char* shortname);
+oidc_error_t gen_session_store(const char* shortname, const char* config);
+char*        gen_session_load(const char* shortname);
+
+#endif  // OIDC_GEN_SESSION_H
@@ -0,0 +1,65 @@
+#define _XOPEN_SOURCE 700
+#include "gen_timing.h"
+#include "utils/printer.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Session timing for oidc-gen --timing: stages are marked at their end as
+ * the run passes through them and the breakdown is printed at exit, so a
+ * slow provisioning run shows whether the time went into prompting, the
+ * flow, the user or the config write. Marking is a no-op unless --timing
+ * was given.
+ */
+
+#define GEN_TIMING_MAX_STAGES 16
+
+struct timing_mark {
+  const char*   stage;
+  unsigned long at_ms;
+};
+
+static struct timing_mark marks[GEN_TIMING_MAX_STAGES];
+static unsigned int       mark_count;
+static unsigned long      start_ms;
+static int                timing_enabled;
+
+static unsigned long _now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static void _report() {
+  if (mark_count == 0) {
+    return;
+  }
+  printNormal("\noidc-gen timing:\n");
+  unsigned long prev = start_ms;
+  for (unsigned int i = 0; i < mark_count; i++) {
+    printNormal("  %-24s %6lu ms\n", marks[i].stage, marks[i].at_ms - prev);
+    prev = marks[i].at_ms;
+  }
+  printNormal("  %-24s %6lu ms\n", "total", prev - start_ms);
+}
+
+void gen_timing_enable() {
+  timing_enabled = 1;
+  start_ms       = _now_ms();
+  atexit(_report);  // oidc-gen leaves through exit() on every path
+}
+
+/**
+ * @brief records the end of a stage. The printed duration of a stage is the
+ * time since the previous mark (or since enabling). Does nothing if --timing
+ * was not given.
+ */
+void gen_timing_mark(const char* stage) {
+  if (!timing_enabled || mark_count >= GEN_TIMING_MAX_STAGES) {
+    return;
+  }
+  marks[mark_count].stage   = stage;
+  marks[mark_count].at_ms   = _now_ms();
+  mark_count++;
+}
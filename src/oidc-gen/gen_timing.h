@@ -0,0 +1,7 @@
+#ifndef GEN_TIMING_H
+#define GEN_TIMING_H
+
+void gen_timing_enable();
+void gen_timing_mark(const char* stage);
+
+#endif  // GEN_TIMING_H
@@ -1,6 +1,7 @@
 #include "oidc-gen.h"
 
 #include "gen_handler.h"
+#include "gen_timing.h"
 #ifndef __APPLE__
 #include "privileges/gen_privileges.h"
 #endif
@@ -21,6 +22,10 @@ int main(int argc, char** argv) {
   struct arguments arguments;
   initArguments(&arguments);
   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  if (arguments.timing) {
+    gen_timing_enable();
+    gen_timing_mark("argument parsing");
+  }
   if (arguments.debug) {
     logger_setloglevel(DEBUG);
   }
@@ -54,6 +59,12 @@ int main(int argc, char** argv) {
     exit(EXIT_SUCCESS);
   }
   common_assertAgent();
+  gen_timing_mark("agent connect");
+
+  if (arguments.batch) {
+    gen_handleBatch(arguments.batch, &arguments);
+    exit(EXIT_SUCCESS);
+  }
 
   if (arguments.state) {
     stateLookUpWithConfigSave(arguments.state, &arguments);
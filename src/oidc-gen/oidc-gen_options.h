@@ -24,6 +24,7 @@ struct arguments {
   char* device_authorization_endpoint;
   char* updateConfigFile;
   char* pw_cmd;
+  char* batch;
 
   struct optional_arg dynRegToken;
   struct optional_arg cert_path;
@@ -49,6 +50,7 @@ struct arguments {
   unsigned char noWebserver;
   unsigned char noScheme;
   unsigned char reauthenticate;
+  unsigned char timing;
 };
 
 /* Keys for options without short-options. */
@@ -69,6 +71,8 @@ struct arguments {
 #define OPT_NO_WEBSERVER 15
 #define OPT_REAUTHENTICATE 16
 #define OPT_NO_SCHEME 17
+#define OPT_BATCH 18
+#define OPT_TIMING 19
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "Getting information:", 1},
@@ -99,6 +103,12 @@ static struct argp_option options[] = {
      "Used to update an existing account configuration file with a new refresh "
      "token. Can be used if no other metadata should be changed.",
      2},
+    {"batch", OPT_BATCH, "FILE", 0,
+     "Provisions all account configurations described in FILE in one run. "
+     "FILE is a json array of objects with the keys 'name' and 'issuer_url' "
+     "and optionally 'scope' and 'flow'. Public clients are used and the "
+     "encryption password is prompted only once for the whole batch.",
+     2},
 
     {0, 0, 0, 0, "Advanced:", 3},
     {"output", 'o', "FILE", 0,
@@ -182,6 +192,8 @@ static struct argp_option options[] = {
     {0, 0, 0, 0, "Verbosity:", 5},
     {"debug", 'g', 0, 0, "Sets the log level to DEBUG", 5},
     {"verbose", 'v', 0, 0, "Enables verbose mode", 5},
+    {"timing", OPT_TIMING, 0, 0,
+     "Prints a timing breakdown of the generation stages at exit", 5},
 
     {0, 0, 0, 0, "Help:", -1},
     {0, 'h', 0, OPTION_HIDDEN, 0, -1},
@@ -203,6 +215,7 @@ static inline void initArguments(struct arguments* arguments) {
   arguments->updateConfigFile              = NULL;
   arguments->redirect_uris                 = NULL;
   arguments->pw_cmd                        = NULL;
+  arguments->batch                         = NULL;
 
   arguments->dynRegToken.str     = NULL;
   arguments->dynRegToken.useIt   = 0;
@@ -229,6 +242,7 @@ static inline void initArguments(struct arguments* arguments) {
   arguments->noWebserver      = 0;
   arguments->reauthenticate   = 0;
   arguments->noScheme         = 0;
+  arguments->timing           = 0;
 }
 
 static inline error_t parse_opt(int key, char* arg, struct argp_state* state) {
@@ -241,6 +255,7 @@ static inline error_t parse_opt(int key, char* arg, struct argp_state* state) {
     case 'v': arguments->verbose = 1; break;
     case 'm': arguments->manual = 1; break;
     case OPT_REAUTHENTICATE: arguments->reauthenticate = 1; break;
+    case OPT_TIMING: arguments->timing = 1; break;
     case OPT_PUBLICCLIENT: arguments->usePublicClient = 1; break;
     case OPT_QR: arguments->qr = 1; break;
     case OPT_QRTERMINAL:
@@ -262,6 +277,7 @@ static inline error_t parse_opt(int key, char* arg, struct argp_state* state) {
     case 'u': arguments->updateConfigFile = arg; break;
     case 'p': arguments->print = arg; break;
     case OPT_PW_CMD: arguments->pw_cmd = arg; break;
+    case OPT_BATCH: arguments->batch = arg; break;
     case OPT_DEVICE: arguments->device_authorization_endpoint = arg; break;
     case OPT_codeExchange: arguments->codeExchange = arg; break;
     case OPT_state: arguments->state = arg; break;
@@ -2,15 +2,31 @@
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
+#include "defines/settings.h"
 #include "ipc/communicator.h"
+#include "ipc/compactIpc.h"
+#include "ipc/ipc.h"
+#include "ipc/tokenMirror.h"
+#include "list/list.h"
 #include "utils/json.h"
 #include "utils/key_value.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/printer.h"
+#include "utils/stringUtils.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
 #ifndef API_LOGLEVEL
 #define API_LOGLEVEL NOTICE
@@ -23,6 +39,148 @@
 #define END_APILOGLEVEL logger_setlogmask(oldLogMask);
 #endif  // END_APILOGLEVEL
 
+// Opt-in compact binary framing; see oidcagent_useCompactIpc in api.h.
+// -1 means "not decided yet": the environment is checked on first use.
+static int use_compact_ipc = -1;
+
+void oidcagent_useCompactIpc() { use_compact_ipc = 1; }
+
+static int _compactIpcEnabled() {
+  if (use_compact_ipc < 0) {
+    const char* env = getenv("OIDC_AGENT_COMPACT_IPC");
+    use_compact_ipc = strValid(env) && !strequal(env, "0");
+  }
+  return use_compact_ipc;
+}
+
+// Opt-in per-process token cache; see oidcagent_useTokenCache in api.h.
+// -1 means "not decided yet": the environment is checked on first use.
+static int use_token_cache = -1;
+
+void oidcagent_useTokenCache() { use_token_cache = 1; }
+
+static int _tokenCacheEnabled() {
+  if (use_token_cache < 0) {
+    const char* env = getenv("OIDC_AGENT_TOKEN_CACHE");
+    use_token_cache = strValid(env) && !strequal(env, "0");
+  }
+  return use_token_cache;
+}
+
+#define TOKEN_CACHE_MAX_ENTRIES 16
+
+struct cachedToken {
+  char*  key;  // "<a|i>:<account or issuer>|<scope>"
+  char*  token;
+  char*  issuer;
+  time_t expires_at;
+  time_t next_request_at;  // the agent's rate hint; 0 if none was given
+};
+
+static list_t*         token_cache      = NULL;
+static pthread_mutex_t token_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _secFreeCachedToken(struct cachedToken* entry) {
+  secFree(entry->key);
+  secFree(entry->token);
+  secFree(entry->issuer);
+  secFree(entry);
+}
+
+static int _cachedTokenMatchKey(const char* key,
+                                const struct cachedToken* entry) {
+  return strequal(key, entry->key);
+}
+
+static char* _tokenCacheKey(char type, const char* name, const char* scope) {
+  return oidc_sprintf("%c:%s|%s", type, name, scope ?: "");
+}
+
+/**
+ * @brief serves a token request from the cache if the validity window allows
+ *
+ * Beyond the validity window the cache also honors the agent's rate hint:
+ * once the suggested next-request time has passed the entry is dropped and
+ * the agent is asked again - it usually already holds the refreshed
+ * successor token, which re-arms the cache for another hint window.
+ * @return the cached token response; a zeroed response if there is no cached
+ * token that is still valid for @p min_valid_period
+ */
+static struct token_response _tokenCacheGet(char type, const char* name,
+                                            const char* scope,
+                                            time_t      min_valid_period) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (!_tokenCacheEnabled() || name == NULL) {
+    return ret;
+  }
+  char* key = _tokenCacheKey(type, name, scope);
+  pthread_mutex_lock(&token_cache_lock);
+  list_node_t* node = token_cache ? findInList(token_cache, key) : NULL;
+  if (node != NULL) {
+    struct cachedToken* entry = node->val;
+    time_t              now   = time(NULL);
+    unsigned char       fresh;
+    if (entry->expires_at != 0) {
+      fresh = entry->expires_at - now >=
+              (min_valid_period > 0 ? min_valid_period : 1);
+    } else {  // expiry unknown: cached on the agent's rate hint alone; only
+              // callers without a validity demand may be served from it
+      fresh = min_valid_period <= 0;
+    }
+    if (entry->next_request_at != 0 && now >= entry->next_request_at) {
+      fresh = 0;  // the agent suggested to ask again by now
+    }
+    if (fresh) {
+      ret.token      = oidc_strcopy(entry->token);
+      ret.issuer     = oidc_strcopy(entry->issuer);
+      ret.expires_at = entry->expires_at;
+      oidc_errno     = OIDC_SUCCESS;
+    } else {  // the window would be violated; drop it and ask the agent
+      list_remove(token_cache, node);
+    }
+  }
+  pthread_mutex_unlock(&token_cache_lock);
+  secFree(key);
+  return ret;
+}
+
+/**
+ * @brief caches a token response obtained from the agent
+ * Responses without a token are never cached; responses without a known
+ * expiration time only if the agent gave a rate hint - without either the
+ * validity window could not be checked.
+ */
+static void _tokenCachePut(char type, const char* name, const char* scope,
+                           const struct token_response* response,
+                           time_t                       next_request_at) {
+  if (!_tokenCacheEnabled() || name == NULL || response->token == NULL ||
+      (response->expires_at <= 0 && next_request_at <= 0)) {
+    return;
+  }
+  char* key = _tokenCacheKey(type, name, scope);
+  pthread_mutex_lock(&token_cache_lock);
+  if (token_cache == NULL) {
+    token_cache        = list_new();
+    token_cache->free  = (void (*)(void*)) & _secFreeCachedToken;
+    token_cache->match = (matchFunction)_cachedTokenMatchKey;
+  }
+  list_node_t* node = findInList(token_cache, key);
+  if (node != NULL) {
+    list_remove(token_cache, node);
+  }
+  if (token_cache->len >= TOKEN_CACHE_MAX_ENTRIES) {
+    list_remove(token_cache, token_cache->head);
+  }
+  struct cachedToken* entry = secAlloc(sizeof(struct cachedToken));
+  entry->key                = key;
+  entry->token              = oidc_strcopy(response->token);
+  entry->issuer             = oidc_strcopy(response->issuer);
+  entry->expires_at         = response->expires_at;
+  entry->next_request_at    = next_request_at;
+  list_rpush(token_cache, list_node_new(entry));
+  pthread_mutex_unlock(&token_cache_lock);
+}
+
 char* communicate(const char* fmt, ...) {
   START_APILOGLEVEL
   if (fmt == NULL) {
@@ -38,6 +196,22 @@ char* communicate(const char* fmt, ...) {
   return ret;
 }
 
+/**
+ * @brief encodes @p ipc_request compactly if enabled and decodes a compact
+ * response back to json text, so the rest of the api only ever sees json
+ */
+static char* _communicateMaybeCompact(const char* ipc_request) {
+  char* compact  = _compactIpcEnabled() ? compactIpc_encode(ipc_request) : NULL;
+  char* response = communicate("%s", compact ?: ipc_request);
+  secFree(compact);
+  if (compactIpc_isCompact(response)) {
+    char* json = compactIpc_decode(response);
+    secFree(response);
+    response = json;
+  }
+  return response;
+}
+
 char* _getAccessTokenRequest(const char* accountname, const char* issuer,
                              time_t min_valid_period, const char* scope,
                              const char* hint) {
@@ -74,13 +248,21 @@ char* getAccessTokenRequestIssuer(const char* issuer, time_t min_valid_period,
   return _getAccessTokenRequest(NULL, issuer, min_valid_period, scope, hint);
 }
 
-struct token_response _getTokenResponseFromRequest(const char* ipc_request) {
-  char* response = communicate(ipc_request);
+/**
+ * @brief parses an access token response
+ * @param next_request_at_out if not @c NULL, filled with the agent's rate
+ * hint (@c 0 if the response carried none - e.g. an older agent)
+ */
+struct token_response _getTokenResponseFromResponse(
+    char* response, time_t* next_request_at_out) {
+  if (next_request_at_out != NULL) {
+    *next_request_at_out = 0;
+  }
   if (response == NULL) {
     return (struct token_response){NULL, NULL, 0};
   }
   INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, OIDC_KEY_ACCESSTOKEN,
-                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT);
+                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT, AGENT_KEY_NEXTREQUESTAT);
   if (CALL_GETJSONVALUES(response) < 0) {
     printError("Read malformed data. Please hand in bug report.\n");
     secFree(response);
@@ -88,7 +270,8 @@ struct token_response _getTokenResponseFromRequest(const char* ipc_request) {
     return (struct token_response){NULL, NULL, 0};
   }
   secFree(response);
-  KEY_VALUE_VARS(status, error, access_token, issuer, expires_at);
+  KEY_VALUE_VARS(status, error, access_token, issuer, expires_at,
+                 next_request_at);
   if (_error) {  // error
     oidc_errno = OIDC_EERROR;
     oidc_seterror(_error);
@@ -99,19 +282,45 @@ struct token_response _getTokenResponseFromRequest(const char* ipc_request) {
     oidc_errno        = OIDC_SUCCESS;
     time_t expires_at = strToULong(_expires_at);
     secFree(_expires_at);
+    if (next_request_at_out != NULL && _next_request_at != NULL) {
+      *next_request_at_out = strToULong(_next_request_at);
+    }
+    secFree(_next_request_at);
     return (struct token_response){_access_token, _issuer, expires_at};
   }
 }
 
+struct token_response _getTokenResponseFromRequest(
+    const char* ipc_request, time_t* next_request_at_out) {
+  return _getTokenResponseFromResponse(_communicateMaybeCompact(ipc_request),
+                                       next_request_at_out);
+}
+
 struct token_response getTokenResponse(const char* accountname,
                                        time_t      min_valid_period,
                                        const char* scope,
                                        const char* application_hint) {
   START_APILOGLEVEL
+  struct token_response ret =
+      _tokenCacheGet('a', accountname, scope, min_valid_period);
+  if (ret.token != NULL) {
+    END_APILOGLEVEL
+    return ret;
+  }
+  // agents started with token mirroring serve still-valid tokens straight
+  // from shared memory, without any ipc round trip
+  if (tokenMirror_lookup(accountname, scope, min_valid_period, &ret.token,
+                         &ret.issuer, &ret.expires_at)) {
+    oidc_errno = OIDC_SUCCESS;
+    END_APILOGLEVEL
+    return ret;
+  }
   char* request = getAccessTokenRequest(accountname, min_valid_period, scope,
                                         application_hint);
-  struct token_response ret = _getTokenResponseFromRequest(request);
+  time_t next_request_at = 0;
+  ret = _getTokenResponseFromRequest(request, &next_request_at);
   secFree(request);
+  _tokenCachePut('a', accountname, scope, &ret, next_request_at);
   END_APILOGLEVEL
   return ret;
 }
@@ -121,14 +330,246 @@ struct token_response getTokenResponseForIssuer(const char* issuer_url,
                                                 const char* scope,
                                                 const char* application_hint) {
   START_APILOGLEVEL
+  struct token_response ret =
+      _tokenCacheGet('i', issuer_url, scope, min_valid_period);
+  if (ret.token != NULL) {
+    END_APILOGLEVEL
+    return ret;
+  }
   char* request = getAccessTokenRequestIssuer(issuer_url, min_valid_period,
                                               scope, application_hint);
-  struct token_response ret = _getTokenResponseFromRequest(request);
+  time_t next_request_at = 0;
+  ret = _getTokenResponseFromRequest(request, &next_request_at);
   secFree(request);
+  _tokenCachePut('i', issuer_url, scope, &ret, next_request_at);
   END_APILOGLEVEL
   return ret;
 }
 
+/**
+ * @brief stores @p value - an owned, allocated string - in a reusable buffer
+ *
+ * If the buffer is large enough the value is copied in and freed; otherwise
+ * the value itself is adopted as the new, larger buffer. Either way no
+ * additional allocation happens.
+ */
+static void _bufAdoptString(char** buf, size_t* cap, char* value) {
+  if (value == NULL) {
+    if (*buf != NULL) {
+      (*buf)[0] = '\0';
+    }
+    return;
+  }
+  size_t need = strlen(value) + 1;
+  if (*cap >= need) {
+    memcpy(*buf, value, need);
+    secFree(value);
+  } else {
+    secFree(*buf);
+    *buf = value;
+    *cap = need;
+  }
+}
+
+int getTokenResponseInto(struct token_response_buf* buf,
+                         const char* accountname, time_t min_valid_period,
+                         const char* scope, const char* application_hint) {
+  START_APILOGLEVEL
+  if (buf == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    END_APILOGLEVEL
+    return oidc_errno;
+  }
+  struct token_response cached =
+      _tokenCacheGet('a', accountname, scope, min_valid_period);
+  if (cached.token != NULL) {
+    _bufAdoptString(&buf->token, &buf->token_cap, cached.token);
+    _bufAdoptString(&buf->issuer, &buf->issuer_cap, cached.issuer);
+    buf->expires_at = cached.expires_at;
+    END_APILOGLEVEL
+    return OIDC_SUCCESS;
+  }
+  char* request = getAccessTokenRequest(accountname, min_valid_period, scope,
+                                        application_hint);
+  char* response = _communicateMaybeCompact(request);
+  secFree(request);
+  if (response == NULL) {
+    END_APILOGLEVEL
+    return oidc_errno;
+  }
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, OIDC_KEY_ACCESSTOKEN,
+                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT, AGENT_KEY_NEXTREQUESTAT);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    printError("Read malformed data. Please hand in bug report.\n");
+    secFree(response);
+    SEC_FREE_KEY_VALUES();
+    END_APILOGLEVEL
+    return oidc_errno;
+  }
+  secFree(response);
+  KEY_VALUE_VARS(status, error, access_token, issuer, expires_at,
+                 next_request_at);
+  if (_error) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror(_error);
+    SEC_FREE_KEY_VALUES();
+    END_APILOGLEVEL
+    return OIDC_EERROR;
+  }
+  secFree(_status);
+  buf->expires_at = strToULong(_expires_at);
+  secFree(_expires_at);
+  time_t next_request_at =
+      _next_request_at != NULL ? strToULong(_next_request_at) : 0;
+  secFree(_next_request_at);
+  struct token_response resp = {_access_token, _issuer, buf->expires_at};
+  _tokenCachePut('a', accountname, scope, &resp,
+                 next_request_at);  // copies the strings
+  // the parsed strings move into the caller's buffers instead of being
+  // copied out and freed
+  _bufAdoptString(&buf->token, &buf->token_cap, _access_token);
+  _bufAdoptString(&buf->issuer, &buf->issuer_cap, _issuer);
+  oidc_errno = OIDC_SUCCESS;
+  END_APILOGLEVEL
+  return OIDC_SUCCESS;
+}
+
+void secFreeTokenResponseBuf(struct token_response_buf* buf) {
+  if (buf == NULL) {
+    return;
+  }
+  secFree(buf->token);
+  buf->token     = NULL;
+  buf->token_cap = 0;
+  secFree(buf->issuer);
+  buf->issuer     = NULL;
+  buf->issuer_cap = 0;
+  buf->expires_at = 0;
+}
+
+struct token_response* getTokenResponses(const char* const* accountnames,
+                                         size_t count, time_t min_valid_period,
+                                         const char* scope,
+                                         const char* application_hint) {
+  START_APILOGLEVEL
+  if (accountnames == NULL || count == 0) {
+    oidc_setArgNullFuncError(__func__);
+    END_APILOGLEVEL
+    return NULL;
+  }
+  struct token_response* responses =
+      secAlloc(sizeof(struct token_response) * count);
+  list_t* missing = list_new();  // names the cache could not satisfy
+  for (size_t i = 0; i < count; i++) {
+    responses[i] =
+        _tokenCacheGet('a', accountnames[i], scope, min_valid_period);
+    if (responses[i].token == NULL) {
+      list_rpush(missing, list_node_new((char*)accountnames[i]));
+    }
+  }
+  if (missing->len == 0) {  // everything served from the cache
+    list_destroy(missing);
+    oidc_errno = OIDC_SUCCESS;
+    END_APILOGLEVEL
+    return responses;
+  }
+  cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                   REQUEST_VALUE_ACCESSTOKEN, IPC_KEY_MINVALID,
+                                   cJSON_Number, min_valid_period, NULL);
+  jsonAddJSON(json, IPC_KEY_ACCOUNTLIST, listToJSONArray(missing));
+  list_destroy(missing);
+  if (strValid(scope)) {
+    jsonAddStringValue(json, OIDC_KEY_SCOPE, scope);
+  }
+  if (strValid(application_hint)) {
+    jsonAddStringValue(json, IPC_KEY_APPLICATIONHINT, application_hint);
+  }
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  logger(DEBUG, "%s", request);
+  char* response = _communicateMaybeCompact(request);
+  secFree(request);
+  if (response == NULL) {  // cache hits are still returned
+    END_APILOGLEVEL
+    return responses;
+  }
+  cJSON* dom = stringToJson(response);
+  secFree(response);
+  if (dom == NULL) {
+    END_APILOGLEVEL
+    return responses;
+  }
+  char* error = getJSONValue(dom, OIDC_KEY_ERROR);
+  if (error != NULL) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror(error);
+    secFree(error);
+    secFreeJson(dom);
+    END_APILOGLEVEL
+    return responses;
+  }
+  cJSON* tokens = getJSONItem(dom, IPC_KEY_TOKENS);
+  int    n      = cJSON_GetArraySize(tokens);
+  for (int i = 0; i < n; i++) {
+    cJSON* entry   = cJSON_GetArrayItem(tokens, i);
+    char*  account = getJSONValue(entry, IPC_KEY_SHORTNAME);
+    char*  token   = getJSONValue(entry, OIDC_KEY_ACCESSTOKEN);
+    if (account == NULL || token == NULL) {  // error entry; stays zeroed
+      secFree(account);
+      secFree(token);
+      continue;
+    }
+    for (size_t j = 0; j < count; j++) {
+      if (responses[j].token == NULL && strequal(accountnames[j], account)) {
+        cJSON* expires_at     = getJSONItem(entry, AGENT_KEY_EXPIRESAT);
+        responses[j].token    = token;
+        responses[j].issuer   = getJSONValue(entry, OIDC_KEY_ISSUER);
+        responses[j].expires_at =
+            expires_at != NULL ? (time_t)expires_at->valuedouble : 0;
+        _tokenCachePut('a', account, scope, &responses[j],
+                       0);  // batch entries carry no rate hint
+        token = NULL;  // ownership went into the response
+        break;
+      }
+    }
+    secFree(account);
+    secFree(token);
+  }
+  secFreeJson(dom);
+  oidc_errno = OIDC_SUCCESS;
+  END_APILOGLEVEL
+  return responses;
+}
+
+char** getAccessTokens(const char* const* accountnames, size_t count,
+                       time_t min_valid_period, const char* scope) {
+  START_APILOGLEVEL
+  struct token_response* responses = getTokenResponses(
+      accountnames, count, min_valid_period, scope, NULL);
+  if (responses == NULL) {
+    END_APILOGLEVEL
+    return NULL;
+  }
+  char** tokens = secAlloc(sizeof(char*) * count);
+  for (size_t i = 0; i < count; i++) {
+    tokens[i]          = responses[i].token;
+    responses[i].token = NULL;
+    secFree(responses[i].issuer);
+  }
+  secFree(responses);
+  END_APILOGLEVEL
+  return tokens;
+}
+
+void secFreeTokenResponses(struct token_response* responses, size_t count) {
+  START_APILOGLEVEL
+  if (responses != NULL) {
+    for (size_t i = 0; i < count; i++) { secFreeTokenResponse(responses[i]); }
+    secFree(responses);
+  }
+  END_APILOGLEVEL
+}
+
 struct token_response getTokenResponseForGlobalDefaultConfig(
     time_t min_valid_period, const char* scope, const char* application_hint) {
   // TODO
@@ -162,6 +603,331 @@ char* getAccessTokenForIssuer(const char* issuer_url, time_t min_valid_period,
   return response.token;
 }
 
+struct agent_connection {
+  struct connection con;
+};
+
+struct agent_connection* agent_connect() {
+  START_APILOGLEVEL
+  struct agent_connection* agent = secAlloc(sizeof(struct agent_connection));
+  if (ipc_client_init(&agent->con, OIDC_SOCK_ENV_NAME) != OIDC_SUCCESS ||
+      ipc_connect(agent->con) < 0) {
+    ipc_closeConnection(&agent->con);
+    secFree(agent);
+    agent = NULL;
+  }
+  END_APILOGLEVEL
+  return agent;
+}
+
+struct token_response agent_getTokenResponse(struct agent_connection* agent,
+                                             const char* accountname,
+                                             time_t      min_valid_period,
+                                             const char* scope,
+                                             const char* application_hint) {
+  START_APILOGLEVEL
+  struct token_response ret = {NULL, NULL, 0};
+  if (agent == NULL) {
+    oidc_setArgNullFuncError(__func__);
+  } else {
+    ret = _tokenCacheGet('a', accountname, scope, min_valid_period);
+    if (ret.token != NULL) {
+      END_APILOGLEVEL
+      return ret;
+    }
+    char* request = getAccessTokenRequest(accountname, min_valid_period, scope,
+                                          application_hint);
+    char* compact = _compactIpcEnabled() ? compactIpc_encode(request) : NULL;
+    char* response =
+        ipc_communicateWithSock(*(agent->con.sock), "%s", compact ?: request);
+    secFree(compact);
+    if (compactIpc_isCompact(response)) {
+      char* json = compactIpc_decode(response);
+      secFree(response);
+      response = json;
+    }
+    time_t next_request_at = 0;
+    ret = _getTokenResponseFromResponse(response, &next_request_at);
+    secFree(request);
+    _tokenCachePut('a', accountname, scope, &ret, next_request_at);
+  }
+  END_APILOGLEVEL
+  return ret;
+}
+
+char* agent_getAccessToken(struct agent_connection* agent,
+                           const char* accountname, time_t min_valid_period,
+                           const char* scope, const char* application_hint) {
+  START_APILOGLEVEL
+  struct token_response response = agent_getTokenResponse(
+      agent, accountname, min_valid_period, scope, application_hint);
+  secFree(response.issuer);
+  END_APILOGLEVEL
+  return response.token;
+}
+
+void agent_disconnect(struct agent_connection* agent) {
+  START_APILOGLEVEL
+  if (agent != NULL) {
+    ipc_closeConnection(&agent->con);
+    secFree(agent);
+  }
+  END_APILOGLEVEL
+}
+
+/*
+ * Asynchronous token requests. The blocking api costs one thread per
+ * concurrent token fetch; event-driven applications instead get a handle
+ * with a non-blocking fd, poll it, and call asyncTokenRequestProcess to
+ * advance the request through connect, write and read until the completion
+ * callback fires. The wire format is the same length-prefixed json the
+ * blocking path uses.
+ */
+
+enum async_state {
+  ASYNC_CONNECTING,
+  ASYNC_WRITING,
+  ASYNC_READING_HEADER,
+  ASYNC_READING_PAYLOAD,
+  ASYNC_DONE,
+};
+
+struct async_token_request {
+  int                     sock;
+  enum async_state        state;
+  char*                   out;  // length prefix + request payload
+  size_t                  out_len;
+  size_t                  sent;
+  unsigned char           header[IPC_LEN_PREFIX_SIZE];
+  size_t                  header_got;
+  char*                   in;
+  uint32_t                in_len;
+  size_t                  got;
+  char*                   account;  // for caching the response
+  char*                   scope;
+  token_response_callback callback;
+  void*                   userdata;
+};
+
+/**
+ * @brief finishes a request with an error and notifies the caller
+ */
+static int _asyncFinishError(struct async_token_request* request,
+                             oidc_error_t                err) {
+  oidc_errno = err;
+  if (request->sock >= 0) {
+    close(request->sock);
+    request->sock = -1;
+  }
+  request->state = ASYNC_DONE;
+  request->callback((struct token_response){NULL, NULL, 0},
+                    request->userdata);
+  return 1;
+}
+
+struct async_token_request* getAccessTokenAsync(
+    const char* accountname, time_t min_valid_period, const char* scope,
+    const char* application_hint, token_response_callback callback,
+    void* userdata) {
+  START_APILOGLEVEL
+  if (callback == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    END_APILOGLEVEL
+    return NULL;
+  }
+  struct async_token_request* request =
+      secAlloc(sizeof(struct async_token_request));
+  request->sock     = -1;
+  request->callback = callback;
+  request->userdata = userdata;
+  request->account  = oidc_strcopy(accountname);
+  request->scope    = oidc_strcopy(scope);
+  struct token_response cached =
+      _tokenCacheGet('a', accountname, scope, min_valid_period);
+  if (cached.token != NULL) {  // completed without touching the agent
+    request->state = ASYNC_DONE;
+    callback(cached, userdata);
+    END_APILOGLEVEL
+    return request;
+  }
+  const char* path = getenv(OIDC_SOCK_ENV_NAME);
+  if (!strValid(path)) {
+    oidc_errno = OIDC_EENVVAR;
+    goto fail;
+  }
+  request->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (request->sock < 0) {
+    oidc_errno = OIDC_ECRSOCK;
+    goto fail;
+  }
+  fcntl(request->sock, F_SETFL, O_NONBLOCK);
+  fcntl(request->sock, F_SETFD, FD_CLOEXEC);
+  char* json = getAccessTokenRequest(accountname, min_valid_period, scope,
+                                     application_hint);
+  if (json == NULL) {
+    goto fail;
+  }
+  size_t len       = strlen(json);
+  request->out_len = IPC_LEN_PREFIX_SIZE + len;
+  request->out     = secAlloc(request->out_len);
+  ipc_packMsgLen((unsigned char*)request->out, len);
+  memcpy(request->out + IPC_LEN_PREFIX_SIZE, json, len);
+  secFree(json);
+  struct sockaddr_un server = {.sun_family = AF_UNIX};
+  strcpy(server.sun_path, path);
+  if (connect(request->sock, (struct sockaddr*)&server, sizeof(server)) == 0) {
+    request->state = ASYNC_WRITING;
+  } else if (errno == EINPROGRESS || errno == EAGAIN) {
+    request->state = ASYNC_CONNECTING;
+  } else {
+    logger(ERROR, "connecting stream socket: %m");
+    oidc_errno = OIDC_ECONSOCK;
+    goto fail;
+  }
+  END_APILOGLEVEL
+  return request;
+fail:
+  secFreeAsyncTokenRequest(request);
+  END_APILOGLEVEL
+  return NULL;
+}
+
+int asyncTokenRequestFd(const struct async_token_request* request) {
+  return request != NULL ? request->sock : -1;
+}
+
+int asyncTokenRequestWantsWrite(const struct async_token_request* request) {
+  return request != NULL && (request->state == ASYNC_CONNECTING ||
+                             request->state == ASYNC_WRITING);
+}
+
+int asyncTokenRequestProcess(struct async_token_request* request) {
+  START_APILOGLEVEL
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    END_APILOGLEVEL
+    return 1;
+  }
+  int ret = 0;
+  switch (request->state) {
+    case ASYNC_CONNECTING: {
+      int       err     = 0;
+      socklen_t err_len = sizeof(err);
+      getsockopt(request->sock, SOL_SOCKET, SO_ERROR, &err, &err_len);
+      if (err != 0) {
+        ret = _asyncFinishError(request, OIDC_ECONSOCK);
+        break;
+      }
+      request->state = ASYNC_WRITING;
+    }
+    // fall through
+    case ASYNC_WRITING:
+      while (request->sent < request->out_len) {
+        ssize_t n = write(request->sock, request->out + request->sent,
+                          request->out_len - request->sent);
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            END_APILOGLEVEL
+            return 0;
+          }
+          ret = _asyncFinishError(request, OIDC_EWRITE);
+          END_APILOGLEVEL
+          return ret;
+        }
+        request->sent += n;
+      }
+      secFree(request->out);
+      request->state = ASYNC_READING_HEADER;
+      break;  // now wait for readability
+    case ASYNC_READING_HEADER:
+      while (request->header_got < IPC_LEN_PREFIX_SIZE) {
+        ssize_t n =
+            read(request->sock, (char*)request->header + request->header_got,
+                 IPC_LEN_PREFIX_SIZE - request->header_got);
+        if (n <= 0) {
+          if (n < 0 && errno == EINTR) {
+            continue;
+          }
+          if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            END_APILOGLEVEL
+            return 0;
+          }
+          ret = _asyncFinishError(request, OIDC_EIPCDIS);
+          END_APILOGLEVEL
+          return ret;
+        }
+        request->header_got += n;
+      }
+      request->in_len = ipc_unpackMsgLen(request->header);
+      if (request->in_len == 0) {
+        ret = _asyncFinishError(request, OIDC_EIPCDIS);
+        break;
+      }
+      request->in    = secAlloc(request->in_len + 1);
+      request->state = ASYNC_READING_PAYLOAD;
+    // fall through
+    case ASYNC_READING_PAYLOAD:
+      while (request->got < request->in_len) {
+        ssize_t n = read(request->sock, request->in + request->got,
+                         request->in_len - request->got);
+        if (n <= 0) {
+          if (n < 0 && errno == EINTR) {
+            continue;
+          }
+          if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            END_APILOGLEVEL
+            return 0;
+          }
+          ret = _asyncFinishError(request, OIDC_EIPCDIS);
+          END_APILOGLEVEL
+          return ret;
+        }
+        request->got += n;
+      }
+      close(request->sock);
+      request->sock  = -1;
+      request->state = ASYNC_DONE;
+      {
+        char* response = request->in;  // ownership passes to the parser
+        request->in    = NULL;
+        if (compactIpc_isCompact(response)) {
+          char* decoded = compactIpc_decode(response);
+          secFree(response);
+          response = decoded;
+        }
+        time_t                next_request_at = 0;
+        struct token_response token_response =
+            _getTokenResponseFromResponse(response, &next_request_at);
+        _tokenCachePut('a', request->account, request->scope, &token_response,
+                       next_request_at);
+        request->callback(token_response, request->userdata);
+      }
+      ret = 1;
+      break;
+    case ASYNC_DONE: ret = 1; break;
+  }
+  END_APILOGLEVEL
+  return ret;
+}
+
+void secFreeAsyncTokenRequest(struct async_token_request* request) {
+  START_APILOGLEVEL
+  if (request != NULL) {
+    if (request->sock >= 0) {
+      close(request->sock);
+    }
+    secFree(request->out);
+    secFree(request->in);
+    secFree(request->account);
+    secFree(request->scope);
+    secFree(request);
+  }
+  END_APILOGLEVEL
+}
+
 char* oidcagent_serror() { return oidc_serror(); }
 
 void oidcagent_perror() { oidc_perror(); }
@@ -1,6 +1,7 @@
 #ifndef OIDC_API_H
 #define OIDC_API_H
 
+#include <stddef.h>
 #include <time.h>
 
 /**
@@ -110,6 +111,271 @@ struct token_response getTokenResponseForIssuer(const char* issuer_url,
                                                 const char* scope,
                                                 const char* application_hint);
 
+/**
+ * @struct token_response_buf api.h
+ * @brief a caller-owned, reusable token response buffer
+ *
+ * Zero-initialize it before the first use. The string buffers are reused
+ * across calls and only grow when a value is longer than any seen before, so
+ * high-frequency callers do not pay an allocation per call. Has to be freed
+ * once after the last use with @c secFreeTokenResponseBuf.
+ */
+struct token_response_buf {
+  char*  token;
+  char*  issuer;
+  time_t expires_at;
+  size_t token_cap;  // allocated sizes of the buffers above
+  size_t issuer_cap;
+};
+
+/**
+ * @brief gets a valid access token for an account config into a reusable
+ * caller-owned buffer
+ *
+ * Like @c getTokenResponse, but instead of returning freshly allocated
+ * strings the result is stored in @p buf, reusing its buffers across calls.
+ * @param buf the response buffer; zero-initialized before the first call
+ * @param accountname the short name of the account config for which an
+ * access token should be returned
+ * @param min_valid_period the minium period of time the access token has to
+ * be valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration
+ * should be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @return @c 0 on success - @p buf then holds the token, issuer, and
+ * expiration time. On failure an oidc error code is returned, @c oidc_errno
+ * is set, and the buffer contents are unspecified.
+ */
+int getTokenResponseInto(struct token_response_buf* buf,
+                         const char* accountname, time_t min_valid_period,
+                         const char* scope, const char* application_hint);
+
+/**
+ * @brief clears and frees the buffers of a token_response_buf
+ * @param buf the buffer struct to be freed; the struct itself is
+ * caller-owned and is reset for reuse
+ */
+void secFreeTokenResponseBuf(struct token_response_buf* buf);
+
+/**
+ * @brief gets valid access tokens for multiple account configs in one
+ * agent round trip
+ *
+ * Where a loop over @c getTokenResponse pays one socket connect and ipc
+ * round trip per account, this sends a single request listing all accounts
+ * and the agent answers with all tokens at once. Accounts served from the
+ * client-side token cache (see @c OIDC_AGENT_TOKEN_CACHE) are not sent at
+ * all.
+ * @param accountnames an array of @p count account config short names
+ * @param count the number of entries in @p accountnames
+ * @param min_valid_period the minium period of time the access tokens have
+ * to be valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access tokens; applied to all accounts. @c NULL if default values should
+ * be used.
+ * @param application_hint a hint indicating what application requests the
+ * access tokens. This string might be displayed to the user.
+ * @return an array of @p count token_response structs, index-aligned with
+ * @p accountnames; entries for accounts that could not be served are
+ * zeroed. Has to be freed after usage using the @c secFreeTokenResponses
+ * function. On failure @c NULL is returned and @c oidc_errno is set.
+ */
+struct token_response* getTokenResponses(const char* const* accountnames,
+                                         size_t count, time_t min_valid_period,
+                                         const char* scope,
+                                         const char* application_hint);
+
+/**
+ * @brief gets valid access tokens for multiple account configs in one
+ * agent round trip
+ * @return an array of @p count access tokens, index-aligned with
+ * @p accountnames; entries for accounts that could not be served are
+ * @c NULL. Both the tokens and the array itself have to be freed after
+ * usage using the @c secFree function. On failure @c NULL is returned and
+ * @c oidc_errno is set.
+ * @see getTokenResponses
+ */
+char** getAccessTokens(const char* const* accountnames, size_t count,
+                       time_t min_valid_period, const char* scope);
+
+/**
+ * @brief clears and frees an array returned by @c getTokenResponses
+ * @param responses the array to be freed
+ * @param count the count that was passed to @c getTokenResponses
+ */
+void secFreeTokenResponses(struct token_response* responses, size_t count);
+
+/**
+ * @struct agent_connection api.h
+ * @brief an opaque handle for a persistent connection to the agent
+ */
+struct agent_connection;
+
+/**
+ * @brief opens a persistent connection to the agent
+ *
+ * The returned handle keeps the agent socket open, so repeated token requests
+ * made through it only cost a single round trip instead of a connection setup
+ * and teardown per request.
+ * @return a pointer to the connection handle. Has to be closed after usage
+ * using @c agent_disconnect. On failure @c NULL is returned and @c oidc_errno
+ * is set.
+ */
+struct agent_connection* agent_connect();
+
+/**
+ * @brief gets a valid access token for an account config as well as related
+ * information, using a persistent agent connection
+ * @param agent the connection handle obtained from @c agent_connect
+ * @param accountname the short name of the account config for which an access
+ * token should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration should
+ * be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+struct token_response agent_getTokenResponse(struct agent_connection* agent,
+                                             const char* accountname,
+                                             time_t      min_valid_period,
+                                             const char* scope,
+                                             const char* application_hint);
+
+/**
+ * @brief gets a valid access token for an account config, using a persistent
+ * agent connection
+ * @param agent the connection handle obtained from @c agent_connect
+ * @param accountname the short name of the account config for which an access
+ * token should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration should
+ * be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @return a pointer to the access token. Has to be freed after usage using
+ * @c secFree function. On failure @c NULL is returned and @c oidc_errno is set.
+ */
+char* agent_getAccessToken(struct agent_connection* agent,
+                           const char* accountname, time_t min_valid_period,
+                           const char* scope, const char* application_hint);
+
+/**
+ * @brief closes a persistent agent connection and frees the handle
+ * @param agent the connection handle obtained from @c agent_connect
+ */
+void agent_disconnect(struct agent_connection* agent);
+
+/**
+ * @struct async_token_request api.h
+ * @brief an opaque handle for a token request in flight
+ */
+struct async_token_request;
+
+/**
+ * @brief the completion callback for an asynchronous token request
+ * @param response the token response; ownership passes to the callback,
+ * which has to free it using @c secFreeTokenResponse. On failure a zeroed
+ * response is passed and @c oidc_errno is set.
+ * @param userdata the pointer given to @c getAccessTokenAsync
+ */
+typedef void (*token_response_callback)(struct token_response response,
+                                        void*                 userdata);
+
+/**
+ * @brief starts an asynchronous token request
+ *
+ * The request is performed with non-blocking io against the agent socket,
+ * so event-driven applications can drive many token requests from one
+ * thread: add the fd from @c asyncTokenRequestFd to the event loop -
+ * waiting for writability while @c asyncTokenRequestWantsWrite returns
+ * @c 1 and for readability otherwise - and call
+ * @c asyncTokenRequestProcess whenever the fd is ready.
+ * @param accountname the short name of the account config for which an
+ * access token should be returned
+ * @param min_valid_period the minium period of time the access token has to
+ * be valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration
+ * should be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param callback called exactly once when the request finishes
+ * @param userdata passed through to @p callback
+ * @return a pointer to the request handle. Has to be freed after completion
+ * using @c secFreeAsyncTokenRequest. If the token cache satisfies the
+ * request, the callback is invoked before this function returns and the
+ * handle is already completed. On failure to even start the request @c NULL
+ * is returned, @c oidc_errno is set, and the callback is not invoked.
+ */
+struct async_token_request* getAccessTokenAsync(
+    const char* accountname, time_t min_valid_period, const char* scope,
+    const char* application_hint, token_response_callback callback,
+    void* userdata);
+
+/**
+ * @brief gets the pollable fd of an asynchronous token request
+ * @return the fd to wait on; @c -1 if the request already completed
+ */
+int asyncTokenRequestFd(const struct async_token_request* request);
+
+/**
+ * @brief checks what event an asynchronous token request is waiting for
+ * @return @c 1 if the fd should be polled for writability, @c 0 for
+ * readability
+ */
+int asyncTokenRequestWantsWrite(const struct async_token_request* request);
+
+/**
+ * @brief advances an asynchronous token request
+ * Call this whenever the fd is ready for the polled event. It performs all
+ * io currently possible without blocking.
+ * @return @c 1 when the request finished and the callback was invoked -
+ * stop polling the fd; @c 0 while the request is still in flight
+ */
+int asyncTokenRequestProcess(struct async_token_request* request);
+
+/**
+ * @brief frees an asynchronous token request handle
+ * Aborts the request if it is still in flight; the callback is not invoked.
+ * @param request the handle obtained from @c getAccessTokenAsync
+ */
+void secFreeAsyncTokenRequest(struct async_token_request* request);
+
+/**
+ * @brief enables the compact binary ipc framing for this process
+ *
+ * Token requests and responses are exchanged in a compact tagged encoding
+ * instead of json text, roughly halving the serialization cost on both
+ * sides. Only useful for applications requesting tokens at high frequency;
+ * requires an agent that understands the compact framing (older agents
+ * reject compact requests as malformed). Can also be enabled by setting the
+ * environment variable @c OIDC_AGENT_COMPACT_IPC.
+ */
+void oidcagent_useCompactIpc();
+
+/**
+ * @brief enables the per-process token cache for this application
+ *
+ * Token responses are cached in memory keyed by account (or issuer url) and
+ * scope; a repeat request whose @c min_valid_period is still satisfied by
+ * the cached token's expiration time is served without talking to the
+ * agent. Only useful for applications requesting the same token at high
+ * frequency; revocations by the agent are not seen until the cached token
+ * expires. Can also be enabled by setting the environment variable
+ * @c OIDC_AGENT_TOKEN_CACHE.
+ */
+void oidcagent_useTokenCache();
+
 /**
  * @brief gets an error string detailing the last occured error
  * @return the error string. MUST NOT be freed.
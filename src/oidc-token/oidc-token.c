@@ -1,3 +1,4 @@
+#define _XOPEN_SOURCE 700
 #include "oidc-token.h"
 #ifndef __APPLE__
 #include "privileges/token_privileges.h"
@@ -5,9 +6,14 @@
 #include "utils/disableTracing.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/numberString.h"
 
 #include "api.h"
 
+#include <string.h>
+#include <unistd.h>
+
 int main(int argc, char** argv) {
   platform_disable_tracing();
   logger_open("oidc-token");
@@ -36,7 +42,9 @@ int main(int argc, char** argv) {
       // fprintf(stderr, "Error: %s\n", oidcagent_serror());
       oidcagent_perror();
     } else {
-      if (arguments.printAll) {
+      if (arguments.format) {
+        printFormatted(arguments.format, response);
+      } else if (arguments.printAll) {
         printf("%s\n", response.token);
         printf("%s\n", response.issuer);
         printf("%lu\n", response.expires_at);
@@ -80,6 +88,71 @@ int main(int argc, char** argv) {
   return 0;
 }
 
+/**
+ * @brief returns the response field a format specifier refers to
+ * @return the field value or @c NULL for an unknown specifier
+ */
+static const char* _formatField(char c, const struct token_response* response,
+                                const char* expires) {
+  switch (c) {
+    case 't': return response->token;
+    case 'i': return response->issuer ?: "";
+    case 'e': return expires;
+    default: return NULL;
+  }
+}
+
+void printFormatted(const char* format, struct token_response response) {
+  if (format == NULL) {
+    fprintf(stderr, "passed NULL to %s", __func__);
+    return;
+  }
+  char* expires = ulongToString(response.expires_at);
+  // two passes over the template: measure, then fill, so the whole output
+  // leaves in one write
+  size_t len = 0;
+  for (const char* p = format; *p; p++) {
+    if (*p == '%' && p[1] != '\0') {
+      const char* value = _formatField(p[1], &response, expires);
+      if (value != NULL) {
+        len += strlen(value);
+        p++;
+        continue;
+      }
+      if (p[1] == '%') {
+        p++;
+      }
+    } else if (*p == '\\' && (p[1] == 'n' || p[1] == 't' || p[1] == '\\')) {
+      p++;
+    }
+    len++;
+  }
+  char* out = secAlloc(len + 1);
+  char* o   = out;
+  for (const char* p = format; *p; p++) {
+    if (*p == '%' && p[1] != '\0') {
+      const char* value = _formatField(p[1], &response, expires);
+      if (value != NULL) {
+        o = stpcpy(o, value);
+        p++;
+        continue;
+      }
+      if (p[1] == '%') {
+        p++;
+      }
+    } else if (*p == '\\' && (p[1] == 'n' || p[1] == 't' || p[1] == '\\')) {
+      p++;
+      *o++ = *p == 'n' ? '\n' : *p == 't' ? '\t' : '\\';
+      continue;
+    }
+    *o++ = *p;
+  }
+  ssize_t written = write(STDOUT_FILENO, out, len);
+  (void)written;
+  secFree(out);
+  secFree(expires);
+}
+
 void printEnvCommands(struct arguments*     arguments,
                       struct token_response response) {
   if (arguments == NULL) {
@@ -12,4 +12,5 @@ const char* argp_program_bug_address = BUG_ADDRESS;
 
 void printEnvCommands(struct arguments*     arguments,
                       struct token_response response);
+void printFormatted(const char* format, struct token_response response);
 #endif  // OIDC_TOKEN_H
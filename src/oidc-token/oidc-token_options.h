@@ -30,10 +30,13 @@ struct arguments {
   unsigned char seccomp;
   unsigned char printAll;
 
+  char* format;
+
   time_t min_valid_period;
 };
 
 #define OPT_SECCOMP 1
+#define OPT_FORMAT 2
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "General:", 1},
@@ -72,6 +75,13 @@ static struct argp_option options[] = {
      "Return all available information (token, issuer, expiration time). Each "
      "value is printed in one line.",
      2},
+    {"format", OPT_FORMAT, "TEMPLATE", 0,
+     "Print the fields described by TEMPLATE in a single output operation. %t "
+     "is replaced by the access token, %i by the issuer, and %e by the "
+     "expiration time; %% gives a literal percent sign and \\n and \\t give a "
+     "newline / tab. No trailing newline is added. All fields come from the "
+     "same agent response, so scripts never have to call oidc-token twice.",
+     2},
 
     {0, 0, 0, 0, "Advanced:", 2},
     {"scope", 's', "SCOPE", 0,
@@ -107,6 +117,7 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
       arguments->min_valid_period = strToInt(arg);
       break;
     case OPT_SECCOMP: arguments->seccomp = 1; break;
+    case OPT_FORMAT: arguments->format = arg; break;
     case 'i':
       arguments->issuer_env.str   = arg;
       arguments->issuer_env.useIt = 1;
@@ -163,6 +174,7 @@ static inline void initArguments(struct arguments* arguments) {
   arguments->issuer_env.str       = NULL;
   arguments->issuer_env.useIt     = 0;
   arguments->printAll             = 0;
+  arguments->format               = NULL;
 }
 
 #endif  // OIDC_TOKEN_OPTIONS_H
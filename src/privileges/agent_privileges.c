@@ -1,14 +1,126 @@
-// #define _XOPEN_SOURCE 500
+#define _XOPEN_SOURCE 500
 #include "agent_privileges.h"
+#include "defines/settings.h"
 #include "privileges.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <seccomp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// #include <unistd.h>
+/**
+ * Parsing the privilege profiles and compiling them into a BPF filter with
+ * libseccomp takes tens of milliseconds - during the most latency-sensitive
+ * phase of agent startup. The compiled program is therefore cached as a
+ * binary file in the oidc directory: subsequent starts load it with two
+ * prctl calls and skip the parse and compile entirely. The cache is
+ * invalidated by comparing its mtime against the profile files; the kill
+ * path uses a separate cache file since its filter differs.
+ */
+
+// the profiles the agent filter is built from (including the transitive
+// ones the add functions pull in); a cache older than any of them is stale
+static const char* agent_profiles[] = {
+    "general", "memory", "print",  "logging", "time",       "socket",
+    "agentIpc", "crypt", "daemon", "http",    "httpserver", "kill"};
+
+static char* _bpfCachePath(int kill_flag) {
+  return concatToOidcDir(kill_flag ? "agent-seccomp-kill.bpf"
+                                   : "agent-seccomp.bpf");
+}
+
+static time_t _profilesMaxMtime() {
+  time_t newest = 0;
+  for (size_t i = 0; i < sizeof(agent_profiles) / sizeof(*agent_profiles);
+       i++) {
+    char* path =
+        oidc_sprintf("%s/%s.priv", PRIVILEGES_PATH, agent_profiles[i]);
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_mtime > newest) {
+      newest = st.st_mtime;
+    }
+    secFree(path);
+  }
+  return newest;
+}
+
+/**
+ * @brief loads a cached precompiled BPF program
+ * @return 0 on success, -1 if there is no usable (existing, fresh,
+ * well-formed) cache - the caller then compiles the filter normally
+ */
+static int _loadCachedBpf(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_mtime < _profilesMaxMtime() ||
+      st.st_size == 0 ||
+      st.st_size % (off_t)sizeof(struct sock_filter) != 0 ||
+      st.st_size / (off_t)sizeof(struct sock_filter) > USHRT_MAX) {
+    close(fd);
+    return -1;
+  }
+  struct sock_filter* insns = secAlloc(st.st_size);
+  ssize_t             r     = read(fd, insns, st.st_size);
+  close(fd);
+  if (r != st.st_size) {
+    secFree(insns);
+    return -1;
+  }
+  struct sock_fprog prog = {
+      .len    = st.st_size / sizeof(struct sock_filter),
+      .filter = insns,
+  };
+  // what seccomp_load would do, minus compiling: no new privs, then attach
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+      prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0) {
+    secFree(insns);
+    return -1;
+  }
+  secFree(insns);
+  return 0;
+}
+
+/**
+ * @brief writes the compiled program of @p ctx to the cache file
+ * Has to run before the filter is loaded - afterwards the file syscalls
+ * needed here may already be denied.
+ */
+static void _writeBpfCache(scmp_filter_ctx ctx, const char* path) {
+  char* tmp = oidc_sprintf("%s.tmp", path);
+  int   fd  = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    secFree(tmp);
+    return;
+  }
+  if (seccomp_export_bpf(ctx, fd) == 0) {
+    close(fd);
+    rename(tmp, path);  // atomic; a concurrent start sees the old or the
+                        // new cache, never a partial one
+  } else {
+    close(fd);
+    unlink(tmp);
+  }
+  secFree(tmp);
+}
 
 void initOidcAgentPrivileges(struct arguments* arguments) {
+  char* cache = _bpfCachePath(arguments->kill_flag);
+  if (cache != NULL && _loadCachedBpf(cache) == 0) {
+    secFree(cache);
+    return;  // the precompiled program is active; nothing was parsed
+  }
   int             rc  = -1;
   scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
   if (ctx == NULL) {
@@ -28,6 +140,10 @@ void initOidcAgentPrivileges(struct arguments* arguments) {
   addHttpSysCalls(ctx);
   addHttpServerSysCalls(ctx);
 
+  if (cache != NULL) {
+    _writeBpfCache(ctx, cache);  // the next start skips the compile
+  }
+  secFree(cache);
   rc = seccomp_load(ctx);
   seccomp_release(ctx);
   checkRc(rc, "seccomp_load", "");
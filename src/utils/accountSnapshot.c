@@ -0,0 +1,130 @@
+#include "accountSnapshot.h"
+#include "account/account.h"
+#include "utils/db/account_db.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+struct accountSnapshotEntry {
+  char*         name;
+  char*         issuer;
+  time_t        death;
+  time_t        last_used;
+  unsigned long used_count;
+  unsigned long token_expires_at;
+};
+
+static struct accountSnapshotEntry* snapshot     = NULL;
+static size_t                       snapshot_len = 0;
+
+// bumped on every refresh, so consumers can cheaply detect that the
+// loaded account set (or its token expiries) changed
+static unsigned long generation = 0;
+
+static void _secFreeSnapshot() {
+  for (size_t i = 0; i < snapshot_len; i++) {
+    secFree(snapshot[i].name);
+    secFree(snapshot[i].issuer);
+  }
+  secFree(snapshot);
+  snapshot     = NULL;
+  snapshot_len = 0;
+}
+
+/**
+ * @brief rebuilds the snapshot from the account db
+ * Has to be called after every account add / remove; the walk over the
+ * account structs happens only here, readers see just the copied public
+ * attributes.
+ */
+void accountSnapshot_refresh() {
+  _secFreeSnapshot();
+  generation++;
+  list_t* accounts = accountDB_getList();
+  if (accounts == NULL || accounts->len == 0) {
+    return;
+  }
+  snapshot = secAlloc(accounts->len * sizeof(struct accountSnapshotEntry));
+  list_node_t* node;
+  LIST_FOREACH(accounts, node) {
+    struct oidc_account* account = node->val;
+    snapshot[snapshot_len].name = oidc_strcopy(account_getName(account));
+    snapshot[snapshot_len].issuer =
+        oidc_strcopy(account_getIssuerUrl(account));
+    snapshot[snapshot_len].death      = account_getDeath(account);
+    snapshot[snapshot_len].last_used  = account_getLastUsed(account);
+    snapshot[snapshot_len].used_count = account_getUsedCount(account);
+    snapshot[snapshot_len].token_expires_at =
+        account_getTokenExpiresAt(account);
+    snapshot_len++;
+  }
+  logger(DEBUG, "Refreshed account snapshot with %lu entries", snapshot_len);
+}
+
+/**
+ * @brief returns the number of snapshot refreshes done so far
+ */
+unsigned long accountSnapshot_generation() { return generation; }
+
+/**
+ * @brief returns the loaded account short names as JSON Array String
+ * Served from the snapshot without touching the account db. Has to be freed
+ * after usage.
+ */
+char* accountSnapshot_nameListJSON() {
+  char* list = oidc_strcopy("[");
+  for (size_t i = 0; i < snapshot_len; i++) {
+    char* tmp = oidc_sprintf("%s%s\"%s\"", list, i == 0 ? "" : ",",
+                             snapshot[i].name);
+    secFree(list);
+    list = tmp;
+  }
+  char* str = oidc_strcat(list, "]");
+  secFree(list);
+  return str;
+}
+
+/**
+ * @brief returns per-account usage statistics as JSON Array String
+ * Has to be freed after usage.
+ */
+char* accountSnapshot_usageJSON() {
+  char* usage = oidc_strcopy("[");
+  for (size_t i = 0; i < snapshot_len; i++) {
+    char* tmp = oidc_sprintf(
+        "%s%s{\"account\":\"%s\",\"issuer\":\"%s\",\"last_used\":%lu,"
+        "\"used_count\":%lu,\"death\":%lu}",
+        usage, i == 0 ? "" : ",", snapshot[i].name, snapshot[i].issuer ?: "",
+        snapshot[i].last_used, snapshot[i].used_count, snapshot[i].death);
+    secFree(usage);
+    usage = tmp;
+  }
+  char* str = oidc_strcat(usage, "]");
+  secFree(usage);
+  return str;
+}
+
+/**
+ * @brief returns a freshness summary for health monitoring as JSON Object
+ * String
+ *
+ * Contains the loaded account count and per account the cached access
+ * token's expiry time and the account's configured lifetime end, so a
+ * monitor can see how long the agent can serve from cache without another
+ * token request. Has to be freed after usage.
+ */
+char* accountSnapshot_healthJSON() {
+  char* accounts = oidc_strcopy("[");
+  for (size_t i = 0; i < snapshot_len; i++) {
+    char* tmp = oidc_sprintf(
+        "%s%s{\"account\":\"%s\",\"token_expires_at\":%lu,\"death\":%lu}",
+        accounts, i == 0 ? "" : ",", snapshot[i].name,
+        snapshot[i].token_expires_at, snapshot[i].death);
+    secFree(accounts);
+    accounts = tmp;
+  }
+  char* str = oidc_sprintf("{\"loaded_accounts\":%lu,\"accounts\":%s]}",
+                           snapshot_len, accounts);
+  secFree(accounts);
+  return str;
+}
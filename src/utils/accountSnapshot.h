@@ -0,0 +1,20 @@
+#ifndef OIDC_ACCOUNT_SNAPSHOT_H
+#define OIDC_ACCOUNT_SNAPSHOT_H
+
+#include <time.h>
+
+/**
+ * Read-only snapshot of the loaded accounts' public attributes (short name,
+ * issuer url, expiry and usage times). It is refreshed whenever an account
+ * is added to or removed from the account db, so list and status queries
+ * are answered from a compact contiguous array and never walk the
+ * secret-bearing account structs.
+ */
+
+void          accountSnapshot_refresh();
+unsigned long accountSnapshot_generation();
+char*         accountSnapshot_nameListJSON();
+char*         accountSnapshot_usageJSON();
+char*         accountSnapshot_healthJSON();
+
+#endif  // OIDC_ACCOUNT_SNAPSHOT_H
@@ -1,6 +1,8 @@
 #include "accountUtils.h"
 #include "account/account.h"
+#include "accountSnapshot.h"
 #include "deathUtils.h"
+#include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
 #include "utils/db/account_db.h"
 #include "utils/file_io/cryptFileUtils.h"
@@ -34,6 +36,79 @@ struct oidc_account* getDeathAccount() {
   return accountDB_getDeathEntry((time_t(*)(void*))account_getDeath);
 }
 
+/**
+ * @brief evicts least recently used accounts until at most @p maxAccounts
+ * are loaded
+ * Only accounts whose configuration is persisted on disk are evicted, so an
+ * evicted account can be loaded again (or autoloaded) at any time; accounts
+ * that exist only in the agent are always kept.
+ * @param maxAccounts the maximum number of loaded accounts; @c 0 means
+ * unlimited
+ */
+void accountDB_enforceLimit(unsigned long maxAccounts) {
+  if (maxAccounts == 0) {
+    return;
+  }
+  while (accountDB_getSize() > maxAccounts) {
+    struct oidc_account* lru      = NULL;
+    list_t*              accounts = accountDB_getList();
+    list_node_t*         node;
+    LIST_FOREACH(accounts, node) {
+      struct oidc_account* account = node->val;
+      if (!accountConfigExists(account_getName(account))) {
+        continue;
+      }
+      if (lru == NULL ||
+          account_getLastUsed(account) < account_getLastUsed(lru)) {
+        lru = account;
+      }
+    }
+    if (lru == NULL) {  // nothing evictable
+      return;
+    }
+    logger(NOTICE, "Evicting least recently used account '%s'",
+           account_getName(lru));
+    accountDB_removeIfFound(lru);
+    accountSnapshot_refresh();
+  }
+}
+
+/**
+ * @brief evicts accounts that have not been used for @p idle_for seconds
+ * Like @c accountDB_enforceLimit only accounts whose configuration is
+ * persisted on disk are evicted: the encrypted config file is the sealed
+ * form of their secrets, and autoload brings them back on the next request.
+ * Used by the memory-pressure reclamation.
+ * @return the number of evicted accounts
+ */
+unsigned int accountDB_evictIdle(time_t idle_for) {
+  time_t       cutoff  = time(NULL) - idle_for;
+  unsigned int evicted = 0;
+  while (1) {
+    struct oidc_account* victim   = NULL;
+    list_t*              accounts = accountDB_getList();
+    list_node_t*         node;
+    LIST_FOREACH(accounts, node) {
+      struct oidc_account* account = node->val;
+      if (account_getLastUsed(account) < cutoff &&
+          accountConfigExists(account_getName(account))) {
+        victim = account;
+        break;
+      }
+    }
+    if (victim == NULL) {
+      break;
+    }
+    logger(NOTICE, "Evicting idle account '%s'", account_getName(victim));
+    accountDB_removeIfFound(victim);
+    evicted++;
+  }
+  if (evicted) {
+    accountSnapshot_refresh();
+  }
+  return evicted;
+}
+
 struct oidc_account* getAccountFromMaybeEncryptedFile(const char* filepath) {
   if (filepath == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -44,8 +119,14 @@ struct oidc_account* getAccountFromMaybeEncryptedFile(const char* filepath) {
     return NULL;
   }
   if (!isJSONObject(config)) {
-    char* tmp = getDecryptedTextWithPromptFor(config, filepath,
-                                              decryptFileContent, 0, NULL);
+    // binary containers cannot be passed around as strings; hand the prompt
+    // loop the filepath and the file-based decrypt function instead
+    char* tmp =
+        crypt_isBinaryCipher(config)
+            ? getDecryptedTextWithPromptFor(filepath, filepath, decryptFile, 0,
+                                            NULL)
+            : getDecryptedTextWithPromptFor(config, filepath,
+                                            decryptFileContent, 0, NULL);
     if (NULL == tmp) {
       return NULL;
     }
@@ -187,11 +268,13 @@ list_t* db_findAccountsByIssuerUrl(const char* issuer_url) {
   }
   matchFunction oldMatch =
       accountDB_setMatchFunction((matchFunction)account_matchByIssuerUrl);
-  char*               tmp      = oidc_strcopy(issuer_url);
-  struct oidc_issuer  iss      = {.issuer_url = tmp};
+  char*              tmp = oidc_strcopy(issuer_url);
+  struct oidc_issuer iss = {.issuer_url = tmp};
+  issuer_cacheNormalizedUrl(&iss);  // so the lookup stays on the hashed path
   struct oidc_account key      = {.issuer = &iss};
   list_t*             accounts = accountDB_findAllValues(&key);
   secFree(tmp);
+  secFree(iss.issuer_url_norm);
   accountDB_setMatchFunction(oldMatch);
   return accounts;
 }
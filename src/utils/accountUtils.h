@@ -7,6 +7,8 @@
 
 time_t               getMinAccountDeath();
 struct oidc_account* getDeathAccount();
+void                 accountDB_enforceLimit(unsigned long maxAccounts);
+unsigned int         accountDB_evictIdle(time_t idle_for);
 
 struct oidc_account* getAccountFromFile(const char* filepath);
 struct oidc_account* getDecryptedAccountFromFile(const char* accountname,
@@ -0,0 +1,296 @@
+#define _XOPEN_SOURCE 700
+#include "agent_metrics.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Agent-level request metrics.
+ *
+ * Counts requests into a per-operation slot holding a request counter, the
+ * accumulated handling time and a power-of-two latency histogram - the same
+ * lock-free scheme the per-host HTTP metrics use: slots are found by
+ * scanning a fixed array whose op names are published with a release store,
+ * counters are updated with relaxed atomic adds, and only registering a new
+ * op takes a mutex. oidcp and oidcd each collect into their own copy of the
+ * table (they are separate processes); both are exposed through the metrics
+ * request, so the gap between the client wall time oidcp sees and the
+ * handler time oidcd sees is the pipe and queueing overhead.
+ *
+ * Timestamps come from CLOCK_MONOTONIC_COARSE: millisecond buckets do not
+ * need better resolution and the coarse clock stays off the vsyscall slow
+ * paths.
+ */
+
+#define AGENT_METRICS_OPS 24
+#define AGENT_METRICS_BUCKETS 16
+
+struct agent_metrics_entry {
+  char*         op;
+  unsigned long requests;
+  unsigned long total_time_ms;
+  unsigned long buckets[AGENT_METRICS_BUCKETS];
+};
+
+static struct agent_metrics_entry ops[AGENT_METRICS_OPS];
+static pthread_mutex_t            ops_register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long agent_metrics_now_ms() {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) != 0)
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000 +
+         (unsigned long)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief microsecond timestamp from the precise monotonic clock
+ *
+ * For sub-millisecond measurements like the event loop phase profiling,
+ * where the coarse clock's resolution would round everything to zero.
+ */
+unsigned long agent_metrics_now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000 +
+         (unsigned long)ts.tv_nsec / 1000;
+}
+
+static struct agent_metrics_entry* _ops_find(const char* op) {
+  for (unsigned char i = 0; i < AGENT_METRICS_OPS; i++) {
+    char* o = __atomic_load_n(&ops[i].op, __ATOMIC_ACQUIRE);
+    if (o != NULL && strequal(o, op)) {
+      return &ops[i];
+    }
+  }
+  return NULL;
+}
+
+static struct agent_metrics_entry* _ops_register(const char* op) {
+  pthread_mutex_lock(&ops_register_lock);
+  struct agent_metrics_entry* entry = _ops_find(op);
+  if (entry != NULL) {  // registered concurrently
+    pthread_mutex_unlock(&ops_register_lock);
+    return entry;
+  }
+  for (unsigned char i = 0; i < AGENT_METRICS_OPS; i++) {
+    if (ops[i].op == NULL) {
+      // publish the op name last so lock-free readers only see complete slots
+      __atomic_store_n(&ops[i].op, oidc_strcopy(op), __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&ops_register_lock);
+      return &ops[i];
+    }
+  }
+  pthread_mutex_unlock(&ops_register_lock);
+  logger(DEBUG, "agent metrics table full; not counting %s", op);
+  return NULL;
+}
+
+/**
+ * @brief counts a handled request
+ * @param op the request type or internal job name it is counted under
+ * @param duration_ms how long the handling took
+ */
+void agent_metrics_record(const char* op, unsigned long duration_ms) {
+  if (op == NULL) {
+    return;
+  }
+  struct agent_metrics_entry* entry = _ops_find(op);
+  if (entry == NULL) {
+    entry = _ops_register(op);
+    if (entry == NULL) {
+      return;
+    }
+  }
+  unsigned char bucket = 0;
+  for (unsigned long v = duration_ms;
+       v > 0 && bucket < AGENT_METRICS_BUCKETS - 1; v >>= 1) {
+    bucket++;
+  }
+  __atomic_add_fetch(&entry->requests, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->total_time_ms, duration_ms, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->buckets[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Span tracing for the interactive auth code flow, correlated by the flow's
+ * state string. Each stage boundary records the time since the previous
+ * boundary under the stage's op name, so the per-op histograms above show
+ * where interactive login time goes - webserver setup, the user
+ * authorizing, the code exchange, delivering the config - instead of one
+ * opaque total. Boundaries are hit from the main loop and from the redirect
+ * listener threads, hence the lock.
+ */
+#ifndef AGENT_METRICS_FLOWS
+#define AGENT_METRICS_FLOWS 32
+#endif
+
+struct flow_trace {
+  char*         state;
+  unsigned long last_ms;
+};
+
+static struct flow_trace flow_traces[AGENT_METRICS_FLOWS];
+static pthread_mutex_t   flow_traces_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief starts the span trace of the auth code flow for @p state
+ */
+void agent_metrics_flowBegin(const char* state) {
+  if (state == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&flow_traces_lock);
+  for (unsigned char i = 0; i < AGENT_METRICS_FLOWS; i++) {
+    if (flow_traces[i].state == NULL) {
+      flow_traces[i].state   = oidc_strcopy(state);
+      flow_traces[i].last_ms = agent_metrics_now_ms();
+      break;
+    }
+  }
+  pthread_mutex_unlock(&flow_traces_lock);
+}
+
+/**
+ * @brief records the time since the previous stage boundary of the flow
+ * for @p state under the op name @p stage
+ * Unknown states are ignored, so boundaries may be hit unconditionally.
+ */
+void agent_metrics_flowStage(const char* state, const char* stage) {
+  if (state == NULL) {
+    return;
+  }
+  unsigned long now      = agent_metrics_now_ms();
+  unsigned long duration = 0;
+  int           found    = 0;
+  pthread_mutex_lock(&flow_traces_lock);
+  for (unsigned char i = 0; i < AGENT_METRICS_FLOWS; i++) {
+    if (flow_traces[i].state != NULL &&
+        strequal(flow_traces[i].state, state)) {
+      duration               = now - flow_traces[i].last_ms;
+      flow_traces[i].last_ms = now;
+      found                  = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&flow_traces_lock);
+  if (found) {
+    agent_metrics_record(stage, duration);
+  }
+}
+
+/**
+ * @brief drops the span trace of the flow for @p state
+ */
+void agent_metrics_flowEnd(const char* state) {
+  if (state == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&flow_traces_lock);
+  for (unsigned char i = 0; i < AGENT_METRICS_FLOWS; i++) {
+    if (flow_traces[i].state != NULL &&
+        strequal(flow_traces[i].state, state)) {
+      secFree(flow_traces[i].state);
+      flow_traces[i].state = NULL;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&flow_traces_lock);
+}
+
+/**
+ * @brief dumps all collected metrics
+ * @return a pointer to a JSON object string, keyed by op. Has to be freed
+ * after usage.
+ */
+char* agent_metrics_toJSON() {
+  cJSON* obj = stringToJson("{}");
+  if (obj == NULL) {
+    return NULL;
+  }
+  for (unsigned char i = 0; i < AGENT_METRICS_OPS; i++) {
+    char* op = __atomic_load_n(&ops[i].op, __ATOMIC_ACQUIRE);
+    if (op == NULL) {
+      continue;
+    }
+    cJSON* e = stringToJson("{}");
+    jsonAddNumberValue(e, "requests",
+                       __atomic_load_n(&ops[i].requests, __ATOMIC_RELAXED));
+    jsonAddNumberValue(
+        e, "total_time_ms",
+        __atomic_load_n(&ops[i].total_time_ms, __ATOMIC_RELAXED));
+    char* buckets = oidc_strcopy("[");
+    for (unsigned char b = 0; b < AGENT_METRICS_BUCKETS; b++) {
+      char* tmp = oidc_sprintf(
+          "%s%s%lu", buckets, b == 0 ? "" : ",",
+          __atomic_load_n(&ops[i].buckets[b], __ATOMIC_RELAXED));
+      secFree(buckets);
+      buckets = tmp;
+    }
+    char* arr = oidc_strcat(buckets, "]");
+    secFree(buckets);
+    jsonAddArrayValue(e, "latency_ms_pow2_buckets", arr);
+    secFree(arr);
+    jsonAddJSON(obj, op, e);
+  }
+  char* json = jsonToStringUnformatted(obj);
+  secFreeJson(obj);
+  return json;
+}
+
+/**
+ * @brief dumps all collected metrics in the Prometheus text exposition
+ * format
+ *
+ * The power-of-two buckets map exactly onto cumulative 'le' bounds: after
+ * adding bucket @c b the covered durations are those below @c 2^b ms, so
+ * the bound is @c 2^b-1.
+ * @return a pointer to the exposition text. Has to be freed after usage.
+ */
+char* agent_metrics_toPrometheus() {
+  char* text = oidc_strcopy(
+      "# HELP oidc_agent_requests_total Requests handled, by operation.\n"
+      "# TYPE oidc_agent_requests_total counter\n"
+      "# HELP oidc_agent_request_duration_milliseconds Request handling "
+      "time, by operation.\n"
+      "# TYPE oidc_agent_request_duration_milliseconds histogram\n");
+  for (unsigned char i = 0; i < AGENT_METRICS_OPS; i++) {
+    char* op = __atomic_load_n(&ops[i].op, __ATOMIC_ACQUIRE);
+    if (op == NULL) {
+      continue;
+    }
+    unsigned long requests = __atomic_load_n(&ops[i].requests,
+                                             __ATOMIC_RELAXED);
+    char*         tmp      = oidc_sprintf(
+        "%soidc_agent_requests_total{op=\"%s\"} %lu\n", text, op, requests);
+    secFree(text);
+    text              = tmp;
+    unsigned long cum = 0;
+    for (unsigned char b = 0; b < AGENT_METRICS_BUCKETS - 1; b++) {
+      cum += __atomic_load_n(&ops[i].buckets[b], __ATOMIC_RELAXED);
+      tmp = oidc_sprintf(
+          "%soidc_agent_request_duration_milliseconds_bucket{op=\"%s\","
+          "le=\"%lu\"} %lu\n",
+          text, op, (1UL << b) - 1, cum);
+      secFree(text);
+      text = tmp;
+    }
+    tmp = oidc_sprintf(
+        "%soidc_agent_request_duration_milliseconds_bucket{op=\"%s\","
+        "le=\"+Inf\"} %lu\n"
+        "oidc_agent_request_duration_milliseconds_sum{op=\"%s\"} %lu\n"
+        "oidc_agent_request_duration_milliseconds_count{op=\"%s\"} %lu\n",
+        text, op, requests, op,
+        __atomic_load_n(&ops[i].total_time_ms, __ATOMIC_RELAXED), op,
+        requests);
+    secFree(text);
+    text = tmp;
+  }
+  return text;
+}
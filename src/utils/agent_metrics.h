@@ -0,0 +1,14 @@
+#ifndef AGENT_METRICS_H
+#define AGENT_METRICS_H
+
+unsigned long agent_metrics_now_ms();
+unsigned long agent_metrics_now_us();
+void  agent_metrics_record(const char* op, unsigned long duration_ms);
+char* agent_metrics_toJSON();
+char* agent_metrics_toPrometheus();
+
+void agent_metrics_flowBegin(const char* state);
+void agent_metrics_flowStage(const char* state, const char* stage);
+void agent_metrics_flowEnd(const char* state);
+
+#endif  // AGENT_METRICS_H
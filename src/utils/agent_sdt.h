@@ -0,0 +1,23 @@
+#ifndef AGENT_SDT_H
+#define AGENT_SDT_H
+
+/*
+ * Static tracepoints (USDT) at the agent's hot-path boundaries, for
+ * bpftrace / systemtap profiling of production agents without log
+ * parsing. Built with `make USDT=1` (needs systemtap-sdt-dev); without
+ * the flag the probe macros expand to nothing, so the default build pays
+ * zero overhead. The provider name is oidc_agent.
+ */
+
+#ifdef AGENT_USDT
+#include <sys/sdt.h>
+#define AGENT_PROBE(name) DTRACE_PROBE(oidc_agent, name)
+#define AGENT_PROBE1(name, a) DTRACE_PROBE1(oidc_agent, name, (a))
+#define AGENT_PROBE2(name, a, b) DTRACE_PROBE2(oidc_agent, name, (a), (b))
+#else
+#define AGENT_PROBE(name)
+#define AGENT_PROBE1(name, a)
+#define AGENT_PROBE2(name, a, b)
+#endif  // AGENT_USDT
+
+#endif  // AGENT_SDT_H
@@ -0,0 +1,52 @@
+#include "agent_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static __thread char trace_id[AGENT_TRACE_ID_LEN + 1];
+static __thread int  trace_active = 0;
+
+static unsigned long trace_counter = 0;
+
+/**
+ * @brief generates a new trace id for the calling thread
+ *
+ * The id mixes a process-wide counter with a pid / start time seed, so ids
+ * from the forked oidcp and oidcd processes and from agent restarts do not
+ * collide in the logs.
+ * @return the new id; owned by the calling thread's trace state
+ */
+const char* agent_trace_begin() {
+  static unsigned long seed = 0;
+  if (seed == 0) {
+    seed = ((unsigned long)getpid() << 20) ^ (unsigned long)time(NULL);
+  }
+  unsigned long count = __atomic_add_fetch(&trace_counter, 1, __ATOMIC_RELAXED);
+  snprintf(trace_id, sizeof(trace_id), "%0*lx", AGENT_TRACE_ID_LEN,
+           (seed * 2654435761UL + count) & 0xffffffffUL);
+  trace_active = 1;
+  return trace_id;
+}
+
+/**
+ * @brief adopts the trace id of a message received from the other process
+ * @param id the received id; @c NULL or empty clears the trace state
+ */
+void agent_trace_set(const char* id) {
+  if (id == NULL || *id == '\0') {
+    agent_trace_end();
+    return;
+  }
+  strncpy(trace_id, id, AGENT_TRACE_ID_LEN);
+  trace_id[AGENT_TRACE_ID_LEN] = '\0';
+  trace_active                 = 1;
+}
+
+/**
+ * @return the calling thread's current trace id or @c NULL if none is set
+ */
+const char* agent_trace_get() { return trace_active ? trace_id : NULL; }
+
+void agent_trace_end() { trace_active = 0; }
@@ -0,0 +1,19 @@
+#ifndef AGENT_TRACE_H
+#define AGENT_TRACE_H
+
+/*
+ * Per-request trace ids. A compact hex id is generated when a client
+ * request is read and travels with the request through the oidcp-oidcd
+ * pipe, so the log lines both processes write while working on it - ipc,
+ * handler, http - can be correlated. The current id is thread-local; the
+ * logger prefixes every line with it while one is set.
+ */
+
+#define AGENT_TRACE_ID_LEN 8
+
+const char* agent_trace_begin();
+void        agent_trace_set(const char* id);
+const char* agent_trace_get();
+void        agent_trace_end();
+
+#endif  // AGENT_TRACE_H
@@ -3,18 +3,39 @@
 #include "ipc/cryptCommunicator.h"
 #include "list/list.h"
 #include "utils/file_io/fileUtils.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/file_io/oidc_index.h"
 #include "utils/listUtils.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/printer.h"
 
 void common_handleListAccountConfigs() {
-  list_t* list = getAccountConfigFileList();
-  list_mergeSort(list, (int (*)(const void*, const void*))compareFilesByName);
-  char* str = listToDelimitedString(list, '\n');
-  list_destroy(list);
-  printf("The following account configurations are usable: \n%s\n", str);
-  secFree(str);
+  list_t* indexed = oidcIndex_accountList();  // served from the on-disk
+                                              // index without a readdir
+  if (indexed != NULL) {
+    printf("The following account configurations are usable: \n");
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(indexed, LIST_HEAD);
+    while ((node = list_iterator_next(it))) { printf("%s\n", (char*)node->val); }
+    list_iterator_destroy(it);
+    secFreeList(indexed);
+    return;
+  }
+  char* oidc_dir = getOidcDir();
+  const struct dirSnapshot* snapshot = getDirSnapshot(oidc_dir);
+  secFree(oidc_dir);
+  if (snapshot == NULL) {
+    oidc_perror();
+    return;
+  }
+  printf("The following account configurations are usable: \n");
+  for (size_t i = 0; i < snapshot->count; i++) {  // already sorted by name
+    const char* name = dirSnapshot_name(snapshot, i);
+    if (isAccountConfigFile(name, NULL)) {
+      printf("%s\n", name);
+    }
+  }
 }
 
 void common_assertAgent() {
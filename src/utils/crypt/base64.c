@@ -0,0 +1,90 @@
+#include "base64.h"
+
+#include <stdint.h>
+
+static const char b64_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char b64url_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// built lazily from the encode tables; filling them twice is harmless, so no
+// locking is needed
+static signed char   b64_dtable[256];
+static signed char   b64url_dtable[256];
+static unsigned char dtables_ready = 0;
+
+static void _b64_initDecodeTables() {
+  for (int i = 0; i < 256; i++) {
+    b64_dtable[i]    = -1;
+    b64url_dtable[i] = -1;
+  }
+  for (int i = 0; i < 64; i++) {
+    b64_dtable[(unsigned char)b64_table[i]]       = i;
+    b64url_dtable[(unsigned char)b64url_table[i]] = i;
+  }
+  dtables_ready = 1;
+}
+
+size_t agent_base64_encode(char* out, const unsigned char* in, size_t len,
+                           int urlsafe_nopad) {
+  const char* T = urlsafe_nopad ? b64url_table : b64_table;
+  char*       o = out;
+  size_t      i = 0;
+  while (len - i >= 3) {
+    uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+    *o++       = T[v >> 18];
+    *o++       = T[(v >> 12) & 63];
+    *o++       = T[(v >> 6) & 63];
+    *o++       = T[v & 63];
+    i += 3;
+  }
+  switch (len - i) {
+    case 1:
+      *o++ = T[in[i] >> 2];
+      *o++ = T[(in[i] & 3) << 4];
+      if (!urlsafe_nopad) {
+        *o++ = '=';
+        *o++ = '=';
+      }
+      break;
+    case 2:
+      *o++ = T[in[i] >> 2];
+      *o++ = T[(in[i] & 3) << 4 | in[i + 1] >> 4];
+      *o++ = T[(in[i + 1] & 15) << 2];
+      if (!urlsafe_nopad) {
+        *o++ = '=';
+      }
+      break;
+    default: break;
+  }
+  *o = '\0';
+  return o - out;
+}
+
+int agent_base64_decode(unsigned char* bin, size_t bin_len, const char* base64,
+                        int urlsafe) {
+  if (bin == NULL || base64 == NULL) {
+    return -1;
+  }
+  if (!dtables_ready) {
+    _b64_initDecodeTables();
+  }
+  const signed char*   T        = urlsafe ? b64url_dtable : b64_dtable;
+  size_t               produced = 0;
+  uint32_t             acc      = 0;
+  unsigned char        bits     = 0;
+  const unsigned char* p        = (const unsigned char*)base64;
+  for (; *p != '\0' && *p != '=' && produced < bin_len; p++) {
+    signed char d = T[*p];
+    if (d < 0) {
+      return -1;
+    }
+    acc = acc << 6 | (unsigned char)d;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      bin[produced++] = acc >> bits;
+    }
+  }
+  return produced == bin_len ? 0 : -1;
+}
@@ -1,11 +1,46 @@
 #include "crypt.h"
+#include "base64.h"
+#include "defines/settings.h"
+#include "cryptTrace.h"
+#include "keyCache.h"
+#include "sha256.h"
 #include "list/list.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/agent_sdt.h"
+#include "utils/slab.h"
 #include "utils/oidc_error.h"
+#include "utils/secure_compare.h"
+#include "utils/stringUtils.h"
 
+#include <pthread.h>
 #include <sodium.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// encryptionInfo structs churn once per crypt operation; per-thread pools
+// keep the traffic off the heap without locking
+static __thread struct slab_pool encryptionInfo_pool =
+    SLAB_POOL_INIT(struct encryptionInfo);
+
+struct encryptionInfo* secAllocEncryptionInfo() {
+  return slab_alloc(&encryptionInfo_pool);
+}
+
+void secFreeEncryptionInfo(struct encryptionInfo* crypt) {
+  if (crypt == NULL) {
+    return;
+  }
+  secFree(crypt->encrypted_base64);
+  secFree(crypt->nonce_base64);
+  secFree(crypt->salt_base64);
+  secFree(crypt->hash_key_base64);
+  slab_free(&encryptionInfo_pool, crypt);
+}
 
 // use these for new encryptions
 #define SODIUM_KEY_LEN crypto_secretbox_KEYBYTES
@@ -22,15 +57,107 @@
  */
 void initCrypt() { randombytes_stir(); }
 
+/**
+ * Buffered CSPRNG pool. Nonces, states and code verifiers each need only a
+ * handful of random bytes; serving them from a periodically refilled pool
+ * amortizes the syscall-backed sodium RNG over many requests. The pool is
+ * mlock'ed, handed-out bytes are wiped, and a pid guard discards bytes
+ * inherited over fork so parent and child can never draw the same stream.
+ */
+#define RANDOM_POOL_SIZE 1024
+
+static unsigned char   random_pool[RANDOM_POOL_SIZE];
+static size_t          random_pool_avail = 0;
+static pid_t           random_pool_pid   = 0;
+static pthread_mutex_t random_pool_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief fills a buffer with random bytes from the buffered pool
+ * @param buffer the buffer to be filled
+ * @param len the number of random bytes needed
+ */
+void secRandomFill(unsigned char* buffer, size_t len) {
+  if (len >= RANDOM_POOL_SIZE) {  // too big to amortize, serve directly
+    randombytes_buf(buffer, len);
+    return;
+  }
+  pthread_mutex_lock(&random_pool_lock);
+  pid_t pid = getpid();
+  if (pid != random_pool_pid) {  // first use in this process
+    random_pool_avail = 0;
+    random_pool_pid   = pid;
+    sodium_mlock(random_pool, sizeof(random_pool));
+  }
+  if (random_pool_avail < len) {
+    randombytes_buf(random_pool, sizeof(random_pool));
+    random_pool_avail = sizeof(random_pool);
+  }
+  random_pool_avail -= len;
+  memcpy(buffer, random_pool + random_pool_avail, len);
+  sodium_memzero(random_pool + random_pool_avail, len);  // never serve a
+                                                         // byte twice
+  pthread_mutex_unlock(&random_pool_lock);
+}
+
+// KDF cost parameters used for new encryptions; decryption always uses the
+// parameters recorded in the file header, so changing the profile never
+// breaks existing files.
+static int           kdf_ops_limit      = SODIUM_PW_HASH_OPSLIMIT;
+static int           kdf_mem_limit      = SODIUM_PW_HASH_MEMLIMIT;
+static unsigned char kdf_profile_loaded = 0;
+
+/**
+ * @brief selects the KDF cost profile used for new encryptions
+ * @param profile one of @c "interactive", @c "moderate", @c "sensitive" or a
+ * numeric @c "opslimit:memlimit" pair as printed by @c make @c benchmark-crypt
+ * @return an oidc_error code. oidc_errno is set properly.
+ */
+oidc_error_t crypt_setKDFProfile(const char* profile) {
+  if (profile == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  int ops;
+  int mem;
+  if (strcaseequal(profile, "interactive")) {
+    ops = crypto_pwhash_OPSLIMIT_INTERACTIVE;
+    mem = crypto_pwhash_MEMLIMIT_INTERACTIVE;
+  } else if (strcaseequal(profile, "moderate")) {
+    ops = crypto_pwhash_OPSLIMIT_MODERATE;
+    mem = crypto_pwhash_MEMLIMIT_MODERATE;
+  } else if (strcaseequal(profile, "sensitive")) {
+    ops = crypto_pwhash_OPSLIMIT_SENSITIVE;
+    mem = crypto_pwhash_MEMLIMIT_SENSITIVE;
+  } else if (sscanf(profile, "%d:%d", &ops, &mem) != 2 || ops <= 0 ||
+             mem <= 0) {
+    logger(ERROR, "Unknown KDF profile '%s'", profile);
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  kdf_ops_limit      = ops;
+  kdf_mem_limit      = mem;
+  kdf_profile_loaded = 1;
+  logger(DEBUG, "Using KDF profile '%s' (opslimit %d, memlimit %d)", profile,
+         ops, mem);
+  return OIDC_SUCCESS;
+}
+
 /**
  * @brief returns current cryptParameters
  * @return a cryptParameter struct
  */
 struct cryptParameter newCryptParameters() {
+  if (!kdf_profile_loaded) {
+    const char* profile = getenv(OIDC_KDF_PROFILE_ENV_NAME);
+    if (profile != NULL) {
+      crypt_setKDFProfile(profile);  // on failure the defaults stay
+    }
+    kdf_profile_loaded = 1;
+  }
   return (struct cryptParameter){
-      SODIUM_NONCE_LEN,        SODIUM_SALT_LEN,       SODIUM_MAC_LEN,
-      SODIUM_KEY_LEN,          SODIUM_BASE64_VARIANT, SODIUM_PW_HASH_OPSLIMIT,
-      SODIUM_PW_HASH_MEMLIMIT, SODIUM_PW_HASH_ALG};
+      SODIUM_NONCE_LEN, SODIUM_SALT_LEN,       SODIUM_MAC_LEN,
+      SODIUM_KEY_LEN,   SODIUM_BASE64_VARIANT, kdf_ops_limit,
+      kdf_mem_limit,    SODIUM_PW_HASH_ALG};
 }
 
 /**
@@ -87,7 +214,7 @@ struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
                                             const unsigned char* key) {
   struct cryptParameter cryptParams = newCryptParameters();
   char                  nonce[cryptParams.nonce_len];
-  randombytes_buf(nonce, cryptParams.nonce_len);
+  secRandomFill((unsigned char*)nonce, cryptParams.nonce_len);
   unsigned char ciphertext[cryptParams.mac_len + strlen((char*)text)];
   if (crypto_secretbox_easy(ciphertext, text, strlen((char*)text),
                             (unsigned char*)nonce, key) != 0) {
@@ -97,7 +224,7 @@ struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
   char* ciphertext_base64 =
       toBase64((char*)ciphertext, cryptParams.mac_len + strlen((char*)text));
   char*                  nonce_base64 = toBase64(nonce, cryptParams.nonce_len);
-  struct encryptionInfo* crypt        = secAlloc(sizeof(struct encryptionInfo));
+  struct encryptionInfo* crypt        = secAllocEncryptionInfo();
   crypt->encrypted_base64             = ciphertext_base64;
   crypt->nonce_base64                 = nonce_base64;
   crypt->cryptParameter               = cryptParams;
@@ -113,11 +240,12 @@ struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
  * can be passed to @c crypt_decrypt for decryption
  * @note before version 2.1.0 this function used hex encoding
  */
-char* crypt_encrypt(const char* text, const char* password) {
-  struct encryptionInfo* cry = _crypt_encrypt((unsigned char*)text, password);
-  if (cry == NULL || cry->encrypted_base64 == NULL) {
-    return NULL;
-  }
+/**
+ * @brief formats an encryptionInfo into the config file cipher format
+ * @return the formatted string. Has to be freed after usage.
+ */
+static char* _crypt_formatCipher(const struct encryptionInfo* cry,
+                                 size_t                       cipher_len) {
   // Current config file format:
   // 1 cipher_len
   // 2 nonce_base64
@@ -127,18 +255,403 @@ char* crypt_encrypt(const char* text, const char* password) {
   // 6 hash_key_base64
   // [7 version] // Not included here
   const char* const fmt = "%lu\n%s\n%s\n%lu:%lu:%lu:%lu:%d:%d:%d:%d\n%s\n%s";
-  size_t            cipher_len = strlen(text) + cry->cryptParameter.mac_len;
-  char*             ret        = oidc_sprintf(
+  return oidc_sprintf(
       fmt, cipher_len, cry->nonce_base64, cry->salt_base64,
       cry->cryptParameter.nonce_len, cry->cryptParameter.salt_len,
       cry->cryptParameter.mac_len, cry->cryptParameter.key_len,
       cry->cryptParameter.base64_variant, cry->cryptParameter.hash_ops_limit,
       cry->cryptParameter.hash_mem_limit, cry->cryptParameter.hash_alg,
       cry->encrypted_base64, cry->hash_key_base64);
+}
+
+char* crypt_encrypt(const char* text, const char* password) {
+  CRYPT_TRACE_START();
+  struct encryptionInfo* cry = _crypt_encrypt((unsigned char*)text, password);
+  if (cry == NULL || cry->encrypted_base64 == NULL) {
+    return NULL;
+  }
+  size_t cipher_len = strlen(text) + cry->cryptParameter.mac_len;
+  char*  ret        = _crypt_formatCipher(cry, cipher_len);
+  secFreeEncryptionInfo(cry);
+  CRYPT_TRACE_END("crypt_encrypt");
+  return ret;
+}
+
+/*
+ * Binary config-file container (version 1), replacing the line-oriented
+ * base64 format for newly written files:
+ *   magic                                       CRYPT_BINARY_MAGIC_LEN bytes
+ *   container version                           1 byte
+ *   nonce_len, salt_len, mac_len, key_len       4 x u64
+ *   base64_variant, ops limit, mem limit, alg   4 x i32
+ *   cipher_len                                  u64
+ *   salt, hash_key, nonce, cipher               raw bytes
+ * The whole file is loaded with one read and decrypted with a pointer walk
+ * over the buffer - no line splitting, no sscanf, no base64 decode of the
+ * ciphertext. The integers are fixed-width in host byte order; agent config
+ * files are per-user state, not moved between architectures.
+ */
+#define CRYPT_BINARY_VERSION 1
+
+static unsigned char* _pack_u64(unsigned char* p, uint64_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static unsigned char* _pack_i32(unsigned char* p, int32_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static const unsigned char* _unpack_u64(const unsigned char* p, uint64_t* v) {
+  memcpy(v, p, sizeof(*v));
+  return p + sizeof(*v);
+}
+
+static const unsigned char* _unpack_i32(const unsigned char* p, int32_t* v) {
+  memcpy(v, p, sizeof(*v));
+  return p + sizeof(*v);
+}
+
+#define CRYPT_BINARY_HEADER_LEN \
+  (CRYPT_BINARY_MAGIC_LEN + 1 + 5 * sizeof(uint64_t) + 4 * sizeof(int32_t))
+
+/**
+ * @brief checks if data is in the binary encrypted-file format
+ * @param data the (possibly truncated) file content
+ * @return @c 1 if @p data starts with the container magic, @c 0 otherwise
+ */
+int crypt_isBinaryCipher(const char* data) {
+  return data != NULL &&
+         strncmp(data, CRYPT_BINARY_MAGIC, CRYPT_BINARY_MAGIC_LEN) == 0;
+}
+
+/**
+ * @brief encrypts a given text with the given password into the binary
+ * container format
+ * @param text the nullterminated text
+ * @param password the nullterminated password, used for encryption
+ * @param out_len filled with the container size in bytes
+ * @return the container blob - it contains nullbytes, so it has to be
+ * written with @c writeFileBinary. Has to be freed after usage.
+ */
+unsigned char* crypt_encryptBinary(const char* text, const char* password,
+                                   size_t* out_len) {
+  if (text == NULL || password == NULL || out_len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct cryptParameter params = newCryptParameters();
+  char                  salt_base64[sodium_base64_ENCODED_LEN(
+                            SODIUM_SALT_LEN, sodium_base64_VARIANT_ORIGINAL) +
+                       1] = {0};
+  struct key_set keys = crypt_keyDerivation_base64(password, salt_base64, 1,
+                                                   &params);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return NULL;
+  }
+  unsigned char salt[params.salt_len];
+  fromBase64(salt_base64, params.salt_len, salt);
+  size_t        msg_len    = strlen(text);
+  size_t        cipher_len = msg_len + params.mac_len;
+  unsigned char nonce[params.nonce_len];
+  secRandomFill(nonce, params.nonce_len);
+  size_t total = CRYPT_BINARY_HEADER_LEN + params.salt_len + params.key_len +
+                 params.nonce_len + cipher_len;
+  unsigned char* out = secAlloc(total);
+  unsigned char* p   = out;
+  memcpy(p, CRYPT_BINARY_MAGIC, CRYPT_BINARY_MAGIC_LEN);
+  p    = out + CRYPT_BINARY_MAGIC_LEN;
+  *p++ = CRYPT_BINARY_VERSION;
+  p    = _pack_u64(p, params.nonce_len);
+  p    = _pack_u64(p, params.salt_len);
+  p    = _pack_u64(p, params.mac_len);
+  p    = _pack_u64(p, params.key_len);
+  p    = _pack_i32(p, params.base64_variant);
+  p    = _pack_i32(p, params.hash_ops_limit);
+  p    = _pack_i32(p, params.hash_mem_limit);
+  p    = _pack_i32(p, params.hash_alg);
+  p    = _pack_u64(p, cipher_len);
+  memcpy(p, salt, params.salt_len);
+  p += params.salt_len;
+  memcpy(p, keys.hash_key, params.key_len);
+  p += params.key_len;
+  memcpy(p, nonce, params.nonce_len);
+  p += params.nonce_len;
+  if (crypto_secretbox_easy(p, (const unsigned char*)text, msg_len, nonce,
+                            (unsigned char*)keys.encryption_key) != 0) {
+    secFree(keys.encryption_key);
+    secFree(keys.hash_key);
+    secFree(out);
+    oidc_errno = OIDC_EENCRYPT;
+    return NULL;
+  }
+  secFree(keys.encryption_key);
+  secFree(keys.hash_key);
+  *out_len = total;
+  return out;
+}
+
+/**
+ * @brief decrypts a binary container with the given password
+ * @param data the container as read with @c readFileBinary
+ * @param data_len the container size in bytes
+ * @param password the nullterminated password, used for encryption
+ * @return a pointer to the decrypted text. It has to be freed after usage.
+ * If the decryption fails @c NULL is returned.
+ */
+char* crypt_decryptBinary(const unsigned char* data, size_t data_len,
+                          const char* password) {
+  if (data == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (data_len < CRYPT_BINARY_HEADER_LEN ||
+      !crypt_isBinaryCipher((const char*)data)) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  const unsigned char* p = data + CRYPT_BINARY_MAGIC_LEN;
+  if (*p++ != CRYPT_BINARY_VERSION) {
+    logger(ERROR, "Unknown binary cipher container version");
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  struct cryptParameter params;
+  uint64_t              u;
+  int32_t               i;
+  uint64_t              cipher_len;
+  p               = _unpack_u64(p, &u);
+  params.nonce_len = u;
+  p               = _unpack_u64(p, &u);
+  params.salt_len = u;
+  p               = _unpack_u64(p, &u);
+  params.mac_len  = u;
+  p               = _unpack_u64(p, &u);
+  params.key_len  = u;
+  p                     = _unpack_i32(p, &i);
+  params.base64_variant = i;
+  p                     = _unpack_i32(p, &i);
+  params.hash_ops_limit = i;
+  p                     = _unpack_i32(p, &i);
+  params.hash_mem_limit = i;
+  p                     = _unpack_i32(p, &i);
+  params.hash_alg       = i;
+  p                     = _unpack_u64(p, &cipher_len);
+  if (params.nonce_len > 64 || params.salt_len > 64 || params.key_len > 64 ||
+      cipher_len < params.mac_len ||
+      data_len != CRYPT_BINARY_HEADER_LEN + params.salt_len + params.key_len +
+                      params.nonce_len + cipher_len) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  const unsigned char* salt     = p;
+  const unsigned char* hash_key = salt + params.salt_len;
+  const unsigned char* nonce    = hash_key + params.key_len;
+  const unsigned char* cipher   = nonce + params.nonce_len;
+  char                 salt_base64[sodium_base64_ENCODED_LEN(
+                           64, sodium_base64_VARIANT_ORIGINAL) +
+                       1] = {0};
+  sodium_bin2base64(salt_base64, sizeof(salt_base64), salt, params.salt_len,
+                    sodium_base64_VARIANT_ORIGINAL);
+  // the base64 salt addresses the key cache with the same key as the legacy
+  // format, so mixed-format files under one password share derivations
+  struct key_set keys =
+      crypt_keyDerivation_base64(password, salt_base64, 0, &params);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return NULL;
+  }
+  if (!secure_equal(keys.hash_key, hash_key, params.key_len)) {
+    secFree(keys.encryption_key);
+    secFree(keys.hash_key);
+    oidc_errno = OIDC_EPASS;
+    return NULL;
+  }
+  secFree(keys.hash_key);
+  unsigned char* decrypted =
+      secAlloc(sizeof(unsigned char) * (cipher_len - params.mac_len + 1));
+  if (crypto_secretbox_open_easy(decrypted, cipher, cipher_len, nonce,
+                                 (unsigned char*)keys.encryption_key) != 0) {
+    logger(NOTICE, "Decryption failed.");
+    secFree(keys.encryption_key);
+    secFree(decrypted);
+    oidc_errno = OIDC_EDECRYPT;
+    return NULL;
+  }
+  secFree(keys.encryption_key);
+  return (char*)decrypted;
+}
+
+/*
+ * Sealed blobs: a keyed secretbox in a small line format (magic,
+ * cipher_len, nonce, cipher - the crypt parameters are the defaults, so
+ * nothing else needs to be stored). No salt, no KDF, no hash key: whoever
+ * does not hold the key learns nothing and has no password to brute
+ * force. Used for state that one invocation hands to a later one through
+ * the filesystem and that is only meant to be readable while the issuing
+ * agent session is alive.
+ */
+
+// callers size their key buffers with CRYPT_SEAL_KEY_LEN instead of
+// pulling in the sodium headers; keep the two in sync
+typedef char _crypt_seal_key_len_matches_sodium
+    [CRYPT_SEAL_KEY_LEN == SODIUM_KEY_LEN ? 1 : -1];
+
+/**
+ * @brief checks if data is a sealed blob
+ * @param data the (possibly truncated) file content
+ * @return @c 1 if @p data starts with the seal magic, @c 0 otherwise
+ */
+int crypt_isSealedCipher(const char* data) {
+  return data != NULL &&
+         strncmp(data, CRYPT_SEAL_MAGIC, CRYPT_SEAL_MAGIC_LEN) == 0;
+}
+
+/**
+ * @brief seals a given text with the given key
+ * @param text the nullterminated text
+ * @param key a key of @c CRYPT_SEAL_KEY_LEN random bytes
+ * @return the sealed blob as nullterminated string. Has to be freed after
+ * usage.
+ */
+char* crypt_sealWithKey(const char* text, const unsigned char* key) {
+  if (text == NULL || key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct encryptionInfo* cry = crypt_encryptWithKey((unsigned char*)text, key);
+  if (cry == NULL) {
+    return NULL;
+  }
+  if (cry->encrypted_base64 == NULL) {
+    secFreeEncryptionInfo(cry);
+    return NULL;
+  }
+  char* ret = oidc_sprintf(CRYPT_SEAL_MAGIC "%lu\n%s\n%s",
+                           strlen(text) + cry->cryptParameter.mac_len,
+                           cry->nonce_base64, cry->encrypted_base64);
   secFreeEncryptionInfo(cry);
   return ret;
 }
 
+/**
+ * @brief opens a sealed blob with the given key
+ * @param sealed the blob as produced by @c crypt_sealWithKey
+ * @param key the key it was sealed with
+ * @return a pointer to the plaintext. Has to be freed after usage. @c NULL
+ * if the blob is malformed or was sealed with a different key.
+ */
+char* crypt_unsealWithKey(const char* sealed, const unsigned char* key) {
+  if (sealed == NULL || key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!crypt_isSealedCipher(sealed)) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  char*         end        = NULL;
+  unsigned long cipher_len = strtoul(sealed + CRYPT_SEAL_MAGIC_LEN, &end, 10);
+  if (end == NULL || *end != '\n') {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  const char* nonce_base64 = end + 1;
+  const char* newline      = strchr(nonce_base64, '\n');
+  if (newline == NULL) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  const char*           cipher_base64 = newline + 1;
+  struct cryptParameter params        = newCryptParameters();
+  // the length field sizes two stack buffers in crypt_decryptWithKey, so
+  // it has to be consistent with the actual cipher before it is used
+  if (cipher_len < params.mac_len ||
+      cipher_len > strlen(cipher_base64) / 4 * 3 + 2) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  char* nonce = oidc_strncopy(nonce_base64, (size_t)(newline - nonce_base64));
+  struct encryptionInfo crypt = {.encrypted_base64 = (char*)cipher_base64,
+                                 .nonce_base64     = nonce,
+                                 .cryptParameter   = params};
+  char* decrypted = (char*)crypt_decryptWithKey(&crypt, cipher_len, key);
+  secFree(nonce);
+  return decrypted;
+}
+
+/**
+ * @brief derives a key set with a fresh salt for batch encryption
+ * The derived key set can be passed to @c batchCrypt_encrypt several times,
+ * so the expensive KDF runs once per batch instead of once per text.
+ * @return an oidc_error code. oidc_errno is set properly.
+ */
+oidc_error_t batchCrypt_init(struct batchCrypt* bc, const char* password) {
+  if (bc == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  bc->cryptParams = newCryptParameters();
+  bc->salt_base64 =
+      secAlloc(sodium_base64_ENCODED_LEN(SODIUM_SALT_LEN,
+                                         sodium_base64_VARIANT_ORIGINAL) +
+               1);
+  bc->keys =
+      crypt_keyDerivation_base64(password, bc->salt_base64, 1,
+                                 &bc->cryptParams);
+  if (bc->keys.encryption_key == NULL) {
+    secFree(bc->keys.hash_key);
+    secFree(bc->salt_base64);
+    bc->salt_base64 = NULL;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief encrypts a text with an already derived batch key set
+ * Produces the same formatted string as @c crypt_encrypt, so the result can
+ * be decrypted with @c crypt_decrypt using the password the batch was
+ * initialized with.
+ * @return the encrypted text. Has to be freed after usage.
+ */
+char* batchCrypt_encrypt(struct batchCrypt* bc, const char* text) {
+  if (bc == NULL || text == NULL || bc->keys.encryption_key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct encryptionInfo* cry = crypt_encryptWithKey(
+      (unsigned char*)text, (unsigned char*)bc->keys.encryption_key);
+  if (cry == NULL) {
+    return NULL;
+  }
+  cry->salt_base64     = oidc_strcopy(bc->salt_base64);
+  cry->hash_key_base64 = toBase64(bc->keys.hash_key, bc->cryptParams.key_len);
+  cry->cryptParameter  = bc->cryptParams;
+  if (cry->encrypted_base64 == NULL) {
+    secFreeEncryptionInfo(cry);
+    return NULL;
+  }
+  char* ret =
+      _crypt_formatCipher(cry, strlen(text) + cry->cryptParameter.mac_len);
+  secFreeEncryptionInfo(cry);
+  return ret;
+}
+
+/**
+ * @brief clears and frees the key material held by a batchCrypt
+ */
+void batchCrypt_done(struct batchCrypt* bc) {
+  if (bc == NULL) {
+    return;
+  }
+  secFree(bc->keys.encryption_key);
+  secFree(bc->keys.hash_key);
+  secFree(bc->salt_base64);
+}
+
 /**
  * @brief decrypts a given encrypted text with the given password.
  * @param crypt a encryptionInfo struct containing all relevant encryption
@@ -174,8 +687,7 @@ unsigned char* crypt_decrypt_base64(struct encryptionInfo* crypt,
   char* computed_hash_key_base64 =
       toBase64(keys.hash_key, crypt->cryptParameter.key_len);
   secFree(keys.hash_key);
-  if (sodium_memcmp(computed_hash_key_base64, crypt->hash_key_base64,
-                    strlen(crypt->hash_key_base64)) != 0) {
+  if (!strsecequal(computed_hash_key_base64, crypt->hash_key_base64)) {
     secFree(keys.encryption_key);
     secFree(computed_hash_key_base64);
     oidc_errno = OIDC_EPASS;
@@ -237,7 +749,7 @@ char* crypt_decryptFromList(list_t* lines, const char* password) {
     return NULL;
   }
   logger(DEBUG, "Decrypt using base64 encoding");
-  struct encryptionInfo* crypt      = secAlloc(sizeof(struct encryptionInfo));
+  struct encryptionInfo* crypt      = secAllocEncryptionInfo();
   size_t                 cipher_len = 0;
   sscanf(list_at(lines, 0)->val, "%lu", &cipher_len);
   crypt->nonce_base64     = oidc_strcopy(list_at(lines, 1)->val);
@@ -281,8 +793,10 @@ char* crypt_decrypt(const char* crypt_str, const char* password) {
     list_destroy(lines);
     return NULL;
   }
+  CRYPT_TRACE_START();
   char* ret = crypt_decryptFromList(lines, password);
   list_destroy(lines);
+  CRYPT_TRACE_END("crypt_decrypt");
   return ret;
 }
 
@@ -299,13 +813,21 @@ char* toBase64WithVariant(const char* bin, size_t len, int variant) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  size_t base64len = sodium_base64_ENCODED_LEN(len, variant);
-  char*  base64    = secAlloc(base64len + 1);
+  size_t base64len = sodium_base64_ENCODED_LEN(len, variant);  // includes the
+                                                               // nullterminator
+  char* base64 = secAlloc(base64len);
   if (base64 == NULL) {
     oidc_errno = OIDC_EALLOC;
     return NULL;
   }
-  sodium_bin2base64(base64, base64len, (const unsigned char*)bin, len, variant);
+  if (variant == sodium_base64_VARIANT_ORIGINAL) {
+    agent_base64_encode(base64, (const unsigned char*)bin, len, 0);
+  } else if (variant == sodium_base64_VARIANT_URLSAFE_NO_PADDING) {
+    agent_base64_encode(base64, (const unsigned char*)bin, len, 1);
+  } else {
+    sodium_bin2base64(base64, base64len, (const unsigned char*)bin, len,
+                      variant);
+  }
   return base64;
 }
 
@@ -354,10 +876,7 @@ int fromBase64(const char* base64, size_t bin_len, unsigned char* bin) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  return sodium_base642bin(
-      bin, bin_len, base64,
-      sodium_base64_ENCODED_LEN(bin_len, sodium_base64_VARIANT_ORIGINAL), NULL,
-      NULL, NULL, sodium_base64_VARIANT_ORIGINAL);
+  return agent_base64_decode(bin, bin_len, base64, 0);
 }
 
 /**
@@ -372,11 +891,7 @@ int fromBase64UrlSafe(const char* base64, size_t bin_len, unsigned char* bin) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  return sodium_base642bin(
-      bin, bin_len, base64,
-      sodium_base64_ENCODED_LEN(bin_len,
-                                sodium_base64_VARIANT_URLSAFE_NO_PADDING),
-      NULL, NULL, NULL, sodium_base64_VARIANT_ORIGINAL);
+  return agent_base64_decode(bin, bin_len, base64, 1);
 }
 
 /**
@@ -395,7 +910,7 @@ char* sha256(const char* str) {
     oidc_errno = OIDC_EALLOC;
     return NULL;
   }
-  crypto_hash_sha256((unsigned char*)sha, (unsigned char*)str, strlen(str));
+  agent_sha256((unsigned char*)sha, (unsigned char*)str, strlen(str));
   return sha;
 }
 
@@ -440,6 +955,18 @@ struct key_set crypt_keyDerivation_base64(const char* password,
                                           int         generateNewSalt,
                                           struct cryptParameter* cryptParams) {
   logger(DEBUG, "Derivate key using base64 encoding");
+  CRYPT_TRACE_START();
+  if (!generateNewSalt) {  // a fresh random salt can never be cached
+    char* cached = keyCache_lookup(password, salt_base64, cryptParams);
+    if (cached != NULL) {
+      char* encryption_key = oidc_memcopy(cached, cryptParams->key_len);
+      char* hash_key =
+          oidc_memcopy(cached + cryptParams->key_len, cryptParams->key_len);
+      secFree(cached);
+      CRYPT_TRACE_END("crypt_keyDerivation_base64(cached)");
+      return (struct key_set){encryption_key, hash_key};
+    }
+  }
   char* key = secAlloc(sizeof(unsigned char) * (2 * cryptParams->key_len + 1));
   unsigned char salt[cryptParams->key_len];
   if (generateNewSalt) {
@@ -454,21 +981,27 @@ struct key_set crypt_keyDerivation_base64(const char* password,
   } else {
     fromBase64(salt_base64, cryptParams->salt_len, salt);
   }
+  AGENT_PROBE2(kdf_start, cryptParams->hash_ops_limit,
+               cryptParams->hash_mem_limit);
   if (crypto_pwhash((unsigned char*)key, 2 * cryptParams->key_len, password,
-                    strlen(password), salt, crypto_pwhash_OPSLIMIT_INTERACTIVE,
-                    crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                    crypto_pwhash_ALG_DEFAULT) != 0) {
+                    strlen(password), salt, cryptParams->hash_ops_limit,
+                    cryptParams->hash_mem_limit,
+                    cryptParams->hash_alg) != 0) {
     secFree(key);
     logger(ALERT,
            "Could not derivate key. Probably because system out of memory.\n");
     oidc_errno = OIDC_EMEM;
     return (struct key_set){NULL, NULL};
   }
+  if (!generateNewSalt) {
+    keyCache_store(password, salt_base64, cryptParams, key);
+  }
   char* encryption_key = oidc_memcopy(key, cryptParams->key_len);
   char* hash_key =
       oidc_memcopy(key + cryptParams->key_len, cryptParams->key_len);
   secFree(key);
   struct key_set keys = {encryption_key, hash_key};
+  CRYPT_TRACE_END("crypt_keyDerivation_base64");
   return keys;
 }
 
@@ -482,7 +1015,7 @@ struct key_set crypt_keyDerivation_base64(const char* password,
  */
 void randomFillBase64UrlSafe(char buffer[], size_t buffer_size) {
   unsigned char bin[buffer_size];
-  randombytes_buf(bin, buffer_size);
+  secRandomFill(bin, buffer_size);
   char base64[sodium_base64_ENCODED_LEN(
       buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING)];
   sodium_bin2base64(base64,
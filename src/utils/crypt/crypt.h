@@ -3,11 +3,49 @@
 
 #include "cryptdef.h"
 #include "list/list.h"
+#include "utils/oidc_error.h"
+
+/**
+ * Key set derived once per batch so several texts can be encrypted with a
+ * single KDF run; initialize with @c batchCrypt_init and release with
+ * @c batchCrypt_done.
+ */
+struct batchCrypt {
+  struct key_set        keys;
+  char*                 salt_base64;
+  struct cryptParameter cryptParams;
+};
+
+/**
+ * magic prefix of the binary encrypted-file container; NUL-free, so string
+ * based readers can still detect the format from a truncated read
+ */
+#define CRYPT_BINARY_MAGIC "OIDC-AGENT-CRYPT\x01"
+#define CRYPT_BINARY_MAGIC_LEN (sizeof(CRYPT_BINARY_MAGIC) - 1)
+
+/**
+ * magic prefix of a sealed blob - a keyed cipher without any KDF data,
+ * used for short lived state that is only meant to survive within one
+ * agent session
+ */
+#define CRYPT_SEAL_MAGIC "OIDC-AGENT-SEAL\x01"
+#define CRYPT_SEAL_MAGIC_LEN (sizeof(CRYPT_SEAL_MAGIC) - 1)
+// crypto_secretbox_KEYBYTES; asserted in crypt.c so callers do not need
+// the sodium headers
+#define CRYPT_SEAL_KEY_LEN 32
 
 void                   initCrypt();
 char*                  crypt_encrypt(const char* text, const char* password);
+int            crypt_isBinaryCipher(const char* data);
+unsigned char* crypt_encryptBinary(const char* text, const char* password,
+                                   size_t* out_len);
+char*          crypt_decryptBinary(const unsigned char* data, size_t data_len,
+                                   const char* password);
 struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
                                             const unsigned char* key);
+int   crypt_isSealedCipher(const char* data);
+char* crypt_sealWithKey(const char* text, const unsigned char* key);
+char* crypt_unsealWithKey(const char* sealed, const unsigned char* key);
 char*          crypt_decrypt(const char* crypt_str, const char* password);
 char*          crypt_decryptFromList(list_t* lines, const char* password);
 unsigned char* crypt_decryptWithKey(const struct encryptionInfo* crypt,
@@ -23,7 +61,13 @@ char*          toBase64UrlSafe(const char* bin, size_t len);
 int   fromBase64(const char* base64, size_t bin_len, unsigned char* bin);
 int   fromBase64UrlSafe(const char* base64, size_t bin_len, unsigned char* bin);
 void  randomFillBase64UrlSafe(char buffer[], size_t buffer_size);
+void  secRandomFill(unsigned char* buffer, size_t len);
 char* s256(const char* str);
 struct cryptParameter newCryptParameters();
+oidc_error_t          crypt_setKDFProfile(const char* profile);
+
+oidc_error_t batchCrypt_init(struct batchCrypt* bc, const char* password);
+char*        batchCrypt_encrypt(struct batchCrypt* bc, const char* text);
+void         batchCrypt_done(struct batchCrypt* bc);
 
 #endif  // CRYPT_H
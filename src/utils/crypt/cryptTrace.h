@@ -0,0 +1,40 @@
+#ifndef CRYPT_TRACE_H
+#define CRYPT_TRACE_H
+
+/**
+ * Cycle-count tracing for the crypto operations. Compiled out by default;
+ * build with @c make @c CRYPT_TRACE=1 to log one DEBUG line per traced
+ * operation. The counters are read with rdtsc on x86-64 and fall back to
+ * the monotonic clock in nanoseconds elsewhere.
+ */
+
+#ifdef AGENT_CRYPT_TRACE
+
+#include "utils/logger.h"
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t _crypt_trace_now() {
+#if defined(__x86_64__) && defined(__GNUC__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+#define CRYPT_TRACE_START() uint64_t _crypt_trace_start = _crypt_trace_now()
+#define CRYPT_TRACE_END(op)                                \
+  logger(DEBUG, "crypttrace %s: %llu", (op),               \
+         (unsigned long long)(_crypt_trace_now() - _crypt_trace_start))
+
+#else
+
+#define CRYPT_TRACE_START()
+#define CRYPT_TRACE_END(op)
+
+#endif  // AGENT_CRYPT_TRACE
+
+#endif  // CRYPT_TRACE_H
@@ -6,6 +6,7 @@
 #include "hexCrypt.h"
 #include "list/list.h"
 #include "memoryCrypt.h"
+#include "utils/accountSnapshot.h"
 #include "utils/accountUtils.h"
 #include "utils/db/account_db.h"
 #include "utils/logger.h"
@@ -13,6 +14,7 @@
 #include "utils/oidc_error.h"
 #include "utils/versionUtils.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -180,56 +182,70 @@ char* decryptForIpc(const char* msg, const unsigned char* key) {
 
 /**
  * @brief encrypts sensitive information when the agent is locked.
- * encrypts all loaded access_token, additional encryption (on top of already in
- * place xor) for refresh_token, client_id, client_secret
+ * encrypts all loaded access_token, additional encryption (on top of the
+ * memory encryption already in place) for refresh_token, client_id,
+ * client_secret
  * @param loaded the list of currently loaded accounts
  * @param password the lock password that will be used for encryption
  * @return an oidc_error code
  */
 oidc_error_t lockEncrypt(const char* password) {
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(accountDB_getList(), LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
+  // the key set is derived once and shared by all entries, so locking runs
+  // one KDF instead of one per field and account
+  struct batchCrypt bc = {};
+  if (batchCrypt_init(&bc, password) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  oidc_error_t ret      = OIDC_SUCCESS;
+  list_t*      accounts = accountDB_getList();
+  list_node_t* node;
+  LIST_FOREACH(accounts, node) {
     struct oidc_account* acc = node->val;
-    char* tmp = encryptText(account_getAccessToken(acc), password);
+    char* tmp = batchCrypt_encrypt(&bc, account_getAccessToken(acc));
     if (tmp == NULL) {
-      return oidc_errno;
+      ret = oidc_errno;
+      break;
     }
     account_setAccessToken(acc, tmp);
-    tmp = encryptText(account_getRefreshToken(acc), password);
+    tmp = batchCrypt_encrypt(&bc, account_getRefreshToken(acc));
     if (tmp == NULL) {
-      return oidc_errno;
+      ret = oidc_errno;
+      break;
     }
     account_setRefreshToken(acc, tmp);
-    tmp = encryptText(account_getClientId(acc), password);
+    tmp = batchCrypt_encrypt(&bc, account_getClientId(acc));
     if (tmp == NULL) {
-      return oidc_errno;
+      ret = oidc_errno;
+      break;
     }
     account_setClientId(acc, tmp);
     if (strValid(account_getClientSecret(acc))) {
-      tmp = encryptText(account_getClientSecret(acc), password);
+      tmp = batchCrypt_encrypt(&bc, account_getClientSecret(acc));
       if (tmp == NULL) {
-        return oidc_errno;
+        ret = oidc_errno;
+        break;
       }
       account_setClientSecret(acc, tmp);
     }
   }
-  list_iterator_destroy(it);
-  return OIDC_SUCCESS;
+  batchCrypt_done(&bc);
+  return ret;
 }
 
 /**
  * @brief decrypts sensitive information when the agent is unlocked.
  * After this call refresh_token, client_id, and client_secret will still be
- * xor encrypted
+ * memory encrypted
  * @param loaded the list of currently loaded accounts
  * @param password the lock password that was used for encryption
  * @return an oidc_error code
  */
 oidc_error_t lockDecrypt(const char* password) {
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(accountDB_getList(), LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
+  // all entries were encrypted with the same salt, so after the first entry
+  // the key cache answers the KDF for the rest
+  list_t*      accounts = accountDB_getList();
+  list_node_t* node;
+  LIST_FOREACH(accounts, node) {
     struct oidc_account* acc = node->val;
     char* tmp = crypt_decrypt(account_getAccessToken(acc), password);
     if (tmp == NULL) {
@@ -252,19 +268,32 @@ oidc_error_t lockDecrypt(const char* password) {
     }
     account_setClientSecret(acc, tmp);
   }
-  list_iterator_destroy(it);
   return OIDC_SUCCESS;
 }
 
+// Decrypted windows can overlap: a worker holds its account decrypted across
+// a whole http refresh, and the main thread may decrypt the same account for
+// another client meanwhile. The per-account plain_depth counts the open
+// windows; only the first open decrypts and only the last close re-encrypts,
+// so an inner window never runs memoryDecrypt on already-plaintext fields
+// (which would free the strings the outer window is using). The lock only
+// covers the depth transition and the field mutation, never the window
+// itself, so no thread ever blocks on another's refresh.
+static pthread_mutex_t plain_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct oidc_account* _db_decryptFoundAccount(struct oidc_account* account) {
   if (account == NULL) {
     return NULL;
   }
-  account_setRefreshToken(account,
-                          memoryDecrypt(account_getRefreshToken(account)));
-  account_setClientId(account, memoryDecrypt(account_getClientId(account)));
-  account_setClientSecret(account,
-                          memoryDecrypt(account_getClientSecret(account)));
+  pthread_mutex_lock(&plain_lock);
+  if (account->plain_depth++ == 0) {
+    account_setRefreshToken(account,
+                            memoryDecrypt(account_getRefreshToken(account)));
+    account_setClientId(account, memoryDecrypt(account_getClientId(account)));
+    account_setClientSecret(account,
+                            memoryDecrypt(account_getClientSecret(account)));
+  }
+  pthread_mutex_unlock(&plain_lock);
   return account;
 }
 
@@ -280,12 +309,14 @@ struct oidc_account* _db_decryptFoundAccount(struct oidc_account* account) {
 struct oidc_account* db_getAccountDecrypted(struct oidc_account* key) {
   logger(DEBUG, "Getting / Decrypting account from list");
   struct oidc_account* account = accountDB_findValue(key);
+  account_touch(account);
   return _db_decryptFoundAccount(account);
 }
 
 struct oidc_account* db_getAccountDecryptedByShortname(const char* shortname) {
   logger(DEBUG, "Getting / Decrypting account from list");
   struct oidc_account* account = db_findAccountByShortname(shortname);
+  account_touch(account);
   return _db_decryptFoundAccount(account);
 }
 
@@ -299,11 +330,21 @@ struct oidc_account* db_getAccountDecryptedByShortname(const char* shortname) {
  */
 void db_addAccountEncrypted(struct oidc_account* account) {
   logger(DEBUG, "Adding / Reencrypting account to list");
+  account_materializeAll(account);  // a long-lived account must not keep an
+                                    // unencrypted json view of its secrets
+  pthread_mutex_lock(&plain_lock);
+  if (account->plain_depth > 0 && --account->plain_depth > 0) {
+    // an outer decrypted window is still open; its close re-encrypts the
+    // fields as they are then - including any refresh token rotated here
+    pthread_mutex_unlock(&plain_lock);
+    return;
+  }
   account_setRefreshToken(account,
                           memoryEncrypt(account_getRefreshToken(account)));
   account_setClientId(account, memoryEncrypt(account_getClientId(account)));
   account_setClientSecret(account,
                           memoryEncrypt(account_getClientSecret(account)));
+  pthread_mutex_unlock(&plain_lock);
   struct oidc_account* found = accountDB_findValue(account);
   if (found && found != account) {
     accountDB_removeIfFound(account);
@@ -311,4 +352,5 @@ void db_addAccountEncrypted(struct oidc_account* account) {
   if (found != account) {
     accountDB_addValue(account);
   }
+  accountSnapshot_refresh();
 }
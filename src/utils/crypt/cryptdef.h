@@ -30,15 +30,16 @@ struct encryptionInfo {
 };
 
 /**
- * @brief clears and frees an encryptionInfo
+ * @brief allocates an encryptionInfo, reusing one from the pool if possible
+ * @return a zeroed encryptionInfo. Has to be freed after usage using
+ * @c secFreeEncryptionInfo
+ */
+struct encryptionInfo* secAllocEncryptionInfo();
+
+/**
+ * @brief clears an encryptionInfo and gives it back to the pool
  * @param crypt a pointer to the encryptionInfo struct to be cleared
  */
-static inline void secFreeEncryptionInfo(struct encryptionInfo* crypt) {
-  secFree(crypt->encrypted_base64);
-  secFree(crypt->nonce_base64);
-  secFree(crypt->salt_base64);
-  secFree(crypt->hash_key_base64);
-  secFree(crypt);
-}
+void secFreeEncryptionInfo(struct encryptionInfo* crypt);
 
 #endif  // OIDC_CRYPT_DEF_H
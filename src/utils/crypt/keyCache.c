@@ -0,0 +1,129 @@
+#include "keyCache.h"
+#include "sha256.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/secure_compare.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <sodium.h>
+#include <string.h>
+#include <time.h>
+
+#define KEYCACHE_MAX_ENTRIES 8
+#define KEYCACHE_TTL 300  // seconds
+
+struct keyCacheEntry {
+  unsigned char pw_hash[crypto_hash_sha256_BYTES];  // sha256 of the password;
+                                                    // the password itself is
+                                                    // never stored
+  char*                 salt_base64;
+  struct cryptParameter params;
+  char*                 key;  // 2*key_len bytes in mlocked memory
+  time_t                stored_at;
+};
+
+static struct keyCacheEntry entries[KEYCACHE_MAX_ENTRIES];
+
+// derivations run on the oidcd worker threads as well as in the main loop
+static pthread_mutex_t keyCache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _keyCache_wipeEntry(struct keyCacheEntry* e) {
+  if (e->key != NULL) {
+    sodium_munlock(e->key, 2 * e->params.key_len);
+    secFree(e->key);
+    e->key = NULL;
+  }
+  secFree(e->salt_base64);
+  e->salt_base64 = NULL;
+  sodium_memzero(e->pw_hash, sizeof(e->pw_hash));
+  e->stored_at = 0;
+}
+
+/**
+ * @brief compares the parameters that influence the key derivation
+ */
+static int _keyCache_paramsMatch(const struct cryptParameter* a,
+                                 const struct cryptParameter* b) {
+  return a->key_len == b->key_len && a->salt_len == b->salt_len &&
+         a->hash_ops_limit == b->hash_ops_limit &&
+         a->hash_mem_limit == b->hash_mem_limit && a->hash_alg == b->hash_alg;
+}
+
+static struct keyCacheEntry* _keyCache_find(
+    const unsigned char* pw_hash, const char* salt_base64,
+    const struct cryptParameter* cryptParams) {
+  for (unsigned char i = 0; i < KEYCACHE_MAX_ENTRIES; i++) {
+    struct keyCacheEntry* e = &entries[i];
+    if (e->key == NULL) {
+      continue;
+    }
+    if (time(NULL) - e->stored_at > KEYCACHE_TTL) {
+      _keyCache_wipeEntry(e);
+      continue;
+    }
+    if (secure_equal(e->pw_hash, pw_hash, sizeof(e->pw_hash)) &&
+        strequal(e->salt_base64, salt_base64) &&
+        _keyCache_paramsMatch(&e->params, cryptParams)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+char* keyCache_lookup(const char* password, const char* salt_base64,
+                      const struct cryptParameter* cryptParams) {
+  if (password == NULL || salt_base64 == NULL || cryptParams == NULL) {
+    return NULL;
+  }
+  unsigned char pw_hash[crypto_hash_sha256_BYTES];
+  agent_sha256(pw_hash, (const unsigned char*)password, strlen(password));
+  pthread_mutex_lock(&keyCache_lock);
+  struct keyCacheEntry* e = _keyCache_find(pw_hash, salt_base64, cryptParams);
+  char*                 ret = NULL;
+  if (e != NULL) {
+    logger(DEBUG, "Derived key served from cache");
+    ret = oidc_memcopy(e->key, 2 * e->params.key_len);
+  }
+  pthread_mutex_unlock(&keyCache_lock);
+  sodium_memzero(pw_hash, sizeof(pw_hash));
+  return ret;
+}
+
+void keyCache_store(const char* password, const char* salt_base64,
+                    const struct cryptParameter* cryptParams,
+                    const char*                  key) {
+  if (password == NULL || salt_base64 == NULL || cryptParams == NULL ||
+      key == NULL) {
+    return;
+  }
+  unsigned char pw_hash[crypto_hash_sha256_BYTES];
+  agent_sha256(pw_hash, (const unsigned char*)password, strlen(password));
+  pthread_mutex_lock(&keyCache_lock);
+  struct keyCacheEntry* e = _keyCache_find(pw_hash, salt_base64, cryptParams);
+  if (e == NULL) {  // replace the oldest entry
+    e = &entries[0];
+    for (unsigned char i = 1; i < KEYCACHE_MAX_ENTRIES; i++) {
+      if (entries[i].stored_at < e->stored_at) {
+        e = &entries[i];
+      }
+    }
+    _keyCache_wipeEntry(e);
+    memcpy(e->pw_hash, pw_hash, sizeof(e->pw_hash));
+    e->salt_base64 = oidc_strcopy(salt_base64);
+    e->params      = *cryptParams;
+    e->key         = oidc_memcopy((void*)key, 2 * cryptParams->key_len);
+    sodium_mlock(e->key, 2 * cryptParams->key_len);
+  }
+  e->stored_at = time(NULL);
+  pthread_mutex_unlock(&keyCache_lock);
+  sodium_memzero(pw_hash, sizeof(pw_hash));
+}
+
+void keyCache_clear() {
+  pthread_mutex_lock(&keyCache_lock);
+  for (unsigned char i = 0; i < KEYCACHE_MAX_ENTRIES; i++) {
+    _keyCache_wipeEntry(&entries[i]);
+  }
+  pthread_mutex_unlock(&keyCache_lock);
+}
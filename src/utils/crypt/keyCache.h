@@ -0,0 +1,41 @@
+#ifndef OIDC_KEYCACHE_H
+#define OIDC_KEYCACHE_H
+
+#include "cryptdef.h"
+
+/**
+ * In-memory cache for derived keys.
+ *
+ * Deriving the encryption keys from a password is a deliberately expensive
+ * Argon2 run taking several hundred milliseconds. When several config files
+ * are protected by the same password (oidc-add loading multiple accounts,
+ * the password store replaying a cached password), every decryption repeats
+ * the identical derivation. The cache maps (password, salt, parameters) to
+ * the derived key material, so repeats skip the KDF. The password itself is
+ * never stored - only its sha256 - and the key material is held in memory
+ * locked with @c sodium_mlock and expires after a few minutes.
+ */
+
+/**
+ * @brief looks up the derived key material for a password/salt/parameter
+ * combination
+ * @return a pointer to a copy of the 2*key_len bytes of key material. Has to
+ * be freed after usage. @c NULL on a cache miss.
+ */
+char* keyCache_lookup(const char* password, const char* salt_base64,
+                      const struct cryptParameter* cryptParams);
+
+/**
+ * @brief caches the derived key material for a password/salt/parameter
+ * combination
+ * @param key the 2*key_len bytes of derived key material; copied
+ */
+void keyCache_store(const char* password, const char* salt_base64,
+                    const struct cryptParameter* cryptParams, const char* key);
+
+/**
+ * @brief wipes all cached key material; called when the agent is locked
+ */
+void keyCache_clear();
+
+#endif  // OIDC_KEYCACHE_H
@@ -1,5 +1,6 @@
 #include "memoryCrypt.h"
 #include "crypt.h"
+#include "cryptTrace.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
@@ -8,26 +9,8 @@
 #include <sodium.h>
 #include <string.h>
 
-static uint64_t memoryPass;
-
-/**
- * @brief XORs len bytes of string with key
- * @param string the string to be encrypted
- * @param key a 64bit number used as encryption key
- * @param len the nubmer of bytes to be encrypted
- * @return a pointer to the encrypted string. It has to be freed after usage.
- */
-char* xorCrypt(const char* string, uint64_t key, size_t len) {
-  size_t length = sizeof(key);
-  char*  str    = secAlloc(len + 1);
-  char*  s      = str;
-  for (size_t i = 0; i < len; i++) {
-    *str = *string ^ *((unsigned char*)&key + (i % length));
-    str++;
-    string++;
-  }
-  return s;
-}
+// per-agent random key; generated at startup and kept in mlocked memory
+static unsigned char* memoryKey;
 
 /**
  * @brief decryptes the memory encrypted cipher
@@ -36,58 +19,133 @@ char* xorCrypt(const char* string, uint64_t key, size_t len) {
  * @return a pointer to the decrypted string. It has to be freed after usage.
  */
 char* memoryDecrypt(const char* cipher) {
-  if (!strValid(cipher)) {
+  if (!strValid(cipher) || memoryKey == NULL) {
     // oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  // logger(DEBUG, "memory decryption '%s'", cipher);
+  CRYPT_TRACE_START();
   char*  tmp           = oidc_strcopy(cipher);
-  size_t len           = strToInt(strtok(tmp, ":"));
+  size_t len           = strToULong(strtok(tmp, ":"));
+  char*  nonce_base64  = strtok(NULL, ":");
   char*  cipher_base64 = strtok(NULL, ":");
-  if (len == 0 || cipher_base64 == NULL) {
+  if (len == 0 || nonce_base64 == NULL || cipher_base64 == NULL) {
     secFree(tmp);
     oidc_errno = OIDC_ECRYPM;
     return NULL;
   }
-  unsigned char* cipher_bin = secAlloc(sizeof(char) * (len + 1));
-  fromBase64(cipher_base64, len, cipher_bin);
-  char* decrypted = xorCrypt((char*)cipher_bin, memoryPass, len);
+  unsigned char nonce[crypto_secretbox_NONCEBYTES];
+  fromBase64(nonce_base64, crypto_secretbox_NONCEBYTES, nonce);
+  size_t         cipher_len = len + crypto_secretbox_MACBYTES;
+  unsigned char* cipher_bin = secAlloc(cipher_len);
+  fromBase64(cipher_base64, cipher_len, cipher_bin);
+  char* decrypted = secAlloc(len + 1);
+  if (crypto_secretbox_open_easy((unsigned char*)decrypted, cipher_bin,
+                                 cipher_len, nonce, memoryKey) != 0) {
+    logger(ERROR, "Memory decryption failed");
+    secFree(decrypted);
+    decrypted  = NULL;
+    oidc_errno = OIDC_EDECRYPT;
+  }
   secFree(cipher_bin);
   secFree(tmp);
+  CRYPT_TRACE_END("memoryDecrypt");
   return decrypted;
 }
 
 /**
  * @brief encryptes text
  * @param text the text to be encrypted
- * @return a pointer to the base64 encoded encrypted string. It has to be freed
+ * @return a pointer to the encrypted string. It has to be freed
  * after usage.
  */
 char* memoryEncrypt(const char* text) {
-  if (!strValid(text)) {
+  if (!strValid(text) || memoryKey == NULL) {
     // oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  // logger(DEBUG, "memory encryption '%s'", text);
-  size_t len           = strlen(text);
-  char*  cipher        = xorCrypt(text, memoryPass, len);
-  char*  cipher_base64 = toBase64(cipher, len);
+  CRYPT_TRACE_START();
+  size_t        len = strlen(text);
+  unsigned char nonce[crypto_secretbox_NONCEBYTES];
+  secRandomFill(nonce, sizeof(nonce));
+  unsigned char* cipher = secAlloc(len + crypto_secretbox_MACBYTES);
+  crypto_secretbox_easy(cipher, (const unsigned char*)text, len, nonce,
+                        memoryKey);
+  // The container has to stay a C string - the agent lock runs the
+  // string-based password encryption over these values - so the binary nonce
+  // and cipher are base64 encoded.
+  char* nonce_base64 = toBase64((char*)nonce, sizeof(nonce));
+  char* cipher_base64 =
+      toBase64((char*)cipher, len + crypto_secretbox_MACBYTES);
+  char* ciphered = oidc_sprintf("%lu:%s:%s", len, nonce_base64, cipher_base64);
   secFree(cipher);
-  char* fmt      = "%lu:%s";
-  char* ciphered = oidc_sprintf(fmt, len, cipher_base64);
+  secFree(nonce_base64);
   secFree(cipher_base64);
+  CRYPT_TRACE_END("memoryEncrypt");
   return ciphered;
 }
 
+struct memCryptBlob {
+  unsigned char nonce[crypto_secretbox_NONCEBYTES];
+  unsigned char* cipher;  // len + crypto_secretbox_MACBYTES bytes
+  size_t         len;     // plaintext length
+};
+
+void _secFreeMemCryptBlob(struct memCryptBlob* blob) {
+  if (blob == NULL) {
+    return;
+  }
+  secFree(blob->cipher);
+  secFree(blob);
+}
+
+/**
+ * @brief encryptes text into a binary secretbox container
+ * @return a pointer to the container. Has to be freed after usage (with
+ * @c secFreeMemCryptBlob ).
+ */
+struct memCryptBlob* memoryEncryptBinary(const char* text) {
+  if (!strValid(text) || memoryKey == NULL) {
+    return NULL;
+  }
+  struct memCryptBlob* blob = secAlloc(sizeof(struct memCryptBlob));
+  blob->len                 = strlen(text);
+  secRandomFill(blob->nonce, sizeof(blob->nonce));
+  blob->cipher = secAlloc(blob->len + crypto_secretbox_MACBYTES);
+  crypto_secretbox_easy(blob->cipher, (const unsigned char*)text, blob->len,
+                        blob->nonce, memoryKey);
+  return blob;
+}
+
+/**
+ * @brief decryptes a binary secretbox container
+ * Unlike @c memoryDecrypt this neither parses nor base64 decodes anything.
+ * @param blob a container returned by @c memoryEncryptBinary
+ * @return a pointer to the decrypted string. It has to be freed after usage.
+ */
+char* memoryDecryptBinary(const struct memCryptBlob* blob) {
+  if (blob == NULL || memoryKey == NULL) {
+    return NULL;
+  }
+  char* decrypted = secAlloc(blob->len + 1);
+  if (crypto_secretbox_open_easy((unsigned char*)decrypted, blob->cipher,
+                                 blob->len + crypto_secretbox_MACBYTES,
+                                 blob->nonce, memoryKey) != 0) {
+    logger(ERROR, "Memory decryption failed");
+    secFree(decrypted);
+    oidc_errno = OIDC_EDECRYPT;
+    return NULL;
+  }
+  return decrypted;
+}
+
 /**
  * @brief initializes memory encryption
- * generates a random 64bit memory encryption passnumber
+ * generates a random secretbox key and locks it into memory
  */
 void initMemoryCrypt() {
-  uint64_t a    = randombytes_random();
-  uint32_t b    = randombytes_random();
-  uint64_t pass = (a << 32) | b;
-  memoryPass    = pass;
+  if (memoryKey == NULL) {
+    memoryKey = secAlloc(crypto_secretbox_KEYBYTES);
+    sodium_mlock(memoryKey, crypto_secretbox_KEYBYTES);
+  }
+  randombytes_buf(memoryKey, crypto_secretbox_KEYBYTES);
 }
-
-uint64_t _getMemoryPass() { return memoryPass; }
@@ -4,6 +4,22 @@
 char* memoryEncrypt(const char* str);
 char* memoryDecrypt(const char* str);
 
+// binary secretbox container under the same memory key; unlike the string
+// form it needs no base64 or parsing to decrypt, so it suits values that
+// are decrypted repeatedly
+struct memCryptBlob;
+struct memCryptBlob* memoryEncryptBinary(const char* text);
+char*                memoryDecryptBinary(const struct memCryptBlob* blob);
+void                 _secFreeMemCryptBlob(struct memCryptBlob* blob);
+
 void initMemoryCrypt();
 
+#ifndef secFreeMemCryptBlob
+#define secFreeMemCryptBlob(ptr) \
+  do {                           \
+    _secFreeMemCryptBlob((ptr)); \
+    (ptr) = NULL;                \
+  } while (0)
+#endif  // secFreeMemCryptBlob
+
 #endif
@@ -0,0 +1,269 @@
+#include "sha256.h"
+
+#include <sodium.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHA256_HAVE_SHANI_PATH
+#include <immintrin.h>
+#endif
+
+#ifdef SHA256_HAVE_SHANI_PATH
+
+// Compression function on the x86 SHA extensions; the round structure
+// follows Intel's reference sequence. Compiled with a target attribute so
+// the rest of the build needs no instruction-set flags - the dispatcher
+// only selects this path after checking cpuid.
+__attribute__((target("sha,sse4.1"))) static void _sha256_shani_blocks(
+    uint32_t state[8], const unsigned char* data, size_t blocks) {
+  __m128i STATE0, STATE1, MSG, TMP, MSG0, MSG1, MSG2, MSG3;
+  __m128i ABEF_SAVE, CDGH_SAVE;
+  const __m128i MASK =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  TMP    = _mm_loadu_si128((const __m128i*)&state[0]); /* DCBA */
+  STATE1 = _mm_loadu_si128((const __m128i*)&state[4]); /* HGFE */
+
+  TMP    = _mm_shuffle_epi32(TMP, 0xB1);       /* CDAB */
+  STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);    /* EFGH */
+  STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);    /* ABEF */
+  STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0); /* CDGH */
+
+  while (blocks-- > 0) {
+    ABEF_SAVE = STATE0;
+    CDGH_SAVE = STATE1;
+
+    /* Rounds 0-3 */
+    MSG    = _mm_loadu_si128((const __m128i*)(data + 0));
+    MSG0   = _mm_shuffle_epi8(MSG, MASK);
+    MSG    = _mm_add_epi32(
+        MSG0, _mm_set_epi64x(0xE9B5DBA5B5C0FBCFULL, 0x71374491428A2F98ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+
+    /* Rounds 4-7 */
+    MSG1   = _mm_loadu_si128((const __m128i*)(data + 16));
+    MSG1   = _mm_shuffle_epi8(MSG1, MASK);
+    MSG    = _mm_add_epi32(
+        MSG1, _mm_set_epi64x(0xAB1C5ED5923F82A4ULL, 0x59F111F13956C25BULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG0   = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 8-11 */
+    MSG2   = _mm_loadu_si128((const __m128i*)(data + 32));
+    MSG2   = _mm_shuffle_epi8(MSG2, MASK);
+    MSG    = _mm_add_epi32(
+        MSG2, _mm_set_epi64x(0x550C7DC3243185BEULL, 0x12835B01D807AA98ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG1   = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 12-15 */
+    MSG3   = _mm_loadu_si128((const __m128i*)(data + 48));
+    MSG3   = _mm_shuffle_epi8(MSG3, MASK);
+    MSG    = _mm_add_epi32(
+        MSG3, _mm_set_epi64x(0xC19BF1749BDC06A7ULL, 0x80DEB1FE72BE5D74ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG3, MSG2, 4);
+    MSG0   = _mm_add_epi32(MSG0, TMP);
+    MSG0   = _mm_sha256msg2_epu32(MSG0, MSG3);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG2   = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 16-19 */
+    MSG    = _mm_add_epi32(
+        MSG0, _mm_set_epi64x(0x240CA1CC0FC19DC6ULL, 0xEFBE4786E49B69C1ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG0, MSG3, 4);
+    MSG1   = _mm_add_epi32(MSG1, TMP);
+    MSG1   = _mm_sha256msg2_epu32(MSG1, MSG0);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG3   = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 20-23 */
+    MSG    = _mm_add_epi32(
+        MSG1, _mm_set_epi64x(0x76F988DA5CB0A9DCULL, 0x4A7484AA2DE92C6FULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG1, MSG0, 4);
+    MSG2   = _mm_add_epi32(MSG2, TMP);
+    MSG2   = _mm_sha256msg2_epu32(MSG2, MSG1);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG0   = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 24-27 */
+    MSG    = _mm_add_epi32(
+        MSG2, _mm_set_epi64x(0xBF597FC7B00327C8ULL, 0xA831C66D983E5152ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG2, MSG1, 4);
+    MSG3   = _mm_add_epi32(MSG3, TMP);
+    MSG3   = _mm_sha256msg2_epu32(MSG3, MSG2);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG1   = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 28-31 */
+    MSG    = _mm_add_epi32(
+        MSG3, _mm_set_epi64x(0x1429296706CA6351ULL, 0xD5A79147C6E00BF3ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG3, MSG2, 4);
+    MSG0   = _mm_add_epi32(MSG0, TMP);
+    MSG0   = _mm_sha256msg2_epu32(MSG0, MSG3);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG2   = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 32-35 */
+    MSG    = _mm_add_epi32(
+        MSG0, _mm_set_epi64x(0x53380D134D2C6DFCULL, 0x2E1B213827B70A85ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG0, MSG3, 4);
+    MSG1   = _mm_add_epi32(MSG1, TMP);
+    MSG1   = _mm_sha256msg2_epu32(MSG1, MSG0);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG3   = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 36-39 */
+    MSG    = _mm_add_epi32(
+        MSG1, _mm_set_epi64x(0x92722C8581C2C92EULL, 0x766A0ABB650A7354ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG1, MSG0, 4);
+    MSG2   = _mm_add_epi32(MSG2, TMP);
+    MSG2   = _mm_sha256msg2_epu32(MSG2, MSG1);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG0   = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    /* Rounds 40-43 */
+    MSG    = _mm_add_epi32(
+        MSG2, _mm_set_epi64x(0xC76C51A3C24B8B70ULL, 0xA81A664BA2BFE8A1ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG2, MSG1, 4);
+    MSG3   = _mm_add_epi32(MSG3, TMP);
+    MSG3   = _mm_sha256msg2_epu32(MSG3, MSG2);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG1   = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    /* Rounds 44-47 */
+    MSG    = _mm_add_epi32(
+        MSG3, _mm_set_epi64x(0x106AA070F40E3585ULL, 0xD6990624D192E819ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG3, MSG2, 4);
+    MSG0   = _mm_add_epi32(MSG0, TMP);
+    MSG0   = _mm_sha256msg2_epu32(MSG0, MSG3);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG2   = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+    /* Rounds 48-51 */
+    MSG    = _mm_add_epi32(
+        MSG0, _mm_set_epi64x(0x34B0BCB52748774CULL, 0x1E376C0819A4C116ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG0, MSG3, 4);
+    MSG1   = _mm_add_epi32(MSG1, TMP);
+    MSG1   = _mm_sha256msg2_epu32(MSG1, MSG0);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+    MSG3   = _mm_sha256msg1_epu32(MSG3, MSG0);
+
+    /* Rounds 52-55 */
+    MSG    = _mm_add_epi32(
+        MSG1, _mm_set_epi64x(0x682E6FF35B9CCA4FULL, 0x4ED8AA4A391C0CB3ULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG1, MSG0, 4);
+    MSG2   = _mm_add_epi32(MSG2, TMP);
+    MSG2   = _mm_sha256msg2_epu32(MSG2, MSG1);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+
+    /* Rounds 56-59 */
+    MSG    = _mm_add_epi32(
+        MSG2, _mm_set_epi64x(0x8CC7020884C87814ULL, 0x78A5636F748F82EEULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    TMP    = _mm_alignr_epi8(MSG2, MSG1, 4);
+    MSG3   = _mm_add_epi32(MSG3, TMP);
+    MSG3   = _mm_sha256msg2_epu32(MSG3, MSG2);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+
+    /* Rounds 60-63 */
+    MSG    = _mm_add_epi32(
+        MSG3, _mm_set_epi64x(0xC67178F2BEF9A3F7ULL, 0xA4506CEB90BEFFFAULL));
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+    MSG    = _mm_shuffle_epi32(MSG, 0x0E);
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+
+    STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+    STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+    data += 64;
+  }
+
+  TMP    = _mm_shuffle_epi32(STATE0, 0x1B);    /* FEBA */
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);    /* DCHG */
+  STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0); /* DCBA */
+  STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);    /* HGFE */
+
+  _mm_storeu_si128((__m128i*)&state[0], STATE0);
+  _mm_storeu_si128((__m128i*)&state[4], STATE1);
+}
+
+static void _sha256_shani(unsigned char out[AGENT_SHA256_BYTES],
+                          const unsigned char* in, size_t len) {
+  uint32_t state[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                       0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+  size_t   blocks   = len / 64;
+  _sha256_shani_blocks(state, in, blocks);
+  unsigned char last[128] = {0};
+  size_t        rem       = len - blocks * 64;
+  memcpy(last, in + blocks * 64, rem);
+  last[rem]          = 0x80;
+  size_t   padBlocks = rem < 56 ? 1 : 2;
+  uint64_t bitlen    = (uint64_t)len * 8;
+  for (int i = 0; i < 8; i++) {
+    last[padBlocks * 64 - 1 - i] = (unsigned char)(bitlen >> (8 * i));
+  }
+  _sha256_shani_blocks(state, last, padBlocks);
+  for (int i = 0; i < 8; i++) {
+    out[4 * i]     = (unsigned char)(state[i] >> 24);
+    out[4 * i + 1] = (unsigned char)(state[i] >> 16);
+    out[4 * i + 2] = (unsigned char)(state[i] >> 8);
+    out[4 * i + 3] = (unsigned char)(state[i]);
+  }
+  sodium_memzero(last, sizeof(last));
+  sodium_memzero(state, sizeof(state));
+}
+
+#endif  // SHA256_HAVE_SHANI_PATH
+
+static void _sha256_sodium(unsigned char out[AGENT_SHA256_BYTES],
+                           const unsigned char* in, size_t len) {
+  crypto_hash_sha256(out, in, len);
+}
+
+typedef void (*sha256_fn)(unsigned char[AGENT_SHA256_BYTES],
+                          const unsigned char*, size_t);
+
+static sha256_fn sha256_impl = NULL;
+
+void agent_sha256(unsigned char out[AGENT_SHA256_BYTES],
+                  const unsigned char* in, size_t len) {
+  if (sha256_impl == NULL) {  // racing initializations resolve the same value
+#ifdef SHA256_HAVE_SHANI_PATH
+    sha256_impl =
+        __builtin_cpu_supports("sha") ? _sha256_shani : _sha256_sodium;
+#else
+    sha256_impl = _sha256_sodium;
+#endif
+  }
+  sha256_impl(out, in, len);
+}
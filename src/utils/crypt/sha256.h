@@ -0,0 +1,22 @@
+#ifndef AGENT_SHA256_H
+#define AGENT_SHA256_H
+
+#include <stddef.h>
+
+#define AGENT_SHA256_BYTES 32
+
+/**
+ * @brief computes the sha256 hash of a buffer
+ *
+ * Runtime-dispatched: on x86-64 CPUs with the SHA extensions the compression
+ * rounds run on dedicated instructions, which is several times faster than
+ * sodium's portable implementation; anywhere else sodium is used. The output
+ * is identical either way.
+ * @param out filled with the 32 byte hash
+ * @param in the buffer to be hashed
+ * @param len the length of @p in in bytes
+ */
+void agent_sha256(unsigned char out[AGENT_SHA256_BYTES],
+                  const unsigned char* in, size_t len);
+
+#endif  // AGENT_SHA256_H
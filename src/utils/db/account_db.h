@@ -11,9 +11,18 @@
 #define accountDB_setMatchFunction(match) \
   db_setMatchFunction(OIDC_DB_ACCOUNTS, (match))
 
+#define accountDB_setHashKeys(primary, secondary) \
+  db_setHashKeys(OIDC_DB_ACCOUNTS, (primary), (secondary))
+
 #define accountDB_setFreeFunction(free) \
   db_setFreeFunction(OIDC_DB_ACCOUNTS, (free))
 
+#define accountDB_setDeathGetter(getter) \
+  db_setDeathGetter(OIDC_DB_ACCOUNTS, (getter))
+
+#define accountDB_notifyDeathChange(value) \
+  do { db_notifyDeathChange(OIDC_DB_ACCOUNTS, (value)); } while (0)
+
 #define accountDB_removeIfFound(value) \
   do { db_removeIfFound(OIDC_DB_ACCOUNTS, (value)); } while (0)
 
@@ -11,9 +11,15 @@
 #define codeVerifierDB_setMatchFunction(match) \
   db_setMatchFunction(OIDC_DB_CODEVERIFIERS, (match))
 
+#define codeVerifierDB_setHashKeys(primary, secondary) \
+  db_setHashKeys(OIDC_DB_CODEVERIFIERS, (primary), (secondary))
+
 #define codeVerifierDB_setFreeFunction(free) \
   db_setFreeFunction(OIDC_DB_CODEVERIFIERS, (free))
 
+#define codeVerifierDB_setDeathGetter(getter) \
+  db_setDeathGetter(OIDC_DB_CODEVERIFIERS, (getter))
+
 #define codeVerifierDB_removeIfFound(value) \
   do { db_removeIfFound(OIDC_DB_CODEVERIFIERS, (value)); } while (0)
 
@@ -11,6 +11,9 @@
 #define connectionDB_setMatchFunction(match) \
   db_setMatchFunction(OIDC_DB_CONNECTIONS, (match))
 
+#define connectionDB_setFdKey(extract) \
+  db_setFdKey(OIDC_DB_CONNECTIONS, (extract))
+
 #define connectionDB_setFreeFunction(free) \
   db_setFreeFunction(OIDC_DB_CONNECTIONS, (free))
 
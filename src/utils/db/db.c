@@ -1,16 +1,288 @@
+#define _XOPEN_SOURCE 700
 #include "db.h"
 #include "list/list.h"
 #include "utils/deathUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/timerQueue.h"
+
+#include <pthread.h>
+#include <string.h>
 
 static list_t* dbs = NULL;
 
+// The dbs are accessed from the oidcd worker threads as well as from the
+// main loop, so all public entry points are guarded by one recursive lock.
+static pthread_mutex_t db_lock;
+static unsigned char   db_lock_initialized = 0;
+
+static void _db_lock_init() {
+  if (db_lock_initialized) {
+    return;
+  }
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&db_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  db_lock_initialized = 1;
+}
+
+static void _db_lockAcquire() {
+  _db_lock_init();
+  pthread_mutex_lock(&db_lock);
+}
+
+static void _db_lockRelease() { pthread_mutex_unlock(&db_lock); }
+
+/*
+ * Optional hash index over a db.
+ *
+ * The linked list stays the owner of the values and keeps supporting
+ * iteration, findAll and the death scans; the index is a pure accelerator
+ * for db_findValue. Lookups extract the key string from the key struct,
+ * probe the table and verify every candidate with the db's current match
+ * function, so a hit is always correct no matter which match function is
+ * installed; on a miss the list walk runs as before. Keys are borrowed from
+ * the values, and the index is rebuilt from the list after removals.
+ */
+#define DB_HASH_INITIAL_CAPACITY 64
+
+struct db_hash_entry {
+  const char* key;  // borrowed from the value; NULL means empty slot
+  void*       value;
+};
+
+struct db_hash_index {
+  struct db_hash_entry* entries;
+  size_t                capacity;
+  size_t                used;
+  db_keyExtractor       extract;
+};
+
+/*
+ * Optional fd index over a db.
+ *
+ * File descriptors are small dense integers and unique per value, so a plain
+ * slot array indexed by fd gives O(1) add, find and remove with no probing
+ * and no rebuild after removals. Like the hash index the list stays the
+ * owner and every hit is verified with the db's match function.
+ */
+#define DB_FD_INITIAL_CAPACITY 64
+
+struct db_fd_index {
+  void**         slots;  // indexed by fd; NULL means empty
+  size_t         capacity;
+  db_fdExtractor extract;
+};
+
 struct oidc_db {
-  db_name db;
-  list_t* list;
+  db_name              db;
+  list_t*              list;
+  struct db_hash_index index[2];
+  struct db_fd_index   fdindex;
+  // min-heap over the values' death times; only present once a death
+  // getter is registered with db_setDeathGetter
+  struct timerQueue* timers;
+  time_t (*deathGetter)(void*);
+  // bumped on every mutation; guards the one-entry lookup memo below
+  unsigned long generation;
+  struct {
+    char*         key;  // owned copy of the extracted primary key
+    void*         value;
+    unsigned long generation;
+  } memo;
+  // lookup counters since start; reported by db_storeInfoToJSON
+  struct {
+    unsigned long lookups;     // db_findValue / db_findValueWithFunction calls
+    unsigned long hits;        // lookups that returned a value
+    unsigned long memo_hits;   // answered from the one-entry memo
+    unsigned long index_hits;  // answered from an fd or hash index
+    unsigned long list_scans;  // lookups that fell back to a list walk
+    unsigned long probes;      // hash slots inspected in total
+    unsigned long scanned;     // list nodes compared in total
+  } stats;
 };
 
+static unsigned long _db_hash(const char* s) {
+  unsigned long hash = 14695981039346656037UL;  // FNV-1a
+  for (const unsigned char* c = (const unsigned char*)s; *c; c++) {
+    hash ^= *c;
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+static void _db_indexGrow(struct db_hash_index* index);
+
+static void _db_indexInsert(struct db_hash_index* index, void* value) {
+  if (index->entries == NULL || index->extract == NULL) {
+    return;
+  }
+  const char* key = index->extract(value);
+  if (key == NULL) {
+    return;
+  }
+  if ((index->used + 1) * 4 > index->capacity * 3) {
+    _db_indexGrow(index);
+  }
+  size_t i = _db_hash(key) % index->capacity;
+  while (index->entries[i].key != NULL) {  // duplicate keys (several values
+                                           // under the same issuer) simply
+                                           // occupy consecutive slots
+    i = (i + 1) % index->capacity;
+  }
+  index->entries[i].key   = key;
+  index->entries[i].value = value;
+  index->used++;
+}
+
+static void _db_indexGrow(struct db_hash_index* index) {
+  struct db_hash_entry* old     = index->entries;
+  size_t                old_cap = index->capacity;
+  index->capacity *= 2;
+  index->entries = secAlloc(index->capacity * sizeof(struct db_hash_entry));
+  index->used    = 0;
+  for (size_t i = 0; i < old_cap; i++) {
+    if (old[i].key != NULL) {
+      _db_indexInsert(index, old[i].value);
+    }
+  }
+  secFree(old);
+}
+
+/**
+ * @brief drops and refills an index from the db's list
+ *
+ * Needed after removals: open addressing cannot delete single entries
+ * without breaking probe chains, and removals are rare.
+ */
+static void _db_indexRebuild(struct oidc_db* db_s,
+                             struct db_hash_index* index) {
+  if (index->entries == NULL) {
+    return;
+  }
+  memset(index->entries, 0, index->capacity * sizeof(struct db_hash_entry));
+  index->used = 0;
+  list_node_t* node;
+  LIST_FOREACH(db_s->list, node) { _db_indexInsert(index, node->val); }
+}
+
+static void* _db_indexFind(struct db_hash_index* index, void* key,
+                           matchFunction match, unsigned long* probes) {
+  if (index->entries == NULL || index->extract == NULL) {
+    return NULL;
+  }
+  const char* k = index->extract(key);
+  if (k == NULL) {
+    return NULL;
+  }
+  for (size_t i = _db_hash(k) % index->capacity;
+       index->entries[i].key != NULL; i = (i + 1) % index->capacity) {
+    if (probes != NULL) {
+      (*probes)++;
+    }
+    if (strcmp(index->entries[i].key, k) != 0) {
+      continue;
+    }
+    void* candidate = index->entries[i].value;
+    if (match ? match(key, candidate) : key == candidate) {
+      return candidate;
+    }
+  }
+  return NULL;
+}
+
+static void _db_fdInsert(struct db_fd_index* index, void* value) {
+  if (index->slots == NULL || index->extract == NULL) {
+    return;
+  }
+  int fd = index->extract(value);
+  if (fd < 0) {
+    return;
+  }
+  if ((size_t)fd >= index->capacity) {
+    size_t newCapacity = index->capacity;
+    while ((size_t)fd >= newCapacity) { newCapacity *= 2; }
+    void** newSlots = secAlloc(newCapacity * sizeof(void*));
+    memcpy(newSlots, index->slots, index->capacity * sizeof(void*));
+    secFree(index->slots);
+    index->slots    = newSlots;
+    index->capacity = newCapacity;
+  }
+  index->slots[fd] = value;
+}
+
+// Must run before the value is removed from the list (and possibly freed),
+// while the fd can still be extracted from it.
+static void _db_fdRemove(struct db_fd_index* index, void* value) {
+  if (index->slots == NULL || index->extract == NULL) {
+    return;
+  }
+  int fd = index->extract(value);
+  if (fd >= 0 && (size_t)fd < index->capacity && index->slots[fd] == value) {
+    index->slots[fd] = NULL;
+  }
+}
+
+static void* _db_fdFind(struct db_fd_index* index, void* key,
+                        matchFunction match) {
+  if (index->slots == NULL || index->extract == NULL) {
+    return NULL;
+  }
+  int fd = index->extract(key);
+  if (fd < 0 || (size_t)fd >= index->capacity) {
+    return NULL;
+  }
+  void* candidate = index->slots[fd];
+  if (candidate == NULL) {
+    return NULL;
+  }
+  return (match ? match(key, candidate) : key == candidate) ? candidate : NULL;
+}
+
+/*
+ * One-entry lookup memo guarded by the db's generation counter.
+ *
+ * Request handling tends to look up the same shortname several times in a
+ * row (handler, autoload, token path); as long as no mutation bumped the
+ * generation in between, those repeats are answered from the memo without
+ * touching the indexes or the list. Hits are still verified with the match
+ * function.
+ */
+static void* _db_memoFind(struct oidc_db* db_s, void* key,
+                          matchFunction match) {
+  if (db_s->memo.key == NULL || db_s->memo.generation != db_s->generation) {
+    return NULL;
+  }
+  db_keyExtractor extract = db_s->index[0].extract;
+  if (extract == NULL) {
+    return NULL;
+  }
+  const char* k = extract(key);
+  if (k == NULL || !strequal(k, db_s->memo.key)) {
+    return NULL;
+  }
+  void* candidate = db_s->memo.value;
+  return (match ? match(key, candidate) : key == candidate) ? candidate : NULL;
+}
+
+static void _db_memoStore(struct oidc_db* db_s, void* key, void* value) {
+  db_keyExtractor extract = db_s->index[0].extract;
+  if (extract == NULL) {
+    return;
+  }
+  const char* k = extract(key);
+  if (k == NULL) {
+    return;
+  }
+  secFree(db_s->memo.key);
+  db_s->memo.key        = oidc_strcopy(k);
+  db_s->memo.value      = value;
+  db_s->memo.generation = db_s->generation;
+}
+
 int matchDBs(const struct oidc_db* a, const struct oidc_db* b) {
   return a->db == b->db;
 }
@@ -32,83 +304,265 @@ list_node_t* _getDBNode(const db_name db) {
 }
 
 list_t* db_getDB(const db_name db) {
+  _db_lockAcquire();
   list_node_t* found = _getDBNode(db);
-  if (found == NULL) {
-    return NULL;
-  }
-  return ((struct oidc_db*)found->val)->list;
+  list_t* ret = found == NULL ? NULL : ((struct oidc_db*)found->val)->list;
+  _db_lockRelease();
+  return ret;
 }
 
 void db_newDB(const db_name db) {
+  _db_lockAcquire();
   db_init();
   if (db_getDB(db) != NULL) {
+    _db_lockRelease();
     return;
   }
   struct oidc_db* db_e = secAlloc(sizeof(struct oidc_db));
   db_e->db             = db;
   db_e->list           = list_new();
   list_rpush(dbs, list_node_new(db_e));
+  _db_lockRelease();
 }
 
 matchFunction db_setMatchFunction(const db_name db, matchFunction match) {
+  _db_lockAcquire();
   db_init();
   list_t* db_list = db_getDB(db);
   if (db_list == NULL) {
     db_newDB(db);
-    return db_setMatchFunction(db, match);
+    matchFunction ret = db_setMatchFunction(db, match);
+    _db_lockRelease();
+    return ret;
   }
   matchFunction oldMatch = db_list->match;
   db_list->match         = match;
+  list_node_t* node      = _getDBNode(db);
+  if (node != NULL) {  // a different comparator invalidates the memo
+    ((struct oidc_db*)node->val)->generation++;
+  }
+  _db_lockRelease();
   return oldMatch;
 }
 
 freeFunction db_setFreeFunction(const db_name db, void (*free_fn)(void*)) {
+  _db_lockAcquire();
   db_init();
   list_t* db_list = db_getDB(db);
   if (db_list == NULL) {
     db_newDB(db);
-    return db_setFreeFunction(db, free_fn);
+    freeFunction ret = db_setFreeFunction(db, free_fn);
+    _db_lockRelease();
+    return ret;
   }
   freeFunction oldFree = db_list->free;
   db_list->free        = free_fn;
+  _db_lockRelease();
   return oldFree;
 }
 
+void db_setHashKeys(const db_name db, db_keyExtractor primary,
+                    db_keyExtractor secondary) {
+  _db_lockAcquire();
+  db_init();
+  db_newDB(db);
+  list_node_t*    node = _getDBNode(db);
+  struct oidc_db* db_s = node->val;
+  db_keyExtractor extractors[2] = {primary, secondary};
+  for (unsigned char i = 0; i < 2; i++) {
+    db_s->index[i].extract = extractors[i];
+    if (extractors[i] != NULL && db_s->index[i].entries == NULL) {
+      db_s->index[i].capacity = DB_HASH_INITIAL_CAPACITY;
+      db_s->index[i].entries =
+          secAlloc(db_s->index[i].capacity * sizeof(struct db_hash_entry));
+    }
+    _db_indexRebuild(db_s, &db_s->index[i]);
+  }
+  db_s->generation++;
+  _db_lockRelease();
+}
+
+void db_setFdKey(const db_name db, db_fdExtractor extract) {
+  _db_lockAcquire();
+  db_init();
+  db_newDB(db);
+  list_node_t*    node = _getDBNode(db);
+  struct oidc_db* db_s = node->val;
+  db_s->fdindex.extract = extract;
+  if (extract != NULL && db_s->fdindex.slots == NULL) {
+    db_s->fdindex.capacity = DB_FD_INITIAL_CAPACITY;
+    db_s->fdindex.slots = secAlloc(db_s->fdindex.capacity * sizeof(void*));
+  }
+  if (db_s->fdindex.slots != NULL) {
+    memset(db_s->fdindex.slots, 0, db_s->fdindex.capacity * sizeof(void*));
+    list_node_t* n;
+    LIST_FOREACH(db_s->list, n) { _db_fdInsert(&db_s->fdindex, n->val); }
+  }
+  _db_lockRelease();
+}
+
+void db_setDeathGetter(const db_name db, time_t (*getter)(void*)) {
+  _db_lockAcquire();
+  db_init();
+  db_newDB(db);
+  list_node_t*    node = _getDBNode(db);
+  struct oidc_db* db_s = node->val;
+  db_s->deathGetter    = getter;
+  if (db_s->timers == NULL && getter != NULL) {
+    db_s->timers = timerQueue_new(getter);
+    list_node_t* n;
+    LIST_FOREACH(db_s->list, n) { timerQueue_push(db_s->timers, n->val); }
+  }
+  _db_lockRelease();
+}
+
+void db_notifyDeathChange(const db_name db, void* value) {
+  _db_lockAcquire();
+  list_node_t* node = _getDBNode(db);
+  if (node != NULL) {
+    timerQueue_rekey(((struct oidc_db*)node->val)->timers, value);
+  }
+  _db_lockRelease();
+}
+
 void db_removeIfFound(const db_name db, void* value) {
+  _db_lockAcquire();
+  list_node_t* node = _getDBNode(db);
+  if (node != NULL) {  // drop the fd slot while value is still alive
+    _db_fdRemove(&((struct oidc_db*)node->val)->fdindex, value);
+    timerQueue_remove(((struct oidc_db*)node->val)->timers, value);
+  }
   list_removeIfFound(db_getDB(db), value);
+  if (node != NULL) {
+    struct oidc_db* db_s = node->val;
+    _db_indexRebuild(db_s, &db_s->index[0]);
+    _db_indexRebuild(db_s, &db_s->index[1]);
+    db_s->generation++;
+  }
+  _db_lockRelease();
 }
 
 void db_addValue(const db_name db, void* value) {
+  _db_lockAcquire();
   list_rpush(db_getDB(db), list_node_new(value));
+  list_node_t* node = _getDBNode(db);
+  if (node != NULL) {
+    struct oidc_db* db_s = node->val;
+    _db_indexInsert(&db_s->index[0], value);
+    _db_indexInsert(&db_s->index[1], value);
+    _db_fdInsert(&db_s->fdindex, value);
+    timerQueue_push(db_s->timers, value);
+    db_s->generation++;
+  }
   logger(DEBUG, "Added value to db %hhu. Now there are %lu entries.", db,
          db_getSize(db));
+  _db_lockRelease();
 }
 
 size_t db_getSize(const db_name db) {
+  _db_lockAcquire();
   list_t* dbl = db_getDB(db);
-  return dbl ? dbl->len : 0;
+  size_t  ret = dbl ? dbl->len : 0;
+  _db_lockRelease();
+  return ret;
+}
+
+/**
+ * @brief walks the db's list comparing with @p match, counting compared nodes
+ */
+static void* _db_listScan(struct oidc_db* db_s, void* key, matchFunction match,
+                          unsigned long* scanned) {
+  list_node_t* node;
+  LIST_FOREACH(db_s->list, node) {
+    if (scanned != NULL) {
+      (*scanned)++;
+    }
+    if (match ? match(key, node->val) : key == node->val) {
+      return node->val;
+    }
+  }
+  return NULL;
 }
 
 void* db_findValue(const db_name db, void* key) {
-  list_node_t* node = findInList(db_getDB(db), key);
-  return node ? node->val : NULL;
+  _db_lockAcquire();
+  void*        ret    = NULL;
+  list_node_t* dbnode = _getDBNode(db);
+  if (dbnode != NULL) {
+    struct oidc_db* db_s  = dbnode->val;
+    matchFunction   match = db_s->list->match;
+    db_s->stats.lookups++;
+    void* memo = _db_memoFind(db_s, key, match);
+    if (memo != NULL) {
+      db_s->stats.memo_hits++;
+      db_s->stats.hits++;
+      _db_lockRelease();
+      return memo;
+    }
+    ret = _db_fdFind(&db_s->fdindex, key, match)
+              ?: _db_indexFind(&db_s->index[0], key, match,
+                               &db_s->stats.probes)
+                     ?: _db_indexFind(&db_s->index[1], key, match,
+                                      &db_s->stats.probes);
+    if (ret != NULL) {
+      db_s->stats.index_hits++;
+    } else {
+      db_s->stats.list_scans++;
+      ret = _db_listScan(db_s, key, match, &db_s->stats.scanned);
+    }
+    if (ret != NULL) {
+      db_s->stats.hits++;
+      _db_memoStore(db_s, key, ret);
+    }
+  } else {
+    list_node_t* node = findInList(db_getDB(db), key);
+    ret               = node ? node->val : NULL;
+  }
+  _db_lockRelease();
+  return ret;
 }
 
 list_t* db_findAllValues(const db_name db, void* key) {
-  return findAllInList(db_getDB(db), key);
+  _db_lockAcquire();
+  list_t* ret = findAllInList(db_getDB(db), key);
+  _db_lockRelease();
+  return ret;
 }
 
 void* db_findValueWithFunction(const db_name db, void* key,
                                matchFunction match) {
-  matchFunction oldMatch = db_setMatchFunction(db, match);
-  void*         ret      = db_findValue(db, key);
-  db_setMatchFunction(db, oldMatch);
+  _db_lockAcquire();
+  void*        ret    = NULL;
+  list_node_t* dbnode = _getDBNode(db);
+  if (dbnode != NULL) {  // the comparator is passed through directly; the
+                         // installed match function is neither swapped nor
+                         // written
+    struct oidc_db* db_s = dbnode->val;
+    db_s->stats.lookups++;
+    ret = _db_fdFind(&db_s->fdindex, key, match)
+              ?: _db_indexFind(&db_s->index[0], key, match,
+                               &db_s->stats.probes)
+                     ?: _db_indexFind(&db_s->index[1], key, match,
+                                      &db_s->stats.probes);
+    if (ret != NULL) {
+      db_s->stats.index_hits++;
+    } else {
+      db_s->stats.list_scans++;
+      ret = _db_listScan(db_s, key, match, &db_s->stats.scanned);
+    }
+    if (ret != NULL) {
+      db_s->stats.hits++;
+    }
+  }
+  _db_lockRelease();
   return ret;
 }
 
 void db_reset(const db_name db) {
+  _db_lockAcquire();
   list_node_t* node = _getDBNode(db);
   if (node == NULL) {
+    _db_lockRelease();
     return;
   }
   struct oidc_db* db_s   = node->val;
@@ -119,12 +573,104 @@ void db_reset(const db_name db) {
   db_s->list        = list_new();
   db_s->list->match = match;
   db_s->list->free  = free_fn;
+  _db_indexRebuild(db_s, &db_s->index[0]);
+  _db_indexRebuild(db_s, &db_s->index[1]);
+  if (db_s->fdindex.slots != NULL) {
+    memset(db_s->fdindex.slots, 0, db_s->fdindex.capacity * sizeof(void*));
+  }
+  timerQueue_clear(db_s->timers);
+  db_s->generation++;
+  _db_lockRelease();
 }
 
 time_t db_getMinDeath(const db_name db, time_t (*deathGetter)(void*)) {
-  return getMinDeathFrom(db_getDB(db), deathGetter);
+  _db_lockAcquire();
+  time_t       ret  = 0;
+  list_node_t* node = _getDBNode(db);
+  struct oidc_db* db_s = node != NULL ? node->val : NULL;
+  if (db_s != NULL && db_s->timers != NULL &&
+      db_s->deathGetter == deathGetter) {
+    ret = timerQueue_nextDeath(db_s->timers);
+  } else {
+    ret = getMinDeathFrom(db_getDB(db), deathGetter);
+  }
+  _db_lockRelease();
+  return ret;
+}
+
+static const char* _db_nameString(db_name db) {
+  switch (db) {
+    case OIDC_DB_CONNECTIONS: return "connections";
+    case OIDC_DB_ACCOUNTS: return "accounts";
+    case OIDC_DB_PASSWORDS: return "passwords";
+    case OIDC_DB_CODEVERIFIERS: return "codeverifiers";
+    default: return "unknown";
+  }
+}
+
+/**
+ * @brief estimates the memory held by a db's bookkeeping structures
+ *
+ * Covers the list nodes, the index tables and the timer heap; the stored
+ * values themselves are opaque and not included.
+ */
+static size_t _db_footprint(const struct oidc_db* db_s) {
+  size_t bytes = sizeof(struct oidc_db);
+  if (db_s->list != NULL) {
+    bytes += sizeof(list_t) + db_s->list->len * sizeof(list_node_t);
+  }
+  for (unsigned char i = 0; i < 2; i++) {
+    bytes += db_s->index[i].capacity * sizeof(struct db_hash_entry);
+  }
+  bytes += db_s->fdindex.capacity * sizeof(void*);
+  bytes += timerQueue_footprint(db_s->timers);
+  return bytes;
+}
+
+char* db_storeInfoToJSON() {
+  _db_lockAcquire();
+  char*         json  = oidc_strcopy("{");
+  unsigned char first = 1;
+  list_node_t*  node;
+  LIST_FOREACH(dbs, node) {
+    struct oidc_db* db_s = node->val;
+    double          avgProbe =
+        db_s->stats.lookups
+                     ? (double)db_s->stats.probes / db_s->stats.lookups
+                     : 0.;
+    double avgScan = db_s->stats.list_scans
+                         ? (double)db_s->stats.scanned / db_s->stats.list_scans
+                         : 0.;
+    char* tmp = oidc_sprintf(
+        "%s%s\"%s\":{\"entries\":%lu,\"bytes\":%lu,\"lookups\":%lu,"
+        "\"hits\":%lu,\"memo_hits\":%lu,\"index_hits\":%lu,"
+        "\"list_scans\":%lu,\"avg_probe_len\":%.2f,\"avg_scan_len\":%.2f}",
+        json, first ? "" : ",", _db_nameString(db_s->db),
+        (unsigned long)(db_s->list ? db_s->list->len : 0),
+        (unsigned long)_db_footprint(db_s), db_s->stats.lookups,
+        db_s->stats.hits, db_s->stats.memo_hits, db_s->stats.index_hits,
+        db_s->stats.list_scans, avgProbe, avgScan);
+    secFree(json);
+    json  = tmp;
+    first = 0;
+  }
+  _db_lockRelease();
+  char* ret = oidc_strcat(json, "}");
+  secFree(json);
+  return ret;
 }
 
 void* db_getDeathEntry(const db_name db, time_t (*deathGetter)(void*)) {
-  return getDeathElementFrom(db_getDB(db), deathGetter);
+  _db_lockAcquire();
+  void*        ret  = NULL;
+  list_node_t* node = _getDBNode(db);
+  struct oidc_db* db_s = node != NULL ? node->val : NULL;
+  if (db_s != NULL && db_s->timers != NULL &&
+      db_s->deathGetter == deathGetter) {
+    ret = timerQueue_getExpired(db_s->timers);
+  } else {
+    ret = getDeathElementFrom(db_getDB(db), deathGetter);
+  }
+  _db_lockRelease();
+  return ret;
 }
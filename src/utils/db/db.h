@@ -12,7 +12,26 @@ typedef unsigned short db_name;
 #define OIDC_DB_PASSWORDS 3
 #define OIDC_DB_CODEVERIFIERS 4
 
+/**
+ * Extracts the string key a value should be hash-indexed under; returns
+ * @c NULL if the value has no such key. Called for stored values as well as
+ * for the key structs passed to @c db_findValue.
+ */
+typedef const char* (*db_keyExtractor)(void*);
+
+/**
+ * Extracts the file descriptor a value should be indexed under; returns a
+ * negative value if the value has no fd. Called for stored values as well as
+ * for the key structs passed to @c db_findValue.
+ */
+typedef int (*db_fdExtractor)(void*);
+
 void          db_newDB(const db_name db);
+void          db_setHashKeys(const db_name db, db_keyExtractor primary,
+                             db_keyExtractor secondary);
+void          db_setFdKey(const db_name db, db_fdExtractor extract);
+void          db_setDeathGetter(const db_name db, time_t (*getter)(void*));
+void          db_notifyDeathChange(const db_name db, void* value);
 list_t*       db_getDB(const db_name db);
 matchFunction db_setMatchFunction(const db_name db, matchFunction);
 freeFunction  db_setFreeFunction(const db_name db, freeFunction);
@@ -26,4 +45,11 @@ void   db_reset(const db_name db);
 time_t db_getMinDeath(const db_name db, time_t (*deathGetter)(void*));
 void*  db_getDeathEntry(const db_name db, time_t (*deathGetter)(void*));
 
+/**
+ * @brief builds a json object with per-db size, footprint and lookup stats
+ * Only covers the dbs living in the calling process.
+ * @return a pointer to the json string. Has to be freed after usage.
+ */
+char* db_storeInfoToJSON();
+
 #endif  // OIDC_DB_H
@@ -12,6 +12,9 @@
 #define passwordDB_setFreeFunction(free) \
   db_setFreeFunction(OIDC_DB_PASSWORDS, (free))
 
+#define passwordDB_setDeathGetter(getter) \
+  db_setDeathGetter(OIDC_DB_PASSWORDS, (getter))
+
 #define passwordDB_removeIfFound(value) \
   do { db_removeIfFound(OIDC_DB_PASSWORDS, (value)); } while (0)
 
@@ -14,10 +14,9 @@ time_t getMinDeathFrom(list_t* list, time_t (*deathGetter)(void*)) {
     oidc_setArgNullFuncError(__func__);
     return 0;
   }
-  time_t           min = 0;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(list, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
+  time_t       min = 0;
+  list_node_t* node;
+  LIST_FOREACH(list, node) {
     void*  elem  = node->val;
     time_t death = deathGetter(elem);
     logger(DEBUG, "this death is %lu", death);
@@ -26,7 +25,6 @@ time_t getMinDeathFrom(list_t* list, time_t (*deathGetter)(void*)) {
       min = death;
     }
   }
-  list_iterator_destroy(it);
   logger(DEBUG, "Minimum death in list is %lu", min);
   return min;
 }
@@ -36,19 +34,16 @@ void* getDeathElementFrom(list_t* list, time_t (*deathGetter)(void*)) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  list_node_t*     node;
-  list_iterator_t* it  = list_iterator_new(list, LIST_HEAD);
-  time_t           now = time(NULL);
-  while ((node = list_iterator_next(it))) {
+  list_node_t* node;
+  time_t       now = time(NULL);
+  LIST_FOREACH(list, node) {
     void*  elem  = node->val;
     time_t death = deathGetter(elem);
     if (death > 0 && death <= now) {
-      list_iterator_destroy(it);
       logger(DEBUG, "Found element died at %lu (current time %lu)", death, now);
       return elem;
     }
   }
-  list_iterator_destroy(it);
   logger(DEBUG, "Found no death element");
   return NULL;
 }
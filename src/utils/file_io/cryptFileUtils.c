@@ -1,10 +1,15 @@
 #include "cryptFileUtils.h"
-#include "list/list.h"
+#include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
 #include "utils/file_io/file_io.h"
+#include "utils/file_io/fileUtils.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
 
+#include <pthread.h>
+#include <unistd.h>
+
 /**
  * @brief encrypts and writes a given text with the given password.
  * @param text the text to be encrypted
@@ -18,14 +23,15 @@ oidc_error_t encryptAndWriteToFile(const char* text, const char* filepath,
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  char* toWrite = encryptWithVersionLine(text, password);
+  size_t         len     = 0;
+  unsigned char* toWrite = crypt_encryptBinary(text, password, &len);
   if (toWrite == NULL) {
     return oidc_errno;
   }
   logger(DEBUG, "Write to file %s", filepath);
-  writeFile(filepath, toWrite);
+  oidc_error_t ret = writeFileBinary(filepath, (char*)toWrite, len);
   secFree(toWrite);
-  return OIDC_SUCCESS;
+  return ret;
 }
 
 oidc_error_t encryptAndWriteToOidcFile(const char* text, const char* filename,
@@ -68,11 +74,92 @@ char* decryptFile(const char* filepath, const char* password) {
   if (!fileDoesExist(filepath)) {
     return NULL;
   }
-  list_t* lines = getLinesFromFile(filepath);
-  if (lines == NULL) {
+  size_t      size    = 0;
+  const char* content = readFileCachedBinaryPinned(filepath, &size);
+  if (content == NULL) {
     return NULL;
   }
-  char* ret = decryptLinesList(lines, password);
-  list_destroy(lines);
+  char* ret;
+  if (crypt_isBinaryCipher(content)) {
+    // decrypt straight out of the pinned cache buffer - the plaintext is
+    // the only allocation this branch makes
+    ret = crypt_decryptBinary((const unsigned char*)content, size, password);
+    fileCacheUnpin(content);
+  } else {  // legacy formats need a mutable copy to split into line views
+    char* copy = oidc_strcopy(content);
+    fileCacheUnpin(content);
+    list_t* lines = delimitedStringToViewList(copy, '\n');
+    ret           = decryptLinesList(lines, password);
+    list_destroy(lines);
+    secFree(copy);
+  }
   return ret;
 }
+
+struct decryptPool {
+  struct decryptFileJob* jobs;
+  size_t                 numJobs;
+  size_t                 next;
+  pthread_mutex_t        lock;
+};
+
+static void* _decryptWorker(void* arg) {
+  struct decryptPool* pool = arg;
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    size_t i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (i >= pool->numJobs) {
+      return NULL;
+    }
+    if (pool->jobs[i].content == NULL && pool->jobs[i].filepath == NULL) {
+      continue;  // nothing to decrypt; the result stays NULL
+    }
+    pool->jobs[i].result =
+        pool->jobs[i].content != NULL
+            ? decryptFileContent(pool->jobs[i].content, pool->jobs[i].password)
+            : decryptFile(pool->jobs[i].filepath, pool->jobs[i].password);
+  }
+}
+
+/**
+ * @brief decrypts several independent files on a thread pool sized to cores
+ *
+ * The key derivation dominates the per-file cost, so decrypting the files
+ * concurrently cuts the wall time for bulk loads roughly by the core count.
+ * Jobs that fail just leave their @c result @c NULL; the caller should retry
+ * them serially so the user can be prompted and @c oidc_errno (which is
+ * shared between the workers) is set reliably.
+ */
+void decryptFilesParallel(struct decryptFileJob* jobs, size_t numJobs) {
+  if (jobs == NULL || numJobs == 0) {
+    return;
+  }
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) {
+    cores = 1;
+  }
+  size_t numThreads = (size_t)cores < numJobs ? (size_t)cores : numJobs;
+  if (numThreads <= 1) {
+    struct decryptPool pool = {
+        .jobs = jobs, .numJobs = numJobs, .lock = PTHREAD_MUTEX_INITIALIZER};
+    _decryptWorker(&pool);
+    return;
+  }
+  logger(DEBUG, "Decrypting %lu files on %lu threads", numJobs, numThreads);
+  struct decryptPool pool = {
+      .jobs = jobs, .numJobs = numJobs, .lock = PTHREAD_MUTEX_INITIALIZER};
+  pthread_t threads[numThreads];
+  size_t    started = 0;
+  for (size_t i = 0; i < numThreads; i++) {
+    if (pthread_create(&threads[i], NULL, _decryptWorker, &pool) != 0) {
+      break;
+    }
+    started++;
+  }
+  if (started == 0) {  // could not spawn any worker; decrypt on this thread
+    _decryptWorker(&pool);
+    return;
+  }
+  for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+}
@@ -3,11 +3,28 @@
 
 #include "utils/oidc_error.h"
 
+#include <stddef.h>
+
+/**
+ * One decryption to be done by @c decryptFilesParallel. The ciphertext is
+ * either read from @c filepath or - if @c content is set - taken from
+ * memory, e.g. a config blob carried in a bulk load request. @c result is
+ * filled with the decrypted content (Has to be freed after usage) or
+ * @c NULL if the decryption failed.
+ */
+struct decryptFileJob {
+  const char* filepath;
+  const char* content;
+  const char* password;
+  char*       result;
+};
+
 oidc_error_t encryptAndWriteToFile(const char* text, const char* filepath,
                                    const char* password);
 oidc_error_t encryptAndWriteToOidcFile(const char* text, const char* filename,
                                        const char* password);
 char*        decryptFile(const char* filepath, const char* password);
 char*        decryptOidcFile(const char* filename, const char* password);
+void         decryptFilesParallel(struct decryptFileJob* jobs, size_t numJobs);
 
 #endif  // CRYPT_FILE_UTILS_H
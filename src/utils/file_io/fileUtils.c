@@ -1,5 +1,7 @@
 #include "fileUtils.h"
+#include "file_io.h"
 #include "oidc_file_io.h"
+#include "oidc_index.h"
 #include "utils/crypt/crypt.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
@@ -9,10 +11,336 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <grp.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/*
+ * File-content cache. oidc-gen and the prompt flows read the same files under
+ * the oidc dir (clientconfigs, issuer.config, pubclients.config) many times
+ * per session and oidcd's autoload re-reads account configs on every trigger;
+ * repeated reads are served from memory instead. Entries are invalidated by
+ * inotify where available (a rename over a watched file - what the atomic
+ * writes do - drops its watch) and by a stat check on mtime/size/inode
+ * otherwise. The cache is cleared when the pid changes so the oidcp/oidcd
+ * split does not share watch descriptors across the fork.
+ */
+
+#define FILE_CACHE_MAX_ENTRIES 32
+
+struct cachedFile {
+  char*        path;
+  char*        content;  // one NUL byte appended past len
+  size_t       len;
+  unsigned int pins;  // pinned readers; pinned content outlives the entry
+  int    wd;  // inotify watch descriptor; -1 means stat-based validation
+  time_t mtime;
+  off_t  size;
+  ino_t  ino;
+};
+
+static list_t*         file_cache         = NULL;
+static list_t*         file_cache_orphans = NULL;
+static pthread_mutex_t file_cache_lock    = PTHREAD_MUTEX_INITIALIZER;
+static pid_t           file_cache_pid     = 0;
+#ifdef __linux__
+static int file_cache_inotify = -1;
+#endif
+
+static void _secFreeCachedFile(struct cachedFile* entry) {
+  if (entry == NULL) {
+    return;
+  }
+#ifdef __linux__
+  if (entry->wd >= 0 && file_cache_inotify >= 0) {
+    inotify_rm_watch(file_cache_inotify, entry->wd);
+  }
+#endif
+  secFree(entry->path);
+  secFree(entry->content);
+  secFree(entry);
+}
+
+static int _cachedFileMatchPath(const char*              path,
+                                const struct cachedFile* entry) {
+  return strequal(path, entry->path);
+}
+
+static void _fileCacheInit() {
+  if (file_cache_pid != getpid()) {  // initial call or forked child
+    if (file_cache != NULL) {
+      secFreeList(file_cache);
+      file_cache = NULL;
+    }
+    if (file_cache_orphans != NULL) {  // no pinned reader survives a fork
+      secFreeList(file_cache_orphans);
+      file_cache_orphans = NULL;
+    }
+#ifdef __linux__
+    if (file_cache_inotify >= 0) {
+      close(file_cache_inotify);
+      file_cache_inotify = -1;
+    }
+#endif
+    file_cache_pid = getpid();
+  }
+  if (file_cache == NULL) {
+    file_cache        = list_new();
+    file_cache->free  = (void (*)(void*)) & _secFreeCachedFile;
+    file_cache->match = (matchFunction)_cachedFileMatchPath;
+#ifdef __linux__
+    file_cache_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  }
+}
+
+/**
+ * @brief removes @p node from the cache without invalidating pinned content
+ * An entry whose content is currently pinned is moved to the orphan list
+ * instead of being freed; @c fileCacheUnpin frees it with the last pin.
+ */
+static void _fileCacheRemoveNode(list_node_t* node) {
+  struct cachedFile* entry = node->val;
+  if (entry->pins > 0) {
+    if (file_cache_orphans == NULL) {
+      file_cache_orphans       = list_new();
+      file_cache_orphans->free = (void (*)(void*)) & _secFreeCachedFile;
+    }
+    list_rpush(file_cache_orphans, list_node_new(entry));
+    node->val = NULL;
+  }
+  list_remove(file_cache, node);
+}
+
+#ifdef __linux__
+static void _fileCacheRemoveWd(int wd) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(file_cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct cachedFile* entry = node->val;
+    if (entry->wd == wd) {
+      entry->wd = -1;  // the kernel already dropped the watch
+      list_iterator_destroy(it);
+      _fileCacheRemoveNode(node);
+      return;
+    }
+  }
+  list_iterator_destroy(it);
+}
+#endif
+
+/**
+ * @brief drops cache entries whose files changed since they were read
+ */
+static void _fileCacheDrainEvents() {
+#ifdef __linux__
+  if (file_cache_inotify < 0) {
+    return;
+  }
+  char    buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(file_cache_inotify, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + len;) {
+      const struct inotify_event* event = (const struct inotify_event*)p;
+      _fileCacheRemoveWd(event->wd);
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+#endif
+}
+
+/**
+ * @brief checks a stat-validated entry against the file on disk
+ * @return 1 if the cached content is still current, 0 if not
+ */
+static int _cachedFileStatMatches(const struct cachedFile* entry) {
+  struct stat st;
+  if (stat(entry->path, &st) != 0) {
+    return 0;
+  }
+  return st.st_mtime == entry->mtime && st.st_size == entry->size &&
+         st.st_ino == entry->ino;
+}
+
+/**
+ * @brief looks up (or loads) the cache entry for @p path
+ * Must be called with @c file_cache_lock held.
+ * @return the current entry; @c NULL on read failure
+ */
+static struct cachedFile* _fileCacheLookup(const char* path) {
+  _fileCacheInit();
+  _fileCacheDrainEvents();
+  list_node_t*       node  = findInList(file_cache, path);
+  struct cachedFile* entry = node ? node->val : NULL;
+  if (entry != NULL && entry->wd < 0 && !_cachedFileStatMatches(entry)) {
+    _fileCacheRemoveNode(node);
+    entry = NULL;
+  }
+  if (entry == NULL) {
+    size_t len     = 0;
+    char*  content = readFileStat(path, &len);
+    if (content == NULL) {
+      return NULL;
+    }
+    entry          = secAlloc(sizeof(struct cachedFile));
+    entry->path    = oidc_strcopy(path);
+    entry->content = content;
+    entry->len     = len;
+    entry->wd      = -1;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+      entry->mtime = st.st_mtime;
+      entry->size  = st.st_size;
+      entry->ino   = st.st_ino;
+    }
+#ifdef __linux__
+    if (file_cache_inotify >= 0) {
+      entry->wd = inotify_add_watch(file_cache_inotify, path,
+                                    IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                        IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+#endif
+    if (file_cache->len >= FILE_CACHE_MAX_ENTRIES) {
+      _fileCacheRemoveNode(file_cache->head);
+    }
+    list_rpush(file_cache, list_node_new(entry));
+  }
+  return entry;
+}
+
+/**
+ * @brief reads a file through the file-content cache
+ * Repeated reads of the same unchanged file are served from memory; see the
+ * cache description above for how entries are invalidated.
+ * @param path the file to be read
+ * @param size if not @c NULL, filled with the number of bytes read
+ * @return a copy of the file content with one NUL byte appended past
+ * @p size. Has to be freed after usage. On failure @c NULL is returned and
+ * oidc_errno is set.
+ */
+char* readFileCachedBinary(const char* path, size_t* size) {
+  if (path == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  pthread_mutex_lock(&file_cache_lock);
+  struct cachedFile* entry = _fileCacheLookup(path);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&file_cache_lock);
+    return NULL;
+  }
+  char* ret = secAlloc(entry->len + 1);
+  memcpy(ret, entry->content, entry->len);
+  if (size != NULL) {
+    *size = entry->len;
+  }
+  pthread_mutex_unlock(&file_cache_lock);
+  return ret;
+}
+
+/**
+ * @brief reads a file through the file-content cache without copying
+ * The returned pointer is the cache's own buffer, pinned so that cache
+ * invalidation and eviction cannot free it; it stays valid - but possibly
+ * stale - until it is released with @c fileCacheUnpin. Use this instead of
+ * @c readFileCachedBinary when the content is only consumed and the copy
+ * would be thrown away right after, e.g. for decryption.
+ * @param path the file to be read
+ * @param size if not @c NULL, filled with the number of bytes read
+ * @return the cached file content with one NUL byte appended past @p size.
+ * Has to be released with @c fileCacheUnpin after usage - not freed. On
+ * failure @c NULL is returned and oidc_errno is set.
+ */
+const char* readFileCachedBinaryPinned(const char* path, size_t* size) {
+  if (path == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  pthread_mutex_lock(&file_cache_lock);
+  struct cachedFile* entry = _fileCacheLookup(path);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&file_cache_lock);
+    return NULL;
+  }
+  entry->pins++;
+  if (size != NULL) {
+    *size = entry->len;
+  }
+  pthread_mutex_unlock(&file_cache_lock);
+  return entry->content;
+}
+
+/**
+ * @brief releases a pin obtained from @c readFileCachedBinaryPinned
+ * @param content the pointer returned by the pinned read; may be @c NULL
+ */
+void fileCacheUnpin(const char* content) {
+  if (content == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&file_cache_lock);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(file_cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct cachedFile* entry = node->val;
+    if (entry->content == content && entry->pins > 0) {
+      entry->pins--;
+      list_iterator_destroy(it);
+      pthread_mutex_unlock(&file_cache_lock);
+      return;
+    }
+  }
+  list_iterator_destroy(it);
+  if (file_cache_orphans != NULL) {
+    it = list_iterator_new(file_cache_orphans, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      struct cachedFile* entry = node->val;
+      if (entry->content == content) {
+        if (--entry->pins == 0) {
+          list_iterator_destroy(it);
+          list_remove(file_cache_orphans, node);
+          pthread_mutex_unlock(&file_cache_lock);
+          return;
+        }
+        break;
+      }
+    }
+    list_iterator_destroy(it);
+  }
+  pthread_mutex_unlock(&file_cache_lock);
+}
+
+/**
+ * @brief reads a text file through the file-content cache
+ * @param path the file to be read
+ * @return a copy of the file content. Has to be freed after usage. On failure
+ * @c NULL is returned and oidc_errno is set.
+ */
+char* readFileCached(const char* path) {
+  return readFileCachedBinary(path, NULL);
+}
+
+/**
+ * @brief drops all cached file contents
+ * Pinned content is orphaned and freed with its last pin; the next read of
+ * any file goes back to disk. Used by the memory-pressure reclamation.
+ */
+void fileCache_drop() {
+  pthread_mutex_lock(&file_cache_lock);
+  if (file_cache != NULL) {
+    list_node_t* node;
+    while ((node = list_at(file_cache, 0)) != NULL) {
+      _fileCacheRemoveNode(node);
+    }
+  }
+  pthread_mutex_unlock(&file_cache_lock);
+}
 
 /**
  * @brief checks if the oidc directory exists
@@ -36,35 +364,155 @@ void assertOidcDirExists() {
   }
 }
 
-list_t* getFileListForDirIf(const char* dirname,
-                            int(match(const char*, const char*)),
-                            const char* arg) {
-  DIR*           dir;
+/*
+ * Directory snapshots. Tab-completion, `oidc-add -l` and the gen prompts
+ * enumerate the configs under the oidc dir repeatedly; instead of a fresh
+ * readdir plus a list of copied filenames per call, a directory is scanned
+ * once into a contiguous, sorted name arena that is only rescanned when the
+ * directory mtime changes. Iteration over a snapshot does not allocate.
+ */
+
+struct dirSnapshotEntry {
+  char*              dirname;
+  time_t             mtime;
+  struct dirSnapshot view;
+};
+
+static list_t*         dir_snapshots     = NULL;
+static pthread_mutex_t dir_snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _secFreeDirSnapshotEntry(struct dirSnapshotEntry* entry) {
+  secFree(entry->dirname);
+  _secFree((char*)entry->view.names);
+  _secFree((size_t*)entry->view.offsets);
+  secFree(entry);
+}
+
+static int _dirSnapshotMatchDirname(const char*                    dirname,
+                                    const struct dirSnapshotEntry* entry) {
+  return strequal(dirname, entry->dirname);
+}
+
+static const char* _dirSnapshotSortArena = NULL;
+
+static int _compareNameOffsets(const void* a, const void* b) {
+  return strcmp(_dirSnapshotSortArena + *(const size_t*)a,
+                _dirSnapshotSortArena + *(const size_t*)b);
+}
+
+/**
+ * @brief scans @p dirname into @p entry's name arena
+ * @return @c OIDC_SUCCESS on success, an oidc_error code otherwise
+ */
+static oidc_error_t _dirSnapshotScan(struct dirSnapshotEntry* entry) {
+  DIR* dir = opendir(entry->dirname);
+  if (dir == NULL) {
+    oidc_seterror(strerror(errno));
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  struct stat st;
+  entry->mtime = stat(entry->dirname, &st) == 0 ? st.st_mtime : 0;
+  size_t  names_cap   = 1024;
+  size_t  names_len   = 0;
+  size_t  offsets_cap = 32;
+  size_t  count       = 0;
+  char*   names       = secAlloc(names_cap);
+  size_t* offsets     = secAlloc(offsets_cap * sizeof(size_t));
   struct dirent* ent;
-  if ((dir = opendir(dirname)) != NULL) {
-    list_t* list = list_new();
-    list->free   = (void (*)(void*)) & _secFree;
-    list->match  = (matchFunction)strequal;
-    while ((ent = readdir(dir)) != NULL) {
-      if (!strequal(ent->d_name, ".") && !strequal(ent->d_name, "..")) {
-#ifdef _DIRENT_HAVE_DTYPE
-        if (ent->d_type == DT_REG) {
-#endif
-          if (match(ent->d_name, arg)) {
-            list_rpush(list, list_node_new(oidc_strcopy(ent->d_name)));
-          }
+  while ((ent = readdir(dir)) != NULL) {
+    if (strequal(ent->d_name, ".") || strequal(ent->d_name, "..")) {
+      continue;
+    }
 #ifdef _DIRENT_HAVE_DTYPE
-        }
+    if (ent->d_type != DT_REG) {
+      continue;
+    }
 #endif
-      }
+    size_t len = strlen(ent->d_name) + 1;
+    while (names_len + len > names_cap) {
+      names_cap *= 2;
+      names = secRealloc(names, names_cap);
+    }
+    if (count == offsets_cap) {
+      offsets_cap *= 2;
+      offsets = secRealloc(offsets, offsets_cap * sizeof(size_t));
+    }
+    memcpy(names + names_len, ent->d_name, len);
+    offsets[count++] = names_len;
+    names_len += len;
+  }
+  closedir(dir);
+  _dirSnapshotSortArena = names;
+  qsort(offsets, count, sizeof(size_t), _compareNameOffsets);
+  _secFree((char*)entry->view.names);
+  _secFree((size_t*)entry->view.offsets);
+  entry->view.names   = names;
+  entry->view.offsets = offsets;
+  entry->view.count   = count;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns a snapshot of the regular files in @p dirname
+ * The snapshot is cached and only rescanned when the directory mtime
+ * changes; the names are sorted. The returned pointer is owned by the cache
+ * and stays valid until the next call for the same directory, so it must
+ * not be held across calls that can rescan.
+ * @return a pointer to the snapshot, or @c NULL if the directory cannot be
+ * read (oidc_errno is set)
+ */
+const struct dirSnapshot* getDirSnapshot(const char* dirname) {
+  if (dirname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  pthread_mutex_lock(&dir_snapshot_lock);
+  if (dir_snapshots == NULL) {
+    dir_snapshots        = list_new();
+    dir_snapshots->free  = (void (*)(void*)) & _secFreeDirSnapshotEntry;
+    dir_snapshots->match = (matchFunction)_dirSnapshotMatchDirname;
+  }
+  list_node_t*             node  = findInList(dir_snapshots, dirname);
+  struct dirSnapshotEntry* entry = node ? node->val : NULL;
+  if (entry != NULL) {
+    struct stat st;
+    if (stat(dirname, &st) == 0 && st.st_mtime == entry->mtime) {
+      pthread_mutex_unlock(&dir_snapshot_lock);
+      return &entry->view;
     }
-    closedir(dir);
-    return list;
   } else {
-    oidc_seterror(strerror(errno));
-    oidc_errno = OIDC_EERROR;
+    entry          = secAlloc(sizeof(struct dirSnapshotEntry));
+    entry->dirname = oidc_strcopy(dirname);
+    list_rpush(dir_snapshots, list_node_new(entry));
+    node = dir_snapshots->tail;
+  }
+  if (_dirSnapshotScan(entry) != OIDC_SUCCESS) {
+    list_remove(dir_snapshots, node);
+    pthread_mutex_unlock(&dir_snapshot_lock);
     return NULL;
   }
+  pthread_mutex_unlock(&dir_snapshot_lock);
+  return &entry->view;
+}
+
+list_t* getFileListForDirIf(const char* dirname,
+                            int(match(const char*, const char*)),
+                            const char* arg) {
+  const struct dirSnapshot* snapshot = getDirSnapshot(dirname);
+  if (snapshot == NULL) {
+    return NULL;
+  }
+  list_t* list = list_new();
+  list->free   = (void (*)(void*)) & _secFree;
+  list->match  = (matchFunction)strequal;
+  for (size_t i = 0; i < snapshot->count; i++) {
+    const char* name = dirSnapshot_name(snapshot, i);
+    if (match(name, arg)) {
+      list_rpush(list, list_node_new(oidc_strcopy(name)));
+    }
+  }
+  return list;
 }
 
 int alwaysOne(const char* a __attribute__((unused)),
@@ -108,6 +556,12 @@ int isAccountConfigFile(const char* filename,
 }
 
 list_t* getAccountConfigFileList() {
+  list_t* indexed = oidcIndex_accountList();  // one mmap instead of a
+                                              // readdir; falls back when the
+                                              // index is missing or stale
+  if (indexed != NULL) {
+    return indexed;
+  }
   char*   oidc_dir = getOidcDir();
   list_t* list     = getFileListForDirIf(oidc_dir, &isAccountConfigFile, NULL);
   secFree(oidc_dir);
@@ -7,6 +7,33 @@
 void assertOidcDirExists();
 void checkOidcDirExists();
 
+char* readFileCached(const char* path);
+char* readFileCachedBinary(const char* path, size_t* size);
+const char* readFileCachedBinaryPinned(const char* path, size_t* size);
+void        fileCacheUnpin(const char* content);
+void        fileCache_drop();
+
+/**
+ * A sorted snapshot of the regular files in a directory: all names live in
+ * one contiguous NUL-separated arena and are addressed by offset, so
+ * iterating does not allocate. See @c getDirSnapshot.
+ */
+struct dirSnapshot {
+  const char*   names;
+  const size_t* offsets;
+  size_t        count;
+};
+#define dirSnapshot_name(s, i) ((s)->names + (s)->offsets[(i)])
+
+const struct dirSnapshot* getDirSnapshot(const char* dirname);
+
+int isAccountConfigFile(const char* filename, const char* a);
+int isClientConfigFile(const char* filename, const char* a);
+
+list_t* getFileListForDirIf(const char* dirname,
+                            int(match(const char*, const char*)),
+                            const char* arg);
+
 list_t* getAccountConfigFileList();
 list_t* getClientConfigFileList();
 
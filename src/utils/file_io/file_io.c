@@ -1,5 +1,7 @@
 #define _XOPEN_SOURCE 700
 #include "file_io.h"
+#include "defines/settings.h"
+#include "file_io_metrics.h"
 #include "list/list.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
@@ -7,6 +9,7 @@
 #include "utils/stringUtils.h"
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -57,6 +60,7 @@ char* readFILE(FILE* fp) {
  */
 char* readFile(const char* path) {
   logger(DEBUG, "Reading file: %s", path);
+  unsigned long t0 = file_io_metrics_start();
 
   FILE* fp = fopen(path, "rb");
   if (!fp) {
@@ -67,9 +71,107 @@ char* readFile(const char* path) {
 
   char* ret = readFILE(fp);
   fclose(fp);
+  if (t0 != 0) {
+    file_io_metrics_record(path, FILE_IO_OP_READ,
+                           ret != NULL ? strlen(ret) : 0, t0);
+  }
   return ret;
 }
 
+/**
+ * @brief reads a file of arbitrary - also binary - content
+ * @param path the file to be read
+ * @param size filled with the number of bytes read
+ * @return a pointer to the file content; one NUL byte is appended past
+ * @p size so text files can also be used as strings. Has to be freed after
+ * usage. On failure @c NULL is returned and oidc_errno is set.
+ */
+char* readFileBinary(const char* path, size_t* size) {
+  logger(DEBUG, "Reading file: %s", path);
+  unsigned long t0 = file_io_metrics_start();
+  FILE*         fp = fopen(path, "rb");
+  if (!fp) {
+    logger(NOTICE, "%m\n");
+    oidc_errno = OIDC_EFOPEN;
+    return NULL;
+  }
+  fseek(fp, 0L, SEEK_END);
+  long lSize = ftell(fp);
+  rewind(fp);
+  if (lSize < 0) {
+    oidc_setErrnoError();
+    logger(ERROR, "%s", oidc_serror());
+    fclose(fp);
+    return NULL;
+  }
+  char* buffer = secAlloc(lSize + 1);
+  if (lSize != 0 && 1 != fread(buffer, lSize, 1, fp)) {
+    oidc_errno = feof(fp) ? OIDC_EEOF : OIDC_EFREAD;
+    secFree(buffer);
+    logger(ERROR, "entire read failed in function %s", __func__);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  file_io_metrics_record(path, FILE_IO_OP_READ, (size_t)lSize, t0);
+  if (size != NULL) {
+    *size = (size_t)lSize;
+  }
+  return buffer;
+}
+
+/**
+ * @brief reads a file with a single allocation and a single read
+ * fstats the file, allocates the buffer once and reads the whole content in
+ * one go - no stdio buffering and no per-chunk reallocation; use this instead
+ * of @c readFile on hot paths.
+ * @param path the file to be read
+ * @param size if not @c NULL, filled with the number of bytes read
+ * @return a pointer to the file content; one NUL byte is appended past
+ * @p size so text files can also be used as strings. Has to be freed after
+ * usage. On failure @c NULL is returned and oidc_errno is set.
+ */
+char* readFileStat(const char* path, size_t* size) {
+  logger(DEBUG, "Reading file: %s", path);
+  unsigned long t0 = file_io_metrics_start();
+  int           fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    logger(NOTICE, "%m\n");
+    oidc_errno = OIDC_EFOPEN;
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    oidc_setErrnoError();
+    logger(ERROR, "%s", oidc_serror());
+    close(fd);
+    return NULL;
+  }
+  size_t len    = (size_t)st.st_size;
+  char*  buffer = secAlloc(len + 1);
+  size_t got    = 0;
+  while (got < len) {
+    ssize_t n = read(fd, buffer + got, len - got);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      oidc_errno = n == 0 ? OIDC_EEOF : OIDC_EFREAD;
+      secFree(buffer);
+      logger(ERROR, "entire read failed in function %s", __func__);
+      close(fd);
+      return NULL;
+    }
+    got += n;
+  }
+  close(fd);
+  file_io_metrics_record(path, FILE_IO_OP_READ, len, t0);
+  if (size != NULL) {
+    *size = len;
+  }
+  return buffer;
+}
+
 char* getLineFromFILE(FILE* fp) {
   char*  buf = NULL;
   size_t len = 0;
@@ -89,8 +191,69 @@ char* getLineFromFILE(FILE* fp) {
   return secFreeAblePointer;
 }
 
+/**
+ * @brief atomically replaces @p path with @p len bytes of @p data
+ * The data is written to a temporary file next to @p path which is then
+ * renamed over it, so readers never see a partially written file and a crash
+ * mid-write leaves the old content intact. If the environment variable
+ * OIDC_AGENT_FSYNC is set, the temporary file is additionally fsynced before
+ * the rename, trading write latency for durability across power loss.
+ */
+static oidc_error_t _writeAtomic(const char* path, const char* data,
+                                 size_t len) {
+  unsigned long t0       = file_io_metrics_start();
+  char*         tmp_path = oidc_sprintf("%s.tmp.XXXXXX", path);
+  int   fd       = mkstemp(tmp_path);
+  if (fd < 0) {
+    logger(ALERT, "Error opening temporary file for '%s': %m\n", path);
+    secFree(tmp_path);
+    return OIDC_EFOPEN;
+  }
+  // mkstemp creates with 0600; a replaced file keeps its mode (config files
+  // can hold encrypted credentials and may be stricter than the default), a
+  // new file gets the mode fopen("w") would have given under the umask
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    fchmod(fd, st.st_mode & 07777);
+  } else {
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+  }
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = write(fd, data + written, len - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      oidc_setErrnoError();
+      close(fd);
+      unlink(tmp_path);
+      secFree(tmp_path);
+      return oidc_errno;
+    }
+    written += n;
+  }
+  if (getenv(OIDC_FSYNC_ENV_NAME)) {
+    fsync(fd);
+  }
+  close(fd);
+  if (rename(tmp_path, path) != 0) {
+    oidc_setErrnoError();
+    logger(ALERT, "Error renaming '%s' to '%s': %m\n", tmp_path, path);
+    unlink(tmp_path);
+    secFree(tmp_path);
+    return oidc_errno;
+  }
+  secFree(tmp_path);
+  file_io_metrics_record(path, FILE_IO_OP_WRITE, len, t0);
+  return OIDC_SUCCESS;
+}
+
 /** @fn void writeFile(const char* path, const char* text)
  * @brief writes text to a file
+ * The file is replaced atomically, see @c _writeAtomic.
  * @note \p text has to be nullterminated and must not contain nullbytes.
  * @param path the file to be written
  * @param text the nullterminated text to be written
@@ -102,14 +265,23 @@ oidc_error_t writeFile(const char* path, const char* text) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  FILE* f = fopen(path, "w");
-  if (f == NULL) {
-    logger(ALERT, "Error opening file '%s' in function writeToFile().\n", path);
-    return OIDC_EFOPEN;
+  return _writeAtomic(path, text, strlen(text));
+}
+
+/**
+ * @brief writes data of arbitrary - also binary - content to a file
+ * The file is replaced atomically, see @c _writeAtomic.
+ * @param path the file to be written
+ * @param data the data to be written
+ * @param len the number of bytes to write
+ * @return OIDC_SUCCESS on success, an oidc_error code on failure.
+ */
+oidc_error_t writeFileBinary(const char* path, const char* data, size_t len) {
+  if (path == NULL || data == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
   }
-  fprintf(f, "%s", text);
-  fclose(f);
-  return OIDC_SUCCESS;
+  return _writeAtomic(path, data, len);
 }
 
 oidc_error_t appendFile(const char* path, const char* text) {
@@ -117,7 +289,8 @@ oidc_error_t appendFile(const char* path, const char* text) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  FILE* f = fopen(path, "a");
+  unsigned long t0 = file_io_metrics_start();
+  FILE*         f  = fopen(path, "a");
   if (f == NULL) {
 #ifndef __APPLE__  // logger on MAC uses this function so don't use logger if
                    // something goes wrong
@@ -127,6 +300,9 @@ oidc_error_t appendFile(const char* path, const char* text) {
   }
   fprintf(f, "%s\n", text);
   fclose(f);
+  if (t0 != 0) {
+    file_io_metrics_record(path, FILE_IO_OP_APPEND, strlen(text) + 1, t0);
+  }
   return OIDC_SUCCESS;
 }
 
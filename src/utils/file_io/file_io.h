@@ -5,8 +5,11 @@
 #include "utils/oidc_error.h"
 
 oidc_error_t writeFile(const char* filepath, const char* text);
+oidc_error_t writeFileBinary(const char* path, const char* data, size_t len);
 oidc_error_t appendFile(const char* path, const char* text);
 char*        readFile(const char* path);
+char*        readFileBinary(const char* path, size_t* size);
+char*        readFileStat(const char* path, size_t* size);
 char*        getLineFromFILE(FILE* fp);
 int          fileDoesExist(const char* path);
 int          dirExists(const char* path);
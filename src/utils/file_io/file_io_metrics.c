@@ -0,0 +1,173 @@
+#define _XOPEN_SOURCE 700
+#include "file_io_metrics.h"
+
+#include "defines/settings.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Per-path file I/O metrics.
+ *
+ * Disabled unless OIDC_AGENT_IO_TRACE is set, so regular operation pays a
+ * single cached getenv check per call. When enabled, every read, write and
+ * append in file_io.c is counted into a per-path slot holding call count,
+ * bytes and cumulative latency per operation. The table follows the
+ * http_metrics scheme: the hot path scans a fixed array whose path pointers
+ * are published with a release store, counters are relaxed atomic adds, and
+ * only registering a new path takes a mutex. The collected table is dumped
+ * as part of the metrics IPC response - this is how redundant config reads
+ * that the content caches do not cover show up.
+ */
+
+#define FILE_IO_METRICS_PATHS 64
+
+struct file_io_metrics_entry {
+  char*         path;
+  unsigned long calls[FILE_IO_OPS];
+  unsigned long bytes[FILE_IO_OPS];
+  unsigned long time_ms[FILE_IO_OPS];
+};
+
+static struct file_io_metrics_entry metrics[FILE_IO_METRICS_PATHS];
+static pthread_mutex_t              metrics_register_lock =
+    PTHREAD_MUTEX_INITIALIZER;
+
+static int _metrics_enabled() {
+  static signed char enabled = -1;
+  if (enabled < 0) {
+    enabled = getenv(OIDC_IO_TRACE_ENV_NAME) != NULL ? 1 : 0;
+  }
+  return enabled;
+}
+
+static unsigned long _now_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/**
+ * @brief starts timing a file operation
+ * @return a timer token to be passed to @c file_io_metrics_record; @c 0 when
+ * tracing is disabled, so callers can skip any work only needed for the
+ * record call
+ */
+unsigned long file_io_metrics_start() {
+  if (!_metrics_enabled()) {
+    return 0;
+  }
+  return _now_ms();
+}
+
+static struct file_io_metrics_entry* _metrics_find(const char* path) {
+  for (unsigned char i = 0; i < FILE_IO_METRICS_PATHS; i++) {
+    char* p = __atomic_load_n(&metrics[i].path, __ATOMIC_ACQUIRE);
+    if (p != NULL && strequal(p, path)) {
+      return &metrics[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief registers a slot for @p path
+ * @return the slot; @c NULL if the table is full - the path then simply
+ * stays uncounted
+ */
+static struct file_io_metrics_entry* _metrics_register(const char* path) {
+  pthread_mutex_lock(&metrics_register_lock);
+  struct file_io_metrics_entry* entry = _metrics_find(path);
+  if (entry != NULL) {  // registered concurrently
+    pthread_mutex_unlock(&metrics_register_lock);
+    return entry;
+  }
+  for (unsigned char i = 0; i < FILE_IO_METRICS_PATHS; i++) {
+    if (metrics[i].path == NULL) {
+      // publish the path last so lock-free readers only see complete slots
+      __atomic_store_n(&metrics[i].path, oidc_strcopy(path), __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&metrics_register_lock);
+      return &metrics[i];
+    }
+  }
+  pthread_mutex_unlock(&metrics_register_lock);
+  return NULL;
+}
+
+/**
+ * @brief counts a finished file operation on @p path
+ * @param op which of read / write / append was done
+ * @param bytes how many bytes were transferred
+ * @param start the token returned by @c file_io_metrics_start; @c 0 makes
+ * this a no-op
+ */
+void file_io_metrics_record(const char* path, enum file_io_op op, size_t bytes,
+                            unsigned long start) {
+  if (start == 0 || path == NULL) {
+    return;
+  }
+  unsigned long                 duration_ms = _now_ms() - start;
+  struct file_io_metrics_entry* entry       = _metrics_find(path);
+  if (entry == NULL) {
+    entry = _metrics_register(path);
+    if (entry == NULL) {
+      return;
+    }
+  }
+  __atomic_add_fetch(&entry->calls[op], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->bytes[op], bytes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->time_ms[op], duration_ms, __ATOMIC_RELAXED);
+}
+
+static char* _countersToJSONArray(const unsigned long* counters) {
+  char* arr = oidc_strcopy("[");
+  for (unsigned char op = 0; op < FILE_IO_OPS; op++) {
+    char* tmp = oidc_sprintf("%s%s%lu", arr, op == 0 ? "" : ",",
+                             __atomic_load_n(&counters[op], __ATOMIC_RELAXED));
+    secFree(arr);
+    arr = tmp;
+  }
+  char* ret = oidc_strcat(arr, "]");
+  secFree(arr);
+  return ret;
+}
+
+/**
+ * @brief dumps the collected file I/O counters
+ * @return a pointer to a JSON object string keyed by path; each entry holds
+ * [read, write, append] arrays for calls, bytes and time_ms. @c NULL when
+ * tracing is disabled. Has to be freed after usage.
+ */
+char* file_io_metrics_toJSON() {
+  if (!_metrics_enabled()) {
+    return NULL;
+  }
+  cJSON* obj = stringToJson("{}");
+  if (obj == NULL) {
+    return NULL;
+  }
+  for (unsigned char i = 0; i < FILE_IO_METRICS_PATHS; i++) {
+    char* path = __atomic_load_n(&metrics[i].path, __ATOMIC_ACQUIRE);
+    if (path == NULL) {
+      continue;
+    }
+    cJSON* e   = stringToJson("{}");
+    char*  arr = _countersToJSONArray(metrics[i].calls);
+    jsonAddArrayValue(e, "calls", arr);
+    secFree(arr);
+    arr = _countersToJSONArray(metrics[i].bytes);
+    jsonAddArrayValue(e, "bytes", arr);
+    secFree(arr);
+    arr = _countersToJSONArray(metrics[i].time_ms);
+    jsonAddArrayValue(e, "time_ms", arr);
+    secFree(arr);
+    jsonAddJSON(obj, path, e);
+  }
+  char* ret = jsonToString(obj);
+  secFreeJson(obj);
+  return ret;
+}
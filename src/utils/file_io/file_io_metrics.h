@@ -0,0 +1,18 @@
+#ifndef FILE_IO_METRICS_H
+#define FILE_IO_METRICS_H
+
+#include <stddef.h>
+
+enum file_io_op {
+  FILE_IO_OP_READ   = 0,
+  FILE_IO_OP_WRITE  = 1,
+  FILE_IO_OP_APPEND = 2,
+};
+#define FILE_IO_OPS 3
+
+unsigned long file_io_metrics_start();
+void  file_io_metrics_record(const char* path, enum file_io_op op,
+                             size_t bytes, unsigned long start);
+char* file_io_metrics_toJSON();
+
+#endif  // FILE_IO_METRICS_H
@@ -1,6 +1,8 @@
 #include "oidc_file_io.h"
 #include "defines/settings.h"
 #include "file_io.h"
+#include "fileUtils.h"
+#include "oidc_index.h"
 #include "list/list.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
@@ -18,7 +20,7 @@
  */
 char* readOidcFile(const char* filename) {
   char* path = concatToOidcDir(filename);
-  char* c    = readFile(path);
+  char* c    = readFileCached(path);
   secFree(path);
   return c;
 }
@@ -35,6 +37,9 @@ oidc_error_t writeOidcFile(const char* filename, const char* text) {
   char*        path = concatToOidcDir(filename);
   oidc_error_t er   = writeFile(path, text);
   secFree(path);
+  if (er == OIDC_SUCCESS) {
+    oidcIndex_update(filename);  // no-op for non account config files
+  }
   return er;
 }
 
@@ -84,12 +89,42 @@ list_t* getPossibleOidcDirLocations() {
   return possibleLocations;
 }
 
+// The resolved oidc dir is stable within one process, but the file helpers
+// resolve it several times per request; cache it after the first lookup.
+static char* oidc_dir_cache = NULL;
+
+/**
+ * @brief drops the cached oidc directory path so the next @c getOidcDir
+ * resolves it again; has to be called when the directory is created or moved
+ * within this process
+ */
+void resetOidcDirCache() { secFree(oidc_dir_cache); }
+
 /** @fn char* getOidcDir()
  * @brief get the oidc directory path
+ * The resolved path is cached; use @c resetOidcDirCache after creating the
+ * directory. If @c OIDC_CONFIG_DIR is set and exists, it is used without
+ * probing the default locations.
  * @return a pointer to the oidc directory path. Has to be freed after usage. If
  * no oidc dir is found, NULL is returned
  */
 char* getOidcDir() {
+  if (oidc_dir_cache != NULL) {
+    return oidc_strcopy(oidc_dir_cache);
+  }
+  char* locFromEnv = getenv(OIDC_CONFIG_DIR_ENV_NAME);
+  if (locFromEnv != NULL) {
+    char* path = getNonTildePath(locFromEnv);
+    if (dirExists(path) > 0) {
+      oidc_dir_cache = withTrailingSlash(path);
+      secFree(path);
+      return oidc_strcopy(oidc_dir_cache);
+    }
+    logger(WARNING, "Dir '%s' set by " OIDC_CONFIG_DIR_ENV_NAME
+                    " does not exist; probing the default locations",
+           path);
+    secFree(path);
+  }
   list_t*          possibleLocations = getPossibleOidcDirLocations();
   list_node_t*     node;
   list_iterator_t* it = list_iterator_new(possibleLocations, LIST_HEAD);
@@ -98,9 +133,9 @@ char* getOidcDir() {
     logger(DEBUG, "Checking if dir '%s' exists.", path);
     if (dirExists(path) > 0) {
       list_iterator_destroy(it);
-      char* ret = withTrailingSlash(path);
+      oidc_dir_cache = withTrailingSlash(path);
       list_destroy(possibleLocations);
-      return ret;
+      return oidc_strcopy(oidc_dir_cache);
     }
   }
   list_iterator_destroy(it);
@@ -133,7 +168,8 @@ oidc_error_t createOidcDir() {
     list_destroy(possibleLocations);
     return OIDC_SUCCESS;
   }
-  oidc_error_t ret        = createDir(path);
+  oidc_error_t ret = createDir(path);
+  resetOidcDirCache();  // the new dir may resolve differently now
   char* issuerconfig_path = oidc_sprintf("%s/%s", path, ISSUER_CONFIG_FILENAME);
   list_destroy(possibleLocations);
   int fd = open(issuerconfig_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
@@ -152,6 +188,9 @@ int removeOidcFile(const char* filename) {
   char* path = concatToOidcDir(filename);
   int   r    = removeFile(path);
   secFree(path);
+  if (r == 0) {
+    oidcIndex_remove(filename);
+  }
   return r;
 }
 
@@ -169,9 +208,57 @@ list_t* getLinesFromOidcFile(const char* filename) {
   return ret;
 }
 
+/**
+ * @brief returns the issuer url part of an issuer.config line
+ * Has to be freed after usage.
+ */
+static char* _issuerFromConfigLine(const char* line) {
+  const char* space = strchr(line, ' ');
+  return space != NULL ? oidc_strncopy(line, space - line)
+                       : oidc_strcopy(line);
+}
+
+/**
+ * @brief rewrites issuer.config without duplicate issuer entries
+ * @c updateIssuerConfig only appends, so concurrent runs can race the
+ * duplicate check and append the same issuer twice; the first entry of an
+ * issuer wins, matching the readers.
+ */
+static void _compactIssuerConfig(list_t* lines) {
+  logger(DEBUG, "Compacting " ISSUER_CONFIG_FILENAME);
+  list_t* seen = list_new();
+  seen->free   = _secFree;
+  seen->match  = (matchFunction)strcaseequal;
+  list_t* kept = list_new();
+  kept->match  = (matchFunction)strequal;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(lines, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    char* issuer = _issuerFromConfigLine(node->val);
+    if (findInList(seen, issuer) == NULL) {
+      list_rpush(seen, list_node_new(issuer));
+      list_rpush(kept, list_node_new(node->val));
+    } else {
+      secFree(issuer);
+    }
+  }
+  list_iterator_destroy(it);
+  char* compacted = listToDelimitedString(kept, '\n');
+  char* content   = oidc_strcat(compacted, "\n");  // keep the file ready for
+                                                   // the next append
+  writeOidcFile(ISSUER_CONFIG_FILENAME, content);
+  secFree(content);
+  secFree(compacted);
+  list_destroy(kept);
+  secFreeList(seen);
+}
+
 /**
  * @brief updates the issuer.config file.
- * If the issuer url is not already in the issuer.config file, it will be added.
+ * If the issuer url is not already in the issuer.config file, it will be
+ * added. New entries are appended instead of rewriting the whole file; if
+ * appends from concurrent runs left duplicate issuers behind, the file is
+ * compacted first.
  * @param issuer_url the issuer url to be added
  * @param shortname will be used as the default account config for this issuer
  */
@@ -179,22 +266,49 @@ void updateIssuerConfig(const char* issuer_url, const char* shortname) {
   if (issuer_url == NULL || shortname == NULL) {
     return;
   }
-  char* issuers = readOidcFile(ISSUER_CONFIG_FILENAME);
-  char* new_issuers;
-  if (issuers) {
-    if (strSubStringCase(issuers, issuer_url)) {
-      secFree(issuers);
+  char* indexed = oidcIndex_shortnameForIssuer(issuer_url);
+  if (indexed != NULL) {  // issuer urls only get into the index through the
+                          // append below, so a hit means the entry exists
+    secFree(indexed);
+    return;
+  }
+  list_t* lines = getLinesFromOidcFile(ISSUER_CONFIG_FILENAME);
+  if (lines != NULL) {
+    unsigned char found      = 0;
+    unsigned char duplicates = 0;
+    list_t*       seen       = list_new();
+    seen->free               = _secFree;
+    seen->match              = (matchFunction)strcaseequal;
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(lines, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      char* issuer = _issuerFromConfigLine(node->val);
+      if (strcaseequal(issuer, issuer_url)) {
+        found = 1;
+      }
+      if (findInList(seen, issuer) != NULL) {
+        duplicates = 1;
+        secFree(issuer);
+      } else {
+        list_rpush(seen, list_node_new(issuer));
+      }
+    }
+    list_iterator_destroy(it);
+    secFreeList(seen);
+    if (duplicates) {
+      _compactIssuerConfig(lines);
+    }
+    secFreeList(lines);
+    if (found) {
       return;
     }
-    new_issuers = oidc_sprintf("%s\n%s %s", issuers, issuer_url, shortname);
-    secFree(issuers);
-  } else {
-    new_issuers = oidc_sprintf("%s %s", issuer_url, shortname);
   }
-  if (new_issuers == NULL) {
+  char* new_line = oidc_sprintf("%s %s", issuer_url, shortname);
+  if (new_line == NULL) {
     logger(ERROR, "%s", oidc_serror());
-  } else {
-    writeOidcFile(ISSUER_CONFIG_FILENAME, new_issuers);
-    secFree(new_issuers);
+    return;
   }
+  appendOidcFile(ISSUER_CONFIG_FILENAME, new_line);
+  secFree(new_line);
+  oidcIndex_setIssuer(shortname, issuer_url);
 }
@@ -5,6 +5,7 @@
 #include "utils/oidc_error.h"
 
 char*        getOidcDir();
+void         resetOidcDirCache();
 oidc_error_t createOidcDir();
 oidc_error_t writeOidcFile(const char* filename, const char* text);
 oidc_error_t appendOidcFile(const char* filename, const char* text);
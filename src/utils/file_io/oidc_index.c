@@ -0,0 +1,463 @@
+#define _XOPEN_SOURCE 700
+#include "oidc_index.h"
+#include "fileUtils.h"
+#include "oidc_file_io.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A compact read-only index of the account configs under the oidc dir:
+ * shortnames, the issuer url each shortname was generated for, file mtimes
+ * and the crypt parameter version - no secrets. Enumeration, existence
+ * checks and the issuer lookup of updateIssuerConfig become one mmap and a
+ * binary search instead of a readdir plus per-file stats, which matters for
+ * users with hundreds of configs on NFS homes.
+ *
+ * The index is maintained on the write paths (writeOidcFile,
+ * removeOidcFile, updateIssuerConfig) and written atomically via rename.
+ * Readers trust it only while the oidc dir's mtime is not newer than the
+ * index file's: configs added or removed behind the agent's back (scp, a
+ * second host) invalidate it and every consumer falls back to the readdir
+ * path until the next write rebuilds it. A missing or invalid index is
+ * never an error, only a cache miss.
+ */
+
+#define OIDC_INDEX_MAGIC 0x58444930u  // "0IDX"
+#define OIDC_INDEX_FORMAT_VERSION 1u
+// set when a shortname or issuer url did not fit its fixed field; an
+// incomplete index cannot answer enumeration or negative lookups
+#define OIDC_INDEX_FLAG_INCOMPLETE 0x1u
+
+#ifndef OIDC_INDEX_NAME_MAX
+#define OIDC_INDEX_NAME_MAX 64
+#endif
+#ifndef OIDC_INDEX_ISSUER_MAX
+#define OIDC_INDEX_ISSUER_MAX 128
+#endif
+
+struct oidcIndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t flags;
+};
+
+struct oidcIndexRecord {
+  char    name[OIDC_INDEX_NAME_MAX];      // nullterminated shortname
+  char    issuer[OIDC_INDEX_ISSUER_MAX];  // issuer url; empty if unknown
+  int64_t mtime;                          // of the config file at index time
+  uint32_t crypt_version;  // reserved for the crypt parameter version
+  uint32_t reserved;
+};
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// cached mapping; revalidated against the index file's stat on every use
+static void*  index_map       = NULL;
+static size_t index_map_size  = 0;
+static time_t index_map_mtime = 0;
+static ino_t  index_map_ino   = 0;
+
+static char* _indexPath() { return concatToOidcDir(ACCOUNT_INDEX_FILENAME); }
+
+static void _indexUnmap() {
+  if (index_map != NULL) {
+    munmap(index_map, index_map_size);
+    index_map      = NULL;
+    index_map_size = 0;
+  }
+}
+
+/**
+ * @brief maps the index file if it exists and is still fresh
+ * Holds no lock itself; the caller has to hold @c index_lock and must not
+ * keep the returned pointer across an unlock.
+ * @return a pointer to the mapped header, or @c NULL if there is no usable
+ * index
+ */
+static const struct oidcIndexHeader* _indexMap() {
+  char* dir = getOidcDir();
+  if (dir == NULL) {
+    return NULL;
+  }
+  struct stat dir_st;
+  int         dir_ok = stat(dir, &dir_st);
+  secFree(dir);
+  char*       path = _indexPath();
+  struct stat st;
+  if (dir_ok != 0 || stat(path, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct oidcIndexHeader) ||
+      dir_st.st_mtime > st.st_mtime) {
+    // never written, or the dir changed after the last index write
+    secFree(path);
+    _indexUnmap();
+    return NULL;
+  }
+  if (index_map != NULL &&
+      (st.st_mtime != index_map_mtime || (size_t)st.st_size != index_map_size ||
+       st.st_ino != index_map_ino)) {
+    _indexUnmap();
+  }
+  if (index_map == NULL) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      secFree(path);
+      return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      secFree(path);
+      return NULL;
+    }
+    index_map       = map;
+    index_map_size  = st.st_size;
+    index_map_mtime = st.st_mtime;
+    index_map_ino   = st.st_ino;
+  }
+  secFree(path);
+  const struct oidcIndexHeader* hdr = index_map;
+  if (hdr->magic != OIDC_INDEX_MAGIC ||
+      hdr->version != OIDC_INDEX_FORMAT_VERSION ||
+      sizeof(struct oidcIndexHeader) +
+              (size_t)hdr->count * sizeof(struct oidcIndexRecord) !=
+          index_map_size) {
+    _indexUnmap();
+    return NULL;
+  }
+  return hdr;
+}
+
+static const struct oidcIndexRecord* _indexRecords(
+    const struct oidcIndexHeader* hdr) {
+  return (const struct oidcIndexRecord*)(hdr + 1);
+}
+
+/**
+ * @brief binary search for @p shortname in a mapped index
+ */
+static const struct oidcIndexRecord* _indexFind(
+    const struct oidcIndexHeader* hdr, const char* shortname) {
+  const struct oidcIndexRecord* recs = _indexRecords(hdr);
+  size_t                        lo   = 0;
+  size_t                        hi   = hdr->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int    cmp = strcmp(shortname, recs[mid].name);
+    if (cmp == 0) {
+      return &recs[mid];
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+static int _compareRecordsByName(const void* a, const void* b) {
+  return strcmp(((const struct oidcIndexRecord*)a)->name,
+                ((const struct oidcIndexRecord*)b)->name);
+}
+
+/**
+ * @brief fills @p rec for @p shortname , stating the config file for its
+ * mtime
+ * @return @c 0 on success, @c -1 if the name does not fit the fixed field
+ */
+static int _recordFill(struct oidcIndexRecord* rec, const char* shortname) {
+  if (strlen(shortname) >= OIDC_INDEX_NAME_MAX) {
+    return -1;
+  }
+  memset(rec, 0, sizeof(*rec));
+  strcpy(rec->name, shortname);
+  char*       path = concatToOidcDir(shortname);
+  struct stat st;
+  rec->mtime = stat(path, &st) == 0 ? (int64_t)st.st_mtime : 0;
+  secFree(path);
+  return 0;
+}
+
+/**
+ * @brief writes @p records as the new index, atomically via rename
+ */
+static oidc_error_t _indexWrite(const struct oidcIndexRecord* records,
+                                uint32_t count, uint32_t flags) {
+  struct oidcIndexHeader hdr = {OIDC_INDEX_MAGIC, OIDC_INDEX_FORMAT_VERSION,
+                                count, flags};
+  char*                  path = _indexPath();
+  char* tmp = oidc_sprintf("%s.tmp%d", path, (int)getpid());
+  if (tmp == NULL) {
+    secFree(path);
+    return oidc_errno;
+  }
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0 ||
+      write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+      write(fd, records, (size_t)count * sizeof(*records)) !=
+          (ssize_t)((size_t)count * sizeof(*records)) ||
+      close(fd) != 0 || rename(tmp, path) != 0) {
+    if (fd >= 0) {
+      unlink(tmp);
+    }
+    secFree(tmp);
+    secFree(path);
+    oidc_errno = OIDC_EWRITE;
+    return oidc_errno;
+  }
+  secFree(tmp);
+  secFree(path);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief loads the current records into a modifiable array
+ * Prefers the mapped index; if there is none, the records are rebuilt from
+ * a directory scan so the first write after an external change repairs the
+ * index.
+ * @param count_out number of returned records
+ * @param flags_out the index flags
+ * @return a record array of at least one extra slot. Has to be freed after
+ * usage.
+ */
+static struct oidcIndexRecord* _indexLoadForUpdate(uint32_t* count_out,
+                                                   uint32_t* flags_out) {
+  const struct oidcIndexHeader* hdr = _indexMap();
+  if (hdr != NULL) {
+    struct oidcIndexRecord* records =
+        secAlloc(((size_t)hdr->count + 1) * sizeof(*records));
+    memcpy(records, _indexRecords(hdr),
+           (size_t)hdr->count * sizeof(*records));
+    *count_out = hdr->count;
+    *flags_out = hdr->flags;
+    return records;
+  }
+  char* oidc_dir = getOidcDir();
+  if (oidc_dir == NULL) {
+    return NULL;
+  }
+  list_t* files = getFileListForDirIf(oidc_dir, &isAccountConfigFile, NULL);
+  secFree(oidc_dir);
+  if (files == NULL) {
+    return NULL;
+  }
+  struct oidcIndexRecord* records =
+      secAlloc(((size_t)files->len + 1) * sizeof(*records));
+  uint32_t         count = 0;
+  uint32_t         flags = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(files, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (_recordFill(&records[count], node->val) != 0) {
+      flags |= OIDC_INDEX_FLAG_INCOMPLETE;
+      continue;
+    }
+    count++;
+  }
+  list_iterator_destroy(it);
+  secFreeList(files);
+  qsort(records, count, sizeof(*records), _compareRecordsByName);
+  *count_out = count;
+  *flags_out = flags;
+  return records;
+}
+
+/**
+ * @brief records @p shortname in the index after its config file was written
+ * @return @c OIDC_SUCCESS if the index was updated; failures only cost
+ * index coverage, so callers may ignore the return value
+ */
+oidc_error_t oidcIndex_update(const char* shortname) {
+  if (shortname == NULL || !isAccountConfigFile(shortname, NULL)) {
+    return OIDC_SUCCESS;
+  }
+  pthread_mutex_lock(&index_lock);
+  uint32_t                count   = 0;
+  uint32_t                flags   = 0;
+  struct oidcIndexRecord* records = _indexLoadForUpdate(&count, &flags);
+  if (records == NULL) {
+    pthread_mutex_unlock(&index_lock);
+    return oidc_errno;
+  }
+  struct oidcIndexRecord upd;
+  if (_recordFill(&upd, shortname) != 0) {
+    flags |= OIDC_INDEX_FLAG_INCOMPLETE;
+  } else {
+    unsigned char found = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      if (strequal(records[i].name, upd.name)) {
+        records[i].mtime = upd.mtime;  // keep the recorded issuer
+        found            = 1;
+        break;
+      }
+    }
+    if (!found) {
+      records[count++] = upd;  // the extra slot of _indexLoadForUpdate
+      qsort(records, count, sizeof(*records), _compareRecordsByName);
+    }
+  }
+  oidc_error_t ret = _indexWrite(records, count, flags);
+  secFree(records);
+  pthread_mutex_unlock(&index_lock);
+  return ret;
+}
+
+/**
+ * @brief drops @p shortname from the index after its config file was removed
+ */
+void oidcIndex_remove(const char* shortname) {
+  if (shortname == NULL || !isAccountConfigFile(shortname, NULL)) {
+    return;
+  }
+  pthread_mutex_lock(&index_lock);
+  uint32_t                count   = 0;
+  uint32_t                flags   = 0;
+  struct oidcIndexRecord* records = _indexLoadForUpdate(&count, &flags);
+  if (records == NULL) {
+    pthread_mutex_unlock(&index_lock);
+    return;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (strequal(records[i].name, shortname)) {
+      memmove(&records[i], &records[i + 1],
+              (size_t)(count - i - 1) * sizeof(*records));
+      count--;
+      break;
+    }
+  }
+  _indexWrite(records, count, flags);
+  secFree(records);
+  pthread_mutex_unlock(&index_lock);
+}
+
+/**
+ * @brief records the issuer url @p shortname was configured for
+ */
+void oidcIndex_setIssuer(const char* shortname, const char* issuer_url) {
+  if (shortname == NULL || issuer_url == NULL ||
+      !isAccountConfigFile(shortname, NULL)) {
+    return;
+  }
+  pthread_mutex_lock(&index_lock);
+  uint32_t                count   = 0;
+  uint32_t                flags   = 0;
+  struct oidcIndexRecord* records = _indexLoadForUpdate(&count, &flags);
+  if (records == NULL) {
+    pthread_mutex_unlock(&index_lock);
+    return;
+  }
+  struct oidcIndexRecord* rec = NULL;
+  for (uint32_t i = 0; i < count; i++) {
+    if (strequal(records[i].name, shortname)) {
+      rec = &records[i];
+      break;
+    }
+  }
+  if (rec == NULL) {
+    struct oidcIndexRecord upd;
+    if (_recordFill(&upd, shortname) != 0) {
+      flags |= OIDC_INDEX_FLAG_INCOMPLETE;
+    } else {
+      records[count] = upd;
+      rec            = &records[count++];
+    }
+  }
+  if (rec != NULL) {
+    if (strlen(issuer_url) < OIDC_INDEX_ISSUER_MAX) {
+      memset(rec->issuer, 0, OIDC_INDEX_ISSUER_MAX);
+      strcpy(rec->issuer, issuer_url);
+    } else {
+      flags |= OIDC_INDEX_FLAG_INCOMPLETE;
+    }
+    qsort(records, count, sizeof(*records), _compareRecordsByName);
+  }
+  _indexWrite(records, count, flags);
+  secFree(records);
+  pthread_mutex_unlock(&index_lock);
+}
+
+/**
+ * @brief checks the index for an account config named @p shortname
+ * @return @c 1 if it exists, @c 0 if it does not, @c -1 if the index cannot
+ * answer and the caller has to fall back to the filesystem
+ */
+int oidcIndex_accountExists(const char* shortname) {
+  if (shortname == NULL || strlen(shortname) >= OIDC_INDEX_NAME_MAX) {
+    return -1;
+  }
+  pthread_mutex_lock(&index_lock);
+  const struct oidcIndexHeader* hdr = _indexMap();
+  int                           ret = -1;
+  if (hdr != NULL) {
+    if (_indexFind(hdr, shortname) != NULL) {
+      ret = 1;
+    } else if (!(hdr->flags & OIDC_INDEX_FLAG_INCOMPLETE)) {
+      ret = 0;  // a miss in an incomplete index proves nothing
+    }
+  }
+  pthread_mutex_unlock(&index_lock);
+  return ret;
+}
+
+/**
+ * @brief lists the account config shortnames from the index
+ * @return a sorted list of shortnames, or @c NULL if there is no usable
+ * index and the caller has to enumerate the directory. Has to be freed
+ * after usage.
+ */
+list_t* oidcIndex_accountList() {
+  pthread_mutex_lock(&index_lock);
+  const struct oidcIndexHeader* hdr = _indexMap();
+  if (hdr == NULL || (hdr->flags & OIDC_INDEX_FLAG_INCOMPLETE)) {
+    pthread_mutex_unlock(&index_lock);
+    return NULL;
+  }
+  list_t* list = list_new();
+  list->free   = _secFree;
+  list->match  = (matchFunction)strequal;
+  const struct oidcIndexRecord* recs = _indexRecords(hdr);
+  for (uint32_t i = 0; i < hdr->count; i++) {
+    list_rpush(list, list_node_new(oidc_strcopy(recs[i].name)));
+  }
+  pthread_mutex_unlock(&index_lock);
+  return list;
+}
+
+/**
+ * @brief looks up a shortname configured for @p issuer_url
+ * Issuer urls are only recorded when @c updateIssuerConfig runs, so a miss
+ * is not authoritative; only a hit is.
+ * @return the shortname, or @c NULL on a miss. Has to be freed after usage.
+ */
+char* oidcIndex_shortnameForIssuer(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&index_lock);
+  const struct oidcIndexHeader* hdr = _indexMap();
+  char*                         ret = NULL;
+  if (hdr != NULL) {
+    const struct oidcIndexRecord* recs = _indexRecords(hdr);
+    for (uint32_t i = 0; i < hdr->count; i++) {
+      if (recs[i].issuer[0] != '\0' &&
+          strcaseequal(recs[i].issuer, issuer_url)) {
+        ret = oidc_strcopy(recs[i].name);
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&index_lock);
+  return ret;
+}
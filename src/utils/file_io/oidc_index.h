@@ -0,0 +1,18 @@
+#ifndef OIDC_INDEX_H
+#define OIDC_INDEX_H
+
+#include "list/list.h"
+#include "utils/oidc_error.h"
+
+// The on-disk account config index. The .config suffix keeps it out of the
+// account config enumeration (see isAccountConfigFile).
+#define ACCOUNT_INDEX_FILENAME "accounts.index.config"
+
+oidc_error_t oidcIndex_update(const char* shortname);
+void         oidcIndex_remove(const char* shortname);
+void         oidcIndex_setIssuer(const char* shortname, const char* issuer_url);
+int          oidcIndex_accountExists(const char* shortname);
+list_t*      oidcIndex_accountList();
+char*        oidcIndex_shortnameForIssuer(const char* issuer_url);
+
+#endif  // OIDC_INDEX_H
@@ -2,7 +2,46 @@
 #include "utils/file_io/cryptFileUtils.h"
 #include "utils/file_io/file_io.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/logger.h"
 #include "utils/promptUtils.h"
+#include "utils/stringUtils.h"
+
+/**
+ * @brief checks if the encrypted target file already holds exactly @p text.
+ * The existing file is decrypted with @p password and compared against the
+ * new content. In an edit session the file was already decrypted with the
+ * same password, so the key derivation for the file's salt is served from
+ * the key cache and this check is practically free; an unchanged
+ * configuration can then skip the key derivation and write entirely.
+ * @return @c 1 if the file exists, decrypts with @p password and its content
+ * equals @p text; @c 0 otherwise
+ */
+static int _encryptedFileHoldsText(const char* text, const char* filepath,
+                                   const char* oidc_filename,
+                                   const char* password) {
+  if (!(oidc_filename != NULL ? oidcFileDoesExist(oidc_filename)
+                              : fileDoesExist(filepath))) {
+    return 0;
+  }
+  char* oldText = oidc_filename != NULL
+                      ? decryptOidcFile(oidc_filename, password)
+                      : decryptFile(filepath, password);
+  if (oldText == NULL) {  // e.g. the encryption password changed; rewrite
+    return 0;
+  }
+  int unchanged = strequal(text, oldText);
+  secFree(oldText);
+  return unchanged;
+}
+
+/**
+ * @brief checks if the encrypted file @p filename in the oidc dir already
+ * holds exactly @p text, for callers that manage the password themselves.
+ */
+int encryptedOidcFileHoldsText(const char* text, const char* filename,
+                               const char* password) {
+  return _encryptedFileHoldsText(text, NULL, filename, password);
+}
 
 oidc_error_t _promptAndCryptAndWriteToAnyFile(
     const char* text, const char* filepath, const char* oidc_filename,
@@ -22,6 +61,13 @@ oidc_error_t _promptAndCryptAndWriteToAnyFile(
   if (encryptionPassword == NULL) {
     return oidc_errno;
   }
+  if (_encryptedFileHoldsText(text, filepath, oidc_filename,
+                              encryptionPassword)) {
+    logger(DEBUG, "content of '%s' unchanged; not rewriting it",
+           oidc_filename ?: filepath);
+    secFree(encryptionPassword);
+    return OIDC_SUCCESS;
+  }
   oidc_error_t ret =
       encryptAndWriteFnc(text, oidc_filename ?: filepath, encryptionPassword);
   secFree(encryptionPassword);
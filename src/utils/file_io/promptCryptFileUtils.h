@@ -13,6 +13,8 @@ oidc_error_t promptEncryptAndWriteToOidcFile(const char* text,
                                              const char* hint,
                                              const char* suggestedPassword,
                                              const char* pw_cmd);
+int          encryptedOidcFileHoldsText(const char* text, const char* filename,
+                                        const char* password);
 struct resultWithEncryptionPassword getDecryptedFileAndPasswordFor(
     const char* filepath, const char* pw_cmd);
 struct resultWithEncryptionPassword getDecryptedOidcFileAndPasswordFor(
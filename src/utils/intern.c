@@ -0,0 +1,50 @@
+#include "intern.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+
+/*
+ * Interning table for identifier-class strings. The agent passes the same
+ * few dozen shortnames and issuer urls around constantly; interning them
+ * gives every user the one canonical copy, so storing an identifier is a
+ * pointer store and comparing two interned identifiers is a pointer
+ * comparison. The table only ever grows and its strings are never freed,
+ * which is exactly the lifetime of the identifiers it is meant for. With
+ * tens of entries a linear scan beats any hashing overhead.
+ */
+
+static char**          interned     = NULL;
+static size_t          interned_len = 0;
+static size_t          interned_cap = 0;
+static pthread_mutex_t intern_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+const char* intern(const char* str) {
+  if (str == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&intern_lock);
+  for (size_t i = 0; i < interned_len; i++) {
+    if (strequal(interned[i], str)) {
+      const char* ret = interned[i];
+      pthread_mutex_unlock(&intern_lock);
+      return ret;
+    }
+  }
+  if (interned_len >= interned_cap) {
+    size_t cap = interned_cap ? interned_cap * 2 : 16;
+    char** tmp = secRealloc(interned, cap * sizeof(char*));
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&intern_lock);
+      return NULL;
+    }
+    interned     = tmp;
+    interned_cap = cap;
+  }
+  char* copy = oidc_strcopy(str);
+  if (copy != NULL) {
+    interned[interned_len++] = copy;
+  }
+  pthread_mutex_unlock(&intern_lock);
+  return copy;
+}
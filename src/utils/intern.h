@@ -0,0 +1,18 @@
+#ifndef OIDC_INTERN_H
+#define OIDC_INTERN_H
+
+/**
+ * @brief returns the canonical copy of an identifier-class string
+ *
+ * The returned string is owned by the interning table and lives for the
+ * rest of the process; it must never be freed. Equal strings yield the
+ * same pointer, so interned identifiers can be compared by pointer. Meant
+ * for the few dozen strings - shortnames, issuer urls - that are looked up
+ * and compared all over the agent, not for arbitrary data.
+ * @param str the string to be interned
+ * @return the canonical pointer for @p str; @c NULL if @p str is @c NULL or
+ * allocation failed
+ */
+const char* intern(const char* str);
+
+#endif  // OIDC_INTERN_H
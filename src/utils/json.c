@@ -1,6 +1,10 @@
 #include "json.h"
 
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
 #include "listUtils.h"
+#include "memzero.h"
 #include "oidc_error.h"
 #include "pass.h"
 #include "stringUtils.h"
@@ -11,14 +15,215 @@
 static cJSON_Hooks hooks;
 static int         jsonInitDone = 0;
 
+/*
+ * The fixed set of protocol keys from defines/{ipc,oidc,agent}_values.h that
+ * the agent uses when building json objects. Keys from this table are added
+ * to cJSON nodes as constant references (cJSON_AddItemToObjectCS) instead of
+ * being copied into every node; the table entries live in static storage, so
+ * they outlive any json object.
+ */
+static const char* const json_interned_keys[] = {
+    IPC_KEY_REQUEST,
+    IPC_KEY_STATUS,
+    IPC_KEY_CONFIG,
+    IPC_KEY_CLIENT,
+    IPC_KEY_INFO,
+    IPC_KEY_URI,
+    IPC_KEY_SHORTNAME,
+    IPC_KEY_PASSWORD,
+    IPC_KEY_AUTHORIZATION,
+    IPC_KEY_DEVICE,
+    IPC_KEY_LIFETIME,
+    IPC_KEY_FLOW,
+    IPC_KEY_APPLICATIONHINT,
+    IPC_KEY_MINVALID,
+    IPC_KEY_PASSWORDENTRY,
+    IPC_KEY_CONFIRM,
+    IPC_KEY_REDIRECTEDURI,
+    IPC_KEY_FROMGEN,
+    IPC_KEY_USECUSTOMSCHEMEURL,
+    IPC_KEY_NOSCHEME,
+    IPC_KEY_ISSUERURL,
+    IPC_KEY_MAXSCOPES,
+    IPC_KEY_METRICS,
+    INT_IPC_KEY_OIDCERRNO,
+    OIDC_KEY_TOKEN_ENDPOINT,
+    OIDC_KEY_AUTHORIZATION_ENDPOINT,
+    OIDC_KEY_REVOCATION_ENDPOINT,
+    OIDC_KEY_REGISTRATION_ENDPOINT,
+    OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT,
+    OIDC_KEY_EXPIRESIN,
+    OIDC_KEY_ACCESSTOKEN,
+    OIDC_KEY_REFRESHTOKEN,
+    OIDC_KEY_CLIENTID,
+    OIDC_KEY_CLIENTSECRET,
+    OIDC_KEY_GRANTTYPE,
+    OIDC_KEY_RESPONSETYPE,
+    OIDC_KEY_SCOPE,
+    OIDC_KEY_CODE,
+    OIDC_KEY_STATE,
+    OIDC_KEY_CODEVERIFIER,
+    OIDC_KEY_USERNAME,
+    OIDC_KEY_CLIENTNAME,
+    OIDC_KEY_GRANTTYPES,
+    OIDC_KEY_RESPONSETYPES,
+    OIDC_KEY_REDIRECTURIS,
+    OIDC_KEY_DEVICECODE,
+    OIDC_KEY_USERCODE,
+    OIDC_KEY_VERIFICATIONURI,
+    OIDC_KEY_VERIFICATIONURI_COMPLETE,
+    OIDC_KEY_INTERVAL,
+    OIDC_KEY_ERROR,
+    OIDC_KEY_ERROR_DESCRIPTION,
+    AGENT_KEY_ISSUERURL,
+    AGENT_KEY_DAESETBYUSER,
+    AGENT_KEY_SHORTNAME,
+    AGENT_KEY_CERTPATH,
+    AGENT_KEY_EXPIRESAT,
+};
+
+/**
+ * @brief looks up the canonical interned pointer for a protocol key
+ * @param key the key to be looked up
+ * @return the interned pointer if @p key is one of the fixed protocol keys,
+ * @c NULL otherwise
+ * @internal
+ */
+static const char* _internKey(const char* key) {
+  for (size_t i = 0;
+       i < sizeof(json_interned_keys) / sizeof(*json_interned_keys); i++) {
+    if (json_interned_keys[i] == key ||
+        (json_interned_keys[i][0] == key[0] &&
+         strequal(json_interned_keys[i], key))) {
+      return json_interned_keys[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Per-request json arena.
+ *
+ * Building or parsing one request makes hundreds of tiny cJSON node
+ * allocations that are all dead by the time the response is written. While
+ * a thread has its arena active (jsonArena_begin), the cJSON allocator
+ * bumps a pointer in thread-local chunks instead of going through
+ * secAlloc, and the matching frees are no-ops; jsonArena_end releases
+ * everything in one wipe. Outside an active arena the allocator falls back
+ * to secAlloc/_secFree, so threads that never touch the arena behave as
+ * before. Every allocation carries a one-word tag so the free hook knows
+ * where it came from; strings that leave json code (printed json, string
+ * values) are always plain secAlloc copies.
+ */
+
+#define JSON_ARENA_CHUNK_SIZE (64 * 1024)
+#define JSON_ALLOC_TAG_ARENA ((size_t)0xa7e4a1) /* freed with the arena */
+#define JSON_ALLOC_TAG_HEAP ((size_t)0x4ea91)   /* freed via _secFree */
+
+struct json_arena_chunk {
+  struct json_arena_chunk* next;
+  size_t                   cap;
+  size_t                   used;
+  /* the chunk memory follows the header */
+};
+
+static __thread struct json_arena_chunk* json_arena_chunks = NULL;
+static __thread int                      json_arena_active = 0;
+
+// a chunk's memory is zeroed when it is allocated and re-zeroed in
+// jsonArena_end, so arena allocations are zero-initialized like secAlloc'd
+// ones
+static void* _jsonArena_bump(size_t size) {
+  size = (size + 7) & ~(size_t)7;  // keep allocations 8-byte aligned
+  struct json_arena_chunk* chunk = json_arena_chunks;
+  if (chunk == NULL || chunk->cap - chunk->used < size) {
+    size_t cap = size > JSON_ARENA_CHUNK_SIZE ? size : JSON_ARENA_CHUNK_SIZE;
+    chunk      = secAlloc(sizeof(struct json_arena_chunk) + cap);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->cap        = cap;
+    chunk->next       = json_arena_chunks;
+    json_arena_chunks = chunk;
+  }
+  void* p = (char*)(chunk + 1) + chunk->used;
+  chunk->used += size;
+  return p;
+}
+
+static void* _cjsonAlloc(size_t size) {
+  char* p;
+  if (json_arena_active) {
+    p = _jsonArena_bump(size + sizeof(size_t));
+  } else {
+    p = secAlloc(size + sizeof(size_t));
+  }
+  if (p == NULL) {
+    oidc_errno = OIDC_EALLOC;
+    return NULL;
+  }
+  *(size_t*)p = json_arena_active ? JSON_ALLOC_TAG_ARENA : JSON_ALLOC_TAG_HEAP;
+  return p + sizeof(size_t);
+}
+
+static void _cjsonFree(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  char* p = (char*)ptr - sizeof(size_t);
+  if (*(size_t*)p == JSON_ALLOC_TAG_ARENA) {
+    return;  // released in one wipe by jsonArena_end
+  }
+  _secFree(p);
+}
+
+/**
+ * @brief routes cJSON allocations of the calling thread into its arena
+ *
+ * Until the matching @c jsonArena_end all cJSON nodes the thread creates
+ * are pointer bumps in reused chunks; none of them may outlive the scope.
+ */
+void jsonArena_begin() { json_arena_active = 1; }
+
+/**
+ * @brief temporarily leaves arena mode on the calling thread
+ *
+ * For json that has to outlive the request (e.g. a DOM retained by an
+ * account). The returned state has to be passed to @c jsonArena_resume.
+ */
+int jsonArena_pause() {
+  int active        = json_arena_active;
+  json_arena_active = 0;
+  return active;
+}
+
+void jsonArena_resume(int active) { json_arena_active = active; }
+
+/**
+ * @brief wipes the calling thread's arena and leaves arena mode
+ *
+ * The chunks are kept for the next request; their used part is zeroed so
+ * no token material lingers and the next allocations start out zeroed.
+ */
+void jsonArena_end() {
+  json_arena_active = 0;
+  for (struct json_arena_chunk* chunk = json_arena_chunks; chunk != NULL;
+       chunk = chunk->next) {
+    if (chunk->used) {
+      moresecure_memzero((char*)(chunk + 1), chunk->used);
+      chunk->used = 0;
+    }
+  }
+}
+
 /**
  * @brief initializes the cJSON memory allocator and deallocator if not done yet
  * @internal
  */
 void initCJSON() {
   if (!jsonInitDone) {
-    hooks.malloc_fn = secAlloc;
-    hooks.free_fn   = _secFree;
+    hooks.malloc_fn = _cjsonAlloc;
+    hooks.free_fn   = _cjsonFree;
     cJSON_InitHooks(&hooks);
     jsonInitDone = 1;
   }
@@ -36,12 +241,61 @@ char* jsonToString(cJSON* cjson) {
     return NULL;
   }
   initCJSON();
-  return cJSON_Print(cjson);
+  char* printed = cJSON_Print(cjson);
+  if (printed == NULL) {
+    return NULL;
+  }
+  // the print buffer might live in the json arena; what leaves json code
+  // is always an ordinary secAlloc'd string
+  char* json = oidc_strcopy(printed);
+  cJSON_free(printed);
+  return json;
+}
+
+/**
+ * @brief estimates the unformatted print size of a cJSON (sub)tree
+ *
+ * A cheap upper-ish bound so the print buffer can be sized in one go;
+ * escape sequences can still make the printer grow the buffer once.
+ * @internal
+ */
+static size_t _jsonPrintSizeEstimate(const cJSON* item) {
+  size_t size = 0;
+  for (; item != NULL; item = item->next) {
+    size += 2;  // wrapping braces/brackets or separators
+    if (item->string != NULL) {
+      size += strlen(item->string) + 3;  // quotes and colon
+    }
+    if (cJSON_IsString(item) && item->valuestring != NULL) {
+      size += strlen(item->valuestring) + 2;
+    } else if (cJSON_IsNumber(item)) {
+      size += 26;  // max printed double
+    } else {
+      size += 8;  // true/false/null
+    }
+    if (item->child != NULL) {
+      size += _jsonPrintSizeEstimate(item->child);
+    }
+  }
+  return size;
 }
 
 char* jsonToStringUnformatted(cJSON* cjson) {
-  char* json = jsonToString(cjson);
-  cJSON_Minify(json);
+  if (cjson == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  initCJSON();
+  // render once into a buffer pre-sized from the DOM, instead of printing
+  // formatted and minifying afterwards
+  char* printed = cJSON_PrintBuffered(
+      cjson, (int)_jsonPrintSizeEstimate(cjson) + 1,
+      0);  // cJSON_False is the type constant (1), not a false bool
+  if (printed == NULL) {
+    return NULL;
+  }
+  char* json = oidc_strcopy(printed);
+  cJSON_free(printed);
   return json;
 }
 
@@ -58,17 +312,25 @@ cJSON* _stringToJson(const char* json, int logError) {
     return NULL;
   }
   initCJSON();
-  char* minJson = oidc_strcopy(json);
+  // The copy must come from the cJSON allocator: on success the parsed tree
+  // takes ownership and frees it through the same hooks on cJSON_Delete.
+  size_t len     = strlen(json);
+  char*  minJson = cJSON_malloc(len + 1);
+  if (minJson == NULL) {
+    oidc_errno = OIDC_EALLOC;
+    return NULL;
+  }
+  memcpy(minJson, json, len + 1);
   cJSON_Minify(minJson);
   logger(DEBUG, "Parsing json '%s'", minJson);
-  cJSON* cj = cJSON_Parse(minJson);
+  cJSON* cj = cJSON_ParseInSitu(minJson);
   if (cj == NULL) {
     oidc_errno = OIDC_EJSONPARS;
     if (logError) {
       logger(ERROR, "Parsing failed somewhere around %s", cJSON_GetErrorPtr());
     }
+    cJSON_free(minJson);
   }
-  secFree(minJson);
   return cj;
 }
 
@@ -111,6 +373,64 @@ int isJSONObject(const char* json) {
   return res;
 }
 
+/**
+ * @brief cheap structural probe for "is this a json object"
+ *
+ * Unlike @c isJSONObject this does not validate the json: it only checks
+ * that the first significant byte is '{' and that braces and brackets
+ * balance outside of strings, with an early exit once the outer object
+ * closes. Meant for the IPC receive path where it only has to tell a plain
+ * json message from an encrypted blob without parsing every inbound
+ * message.
+ * @param json the (possibly) json string
+ * @return @c 1 if @p json looks like a json object, @c 0 if not
+ */
+int isLikelyJSONObject(const char* json) {
+  if (NULL == json) {
+    oidc_setArgNullFuncError(__func__);
+    return 0;
+  }
+  const char* p = json;
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') { p++; }
+  if (*p != '{') {
+    return 0;
+  }
+  size_t depth    = 0;
+  int    inString = 0;
+  for (; *p != '\0'; p++) {
+    if (inString) {
+      if (*p == '\\' && p[1] != '\0') {
+        p++;  // skip the escaped character
+      } else if (*p == '"') {
+        inString = 0;
+      }
+      continue;
+    }
+    switch (*p) {
+      case '"': inString = 1; break;
+      case '{':
+      case '[': depth++; break;
+      case '}':
+      case ']':
+        if (depth == 0) {
+          return 0;
+        }
+        if (--depth == 0) {  // outer object closed: only trailing
+                             // whitespace is allowed
+          for (p++; *p != '\0'; p++) {
+            if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+              return 0;
+            }
+          }
+          return 1;
+        }
+        break;
+      default: break;
+    }
+  }
+  return 0;  // unbalanced or unterminated
+}
+
 /**
  * @brief safly calls cJSON_Delete freeing the cJSON Object
  * @param cjson the cJSON Object to be freed
@@ -184,7 +504,7 @@ char* getJSONItemValue(cJSON* valueItem) {
     char* value = cJSON_GetStringValue(valueItem);
     return strValid(value) ? oidc_strcopy(value) : NULL;
   }
-  return cJSON_Print(valueItem);
+  return jsonToString(valueItem);
 }
 
 /**
@@ -215,6 +535,26 @@ char* getJSONValue(const cJSON* cjson, const char* key) {
   return value;
 }
 
+/**
+ * @brief gets the item for a given key from a json object
+ * @param cjson the cJSON object
+ * @param key the key
+ * @return a pointer to the item; it is still owned by @p cjson and must not
+ * be freed on its own. @c NULL if @p key is not found.
+ */
+cJSON* getJSONItem(const cJSON* cjson, const char* key) {
+  if (NULL == cjson || NULL == key) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  initCJSON();
+  if (!cJSON_IsObject(cjson)) {
+    oidc_errno = OIDC_EJSONOBJ;
+    return NULL;
+  }
+  return cJSON_GetObjectItemCaseSensitive(cjson, key);
+}
+
 oidc_error_t setJSONValue(cJSON* cjson, const char* key, const char* value) {
   if (NULL == cjson || NULL == key || value == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -224,7 +564,12 @@ oidc_error_t setJSONValue(cJSON* cjson, const char* key, const char* value) {
   if (jsonHasKey(cjson, key)) {
     cJSON_DeleteItemFromObjectCaseSensitive(cjson, key);
   }
-  cJSON_AddStringToObject(cjson, key, value);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, cJSON_CreateString(value));
+  } else {
+    cJSON_AddStringToObject(cjson, key, value);
+  }
   return OIDC_SUCCESS;
 }
 
@@ -252,12 +597,15 @@ char* getJSONValueFromString(const char* json, const char* key) {
 
 /**
  * @brief gets multiple values from a cJSON object
+ *
+ * The object's child list is walked once and each field is matched against
+ * the wanted keys, instead of one full object scan per key.
  * @param cjson the cJSON object
  * @param pairs an array of key_value pairs. The keys are used as keys. A
  * pointer to the result is stored in the value field. The previous pointer is
  * not freed, thus it should be NULL.
  * @param size the number of key value pairs
- * @return the number of set values or an error code on failure
+ * @return the number of key value pairs or an error code on failure
  */
 oidc_error_t getJSONValues(const cJSON* cjson, struct key_value* pairs,
                            size_t size) {
@@ -271,10 +619,23 @@ oidc_error_t getJSONValues(const cJSON* cjson, struct key_value* pairs,
     return oidc_errno;
   }
   unsigned int i;
-  for (i = 0; i < size; i++) {
-    pairs[i].value = getJSONValue(cjson, pairs[i].key);
+  for (i = 0; i < size; i++) { pairs[i].value = NULL; }
+  for (cJSON* field = cjson->child; field != NULL; field = field->next) {
+    if (field->string == NULL) {
+      continue;
+    }
+    for (i = 0; i < size; i++) {
+      // interned keys match by pointer; only fall back to a string compare
+      // for keys that were copied into the node
+      if (pairs[i].value == NULL &&
+          (pairs[i].key == field->string ||
+           strequal(pairs[i].key, field->string))) {
+        pairs[i].value = getJSONItemValue(field);
+        break;
+      }
+    }
   }
-  return i;
+  return size;
 }
 
 /**
@@ -402,7 +763,12 @@ cJSON* jsonAddStringValue(cJSON* cjson, const char* key, const char* value) {
   }
   initCJSON();
   logger(DEBUG, "Adding value '%s' for key '%s' to a json object", value, key);
-  cJSON_AddStringToObject(cjson, key, value);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, cJSON_CreateString(value));
+  } else {
+    cJSON_AddStringToObject(cjson, key, value);
+  }
   return cjson;
 }
 cJSON* jsonAddNumberValue(cJSON* cjson, const char* key, const double value) {
@@ -411,7 +777,12 @@ cJSON* jsonAddNumberValue(cJSON* cjson, const char* key, const double value) {
     return NULL;
   }
   initCJSON();
-  cJSON_AddNumberToObject(cjson, key, value);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, cJSON_CreateNumber(value));
+  } else {
+    cJSON_AddNumberToObject(cjson, key, value);
+  }
   return cjson;
 }
 cJSON* jsonAddArrayValue(cJSON* cjson, const char* key,
@@ -421,8 +792,13 @@ cJSON* jsonAddArrayValue(cJSON* cjson, const char* key,
     return NULL;
   }
   initCJSON();
-  cJSON* array = stringToJson(json_array);
-  cJSON_AddItemToObject(cjson, key, array);
+  cJSON*      array    = stringToJson(json_array);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, array);
+  } else {
+    cJSON_AddItemToObject(cjson, key, array);
+  }
   return cjson;
 }
 cJSON* jsonAddObjectValue(cJSON* cjson, const char* key,
@@ -432,8 +808,13 @@ cJSON* jsonAddObjectValue(cJSON* cjson, const char* key,
     return NULL;
   }
   initCJSON();
-  cJSON* object = stringToJson(json_object);
-  cJSON_AddItemToObject(cjson, key, object);
+  cJSON*      object   = stringToJson(json_object);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, object);
+  } else {
+    cJSON_AddItemToObject(cjson, key, object);
+  }
   return cjson;
 }
 cJSON* jsonAddJSON(cJSON* cjson, const char* key, cJSON* item) {
@@ -442,7 +823,12 @@ cJSON* jsonAddJSON(cJSON* cjson, const char* key, cJSON* item) {
     return NULL;
   }
   initCJSON();
-  cJSON_AddItemToObject(cjson, key, item);
+  const char* interned = _internKey(key);
+  if (interned != NULL) {
+    cJSON_AddItemToObjectCS(cjson, interned, item);
+  } else {
+    cJSON_AddItemToObject(cjson, key, item);
+  }
   return cjson;
 }
 
@@ -646,16 +1032,20 @@ cJSON* mergeJSONObjects(const cJSON* j1, const cJSON* j2) {
       if (!cJSON_Compare(cJSON_GetObjectItemCaseSensitive(j1, key), el,
                          cJSON_True)) {
         cJSON* el1 = cJSON_GetObjectItemCaseSensitive(j1, key);
-        if ((el->type == cJSON_String && !strValid(el->valuestring)) ||
-            ((el->type == cJSON_Array || el->type == cJSON_Object) &&
+        // mask off cJSON's internal flag bits (set e.g. for in situ parsed
+        // strings) before comparing types
+        const int elType  = el->type & 0xFF;
+        const int el1Type = el1->type & 0xFF;
+        if ((elType == cJSON_String && !strValid(el->valuestring)) ||
+            ((elType == cJSON_Array || elType == cJSON_Object) &&
              cJSON_GetArraySize(el) == 0)) {
           pass;
-        } else if ((el1->type == cJSON_String && !strValid(el1->valuestring)) ||
-                   ((el1->type == cJSON_Array || el1->type == cJSON_Object) &&
+        } else if ((el1Type == cJSON_String && !strValid(el1->valuestring)) ||
+                   ((el1Type == cJSON_Array || el1Type == cJSON_Object) &&
                     cJSON_GetArraySize(el1) == 0)) {
           cJSON* cpy = cJSON_Duplicate(el, cJSON_True);
           cJSON_ReplaceItemViaPointer(json, el1, cpy);
-        } else if (el1->type == cJSON_String && el->type == cJSON_String &&
+        } else if (el1Type == cJSON_String && elType == cJSON_String &&
                    strequal(el1->valuestring, el->valuestring)) {
           pass;
         } else if (strequal("scope", key)) {
@@ -672,8 +1062,8 @@ cJSON* mergeJSONObjects(const cJSON* j1, const cJSON* j2) {
                  "Cannot merge json objects: Conflict for key '%s' between "
                  "value '%s' and '%s'",
                  key, val1, val2);
-          cJSON_free(val1);
-          cJSON_free(val2);
+          secFree(val1);
+          secFree(val2);
           cJSON_Delete(json);
           return NULL;
         }
@@ -682,7 +1072,7 @@ cJSON* mergeJSONObjects(const cJSON* j1, const cJSON* j2) {
       cJSON* (*addFunc)(cJSON*, const char*, const void*) = NULL;
       void*  value                                        = NULL;
       double numbervalue                                  = 0.;
-      switch (el->type) {
+      switch (el->type & 0xFF) {
         case cJSON_String:
           addFunc = (cJSON * (*)(cJSON*, const char*, const void*))
               jsonAddStringValue;
@@ -720,7 +1110,7 @@ int jsonArrayIsEmpty(cJSON* json) {
   if (json == NULL) {
     return OIDC_EARGNULL;
   }
-  if (json->type != cJSON_Array) {
+  if ((json->type & 0xFF) != cJSON_Array) {
     return OIDC_EJSONARR;
   }
   return !cJSON_GetArraySize(json);
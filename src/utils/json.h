@@ -13,7 +13,13 @@
 
 void _secFreeJson(cJSON* cjson);
 
+void jsonArena_begin();
+void jsonArena_end();
+int  jsonArena_pause();
+void jsonArena_resume(int active);
+
 char*        getJSONValue(const cJSON* cjson, const char* key);
+cJSON*       getJSONItem(const cJSON* cjson, const char* key);
 char*        getJSONValueFromString(const char* json, const char* key);
 oidc_error_t getJSONValues(const cJSON* cjson, struct key_value* pairs,
                            size_t size);
@@ -23,6 +29,7 @@ oidc_error_t getJSONValuesFromString(const char* json, struct key_value* pairs,
 int jsonHasKey(const cJSON* cjson, const char* key);
 int jsonStringHasKey(const char* json, const char* key);
 int isJSONObject(const char* json);
+int isLikelyJSONObject(const char* json);
 int jsonArrayIsEmpty(cJSON* json);
 
 char*   jsonToString(cJSON* cjson);
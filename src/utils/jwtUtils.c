@@ -0,0 +1,104 @@
+#include "jwtUtils.h"
+#include "defines/oidc_values.h"
+#include "utils/crypt/base64.h"
+#include "utils/json.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/*
+ * Some issuers omit expires_in from the token response; for their JWT
+ * access tokens the precise expiry sits in the exp claim of the payload.
+ * Decoding it (base64 plus a JSON parse) on every validity check would be
+ * a per-request cost, so decoded expiries are cached keyed by a 64-bit
+ * hash of the token string plus its length - the token itself is never
+ * stored. Negative results (not a JWT, no exp claim) are cached the same
+ * way, so opaque tokens cost one decode attempt per lifetime too.
+ */
+
+#ifndef JWT_EXP_CACHE_SIZE
+#define JWT_EXP_CACHE_SIZE 32
+#endif
+
+struct jwtExpEntry {
+  unsigned long hash;
+  size_t        token_len;
+  time_t        expires_at;  // 0: not a JWT or no exp claim
+  unsigned char used;
+};
+
+static struct jwtExpEntry jwt_cache[JWT_EXP_CACHE_SIZE];
+static unsigned int       jwt_cache_next = 0;
+static pthread_mutex_t    jwt_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief decodes the payload of @p token and reads its exp claim
+ * @return the expiry as unix time, @c 0 if @p token is not a JWT or has
+ * no numeric exp claim
+ */
+static time_t _jwtDecodeExpiresAt(const char* token) {
+  const char* payload = strchr(token, '.');
+  if (payload == NULL) {
+    return 0;
+  }
+  payload++;
+  const char* payload_end = strchr(payload, '.');
+  if (payload_end == NULL) {  // a compact JWS has three segments
+    return 0;
+  }
+  size_t b64_len = (size_t)(payload_end - payload);
+  size_t bin_len = b64_len * 6 / 8;
+  if (bin_len == 0) {
+    return 0;
+  }
+  char* segment = oidc_strncopy(payload, b64_len);
+  if (segment == NULL) {
+    return 0;
+  }
+  time_t         expires_at = 0;
+  unsigned char* decoded    = secAlloc(bin_len + 1);
+  if (agent_base64_decode(decoded, bin_len, segment, 1) == 0) {
+    cJSON* json = stringToJson((char*)decoded);
+    if (json != NULL) {
+      cJSON* exp = getJSONItem(json, OIDC_KEY_JWT_EXP);
+      if (cJSON_IsNumber(exp)) {
+        expires_at = (time_t)exp->valuedouble;
+      }
+      secFreeJson(json);
+    }
+  }
+  secFree(decoded);
+  secFree(segment);
+  return expires_at;
+}
+
+time_t jwt_getExpiresAt(const char* token) {
+  if (!strValid(token)) {
+    return 0;
+  }
+  unsigned long hash = oidc_strhash(token);
+  size_t        len  = strlen(token);
+  pthread_mutex_lock(&jwt_cache_lock);
+  for (unsigned int i = 0; i < JWT_EXP_CACHE_SIZE; i++) {
+    if (jwt_cache[i].used && jwt_cache[i].hash == hash &&
+        jwt_cache[i].token_len == len) {
+      time_t expires_at = jwt_cache[i].expires_at;
+      pthread_mutex_unlock(&jwt_cache_lock);
+      return expires_at;
+    }
+  }
+  pthread_mutex_unlock(&jwt_cache_lock);
+  time_t expires_at = _jwtDecodeExpiresAt(token);
+  pthread_mutex_lock(&jwt_cache_lock);
+  struct jwtExpEntry* slot = &jwt_cache[jwt_cache_next];
+  jwt_cache_next           = (jwt_cache_next + 1) % JWT_EXP_CACHE_SIZE;
+  slot->hash               = hash;
+  slot->token_len          = len;
+  slot->expires_at         = expires_at;
+  slot->used               = 1;
+  pthread_mutex_unlock(&jwt_cache_lock);
+  return expires_at;
+}
@@ -0,0 +1,16 @@
+#ifndef OIDC_JWT_UTILS_H
+#define OIDC_JWT_UTILS_H
+
+#include <time.h>
+
+/**
+ * @brief returns the expiry (exp claim) of a JWT access token
+ * Decoded expiries are cached keyed by a hash of the token string, so a
+ * token is decoded once per lifetime, not once per check.
+ * @param token the access token; may be @c NULL or not a JWT
+ * @return the expiry as unix time; @c 0 if @p token is not a JWT or
+ * carries no exp claim
+ */
+time_t jwt_getExpiresAt(const char* token);
+
+#endif  // OIDC_JWT_UTILS_H
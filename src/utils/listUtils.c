@@ -3,9 +3,11 @@
 #include "json.h"
 #include "memory.h"
 #include "oidc_error.h"
+#include "oidc_string.h"
 #include "stringUtils.h"
 
 #include <stdarg.h>
+#include <strings.h>
 
 char* delimitedStringToJSONArray(char* str, char delimiter) {
   if (str == NULL) {
@@ -74,28 +76,59 @@ list_t* delimitedStringToList(const char* str, char delimiter) {
   return list;
 }
 
+/**
+ * @brief splits @p str in place into a list of views
+ * Unlike @c delimitedStringToList no copies are made: the delimiters in
+ * @p str are overwritten with NUL bytes and the list elements point into
+ * @p str, which therefore has to outlive the returned list. Empty elements
+ * are skipped, matching @c delimitedStringToList.
+ * @param str the delimited string; will be modified
+ * @param delimiter the delimiter
+ * @return a list of pointers into @p str. Has to be freed after usage, but
+ * does not own its elements.
+ */
+list_t* delimitedStringToViewList(char* str, char delimiter) {
+  if (str == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  list_t* list = list_new();
+  list->match  = (matchFunction)strequal;
+  char* elem   = str;
+  while (elem != NULL) {
+    char* next = strchr(elem, delimiter);
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+    if (*elem != '\0') {
+      list_rpush(list, list_node_new(elem));
+    }
+    elem = next;
+  }
+  return list;
+}
+
 char* listToDelimitedString(list_t* list, char delimiter) {
   if (list == NULL) {
     return NULL;
   }
+  struct string str;
+  if (init_string(&str) != OIDC_SUCCESS) {
+    return NULL;
+  }
   list_node_t* node = list_at(list, 0);
-  char*        str  = NULL;
-  char*        tmp  = NULL;
-  if (node == NULL) {
-    str = oidc_sprintf("");
-  } else {
-    str = oidc_sprintf("%s", (char*)node->val);
+  if (node != NULL) {
+    string_append(&str, (char*)node->val);
   }
   unsigned int i;
   for (i = 1; i < list->len; i++) {
-    tmp = oidc_sprintf("%s%c%s", str, delimiter, (char*)list_at(list, i)->val);
-    secFree(str);
-    if (tmp == NULL) {
+    if (string_appendf(&str, "%c%s", delimiter,
+                       (char*)list_at(list, i)->val) != OIDC_SUCCESS) {
+      _secFree(string_finish(&str));
       return NULL;
     }
-    str = tmp;
   }
-  return str;
+  return string_finish(&str);
 }
 
 void* passThrough(void* ptr) { return ptr; }
@@ -126,15 +159,13 @@ list_t* intersectLists(list_t* a, list_t* b) {
   list_t* l = list_new();
   l->free   = _secFree;
   l->match  = a->match;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(a, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
+  list_node_t* node;
+  LIST_FOREACH(a, node) {
     list_node_t* n = findInList(b, node->val);
     if (n) {
       list_rpush(l, list_node_new(oidc_strcopy(n->val)));
     }
   }
-  list_iterator_destroy(it);
   return l;
 }
 
@@ -145,15 +176,13 @@ list_t* subtractLists(list_t* a, list_t* b) {
   list_t* l = list_new();
   l->free   = a->free;
   l->match  = a->match;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(a, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
+  list_node_t* node;
+  LIST_FOREACH(a, node) {
     list_node_t* n = findInList(b, node->val);
     if (n == NULL) {
       list_rpush(l, list_node_new(oidc_strcopy(node->val)));
     }
   }
-  list_iterator_destroy(it);
   return l;
 }
 
@@ -197,9 +226,8 @@ list_t* findAllInList(list_t* l, const void* v) {
   founds->match  = l->match;
   // Don't copy the free function over. We copy the same value pointer, the
   // values should not be freed, only the list
-  list_iterator_t* it = list_iterator_new(l, LIST_HEAD);
-  list_node_t*     node;
-  while ((node = list_iterator_next(it))) {
+  list_node_t* node;
+  LIST_FOREACH(l, node) {
     if (l->match) {
       if (l->match(v, node->val)) {
         list_rpush(founds, list_node_new(node->val));
@@ -210,7 +238,6 @@ list_t* findAllInList(list_t* l, const void* v) {
       }
     }
   }
-  list_iterator_destroy(it);
   if (!listValid(founds)) {
     secFreeList(founds);
     founds = NULL;
@@ -229,77 +256,101 @@ void list_removeIfFound(list_t* l, const void* v) {
   return list_remove(l, node);
 }
 
-// Merges two subarrays of arr[].
-// First subarray is arr[l..m]
-// Second subarray is arr[m+1..r]
-void _merge(void* arr[], int l, int m, int r,
-            int (*comp)(const void*, const void*)) {
-  int i, j, k;
-  int n1 = m - l + 1;
-  int n2 = r - m;
-
-  /* create temp arrays */
-  void* L[n1];
-  void* R[n2];
-
-  /* Copy data to temp arrays L[] and R[] */
-  for (i = 0; i < n1; i++) L[i] = arr[l + i];
-  for (j = 0; j < n2; j++) R[j] = arr[m + 1 + j];
+/**
+ * @brief cuts a chain after at most @p width nodes
+ * @return the head of the rest; might be @c NULL
+ */
+static list_node_t* _splitChain(list_node_t* node, size_t width) {
+  while (node != NULL && --width) { node = node->next; }
+  if (node == NULL) {
+    return NULL;
+  }
+  list_node_t* rest = node->next;
+  node->next        = NULL;
+  return rest;
+}
 
-  /* Merge the temp arrays back into arr[l..r]*/
-  i = 0;  // Initial index of first subarray
-  j = 0;  // Initial index of second subarray
-  k = l;  // Initial index of merged subarray
-  while (i < n1 && j < n2) {
-    if (comp(L[i], R[j]) <= 0) {
-      arr[k] = L[i];
-      i++;
+/**
+ * @brief merges two sorted chains behind @p tail
+ * Only next pointers are relinked; no values are moved and nothing is
+ * allocated.
+ * @return the new tail of the merged chain
+ */
+static list_node_t* _mergeChains(list_node_t* tail, list_node_t* a,
+                                 list_node_t* b,
+                                 int (*comp)(const void*, const void*)) {
+  while (a != NULL && b != NULL) {
+    if (comp(a->val, b->val) <= 0) {
+      tail->next = a;
+      a          = a->next;
     } else {
-      arr[k] = R[j];
-      j++;
+      tail->next = b;
+      b          = b->next;
     }
-    k++;
+    tail = tail->next;
   }
+  tail->next = a != NULL ? a : b;
+  while (tail->next != NULL) { tail = tail->next; }
+  return tail;
+}
 
-  /* Copy the remaining elements of L[], if there
-  are any */
-  while (i < n1) {
-    arr[k] = L[i];
-    i++;
-    k++;
+/**
+ * @brief sorts a list by relinking its nodes
+ * Bottom-up merge sort on the node chain: stable, O(n log n), and free of
+ * temporary arrays - nodes are only relinked, values never move.
+ */
+void list_mergeSort(list_t* l, int (*comp)(const void*, const void*)) {
+  if (l == NULL || l->len < 2) {
+    return;
   }
-
-  /* Copy the remaining elements of R[], if there
-  are any */
-  while (j < n2) {
-    arr[k] = R[j];
-    j++;
-    k++;
+  list_node_t* head = l->head;
+  for (size_t width = 1; width < l->len; width *= 2) {
+    list_node_t  dummy = {NULL, NULL, NULL};
+    list_node_t* tail  = &dummy;
+    list_node_t* cur   = head;
+    while (cur != NULL) {
+      list_node_t* left  = cur;
+      list_node_t* right = _splitChain(left, width);
+      cur                = _splitChain(right, width);
+      tail               = _mergeChains(tail, left, right, comp);
+    }
+    head = dummy.next;
+  }
+  l->head    = head;
+  head->prev = NULL;
+  list_node_t* node = head;
+  while (node->next != NULL) {
+    node->next->prev = node;
+    node             = node->next;
   }
+  l->tail = node;
 }
 
-/* l is for left index and r is right index of the
-sub-array of arr to be sorted */
-void mergeSort(void* arr[], int l, int r,
-               int (*comp)(const void*, const void*)) {
-  if (l < r) {
-    // Same as (l+r)/2, but avoids overflow for
-    // large l and h
-    int m = l + (r - l) / 2;
-
-    // Sort first and second halves
-    mergeSort(arr, l, m, comp);
-    mergeSort(arr, m + 1, r, comp);
-
-    _merge(arr, l, m, r, comp);
+/**
+ * @brief NULL-safe string ordering; used for sorting short name lists
+ */
+int compareStrings(const void* a, const void* b) {
+  if (a == NULL && b == NULL) {
+    return 0;
   }
+  if (a == NULL || b == NULL) {
+    return a == NULL ? -1 : 1;
+  }
+  return strcmp(a, b);
 }
 
-void list_mergeSort(list_t* l, int (*comp)(const void*, const void*)) {
-  void* arr[l->len];
-  for (size_t i = 0; i < l->len; i++) { arr[i] = list_at(l, i)->val; }
-  mergeSort(arr, 0, l->len - 1, comp);
-  for (size_t i = 0; i < l->len; i++) { list_at(l, i)->val = arr[i]; }
+/**
+ * @brief case-insensitive NULL-safe string ordering; used for sorting
+ * issuer url lists
+ */
+int compareStringsCaseInsensitive(const void* a, const void* b) {
+  if (a == NULL && b == NULL) {
+    return 0;
+  }
+  if (a == NULL || b == NULL) {
+    return a == NULL ? -1 : 1;
+  }
+  return strcasecmp(a, b);
 }
 
 void secFreeList(list_t* l) {
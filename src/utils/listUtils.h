@@ -11,6 +11,7 @@ typedef void (*freeFunction)(void*);
 
 char*        delimitedStringToJSONArray(char* str, char delimiter);
 list_t*      delimitedStringToList(const char* str, char delimiter);
+list_t*      delimitedStringToViewList(char* str, char delimiter);
 char*        listToDelimitedString(list_t* list, char delimiter);
 list_t*      intersectLists(list_t* a, list_t* b);
 list_t*      subtractLists(list_t* a, list_t* b);
@@ -20,6 +21,8 @@ list_node_t* findInList(list_t* l, const void* v);
 list_t*      findAllInList(list_t* l, const void* v);
 void         list_removeIfFound(list_t* l, const void* v);
 void         list_mergeSort(list_t* l, int (*comp)(const void*, const void*));
+int          compareStrings(const void* a, const void* b);
+int          compareStringsCaseInsensitive(const void* a, const void* b);
 void         secFreeList(list_t* l);
 list_t*      createList(int copyValues, char* s, ...);
 list_t*      list_addStringIfNotFound(list_t* l, char* v);
@@ -7,23 +7,216 @@
 #include <stdarg.h>
 
 #ifdef __linux__
+#include "utils/agent_trace.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
 #include <syslog.h>
 
-void logger_open(const char* logger_name) {
-  openlog(logger_name, LOG_CONS | LOG_PID, LOG_AUTHPRIV);
+static const char* logger_name;
+static int         logger_opened;
+static int         logger_mask = 0xff;
+
+/*
+ * Asynchronous logging (logger_startAsync): vsyslog is a synchronous write
+ * to the syslog socket, so at DEBUG level - several lines per handled
+ * message - a slow syslog daemon stalls the request loop. In async mode
+ * producers only format the line and publish it into a fixed lock-free
+ * ring (claim a slot by sequence number, publish with a release store); a
+ * detached drainer thread hands the lines to syslog in order. When the
+ * ring is full the line is dropped and counted; the drainer reports the
+ * drops, so overload is visible but never blocks request handling.
+ */
+
+#ifndef LOGGER_RING_SIZE
+#define LOGGER_RING_SIZE 256  // must be a power of two
+#endif
+
+struct log_slot {
+  size_t seq;
+  int    level;
+  char*  msg;
+};
+
+static struct log_slot logger_ring[LOGGER_RING_SIZE];
+static size_t          logger_head;
+static size_t          logger_tail;
+static sem_t           logger_sem;
+static int             logger_async;
+static unsigned long   logger_dropped;
+
+static void (*logger_dump_cb)()                    = NULL;
+static volatile sig_atomic_t logger_dump_requested = 0;
+
+/** @brief registers the callback run on the drainer thread when a dump is
+ * requested */
+void logger_setDumpCallback(void (*cb)()) { logger_dump_cb = cb; }
+
+/**
+ * @brief asks the log drainer thread to run the dump callback
+ *
+ * Async-signal-safe (sem_post is), so a signal handler can trigger a dump
+ * even while the threads doing the actual work are wedged in blocking
+ * calls. Without async logging the request is remembered but nothing runs
+ * it.
+ */
+void logger_requestDump() {
+  logger_dump_requested = 1;
+  if (__atomic_load_n(&logger_async, __ATOMIC_ACQUIRE)) {
+    sem_post(&logger_sem);
+  }
+}
+
+static int _logger_enqueue(int level, char* msg) {
+  size_t pos = __atomic_load_n(&logger_head, __ATOMIC_RELAXED);
+  while (1) {
+    struct log_slot* slot = &logger_ring[pos & (LOGGER_RING_SIZE - 1)];
+    size_t           seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t         dif  = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&logger_head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        slot->level = level;
+        slot->msg   = msg;
+        __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {  // ring full
+      return 0;
+    } else {  // another producer took the slot; reload the head
+      pos = __atomic_load_n(&logger_head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void* _logger_drain(void* ignored) {
+  (void)ignored;
+  while (1) {
+    sem_wait(&logger_sem);
+    if (logger_dump_requested) {
+      logger_dump_requested = 0;
+      if (logger_dump_cb != NULL) {
+        logger_dump_cb();
+      }
+    }
+    if (__atomic_load_n(&logger_head, __ATOMIC_ACQUIRE) == logger_tail) {
+      continue;  // woken for a dump request, not for a message
+    }
+    struct log_slot* slot =
+        &logger_ring[logger_tail & (LOGGER_RING_SIZE - 1)];
+    while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != logger_tail + 1) {
+      sched_yield();  // producer claimed the slot but has not published yet
+    }
+    char* msg   = slot->msg;
+    int   level = slot->level;
+    slot->msg   = NULL;
+    __atomic_store_n(&slot->seq, logger_tail + LOGGER_RING_SIZE,
+                     __ATOMIC_RELEASE);
+    logger_tail++;
+    syslog(LOG_AUTHPRIV | level, "%s", msg);
+    secFree(msg);
+    unsigned long dropped =
+        __atomic_exchange_n(&logger_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+      syslog(LOG_AUTHPRIV | WARNING,
+             "async logger dropped %lu messages under load", dropped);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief takes syslog off the calling threads' paths
+ *
+ * After this call @c logger only formats the line and hands it to a
+ * background thread; a stalled syslog daemon no longer stalls request
+ * handling. Has to be called in the process that does the logging (i.e.
+ * after forking the daemon).
+ */
+void logger_startAsync() {
+  if (logger_async) {
+    return;
+  }
+  for (size_t i = 0; i < LOGGER_RING_SIZE; i++) { logger_ring[i].seq = i; }
+  if (sem_init(&logger_sem, 0, 0) != 0) {
+    return;  // stay synchronous
+  }
+  pthread_t drainer;
+  if (pthread_create(&drainer, NULL, _logger_drain, NULL) != 0) {
+    sem_destroy(&logger_sem);
+    return;
+  }
+  pthread_detach(drainer);
+  __atomic_store_n(&logger_async, 1, __ATOMIC_RELEASE);
 }
 
+/**
+ * @brief only stores the logger name; the syslog connection is made on the
+ * first actual log call. Short lived invocations that never log (e.g.
+ * --help runs from shell completions) then never pay for it. As with
+ * @c openlog the name has to stay valid for the lifetime of the process.
+ */
+void logger_open(const char* name) { logger_name = name; }
+
 void logger(int log_level, const char* msg, ...) {
+  if (!logger_opened) {
+    logger_opened = 1;
+    openlog(logger_name, LOG_CONS | LOG_PID, LOG_AUTHPRIV);
+  }
   va_list args;
   va_start(args, msg);
+  const char* tid = agent_trace_get();
+  if (__atomic_load_n(&logger_async, __ATOMIC_ACQUIRE)) {
+    // syslog would apply the log mask itself; mirror it here so masked
+    // lines are not even formatted
+    if (LOG_MASK(log_level) & logger_mask) {
+      char* formatted = oidc_vsprintf(msg, args);
+      if (tid != NULL && formatted != NULL) {
+        char* traced = oidc_sprintf("[%s] %s", tid, formatted);
+        if (traced != NULL) {
+          _secFree(formatted);
+          formatted = traced;
+        }
+      }
+      if (formatted == NULL || !_logger_enqueue(log_level, formatted)) {
+        _secFree(formatted);
+        __atomic_fetch_add(&logger_dropped, 1, __ATOMIC_RELAXED);
+      } else {
+        sem_post(&logger_sem);
+      }
+    }
+    va_end(args);
+    return;
+  }
+  if (tid != NULL) {  // the id is plain hex, so it is safe in the format
+    char* traced_fmt = oidc_sprintf("[%s] %s", tid, msg);
+    if (traced_fmt != NULL) {
+      vsyslog(LOG_AUTHPRIV | log_level, traced_fmt, args);
+      secFree(traced_fmt);
+      va_end(args);
+      return;
+    }
+  }
   vsyslog(LOG_AUTHPRIV | log_level, msg, args);
+  va_end(args);
+}
+
+int logger_setlogmask(int mask) {
+  logger_mask = mask;
+  return setlogmask(mask);
 }
 
-int logger_setlogmask(int mask) { return setlogmask(mask); }
+int logger_setloglevel(int level) { return logger_setlogmask(LOG_UPTO(level)); }
 
-int logger_setloglevel(int level) { return setlogmask(LOG_UPTO(level)); }
+int logger_debugEnabled() { return LOG_MASK(DEBUG) & logger_mask; }
 
 #elif __APPLE__
+#include "utils/agent_trace.h"
 #include "utils/memory.h"
 #include "utils/stringUtils.h"
 
@@ -59,6 +252,14 @@ void own_log(int _log_level, const char* msg, va_list args) {
     case EMERGENCY: level = "EMERG"; break;
     default: level = ""; break;
   }
+  const char* tid = agent_trace_get();
+  if (tid != NULL) {
+    char* traced = oidc_sprintf("[%s] %s", tid, logmsg);
+    if (traced != NULL) {
+      secFree(logmsg);
+      logmsg = traced;
+    }
+  }
   char* log = oidc_sprintf(fmt, time_str, logger_name, level, logmsg);
   secFree(time_str);
   secFree(logmsg);
@@ -86,4 +287,13 @@ int logger_setloglevel(int level) {
   log_level = level;
   return old;
 }
+
+void logger_startAsync() { /* only implemented for syslog logging */
+}
+
+void logger_setDumpCallback(void (*cb)()) { (void)cb; }
+
+void logger_requestDump() {}
+
+int logger_debugEnabled() { return DEBUG >= log_level; }
 #endif
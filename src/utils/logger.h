@@ -25,8 +25,31 @@
 #endif
 
 void logger_open(const char* logger_name);
+void logger_startAsync();
+void logger_setDumpCallback(void (*cb)());
+void logger_requestDump();
 void logger(int log_level, const char* msg,...);
 int logger_setlogmask(int);
 int logger_setloglevel(int);
+int logger_debugEnabled();
+
+/*
+ * DEBUG_LOG is for debug lines on hot paths: it checks the current log
+ * level before evaluating its arguments, so dereferences and format
+ * argument computation cost nothing while debug logging is off. Built with
+ * `make NO_DEBUG_LOG=1` the call sites compile out entirely.
+ */
+#ifdef NO_DEBUG_LOG
+#define DEBUG_LOG(...) \
+  do {                 \
+  } while (0)
+#else
+#define DEBUG_LOG(...)            \
+  do {                            \
+    if (logger_debugEnabled()) {  \
+      logger(DEBUG, __VA_ARGS__); \
+    }                             \
+  } while (0)
+#endif  // NO_DEBUG_LOG
 
 #endif // OIDC_LOGGER_H
@@ -5,7 +5,7 @@
 #include <stddef.h>
 
 int matchStrings(const char* a, const char* b) {
-  if (a == NULL && b == NULL) {
+  if (a == b) {  // interned identifiers match without a scan
     return 1;
   }
   if (a == NULL) {
@@ -18,7 +18,7 @@ int matchStrings(const char* a, const char* b) {
 }
 
 int matchUrls(const char* a, const char* b) {
-  if (a == NULL && b == NULL) {
+  if (a == b) {
     return 1;
   }
   if (a == NULL) {
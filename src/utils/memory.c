@@ -3,26 +3,110 @@
 #include "oidc_error.h"
 #include "utils/logger.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-void* secCalloc(size_t nmemb, size_t size) { return secAlloc(nmemb * size); }
+/*
+ * Optional allocation accounting (build with -DALLOC_ACCOUNTING): every
+ * allocation is tagged with the file it was made in and a table counts
+ * allocations, bytes and frees per site. The ranked table is part of the
+ * metrics IPC response, so churn sources can be read off a running agent.
+ * The tag travels in the allocation header (in front of the size word), so
+ * frees are attributed to the site that allocated. Without the flag the
+ * header is just the size word and none of this code exists.
+ */
+
+#ifdef ALLOC_ACCOUNTING
+#undef secAlloc
+void* secAlloc(size_t size);
+#include <pthread.h>
+#define ALLOC_HEADER (2 * sizeof(size_t))
+
+#define ALLOC_SITES_MAX 128
+
+struct alloc_site {
+  const char*        site;
+  unsigned long      allocs;
+  unsigned long      frees;
+  unsigned long long bytes;
+};
+
+static struct alloc_site alloc_sites[ALLOC_SITES_MAX];
+static size_t            alloc_sites_len = 0;
+static pthread_mutex_t   alloc_sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// site strings are __FILE__ literals, so pointer comparison is enough for
+// lookups from the same translation unit; a rare duplicate entry for the
+// same file only splits its counters
+static struct alloc_site* _alloc_site_find(const char* site) {
+  for (size_t i = 0; i < alloc_sites_len; i++) {
+    if (alloc_sites[i].site == site) {
+      return &alloc_sites[i];
+    }
+  }
+  if (alloc_sites_len >= ALLOC_SITES_MAX) {
+    return NULL;
+  }
+  alloc_sites[alloc_sites_len].site = site;
+  return &alloc_sites[alloc_sites_len++];
+}
+
+static void _alloc_account(const char* site, size_t size) {
+  pthread_mutex_lock(&alloc_sites_lock);
+  struct alloc_site* s = _alloc_site_find(site);
+  if (s != NULL) {
+    s->allocs++;
+    s->bytes += size;
+  }
+  pthread_mutex_unlock(&alloc_sites_lock);
+}
 
-void* secAlloc(size_t size) {
+void allocAccounting_record(const char* site, size_t size) {
+  _alloc_account(site, size);
+}
+
+static void _free_account(const char* site) {
+  pthread_mutex_lock(&alloc_sites_lock);
+  struct alloc_site* s = _alloc_site_find(site);
+  if (s != NULL) {
+    s->frees++;
+  }
+  pthread_mutex_unlock(&alloc_sites_lock);
+}
+#else
+#define ALLOC_HEADER (sizeof(size_t))
+#endif  // ALLOC_ACCOUNTING
+
+static void* _secAllocTagged(size_t size, const char* site) {
+  (void)site;
   if (size == 0) {
     return NULL;
   }
-  size_t sizesize = sizeof(size);
-  void*  p        = calloc(size + sizesize, 1);
+  char* p = calloc(size + ALLOC_HEADER, 1);
   if (p == NULL) {
     oidc_errno = OIDC_EALLOC;
     logger(ALERT, "Memory alloc failed when trying to allocate %lu bytes",
            size);
     return NULL;
   }
-  *(size_t*)p = size;
-  return p + sizeof(size);
+#ifdef ALLOC_ACCOUNTING
+  *(const char**)(void*)p = site;
+  _alloc_account(site, size);
+#endif
+  *(size_t*)(void*)(p + ALLOC_HEADER - sizeof(size_t)) = size;
+  return p + ALLOC_HEADER;
+}
+
+void* secCalloc(size_t nmemb, size_t size) { return secAlloc(nmemb * size); }
+
+void* secAlloc(size_t size) { return _secAllocTagged(size, "(untagged)"); }
+
+#ifdef ALLOC_ACCOUNTING
+void* _secAllocLoc(size_t size, const char* site) {
+  return _secAllocTagged(size, site);
 }
+#endif
 
 void* secRealloc(void* p, size_t size) {
   if (p == NULL) {
@@ -34,7 +118,12 @@ void* secRealloc(void* p, size_t size) {
   }
   size_t oldsize = *(size_t*)(p - sizeof(size_t));
   size_t movelen = oldsize < size ? oldsize : size;
-  void*  newp    = secAlloc(size);
+#ifdef ALLOC_ACCOUNTING
+  // the grown allocation keeps the site of the original one
+  void* newp = _secAllocTagged(size, *(const char**)(p - ALLOC_HEADER));
+#else
+  void* newp = secAlloc(size);
+#endif
   if (newp == NULL) {
     return NULL;
   }
@@ -43,6 +132,155 @@ void* secRealloc(void* p, size_t size) {
   return newp;
 }
 
+/**
+ * @brief renders the per-site allocation counters as a json array
+ * @return a json array string ranked by allocated bytes, or @c NULL when the
+ * agent was not built with @c ALLOC_ACCOUNTING. Has to be freed after usage.
+ */
+char* allocAccounting_toJSON() {
+#ifndef ALLOC_ACCOUNTING
+  return NULL;
+#else
+  struct alloc_site snapshot[ALLOC_SITES_MAX];
+  pthread_mutex_lock(&alloc_sites_lock);
+  size_t len = alloc_sites_len;
+  memcpy(snapshot, alloc_sites, len * sizeof(*snapshot));
+  pthread_mutex_unlock(&alloc_sites_lock);
+  // selection sort by bytes, descending; the table is small
+  for (size_t i = 0; i + 1 < len; i++) {
+    size_t max = i;
+    for (size_t j = i + 1; j < len; j++) {
+      if (snapshot[j].bytes > snapshot[max].bytes) {
+        max = j;
+      }
+    }
+    struct alloc_site tmp = snapshot[i];
+    snapshot[i]           = snapshot[max];
+    snapshot[max]         = tmp;
+  }
+  // built by hand so the allocator's report does not depend on the json
+  // module, which itself allocates
+  size_t cap = 2 + len * 128;
+  char*  buf = secAlloc(cap);
+  if (buf == NULL) {
+    return NULL;
+  }
+  size_t off = 0;
+  off += snprintf(buf + off, cap - off, "[");
+  for (size_t i = 0; i < len && off < cap - 1; i++) {
+    off += snprintf(buf + off, cap - off,
+                    "%s{\"site\":\"%s\",\"allocs\":%lu,\"frees\":%lu,"
+                    "\"bytes\":%llu}",
+                    i ? "," : "", snapshot[i].site, snapshot[i].allocs,
+                    snapshot[i].frees, snapshot[i].bytes);
+  }
+  if (off < cap - 1) {
+    buf[off] = ']';
+  }
+  return buf;
+#endif
+}
+
+/*
+ * Per-request allocation arena.
+ *
+ * Serving one request makes many small allocations - messages, temporary
+ * strings - that are all dead by the time the response is written, yet each
+ * pays malloc, a wipe and free on its own. While a thread's arena is active
+ * (secArena_begin), secAlloc_scoped bump-allocates from thread-local chunks
+ * that secArena_end wipes and recycles in one go. Arena allocations carry
+ * the same size prefix as secAlloc'd ones, so all string helpers work on
+ * them and secFree stays the universal free: it recognizes arena pointers
+ * and only wipes them, leaving the memory to the bulk recycle. Outside an
+ * active arena secAlloc_scoped falls back to secAlloc, so code shared with
+ * threads that never open an arena behaves as before.
+ */
+
+#ifndef SEC_ARENA_CHUNK_SIZE
+#define SEC_ARENA_CHUNK_SIZE (64 * 1024)
+#endif
+
+struct sec_arena_chunk {
+  struct sec_arena_chunk* next;
+  size_t                  cap;
+  size_t                  used;
+  /* the chunk memory follows the header */
+};
+
+static __thread struct sec_arena_chunk* sec_arena_chunks = NULL;
+static __thread int                     sec_arena_active = 0;
+
+static int _secArena_owns(const void* p) {
+  for (struct sec_arena_chunk* chunk = sec_arena_chunks; chunk != NULL;
+       chunk = chunk->next) {
+    const char* mem = (const char*)(chunk + 1);
+    if ((const char*)p >= mem && (const char*)p < mem + chunk->cap) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief routes secAlloc_scoped allocations of the calling thread into its
+ * arena until the matching @c secArena_end
+ */
+void secArena_begin() { sec_arena_active = 1; }
+
+/**
+ * @brief wipes the calling thread's arena and leaves arena mode
+ *
+ * The chunks are kept for the next request; their used part is zeroed so
+ * no secret material lingers and the next allocations start out zeroed.
+ */
+void secArena_end() {
+  sec_arena_active = 0;
+  for (struct sec_arena_chunk* chunk = sec_arena_chunks; chunk != NULL;
+       chunk = chunk->next) {
+    if (chunk->used) {
+      moresecure_memzero((char*)(chunk + 1), chunk->used);
+      chunk->used = 0;
+    }
+  }
+}
+
+/**
+ * @brief allocates memory that does not outlive the current request scope
+ *
+ * Like @c secAlloc, but while the calling thread's arena is active the
+ * memory is a pointer bump in a recycled chunk. The result is freed with
+ * @c secFree like any other allocation; the allocation must not outlive
+ * the scope it was made in.
+ * @param size the number of bytes to be allocated
+ * @return a pointer to the zeroed allocated memory
+ */
+void* secAlloc_scoped(size_t size) {
+  if (!sec_arena_active || size == 0) {
+    return secAlloc(size);
+  }
+  size_t need = (size + ALLOC_HEADER + 7) & ~(size_t)7;  // keep allocations
+                                                         // 8-byte aligned
+  struct sec_arena_chunk* chunk = sec_arena_chunks;
+  if (chunk == NULL || chunk->cap - chunk->used < need) {
+    size_t cap = need > SEC_ARENA_CHUNK_SIZE ? need : SEC_ARENA_CHUNK_SIZE;
+    chunk      = secAlloc(sizeof(struct sec_arena_chunk) + cap);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->cap       = cap;
+    chunk->next      = sec_arena_chunks;
+    sec_arena_chunks = chunk;
+  }
+  char* p = (char*)(chunk + 1) + chunk->used;
+  chunk->used += need;
+#ifdef ALLOC_ACCOUNTING
+  *(const char**)(void*)p = "(arena)";
+  _alloc_account("(arena)", size);
+#endif
+  *(size_t*)(void*)(p + ALLOC_HEADER - sizeof(size_t)) = size;
+  return p + ALLOC_HEADER;
+}
+
 void _secFreeArray(char** arr, size_t size) {
   size_t i;
   for (i = 0; i < size; i++) { secFree(arr[i]); }
@@ -53,12 +291,27 @@ void _secFree(void* p) {
   if (p == NULL) {
     return;
   }
-  void*  fp  = p - sizeof(size_t);
-  size_t len = *(size_t*)fp;
-  secFreeN(fp, len);
+  char*  fp  = (char*)p - ALLOC_HEADER;
+  size_t len = *(size_t*)((char*)p - sizeof(size_t));
+  if (sec_arena_chunks != NULL && _secArena_owns(fp)) {
+    // arena memory is recycled in bulk by secArena_end; only wipe it
+    moresecure_memzero(fp, len + ALLOC_HEADER);
+    return;
+  }
+#ifdef ALLOC_ACCOUNTING
+  _free_account(*(const char**)(void*)fp);
+#endif
+  moresecure_memzero(fp, len + ALLOC_HEADER);
+  free(fp);
 }
-/** @fn void secFree(void* p, size_t len)
- * @brief clears and frees allocated memory.
+
+/** @fn void _secFreeN(void* p, size_t len)
+ * @brief clears and frees allocated memory of a known length
+ *
+ * The full @p len bytes are wiped, so this is also correct for binary
+ * buffers containing NUL bytes. @c _secFree obtains the length from the
+ * allocation's size prefix; this variant is for raw buffers that were not
+ * allocated with @c secAlloc.
  * @param p a pointer to the memory to be freed
  * @param len the length of the allocated memory
  */
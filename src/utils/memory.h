@@ -6,10 +6,25 @@
 void* secAlloc(size_t size);
 void* secCalloc(size_t nmemb, size_t size);
 void* secRealloc(void* p, size_t size);
+void  secArena_begin();
+void  secArena_end();
+void* secAlloc_scoped(size_t size);
 void  _secFree(void* p);
 void  _secFreeN(void* p, size_t len);
 void  _secFreeArray(char** arr, size_t size);
 void* oidc_memcopy(void* src, size_t size);
+char* allocAccounting_toJSON();
+
+#ifdef ALLOC_ACCOUNTING
+// built with allocation accounting every direct secAlloc call is tagged
+// with the file it is made in; taking the address of secAlloc still yields
+// the untagged function
+void* _secAllocLoc(size_t size, const char* site);
+#define secAlloc(size) _secAllocLoc((size), __FILE__)
+// for allocators layered on top of secAlloc (object pools) to report the
+// traffic they absorb
+void allocAccounting_record(const char* site, size_t size);
+#endif  // ALLOC_ACCOUNTING
 
 #ifndef secFree
 #define secFree(ptr) \
@@ -46,6 +46,37 @@ unsigned long long stringToNumber(char* str) {
   return i;
 }
 
+/**
+ * @brief formats an unsigned number as a decimal string
+ *
+ * Emits two digits per division via a precomputed pair table instead of
+ * going through the printf machinery, for the numbers embedded in agent
+ * responses (ports, expiration times).
+ * @return a pointer to the decimal string. Has to be freed after usage.
+ */
+char* ulongToString(unsigned long l) {
+  static const char pairs[] =
+      "00010203040506070809101112131415161718192021222324"
+      "25262728293031323334353637383940414243444546474849"
+      "50515253545556575859606162636465666768697071727374"
+      "75767778798081828384858687888990919293949596979899";
+  char  buf[21];  // fits 2^64-1 and the terminating zero
+  char* end = buf + sizeof(buf) - 1;
+  char* pos = end;
+  *pos      = '\0';
+  while (l >= 100) {
+    const char* pair = pairs + (l % 100) * 2;
+    *--pos           = pair[1];
+    *--pos           = pair[0];
+    l /= 100;
+  }
+  *--pos = '0' + l % 10;
+  if (l >= 10) {
+    *--pos = '0' + l / 10;
+  }
+  return oidc_strncopy(pos, end - pos);
+}
+
 char* numberToString(unsigned long long l) {
   char  str[10];
   short i = sizeof(str) - 1;
@@ -3,5 +3,6 @@
 
 char*              numberToString(unsigned long long l);
 unsigned long long stringToNumber(char* str);
+char*              ulongToString(unsigned long l);
 
 #endif  // NUMBER_STRING_H
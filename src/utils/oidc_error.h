@@ -67,6 +67,7 @@ enum _oidc_error {
   OIDC_EMSGSIZE = -67,
   OIDC_ESELECT  = -68,
   OIDC_EIOCTL   = -69,
+  OIDC_ECOMPACT = -602,
   OIDC_ETIMEOUT = -600,
   OIDC_EGROUPNF = -601,
 
@@ -107,8 +108,11 @@ enum _oidc_error {
 
 typedef enum _oidc_error oidc_error_t;
 
-int  oidc_errno;
-char oidc_error[1024];
+// Thread-local so concurrent threads - library users as well as the agent's
+// worker pool - each see the error state of their own last call instead of
+// racing on one global.
+extern __thread int  oidc_errno;
+extern __thread char oidc_error[1024];
 
 static inline void oidc_seterror(const char* error) {
   moresecure_memzero(oidc_error, sizeof(oidc_error));
@@ -187,6 +191,7 @@ static inline char* oidc_serrorFor(oidc_error_t err) {
     case OIDC_ECONSOCK: return "Could not connect to oidc-agent";
     case OIDC_ECRSOCK: return "Could not create ipc-socket";
     case OIDC_EMSGSIZE: return "Message size exceeds maximum package size";
+    case OIDC_ECOMPACT: return "could not decode compact ipc message";
     case OIDC_ESOCKINV: return "Invalid socket";
     case OIDC_EIOCTL: return "error ioctl";
     case OIDC_EIPCDIS: return "the other party disconnected";
@@ -1,11 +1,15 @@
 #include "oidc_string.h"
 #include "utils/logger.h"
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 oidc_error_t init_string(struct string* s) {
   s->len = 0;
-  s->ptr = secAlloc(s->len + 1);
+  s->cap = 1;
+  s->ptr = secAlloc(s->cap);
 
   if (s->ptr == NULL) {
     logger(EMERGENCY, "%s (%s:%d) alloc() failed: %m\n", __func__, __FILE__,
@@ -15,3 +19,99 @@ oidc_error_t init_string(struct string* s) {
   }
   return OIDC_SUCCESS;
 }
+
+/**
+ * @brief grows the string's buffer to at least @p cap bytes
+ *
+ * Does nothing if the buffer is already large enough, so callers can reserve
+ * capacity up front and append without further reallocations.
+ */
+oidc_error_t string_reserve(struct string* s, size_t cap) {
+  if (cap <= s->cap) {
+    return OIDC_SUCCESS;
+  }
+  void* tmp = secRealloc(s->ptr, cap);
+  if (tmp == NULL) {
+    logger(EMERGENCY, "%s (%s:%d) realloc() failed: %m\n", __func__, __FILE__,
+           __LINE__);
+    oidc_errno = OIDC_EALLOC;
+    return OIDC_EALLOC;
+  }
+  s->ptr = tmp;
+  s->cap = cap;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief grows the buffer by doubling until it holds at least @p cap bytes
+ *
+ * Doubling keeps a sequence of appends linear in the total length instead of
+ * quadratic, which is what the sprintf-per-concatenation pattern costs.
+ */
+static oidc_error_t _string_grow(struct string* s, size_t cap) {
+  if (cap <= s->cap) {
+    return OIDC_SUCCESS;
+  }
+  size_t newcap = s->cap ? s->cap : 1;
+  while (newcap < cap) { newcap *= 2; }
+  return string_reserve(s, newcap);
+}
+
+/**
+ * @brief appends @p str to the string
+ * @return @c OIDC_SUCCESS on success, an error code otherwise
+ */
+oidc_error_t string_append(struct string* s, const char* str) {
+  if (s == NULL || str == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  size_t len = strlen(str);
+  if (_string_grow(s, s->len + len + 1) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  memcpy(s->ptr + s->len, str, len + 1);
+  s->len += len;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief appends a formatted string to the string
+ * @return @c OIDC_SUCCESS on success, an error code otherwise
+ */
+oidc_error_t string_appendf(struct string* s, const char* fmt, ...) {
+  if (s == NULL || fmt == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  va_list args;
+  va_start(args, fmt);
+  va_list orig;
+  va_copy(orig, args);
+  size_t len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+  if (_string_grow(s, s->len + len + 1) != OIDC_SUCCESS) {
+    va_end(orig);
+    return oidc_errno;
+  }
+  vsprintf(s->ptr + s->len, fmt, orig);
+  va_end(orig);
+  s->len += len;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief hands the built string over to the caller and resets the builder
+ * @return the built string. Has to be freed after usage.
+ */
+char* string_finish(struct string* s) {
+  if (s == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  char* str = s->ptr;
+  s->ptr    = NULL;
+  s->len    = 0;
+  s->cap    = 0;
+  return str;
+}
@@ -7,8 +7,13 @@
 struct string {
   char*  ptr;
   size_t len;
+  size_t cap;  // allocated size of ptr, including the terminating zero byte
 };
 
 oidc_error_t init_string(struct string* s);
+oidc_error_t string_reserve(struct string* s, size_t cap);
+oidc_error_t string_append(struct string* s, const char* str);
+oidc_error_t string_appendf(struct string* s, const char* fmt, ...);
+char*        string_finish(struct string* s);
 
 #endif  // OIDC_STRING_H
@@ -1,12 +1,23 @@
 #include "password_entry.h"
+#include "utils/crypt/memoryCrypt.h"
 #include "utils/json.h"
 #include "utils/logger.h"
+#include "utils/slab.h"
+
+// one password entry is parsed per password request; keep the structs in a
+// pool so repeated prompts do not churn the allocator
+static struct slab_pool password_entry_pool =
+    SLAB_POOL_INIT(struct password_entry);
 
 void _secFreePasswordEntry(struct password_entry* pw) {
+  if (pw == NULL) {
+    return;
+  }
   secFree(pw->shortname);
   secFree(pw->password);
   secFree(pw->command);
-  secFree(pw);
+  secFreeMemCryptBlob(pw->mem_cipher);
+  slab_free(&password_entry_pool, pw);
 }
 
 void pwe_setPassword(struct password_entry* pw, char* password) {
@@ -15,6 +26,8 @@ void pwe_setPassword(struct password_entry* pw, char* password) {
   }
   secFree(pw->password);
   pw->password = password;
+  secFreeMemCryptBlob(pw->mem_cipher);  // the fast-path container mirrors
+                                        // the password
   logger(DEBUG, "Setting password. Expires_at is %lu. Expires after is %lu",
          pw->expires_at, pw->expires_after);
   if (pw->expires_at == 0 && pw->expires_after != 0) {
@@ -102,7 +115,7 @@ struct password_entry* JSONStringToPasswordEntry(const char* json) {
                  PW_KEY_EXPIRESAT, PW_KEY_EXPIRESAFTER, PW_KEY_COMMAND);
   GET_JSON_VALUES_RETURN_NULL_ONERROR(json);
   KEY_VALUE_VARS(shortname, type, password, expires_at, expires_after, command);
-  struct password_entry* pw = secAlloc(sizeof(struct password_entry));
+  struct password_entry* pw = slab_alloc(&password_entry_pool);
   pwe_setShortname(pw, _shortname);
   pwe_setPassword(pw, _password);
   pwe_setCommand(pw, _command);
@@ -14,6 +14,10 @@ struct password_entry {
   time_t        expires_at;
   char*         command;
   time_t        expires_after;
+  struct memCryptBlob* mem_cipher;  // oidcp-internal fast-path container
+                                    // for the in-memory password; managed
+                                    // by the password store and never
+                                    // serialized
 };
 
 #define PW_TYPE_MEM 0x01
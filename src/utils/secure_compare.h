@@ -0,0 +1,56 @@
+#ifndef OIDC_SECURE_COMPARE_H
+#define OIDC_SECURE_COMPARE_H
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Constant-time equality for secret-derived buffers.
+ *
+ * An early-exit memcmp/strcmp leaks how many leading bytes matched - a
+ * timing side channel when the compared data gates something (a state
+ * string, a password hash, a cached key). The helpers below accumulate the
+ * XOR of all bytes, word-wide where possible, and only inspect the
+ * accumulator at the end: no data-dependent branch, no early exit, and for
+ * long inputs fewer iterations than sodium's byte-wise loop.
+ */
+
+/**
+ * @brief compares two buffers of @p len bytes in constant time
+ * @return @c 1 if the buffers are equal, @c 0 otherwise
+ */
+static inline int secure_equal(const void* a, const void* b, size_t len) {
+  const unsigned char* pa  = a;
+  const unsigned char* pb  = b;
+  unsigned long        acc = 0;
+  size_t               i   = 0;
+  for (; i + sizeof(unsigned long) <= len; i += sizeof(unsigned long)) {
+    unsigned long wa;
+    unsigned long wb;
+    memcpy(&wa, pa + i, sizeof(wa));
+    memcpy(&wb, pb + i, sizeof(wb));
+    acc |= wa ^ wb;
+  }
+  for (; i < len; i++) { acc |= (unsigned long)(pa[i] ^ pb[i]); }
+  return acc == 0;
+}
+
+/**
+ * @brief compares two nullterminated secret strings in constant time
+ * A length difference is still observable - the lengths of the strings
+ * compared here are public - but the content comparison never exits early.
+ * @c NULL equals only @c NULL, matching @c matchStrings.
+ * @return @c 1 if the strings are equal, @c 0 otherwise
+ */
+static inline int strsecequal(const char* a, const char* b) {
+  if (a == b) {
+    return 1;
+  }
+  if (a == NULL || b == NULL) {
+    return 0;
+  }
+  size_t len = strlen(a);
+  return len == strlen(b) && secure_equal(a, b, len);
+}
+
+#endif  // OIDC_SECURE_COMPARE_H
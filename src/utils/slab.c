@@ -0,0 +1,38 @@
+#include "slab.h"
+#include "memory.h"
+#include "memzero.h"
+
+/**
+ * @brief takes an object from the pool, falling back to @c secAlloc
+ * @return a zeroed object of the pool's size. Has to be given back using
+ * @c slab_free.
+ */
+void* slab_alloc(struct slab_pool* pool) {
+  if (pool->free_len > 0) {
+    void* obj                  = pool->free[--pool->free_len];
+    pool->free[pool->free_len] = NULL;
+#ifdef ALLOC_ACCOUNTING
+    allocAccounting_record("(pool reuse)", pool->obj_size);
+#endif
+    return obj;
+  }
+  return secAlloc(pool->obj_size);
+}
+
+/**
+ * @brief wipes an object and keeps it in the pool for reuse
+ *
+ * If the pool is full the object goes back to the heap via @c secFree, which
+ * also wipes it.
+ */
+void slab_free(struct slab_pool* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+  if (pool->free_len >= SLAB_POOL_CAPACITY) {
+    secFree(obj);
+    return;
+  }
+  moresecure_memzero(obj, pool->obj_size);
+  pool->free[pool->free_len++] = obj;
+}
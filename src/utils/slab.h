@@ -0,0 +1,30 @@
+#ifndef OIDC_SLAB_H
+#define OIDC_SLAB_H
+
+#include <stddef.h>
+
+#define SLAB_POOL_CAPACITY 32
+
+/**
+ * @struct slab_pool slab.h
+ * @brief a free-list pool for fixed-size objects
+ *
+ * Freed objects are wiped and kept for reuse instead of going back to the
+ * heap, so hot paths that allocate and release the same small structs per
+ * connection or per message do not churn the allocator. Objects handed out
+ * by @c slab_alloc are zeroed like @c secAlloc ones; a pool can take back
+ * any object of its size that was allocated with @c secAlloc.
+ */
+struct slab_pool {
+  size_t        obj_size;
+  void*         free[SLAB_POOL_CAPACITY];
+  unsigned char free_len;
+};
+
+#define SLAB_POOL_INIT(type) \
+  { sizeof(type), {NULL}, 0 }
+
+void* slab_alloc(struct slab_pool* pool);
+void  slab_free(struct slab_pool* pool, void* obj);
+
+#endif  // OIDC_SLAB_H
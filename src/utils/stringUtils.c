@@ -2,6 +2,8 @@
 #include "stringUtils.h"
 #include "oidc_error.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/memzero.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -64,23 +66,56 @@ char* oidc_sprintf(const char* fmt, ...) {
   return ret;
 }
 
-char* oidc_vsprintf(const char* fmt, va_list args) {
+static char* _oidc_vsprintf(const char* fmt, va_list args,
+                            void* (*alloc)(size_t)) {
   if (fmt == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
   va_list orig;
   va_copy(orig, args);
-  size_t len = vsnprintf(NULL, 0, fmt, args);
-  char*  s   = secAlloc(sizeof(char) * (len + 1));
+  // most formatted strings in the agent are short; format into a stack
+  // buffer first so they are formatted only once instead of being sized
+  // with a dry vsnprintf run and then formatted again
+  char   buf[256];
+  size_t len = vsnprintf(buf, sizeof(buf), fmt, args);
+  char*  s   = alloc(sizeof(char) * (len + 1));
   if (s == NULL) {
+    va_end(orig);
     return NULL;
   }
-  vsprintf(s, fmt, orig);
+  if (len < sizeof(buf)) {
+    memcpy(s, buf, len + 1);
+    moresecure_memzero(buf, len);
+  } else {
+    vsprintf(s, fmt, orig);
+  }
   va_end(orig);
   return s;
 }
 
+char* oidc_vsprintf(const char* fmt, va_list args) {
+  return _oidc_vsprintf(fmt, args, secAlloc);
+}
+
+/**
+ * @brief like @c oidc_sprintf, but the result lives in the calling thread's
+ * request arena while one is active; it must not outlive the request
+ * @return a pointer to a string printed according to the format. Has to be
+ * freed after usage.
+ */
+char* oidc_sprintf_scoped(const char* fmt, ...) {
+  if (fmt == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  va_list args;
+  va_start(args, fmt);
+  char* ret = _oidc_vsprintf(fmt, args, secAlloc_scoped);
+  va_end(args);
+  return ret;
+}
+
 char* oidc_strcat(const char* str, const char* suf) {
   if (str == NULL || suf == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -130,21 +165,25 @@ char* getDateString() {
 /**
  * eliminates a character c if it is followed by character f
  */
+// The strelim family compacts in place with one read and one write cursor,
+// so a string is rewritten once no matter how many characters are
+// eliminated, instead of shifting the whole tail per match.
+
 char* strelimIfFollowed(char* str, char c, char f) {
   if (str == NULL) {
     oidc_setArgNullFuncError(__func__);
     return str;
   }
-  size_t len = strlen(str);
-  size_t i, j;
-  for (i = 0; i < len - 1; i++) {
+  size_t i = 0, j = 0;
+  while (str[i] != '\0') {
     if (str[i] == c && str[i + 1] == f) {
-      for (j = i; j < len - 1; j++) { str[j] = str[j + 1]; }
-      str[j] = '\0';
+      str[j++] = f;  // the follower is kept and not reconsidered
+      i += 2;
+      continue;
     }
+    str[j++] = str[i++];
   }
-  // logger(DEBUG, "In strelim eliminating '%c'; new string is
-  // '%s'", c, str);
+  str[j] = '\0';
   return str;
 }
 
@@ -156,32 +195,31 @@ char* strelimIfAfter(char* str, char c, char f) {
     oidc_setArgNullFuncError(__func__);
     return str;
   }
-  size_t len = strlen(str);
-  size_t i, j;
-  for (i = 1; i < len - 1; i++) {
-    if (str[i] == c && str[i - 1] == f) {
-      for (j = i; j < len - 1; j++) { str[j] = str[j + 1]; }
-      str[j] = '\0';
+  size_t i = 0, j = 0;
+  while (str[i] != '\0') {
+    if (j > 0 && str[i] == c && str[j - 1] == f) {
+      i++;
+      continue;
     }
+    str[j++] = str[i++];
   }
-  // logger(DEBUG, "In strelim eliminating '%c'; new string is
-  // '%s'", c, str);
+  str[j] = '\0';
   return str;
 }
+
 char* strelim(char str[], char c) {
   if (str == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  size_t len = strlen(str);
-  size_t i, j;
-  for (i = 0; i < len; i++) {
-    if (str[i] == c) {
-      for (j = i; j < len; j++) { str[j] = str[j + 1]; }
+  size_t i = 0, j = 0;
+  while (str[i] != '\0') {
+    if (str[i] != c) {
+      str[j++] = str[i];
     }
+    i++;
   }
-  // logger(LOG_AUTHPRIV|LOG_DEBUG, "In strelim eliminating '%c'; new string is
-  // '%s'", c, str);
+  str[j] = '\0';
   return str;
 }
 
@@ -197,7 +235,7 @@ size_t strCountChar(const char* s, char c) {
 }
 
 int strequal(const char* a, const char* b) {
-  if (a == NULL && b == NULL) {
+  if (a == b) {  // also settles interned identifiers and NULL == NULL
     return 1;
   }
   if (a == NULL || b == NULL) {
@@ -221,21 +259,29 @@ char* escapeCharInStr(const char* str, char c) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  char*        s   = oidc_strcopy(str);
-  const char*  pos = s;
-  unsigned int rel = pos - s;
-  while (rel < strlen(s) && (pos = strchr(s + rel, c)) != NULL) {
-    rel       = pos - s;
-    char* tmp = secRealloc(s, strlen(s) + 1 + 1);
-    if (tmp == NULL) {
-      secFree(s);
-      return NULL;
-    }
-    s = tmp;
-    memmove(s + rel + 1, s + rel, strlen(s + rel) + 1);
-    s[rel] = '\\';
-    rel += 2;
+  // two phases: count the characters to be escaped, then copy into one
+  // exact allocation - instead of a realloc and tail shift per escape.
+  // strchr does the scanning in both phases, which libc vectorizes.
+  size_t count = 0;
+  for (const char* pos = str; (pos = strchr(pos, c)) != NULL; pos++) {
+    count++;
+  }
+  char* s = secAlloc(strlen(str) + count + 1);
+  if (s == NULL) {
+    return NULL;
   }
+  char*       out = s;
+  const char* in  = str;
+  const char* pos;
+  while ((pos = strchr(in, c)) != NULL) {
+    size_t chunk = pos - in;
+    memcpy(out, in, chunk);
+    out += chunk;
+    *out++ = '\\';
+    *out++ = c;
+    in     = pos + 1;
+  }
+  strcpy(out, in);
   return s;
 }
 
@@ -306,3 +352,22 @@ unsigned short strToUShort(const char* str) {
   sscanf(str, "%hu", &s);
   return s;
 }
+
+/**
+ * @brief hashes a string (djb2)
+ *
+ * Not cryptographic; used where the same string must map to the same
+ * bucket in every process and across restarts, e.g. for assigning
+ * accounts to oidcd workers.
+ * @return the hash of \p str ; @c 0 for @c NULL
+ */
+unsigned long oidc_strhash(const char* str) {
+  if (str == NULL) {
+    return 0;
+  }
+  unsigned long hash = 5381;
+  for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+    hash = hash * 33 + *p;
+  }
+  return hash;
+}
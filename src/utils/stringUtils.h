@@ -20,6 +20,7 @@ size_t oidc_strlen(const char* str);
 char* strelimIfFollowed(char str[], char c, char f);
 char* strelimIfAfter(char* str, char c, char f);
 char* oidc_sprintf(const char* fmt, ...);
+char* oidc_sprintf_scoped(const char* fmt, ...);
 char* oidc_vsprintf(const char* fmt, va_list args);
 char* oidc_strcat(const char* str, const char* suf);
 char* oidc_strcopy(const char* str);
@@ -31,5 +32,6 @@ unsigned long  strToULong(const char* str);
 int            strToInt(const char* str);
 unsigned char  strToUChar(const char* str);
 unsigned short strToUShort(const char* str);
+unsigned long  oidc_strhash(const char* str);
 
 #endif  // STRING_UTILS_H
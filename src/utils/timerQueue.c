@@ -0,0 +1,208 @@
+#include "timerQueue.h"
+#include "utils/memory.h"
+
+#define TQ_INITIAL_CAPACITY 16
+
+struct tq_entry {
+  time_t death;  // death of value at the time it was (re)pushed
+  void*  value;
+};
+
+struct timerQueue {
+  struct tq_entry* entries;
+  size_t           len;
+  size_t           capacity;
+  time_t (*getDeath)(void*);
+};
+
+struct timerQueue* timerQueue_new(time_t (*deathGetter)(void*)) {
+  struct timerQueue* q = secAlloc(sizeof(struct timerQueue));
+  q->capacity          = TQ_INITIAL_CAPACITY;
+  q->entries           = secAlloc(q->capacity * sizeof(struct tq_entry));
+  q->getDeath          = deathGetter;
+  return q;
+}
+
+static void _tq_swap(struct timerQueue* q, size_t a, size_t b) {
+  struct tq_entry tmp = q->entries[a];
+  q->entries[a]       = q->entries[b];
+  q->entries[b]       = tmp;
+}
+
+static void _tq_siftUp(struct timerQueue* q, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (q->entries[parent].death <= q->entries[i].death) {
+      return;
+    }
+    _tq_swap(q, parent, i);
+    i = parent;
+  }
+}
+
+static void _tq_siftDown(struct timerQueue* q, size_t i) {
+  while (1) {
+    size_t min   = i;
+    size_t left  = 2 * i + 1;
+    size_t right = 2 * i + 2;
+    if (left < q->len && q->entries[left].death < q->entries[min].death) {
+      min = left;
+    }
+    if (right < q->len && q->entries[right].death < q->entries[min].death) {
+      min = right;
+    }
+    if (min == i) {
+      return;
+    }
+    _tq_swap(q, i, min);
+    i = min;
+  }
+}
+
+static void _tq_pushEntry(struct timerQueue* q, time_t death, void* value) {
+  if (q->len == q->capacity) {
+    struct tq_entry* old = q->entries;
+    q->capacity *= 2;
+    q->entries = secAlloc(q->capacity * sizeof(struct tq_entry));
+    for (size_t i = 0; i < q->len; i++) { q->entries[i] = old[i]; }
+    secFree(old);
+  }
+  q->entries[q->len].death = death;
+  q->entries[q->len].value = value;
+  q->len++;
+  _tq_siftUp(q, q->len - 1);
+}
+
+static void _tq_removeAt(struct timerQueue* q, size_t i) {
+  q->len--;
+  if (i == q->len) {
+    return;
+  }
+  q->entries[i] = q->entries[q->len];
+  _tq_siftUp(q, i);
+  _tq_siftDown(q, i);
+}
+
+/**
+ * Drops or rekeys top entries whose stored death no longer matches the
+ * value's current one, so the top of the heap always reflects reality.
+ */
+static void _tq_fixTop(struct timerQueue* q) {
+  while (q->len > 0) {
+    struct tq_entry* top = &q->entries[0];
+    time_t           cur = q->getDeath(top->value);
+    if (cur == top->death) {
+      return;
+    }
+    void* value = top->value;
+    _tq_removeAt(q, 0);
+    if (cur > 0) {
+      _tq_pushEntry(q, cur, value);
+    }
+  }
+}
+
+void timerQueue_push(struct timerQueue* q, void* value) {
+  if (q == NULL || value == NULL) {
+    return;
+  }
+  time_t death = q->getDeath(value);
+  if (death <= 0) {  // never dies; nothing to schedule
+    return;
+  }
+  _tq_pushEntry(q, death, value);
+}
+
+void timerQueue_remove(struct timerQueue* q, void* value) {
+  if (q == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < q->len; i++) {
+    if (q->entries[i].value == value) {
+      _tq_removeAt(q, i);
+      return;
+    }
+  }
+}
+
+void timerQueue_rekey(struct timerQueue* q, void* value) {
+  timerQueue_remove(q, value);
+  timerQueue_push(q, value);
+}
+
+/**
+ * @brief returns the next death in the future; @c 0 if there is none
+ *
+ * Entries that are already expired stay queued for
+ * @c timerQueue_popExpired; they are moved aside for the duration of the
+ * call so the next future deadline is visible behind them.
+ */
+time_t timerQueue_nextDeath(struct timerQueue* q) {
+  if (q == NULL) {
+    return 0;
+  }
+  time_t           now      = time(NULL);
+  time_t           ret      = 0;
+  struct tq_entry* stash    = NULL;
+  size_t           stashLen = 0;
+  while (q->len > 0) {
+    _tq_fixTop(q);
+    if (q->len == 0) {
+      break;
+    }
+    if (q->entries[0].death > now) {
+      ret = q->entries[0].death;
+      break;
+    }
+    if (stash == NULL) {
+      stash = secAlloc(q->len * sizeof(struct tq_entry));
+    }
+    stash[stashLen++] = q->entries[0];
+    _tq_removeAt(q, 0);
+  }
+  for (size_t i = 0; i < stashLen; i++) {
+    _tq_pushEntry(q, stash[i].death, stash[i].value);
+  }
+  secFree(stash);
+  return ret;
+}
+
+/**
+ * @brief returns an expired value; @c NULL if none is expired
+ *
+ * The entry is not popped: like @c getDeathElementFrom the caller is
+ * expected to remove the value from its db (or push its death back) before
+ * asking again.
+ */
+void* timerQueue_getExpired(struct timerQueue* q) {
+  if (q == NULL) {
+    return NULL;
+  }
+  _tq_fixTop(q);
+  if (q->len == 0 || q->entries[0].death > time(NULL)) {
+    return NULL;
+  }
+  return q->entries[0].value;
+}
+
+void timerQueue_clear(struct timerQueue* q) {
+  if (q == NULL) {
+    return;
+  }
+  q->len = 0;
+}
+
+size_t timerQueue_footprint(const struct timerQueue* q) {
+  if (q == NULL) {
+    return 0;
+  }
+  return sizeof(struct timerQueue) + q->capacity * sizeof(struct tq_entry);
+}
+
+void secFreeTimerQueue(struct timerQueue* q) {
+  if (q == NULL) {
+    return;
+  }
+  secFree(q->entries);
+  secFree(q);
+}
@@ -0,0 +1,27 @@
+#ifndef OIDC_TIMERQUEUE_H
+#define OIDC_TIMERQUEUE_H
+
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * Binary min-heap over the death times of stored values. The queue does not
+ * own the values; the death time is read through the registered getter when
+ * a value is pushed and re-read whenever the top of the heap is inspected,
+ * so entries whose death moved to a later time (or to 0, never) are rekeyed
+ * or dropped lazily. Values whose death is moved EARLIER while queued must
+ * be rekeyed explicitly with @c timerQueue_rekey.
+ */
+struct timerQueue;
+
+struct timerQueue* timerQueue_new(time_t (*deathGetter)(void*));
+void               timerQueue_push(struct timerQueue* q, void* value);
+void               timerQueue_remove(struct timerQueue* q, void* value);
+void               timerQueue_rekey(struct timerQueue* q, void* value);
+time_t             timerQueue_nextDeath(struct timerQueue* q);
+void*              timerQueue_getExpired(struct timerQueue* q);
+void               timerQueue_clear(struct timerQueue* q);
+size_t             timerQueue_footprint(const struct timerQueue* q);
+void               secFreeTimerQueue(struct timerQueue* q);
+
+#endif  // OIDC_TIMERQUEUE_H
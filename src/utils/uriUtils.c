@@ -56,14 +56,88 @@ char* getBaseUri(const char* uri) {
   return base;
 }
 
+/**
+ * @brief parses the query parameters of @p uri in one pass
+ * The views in @p parsed point into @p uri - nothing is copied or decoded -
+ * so they are only valid as long as @p uri lives. Use @c uriParamsGetValue
+ * to obtain a decoded copy of a single value.
+ * @param parsed the view struct to be filled
+ * @return @c OIDC_SUCCESS on success, an error code if not
+ */
+oidc_error_t uriParseParams(const char* uri, struct uriParams* parsed) {
+  if (uri == NULL || parsed == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  memset(parsed, 0, sizeof(*parsed));
+  parsed->uri      = uri;
+  const char* q    = strchr(uri, '?');
+  parsed->base_len = q ? (size_t)(q - uri) : strlen(uri);
+  if (q == NULL) {
+    return OIDC_SUCCESS;
+  }
+  const char* p = q + 1;
+  while (*p && parsed->count < URI_PARAM_VIEW_MAX) {
+    const char* key = p;
+    while (*p && *p != '=' && *p != '&') { p++; }
+    size_t      key_len   = p - key;
+    const char* value     = NULL;
+    size_t      value_len = 0;
+    if (*p == '=') {
+      value = ++p;
+      while (*p && *p != '&') { p++; }
+      value_len = p - value;
+    }
+    if (*p == '&') {
+      p++;
+    }
+    if (key_len) {
+      parsed->params[parsed->count++] =
+          (struct uriParamView){key, key_len, value, value_len};
+    }
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief looks up @p key in a parsed uri and returns its decoded value
+ * @param parsed a view filled by @c uriParseParams
+ * @return the urldecoded value or @c NULL if the parameter is not present.
+ * Has to be freed after usage.
+ */
+char* uriParamsGetValue(const struct uriParams* parsed, const char* key) {
+  if (parsed == NULL || key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t key_len = strlen(key);
+  for (size_t i = 0; i < parsed->count; i++) {
+    const struct uriParamView* v = &parsed->params[i];
+    if (v->key_len == key_len && strncmp(v->key, key, key_len) == 0 &&
+        v->value != NULL && v->value_len != 0) {
+      char* value = oidc_strncopy(v->value, v->value_len);
+      urldecode(value, value);
+      return value;
+    }
+  }
+  return NULL;
+}
+
 struct codeState codeStateFromURI(const char* uri) {
   if (uri == NULL) {
     oidc_setArgNullFuncError(__func__);
     return (struct codeState){};
   }
-  char* state    = extractParameterValueFromUri(uri, "state");
-  char* code     = extractParameterValueFromUri(uri, "code");
-  char* base_uri = getBaseUri(uri);
+  struct uriParams params;
+  if (uriParseParams(uri, &params) != OIDC_SUCCESS) {
+    return (struct codeState){};
+  }
+  char* state    = uriParamsGetValue(&params, "state");
+  char* code     = uriParamsGetValue(&params, "code");
+  char* base_uri = oidc_strncopy(uri, params.base_len);
+  if (base_uri != NULL) {
+    urldecode(base_uri, base_uri);
+  }
   if (base_uri == NULL) {
     oidc_errno = OIDC_ENOBASEURI;
   } else if (state == NULL) {
@@ -94,33 +168,30 @@ char* findCustomSchemeUri(list_t* uris) {
   return NULL;
 }
 
+int allUrisCustomScheme(list_t* uris) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(uris, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (!strstarts(node->val, AGENT_CUSTOM_SCHEME)) {
+      list_iterator_destroy(it);
+      return 0;
+    }
+  }
+  list_iterator_destroy(it);
+  return 1;
+}
+
 char* extractParameterValueFromUri(const char* uri, const char* parameter) {
   if (uri == NULL || parameter == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
   logger(DEBUG, "Extracting parameter '%s' from uri '%s'", parameter, uri);
-  char* tmp    = oidc_strcopy(uri);
-  char* params = strchr(tmp, '?');
-  if (params == NULL) {
+  struct uriParams params;
+  if (uriParseParams(uri, &params) != OIDC_SUCCESS) {
     return NULL;
   }
-  params++;
-  char* param_k = strtok(params, "=");
-  char* param_v = strtok(NULL, "&");
-  char* value   = NULL;
-  while (value == NULL && param_k != NULL && param_v != NULL) {
-    // logger(DEBUG, "URI contains parameter: %s - %s",
-    // param_k, param_v);
-    if (strequal(parameter, param_k)) {
-      value = oidc_strcopy(param_v);
-      break;
-    }
-    param_k = strtok(NULL, "=");
-    param_v = strtok(NULL, "&");
-  }
-  secFree(tmp);
-  urldecode(value, value);
+  char* value = uriParamsGetValue(&params, parameter);
   logger(DEBUG, "Extracted value is '%s'", value);
   return value;
 }
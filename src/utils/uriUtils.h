@@ -2,6 +2,9 @@
 #define OIDC_URIUTILS_H
 
 #include "list/list.h"
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
 
 struct codeState {
   char* code;
@@ -9,9 +12,35 @@ struct codeState {
   char* uri;
 };
 
+#ifndef URI_PARAM_VIEW_MAX
+#define URI_PARAM_VIEW_MAX 16
+#endif
+
+struct uriParamView {
+  const char* key;  // view into the parsed uri; not null-terminated
+  size_t      key_len;
+  const char* value;  // view into the parsed uri; still percent-encoded
+  size_t      value_len;
+};
+
+/**
+ * Indexed view of a uri's query parameters, filled in one pass by
+ * @c uriParseParams. All views point into the parsed uri - nothing is
+ * copied - so they are only valid as long as the uri string lives.
+ */
+struct uriParams {
+  const char*         uri;
+  size_t              base_len;  // length of the uri up to the '?'
+  size_t              count;
+  struct uriParamView params[URI_PARAM_VIEW_MAX];
+};
+
 struct codeState codeStateFromURI(const char* uri);
 void             secFreeCodeState(struct codeState cs);
 char*            findCustomSchemeUri(list_t* uris);
+int              allUrisCustomScheme(list_t* uris);
+oidc_error_t     uriParseParams(const char* uri, struct uriParams* parsed);
+char* uriParamsGetValue(const struct uriParams* parsed, const char* key);
 char* extractParameterValueFromUri(const char* uri, const char* parameter);
 char* getBaseUri(const char* uri);
 
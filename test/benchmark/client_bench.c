@@ -0,0 +1,295 @@
+#define _GNU_SOURCE  // MAP_ANONYMOUS
+
+#include "defines/settings.h"
+#include "oidc-token/api.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Client-observed latency benchmark for liboidc-agent.
+ *
+ * Spawns a configurable number of processes, each running a configurable
+ * number of threads, all calling getAccessToken() against a live agent
+ * (OIDC_SOCK has to be set, i.e. run it under eval `oidc-agent`). Accounts
+ * are given as a comma separated list and are used round robin, so a mix of
+ * loaded and unloaded names exercises both the cached and the error path.
+ *
+ * Reported per run:
+ *  - p50/p95/p99/max of the steady-state call latency
+ *  - the first-call latency per thread (connection setup + first request)
+ *    versus the steady-state request cost, quantifying what the persistent
+ *    per-thread connection saves
+ *  - agent-side CPU (oidcp given by OIDCD_PID plus its oidcd child),
+ *    sampled from /proc before and after the run
+ *
+ * Error responses (e.g. for unloaded accounts) are timed and counted; they
+ * still cost a full round trip.
+ *
+ * Usage: client_bench [processes] [threads] [requests_per_thread]
+ *                     [account[,account...]]
+ */
+
+#define DEFAULT_PROCESSES 4
+#define DEFAULT_THREADS 4
+#define DEFAULT_REQUESTS 100
+
+struct thread_args {
+  unsigned int   requests;
+  unsigned int   thread_index;   // global index over all processes
+  char**         accounts;
+  unsigned int   account_count;
+  unsigned long* latencies_us;   // slice of the shared array for this thread
+  unsigned long* first_call_us;  // single shared slot for this thread
+  unsigned int*  error_responses;
+};
+
+static unsigned long _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void* _thread_main(void* args_ptr) {
+  struct thread_args* args = args_ptr;
+  for (unsigned int i = 0; i < args->requests; i++) {
+    const char* account =
+        args->accounts[(args->thread_index + i) % args->account_count];
+    unsigned long start = _now_us();
+    char*         token = getAccessToken(account, 60, "client_bench");
+    unsigned long took  = _now_us() - start;
+    if (token == NULL) {
+      __atomic_fetch_add(args->error_responses, 1, __ATOMIC_RELAXED);
+    }
+    secFree(token);
+    if (i == 0) {  // includes connection setup on this thread
+      *args->first_call_us = took;
+    } else {
+      args->latencies_us[i - 1] = took;
+    }
+  }
+  return NULL;
+}
+
+static int _compare_ulong(const void* a, const void* b) {
+  unsigned long la = *(const unsigned long*)a;
+  unsigned long lb = *(const unsigned long*)b;
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static unsigned long _percentile(const unsigned long* sorted, size_t len,
+                                 unsigned int p) {
+  if (len == 0) {
+    return 0;
+  }
+  size_t index = len * p / 100;
+  return sorted[index < len ? index : len - 1];
+}
+
+/**
+ * @brief reads utime+stime jiffies of a process from /proc
+ * @return the jiffies or 0 if the stat file could not be read
+ */
+static unsigned long _procJiffies(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return 0;
+  }
+  unsigned long utime = 0;
+  unsigned long stime = 0;
+  // fields 14 and 15; field 2 (comm) may contain spaces but is
+  // parenthesized, so skip up to the closing paren first
+  int ok = fscanf(f,
+                  "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                  "%lu %lu",
+                  &utime, &stime) == 2;
+  fclose(f);
+  return ok ? utime + stime : 0;
+}
+
+/**
+ * @brief sums the CPU jiffies of the agent and its direct children
+ *
+ * OIDCD_PID names the oidcp process; oidcd is its (unreaped) child, so its
+ * time is not in oidcp's cutime and has to be collected by a /proc scan.
+ */
+static unsigned long _agentJiffies(pid_t agent_pid) {
+  unsigned long sum = _procJiffies(agent_pid);
+  DIR*          d   = opendir("/proc");
+  if (d == NULL) {
+    return sum;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    char* end;
+    long  pid = strtol(entry->d_name, &end, 10);
+    if (*end != '\0' || pid <= 0) {
+      continue;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    long ppid = 0;
+    if (fscanf(f, "%*d (%*[^)]) %*c %ld", &ppid) == 1 && ppid == agent_pid) {
+      sum += _procJiffies((pid_t)pid);
+    }
+    fclose(f);
+  }
+  closedir(d);
+  return sum;
+}
+
+static void _run_process(unsigned int proc_index, unsigned int threads,
+                         unsigned int requests, char** accounts,
+                         unsigned int account_count,
+                         unsigned long* latencies_us,
+                         unsigned long* first_calls_us,
+                         unsigned int*  error_responses) {
+  pthread_t*          thread_ids = secAlloc(threads * sizeof(pthread_t));
+  struct thread_args* args = secAlloc(threads * sizeof(struct thread_args));
+  for (unsigned int t = 0; t < threads; t++) {
+    unsigned int global = proc_index * threads + t;
+    args[t].requests    = requests;
+    args[t].thread_index    = global;
+    args[t].accounts        = accounts;
+    args[t].account_count   = account_count;
+    args[t].latencies_us    = latencies_us + (size_t)global * (requests - 1);
+    args[t].first_call_us   = first_calls_us + global;
+    args[t].error_responses = error_responses;
+    if (pthread_create(&thread_ids[t], NULL, _thread_main, &args[t]) != 0) {
+      fprintf(stderr, "could not create benchmark thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (unsigned int t = 0; t < threads; t++) {
+    pthread_join(thread_ids[t], NULL);
+  }
+  secFree(thread_ids);
+  secFree(args);
+}
+
+int main(int argc, char** argv) {
+  unsigned int processes = argc > 1 ? strToULong(argv[1]) : DEFAULT_PROCESSES;
+  unsigned int threads   = argc > 2 ? strToULong(argv[2]) : DEFAULT_THREADS;
+  unsigned int requests  = argc > 3 ? strToULong(argv[3]) : DEFAULT_REQUESTS;
+  char* account_arg = oidc_strcopy(argc > 4 ? argv[4] : "bench");
+  if (processes == 0 || threads == 0 || requests < 2) {
+    fprintf(stderr,
+            "Usage: %s [processes] [threads] [requests_per_thread (>=2)] "
+            "[account[,account...]]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (getenv(OIDC_SOCK_ENV_NAME) == NULL) {
+    fprintf(stderr, "%s not set; start an agent first\n", OIDC_SOCK_ENV_NAME);
+    return EXIT_FAILURE;
+  }
+
+  unsigned int account_count = 1;
+  for (const char* p = account_arg; *p; p++) {
+    if (*p == ',') {
+      account_count++;
+    }
+  }
+  char**       accounts = secAlloc(account_count * sizeof(char*));
+  unsigned int a        = 0;
+  for (char* tok = strtok(account_arg, ","); tok != NULL;
+       tok       = strtok(NULL, ",")) {
+    accounts[a++] = tok;
+  }
+
+  unsigned int total_threads = processes * threads;
+  size_t       total         = (size_t)total_threads * (requests - 1);
+  // shared between the benchmark processes so the parent can aggregate
+  size_t map_size = total * sizeof(unsigned long) +
+                    total_threads * sizeof(unsigned long) +
+                    sizeof(unsigned int);
+  void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "mmap failed\n");
+    return EXIT_FAILURE;
+  }
+  unsigned long* latencies_us    = map;
+  unsigned long* first_calls_us  = latencies_us + total;
+  unsigned int*  error_responses = (unsigned int*)(first_calls_us +
+                                                  total_threads);
+
+  printf("%u processes x %u threads x %u requests against %s (%u accounts)\n",
+         processes, threads, requests, getenv(OIDC_SOCK_ENV_NAME),
+         account_count);
+  fflush(stdout);  // children inherit the stdio buffer
+  const char*   agent_pid_str = getenv(OIDC_PID_ENV_NAME);
+  pid_t         agent_pid     = agent_pid_str ? (pid_t)atoi(agent_pid_str) : 0;
+  unsigned long agent_before  = agent_pid ? _agentJiffies(agent_pid) : 0;
+  unsigned long bench_start   = _now_us();
+
+  for (unsigned int p = 0; p < processes; p++) {
+    pid_t child = fork();
+    if (child < 0) {
+      fprintf(stderr, "fork failed\n");
+      return EXIT_FAILURE;
+    }
+    if (child == 0) {
+      _run_process(p, threads, requests, accounts, account_count, latencies_us,
+                   first_calls_us, error_responses);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  int status;
+  int failed = 0;
+  while (wait(&status) > 0) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      failed = 1;
+    }
+  }
+  unsigned long elapsed_us  = _now_us() - bench_start;
+  unsigned long agent_after = agent_pid ? _agentJiffies(agent_pid) : 0;
+
+  qsort(latencies_us, total, sizeof(unsigned long), _compare_ulong);
+  qsort(first_calls_us, total_threads, sizeof(unsigned long), _compare_ulong);
+  printf("requests: %lu  error responses: %u  elapsed: %.2fs\n",
+         (unsigned long)total_threads * requests, *error_responses,
+         elapsed_us / 1e6);
+  printf("throughput: %.0f req/s\n",
+         (double)total_threads * requests / (elapsed_us / 1e6));
+  printf("steady-state latency p50: %luus  p95: %luus  p99: %luus  max: "
+         "%luus\n",
+         _percentile(latencies_us, total, 50),
+         _percentile(latencies_us, total, 95),
+         _percentile(latencies_us, total, 99), latencies_us[total - 1]);
+  printf("first call (incl. connection setup) p50: %luus  -> setup cost "
+         "~%ldus over a steady-state request\n",
+         _percentile(first_calls_us, total_threads, 50),
+         (long)_percentile(first_calls_us, total_threads, 50) -
+             (long)_percentile(latencies_us, total, 50));
+  if (agent_pid) {
+    printf("agent cpu: %.2fs (%.1f%% of wall time)\n",
+           (double)(agent_after - agent_before) / sysconf(_SC_CLK_TCK),
+           100.0 * ((double)(agent_after - agent_before) /
+                    sysconf(_SC_CLK_TCK)) /
+               (elapsed_us / 1e6));
+  } else {
+    printf("agent cpu: n/a (%s not set)\n", OIDC_PID_ENV_NAME);
+  }
+
+  munmap(map, map_size);
+  secFree(accounts);
+  secFree(account_arg);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
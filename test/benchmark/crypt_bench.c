@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+
+#include "utils/crypt/crypt.h"
+#include "utils/memory.h"
+
+#include <sodium.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * KDF benchmark: measures the Argon2 derivation on this machine for the
+ * three libsodium cost profiles and recommends the strongest profile whose
+ * derivation stays under a latency target. The decryption cost of a config
+ * file equals one derivation, so the target is effectively a per-file
+ * decrypt latency budget.
+ *
+ * Usage: crypt_bench [target_ms]   (default target: 150ms)
+ */
+
+#define DEFAULT_TARGET_MS 150
+#define RUNS_PER_PROFILE 3
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+struct profile {
+  const char* name;
+  int         ops;
+  size_t      mem;
+};
+
+static double benchProfile(const struct profile* p) {
+  unsigned char salt[crypto_pwhash_SALTBYTES];
+  unsigned char key[2 * crypto_secretbox_KEYBYTES];
+  randombytes_buf(salt, sizeof(salt));
+  double best = -1;
+  for (int run = 0; run < RUNS_PER_PROFILE; run++) {
+    double start = now_ms();
+    if (crypto_pwhash(key, sizeof(key), "benchmark-password", 18, salt, p->ops,
+                      p->mem, crypto_pwhash_ALG_DEFAULT) != 0) {
+      return -1;  // not enough memory for this profile
+    }
+    double elapsed = now_ms() - start;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  long target_ms = argc > 1 ? strtol(argv[1], NULL, 10) : DEFAULT_TARGET_MS;
+  if (target_ms <= 0) {
+    fprintf(stderr, "usage: crypt_bench [target_ms]\n");
+    return EXIT_FAILURE;
+  }
+  if (sodium_init() < 0) {
+    fprintf(stderr, "sodium_init failed\n");
+    return EXIT_FAILURE;
+  }
+  const struct profile profiles[] = {
+      {"interactive", crypto_pwhash_OPSLIMIT_INTERACTIVE,
+       crypto_pwhash_MEMLIMIT_INTERACTIVE},
+      {"moderate", crypto_pwhash_OPSLIMIT_MODERATE,
+       crypto_pwhash_MEMLIMIT_MODERATE},
+      {"sensitive", crypto_pwhash_OPSLIMIT_SENSITIVE,
+       crypto_pwhash_MEMLIMIT_SENSITIVE},
+  };
+  const struct profile* pick = NULL;
+  printf("KDF timings on this machine (best of %d runs):\n", RUNS_PER_PROFILE);
+  for (size_t i = 0; i < sizeof(profiles) / sizeof(*profiles); i++) {
+    double ms = benchProfile(&profiles[i]);
+    if (ms < 0) {
+      printf("  %-12s       (skipped: memlimit %zu not available)\n",
+             profiles[i].name, profiles[i].mem);
+      continue;
+    }
+    printf("  %-12s %8.1f ms  (opslimit %d, memlimit %zu)\n", profiles[i].name,
+           ms, profiles[i].ops, profiles[i].mem);
+    if (ms <= (double)target_ms) {
+      pick = &profiles[i];  // profiles are ordered by cost
+    }
+  }
+  printf("\n");
+  if (pick == NULL) {
+    printf("No profile stays under %ldms on this machine; keeping the "
+           "default. Consider a higher target.\n",
+           target_ms);
+    return EXIT_SUCCESS;
+  }
+  printf("Strongest profile within %ldms: %s\n", target_ms, pick->name);
+  printf("To use it for new encryptions:\n");
+  printf("  export OIDC_AGENT_KDF_PROFILE=%s\n", pick->name);
+  printf("Files written under other parameters keep decrypting; the "
+         "parameters are recorded per file.\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/cryptdef.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Crypto baseline benchmark: reports ops/sec for the operations the agent
+ * spends crypto time in - password-based file encrypt/decrypt at each KDF
+ * profile, keyed (IPC-style) encrypt/decrypt at several message sizes, and
+ * the in-memory cipher. Run before and after changes to the crypto layer.
+ *
+ * Usage: crypto_bench
+ */
+
+#define FILE_CRYPT_ITERATIONS 5
+#define MSG_CRYPT_SECONDS 1.0
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static char* makeText(size_t len) {
+  char* text = secAlloc(len + 1);
+  for (size_t i = 0; i < len; i++) { text[i] = 'a' + i % 26; }
+  return text;
+}
+
+static void benchFileCrypt(const char* profile) {
+  if (crypt_setKDFProfile(profile) != OIDC_SUCCESS) {
+    printf("  %-12s       (skipped: profile not available)\n", profile);
+    return;
+  }
+  char*  text  = makeText(1024);
+  double start = now_ms();
+  double encMs = 0;
+  double decMs = 0;
+  int    ok    = 1;
+  for (int i = 0; i < FILE_CRYPT_ITERATIONS; i++) {
+    start      = now_ms();
+    char* enc  = crypt_encrypt(text, "benchmark-password");
+    encMs += now_ms() - start;
+    if (enc == NULL) {
+      ok = 0;
+      break;
+    }
+    start     = now_ms();
+    char* dec = crypt_decrypt(enc, "benchmark-password");
+    decMs += now_ms() - start;
+    secFree(enc);
+    if (dec == NULL || !strequal(dec, text)) {
+      secFree(dec);
+      ok = 0;
+      break;
+    }
+    secFree(dec);
+  }
+  secFree(text);
+  if (!ok) {
+    printf("  %-12s       FAILED\n", profile);
+    return;
+  }
+  printf("  %-12s encrypt %6.2f ops/s   decrypt %6.2f ops/s\n", profile,
+         FILE_CRYPT_ITERATIONS * 1e3 / encMs,
+         FILE_CRYPT_ITERATIONS * 1e3 / decMs);
+}
+
+static void benchMsgCrypt(size_t msgLen) {
+  unsigned char key[crypto_secretbox_KEYBYTES];
+  randombytes_buf(key, sizeof(key));
+  char*         text = makeText(msgLen);
+  unsigned long ops  = 0;
+  double        start;
+  double        encMs = 0;
+  double        decMs = 0;
+  while (encMs + decMs < MSG_CRYPT_SECONDS * 1e3) {
+    start = now_ms();
+    struct encryptionInfo* enc =
+        crypt_encryptWithKey((unsigned char*)text, key);
+    encMs += now_ms() - start;
+    if (enc == NULL || enc->encrypted_base64 == NULL) {
+      printf("  %5luB              FAILED\n", msgLen);
+      secFree(text);
+      return;
+    }
+    start = now_ms();
+    unsigned char* dec = crypt_decryptWithKey(
+        enc, msgLen + enc->cryptParameter.mac_len, key);
+    decMs += now_ms() - start;
+    secFreeEncryptionInfo(enc);
+    if (dec == NULL) {
+      printf("  %5luB              FAILED\n", msgLen);
+      secFree(text);
+      return;
+    }
+    secFree(dec);
+    ops++;
+  }
+  secFree(text);
+  printf("  %5luB       encrypt %8.0f ops/s   decrypt %8.0f ops/s\n", msgLen,
+         ops * 1e3 / encMs, ops * 1e3 / decMs);
+}
+
+static void benchMemoryCrypt() {
+  initMemoryCrypt();
+  char*         text  = makeText(64);  // refresh-token sized
+  unsigned long ops   = 0;
+  double        encMs = 0;
+  double        decMs = 0;
+  double        start;
+  while (encMs + decMs < MSG_CRYPT_SECONDS * 1e3) {
+    start     = now_ms();
+    char* enc = memoryEncrypt(text);
+    encMs += now_ms() - start;
+    start     = now_ms();
+    char* dec = memoryDecrypt(enc);
+    decMs += now_ms() - start;
+    secFree(enc);
+    if (dec == NULL || !strequal(dec, text)) {
+      secFree(dec);
+      printf("  memory cipher       FAILED\n");
+      secFree(text);
+      return;
+    }
+    secFree(dec);
+    ops++;
+  }
+  secFree(text);
+  printf("  64B          encrypt %8.0f ops/s   decrypt %8.0f ops/s\n",
+         ops * 1e3 / encMs, ops * 1e3 / decMs);
+}
+
+int main() {
+  if (sodium_init() < 0) {
+    fprintf(stderr, "sodium_init failed\n");
+    return EXIT_FAILURE;
+  }
+  printf("File encrypt/decrypt (1KiB text, %d iterations per profile):\n",
+         FILE_CRYPT_ITERATIONS);
+  benchFileCrypt("interactive");
+  benchFileCrypt("moderate");
+  benchFileCrypt("sensitive");
+  printf("\nKeyed (IPC) encrypt/decrypt:\n");
+  benchMsgCrypt(64);
+  benchMsgCrypt(1024);
+  benchMsgCrypt(16 * 1024);
+  printf("\nMemory cipher:\n");
+  benchMemoryCrypt();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#define _XOPEN_SOURCE 700
+
+#include "account/account.h"
+#include "account/setandget.h"
+#include "utils/crypt/crypt.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Provisioning-path benchmark: runs the non-interactive parts of the
+ * oidc-gen pipeline - account assembly and json serialization, merging with
+ * a client config, encrypt+write of the config file and the decrypt
+ * roundtrip - in a loop and reports the average time per stage. The network
+ * flow and the prompts are excluded, so the numbers isolate regressions in
+ * the local provisioning path; encrypt and decrypt are dominated by one key
+ * derivation each, which is exactly what a user pays per config.
+ *
+ * Usage: gen_bench [iterations]   (default: 10)
+ */
+
+#define DEFAULT_ITERATIONS 10
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static const char* const CLIENT_CONFIG =
+    "{\"client_id\":\"bench-client\",\"client_secret\":\"bench-secret\","
+    "\"registration_access_token\":\"token\"}";
+
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: gen_bench [iterations]\n");
+    return EXIT_FAILURE;
+  }
+  initCrypt();
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/gen_bench_%d.config", getpid());
+  double assemble_ms = 0;
+  double merge_ms    = 0;
+  double encrypt_ms  = 0;
+  double decrypt_ms  = 0;
+  for (long i = 0; i < iterations; i++) {
+    double start = now_ms();
+    struct oidc_account* account = secAlloc(sizeof(struct oidc_account));
+    account_setName(account, oidc_strcopy("bench"), NULL);
+    account_setIssuerUrl(account,
+                         oidc_strcopy("https://bench.example.com/oidc/"));
+    account_setClientId(account, oidc_strcopy("bench-client"));
+    account_setClientSecret(account, oidc_strcopy("bench-secret"));
+    account_setScope(account, oidc_strcopy("openid profile offline_access"));
+    account_setRefreshToken(account, oidc_strcopy("bench-refresh-token"));
+    char* config = accountToJSONString(account);
+    secFreeAccount(account);
+    assemble_ms += now_ms() - start;
+
+    start      = now_ms();
+    char* text = mergeJSONObjectStrings(config, CLIENT_CONFIG);
+    secFree(config);
+    merge_ms += now_ms() - start;
+
+    start = now_ms();
+    if (encryptAndWriteToFile(text, path, "bench-password") != OIDC_SUCCESS) {
+      fprintf(stderr, "encrypt+write failed\n");
+      return EXIT_FAILURE;
+    }
+    encrypt_ms += now_ms() - start;
+
+    start           = now_ms();
+    char* decrypted = decryptFile(path, "bench-password");
+    decrypt_ms += now_ms() - start;
+    if (decrypted == NULL || !strequal(decrypted, text)) {
+      fprintf(stderr, "decrypt roundtrip failed\n");
+      return EXIT_FAILURE;
+    }
+    secFree(decrypted);
+    secFree(text);
+  }
+  removeFile(path);
+  printf("provisioning path, average over %ld iterations:\n", iterations);
+  printf("  %-20s %8.2f ms\n", "assemble+serialize", assemble_ms / iterations);
+  printf("  %-20s %8.2f ms\n", "merge client config", merge_ms / iterations);
+  printf("  %-20s %8.2f ms\n", "encrypt+write", encrypt_ms / iterations);
+  printf("  %-20s %8.2f ms\n", "decrypt roundtrip", decrypt_ms / iterations);
+  return EXIT_SUCCESS;
+}
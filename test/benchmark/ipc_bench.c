@@ -0,0 +1,149 @@
+#define _XOPEN_SOURCE 700
+
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/ipc.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * IPC throughput and latency benchmark.
+ *
+ * Spawns a number of concurrent clients against a live agent socket
+ * (OIDC_SOCK has to be set, i.e. run it under eval `oidc-agent`), issuing
+ * mixed check/access_token traffic the way short-lived oidc-token
+ * invocations do: one connection per request. Reports p50/p95/p99 latency
+ * and requests per second, so changes to the socket path in serveripc.c can
+ * be quantified.
+ *
+ * The access_token requests use the account short name given on the command
+ * line; if it is not loaded the agent answers with an error response, which
+ * still exercises the full oidcp - oidcd round trip and is counted normally.
+ *
+ * Usage: ipc_bench [clients] [requests_per_client] [accountname]
+ */
+
+#define DEFAULT_CLIENTS 10
+#define DEFAULT_REQUESTS 100
+
+// Every ACCESSTOKEN_SHARE-th request is an access_token request, the rest
+// are check requests.
+#define ACCESSTOKEN_SHARE 4
+
+struct bench_args {
+  unsigned int    requests;
+  const char*     at_request;
+  unsigned long*  latencies_us;  // slice of the global array for this client
+  unsigned int    errors;
+};
+
+static unsigned long _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void* _client_main(void* args_ptr) {
+  struct bench_args* args = args_ptr;
+  for (unsigned int i = 0; i < args->requests; i++) {
+    const char* request =
+        i % ACCESSTOKEN_SHARE == 0 ? args->at_request : REQUEST_CHECK;
+    unsigned long     start = _now_us();
+    struct connection con   = {};
+    if (ipc_client_init(&con, OIDC_SOCK_ENV_NAME) != OIDC_SUCCESS ||
+        ipc_connect(con) < 0) {
+      args->errors++;
+      args->latencies_us[i] = 0;
+      continue;
+    }
+    char* response = ipc_communicateWithSock(*(con.sock), "%s", request);
+    ipc_closeConnection(&con);
+    if (response == NULL) {
+      args->errors++;
+      args->latencies_us[i] = 0;
+      continue;
+    }
+    secFree(response);
+    args->latencies_us[i] = _now_us() - start;
+  }
+  return NULL;
+}
+
+static int _compare_ulong(const void* a, const void* b) {
+  unsigned long la = *(const unsigned long*)a;
+  unsigned long lb = *(const unsigned long*)b;
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static unsigned long _percentile(const unsigned long* sorted, size_t len,
+                                 unsigned int p) {
+  if (len == 0) {
+    return 0;
+  }
+  size_t index = len * p / 100;
+  return sorted[index < len ? index : len - 1];
+}
+
+int main(int argc, char** argv) {
+  unsigned int clients  = argc > 1 ? strToULong(argv[1]) : DEFAULT_CLIENTS;
+  unsigned int requests = argc > 2 ? strToULong(argv[2]) : DEFAULT_REQUESTS;
+  const char*  account  = argc > 3 ? argv[3] : "bench";
+  if (clients == 0 || requests == 0) {
+    fprintf(stderr, "Usage: %s [clients] [requests_per_client] [accountname]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (getenv(OIDC_SOCK_ENV_NAME) == NULL) {
+    fprintf(stderr, "%s not set; start an agent first\n", OIDC_SOCK_ENV_NAME);
+    return EXIT_FAILURE;
+  }
+  char* at_request = oidc_sprintf(
+      "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCESSTOKEN "\",\""
+      IPC_KEY_SHORTNAME "\":\"%s\",\"" IPC_KEY_MINVALID "\":60,\""
+      IPC_KEY_APPLICATIONHINT "\":\"ipc_bench\"}",
+      account);
+
+  size_t             total        = (size_t)clients * requests;
+  unsigned long*     latencies_us = secAlloc(total * sizeof(unsigned long));
+  pthread_t*         threads      = secAlloc(clients * sizeof(pthread_t));
+  struct bench_args* args         = secAlloc(clients * sizeof(struct bench_args));
+
+  printf("%u clients x %u requests against %s (account '%s')\n", clients,
+         requests, getenv(OIDC_SOCK_ENV_NAME), account);
+  unsigned long bench_start = _now_us();
+  for (unsigned int c = 0; c < clients; c++) {
+    args[c].requests     = requests;
+    args[c].at_request   = at_request;
+    args[c].latencies_us = latencies_us + (size_t)c * requests;
+    if (pthread_create(&threads[c], NULL, _client_main, &args[c]) != 0) {
+      fprintf(stderr, "could not create client thread\n");
+      return EXIT_FAILURE;
+    }
+  }
+  unsigned int errors = 0;
+  for (unsigned int c = 0; c < clients; c++) {
+    pthread_join(threads[c], NULL);
+    errors += args[c].errors;
+  }
+  unsigned long elapsed_us = _now_us() - bench_start;
+
+  qsort(latencies_us, total, sizeof(unsigned long), _compare_ulong);
+  printf("requests: %lu  errors: %u  elapsed: %.2fs\n", (unsigned long)total,
+         errors, elapsed_us / 1e6);
+  printf("throughput: %.0f req/s\n", total / (elapsed_us / 1e6));
+  printf("latency p50: %luus  p95: %luus  p99: %luus  max: %luus\n",
+         _percentile(latencies_us, total, 50),
+         _percentile(latencies_us, total, 95),
+         _percentile(latencies_us, total, 99), latencies_us[total - 1]);
+
+  secFree(at_request);
+  secFree(latencies_us);
+  secFree(threads);
+  secFree(args);
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
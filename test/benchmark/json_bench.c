@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+
+#include "account/account.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * JSON micro-benchmark over the payload shapes the agent actually handles:
+ * an account config, a token endpoint response, a device authorization
+ * response and a provider discovery document. Reports ns/op and heap
+ * allocations per op for stringToJson, getJSONValues,
+ * jsonToStringUnformatted and getAccountFromJSON, so changes to
+ * src/utils/json.c and lib/cJSON land with before/after numbers.
+ *
+ * Usage: json_bench [iterations]
+ */
+
+#define DEFAULT_ITERATIONS 20000
+
+/*
+ * Heap allocation counting: malloc/calloc/realloc are interposed and count
+ * while bench_alloc_counting is set. dlsym itself allocates, so the very
+ * first calloc calls are served from a static bootstrap buffer.
+ */
+#ifdef __linux__
+#include <dlfcn.h>
+
+static unsigned long bench_alloc_count    = 0;
+static int           bench_alloc_counting = 0;
+
+static char   bootstrap_heap[16384];
+static size_t bootstrap_used = 0;
+static int    resolving      = 0;
+
+static void* (*real_malloc)(size_t)          = NULL;
+static void* (*real_calloc)(size_t, size_t)  = NULL;
+static void* (*real_realloc)(void*, size_t)  = NULL;
+static void (*real_free)(void*)              = NULL;
+
+static void* _bootstrap_alloc(size_t size) {
+  size_t aligned = (size + 15) & ~(size_t)15;
+  if (bootstrap_used + aligned > sizeof(bootstrap_heap)) {
+    return NULL;
+  }
+  void* p = bootstrap_heap + bootstrap_used;
+  bootstrap_used += aligned;
+  return p;
+}
+
+static int _isBootstrapPtr(const void* p) {
+  return (const char*)p >= bootstrap_heap &&
+         (const char*)p < bootstrap_heap + sizeof(bootstrap_heap);
+}
+
+void* malloc(size_t size) {
+  if (real_malloc == NULL) {
+    if (resolving) {
+      return _bootstrap_alloc(size);
+    }
+    resolving   = 1;
+    real_malloc = (void* (*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    resolving   = 0;
+  }
+  if (bench_alloc_counting) {
+    bench_alloc_count++;
+  }
+  return real_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+  if (real_calloc == NULL) {
+    if (resolving) {
+      void* p = _bootstrap_alloc(nmemb * size);
+      if (p != NULL) {
+        memset(p, 0, nmemb * size);
+      }
+      return p;
+    }
+    resolving   = 1;
+    real_calloc = (void* (*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    resolving   = 0;
+  }
+  if (bench_alloc_counting) {
+    bench_alloc_count++;
+  }
+  return real_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  if (real_realloc == NULL) {
+    resolving    = 1;
+    real_realloc = (void* (*)(void*, size_t))dlsym(RTLD_NEXT, "realloc");
+    resolving    = 0;
+  }
+  if (bench_alloc_counting) {
+    bench_alloc_count++;
+  }
+  return real_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+  if (ptr == NULL || _isBootstrapPtr(ptr)) {
+    return;
+  }
+  if (real_free == NULL) {
+    resolving = 1;
+    real_free = (void (*)(void*))dlsym(RTLD_NEXT, "free");
+    resolving = 0;
+  }
+  real_free(ptr);
+}
+#else
+static unsigned long bench_alloc_count    = 0;
+static int           bench_alloc_counting = 0;
+#endif  // __linux__
+
+// Fixtures captured from real flows (identifiers shortened, secrets faked).
+
+static const char* const ACCOUNT_JSON =
+    "{\"" AGENT_KEY_SHORTNAME "\":\"wlcg\",\"client_name\":\"oidc-agent:wlcg\","
+    "\"" AGENT_KEY_ISSUERURL "\":\"https://wlcg.cloud.cnaf.infn.it/\","
+    "\"" AGENT_KEY_DAESETBYUSER "\":0,"
+    "\"device_authorization_endpoint\":\"https://wlcg.cloud.cnaf.infn.it/"
+    "devicecode\","
+    "\"" OIDC_KEY_CLIENTID
+    "\":\"6aa6e462-1a72-48bb-924e-a1a2e80ac00c\","
+    "\"" OIDC_KEY_CLIENTSECRET "\":\"AK4dVx93yTQ2H-lKY9sJbn8qVvM0Oy\","
+    "\"" OIDC_KEY_REFRESHTOKEN
+    "\":\"eyJhbGciOiJub25lIn0.eyJqdGkiOiI3OWI2NmUyNC0zMzliLTRjZDMtOTA1Ni1kMzM"
+    "xZDRlZjQ4YjcifQ.\","
+    "\"" AGENT_KEY_CERTPATH "\":\"/etc/ssl/certs/ca-certificates.crt\","
+    "\"" OIDC_KEY_USERNAME "\":\"\",\"" OIDC_KEY_PASSWORD "\":\"\","
+    "\"" OIDC_KEY_REDIRECTURIS
+    "\":[\"http://localhost:8080\",\"http://localhost:4242\","
+    "\"http://localhost:43985\"],"
+    "\"" OIDC_KEY_SCOPE "\":\"openid profile offline_access wlcg "
+    "wlcg.groups storage.read:/ compute.read\"}";
+
+static const char* const TOKEN_RESPONSE_JSON =
+    "{\"" OIDC_KEY_ACCESSTOKEN
+    "\":\"eyJraWQiOiJyc2ExIiwiYWxnIjoiUlMyNTYifQ.eyJ3bGNnLnZlciI6IjEuMCIsInN1"
+    "YiI6ImE0NzZhZmNmLTMwMGYtNDhhYy1iYzQ1LWZmNzBiMTNjZTdjYiIsImF1ZCI6Imh0dHBz"
+    "Oi8vd2xjZy5jZXJuLmNoL2p3dC92MS9hbnkiLCJuYmYiOjE2MTQ2ODgzMDYsInNjb3BlIjoi"
+    "b3BlbmlkIHByb2ZpbGUgb2ZmbGluZV9hY2Nlc3MiLCJpc3MiOiJodHRwczovL3dsY2cuY2xv"
+    "dWQuY25hZi5pbmZuLml0LyIsImV4cCI6MTYxNDY5MTkwNiwiaWF0IjoxNjE0Njg4MzA2LCJq"
+    "dGkiOiJiOTMzMzFhZS0wZTdhLTQ5NjgtOTk2Yi1hNmYzYWNlMzIxMWYifQ.SflKxwRJSMeKK"
+    "F2QT4fwpMeJf36POk6yJVadQssw5c\","
+    "\"token_type\":\"Bearer\","
+    "\"" OIDC_KEY_REFRESHTOKEN
+    "\":\"eyJhbGciOiJub25lIn0.eyJqdGkiOiI3OWI2NmUyNC0zMzliLTRjZDMtOTA1Ni1kMzM"
+    "xZDRlZjQ4YjcifQ.\","
+    "\"" OIDC_KEY_EXPIRESIN "\":3599,"
+    "\"" OIDC_KEY_SCOPE "\":\"openid profile offline_access\","
+    "\"id_token\":\"eyJraWQiOiJyc2ExIiwiYWxnIjoiUlMyNTYifQ.eyJzdWIiOiJhNDc2YW"
+    "ZjZiIsImF1ZCI6IjZhYTZlNDYyIn0.c2lnbmF0dXJl\"}";
+
+static const char* const DEVICE_RESPONSE_JSON =
+    "{\"" OIDC_KEY_DEVICECODE
+    "\":\"gXZvrWzLBYofPcnAOMvQyQhcwdchJmvkZHYsKZqjstRCxSzqEfKHyE\","
+    "\"" OIDC_KEY_USERCODE "\":\"PSQ-RFK\","
+    "\"" OIDC_KEY_VERIFICATIONURI
+    "\":\"https://wlcg.cloud.cnaf.infn.it/device\","
+    "\"" OIDC_KEY_VERIFICATIONURI_COMPLETE
+    "\":\"https://wlcg.cloud.cnaf.infn.it/device?user_code=PSQ-RFK\","
+    "\"" OIDC_KEY_EXPIRESIN "\":600,\"" OIDC_KEY_INTERVAL "\":5}";
+
+static const char* const DISCOVERY_JSON =
+    "{\"" OIDC_KEY_ISSUER "\":\"https://wlcg.cloud.cnaf.infn.it/\","
+    "\"" OIDC_KEY_AUTHORIZATION_ENDPOINT
+    "\":\"https://wlcg.cloud.cnaf.infn.it/authorize\","
+    "\"" OIDC_KEY_TOKEN_ENDPOINT
+    "\":\"https://wlcg.cloud.cnaf.infn.it/token\","
+    "\"userinfo_endpoint\":\"https://wlcg.cloud.cnaf.infn.it/userinfo\","
+    "\"" OIDC_KEY_REGISTRATION_ENDPOINT
+    "\":\"https://wlcg.cloud.cnaf.infn.it/register\","
+    "\"" OIDC_KEY_REVOCATION_ENDPOINT
+    "\":\"https://wlcg.cloud.cnaf.infn.it/revoke\","
+    "\"" OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT
+    "\":\"https://wlcg.cloud.cnaf.infn.it/devicecode\","
+    "\"jwks_uri\":\"https://wlcg.cloud.cnaf.infn.it/jwk\","
+    "\"" OIDC_KEY_SCOPES_SUPPORTED
+    "\":[\"openid\",\"profile\",\"email\",\"offline_access\",\"wlcg\","
+    "\"wlcg.groups\",\"storage.read:/\",\"storage.create:/\","
+    "\"compute.read\",\"compute.modify\",\"compute.create\","
+    "\"compute.cancel\",\"storage.modify:/\",\"eduperson_scoped_"
+    "affiliation\",\"eduperson_entitlement\"],"
+    "\"" OIDC_KEY_RESPONSE_TYPES_SUPPORTED
+    "\":[\"code\",\"token\"],"
+    "\"" OIDC_KEY_GRANT_TYPES_SUPPORTED
+    "\":[\"authorization_code\",\"implicit\",\"refresh_token\","
+    "\"client_credentials\",\"password\","
+    "\"urn:ietf:params:oauth:grant-type:device_code\"],"
+    "\"token_endpoint_auth_methods_supported\":[\"client_secret_basic\","
+    "\"client_secret_post\",\"client_secret_jwt\",\"private_key_jwt\","
+    "\"none\"],"
+    "\"claims_supported\":[\"sub\",\"aud\",\"iss\",\"exp\",\"iat\",\"name\","
+    "\"preferred_username\",\"organisation_name\",\"groups\","
+    "\"wlcg.groups\",\"email\"],"
+    "\"code_challenge_methods_supported\":[\"plain\",\"S256\"]}";
+
+static unsigned long _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static unsigned long bench_start_ns;
+
+static void _benchStart() {
+  bench_alloc_count    = 0;
+  bench_alloc_counting = 1;
+  bench_start_ns       = _now_ns();
+}
+
+static void _benchEnd(const char* name, unsigned long iterations) {
+  unsigned long elapsed = _now_ns() - bench_start_ns;
+  bench_alloc_counting  = 0;
+  printf("%-38s %8lu ns/op %8.1f allocs/op\n", name, elapsed / iterations,
+         (double)bench_alloc_count / iterations);
+}
+
+static void _benchParse(const char* name, const char* json,
+                        unsigned long iterations) {
+  _benchStart();
+  for (unsigned long i = 0; i < iterations; i++) {
+    cJSON* cj = stringToJson(json);
+    secFreeJson(cj);
+  }
+  _benchEnd(name, iterations);
+}
+
+int main(int argc, char** argv) {
+  unsigned long iterations =
+      argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+  if (iterations == 0) {
+    iterations = DEFAULT_ITERATIONS;
+  }
+  printf("json_bench: %lu iterations per benchmark\n\n", iterations);
+
+  _benchParse("stringToJson account config", ACCOUNT_JSON, iterations);
+  _benchParse("stringToJson token response", TOKEN_RESPONSE_JSON, iterations);
+  _benchParse("stringToJson device response", DEVICE_RESPONSE_JSON,
+              iterations);
+  _benchParse("stringToJson discovery doc", DISCOVERY_JSON, iterations);
+
+  {
+    jsonArena_begin();
+    _benchStart();
+    for (unsigned long i = 0; i < iterations; i++) {
+      cJSON* cj = stringToJson(TOKEN_RESPONSE_JSON);
+      secFreeJson(cj);
+    }
+    _benchEnd("stringToJson token response (arena)", iterations);
+    jsonArena_end();
+  }
+
+  {
+    cJSON* cj = stringToJson(TOKEN_RESPONSE_JSON);
+    _benchStart();
+    for (unsigned long i = 0; i < iterations; i++) {
+      INIT_KEY_VALUE(OIDC_KEY_ACCESSTOKEN, OIDC_KEY_REFRESHTOKEN,
+                     OIDC_KEY_EXPIRESIN, OIDC_KEY_SCOPE, OIDC_KEY_ERROR);
+      CALL_GETJSONVALUES_FROM_CJSON(cj);
+      SEC_FREE_KEY_VALUES();
+    }
+    _benchEnd("getJSONValues token response", iterations);
+    secFreeJson(cj);
+  }
+
+  {
+    cJSON* cj = stringToJson(DISCOVERY_JSON);
+    _benchStart();
+    for (unsigned long i = 0; i < iterations; i++) {
+      char* s = jsonToStringUnformatted(cj);
+      secFree(s);
+    }
+    _benchEnd("jsonToStringUnformatted discovery", iterations);
+    secFreeJson(cj);
+  }
+
+  {
+    _benchStart();
+    for (unsigned long i = 0; i < iterations; i++) {
+      struct oidc_account* account = getAccountFromJSON(ACCOUNT_JSON);
+      secFreeAccount(account);
+    }
+    _benchEnd("getAccountFromJSON account config", iterations);
+  }
+
+  {
+    _benchStart();
+    for (unsigned long i = 0; i < iterations; i++) {
+      struct oidc_account* account = getAccountFromJSON(ACCOUNT_JSON);
+      account_materializeAll(account);
+      secFreeAccount(account);
+    }
+    _benchEnd("getAccountFromJSON + materializeAll", iterations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+
+#include "ipc/ipc.h"
+#include "list/list.h"
+#include "utils/crypt/crypt.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Performance regression suite (make perftest).
+ *
+ * Timed assertions on the critical primitives: list lookup, json key
+ * extraction on a token payload, config encryption and an ipc round trip
+ * over a socketpair. Absolute time thresholds would flap across machines,
+ * so every run first times a fixed reference workload and scales the
+ * per-primitive budgets by it: a budget is the primitive's cost relative
+ * to the reference, captured with --calibrate on a healthy tree, plus a
+ * 20% allowance. A primitive exceeding its scaled budget fails the run -
+ * and with it the build - so performance does not silently rot between
+ * releases.
+ *
+ * After an intentional performance change, re-run with --calibrate and
+ * update the *_RATIO constants below from its output.
+ *
+ * Usage: perf_regression [--calibrate]
+ */
+
+// tolerated regression before the run fails
+#define SLACK 1.20
+// best-of runs per primitive, to shake off scheduler noise
+#define RUNS 5
+
+// cost of each primitive relative to the reference workload, captured with
+// --calibrate; the crypt budget is the least stable one across machines
+// because the Argon2 derivation is also memory-bound
+#define FINDINLIST_RATIO 0.35
+#define GETJSONVALUES_RATIO 0.90
+#define CRYPT_RATIO 2.10
+#define IPC_RATIO 0.45
+
+#define FINDINLIST_N 1000
+#define FINDINLIST_LOOKUPS 1000
+#define GETJSONVALUES_ITERATIONS 10000
+#define IPC_MESSAGES 2000
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief times the reference workload all budgets are scaled by
+ *
+ * FNV-1a over a 4MiB buffer, 16 passes: pure CPU work with a memory
+ * footprint beyond the caches, so it moves with the machine speed the
+ * same way the measured primitives do.
+ */
+static double calibration_ms() {
+  size_t         len = 4 * 1024 * 1024;
+  unsigned char* buf = malloc(len);
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (unsigned char)i;
+  }
+  double best = -1;
+  for (int run = 0; run < RUNS; run++) {
+    double        start = now_ms();
+    unsigned long h     = 2166136261UL;
+    for (int pass = 0; pass < 16; pass++) {
+      for (size_t i = 0; i < len; i++) {
+        h = (h ^ buf[i]) * 16777619UL;
+      }
+    }
+    buf[0] ^= (unsigned char)h;  // keep the loop observable
+    double elapsed = now_ms() - start;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  free(buf);
+  return best;
+}
+
+static double bench_findInList() {
+  list_t* l = list_new();
+  l->match  = (matchFunction)strequal;
+  l->free   = _secFree;
+  for (int i = 0; i < FINDINLIST_N; i++) {
+    list_rpush(l, list_node_new(oidc_sprintf("account-%d", i)));
+  }
+  double best = -1;
+  for (int run = 0; run < RUNS; run++) {
+    double start = now_ms();
+    for (int i = 0; i < FINDINLIST_LOOKUPS; i++) {
+      if (findInList(l, "account-999") == NULL) {  // worst case: last node
+        fprintf(stderr, "findInList lost an element\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    double elapsed = now_ms() - start;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  list_destroy(l);
+  return best;
+}
+
+static double bench_getJSONValues() {
+  const char* payload =
+      "{\"access_token\":\"eyJhbGciOiJSUzI1NiIsInR5cCI6IkpXVCJ9."
+      "eyJzdWIiOiJiZW5jaG1hcmsiLCJpc3MiOiJodHRwczovL2V4YW1wbGUub3JnLyIsImV4cC"
+      "I6MTcwMDAwMDAwMH0.benchbenchbenchbenchbenchbenchbenchbench\","
+      "\"token_type\":\"Bearer\",\"expires_in\":3599,"
+      "\"refresh_token\":\"a-rather-long-refresh-token-value-0123456789\","
+      "\"scope\":\"openid profile offline_access\",\"id_token\":\"header."
+      "payload.signature\"}";
+  double best = -1;
+  for (int run = 0; run < RUNS; run++) {
+    double start = now_ms();
+    for (int i = 0; i < GETJSONVALUES_ITERATIONS; i++) {
+      INIT_KEY_VALUE("access_token", "token_type", "expires_in",
+                     "refresh_token", "scope", "id_token");
+      if (CALL_GETJSONVALUES(payload) < 0) {
+        fprintf(stderr, "getJSONValues failed on the token payload\n");
+        exit(EXIT_FAILURE);
+      }
+      SEC_FREE_KEY_VALUES();
+    }
+    double elapsed = now_ms() - start;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+static double bench_crypt() {
+  const char* config =
+      "{\"name\":\"benchmark\",\"client_id\":\"bench-client\","
+      "\"client_secret\":\"bench-secret\",\"refresh_token\":\"bench-rt\"}";
+  double best = -1;
+  for (int run = 0; run < RUNS; run++) {
+    double start = now_ms();
+    char*  crypt = crypt_encrypt(config, "benchmark-password");
+    double elapsed = now_ms() - start;
+    if (crypt == NULL) {
+      fprintf(stderr, "crypt_encrypt failed\n");
+      exit(EXIT_FAILURE);
+    }
+    secFree(crypt);
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+static double bench_ipc() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    fprintf(stderr, "socketpair failed\n");
+    exit(EXIT_FAILURE);
+  }
+  const char* msg =
+      "{\"status\":\"success\",\"access_token\":\"a-token-of-representative-"
+      "length-aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\",\"expires_at\":"
+      "1700000000}";
+  double best = -1;
+  for (int run = 0; run < RUNS; run++) {
+    double start = now_ms();
+    for (int i = 0; i < IPC_MESSAGES; i++) {
+      if (ipc_write(fds[0], "%s", msg) != OIDC_SUCCESS) {
+        fprintf(stderr, "ipc_write failed\n");
+        exit(EXIT_FAILURE);
+      }
+      char* read = ipc_read(fds[1]);
+      if (read == NULL) {
+        fprintf(stderr, "ipc_read failed\n");
+        exit(EXIT_FAILURE);
+      }
+      secFree(read);
+    }
+    double elapsed = now_ms() - start;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  return best;
+}
+
+static int check(const char* name, double measured_ms, double ratio,
+                 double cal_ms, int calibrate) {
+  if (calibrate) {
+    printf("  %-16s %8.2fms   ratio %.2f\n", name, measured_ms,
+           measured_ms / cal_ms);
+    return 0;
+  }
+  double budget_ms = ratio * cal_ms * SLACK;
+  int    fail      = measured_ms > budget_ms;
+  printf("  %-16s %8.2fms   budget %8.2fms   %s\n", name, measured_ms,
+         budget_ms, fail ? "FAIL" : "ok");
+  return fail;
+}
+
+int main(int argc, char** argv) {
+  int calibrate = argc > 1 && strequal(argv[1], "--calibrate");
+  initCrypt();
+  double cal_ms = calibration_ms();
+  printf("reference workload: %.2fms%s\n", cal_ms,
+         calibrate ? "   (update the *_RATIO constants from the ratios "
+                     "below)"
+                   : "");
+  int fails = 0;
+  fails += check("findInList", bench_findInList(), FINDINLIST_RATIO, cal_ms,
+                 calibrate);
+  fails += check("getJSONValues", bench_getJSONValues(), GETJSONVALUES_RATIO,
+                 cal_ms, calibrate);
+  fails += check("crypt_encrypt", bench_crypt(), CRYPT_RATIO, cal_ms,
+                 calibrate);
+  fails += check("ipc roundtrip", bench_ipc(), IPC_RATIO, cal_ms, calibrate);
+  if (fails) {
+    fprintf(stderr,
+            "%d primitive%s regressed more than %d%% over the calibrated "
+            "budget\n",
+            fails, fails == 1 ? "" : "s", (int)((SLACK - 1) * 100));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
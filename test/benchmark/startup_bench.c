@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * CLI startup-time benchmark: fork+execs the given command repeatedly and
+ * reports the per-invocation wall time. Stdout and stderr of the command are
+ * redirected to /dev/null, so running e.g. `oidc-gen --help` measures pure
+ * process startup (dynamic linking, library init, argument parsing) as paid
+ * by shell completions that invoke these binaries constantly.
+ *
+ * Usage: startup_bench [iterations] <command> [args...]
+ */
+
+#define DEFAULT_ITERATIONS 100
+
+static unsigned long _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static int _cmpULong(const void* a, const void* b) {
+  unsigned long x = *(const unsigned long*)a;
+  unsigned long y = *(const unsigned long*)b;
+  return x < y ? -1 : x > y;
+}
+
+static unsigned long _percentile(const unsigned long* sorted, size_t n,
+                                 unsigned int p) {
+  size_t i = (n * p) / 100;
+  return sorted[i < n ? i : n - 1];
+}
+
+int main(int argc, char** argv) {
+  int    iterations = DEFAULT_ITERATIONS;
+  char** command    = argv + 1;
+  if (argc > 1) {
+    char* end = NULL;
+    long  it  = strtol(argv[1], &end, 10);
+    if (end != argv[1] && *end == '\0') {  // first arg is the iteration count
+      iterations = (int)it;
+      command    = argv + 2;
+    }
+  }
+  if (*command == NULL || iterations <= 0) {
+    fprintf(stderr, "usage: startup_bench [iterations] <command> [args...]\n");
+    return EXIT_FAILURE;
+  }
+  unsigned long* times = calloc(iterations, sizeof(unsigned long));
+  if (times == NULL) {
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < iterations; i++) {
+    unsigned long start = _now_us();
+    pid_t         pid   = fork();
+    if (pid == 0) {
+      freopen("/dev/null", "w", stdout);
+      freopen("/dev/null", "w", stderr);
+      execvp(command[0], command);
+      _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+      fprintf(stderr, "could not run '%s'\n", command[0]);
+      free(times);
+      return EXIT_FAILURE;
+    }
+    times[i] = _now_us() - start;
+  }
+  qsort(times, iterations, sizeof(unsigned long), _cmpULong);
+  printf("%s: %d invocations\n", command[0], iterations);
+  printf("  min %6lu us  p50 %6lu us  p95 %6lu us  p99 %6lu us  max %6lu us\n",
+         times[0], _percentile(times, iterations, 50),
+         _percentile(times, iterations, 95),
+         _percentile(times, iterations, 99), times[iterations - 1]);
+  free(times);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "utils/agent_metrics.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/password_entry.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Fleet-scale load scenario driver.
+ *
+ * Reproduces production request shapes against a live agent over the real
+ * encrypted socket protocol (OIDC_SOCK has to be set): it first loads a
+ * set of synthetic accounts spread over the mock provider's issuers (run
+ * mock_provider first; `make loadtest` wires both up), then hammers the
+ * agent from many concurrent client threads with access token requests,
+ * mixing in an account list request per client once in a while.
+ *
+ * Latencies are recorded through the agent's own metrics module and
+ * reported as agent_metrics_toJSON() output - the same format the agent's
+ * metrics request emits - so client-observed numbers line up field by
+ * field with the agent-side ones for a direct comparison of queueing and
+ * pipe overhead.
+ *
+ * Usage: load_driver [clients] [accounts] [requests_per_client] [issuers]
+ *                    [base_port]
+ */
+
+#define DEFAULT_CLIENTS 500
+#define DEFAULT_ACCOUNTS 50
+#define DEFAULT_REQUESTS 20
+#define DEFAULT_ISSUERS 5
+#define DEFAULT_BASE_PORT 18470
+
+// every this many token requests a client also asks for the account list,
+// approximating the management traffic seen in production
+#define ACCOUNTLIST_EVERY 16
+
+struct driver_args {
+  unsigned int  thread_index;
+  unsigned int  requests;
+  unsigned int  account_count;
+  unsigned int* error_responses;
+};
+
+/**
+ * @brief the shortname of synthetic account @p i . Has to be freed after
+ * usage.
+ */
+static char* _accountName(unsigned int i) {
+  return oidc_sprintf("load%03u", i);
+}
+
+/**
+ * @brief loads one synthetic account pointing at a mock issuer
+ * @return 1 if the agent answered with success, 0 otherwise
+ */
+static int _loadAccount(unsigned int i, unsigned int issuers,
+                        unsigned int base_port) {
+  char* name = _accountName(i);
+  char* config = oidc_sprintf(
+      "{\"" AGENT_KEY_SHORTNAME "\":\"%s\",\"" AGENT_KEY_ISSUERURL
+      "\":\"http://127.0.0.1:%u/\",\"" OIDC_KEY_CLIENTID
+      "\":\"load-client-%u\",\"" OIDC_KEY_CLIENTSECRET
+      "\":\"load-secret\",\"" OIDC_KEY_REFRESHTOKEN
+      "\":\"mock-rt-%u\",\"" OIDC_KEY_SCOPE
+      "\":\"openid profile offline_access\"}",
+      name, base_port + i % issuers, i, i);
+  struct password_entry pw = {.shortname = name};
+  pwe_setType(&pw, PW_TYPE_PRMT);
+  char* pw_str = passwordEntryToJSONString(&pw);
+  char* res    = ipc_cryptCommunicate(REQUEST_ADD, config, pw_str, 0);
+  secFree(pw_str);
+  secFree(config);
+  secFree(name);
+  int ok = res != NULL && strstr(res, STATUS_SUCCESS) != NULL;
+  if (!ok) {
+    fprintf(stderr, "loading account %u failed: %s\n", i,
+            res != NULL ? res : oidc_serror());
+  }
+  secFree(res);
+  return ok;
+}
+
+static void* _client_main(void* args_ptr) {
+  struct driver_args* args = args_ptr;
+  for (unsigned int i = 0; i < args->requests; i++) {
+    char* account =
+        _accountName((args->thread_index + i) % args->account_count);
+    unsigned long start = agent_metrics_now_ms();
+    char*         res   = ipc_cryptCommunicate(
+        "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCESSTOKEN
+        "\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" IPC_KEY_MINVALID
+        "\":60,\"" IPC_KEY_APPLICATIONHINT "\":\"load_driver\"}",
+        account);
+    agent_metrics_record(REQUEST_VALUE_ACCESSTOKEN,
+                         agent_metrics_now_ms() - start);
+    if (res == NULL || strstr(res, STATUS_SUCCESS) == NULL) {
+      __atomic_fetch_add(args->error_responses, 1, __ATOMIC_RELAXED);
+    }
+    secFree(res);
+    secFree(account);
+    if ((args->thread_index + i) % ACCOUNTLIST_EVERY == 0) {
+      start = agent_metrics_now_ms();
+      res   = ipc_cryptCommunicate("{\"" IPC_KEY_REQUEST
+                                   "\":\"" REQUEST_VALUE_ACCOUNTLIST "\"}");
+      agent_metrics_record(REQUEST_VALUE_ACCOUNTLIST,
+                           agent_metrics_now_ms() - start);
+      if (res == NULL || strstr(res, STATUS_SUCCESS) == NULL) {
+        __atomic_fetch_add(args->error_responses, 1, __ATOMIC_RELAXED);
+      }
+      secFree(res);
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  unsigned int clients  = argc > 1 ? strToULong(argv[1]) : DEFAULT_CLIENTS;
+  unsigned int accounts = argc > 2 ? strToULong(argv[2]) : DEFAULT_ACCOUNTS;
+  unsigned int requests = argc > 3 ? strToULong(argv[3]) : DEFAULT_REQUESTS;
+  unsigned int issuers  = argc > 4 ? strToULong(argv[4]) : DEFAULT_ISSUERS;
+  unsigned int base_port =
+      argc > 5 ? strToULong(argv[5]) : DEFAULT_BASE_PORT;
+  if (clients == 0 || accounts == 0 || requests == 0 || issuers == 0) {
+    fprintf(stderr,
+            "Usage: %s [clients] [accounts] [requests_per_client] [issuers] "
+            "[base_port]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (getenv(OIDC_SOCK_ENV_NAME) == NULL) {
+    fprintf(stderr, "%s not set; start an agent first\n", OIDC_SOCK_ENV_NAME);
+    return EXIT_FAILURE;
+  }
+
+  printf("loading %u accounts over %u issuers (base port %u)\n", accounts,
+         issuers, base_port);
+  unsigned int loaded = 0;
+  for (unsigned int i = 0; i < accounts; i++) {
+    loaded += _loadAccount(i, issuers, base_port);
+  }
+  if (loaded == 0) {
+    fprintf(stderr,
+            "no account could be loaded; is the mock provider running?\n");
+    return EXIT_FAILURE;
+  }
+  printf("loaded %u/%u accounts; starting %u clients x %u requests\n", loaded,
+         accounts, clients, requests);
+  fflush(stdout);
+
+  unsigned int        error_responses = 0;
+  pthread_t*          threads = secAlloc(clients * sizeof(pthread_t));
+  struct driver_args* args = secAlloc(clients * sizeof(struct driver_args));
+  unsigned long       start_ms = agent_metrics_now_ms();
+  for (unsigned int c = 0; c < clients; c++) {
+    args[c].thread_index    = c;
+    args[c].requests        = requests;
+    args[c].account_count   = accounts;
+    args[c].error_responses = &error_responses;
+    if (pthread_create(&threads[c], NULL, _client_main, &args[c]) != 0) {
+      fprintf(stderr, "could not create client thread %u\n", c);
+      return EXIT_FAILURE;
+    }
+  }
+  for (unsigned int c = 0; c < clients; c++) {
+    pthread_join(threads[c], NULL);
+  }
+  unsigned long elapsed_ms = agent_metrics_now_ms() - start_ms;
+  secFree(threads);
+  secFree(args);
+
+  unsigned long total =
+      (unsigned long)clients * requests;  // token requests only
+  printf("done: %lu token requests, %u error responses, %.2fs, %.0f req/s\n",
+         total, error_responses, elapsed_ms / 1e3,
+         total / (elapsed_ms / 1e3));
+  // same format as the agent's metrics request, for direct comparison of
+  // the client-observed and agent-side numbers
+  char* metrics = agent_metrics_toJSON();
+  printf("%s\n", metrics != NULL ? metrics : "{}");
+  secFree(metrics);
+  return error_responses == total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+#define _XOPEN_SOURCE 700
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Mock OIDC provider for load testing.
+ *
+ * Serves several issuers on consecutive localhost ports, each with a
+ * distinct latency / error profile, so the agent's refresh and discovery
+ * flows (src/oidc-agent/oidc/flows/) can be exercised at fleet scale
+ * without a real provider. Per issuer it answers
+ *  - GET /.well-known/openid-configuration with a discovery document
+ *    pointing back at itself
+ *  - POST /token with a token response after the profile's latency plus
+ *    jitter, injecting 429 and 500 answers at the profile's rates
+ *
+ * Issued access tokens are JWT-shaped and carry a per-issuer keyed
+ * checksum as signature, so tokens are distinguishable per issuer and
+ * request; nothing in the agent verifies signatures, so no crypto
+ * dependency is pulled in for a real one.
+ *
+ * Builds standalone (no agent sources), so a broken tree still load-tests.
+ * On SIGINT/SIGTERM a per-issuer request/injection summary is printed.
+ *
+ * Usage: mock_provider [base_port] [issuers]
+ */
+
+#define DEFAULT_BASE_PORT 18470
+#define DEFAULT_ISSUERS 5
+#define MAX_ISSUERS 16
+#define REQUEST_BUF_SIZE 8192
+
+struct issuer_profile {
+  const char*  name;
+  unsigned int latency_ms;
+  unsigned int jitter_ms;
+  unsigned int err429_pct;
+  unsigned int err500_pct;
+};
+
+// five distinct shapes covering the production mix: a fast local issuer,
+// a regional one, a slow remote one, one that throttles and one that fails
+static const struct issuer_profile profiles[] = {
+    {"fast", 5, 2, 0, 0},         {"regional", 40, 15, 0, 0},
+    {"slow", 200, 80, 0, 0},      {"throttling", 30, 10, 10, 0},
+    {"flaky", 80, 40, 0, 10},
+};
+#define PROFILE_COUNT (sizeof(profiles) / sizeof(profiles[0]))
+
+struct issuer {
+  unsigned int                 index;
+  unsigned int                 port;
+  const struct issuer_profile* profile;
+  int                          listen_fd;
+  unsigned long                requests;
+  unsigned long                injected_429;
+  unsigned long                injected_500;
+};
+
+static struct issuer issuers[MAX_ISSUERS];
+static unsigned int  issuer_count = DEFAULT_ISSUERS;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void _stop(int sig) {
+  (void)sig;
+  stopping = 1;
+  for (unsigned int i = 0; i < issuer_count; i++) {
+    if (issuers[i].listen_fd >= 0) {  // wakes the accept loop
+      shutdown(issuers[i].listen_fd, SHUT_RDWR);
+    }
+  }
+}
+
+static void _sleep_ms(unsigned int ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+static void _base64url(const unsigned char* in, size_t len, char* out) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  size_t o = 0;
+  for (size_t i = 0; i < len; i += 3) {
+    unsigned int v = in[i] << 16;
+    if (i + 1 < len) {
+      v |= in[i + 1] << 8;
+    }
+    if (i + 2 < len) {
+      v |= in[i + 2];
+    }
+    out[o++] = alphabet[(v >> 18) & 0x3f];
+    out[o++] = alphabet[(v >> 12) & 0x3f];
+    if (i + 1 < len) {
+      out[o++] = alphabet[(v >> 6) & 0x3f];
+    }
+    if (i + 2 < len) {
+      out[o++] = alphabet[v & 0x3f];
+    }
+  }
+  out[o] = '\0';
+}
+
+/**
+ * @brief builds a JWT-shaped mock token into @p out
+ *
+ * The signature is an FNV-1a checksum of the signing input keyed with the
+ * issuer index - stable enough to tell tokens apart, no real crypto.
+ */
+static void _mock_jwt(const struct issuer* iss, unsigned long serial,
+                      char* out, size_t out_size) {
+  char header[64];
+  char payload[256];
+  snprintf(header, sizeof(header), "{\"alg\":\"HS256\",\"typ\":\"JWT\"}");
+  time_t now = time(NULL);
+  snprintf(payload, sizeof(payload),
+           "{\"iss\":\"http://127.0.0.1:%u/\",\"sub\":\"load\","
+           "\"iat\":%ld,\"exp\":%ld,\"jti\":\"%u-%lu\"}",
+           iss->port, (long)now, (long)now + 300, iss->index, serial);
+  char header_b64[96];
+  char payload_b64[384];
+  _base64url((const unsigned char*)header, strlen(header), header_b64);
+  _base64url((const unsigned char*)payload, strlen(payload), payload_b64);
+  unsigned long long hash = 1469598103934665603ULL ^ (iss->index * 1099511628211ULL);
+  for (const char* p = header_b64; *p; p++) {
+    hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+  }
+  for (const char* p = payload_b64; *p; p++) {
+    hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+  }
+  snprintf(out, out_size, "%s.%s.%016llx", header_b64, payload_b64, hash);
+}
+
+static void _send_response(int fd, int code, const char* status,
+                           const char* extra_headers, const char* body) {
+  char   head[512];
+  size_t body_len = strlen(body);
+  int    head_len =
+      snprintf(head, sizeof(head),
+               "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+               "Content-Length: %zu\r\nConnection: close\r\n%s\r\n",
+               code, status, body_len, extra_headers);
+  if (write(fd, head, head_len) < 0 || write(fd, body, body_len) < 0) {
+    // client went away; nothing to do
+  }
+}
+
+static void _serve_discovery(const struct issuer* iss, int fd) {
+  char body[1024];
+  snprintf(body, sizeof(body),
+           "{\"issuer\":\"http://127.0.0.1:%u/\","
+           "\"token_endpoint\":\"http://127.0.0.1:%u/token\","
+           "\"authorization_endpoint\":\"http://127.0.0.1:%u/auth\","
+           "\"revocation_endpoint\":\"http://127.0.0.1:%u/revoke\","
+           "\"device_authorization_endpoint\":\"http://127.0.0.1:%u/device\","
+           "\"registration_endpoint\":\"http://127.0.0.1:%u/register\","
+           "\"scopes_supported\":[\"openid\",\"profile\",\"offline_access\"],"
+           "\"grant_types_supported\":[\"refresh_token\","
+           "\"authorization_code\",\"urn:ietf:params:oauth:grant-type:device_"
+           "code\"],"
+           "\"response_types_supported\":[\"code\"],"
+           "\"code_challenge_methods_supported\":[\"S256\"]}",
+           iss->port, iss->port, iss->port, iss->port, iss->port, iss->port);
+  _send_response(fd, 200, "OK", "", body);
+}
+
+static void _serve_token(struct issuer* iss, int fd, unsigned int* seed) {
+  const struct issuer_profile* p = iss->profile;
+  unsigned int delay = p->latency_ms;
+  if (p->jitter_ms > 0) {
+    delay += rand_r(seed) % (p->jitter_ms + 1);
+  }
+  _sleep_ms(delay);
+  unsigned int roll = rand_r(seed) % 100;
+  if (roll < p->err429_pct) {
+    __atomic_add_fetch(&iss->injected_429, 1, __ATOMIC_RELAXED);
+    _send_response(fd, 429, "Too Many Requests", "Retry-After: 1\r\n",
+                   "{\"error\":\"rate_limited\"}");
+    return;
+  }
+  if (roll < p->err429_pct + p->err500_pct) {
+    __atomic_add_fetch(&iss->injected_500, 1, __ATOMIC_RELAXED);
+    _send_response(fd, 500, "Internal Server Error", "",
+                   "{\"error\":\"server_error\"}");
+    return;
+  }
+  unsigned long serial =
+      __atomic_add_fetch(&iss->requests, 1, __ATOMIC_RELAXED);
+  char jwt[768];
+  _mock_jwt(iss, serial, jwt, sizeof(jwt));
+  char body[1024];
+  snprintf(body, sizeof(body),
+           "{\"access_token\":\"%s\",\"token_type\":\"Bearer\","
+           "\"expires_in\":300,\"refresh_token\":\"mock-rt-%u-%lu\","
+           "\"scope\":\"openid profile offline_access\"}",
+           jwt, iss->index, serial);
+  _send_response(fd, 200, "OK", "", body);
+}
+
+struct connection {
+  struct issuer* issuer;
+  int            fd;
+};
+
+static void* _connection_main(void* arg) {
+  struct connection* conn = arg;
+  char               buf[REQUEST_BUF_SIZE];
+  size_t             have = 0;
+  // read until the header terminator; the token request body is small
+  // enough that whatever follows it is irrelevant for the mock
+  while (have < sizeof(buf) - 1) {
+    ssize_t n = read(conn->fd, buf + have, sizeof(buf) - 1 - have);
+    if (n <= 0) {
+      break;
+    }
+    have += n;
+    buf[have] = '\0';
+    if (strstr(buf, "\r\n\r\n") != NULL) {
+      break;
+    }
+  }
+  unsigned int seed = (unsigned int)(time(NULL) ^ (uintptr_t)conn ^ conn->fd);
+  if (strncmp(buf, "GET /.well-known/openid-configuration", 37) == 0) {
+    _serve_discovery(conn->issuer, conn->fd);
+  } else if (strncmp(buf, "POST /token", 11) == 0) {
+    _serve_token(conn->issuer, conn->fd, &seed);
+  } else if (have > 0) {
+    _send_response(conn->fd, 404, "Not Found", "", "{\"error\":\"not_found\"}");
+  }
+  close(conn->fd);
+  free(conn);
+  return NULL;
+}
+
+static void* _issuer_main(void* arg) {
+  struct issuer* iss = arg;
+  while (!stopping) {
+    int fd = accept(iss->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (stopping) {
+        break;
+      }
+      continue;
+    }
+    struct connection* conn = malloc(sizeof(struct connection));
+    if (conn == NULL) {
+      close(fd);
+      continue;
+    }
+    conn->issuer = iss;
+    conn->fd     = fd;
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, _connection_main, conn) != 0) {
+      close(fd);
+      free(conn);
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return NULL;
+}
+
+static int _listen_on(unsigned int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port   = htons(port)};
+  addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(fd, 128) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  unsigned int base_port = argc > 1 ? atoi(argv[1]) : DEFAULT_BASE_PORT;
+  issuer_count           = argc > 2 ? atoi(argv[2]) : DEFAULT_ISSUERS;
+  if (base_port == 0 || issuer_count == 0 || issuer_count > MAX_ISSUERS) {
+    fprintf(stderr, "Usage: %s [base_port] [issuers (<=%d)]\n", argv[0],
+            MAX_ISSUERS);
+    return EXIT_FAILURE;
+  }
+  signal(SIGINT, _stop);
+  signal(SIGTERM, _stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_t threads[MAX_ISSUERS];
+  for (unsigned int i = 0; i < issuer_count; i++) {
+    issuers[i].index     = i;
+    issuers[i].port      = base_port + i;
+    issuers[i].profile   = &profiles[i % PROFILE_COUNT];
+    issuers[i].listen_fd = _listen_on(issuers[i].port);
+    if (issuers[i].listen_fd < 0) {
+      fprintf(stderr, "could not listen on port %u\n", issuers[i].port);
+      return EXIT_FAILURE;
+    }
+    if (pthread_create(&threads[i], NULL, _issuer_main, &issuers[i]) != 0) {
+      fprintf(stderr, "could not create issuer thread\n");
+      return EXIT_FAILURE;
+    }
+    printf("issuer %u (%s): http://127.0.0.1:%u/  latency %ums±%ums  "
+           "429:%u%%  500:%u%%\n",
+           i, issuers[i].profile->name, issuers[i].port,
+           issuers[i].profile->latency_ms, issuers[i].profile->jitter_ms,
+           issuers[i].profile->err429_pct, issuers[i].profile->err500_pct);
+  }
+  fflush(stdout);
+  for (unsigned int i = 0; i < issuer_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (unsigned int i = 0; i < issuer_count; i++) {
+    close(issuers[i].listen_fd);
+    printf("issuer %u (%s): %lu token requests, %lu x 429, %lu x 500\n", i,
+           issuers[i].profile->name, issuers[i].requests,
+           issuers[i].injected_429, issuers[i].injected_500);
+  }
+  return EXIT_SUCCESS;
+}
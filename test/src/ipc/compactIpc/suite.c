@@ -0,0 +1,10 @@
+#include "suite.h"
+#include "tc_decode.h"
+#include "tc_encode.h"
+
+Suite* test_suite_compactIpc() {
+  Suite* ts_compactIpc = suite_create("compactIpc");
+  suite_add_tcase(ts_compactIpc, test_case_encode());
+  suite_add_tcase(ts_compactIpc, test_case_decode());
+  return ts_compactIpc;
+}
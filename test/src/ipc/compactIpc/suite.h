@@ -0,0 +1,8 @@
+#ifndef TEST_IPC_COMPACTIPC_SUITE_H
+#define TEST_IPC_COMPACTIPC_SUITE_H
+
+#include <check.h>
+
+Suite* test_suite_compactIpc();
+
+#endif  // TEST_IPC_COMPACTIPC_SUITE_H
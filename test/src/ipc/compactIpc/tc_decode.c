@@ -0,0 +1,101 @@
+#include "tc_decode.h"
+#include "ipc/compactIpc.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#include <string.h>
+
+START_TEST(test_notCompact) {
+  ck_assert_ptr_eq(compactIpc_decode("{\"request\":\"add\"}"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_repeatedEmptyTags) {
+  // 40 repetitions of an empty application_hint field; each one expands to
+  // a full ,"application_hint":"" in the json output, so this overflowed
+  // the decode buffer before duplicate tags were rejected
+  char   msg[1 + 40 * 2 + 1];
+  size_t len = 0;
+  msg[len++] = COMPACT_IPC_MAGIC;
+  for (int i = 0; i < 40; i++) {
+    msg[len++] = (char)(0x80 | 6);
+    msg[len++] = COMPACT_IPC_FIELD_END;
+  }
+  msg[len] = '\0';
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_duplicateTag) {
+  char msg[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 2), 'a',
+                COMPACT_IPC_FIELD_END, (char)(0x80 | 2), 'b',
+                COMPACT_IPC_FIELD_END, '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_unterminatedField) {
+  char msg[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 2), 'a', 'b', '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_unknownTag) {
+  char msg[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 0x70), 'a',
+                COMPACT_IPC_FIELD_END, '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_missingHighBit) {
+  char msg[] = {COMPACT_IPC_MAGIC, 'a', COMPACT_IPC_FIELD_END, '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_badNumber) {
+  char msg[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 4), '4', 'x', '2',
+                COMPACT_IPC_FIELD_END, '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  char empty[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 4), COMPACT_IPC_FIELD_END,
+                  '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(empty), NULL);
+}
+END_TEST
+
+START_TEST(test_controlByteInValue) {
+  char msg[] = {COMPACT_IPC_MAGIC, (char)(0x80 | 2), 'a', 0x01, 'b',
+                COMPACT_IPC_FIELD_END, '\0'};
+  ck_assert_ptr_eq(compactIpc_decode(msg), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECOMPACT);
+}
+END_TEST
+
+START_TEST(test_emptyMessage) {
+  char msg[] = {COMPACT_IPC_MAGIC, '\0'};
+  char* out  = compactIpc_decode(msg);
+  ck_assert_ptr_ne(out, NULL);
+  ck_assert_str_eq(out, "{}");
+  secFree(out);
+}
+END_TEST
+
+TCase* test_case_decode() {
+  TCase* tc_decode = tcase_create("decode");
+  tcase_add_test(tc_decode, test_notCompact);
+  tcase_add_test(tc_decode, test_repeatedEmptyTags);
+  tcase_add_test(tc_decode, test_duplicateTag);
+  tcase_add_test(tc_decode, test_unterminatedField);
+  tcase_add_test(tc_decode, test_unknownTag);
+  tcase_add_test(tc_decode, test_missingHighBit);
+  tcase_add_test(tc_decode, test_badNumber);
+  tcase_add_test(tc_decode, test_controlByteInValue);
+  tcase_add_test(tc_decode, test_emptyMessage);
+  return tc_decode;
+}
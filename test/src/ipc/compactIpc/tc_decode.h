@@ -0,0 +1,8 @@
+#ifndef TEST_IPC_COMPACTIPC_DECODE_H
+#define TEST_IPC_COMPACTIPC_DECODE_H
+
+#include <check.h>
+
+TCase* test_case_decode();
+
+#endif  // TEST_IPC_COMPACTIPC_DECODE_H
@@ -0,0 +1,71 @@
+#include "tc_encode.h"
+#include "ipc/compactIpc.h"
+#include "utils/memory.h"
+
+#include <string.h>
+
+START_TEST(test_roundtripStrings) {
+  const char* json = "{\"request\":\"add\",\"account\":\"short\"}";
+  char*       wire = compactIpc_encode(json);
+  ck_assert_ptr_ne(wire, NULL);
+  ck_assert(compactIpc_isCompact(wire));
+  char* back = compactIpc_decode(wire);
+  ck_assert_ptr_ne(back, NULL);
+  ck_assert_str_eq(back, json);
+  secFree(wire);
+  secFree(back);
+}
+END_TEST
+
+START_TEST(test_roundtripNumber) {
+  const char* json = "{\"request\":\"access_token\",\"min_valid_period\":42}";
+  char*       wire = compactIpc_encode(json);
+  ck_assert_ptr_ne(wire, NULL);
+  char* back = compactIpc_decode(wire);
+  ck_assert_ptr_ne(back, NULL);
+  ck_assert_str_eq(back, json);
+  secFree(wire);
+  secFree(back);
+}
+END_TEST
+
+START_TEST(test_roundtripEscaping) {
+  const char* json = "{\"account\":\"a\\\"b\\\\c\"}";
+  char*       wire = compactIpc_encode(json);
+  ck_assert_ptr_ne(wire, NULL);
+  char* back = compactIpc_decode(wire);
+  ck_assert_ptr_ne(back, NULL);
+  ck_assert_str_eq(back, json);
+  secFree(wire);
+  secFree(back);
+}
+END_TEST
+
+START_TEST(test_fallbackUnknownKey) {
+  char* wire = compactIpc_encode("{\"no_such_key\":\"value\"}");
+  ck_assert_ptr_eq(wire, NULL);
+}
+END_TEST
+
+START_TEST(test_fallbackControlByte) {
+  char* wire = compactIpc_encode("{\"account\":\"line\\nbreak\"}");
+  ck_assert_ptr_eq(wire, NULL);
+}
+END_TEST
+
+START_TEST(test_fallbackNested) {
+  char* wire = compactIpc_encode("{\"account\":{\"inner\":1}}");
+  ck_assert_ptr_eq(wire, NULL);
+}
+END_TEST
+
+TCase* test_case_encode() {
+  TCase* tc_encode = tcase_create("encode");
+  tcase_add_test(tc_encode, test_roundtripStrings);
+  tcase_add_test(tc_encode, test_roundtripNumber);
+  tcase_add_test(tc_encode, test_roundtripEscaping);
+  tcase_add_test(tc_encode, test_fallbackUnknownKey);
+  tcase_add_test(tc_encode, test_fallbackControlByte);
+  tcase_add_test(tc_encode, test_fallbackNested);
+  return tc_encode;
+}
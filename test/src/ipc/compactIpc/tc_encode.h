@@ -0,0 +1,8 @@
+#ifndef TEST_IPC_COMPACTIPC_ENCODE_H
+#define TEST_IPC_COMPACTIPC_ENCODE_H
+
+#include <check.h>
+
+TCase* test_case_encode();
+
+#endif  // TEST_IPC_COMPACTIPC_ENCODE_H
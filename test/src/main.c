@@ -1,4 +1,5 @@
 #include "test/src/account/account/suite.h"
+#include "test/src/ipc/compactIpc/suite.h"
 #include "test/src/utils/crypt/memoryCrypt/suite.h"
 #include "test/src/utils/json/suite.h"
 #include "test/src/utils/portUtils/suite.h"
@@ -27,6 +28,7 @@ int main() {
   number_failed |= runSuite(test_suite_memoryCrypt());
   number_failed |= runSuite(test_suite_account());
   number_failed |= runSuite(test_suite_uriUtils());
+  number_failed |= runSuite(test_suite_compactIpc());
   // TODO
   return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }